@@ -0,0 +1,120 @@
+/**
+ * @file        kp_app_decoder.h
+ * @brief       APP detection head decoder for YOLOX, FCOS and YOLOv7-pose
+ *
+ * A decoder turns the floating-point output nodes of a detection model into boxes (and keypoints) on the image:
+ *
+ *   output nodes -> candidates of each grid cell (sigmoid + score threshold) -> NMS -> boxes on the original image
+ *
+ * Each head type is a plugin which only scans grid cells into candidates, NMS and coordinate mapping are shared.
+ * Raw values are compared to the threshold in logit domain first, so sigmoid is computed only for cells which may pass.
+ * Grid cell positions of every level are kept from the last call and built again only if the model input size changes.
+ *
+ * Order of output nodes given to kp_app_decoder_run(), levels from the largest grid (smallest stride) to the smallest:
+ *   - KP_APP_DECODER_HEAD_YOLOX:        reg(4), obj(1), cls(C) of level 0, then of level 1, ...
+ *   - KP_APP_DECODER_HEAD_FCOS:         reg(4) of all levels, then cls(C) of all levels, then centerness(1) of all levels
+ *   - KP_APP_DECODER_HEAD_YOLOV7_POSE:  one node per level of 3 anchors x (x, y, w, h, obj, C classes, K x (x, y, conf))
+ *
+ * @version     0.1
+ * @date        2024-06-10
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kp_struct.h"
+
+#define KP_APP_DECODER_LEVEL_MAX            5       /**< maximum number of feature levels */
+#define KP_APP_DECODER_ANCHOR_NUM           3       /**< anchors per grid cell of anchor based heads */
+
+/**
+ * @brief a handle of a detection head decoder.
+ */
+typedef struct kp_app_decoder_s *kp_app_decoder_t;
+
+/**
+ * @brief detection head types
+ */
+typedef enum
+{
+    KP_APP_DECODER_HEAD_YOLOX = 0,                  /**< anchor free, exp() box size, score = obj x cls */
+    KP_APP_DECODER_HEAD_FCOS,                       /**< anchor free, ltrb distances, score = sqrt(cls x centerness) */
+    KP_APP_DECODER_HEAD_YOLOV7_POSE,                /**< 3 anchors per cell, score = obj x cls, with keypoints */
+    KP_APP_DECODER_HEAD_MAX,
+} kp_app_decoder_head_t;
+
+/**
+ * @brief decoder configuration, zero values take the defaults of the head.
+ */
+typedef struct
+{
+    kp_app_decoder_head_t head;                         /**< head type of the model */
+    kp_channel_ordering_t channel_ordering;             /**< ordering the nodes are retrieved with by kp_generic_inference_retrieve_float_node() */
+    float score_thresh;                                 /**< minimum box score, 0 for default (YOLOX 0.3, FCOS 0.5, YOLOv7-pose 0.25) */
+    float nms_thresh;                                   /**< IoU threshold of NMS, 0 for default (YOLOX 0.5, FCOS 0.35, YOLOv7-pose 0.45) */
+    uint32_t max_detection_per_class;                   /**< maximum boxes kept by NMS per class, 0 for default (100) */
+    bool class_agnostic_nms;                            /**< true to suppress boxes of different classes too */
+    uint32_t num_keypoint;                              /**< keypoints per box of YOLOv7-pose, 0 for default (17) */
+    uint32_t strides[KP_APP_DECODER_LEVEL_MAX];         /**< stride of each level, 0 to take it from the model input size and the grid size (8, 16, 32, ... without pre_proc_info) */
+    float anchors[KP_APP_DECODER_LEVEL_MAX][KP_APP_DECODER_ANCHOR_NUM][2]; /**< anchor width and height of YOLOv7-pose, all 0 for the YOLOv7 defaults */
+} kp_app_decoder_config_t;
+
+/**
+ * @brief describe a keypoint
+ */
+typedef struct
+{
+    float x;                                /**< x on the image */
+    float y;                                /**< y on the image */
+    float score;                            /**< visibility score */
+} kp_app_keypoint_t;
+
+/**
+ * @brief Create a detection head decoder.
+ *
+ * @param[in] config refer to kp_app_decoder_config_t.
+ * @param[out] error_code refer to KP_API_RETURN_CODE in kp_struct.h, it can be NULL.
+ *
+ * @return the decoder handle, NULL if failed.
+ */
+kp_app_decoder_t kp_app_decoder_create(kp_app_decoder_config_t *config, int *error_code);
+
+/**
+ * @brief Get the number of keypoints per box, 0 for heads without keypoints.
+ *
+ * @param[in] decoder the decoder handle.
+ *
+ * @return number of keypoints.
+ */
+uint32_t kp_app_decoder_get_keypoint_count(kp_app_decoder_t decoder);
+
+/**
+ * @brief Decode output nodes of one inference into boxes.
+ *
+ * The handle can not be used by two threads at the same time, create one handle per thread if needed.
+ * No memory is allocated once the buffers are large enough for the model.
+ *
+ * @param[in] decoder the decoder handle.
+ * @param[in] node_output floating-point output nodes from kp_generic_inference_retrieve_float_node(), in the order of the head (refer to the top of this file).
+ * @param[in] num_output_node number of output nodes.
+ * @param[in] pre_proc_info hardware pre-process info of the image to map boxes back to the image, NULL to keep boxes in model input coordinates.
+ * @param[out] result boxes on the image, sorted by class and then by score.
+ * @param[out] keypoints keypoints of box i are keypoints[i * K] to keypoints[i * K + K - 1], K refers to kp_app_decoder_get_keypoint_count(), it can be NULL if K is 0.
+ * @param[in] max_keypoint_count size of the 'keypoints' array, boxes are dropped if their keypoints do not fit.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h, KP_ERROR_INVALID_MODEL_21 if the nodes do not match the head.
+ */
+int kp_app_decoder_run(kp_app_decoder_t decoder, kp_inf_float_node_output_t *node_output[], uint32_t num_output_node,
+                       kp_hw_pre_proc_info_t *pre_proc_info, kp_yolo_result_t *result,
+                       kp_app_keypoint_t *keypoints, uint32_t max_keypoint_count);
+
+/**
+ * @brief Free the decoder.
+ *
+ * @param[in] decoder the decoder handle.
+ */
+void kp_app_decoder_destroy(kp_app_decoder_t decoder);
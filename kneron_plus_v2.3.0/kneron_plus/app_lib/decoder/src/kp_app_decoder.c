@@ -0,0 +1,790 @@
+/**
+ * @file        kp_app_decoder.c
+ * @brief       detection head decoder functions
+ * @version     0.1
+ * @date        2024-06-10
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "kp_app_decoder.h"
+#include "post_process_helper.h"
+
+#define DEFAULT_MAX_DETECTION_PER_CLASS     100
+#define DEFAULT_NUM_KEYPOINT                17      // COCO person keypoints
+#define INITIAL_CANDIDATES                  1000    // initial capacity of candidate boxes, it grows if more are found
+#define MAX_NODES_PER_LEVEL                 3
+
+typedef struct
+{
+    const float *data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channel;
+    size_t row_stride;                      // distance of (row, ch, col) to (row + 1, ch, col)
+    size_t ch_stride;
+    size_t col_stride;
+} node_view_t;
+
+typedef struct
+{
+    uint32_t grid_w;
+    uint32_t grid_h;
+    float stride;
+    float *grid_x;                          // cell position of each column in model input coordinates
+    float *grid_y;                          // cell position of each row
+} level_t;
+
+typedef struct
+{
+    kp_bounding_box_t box;
+    uint32_t index;                         // scanning order, keypoints start at index x K
+} candidate_t;
+
+/**
+ * A head plugin checks the node shapes and scans the cells of one level into candidates.
+ * Cell positions are (col + grid_offset) x stride, prepared once per model input size.
+ */
+typedef struct
+{
+    uint32_t nodes_per_level;
+    bool role_major;                        // nodes are grouped by role (role 0 of all levels first), else by level
+    float score_thresh;
+    float nms_thresh;
+    float grid_offset;
+    int (*check)(kp_app_decoder_t decoder, node_view_t views[][MAX_NODES_PER_LEVEL], uint32_t num_level);
+    void (*scan)(kp_app_decoder_t decoder, uint32_t level, const node_view_t *nodes);
+} head_plugin_t;
+
+struct kp_app_decoder_s
+{
+    kp_app_decoder_config_t config;
+    const head_plugin_t *plugin;
+    uint32_t class_count;
+    uint32_t num_keypoint;                  // keypoints per box, 0 for heads without keypoints
+    float score_logit;                      // lower bound of the logit of 'score_thresh'
+    bool default_anchors;                   // no anchors are given by the config
+
+    // grid cache of the last model input size
+    uint32_t num_level;
+    uint32_t cache_input_w;
+    uint32_t cache_input_h;
+    level_t levels[KP_APP_DECODER_LEVEL_MAX];
+    float *grid_buf;
+    int grid_capacity;
+
+    // candidates of all classes in scanning order
+    candidate_t *candidates;
+    int candidate_capacity;
+    int num_candidate;
+    bool candidate_dropped;                 // set if candidates were dropped because the buffer could not grow
+    float *candidate_kpts;                  // x, y, score of the keypoints of each candidate
+    int kpt_capacity;
+
+    candidate_t *class_boxes;               // candidates grouped by class (bucket of class i starts at class_start[i])
+    int class_box_capacity;
+    int *class_start;
+    int class_capacity;
+
+    float *column_max;                      // maximum class value of each grid column of a row
+    int column_capacity;
+
+    post_process_kept_boxes_t kept;         // boxes kept by NMS of the current class
+};
+
+static const float yolov7_anchors[2][4][KP_APP_DECODER_ANCHOR_NUM][2] = {
+    // P3 - P5 (tiny models)
+    {{{12, 16}, {19, 36}, {40, 28}},
+     {{36, 75}, {76, 55}, {72, 146}},
+     {{142, 110}, {192, 243}, {459, 401}},
+     {{0, 0}, {0, 0}, {0, 0}}},
+    // P3 - P6 (w6 models)
+    {{{19, 27}, {44, 40}, {38, 94}},
+     {{96, 68}, {86, 152}, {180, 137}},
+     {{140, 301}, {303, 264}, {238, 542}},
+     {{436, 615}, {739, 380}, {925, 792}}}};
+
+/******************************************************************
+ * buffers
+ ******************************************************************/
+
+static float *add_candidate(kp_app_decoder_t decoder, float x1, float y1, float x2, float y2, float score, int class_num)
+{
+    int num = decoder->num_candidate;
+    int num_kpt_value = (int)decoder->num_keypoint * 3;
+
+    if ((0 != post_process_buf_reserve((void **)&decoder->candidates, &decoder->candidate_capacity, num + 1, sizeof(candidate_t))) ||
+        ((0 < num_kpt_value) && (0 != post_process_buf_reserve((void **)&decoder->candidate_kpts, &decoder->kpt_capacity, (num + 1) * num_kpt_value, sizeof(float))))) {
+        if (!decoder->candidate_dropped)
+            printf("app decoder: warning ! out of memory for %d candidate boxes, the rest are dropped\n", num);
+
+        decoder->candidate_dropped = true;
+        return NULL;
+    }
+
+    candidate_t *candidate = &decoder->candidates[decoder->num_candidate++];
+
+    candidate->box.x1 = x1;
+    candidate->box.y1 = y1;
+    candidate->box.x2 = x2;
+    candidate->box.y2 = y2;
+    candidate->box.score = score;
+    candidate->box.class_num = class_num;
+    candidate->index = num;
+
+    return (0 < num_kpt_value) ? &decoder->candidate_kpts[num * num_kpt_value] : NULL;
+}
+
+/******************************************************************
+ * cell scanning helpers
+ ******************************************************************/
+
+static inline float sigmoid(float x)
+{
+    return 1.0f / (1.0f + expf(-x));
+}
+
+static inline const float *node_at(const node_view_t *node, uint32_t row, uint32_t ch)
+{
+    return node->data + row * node->row_stride + ch * node->ch_stride;
+}
+
+static bool row_any_above(const node_view_t *node, uint32_t row, uint32_t ch, float thresh)
+{
+    const float *p = node_at(node, row, ch);
+
+    for (uint32_t col = 0; col < node->width; col++) {
+        if (p[col * node->col_stride] >= thresh)
+            return true;
+    }
+
+    return false;
+}
+
+// maximum of channels [ch, ch + num_ch) of each column of a row into decoder->column_max
+static void class_column_max(kp_app_decoder_t decoder, const node_view_t *node, uint32_t row, uint32_t ch, uint32_t num_ch)
+{
+    float *dst = decoder->column_max;
+    uint32_t width = node->width;
+
+    if (1 == node->col_stride)
+    {
+        memcpy(dst, node_at(node, row, ch), width * sizeof(float));
+
+        for (uint32_t c = 1; c < num_ch; c++)
+            post_process_column_max(dst, node_at(node, row, ch + c), width);
+    }
+    else
+    {
+        for (uint32_t col = 0; col < width; col++)
+        {
+            const float *p = node_at(node, row, ch) + col * node->col_stride;
+            float max_value = p[0];
+
+            for (uint32_t c = 1; c < num_ch; c++)
+                max_value = (p[c * node->ch_stride] > max_value) ? p[c * node->ch_stride] : max_value;
+
+            dst[col] = max_value;
+        }
+    }
+}
+
+// first channel of [ch, ch + num_ch) with the maximum value at a cell
+static int class_argmax(const node_view_t *node, uint32_t row, uint32_t col, uint32_t ch, uint32_t num_ch)
+{
+    const float *p = node_at(node, row, ch) + col * node->col_stride;
+    int best = 0;
+
+    for (uint32_t c = 1; c < num_ch; c++) {
+        if (p[c * node->ch_stride] > p[best * node->ch_stride])
+            best = c;
+    }
+
+    return best;
+}
+
+/******************************************************************
+ * YOLOX: reg(4), obj(1), cls(C) per level
+ ******************************************************************/
+
+static int check_yolox(kp_app_decoder_t decoder, node_view_t views[][MAX_NODES_PER_LEVEL], uint32_t num_level)
+{
+    decoder->class_count = views[0][2].channel;
+
+    for (uint32_t l = 0; l < num_level; l++)
+    {
+        node_view_t *reg = &views[l][0], *obj = &views[l][1], *cls = &views[l][2];
+
+        if ((4 != reg->channel) || (1 != obj->channel) || (decoder->class_count != cls->channel) ||
+            (reg->width != cls->width) || (reg->height != cls->height) || (obj->width != cls->width) || (obj->height != cls->height))
+            return KP_ERROR_INVALID_MODEL_21;
+    }
+
+    return KP_SUCCESS;
+}
+
+static void scan_yolox(kp_app_decoder_t decoder, uint32_t level, const node_view_t *nodes)
+{
+    const node_view_t *reg = &nodes[0], *obj = &nodes[1], *cls = &nodes[2];
+    const level_t *lv = &decoder->levels[level];
+    float thresh = decoder->config.score_thresh;
+
+    for (uint32_t row = 0; row < lv->grid_h; row++)
+    {
+        // score = sigmoid(obj) * sigmoid(cls) <= sigmoid(obj), most rows are skipped here without sigmoid
+        if (!row_any_above(obj, row, 0, decoder->score_logit))
+            continue;
+
+        const float *obj_p = node_at(obj, row, 0);
+
+        class_column_max(decoder, cls, row, 0, decoder->class_count);
+
+        for (uint32_t col = 0; col < lv->grid_w; col++)
+        {
+            float obj_value = obj_p[col * obj->col_stride];
+
+            if (obj_value < decoder->score_logit)
+                continue;
+
+            float obj_score = sigmoid(obj_value);
+
+            if (decoder->column_max[col] < post_process_logit_lower_bound(thresh / obj_score))
+                continue;
+
+            float score = obj_score * sigmoid(decoder->column_max[col]);
+            if (score < thresh)
+                continue;
+
+            const float *reg_p = node_at(reg, row, 0) + col * reg->col_stride;
+            float cx = reg_p[0] * lv->stride + lv->grid_x[col];
+            float cy = reg_p[reg->ch_stride] * lv->stride + lv->grid_y[row];
+            float w = expf(reg_p[2 * reg->ch_stride]) * lv->stride;
+            float h = expf(reg_p[3 * reg->ch_stride]) * lv->stride;
+
+            add_candidate(decoder, cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2, score,
+                          class_argmax(cls, row, col, 0, decoder->class_count));
+        }
+    }
+}
+
+/******************************************************************
+ * FCOS: reg(4), cls(C), centerness(1) per level
+ ******************************************************************/
+
+static int check_fcos(kp_app_decoder_t decoder, node_view_t views[][MAX_NODES_PER_LEVEL], uint32_t num_level)
+{
+    decoder->class_count = views[0][1].channel;
+
+    for (uint32_t l = 0; l < num_level; l++)
+    {
+        node_view_t *reg = &views[l][0], *cls = &views[l][1], *ctr = &views[l][2];
+
+        if ((4 != reg->channel) || (decoder->class_count != cls->channel) || (1 != ctr->channel) ||
+            (reg->width != cls->width) || (reg->height != cls->height) || (ctr->width != cls->width) || (ctr->height != cls->height))
+            return KP_ERROR_INVALID_MODEL_21;
+    }
+
+    return KP_SUCCESS;
+}
+
+static void scan_fcos(kp_app_decoder_t decoder, uint32_t level, const node_view_t *nodes)
+{
+    const node_view_t *reg = &nodes[0], *cls = &nodes[1], *ctr = &nodes[2];
+    const level_t *lv = &decoder->levels[level];
+    float thresh = decoder->config.score_thresh;
+    float reg_scale = (float)(8 << level); // the model is trained with distances of 2^(3 + level) x reg^2
+
+    // score = sqrt(sigmoid(cls) * sigmoid(ctr)) > thresh needs sigmoid(cls) > thresh^2
+    float cls_logit = post_process_logit_lower_bound(thresh * thresh);
+
+    for (uint32_t row = 0; row < lv->grid_h; row++)
+    {
+        const float *ctr_p = node_at(ctr, row, 0);
+
+        class_column_max(decoder, cls, row, 0, decoder->class_count);
+
+        for (uint32_t col = 0; col < lv->grid_w; col++)
+        {
+            if (decoder->column_max[col] < cls_logit)
+                continue;
+
+            float score = sqrtf(sigmoid(decoder->column_max[col]) * sigmoid(ctr_p[col * ctr->col_stride]));
+            if (!(score > thresh))
+                continue;
+
+            const float *reg_p = node_at(reg, row, 0) + col * reg->col_stride;
+            float dist[4];
+
+            for (int i = 0; i < 4; i++)
+            {
+                float v = reg_p[i * reg->ch_stride];
+                dist[i] = (v < 0) ? 0 : reg_scale * v * v;
+            }
+
+            float cx = lv->grid_x[col];
+            float cy = lv->grid_y[row];
+
+            add_candidate(decoder, cx - dist[0], cy - dist[1], cx + dist[2], cy + dist[3], score,
+                          class_argmax(cls, row, col, 0, decoder->class_count));
+        }
+    }
+}
+
+/******************************************************************
+ * YOLOv7-pose: 3 anchors x (x, y, w, h, obj, C classes, K keypoints) per level
+ ******************************************************************/
+
+static int check_yolov7_pose(kp_app_decoder_t decoder, node_view_t views[][MAX_NODES_PER_LEVEL], uint32_t num_level)
+{
+    uint32_t anchor_ch = views[0][0].channel / KP_APP_DECODER_ANCHOR_NUM;
+    uint32_t fixed_ch = 5 + 3 * decoder->num_keypoint;
+
+    if ((4 < num_level) || (anchor_ch <= fixed_ch))
+        return KP_ERROR_INVALID_MODEL_21;
+
+    decoder->class_count = anchor_ch - fixed_ch;
+
+    for (uint32_t l = 0; l < num_level; l++) {
+        if (views[l][0].channel != anchor_ch * KP_APP_DECODER_ANCHOR_NUM)
+            return KP_ERROR_INVALID_MODEL_21;
+    }
+
+    return KP_SUCCESS;
+}
+
+static void scan_yolov7_pose(kp_app_decoder_t decoder, uint32_t level, const node_view_t *nodes)
+{
+    const node_view_t *node = &nodes[0];
+    const level_t *lv = &decoder->levels[level];
+    float thresh = decoder->config.score_thresh;
+    uint32_t class_count = decoder->class_count;
+    uint32_t num_keypoint = decoder->num_keypoint;
+    uint32_t anchor_ch = node->channel / KP_APP_DECODER_ANCHOR_NUM;
+
+    for (uint32_t an = 0; an < KP_APP_DECODER_ANCHOR_NUM; an++)
+    {
+        uint32_t base = an * anchor_ch;
+        const float *anchor = decoder->default_anchors ? yolov7_anchors[(4 == decoder->num_level) ? 1 : 0][level][an] : decoder->config.anchors[level][an];
+
+        for (uint32_t row = 0; row < lv->grid_h; row++)
+        {
+            if (!row_any_above(node, row, base + 4, decoder->score_logit))
+                continue;
+
+            const float *obj_p = node_at(node, row, base + 4);
+
+            class_column_max(decoder, node, row, base + 5, class_count);
+
+            for (uint32_t col = 0; col < lv->grid_w; col++)
+            {
+                float obj_value = obj_p[col * node->col_stride];
+
+                if (obj_value < decoder->score_logit)
+                    continue;
+
+                float obj_score = sigmoid(obj_value);
+
+                if (decoder->column_max[col] < post_process_logit_lower_bound(thresh / obj_score))
+                    continue;
+
+                float score = obj_score * sigmoid(decoder->column_max[col]);
+                if (score < thresh)
+                    continue;
+
+                // x = (2 * sigmoid(tx) - 0.5 + col) * stride, w = (2 * sigmoid(tw))^2 * anchor
+                const float *p = node_at(node, row, base) + col * node->col_stride;
+                size_t cs = node->ch_stride;
+                float cx = 2 * sigmoid(p[0]) * lv->stride + lv->grid_x[col];
+                float cy = 2 * sigmoid(p[cs]) * lv->stride + lv->grid_y[row];
+                float w = 2 * sigmoid(p[2 * cs]);
+                float h = 2 * sigmoid(p[3 * cs]);
+
+                w = w * w * anchor[0];
+                h = h * h * anchor[1];
+
+                float *kpts = add_candidate(decoder, cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2, score,
+                                            class_argmax(node, row, col, base + 5, class_count));
+                if (NULL == kpts)
+                    continue;
+
+                // keypoint x = (2 * kx - 0.5 + col) * stride without sigmoid
+                const float *kp = p + (5 + class_count) * cs;
+
+                for (uint32_t k = 0; k < num_keypoint; k++)
+                {
+                    kpts[3 * k + 0] = 2 * kp[(3 * k + 0) * cs] * lv->stride + lv->grid_x[col];
+                    kpts[3 * k + 1] = 2 * kp[(3 * k + 1) * cs] * lv->stride + lv->grid_y[row];
+                    kpts[3 * k + 2] = sigmoid(kp[(3 * k + 2) * cs]);
+                }
+            }
+        }
+    }
+}
+
+static const head_plugin_t head_plugins[KP_APP_DECODER_HEAD_MAX] = {
+    [KP_APP_DECODER_HEAD_YOLOX] = {3, false, 0.3f, 0.5f, 0.0f, check_yolox, scan_yolox},
+    [KP_APP_DECODER_HEAD_FCOS] = {3, true, 0.5f, 0.35f, 0.5f, check_fcos, scan_fcos},
+    [KP_APP_DECODER_HEAD_YOLOV7_POSE] = {1, false, 0.25f, 0.45f, -0.5f, check_yolov7_pose, scan_yolov7_pose},
+};
+
+/******************************************************************
+ * grid cache
+ ******************************************************************/
+
+static node_view_t make_view(kp_inf_float_node_output_t *node, kp_channel_ordering_t ordering)
+{
+    node_view_t view = {node->data, node->width, node->height, node->channel, 0, 0, 0};
+
+    if (KP_CHANNEL_ORDERING_CHW == ordering)
+    {
+        view.row_stride = node->width;
+        view.ch_stride = (size_t)node->height * node->width;
+        view.col_stride = 1;
+    }
+    else if (KP_CHANNEL_ORDERING_HWC == ordering)
+    {
+        view.row_stride = (size_t)node->width * node->channel;
+        view.ch_stride = 1;
+        view.col_stride = node->channel;
+    }
+    else
+    {
+        view.row_stride = (size_t)node->channel * node->width;
+        view.ch_stride = node->width;
+        view.col_stride = 1;
+    }
+
+    return view;
+}
+
+static int prepare_levels(kp_app_decoder_t decoder, node_view_t views[][MAX_NODES_PER_LEVEL], uint32_t num_level,
+                          kp_hw_pre_proc_info_t *pre_proc_info)
+{
+    uint32_t input_w = (NULL != pre_proc_info) ? pre_proc_info->model_input_width : 0;
+    uint32_t input_h = (NULL != pre_proc_info) ? pre_proc_info->model_input_height : 0;
+    bool same = (num_level == decoder->num_level) && (input_w == decoder->cache_input_w) && (input_h == decoder->cache_input_h);
+    int num_grid_value = 0;
+    int max_grid_w = 0;
+
+    for (uint32_t l = 0; l < num_level; l++)
+    {
+        same = same && (views[l][0].width == decoder->levels[l].grid_w) && (views[l][0].height == decoder->levels[l].grid_h);
+        num_grid_value += views[l][0].width + views[l][0].height;
+        max_grid_w = ((int)views[l][0].width > max_grid_w) ? (int)views[l][0].width : max_grid_w;
+    }
+
+    if (same)
+        return KP_SUCCESS;
+
+    if ((0 != post_process_buf_reserve((void **)&decoder->grid_buf, &decoder->grid_capacity, num_grid_value, sizeof(float))) ||
+        (0 != post_process_buf_reserve((void **)&decoder->column_max, &decoder->column_capacity, max_grid_w, sizeof(float)))) {
+        decoder->num_level = 0;
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+    }
+
+    float *grid = decoder->grid_buf;
+
+    for (uint32_t l = 0; l < num_level; l++)
+    {
+        level_t *lv = &decoder->levels[l];
+        uint32_t stride = decoder->config.strides[l];
+
+        lv->grid_w = views[l][0].width;
+        lv->grid_h = views[l][0].height;
+
+        // the nearest power of 2 of the input / grid ratio, the same as the Python examples
+        if ((0 == stride) && (0 < input_h))
+            stride = 1u << (int)(log2((double)input_h / lv->grid_h) + 0.5);
+        else if (0 == stride)
+            stride = 8u << l;
+
+        lv->stride = (float)stride;
+        lv->grid_x = grid;
+        grid += lv->grid_w;
+        lv->grid_y = grid;
+        grid += lv->grid_h;
+
+        for (uint32_t col = 0; col < lv->grid_w; col++)
+            lv->grid_x[col] = (col + decoder->plugin->grid_offset) * lv->stride;
+
+        for (uint32_t row = 0; row < lv->grid_h; row++)
+            lv->grid_y[row] = (row + decoder->plugin->grid_offset) * lv->stride;
+    }
+
+    decoder->num_level = num_level;
+    decoder->cache_input_w = input_w;
+    decoder->cache_input_h = input_h;
+
+    return KP_SUCCESS;
+}
+
+/******************************************************************
+ * NMS
+ ******************************************************************/
+
+static int candidate_comparator(const void *candidate_1, const void *candidate_2)
+{
+    const candidate_t *_candidate_1 = (const candidate_t *)candidate_1;
+    const candidate_t *_candidate_2 = (const candidate_t *)candidate_2;
+
+    if (_candidate_1->box.score != _candidate_2->box.score)
+        return (_candidate_1->box.score > _candidate_2->box.score) ? -1 : 1;
+
+    return (_candidate_1->index < _candidate_2->index) ? -1 : ((_candidate_1->index > _candidate_2->index) ? 1 : 0);
+}
+
+/**
+ * Candidates are grouped by class with a counting sort (one group if class agnostic), each group is sorted by score,
+ * then a box is kept if it does not overlap any kept box of its group.
+ * Only kept boxes are compared and a group stops at 'max_detection_per_class' kept boxes.
+ */
+static void nms_to_result(kp_app_decoder_t decoder, kp_yolo_result_t *result, kp_app_keypoint_t *keypoints, uint32_t max_keypoint_count)
+{
+    int num_group = decoder->config.class_agnostic_nms ? 1 : (int)decoder->class_count;
+    int num_candidate = decoder->num_candidate;
+    int *group_start;
+    uint32_t num_keypoint = decoder->num_keypoint;
+    uint32_t good_result_count = 0;
+
+    if ((0 != post_process_buf_reserve((void **)&decoder->class_boxes, &decoder->class_box_capacity, num_candidate, sizeof(candidate_t))) ||
+        (0 != post_process_buf_reserve((void **)&decoder->class_start, &decoder->class_capacity, num_group + 1, sizeof(int)))) {
+        printf("app decoder: error ! out of memory for %d candidate boxes\n", num_candidate);
+        num_candidate = 0;
+        num_group = 0;
+    }
+
+    group_start = decoder->class_start;
+
+    if (0 < num_group)
+    {
+        memset(group_start, 0, (num_group + 1) * sizeof(int));
+
+        for (int i = 0; i < num_candidate; i++)
+            group_start[((1 == num_group) ? 0 : decoder->candidates[i].box.class_num) + 1]++;
+
+        for (int i = 0; i < num_group; i++)
+            group_start[i + 1] += group_start[i];
+
+        for (int i = 0; i < num_candidate; i++)
+            decoder->class_boxes[group_start[(1 == num_group) ? 0 : decoder->candidates[i].box.class_num]++] = decoder->candidates[i];
+
+        // group_start[i] is the end of group i now
+        for (int i = num_group; i > 0; i--)
+            group_start[i] = group_start[i - 1];
+        group_start[0] = 0;
+    }
+
+    for (int g = 0; (g < num_group) && (good_result_count < YOLO_GOOD_BOX_MAX); g++)
+    {
+        candidate_t *candidates = &decoder->class_boxes[group_start[g]];
+        int count = group_start[g + 1] - group_start[g];
+
+        decoder->kept.count = 0;
+
+        qsort(candidates, count, sizeof(candidate_t), candidate_comparator);
+
+        for (int j = 0; j < count; j++)
+        {
+            kp_bounding_box_t *box = &candidates[j].box;
+
+            if (post_process_is_suppressed(&decoder->kept, box, decoder->config.nms_thresh))
+                continue;
+
+            // a box is given only with all of its keypoints
+            if ((0 < num_keypoint) && ((NULL == keypoints) || ((good_result_count + 1) * num_keypoint > max_keypoint_count)))
+                break;
+
+            post_process_kept_boxes_add(&decoder->kept, box);
+
+            result->boxes[good_result_count] = *box;
+
+            if (0 < num_keypoint)
+                memcpy(&keypoints[good_result_count * num_keypoint], &decoder->candidate_kpts[candidates[j].index * num_keypoint * 3],
+                       num_keypoint * sizeof(kp_app_keypoint_t));
+
+            good_result_count++;
+
+            if ((decoder->config.max_detection_per_class == (uint32_t)decoder->kept.count) || (good_result_count >= YOLO_GOOD_BOX_MAX))
+                break;
+        }
+    }
+
+    result->box_count = good_result_count;
+    result->class_count = decoder->class_count;
+}
+
+// map boxes and keypoints from model input to the original image, boxes are rounded like the other post-process functions
+static void scale_to_image(kp_app_decoder_t decoder, kp_yolo_result_t *result, kp_app_keypoint_t *keypoints, kp_hw_pre_proc_info_t *pre_proc_info)
+{
+    int img_width = pre_proc_info->img_width;
+    int img_height = pre_proc_info->img_height;
+    float pad_left = pre_proc_info->pad_left;
+    float pad_top = pre_proc_info->pad_top;
+    float ratio_w = (float)img_width / pre_proc_info->resized_img_width;
+    float ratio_h = (float)img_height / pre_proc_info->resized_img_height;
+
+    for (uint32_t i = 0; i < result->box_count; i++)
+    {
+        kp_bounding_box_t *box = &result->boxes[i];
+        float x1 = (box->x1 - pad_left) * ratio_w + 0.5f;
+        float y1 = (box->y1 - pad_top) * ratio_h + 0.5f;
+        float x2 = (box->x2 - pad_left) * ratio_w + 0.5f;
+        float y2 = (box->y2 - pad_top) * ratio_h + 0.5f;
+
+        box->x1 = ((int)x1 > 0) ? (int)x1 : 0;
+        box->y1 = ((int)y1 > 0) ? (int)y1 : 0;
+        box->x2 = ((int)x2 < (img_width - 1)) ? (int)x2 : img_width - 1;
+        box->y2 = ((int)y2 < (img_height - 1)) ? (int)y2 : img_height - 1;
+    }
+
+    for (uint32_t i = 0; i < result->box_count * decoder->num_keypoint; i++)
+    {
+        float x = (keypoints[i].x - pad_left) * ratio_w;
+        float y = (keypoints[i].y - pad_top) * ratio_h;
+
+        keypoints[i].x = (x < 0) ? 0 : ((x > img_width - 1) ? img_width - 1 : x);
+        keypoints[i].y = (y < 0) ? 0 : ((y > img_height - 1) ? img_height - 1 : y);
+    }
+}
+
+/******************************************************************
+ * APIs
+ ******************************************************************/
+
+kp_app_decoder_t kp_app_decoder_create(kp_app_decoder_config_t *config, int *error_code)
+{
+    int ret = KP_SUCCESS;
+    kp_app_decoder_t decoder = NULL;
+
+    if ((NULL == config) || (config->head >= KP_APP_DECODER_HEAD_MAX) || (0 > (int)config->head) ||
+        (config->score_thresh < 0) || (config->score_thresh > 1) || (config->nms_thresh < 0) || (config->nms_thresh > 1) ||
+        (config->channel_ordering > KP_CHANNEL_ORDERING_HWC))
+        ret = KP_ERROR_INVALID_PARAM_12;
+
+    if (ret == KP_SUCCESS)
+    {
+        decoder = (kp_app_decoder_t)calloc(1, sizeof(struct kp_app_decoder_s));
+        if (NULL == decoder)
+            ret = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+    }
+
+    if (ret == KP_SUCCESS)
+    {
+        const head_plugin_t *plugin = &head_plugins[config->head];
+
+        decoder->config = *config;
+        decoder->plugin = plugin;
+
+        if (0 == decoder->config.score_thresh)
+            decoder->config.score_thresh = plugin->score_thresh;
+        if (0 == decoder->config.nms_thresh)
+            decoder->config.nms_thresh = plugin->nms_thresh;
+        if (0 == decoder->config.max_detection_per_class)
+            decoder->config.max_detection_per_class = DEFAULT_MAX_DETECTION_PER_CLASS;
+        if ((KP_APP_DECODER_HEAD_YOLOV7_POSE == config->head) && (0 == decoder->config.num_keypoint))
+            decoder->config.num_keypoint = DEFAULT_NUM_KEYPOINT;
+
+        decoder->num_keypoint = (KP_APP_DECODER_HEAD_YOLOV7_POSE == config->head) ? decoder->config.num_keypoint : 0;
+        decoder->score_logit = post_process_logit_lower_bound(decoder->config.score_thresh);
+        decoder->default_anchors = true;
+
+        for (int i = 0; i < KP_APP_DECODER_LEVEL_MAX * KP_APP_DECODER_ANCHOR_NUM * 2; i++) {
+            if (0 != (&decoder->config.anchors[0][0][0])[i])
+                decoder->default_anchors = false;
+        }
+
+        if ((0 != post_process_kept_boxes_init(&decoder->kept, (int)decoder->config.max_detection_per_class)) ||
+            (0 != post_process_buf_reserve((void **)&decoder->candidates, &decoder->candidate_capacity, INITIAL_CANDIDATES, sizeof(candidate_t))) ||
+            (0 != post_process_buf_reserve((void **)&decoder->class_boxes, &decoder->class_box_capacity, INITIAL_CANDIDATES, sizeof(candidate_t))))
+        {
+            kp_app_decoder_destroy(decoder);
+            decoder = NULL;
+            ret = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+        }
+    }
+
+    if (error_code)
+        *error_code = ret;
+
+    return decoder;
+}
+
+uint32_t kp_app_decoder_get_keypoint_count(kp_app_decoder_t decoder)
+{
+    return (NULL != decoder) ? decoder->num_keypoint : 0;
+}
+
+int kp_app_decoder_run(kp_app_decoder_t decoder, kp_inf_float_node_output_t *node_output[], uint32_t num_output_node,
+                       kp_hw_pre_proc_info_t *pre_proc_info, kp_yolo_result_t *result,
+                       kp_app_keypoint_t *keypoints, uint32_t max_keypoint_count)
+{
+    if ((NULL == decoder) || (NULL == node_output) || (NULL == result))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    const head_plugin_t *plugin = decoder->plugin;
+    uint32_t nodes_per_level = plugin->nodes_per_level;
+    uint32_t num_level = num_output_node / nodes_per_level;
+    node_view_t views[KP_APP_DECODER_LEVEL_MAX][MAX_NODES_PER_LEVEL];
+    int ret;
+
+    result->box_count = 0;
+    result->class_count = 0;
+
+    if ((0 == num_level) || (KP_APP_DECODER_LEVEL_MAX < num_level) || (num_level * nodes_per_level != num_output_node))
+        return KP_ERROR_INVALID_MODEL_21;
+
+    for (uint32_t l = 0; l < num_level; l++)
+    {
+        for (uint32_t r = 0; r < nodes_per_level; r++)
+        {
+            kp_inf_float_node_output_t *node = node_output[plugin->role_major ? r * num_level + l : l * nodes_per_level + r];
+
+            if (NULL == node)
+                return KP_ERROR_INVALID_PARAM_12;
+
+            views[l][r] = make_view(node, decoder->config.channel_ordering);
+        }
+    }
+
+    ret = plugin->check(decoder, views, num_level);
+    if (ret != KP_SUCCESS)
+        return ret;
+
+    ret = prepare_levels(decoder, views, num_level, pre_proc_info);
+    if (ret != KP_SUCCESS)
+        return ret;
+
+    decoder->num_candidate = 0;
+    decoder->candidate_dropped = false;
+
+    for (uint32_t l = 0; l < num_level; l++)
+        plugin->scan(decoder, l, views[l]);
+
+    // NMS runs on unclamped boxes in model input coordinates, boxes are clamped to the image only after it
+    nms_to_result(decoder, result, keypoints, max_keypoint_count);
+
+    if (NULL != pre_proc_info)
+        scale_to_image(decoder, result, keypoints, pre_proc_info);
+
+    return KP_SUCCESS;
+}
+
+void kp_app_decoder_destroy(kp_app_decoder_t decoder)
+{
+    if (NULL == decoder)
+        return;
+
+    free(decoder->grid_buf);
+    free(decoder->candidates);
+    free(decoder->candidate_kpts);
+    free(decoder->class_boxes);
+    free(decoder->class_start);
+    free(decoder->column_max);
+    post_process_kept_boxes_release(&decoder->kept);
+    free(decoder);
+}
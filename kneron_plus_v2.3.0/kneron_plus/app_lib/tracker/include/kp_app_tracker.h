@@ -0,0 +1,95 @@
+/**
+ * @file        kp_app_tracker.h
+ * @brief       APP multi-object tracker (ByteTrack) for detection results
+ *
+ * Boxes of every frame, ex. 'boxes' of kp_yolo_result_t, are associated to tracks in two stages:
+ *   1. boxes with a score above 'track_thresh' are matched to tracked and lost tracks by IoU weighted with the box score
+ *   2. boxes with a lower score (above 'low_thresh') are matched to the tracked tracks left by IoU,
+ *      so an occluded object with a weak detection keeps its track
+ * Track positions are predicted by a constant velocity Kalman filter on box center, aspect ratio and height,
+ * the same as the Python ByteTrack of bytetrack_plus_demo.
+ *
+ * All memory is allocated by kp_app_tracker_create(), kp_app_tracker_update() allocates nothing.
+ *
+ * @version     0.1
+ * @date        2024-06-03
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kp_struct.h"
+
+/**
+ * @brief a handle of a tracker, one per video stream.
+ */
+typedef struct kp_app_tracker_s *kp_app_tracker_t;
+
+/**
+ * @brief tracker configuration, zero values take the defaults.
+ */
+typedef struct
+{
+    float track_thresh;                     /**< boxes with a higher score are matched first, 0 for default (0.6) */
+    float low_thresh;                       /**< boxes with a score in (low_thresh, track_thresh] are matched second, 0 for default (0.1) */
+    float new_track_thresh;                 /**< minimum score of a box starting a track, 0 for default (track_thresh + 0.1) */
+    float match_thresh;                     /**< maximum cost (1 - IoU x score) of the first matching, 0 for default (0.9) */
+    uint32_t track_buffer;                  /**< number of frames a lost track is kept, 0 for default (120), scale it with frame rate / 30 */
+    uint32_t max_track_count;               /**< capacity of tracks including lost ones, the oldest lost track is dropped when full, 0 for default (256) */
+    uint32_t max_box_count;                 /**< maximum number of boxes per frame, more boxes are ignored, 0 for default (YOLO_GOOD_BOX_MAX) */
+    bool class_aware;                       /**< true to match boxes only to tracks of the same class */
+} kp_app_tracker_config_t;
+
+/**
+ * @brief describe a track in a frame
+ */
+typedef struct
+{
+    uint32_t track_id;                      /**< ID of the track, starts from 1 */
+    uint32_t box_index;                     /**< index of the box matched by the track in this frame */
+    uint32_t age;                           /**< number of frames since the track started */
+    kp_bounding_box_t box;                  /**< box estimated by the Kalman filter, 'score' and 'class_num' of the matched box */
+} kp_app_track_t;
+
+/**
+ * @brief Create a tracker.
+ *
+ * @param[in] config refer to kp_app_tracker_config_t, NULL for defaults.
+ * @param[out] error_code refer to KP_API_RETURN_CODE in kp_struct.h, it can be NULL.
+ *
+ * @return the tracker handle, NULL if failed.
+ */
+kp_app_tracker_t kp_app_tracker_create(kp_app_tracker_config_t *config, int *error_code);
+
+/**
+ * @brief Associate the boxes of a new frame to tracks.
+ *
+ * @param[in] tracker the tracker handle.
+ * @param[in] boxes boxes of the frame, ex. 'boxes' of kp_yolo_result_t, x2/y2 are the bottom-right corner.
+ * @param[in] box_count number of boxes.
+ * @param[out] tracks tracks matched in this frame, lost tracks and tracks waiting for a second frame are not given.
+ * @param[in] max_track_count size of the 'tracks' array.
+ * @param[out] track_count number of tracks written to 'tracks'.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_app_tracker_update(kp_app_tracker_t tracker, kp_bounding_box_t *boxes, uint32_t box_count,
+                          kp_app_track_t *tracks, uint32_t max_track_count, uint32_t *track_count);
+
+/**
+ * @brief Drop all tracks, ex. when the video stream is switched, track IDs start from 1 again.
+ *
+ * @param[in] tracker the tracker handle.
+ */
+void kp_app_tracker_reset(kp_app_tracker_t tracker);
+
+/**
+ * @brief Free the tracker.
+ *
+ * @param[in] tracker the tracker handle.
+ */
+void kp_app_tracker_destroy(kp_app_tracker_t tracker);
@@ -0,0 +1,1013 @@
+/**
+ * @file        kp_app_tracker.c
+ * @brief       multi-object tracker (ByteTrack) functions
+ * @version     0.1
+ * @date        2024-06-03
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "kp_app_tracker.h"
+
+#define DEFAULT_TRACK_THRESH        0.6f
+#define DEFAULT_LOW_THRESH          0.1f
+#define DEFAULT_NEW_TRACK_MARGIN    0.1f
+#define DEFAULT_MATCH_THRESH        0.9f
+#define DEFAULT_TRACK_BUFFER        120
+#define DEFAULT_MAX_TRACK_COUNT     256
+#define MAX_COUNT_LIMIT             4096
+
+#define SECOND_MATCH_THRESH         0.5f    // cost (1 - IoU) limit of low score boxes
+#define UNCONFIRMED_MATCH_THRESH    0.7f    // cost (1 - IoU x score) limit of tracks started in the last frame
+#define DUPLICATE_IOU               0.85f   // a tracked and a lost track overlapping more are the same object
+
+#define STD_WEIGHT_POSITION         (1.0f / 20)
+#define STD_WEIGHT_VELOCITY         (1.0f / 160)
+
+#define KF_DIM                      4       // box center x, y, aspect ratio and height
+
+#define TRACK_STATE_REMOVED         0
+#define TRACK_STATE_TRACKED         1
+#define TRACK_STATE_LOST            2
+
+struct kp_app_tracker_s
+{
+    kp_app_tracker_config_t config;
+    uint32_t frame_id;
+    uint32_t next_track_id;
+    void *memory;                           // all arrays below
+
+    // tracks in structure of arrays, [0, num_track) are kept packed
+    uint32_t num_track;
+    float *mean[2 * KF_DIM];                // x, y, a, h and their velocities
+    float *cov_pp[KF_DIM];                  // the covariance is 4 independent 2x2 blocks of position and velocity,
+    float *cov_pv[KF_DIM];                  // as the motion model and all noises are diagonal per dimension
+    float *cov_vv[KF_DIM];
+    float *predict_mask;                    // 1 to predict the track, 0 to keep it
+    uint32_t *track_id;
+    uint32_t *start_frame;
+    uint32_t *last_frame;                   // last frame the track is matched
+    float *score;
+    int32_t *class_num;
+    uint32_t *box_index;
+    uint8_t *state;
+    uint8_t *activated;                     // 0 for a track started in the last frame, not given to users yet
+    uint8_t *duplicate;
+
+    // boxes of the frame, high score boxes first
+    uint32_t num_box;
+    float *box_x1;
+    float *box_y1;
+    float *box_x2;
+    float *box_y2;
+    float *box_score;
+    int32_t *box_class;
+    uint32_t *box_input_index;
+    uint8_t *box_used;
+
+    // association of 'rows' (tracks) and 'cols' (boxes)
+    uint32_t *rows;
+    uint32_t *cols;
+    int32_t *row_match;                     // matched index of 'cols', -1 if none
+    int32_t *col_match;
+    float *row_x1;                          // boxes of the row tracks
+    float *row_y1;
+    float *row_x2;
+    float *row_y2;
+    uint32_t *col_order;                    // cols sorted by x1
+    uint32_t *edge_start;                   // pairs of a cost below the limit, edges of row r are [edge_start[r], edge_start[r + 1])
+    uint32_t *edge_col;
+    float *edge_cost;
+    uint32_t *node_parent;                  // union-find of rows and cols (num_row + col)
+    uint32_t *comp_start;                   // nodes grouped by connected component
+    uint32_t *comp_fill;
+    uint32_t *comp_node;
+    uint32_t *local_index;                  // index of a node in its component
+    float *dense;                           // cost matrix of a component for the Hungarian algorithm
+    float *hung_u;
+    float *hung_v;
+    float *hung_minv;
+    uint32_t *hung_p;
+    uint32_t *hung_way;
+    uint8_t *hung_used;
+};
+
+// carve all arrays from one block, from 'base' 0 it only returns the size
+static size_t layout_arrays(kp_app_tracker_t tracker, uintptr_t base)
+{
+    uintptr_t cursor = base;
+    size_t num_slot = tracker->config.max_track_count;
+    size_t num_box = tracker->config.max_box_count;
+    size_t num_node = num_slot + num_box;
+    size_t num_hung = ((num_slot > num_box) ? num_slot : num_box) + 1;
+
+#define CARVE(ptr, count)                                                     \
+    {                                                                         \
+        ptr = (void *)cursor;                                                 \
+        cursor += ((count) * sizeof(*(ptr)) + 63) & ~(uintptr_t)63;           \
+    }
+
+    for (int d = 0; d < 2 * KF_DIM; d++)
+        CARVE(tracker->mean[d], num_slot);
+
+    for (int d = 0; d < KF_DIM; d++)
+    {
+        CARVE(tracker->cov_pp[d], num_slot);
+        CARVE(tracker->cov_pv[d], num_slot);
+        CARVE(tracker->cov_vv[d], num_slot);
+    }
+
+    CARVE(tracker->predict_mask, num_slot);
+    CARVE(tracker->track_id, num_slot);
+    CARVE(tracker->start_frame, num_slot);
+    CARVE(tracker->last_frame, num_slot);
+    CARVE(tracker->score, num_slot);
+    CARVE(tracker->class_num, num_slot);
+    CARVE(tracker->box_index, num_slot);
+    CARVE(tracker->state, num_slot);
+    CARVE(tracker->activated, num_slot);
+    CARVE(tracker->duplicate, num_slot);
+
+    CARVE(tracker->box_x1, num_box);
+    CARVE(tracker->box_y1, num_box);
+    CARVE(tracker->box_x2, num_box);
+    CARVE(tracker->box_y2, num_box);
+    CARVE(tracker->box_score, num_box);
+    CARVE(tracker->box_class, num_box);
+    CARVE(tracker->box_input_index, num_box);
+    CARVE(tracker->box_used, num_box);
+
+    CARVE(tracker->rows, num_slot);
+    CARVE(tracker->cols, num_box);
+    CARVE(tracker->row_match, num_slot);
+    CARVE(tracker->col_match, num_box);
+    CARVE(tracker->row_x1, num_slot);
+    CARVE(tracker->row_y1, num_slot);
+    CARVE(tracker->row_x2, num_slot);
+    CARVE(tracker->row_y2, num_slot);
+    CARVE(tracker->col_order, num_box);
+    CARVE(tracker->edge_start, num_slot + 1);
+    CARVE(tracker->edge_col, num_slot * num_box);
+    CARVE(tracker->edge_cost, num_slot * num_box);
+    CARVE(tracker->node_parent, num_node);
+    CARVE(tracker->comp_start, num_node + 1);
+    CARVE(tracker->comp_fill, num_node);
+    CARVE(tracker->comp_node, num_node);
+    CARVE(tracker->local_index, num_node);
+    CARVE(tracker->dense, num_slot * num_box);
+    CARVE(tracker->hung_u, num_hung);
+    CARVE(tracker->hung_v, num_hung);
+    CARVE(tracker->hung_minv, num_hung);
+    CARVE(tracker->hung_p, num_hung);
+    CARVE(tracker->hung_way, num_hung);
+    CARVE(tracker->hung_used, num_hung);
+
+#undef CARVE
+
+    return cursor - base;
+}
+
+// IoU of boxes with inclusive pixel coordinates, the same as the Python tracker
+static inline float box_iou(float ax1, float ay1, float ax2, float ay2, float bx1, float by1, float bx2, float by2)
+{
+    float iw = fminf(ax2, bx2) - fmaxf(ax1, bx1) + 1.0f;
+    float ih = fminf(ay2, by2) - fmaxf(ay1, by1) + 1.0f;
+
+    if (iw <= 0.0f || ih <= 0.0f)
+        return 0.0f;
+
+    float inter = iw * ih;
+
+    return inter / ((ax2 - ax1 + 1.0f) * (ay2 - ay1 + 1.0f) + (bx2 - bx1 + 1.0f) * (by2 - by1 + 1.0f) - inter);
+}
+
+/* ############################
+ * ##    Kalman filter       ##
+ * ############################ */
+
+static void box_to_xyah(kp_app_tracker_t tracker, uint32_t b, float z[KF_DIM])
+{
+    float w = tracker->box_x2[b] - tracker->box_x1[b];
+    float h = tracker->box_y2[b] - tracker->box_y1[b];
+
+    z[0] = tracker->box_x1[b] + w / 2;
+    z[1] = tracker->box_y1[b] + h / 2;
+    z[2] = w / h;
+    z[3] = h;
+}
+
+static void track_to_box(kp_app_tracker_t tracker, uint32_t t, float *x1, float *y1, float *x2, float *y2)
+{
+    float h = tracker->mean[3][t];
+    float w = tracker->mean[2][t] * h;
+
+    *x1 = tracker->mean[0][t] - w / 2;
+    *y1 = tracker->mean[1][t] - h / 2;
+    *x2 = *x1 + w;
+    *y2 = *y1 + h;
+}
+
+static void kalman_initiate(kp_app_tracker_t tracker, uint32_t t, const float z[KF_DIM])
+{
+    float h = z[3];
+
+    for (int d = 0; d < KF_DIM; d++)
+    {
+        float std_pos = (2 == d) ? 1e-2f : 2 * STD_WEIGHT_POSITION * h;
+        float std_vel = (2 == d) ? 1e-5f : 10 * STD_WEIGHT_VELOCITY * h;
+
+        tracker->mean[d][t] = z[d];
+        tracker->mean[KF_DIM + d][t] = 0.0f;
+        tracker->cov_pp[d][t] = std_pos * std_pos;
+        tracker->cov_pv[d][t] = 0.0f;
+        tracker->cov_vv[d][t] = std_vel * std_vel;
+    }
+}
+
+// constant velocity prediction of all tracks with 'predict_mask' 1, the noise depends on the height before prediction
+static void kalman_predict(kp_app_tracker_t tracker)
+{
+    uint32_t num_track = tracker->num_track;
+    const float *mask = tracker->predict_mask;
+
+    // the height (dim 3) is predicted last as the noise of all dimensions takes it
+    for (int dim = 0; dim < KF_DIM; dim++)
+    {
+        float *x = tracker->mean[dim];
+        float *v = tracker->mean[KF_DIM + dim];
+        float *pp = tracker->cov_pp[dim];
+        float *pv = tracker->cov_pv[dim];
+        float *vv = tracker->cov_vv[dim];
+        const float *h = tracker->mean[3];
+
+        // aspect ratio noise is constant, others are proportional to the height
+        float weight_pos = (2 == dim) ? 0.0f : STD_WEIGHT_POSITION;
+        float weight_vel = (2 == dim) ? 0.0f : STD_WEIGHT_VELOCITY;
+        float const_pos = (2 == dim) ? 1e-2f : 0.0f;
+        float const_vel = (2 == dim) ? 1e-5f : 0.0f;
+
+        for (uint32_t t = 0; t < num_track; t++)
+        {
+            float std_pos = weight_pos * h[t] + const_pos;
+            float std_vel = weight_vel * h[t] + const_vel;
+            float m = mask[t];
+            float cov_pv = pv[t];
+            float cov_vv = vv[t];
+
+            x[t] += m * v[t];
+            pp[t] += m * (2 * cov_pv + cov_vv + std_pos * std_pos);
+            pv[t] += m * cov_vv;
+            vv[t] += m * std_vel * std_vel;
+        }
+    }
+}
+
+static void kalman_update(kp_app_tracker_t tracker, uint32_t t, const float z[KF_DIM])
+{
+    float h = tracker->mean[3][t];
+
+    for (int d = 0; d < KF_DIM; d++)
+    {
+        float std_meas = (2 == d) ? 1e-1f : STD_WEIGHT_POSITION * h;
+        float cov_pp = tracker->cov_pp[d][t];
+        float cov_pv = tracker->cov_pv[d][t];
+        float s = cov_pp + std_meas * std_meas;
+        float gain_pos = cov_pp / s;
+        float gain_vel = cov_pv / s;
+        float innovation = z[d] - tracker->mean[d][t];
+
+        tracker->mean[d][t] += gain_pos * innovation;
+        tracker->mean[KF_DIM + d][t] += gain_vel * innovation;
+        tracker->cov_pp[d][t] = cov_pp - gain_pos * cov_pp;
+        tracker->cov_pv[d][t] = cov_pv - gain_pos * cov_pv;
+        tracker->cov_vv[d][t] -= gain_vel * cov_pv;
+    }
+}
+
+/* ############################
+ * ##    association         ##
+ * ############################ */
+
+static void sort_cols_by_x1(kp_app_tracker_t tracker, uint32_t num_col)
+{
+    static const uint32_t gaps[] = {701, 301, 132, 57, 23, 10, 4, 1};
+    uint32_t *order = tracker->col_order;
+    const float *x1 = tracker->box_x1;
+    const uint32_t *cols = tracker->cols;
+
+    for (uint32_t c = 0; c < num_col; c++)
+        order[c] = c;
+
+    // shell sort, no memory is allocated
+    for (size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++)
+    {
+        uint32_t gap = gaps[g];
+
+        for (uint32_t i = gap; i < num_col; i++)
+        {
+            uint32_t tmp = order[i];
+            float key = x1[cols[tmp]];
+            uint32_t j = i;
+
+            for (; j >= gap && x1[cols[order[j - gap]]] > key; j -= gap)
+                order[j] = order[j - gap];
+
+            order[j] = tmp;
+        }
+    }
+}
+
+static uint32_t find_root(uint32_t *parent, uint32_t node)
+{
+    while (parent[node] != node)
+    {
+        parent[node] = parent[parent[node]];
+        node = parent[node];
+    }
+
+    return node;
+}
+
+// square Hungarian algorithm on a n x m (n <= m) 'dense' matrix, hung_p[j] is the row (1-based) assigned to column j
+static void hungarian(kp_app_tracker_t tracker, uint32_t n, uint32_t m)
+{
+    const float *a = tracker->dense;
+    float *u = tracker->hung_u;
+    float *v = tracker->hung_v;
+    float *minv = tracker->hung_minv;
+    uint32_t *p = tracker->hung_p;
+    uint32_t *way = tracker->hung_way;
+    uint8_t *used = tracker->hung_used;
+
+    memset(u, 0, (n + 1) * sizeof(float));
+    memset(v, 0, (m + 1) * sizeof(float));
+    memset(p, 0, (m + 1) * sizeof(uint32_t));
+
+    for (uint32_t i = 1; i <= n; i++)
+    {
+        uint32_t j0 = 0;
+
+        p[0] = i;
+
+        for (uint32_t j = 0; j <= m; j++)
+        {
+            minv[j] = FLT_MAX;
+            used[j] = 0;
+        }
+
+        do
+        {
+            uint32_t i0 = p[j0];
+            uint32_t j1 = 0;
+            float delta = FLT_MAX;
+
+            used[j0] = 1;
+
+            for (uint32_t j = 1; j <= m; j++)
+            {
+                if (used[j])
+                    continue;
+
+                float cur = a[(i0 - 1) * m + (j - 1)] - u[i0] - v[j];
+
+                if (cur < minv[j])
+                {
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+
+                if (minv[j] < delta)
+                {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+
+            for (uint32_t j = 0; j <= m; j++)
+            {
+                if (used[j])
+                {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else
+                {
+                    minv[j] -= delta;
+                }
+            }
+
+            j0 = j1;
+        } while (p[j0] != 0);
+
+        do
+        {
+            uint32_t j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+}
+
+static void match(kp_app_tracker_t tracker, uint32_t row, uint32_t col)
+{
+    tracker->row_match[row] = (int32_t)col;
+    tracker->col_match[col] = (int32_t)row;
+}
+
+// solve one connected component of 'num_node' nodes, rows first
+static void solve_component(kp_app_tracker_t tracker, const uint32_t *nodes, uint32_t num_node, uint32_t num_row, float thresh)
+{
+    uint32_t k_row = 0;
+
+    while (k_row < num_node && nodes[k_row] < num_row)
+        k_row++;
+
+    uint32_t k_col = num_node - k_row;
+
+    // all pairs share one track or one box, the cheapest one is the optimum
+    if (1 == k_row || 1 == k_col)
+    {
+        uint32_t best_row = 0, best_col = 0;
+        float best_cost = FLT_MAX;
+
+        for (uint32_t i = 0; i < k_row; i++)
+        {
+            uint32_t r = nodes[i];
+
+            for (uint32_t e = tracker->edge_start[r]; e < tracker->edge_start[r + 1]; e++)
+            {
+                if (tracker->edge_cost[e] < best_cost)
+                {
+                    best_cost = tracker->edge_cost[e];
+                    best_row = r;
+                    best_col = tracker->edge_col[e];
+                }
+            }
+        }
+
+        match(tracker, best_row, best_col);
+        return;
+    }
+
+    // matching a pair saves 'thresh' compared to leaving both unmatched, the same as lapjv with 'cost_limit',
+    // so pairs cost (cost - thresh) and others 0 in the rectangular problem
+    bool transpose = (k_row > k_col);
+    uint32_t n = transpose ? k_col : k_row;
+    uint32_t m = transpose ? k_row : k_col;
+
+    for (uint32_t i = 0; i < num_node; i++)
+        tracker->local_index[nodes[i]] = (i < k_row) ? i : i - k_row;
+
+    memset(tracker->dense, 0, (size_t)n * m * sizeof(float));
+
+    for (uint32_t i = 0; i < k_row; i++)
+    {
+        uint32_t r = nodes[i];
+
+        for (uint32_t e = tracker->edge_start[r]; e < tracker->edge_start[r + 1]; e++)
+        {
+            uint32_t c = tracker->local_index[num_row + tracker->edge_col[e]];
+            size_t idx = transpose ? (size_t)c * m + i : (size_t)i * m + c;
+
+            tracker->dense[idx] = tracker->edge_cost[e] - thresh;
+        }
+    }
+
+    hungarian(tracker, n, m);
+
+    for (uint32_t j = 1; j <= m; j++)
+    {
+        uint32_t i = tracker->hung_p[j];
+
+        if (0 == i || 0.0f <= tracker->dense[(size_t)(i - 1) * m + (j - 1)])
+            continue;
+
+        uint32_t local_row = transpose ? j - 1 : i - 1;
+        uint32_t local_col = transpose ? i - 1 : j - 1;
+
+        match(tracker, nodes[local_row], nodes[k_row + local_col] - num_row);
+    }
+}
+
+/*
+ * Optimal matching of tracks 'rows' to boxes 'cols' with a cost below 'thresh', like lapjv with 'cost_limit'.
+ * The cost is 1 - IoU, or 1 - IoU x score with 'fuse_score'. Pairs not overlapping are never matched, so only the
+ * overlapping pairs are found by sweeping the boxes sorted by x1, and each connected group of pairs is solved alone,
+ * directly if all of its pairs share a track or a box, by the Hungarian algorithm otherwise.
+ */
+static void associate(kp_app_tracker_t tracker, uint32_t num_row, uint32_t num_col, float thresh, bool fuse_score)
+{
+    uint32_t num_node = num_row + num_col;
+    uint32_t num_edge = 0;
+    float max_width = 0.0f;
+
+    for (uint32_t r = 0; r < num_row; r++)
+    {
+        tracker->row_match[r] = -1;
+        track_to_box(tracker, tracker->rows[r], &tracker->row_x1[r], &tracker->row_y1[r], &tracker->row_x2[r], &tracker->row_y2[r]);
+    }
+
+    for (uint32_t c = 0; c < num_col; c++)
+    {
+        uint32_t b = tracker->cols[c];
+
+        tracker->col_match[c] = -1;
+        max_width = fmaxf(max_width, tracker->box_x2[b] - tracker->box_x1[b]);
+    }
+
+    if (0 == num_row || 0 == num_col)
+        return;
+
+    sort_cols_by_x1(tracker, num_col);
+
+    for (uint32_t r = 0; r < num_row; r++)
+    {
+        uint32_t t = tracker->rows[r];
+        float rx1 = tracker->row_x1[r], ry1 = tracker->row_y1[r], rx2 = tracker->row_x2[r], ry2 = tracker->row_y2[r];
+        float lower = rx1 - 1.0f - max_width;
+        uint32_t lo = 0, hi = num_col;
+
+        tracker->edge_start[r] = num_edge;
+
+        // first box which may overlap in x
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+
+            if (tracker->box_x1[tracker->cols[tracker->col_order[mid]]] < lower)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for (uint32_t k = lo; k < num_col; k++)
+        {
+            uint32_t c = tracker->col_order[k];
+            uint32_t b = tracker->cols[c];
+
+            if (tracker->box_x1[b] >= rx2 + 1.0f)
+                break;
+
+            if (tracker->config.class_aware && tracker->class_num[t] != tracker->box_class[b])
+                continue;
+
+            float iou = box_iou(rx1, ry1, rx2, ry2, tracker->box_x1[b], tracker->box_y1[b], tracker->box_x2[b], tracker->box_y2[b]);
+            float cost = 1.0f - (fuse_score ? iou * tracker->box_score[b] : iou);
+
+            if (0.0f < iou && cost < thresh)
+            {
+                tracker->edge_col[num_edge] = c;
+                tracker->edge_cost[num_edge] = cost;
+                num_edge++;
+            }
+        }
+    }
+
+    tracker->edge_start[num_row] = num_edge;
+
+    if (0 == num_edge)
+        return;
+
+    // connected components of rows and cols (num_row + c)
+    uint32_t *parent = tracker->node_parent;
+
+    for (uint32_t i = 0; i < num_node; i++)
+        parent[i] = i;
+
+    for (uint32_t r = 0; r < num_row; r++)
+    {
+        for (uint32_t e = tracker->edge_start[r]; e < tracker->edge_start[r + 1]; e++)
+        {
+            uint32_t root_r = find_root(parent, r);
+            uint32_t root_c = find_root(parent, num_row + tracker->edge_col[e]);
+
+            if (root_r != root_c)
+                parent[root_c] = root_r;
+        }
+    }
+
+    // group nodes by root with a counting sort, so rows come first in each group
+    uint32_t *start = tracker->comp_start;
+
+    memset(start, 0, (num_node + 1) * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < num_node; i++)
+        start[find_root(parent, i) + 1]++;
+
+    for (uint32_t i = 0; i < num_node; i++)
+    {
+        start[i + 1] += start[i];
+        tracker->comp_fill[i] = start[i];
+    }
+
+    for (uint32_t i = 0; i < num_node; i++)
+        tracker->comp_node[tracker->comp_fill[find_root(parent, i)]++] = i;
+
+    for (uint32_t i = 0; i < num_node; i++)
+    {
+        uint32_t count = start[i + 1] - start[i];
+
+        // a node without pairs is alone
+        if (1 < count)
+            solve_component(tracker, &tracker->comp_node[start[i]], count, num_row, thresh);
+    }
+}
+
+/* ############################
+ * ##    tracks              ##
+ * ############################ */
+
+static void update_track(kp_app_tracker_t tracker, uint32_t t, uint32_t b)
+{
+    float z[KF_DIM];
+
+    box_to_xyah(tracker, b, z);
+    kalman_update(tracker, t, z);
+
+    tracker->state[t] = TRACK_STATE_TRACKED;
+    tracker->activated[t] = 1;
+    tracker->last_frame[t] = tracker->frame_id;
+    tracker->score[t] = tracker->box_score[b];
+    tracker->class_num[t] = tracker->box_class[b];
+    tracker->box_index[t] = tracker->box_input_index[b];
+    tracker->box_used[b] = 1;
+}
+
+static void copy_track(kp_app_tracker_t tracker, uint32_t dst, uint32_t src)
+{
+    for (int d = 0; d < 2 * KF_DIM; d++)
+        tracker->mean[d][dst] = tracker->mean[d][src];
+
+    for (int d = 0; d < KF_DIM; d++)
+    {
+        tracker->cov_pp[d][dst] = tracker->cov_pp[d][src];
+        tracker->cov_pv[d][dst] = tracker->cov_pv[d][src];
+        tracker->cov_vv[d][dst] = tracker->cov_vv[d][src];
+    }
+
+    tracker->track_id[dst] = tracker->track_id[src];
+    tracker->start_frame[dst] = tracker->start_frame[src];
+    tracker->last_frame[dst] = tracker->last_frame[src];
+    tracker->score[dst] = tracker->score[src];
+    tracker->class_num[dst] = tracker->class_num[src];
+    tracker->box_index[dst] = tracker->box_index[src];
+    tracker->state[dst] = tracker->state[src];
+    tracker->activated[dst] = tracker->activated[src];
+}
+
+static void remove_tracks(kp_app_tracker_t tracker)
+{
+    uint32_t n = 0;
+
+    for (uint32_t t = 0; t < tracker->num_track; t++)
+    {
+        if (TRACK_STATE_REMOVED == tracker->state[t])
+            continue;
+
+        if (n != t)
+            copy_track(tracker, n, t);
+
+        n++;
+    }
+
+    tracker->num_track = n;
+}
+
+static void start_track(kp_app_tracker_t tracker, uint32_t b)
+{
+    if (tracker->num_track == tracker->config.max_track_count)
+    {
+        // no room, the track lost for the longest time is dropped
+        uint32_t oldest = tracker->num_track;
+
+        for (uint32_t t = 0; t < tracker->num_track; t++)
+        {
+            if (TRACK_STATE_LOST == tracker->state[t] && (oldest == tracker->num_track || tracker->last_frame[t] < tracker->last_frame[oldest]))
+                oldest = t;
+        }
+
+        if (oldest == tracker->num_track)
+            return;
+
+        tracker->num_track--;
+        if (oldest != tracker->num_track)
+            copy_track(tracker, oldest, tracker->num_track);
+    }
+
+    uint32_t t = tracker->num_track++;
+    float z[KF_DIM];
+
+    box_to_xyah(tracker, b, z);
+    kalman_initiate(tracker, t, z);
+
+    tracker->track_id[t] = tracker->next_track_id++;
+    tracker->start_frame[t] = tracker->frame_id;
+    tracker->last_frame[t] = tracker->frame_id;
+    tracker->score[t] = tracker->box_score[b];
+    tracker->class_num[t] = tracker->box_class[b];
+    tracker->box_index[t] = tracker->box_input_index[b];
+    tracker->state[t] = TRACK_STATE_TRACKED;
+    tracker->activated[t] = (1 == tracker->frame_id) ? 1 : 0; // tracks of the first frame are given at once
+}
+
+// a tracked and a lost track of the same object, the younger one is removed
+static void remove_duplicate_tracks(kp_app_tracker_t tracker)
+{
+    uint32_t num_track = tracker->num_track;
+
+    for (uint32_t t = 0; t < num_track; t++)
+    {
+        tracker->duplicate[t] = 0;
+        track_to_box(tracker, t, &tracker->row_x1[t], &tracker->row_y1[t], &tracker->row_x2[t], &tracker->row_y2[t]);
+    }
+
+    for (uint32_t p = 0; p < num_track; p++)
+    {
+        if (TRACK_STATE_TRACKED != tracker->state[p])
+            continue;
+
+        for (uint32_t q = 0; q < num_track; q++)
+        {
+            if (TRACK_STATE_LOST != tracker->state[q])
+                continue;
+
+            if (tracker->row_x2[p] < tracker->row_x1[q] || tracker->row_x2[q] < tracker->row_x1[p])
+                continue;
+
+            float iou = box_iou(tracker->row_x1[p], tracker->row_y1[p], tracker->row_x2[p], tracker->row_y2[p],
+                                tracker->row_x1[q], tracker->row_y1[q], tracker->row_x2[q], tracker->row_y2[q]);
+
+            if (iou <= DUPLICATE_IOU)
+                continue;
+
+            if (tracker->last_frame[p] - tracker->start_frame[p] > tracker->last_frame[q] - tracker->start_frame[q])
+                tracker->duplicate[q] = 1;
+            else
+                tracker->duplicate[p] = 1;
+        }
+    }
+
+    for (uint32_t t = 0; t < num_track; t++)
+    {
+        if (tracker->duplicate[t])
+            tracker->state[t] = TRACK_STATE_REMOVED;
+    }
+
+    remove_tracks(tracker);
+}
+
+// copy valid boxes, high score boxes first, return the number of high score boxes
+static uint32_t load_boxes(kp_app_tracker_t tracker, kp_bounding_box_t *boxes, uint32_t box_count)
+{
+    kp_app_tracker_config_t *config = &tracker->config;
+    uint32_t count = (box_count < config->max_box_count) ? box_count : config->max_box_count;
+    uint32_t num_high = 0;
+    uint32_t n = 0;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            kp_bounding_box_t *box = &boxes[i];
+            bool high = (box->score > config->track_thresh);
+
+            if (!(box->x2 > box->x1 && box->y2 > box->y1))
+                continue;
+
+            if ((0 == pass) ? !high : (high || box->score <= config->low_thresh))
+                continue;
+
+            tracker->box_x1[n] = box->x1;
+            tracker->box_y1[n] = box->y1;
+            tracker->box_x2[n] = box->x2;
+            tracker->box_y2[n] = box->y2;
+            tracker->box_score[n] = box->score;
+            tracker->box_class[n] = box->class_num;
+            tracker->box_input_index[n] = i;
+            tracker->box_used[n] = 0;
+            n++;
+        }
+
+        if (0 == pass)
+            num_high = n;
+    }
+
+    tracker->num_box = n;
+
+    return num_high;
+}
+
+kp_app_tracker_t kp_app_tracker_create(kp_app_tracker_config_t *config, int *error_code)
+{
+    int ret = KP_SUCCESS;
+    kp_app_tracker_config_t cfg = {0};
+
+    if (NULL != config)
+        cfg = *config;
+
+    if (0.0f == cfg.track_thresh)
+        cfg.track_thresh = DEFAULT_TRACK_THRESH;
+    if (0.0f == cfg.low_thresh)
+        cfg.low_thresh = DEFAULT_LOW_THRESH;
+    if (0.0f == cfg.new_track_thresh)
+        cfg.new_track_thresh = cfg.track_thresh + DEFAULT_NEW_TRACK_MARGIN;
+    if (0.0f == cfg.match_thresh)
+        cfg.match_thresh = DEFAULT_MATCH_THRESH;
+    if (0 == cfg.track_buffer)
+        cfg.track_buffer = DEFAULT_TRACK_BUFFER;
+    if (0 == cfg.max_track_count)
+        cfg.max_track_count = DEFAULT_MAX_TRACK_COUNT;
+    if (0 == cfg.max_box_count)
+        cfg.max_box_count = YOLO_GOOD_BOX_MAX;
+
+    if (cfg.track_thresh < 0.0f || cfg.track_thresh > 1.0f || cfg.low_thresh < 0.0f || cfg.low_thresh > cfg.track_thresh ||
+        cfg.new_track_thresh < 0.0f || cfg.match_thresh < 0.0f || cfg.match_thresh > 1.0f ||
+        MAX_COUNT_LIMIT < cfg.max_track_count || MAX_COUNT_LIMIT < cfg.max_box_count)
+        ret = KP_ERROR_INVALID_PARAM_12;
+
+    kp_app_tracker_t tracker = NULL;
+
+    if (ret == KP_SUCCESS)
+    {
+        tracker = (kp_app_tracker_t)calloc(1, sizeof(struct kp_app_tracker_s));
+        if (NULL == tracker)
+            ret = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+    }
+
+    if (ret == KP_SUCCESS)
+    {
+        tracker->config = cfg;
+        tracker->memory = malloc(layout_arrays(tracker, 0) + 63);
+
+        if (NULL == tracker->memory)
+        {
+            free(tracker);
+            tracker = NULL;
+            ret = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+        }
+    }
+
+    if (ret == KP_SUCCESS)
+    {
+        layout_arrays(tracker, ((uintptr_t)tracker->memory + 63) & ~(uintptr_t)63);
+        kp_app_tracker_reset(tracker);
+    }
+
+    if (error_code)
+        *error_code = ret;
+
+    return tracker;
+}
+
+int kp_app_tracker_update(kp_app_tracker_t tracker, kp_bounding_box_t *boxes, uint32_t box_count,
+                          kp_app_track_t *tracks, uint32_t max_track_count, uint32_t *track_count)
+{
+    if (NULL == tracker || NULL == track_count || (NULL == boxes && 0 < box_count) || (NULL == tracks && 0 < max_track_count))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    kp_app_tracker_config_t *config = &tracker->config;
+    uint32_t num_high, num_row, num_col;
+
+    tracker->frame_id++;
+    num_high = load_boxes(tracker, boxes, box_count);
+
+    // predict confirmed and lost tracks, a lost track does not keep growing
+    for (uint32_t t = 0; t < tracker->num_track; t++)
+    {
+        tracker->predict_mask[t] = tracker->activated[t] ? 1.0f : 0.0f;
+
+        if (TRACK_STATE_LOST == tracker->state[t])
+            tracker->mean[KF_DIM + 3][t] = 0.0f;
+    }
+
+    kalman_predict(tracker);
+
+    // first association, confirmed and lost tracks with high score boxes
+    num_row = 0;
+    for (uint32_t t = 0; t < tracker->num_track; t++)
+    {
+        if (tracker->activated[t])
+            tracker->rows[num_row++] = t;
+    }
+
+    for (num_col = 0; num_col < num_high; num_col++)
+        tracker->cols[num_col] = num_col;
+
+    associate(tracker, num_row, num_col, config->match_thresh, true);
+
+    for (uint32_t r = 0; r < num_row; r++)
+    {
+        if (0 <= tracker->row_match[r])
+            update_track(tracker, tracker->rows[r], tracker->cols[tracker->row_match[r]]);
+    }
+
+    // second association, tracked tracks left with low score boxes
+    uint32_t n = 0;
+    for (uint32_t r = 0; r < num_row; r++)
+    {
+        uint32_t t = tracker->rows[r];
+
+        if (0 > tracker->row_match[r] && TRACK_STATE_TRACKED == tracker->state[t])
+            tracker->rows[n++] = t;
+    }
+    num_row = n;
+
+    for (num_col = 0; num_col < tracker->num_box - num_high; num_col++)
+        tracker->cols[num_col] = num_high + num_col;
+
+    associate(tracker, num_row, num_col, SECOND_MATCH_THRESH, false);
+
+    for (uint32_t r = 0; r < num_row; r++)
+    {
+        if (0 <= tracker->row_match[r])
+            update_track(tracker, tracker->rows[r], tracker->cols[tracker->row_match[r]]);
+        else
+            tracker->state[tracker->rows[r]] = TRACK_STATE_LOST;
+    }
+
+    // tracks started in the last frame with high score boxes left, they are removed if not matched
+    num_row = 0;
+    for (uint32_t t = 0; t < tracker->num_track; t++)
+    {
+        if (0 == tracker->activated[t])
+            tracker->rows[num_row++] = t;
+    }
+
+    num_col = 0;
+    for (uint32_t b = 0; b < num_high; b++)
+    {
+        if (0 == tracker->box_used[b])
+            tracker->cols[num_col++] = b;
+    }
+
+    associate(tracker, num_row, num_col, UNCONFIRMED_MATCH_THRESH, true);
+
+    for (uint32_t r = 0; r < num_row; r++)
+    {
+        if (0 <= tracker->row_match[r])
+            update_track(tracker, tracker->rows[r], tracker->cols[tracker->row_match[r]]);
+        else
+            tracker->state[tracker->rows[r]] = TRACK_STATE_REMOVED;
+    }
+
+    for (uint32_t t = 0; t < tracker->num_track; t++)
+    {
+        if (TRACK_STATE_LOST == tracker->state[t] && tracker->frame_id - tracker->last_frame[t] > config->track_buffer)
+            tracker->state[t] = TRACK_STATE_REMOVED;
+    }
+
+    remove_tracks(tracker);
+
+    // new tracks from high score boxes left
+    for (uint32_t b = 0; b < num_high; b++)
+    {
+        if (0 == tracker->box_used[b] && tracker->box_score[b] >= config->new_track_thresh)
+            start_track(tracker, b);
+    }
+
+    remove_duplicate_tracks(tracker);
+
+    *track_count = 0;
+
+    for (uint32_t t = 0; t < tracker->num_track && *track_count < max_track_count; t++)
+    {
+        if (TRACK_STATE_TRACKED != tracker->state[t] || 0 == tracker->activated[t])
+            continue;
+
+        kp_app_track_t *track = &tracks[(*track_count)++];
+
+        track->track_id = tracker->track_id[t];
+        track->box_index = tracker->box_index[t];
+        track->age = tracker->frame_id - tracker->start_frame[t];
+        track_to_box(tracker, t, &track->box.x1, &track->box.y1, &track->box.x2, &track->box.y2);
+        track->box.score = tracker->score[t];
+        track->box.class_num = tracker->class_num[t];
+    }
+
+    return KP_SUCCESS;
+}
+
+void kp_app_tracker_reset(kp_app_tracker_t tracker)
+{
+    if (NULL == tracker)
+        return;
+
+    tracker->frame_id = 0;
+    tracker->next_track_id = 1;
+    tracker->num_track = 0;
+    tracker->num_box = 0;
+}
+
+void kp_app_tracker_destroy(kp_app_tracker_t tracker)
+{
+    if (NULL == tracker)
+        return;
+
+    free(tracker->memory);
+    free(tracker);
+}
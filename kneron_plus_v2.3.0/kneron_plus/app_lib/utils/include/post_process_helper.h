@@ -0,0 +1,71 @@
+/**
+ * @file        post_process_helper.h
+ * @brief       Kneron PLUS post-process helper functions
+ *
+ * Candidate scanning and NMS helpers shared by the post-process functions of examples and APP libraries
+ *
+ * @version     0.1
+ * @date        2024-06-10
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kp_struct.h"
+
+/**
+ * @brief boxes kept by NMS of the current class, stored as arrays to compute IoU of many boxes at once
+ */
+typedef struct
+{
+    float *x1;
+    float *y1;
+    float *x2;
+    float *y2;
+    float *area;
+    int count;
+    int capacity;
+} post_process_kept_boxes_t;
+
+/**
+ * @brief grow '*buf' to hold at least 'num' elements, the capacity is doubled to keep growing cheap.
+ *
+ * @return 0 on success, -1 if out of memory (the buffer is kept as it was).
+ */
+int post_process_buf_reserve(void **buf, int *capacity, int num, size_t elem_size);
+
+/**
+ * @brief a lower bound of logit(p), a value below it can not reach p after sigmoid
+ */
+float post_process_logit_lower_bound(float p);
+
+/**
+ * @brief dst[i] = max(dst[i], src[i])
+ */
+void post_process_column_max(float *dst, const float *src, int num);
+
+/**
+ * @brief allocate room for 'capacity' kept boxes.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+int post_process_kept_boxes_init(post_process_kept_boxes_t *kept, int capacity);
+
+/**
+ * @brief release the buffer of kept boxes, it can be called on a zeroed or failed one.
+ */
+void post_process_kept_boxes_release(post_process_kept_boxes_t *kept);
+
+/**
+ * @brief keep a box, the caller stops at 'capacity' boxes.
+ */
+void post_process_kept_boxes_add(post_process_kept_boxes_t *kept, const kp_bounding_box_t *box);
+
+/**
+ * @brief check if a box overlaps any kept box by IoU larger than 'nms_thresh'.
+ */
+bool post_process_is_suppressed(const post_process_kept_boxes_t *kept, const kp_bounding_box_t *box, float nms_thresh);
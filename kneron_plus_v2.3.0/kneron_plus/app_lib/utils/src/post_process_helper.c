@@ -0,0 +1,127 @@
+/**
+ * @file        post_process_helper.c
+ * @brief       post-process helper functions
+ * @version     0.1
+ * @date        2024-06-10
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "post_process_helper.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define POST_PROCESS_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define POST_PROCESS_NEON
+#include <arm_neon.h>
+#endif
+
+int post_process_buf_reserve(void **buf, int *capacity, int num, size_t elem_size)
+{
+    if (num <= *capacity)
+        return 0;
+
+    int new_capacity = (0 < *capacity) ? *capacity : num;
+
+    while (new_capacity < num)
+        new_capacity *= 2;
+
+    void *new_buf = realloc(*buf, new_capacity * elem_size);
+    if (NULL == new_buf)
+        return -1;
+
+    *buf = new_buf;
+    *capacity = new_capacity;
+
+    return 0;
+}
+
+float post_process_logit_lower_bound(float p)
+{
+    if (p <= 0)
+        return -INFINITY;
+    else if (p > 0.999f)
+        p = 0.999f; // sigmoid() is saturated near 1, keep the bound finite
+
+    return (float)log(p / (1.0 - p)) - 1e-3f;
+}
+
+void post_process_column_max(float *dst, const float *src, int num)
+{
+    int i = 0;
+
+#if defined(POST_PROCESS_X86)
+    for (; i + 4 <= num; i += 4)
+        _mm_storeu_ps(dst + i, _mm_max_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+#elif defined(POST_PROCESS_NEON)
+    for (; i + 4 <= num; i += 4)
+        vst1q_f32(dst + i, vmaxq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+#endif
+
+    for (; i < num; i++)
+        dst[i] = (src[i] > dst[i]) ? src[i] : dst[i];
+}
+
+int post_process_kept_boxes_init(post_process_kept_boxes_t *kept, int capacity)
+{
+    // one buffer for all five arrays
+    kept->x1 = (float *)malloc(5 * capacity * sizeof(float));
+    kept->count = 0;
+    kept->capacity = 0;
+
+    if (NULL == kept->x1)
+        return -1;
+
+    kept->y1 = kept->x1 + capacity;
+    kept->x2 = kept->y1 + capacity;
+    kept->y2 = kept->x2 + capacity;
+    kept->area = kept->y2 + capacity;
+    kept->capacity = capacity;
+
+    return 0;
+}
+
+void post_process_kept_boxes_release(post_process_kept_boxes_t *kept)
+{
+    free(kept->x1);
+    kept->x1 = NULL;
+    kept->count = 0;
+    kept->capacity = 0;
+}
+
+void post_process_kept_boxes_add(post_process_kept_boxes_t *kept, const kp_bounding_box_t *box)
+{
+    int i = kept->count++;
+
+    kept->x1[i] = box->x1;
+    kept->y1[i] = box->y1;
+    kept->x2[i] = box->x2;
+    kept->y2[i] = box->y2;
+    kept->area[i] = (box->y2 - box->y1) * (box->x2 - box->x1);
+}
+
+bool post_process_is_suppressed(const post_process_kept_boxes_t *kept, const kp_bounding_box_t *box, float nms_thresh)
+{
+    float area = (box->y2 - box->y1) * (box->x2 - box->x1);
+    int suppressed = 0;
+
+    // branch-free over kept boxes so the compiler can vectorize it
+    for (int i = 0; i < kept->count; i++)
+    {
+        float left = (kept->x1[i] > box->x1) ? kept->x1[i] : box->x1;
+        float right = (kept->x2[i] < box->x2) ? kept->x2[i] : box->x2;
+        float top = (kept->y1[i] > box->y1) ? kept->y1[i] : box->y1;
+        float bottom = (kept->y2[i] < box->y2) ? kept->y2[i] : box->y2;
+        float w = right - left;
+        float h = bottom - top;
+        float intersection = ((w < 0) || (h < 0)) ? 0 : w * h;
+
+        suppressed |= ((intersection / (kept->area[i] + area - intersection)) > nms_thresh);
+    }
+
+    return (0 != suppressed);
+}
@@ -16,6 +16,7 @@
 #include <math.h>
 
 #include "helper_functions.h"
+#include "kp_image_convert.h"
 
 static struct timeval time_begin;
 static struct timeval time_end;
@@ -235,8 +236,6 @@ char *helper_bmp_file_to_raw_buffer(const char *file_path, int *width, int *heig
     FILEHEADER header1;
     INFOHEADER header2;
 
-    unsigned short *b16_buf = NULL;
-    unsigned char  *b8_buf  = NULL;
     unsigned char *bmp_buf = NULL;
 
     char *raw_buf = NULL;
@@ -311,194 +310,34 @@ char *helper_bmp_file_to_raw_buffer(const char *file_path, int *width, int *heig
 
     if (header2.bits == 24)
     {
-        switch (format)
-        {
-        case KP_IMAGE_FORMAT_RGB565:
-        {
-            b16_buf = (unsigned short *)malloc(header2.width * header2.height * 2);
-            if ( NULL == b16_buf ) {
-                printf("Error! malloc memory for converted data failed\n");
-                goto err;
-            }
-            int rgb565_pos = 0;
-
-            for (int row = header2.height - 1; row >= 0; row--)
-            {
-                int bmp_pos = (header2.width * 3 + padding_byte_num) * row; // we only support bmp file with 3 bytes per pixel
-                for (int col = 0; col < header2.width; col++)
-                {
-                    unsigned char blue = bmp_buf[bmp_pos];
-                    unsigned char green = bmp_buf[bmp_pos + 1];
-                    unsigned char red = bmp_buf[bmp_pos + 2];
-
-                    b16_buf[rgb565_pos] = ((red & 0b11111000) << 8) | ((green & 0b11111100) << 3) | (blue >> 3);
-
-                    bmp_pos += 3;
-                    rgb565_pos++;
-                }
-            }
-
-            raw_buf = (char *)b16_buf;
-            break;
+        uint32_t raw_buf_size = kp_image_convert_get_buffer_size(format, header2.width, header2.height);
+        if (0 == raw_buf_size) {
+            printf("Error! image format is not supported or width/height is not even number\n");
+            goto err;
         }
-        case KP_IMAGE_FORMAT_RGBA8888:
-        {
-            b8_buf = (unsigned char *)malloc(header2.width * header2.height * 4);
-            if ( NULL == b8_buf ) {
-                printf("Error! malloc memory for converted data failed\n");
-                goto err;
-            }
-            int rgba8888_pos = 0;
 
-            for (int row = header2.height - 1; row >= 0; row--)
-            {
-                int bmp_pos = (header2.width * 3 + padding_byte_num) * row; // we only support bmp file with 3 bytes per pixel
-                for (int col = 0; col < header2.width; col++)
-                {
-                    unsigned char blue = bmp_buf[bmp_pos];
-                    unsigned char green = bmp_buf[bmp_pos + 1];
-                    unsigned char red = bmp_buf[bmp_pos + 2];
-
-                    b8_buf[rgba8888_pos++] = red;
-                    b8_buf[rgba8888_pos++] = green;
-                    b8_buf[rgba8888_pos++] = blue;
-                    b8_buf[rgba8888_pos++] = 0;
-
-                    bmp_pos += 3;
-                }
-            }
-
-            raw_buf = (char *)b8_buf;
-            break;
+        raw_buf = (char *)malloc(raw_buf_size);
+        if ( NULL == raw_buf ) {
+            printf("Error! malloc memory for converted data failed\n");
+            goto err;
         }
-        case KP_IMAGE_FORMAT_YUYV:
-        case KP_IMAGE_FORMAT_YCBCR422_CRY1CBY0:
-        case KP_IMAGE_FORMAT_YCBCR422_CBY1CRY0:
-        case KP_IMAGE_FORMAT_YCBCR422_Y1CRY0CB:
-        case KP_IMAGE_FORMAT_YCBCR422_Y1CBY0CR:
-        case KP_IMAGE_FORMAT_YCBCR422_CRY0CBY1:
-        case KP_IMAGE_FORMAT_YCBCR422_CBY0CRY1:
-        case KP_IMAGE_FORMAT_YCBCR422_Y0CRY1CB:
-        case KP_IMAGE_FORMAT_YCBCR422_Y0CBY1CR:
-        {
-            b8_buf = (unsigned char *)malloc(header2.width * header2.height * 2);
-            if ( NULL == b8_buf ) {
-                printf("Error! malloc memory for converted data failed\n");
-                goto err;
-            }
-            int write_pos = 0;
 
-            // generate the order mappings of (y0, cb, y1, cr) to (cr, y1, cb, y0), (cb, y1, cr, y0), ... described in the yuyv or ycbcr image format
-            int order_mapping[4] = {0};
-            generate_ycbcr_to_ycbcr_order_mapping(KP_IMAGE_FORMAT_YCBCR422_Y0CBY1CR, format, order_mapping);
-
-            for (int row = header2.height - 1; row >= 0; row--)
-            {
-                int bmp_pos = (header2.width * 3 + padding_byte_num) * row; // we only support bmp file with 3 bytes per pixel
-
-                // FIXME? How if the width is an odd number?
-                for (int col = 0; col < header2.width / 2; col++)
-                {
-                    unsigned char blue0 = bmp_buf[bmp_pos];
-                    unsigned char green0 = bmp_buf[bmp_pos + 1];
-                    unsigned char red0 = bmp_buf[bmp_pos + 2];
-
-                    unsigned char blue1 = bmp_buf[bmp_pos + 3];
-                    unsigned char green1 = bmp_buf[bmp_pos + 4];
-                    unsigned char red1 = bmp_buf[bmp_pos + 5];
-
-                    // FIXME: use integer method to speed up
-                    float output[4];
-                    output[0] = 0.299 * red0 + 0.587 * green0 + 0.114 * blue0; // y0
-                    output[1] = -0.169 * (red0 + red1) / 2 - 0.331 * (green0 + green1) / 2 + 0.5 * (blue0 + blue1) / 2 + 128; // cb
-                    output[2] = 0.299 * red1 + 0.587 * green1 + 0.114 * blue1; // y1
-                    output[3] = 0.5 * (red0 + red1) / 2 - 0.419 * (green0 + green1) / 2 - 0.081 * (blue0 + blue1) / 2 + 128;  // cr
-
-                    b8_buf[write_pos++] = (unsigned char)output[order_mapping[0]];
-                    b8_buf[write_pos++] = (unsigned char)output[order_mapping[1]];
-                    b8_buf[write_pos++] = (unsigned char)output[order_mapping[2]];
-                    b8_buf[write_pos++] = (unsigned char)output[order_mapping[3]];
-
-                    bmp_pos += 6;
-                }
-            }
-
-            raw_buf = (char *)b8_buf;
-            break;
+        kp_image_convert_t convert = kp_image_convert_create(NULL, NULL);
+        if (NULL == convert) {
+            printf("Error! create image converter failed\n");
+            goto err;
         }
-        case KP_IMAGE_FORMAT_YUV420:
-        {
-            if ((0 != header2.width % 2) || (0 != header2.height % 2)) {
-                printf("Error! width or height is not even number\n");
-                goto err;
-            }
-
-            b8_buf = (unsigned char *)malloc(header2.width * header2.height * 1.5);
-            if ( NULL == b8_buf ) {
-                printf("Error! malloc memory for converted data failed\n");
-                goto err;
-            }
 
-            int y_bias = header2.width * header2.height;
-            int u_bias = y_bias / 4;
-            int u_pos = y_bias;
-            int v_pos = y_bias + u_bias;
+        // rows of bmp are from bottom to top, so convert from the last row in memory with a negative stride
+        int bmp_stride = header2.width * 3 + padding_byte_num; // we only support bmp file with 3 bytes per pixel
+        int ret = kp_image_convert_run(convert, bmp_buf + bmp_stride * (header2.height - 1), header2.width, header2.height, -bmp_stride,
+                                       KP_IMAGE_CONVERT_SRC_BGR888, (uint8_t *)raw_buf, header2.width, header2.height, format, raw_buf_size);
 
-            for (int row = header2.height - 1; row >= 0; row -= 2)
-            {
-                int bmp_pos_row_0 = (header2.width * 3 + padding_byte_num) * row;       // we only support bmp file with 3 bytes per pixel
-                int bmp_pos_row_1 = (header2.width * 3 + padding_byte_num) * (row - 1); // we only support bmp file with 3 bytes per pixel
-                int y_write_pos_row_0 = header2.width * (header2.height - row - 1);
-                int y_write_pos_row_1 = header2.width * (header2.height - row);
-
-                for (int col = 0; col < header2.width; col += 2)
-                {
-                    unsigned char blue0 = bmp_buf[bmp_pos_row_0];
-                    unsigned char green0 = bmp_buf[bmp_pos_row_0 + 1];
-                    unsigned char red0 = bmp_buf[bmp_pos_row_0 + 2];
-
-                    unsigned char blue1 = bmp_buf[bmp_pos_row_0 + 3];
-                    unsigned char green1 = bmp_buf[bmp_pos_row_0 + 4];
-                    unsigned char red1 = bmp_buf[bmp_pos_row_0 + 5];
-
-                    unsigned char blue2 = bmp_buf[bmp_pos_row_1];
-                    unsigned char green2 = bmp_buf[bmp_pos_row_1 + 1];
-                    unsigned char red2 = bmp_buf[bmp_pos_row_1 + 2];
-
-                    unsigned char blue3 = bmp_buf[bmp_pos_row_1 + 3];
-                    unsigned char green3 = bmp_buf[bmp_pos_row_1 + 4];
-                    unsigned char red3 = bmp_buf[bmp_pos_row_1 + 5];
-
-                    float y[2][2];
-                    float u, v;
-
-                    y[0][0] = 0.299 * red0 + 0.587 * green0 + 0.114 * blue0;
-                    y[0][1] = 0.299 * red1 + 0.587 * green1 + 0.114 * blue1;
-                    y[1][0] = 0.299 * red2 + 0.587 * green2 + 0.114 * blue2;
-                    y[1][1] = 0.299 * red3 + 0.587 * green3 + 0.114 * blue3;
-
-                    u = -0.169 * (red0 + red1 + red2 + red3) / 4 - 0.331 * (green0 + green1 + green2 + green3) / 4 + 0.5 * (blue0 + blue1 + blue2 + blue3) / 4 + 128;
-                    v = 0.5 * (red0 + red1 + red2 + red3) / 4 - 0.419 * (green0 + green1 + green2 + green3) / 4 - 0.081 * (blue0 + blue1 + blue2 + blue3) / 4 + 128;
-
-                    b8_buf[y_write_pos_row_0++] = (unsigned char)y[0][0];
-                    b8_buf[y_write_pos_row_0++] = (unsigned char)y[0][1];
-                    b8_buf[y_write_pos_row_1++] = (unsigned char)y[1][0];
-                    b8_buf[y_write_pos_row_1++] = (unsigned char)y[1][0];
-                    b8_buf[u_pos++] = (unsigned char)u;
-                    b8_buf[v_pos++] = (unsigned char)v;
-
-                    bmp_pos_row_0 += 6;
-                    bmp_pos_row_1 += 6;
-                }
-            }
+        kp_image_convert_destroy(convert);
 
-            raw_buf = (char *)b8_buf;
-            break;
-        }
-        case KP_IMAGE_FORMAT_UNKNOWN:
-        default:
-            printf("image format is not supported\n");
-            break;
+        if (KP_SUCCESS != ret) {
+            printf("Error! convert image failed, error = %d\n", ret);
+            goto err;
         }
     }
     else
@@ -512,8 +351,7 @@ char *helper_bmp_file_to_raw_buffer(const char *file_path, int *width, int *heig
 
 err:
     free(bmp_buf);
-    free(b16_buf);
-    free(b8_buf);
+    free(raw_buf);
 
     return NULL;
 }
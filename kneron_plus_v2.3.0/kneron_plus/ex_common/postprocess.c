@@ -13,23 +13,17 @@
 #include <string.h>
 
 #include "postprocess.h"
+#include "post_process_helper.h"
 
 #define YOLO_V3_CELL_BOX_NUM 3
 #define YOLO_V3_BOX_FIX_CH 5
 #define NMS_THRESH_YOLOV3_520 0.45
 #define NMS_THRESH_YOLOV5_720 0.5
-#define MAX_POSSIBLE_BOXES 2000
+#define MAX_POSSIBLE_BOXES 2000           // initial capacity of candidate boxes, the workspace grows if more are found
 #define MODEL_SHIRNK_RATIO_TYV3 32
 #define MODEL_SHIRNK_RATIO_V5 8
 #define YOLO_MAX_DETECTION_PER_CLASS 100
 
-/* IOU Methods */
-enum IOU_TYPE
-{
-    IOU_UNION = 0,
-    IOU_MIN,
-};
-
 const float yolo_v3_anchers[3][3][2] = {
     {{81, 82}, {135, 169}, {344, 319}},
     {{23, 27}, {37, 58}, {81, 82}},
@@ -98,63 +92,6 @@ static int box_comparator(const void *box_1, const void *box_2)
     return int_comparator(_box_1->y2, _box_2->y2);
 }
 
-static float overlap(float l1, float r1, float l2, float r2)
-{
-    float left = l1 > l2 ? l1 : l2;
-    float right = r1 < r2 ? r1 : r2;
-    return right - left;
-}
-
-static float box_intersection(kp_bounding_box_t *a, kp_bounding_box_t *b)
-{
-    float w, h, area;
-
-    w = overlap(a->x1, a->x2, b->x1, b->x2);
-    h = overlap(a->y1, a->y2, b->y1, b->y2);
-
-    if (w < 0 || h < 0)
-        return 0;
-
-    area = w * h;
-    return area;
-}
-
-static float box_union(kp_bounding_box_t *a, kp_bounding_box_t *b)
-{
-    float i, u;
-
-    i = box_intersection(a, b);
-    u = (a->y2 - a->y1) * (a->x2 - a->x1) + (b->y2 - b->y1) * (b->x2 - b->x1) - i;
-
-    return u;
-}
-
-static float box_iou(kp_bounding_box_t *a, kp_bounding_box_t *b, int nms_type)
-{
-    float c = 0.;
-    switch (nms_type)
-    {
-    case IOU_MIN:
-        if (box_intersection(a, b) / box_intersection(a, a) > box_intersection(a, b) / box_intersection(b, b))
-        {
-            c = box_intersection(a, b) / box_intersection(a, a);
-        }
-        else
-        {
-            c = box_intersection(a, b) / box_intersection(b, b);
-        }
-        break;
-    default:
-        if (c < box_intersection(a, b) / box_union(a, b))
-        {
-            c = box_intersection(a, b) / box_union(a, b);
-        }
-        break;
-    }
-
-    return c;
-}
-
 void boxes_scale(kp_bounding_box_t *boxes, int size, kp_hw_pre_proc_info_t *pre_proc_info)
 {
     int img_width = pre_proc_info->img_width;
@@ -183,225 +120,210 @@ void boxes_scale(kp_bounding_box_t *boxes, int size, kp_hw_pre_proc_info_t *pre_
     }
 }
 
-int post_process_yolo_v3(kp_inf_float_node_output_t *node_output[], int num_output_node,
-                         kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+
+/******************************************************************
+ * post-process workspace
+ ******************************************************************/
+
+struct post_process_yolo_workspace_s
 {
-    int class_count = (node_output[0]->channel / YOLO_V3_CELL_BOX_NUM) - YOLO_V3_BOX_FIX_CH;
-    float *box_class_probs = NULL;
-    kp_bounding_box_t *possible_boxes = NULL;
-    kp_bounding_box_t *temp_boxes = NULL;
-    int good_box_count = 0;
-    int good_result_count = 0;
+    kp_bounding_box_t *candidates;      // candidate boxes of all classes in scanning order
+    int candidate_capacity;
+    int num_candidate;
+    bool candidate_dropped;             // set if candidates were dropped because the workspace could not grow
+
+    kp_bounding_box_t *class_boxes;     // candidate boxes grouped by class (bucket of class i starts at class_start[i])
+    int class_box_capacity;
 
-    box_class_probs = (float *)malloc(class_count * sizeof(float));
-    if (NULL == box_class_probs ) {
-        printf("Error! %s(): malloc memory for probs failed\n", __FUNCTION__);
-        goto err;
+    int *class_start;
+    int class_capacity;
+
+    float *column_max;                  // maximum class value of each grid column
+    int column_capacity;
+
+    post_process_kept_boxes_t kept;     // boxes kept by NMS of the current class
+};
+
+post_process_yolo_workspace_t *post_process_yolo_create_workspace(void)
+{
+    post_process_yolo_workspace_t *ws = (post_process_yolo_workspace_t *)calloc(1, sizeof(post_process_yolo_workspace_t));
+    if (NULL == ws)
+        return NULL;
+
+    if ((0 != post_process_buf_reserve((void **)&ws->candidates, &ws->candidate_capacity, MAX_POSSIBLE_BOXES, sizeof(kp_bounding_box_t))) ||
+        (0 != post_process_buf_reserve((void **)&ws->class_boxes, &ws->class_box_capacity, MAX_POSSIBLE_BOXES, sizeof(kp_bounding_box_t))) ||
+        (0 != post_process_kept_boxes_init(&ws->kept, YOLO_MAX_DETECTION_PER_CLASS))) {
+        post_process_yolo_release_workspace(ws);
+        return NULL;
     }
 
-    possible_boxes = (kp_bounding_box_t *)malloc(MAX_POSSIBLE_BOXES * sizeof(kp_bounding_box_t));
-    if (NULL == possible_boxes) {
-        printf("Error! %s(): malloc memory for boxes failed\n", __FUNCTION__);
-        goto err;
+    return ws;
+}
+
+void post_process_yolo_release_workspace(post_process_yolo_workspace_t *ws)
+{
+    if (NULL == ws)
+        return;
+
+    free(ws->candidates);
+    free(ws->class_boxes);
+    free(ws->class_start);
+    free(ws->column_max);
+    post_process_kept_boxes_release(&ws->kept);
+    free(ws);
+}
+
+static int ws_prepare(post_process_yolo_workspace_t *ws, kp_inf_float_node_output_t *node_output[], int num_output_node, int class_count)
+{
+    int max_grid_w = 0;
+
+    for (int i = 0; i < num_output_node; i++) {
+        if (max_grid_w < (int)node_output[i]->width)
+            max_grid_w = node_output[i]->width;
     }
-    temp_boxes = (kp_bounding_box_t *)malloc(MAX_POSSIBLE_BOXES * sizeof(kp_bounding_box_t));
-    if (NULL == temp_boxes) {
-        printf("Error! %s(): malloc memory for temp boxes failed\n", __FUNCTION__);
-        goto err;
+
+    if ((0 >= class_count) ||
+        (0 != post_process_buf_reserve((void **)&ws->class_start, &ws->class_capacity, class_count + 1, sizeof(int))) ||
+        (0 != post_process_buf_reserve((void **)&ws->column_max, &ws->column_capacity, max_grid_w, sizeof(float)))) {
+        return -1;
     }
 
-    for (int i = 0; i < num_output_node; i++)
-    {
-        int grid_w = node_output[i]->width;
-        int grid_h = node_output[i]->height;
-        int grid_c = node_output[i]->channel;
+    ws->num_candidate = 0;
+    ws->candidate_dropped = false;
 
-        int width_size = grid_w * grid_c;
-        int anchor_offset = width_size / 3;
+    return 0;
+}
 
-        float ratio_w = (float)pre_proc_info->model_input_width / grid_w;
-        float ratio_h = (float)pre_proc_info->model_input_height / grid_h;
+static void ws_add_candidate(post_process_yolo_workspace_t *ws, float x1, float y1, float x2, float y2, float score, int class_num)
+{
+    if ((ws->num_candidate >= ws->candidate_capacity) &&
+        (0 != post_process_buf_reserve((void **)&ws->candidates, &ws->candidate_capacity, ws->num_candidate + 1, sizeof(kp_bounding_box_t)))) {
+        if (!ws->candidate_dropped)
+            printf("post yolo: warning ! out of memory for %d candidate boxes, the rest are dropped\n", ws->num_candidate);
 
-        for (int row = 0; row < grid_h; row++)
-        {
-            for (int an = 0; an < YOLO_V3_CELL_BOX_NUM; an++)
-            {
-                float *data = node_output[i]->data + row * width_size + an * anchor_offset;
+        ws->candidate_dropped = true;
+        return;
+    }
 
-                float *x_p = data;
-                float *y_p = x_p + grid_w;
-                float *width_p = y_p + grid_w;
-                float *height_p = width_p + grid_w;
-                float *score_p = height_p + grid_w;
-                float *class_p = score_p + grid_w;
+    kp_bounding_box_t *box = &ws->candidates[ws->num_candidate++];
 
-                for (int col = 0; col < grid_w; col++)
-                {
-                    float box_x = *(x_p + col);
-                    float box_y = *(y_p + col);
-                    float box_w = *(width_p + col);
-                    float box_h = *(height_p + col);
-                    float box_confidence = sigmoid(*(score_p + col));
+    box->x1 = x1;
+    box->y1 = y1;
+    box->x2 = x2;
+    box->y2 = y2;
+    box->score = score;
+    box->class_num = class_num;
+}
 
-                    float x1, y1, x2, y2;
-                    bool first_box = false;
+/******************************************************************
+ * candidate scanning helpers
+ ******************************************************************/
 
-                    for (int j = 0; j < class_count; j++)
-                    {
-                        box_class_probs[j] = (float)*(class_p + col + j * grid_w);
-                    }
+// maximum class value of each column, classes are 'class_stride' floats apart
+static void class_column_max(float *dst, const float *class_p, int class_stride, int class_count, int num)
+{
+    memcpy(dst, class_p, num * sizeof(float));
 
-                    /* Get scores of all class */
-                    for (int j = 0; j < class_count; j++)
-                    {
-                        float max_score = sigmoid(box_class_probs[j]) * box_confidence;
-                        if (max_score >= thresh_value)
-                        {
-                            if (!first_box)
-                            {
-                                first_box = true;
-
-                                box_x = (sigmoid(box_x) + col) * ratio_w;
-                                box_y = (sigmoid(box_y) + row) * ratio_h;
-                                box_w = exp(box_w) * yolo_v3_anchers[i][an][0];
-                                box_h = exp(box_h) * yolo_v3_anchers[i][an][1];
-
-                                x1 = box_x - (box_w / 2);
-                                y1 = box_y - (box_h / 2);
-                                x2 = box_x + (box_w / 2);
-                                y2 = box_y + (box_h / 2);
-                            }
-
-                            possible_boxes[good_box_count].x1 = x1;
-                            possible_boxes[good_box_count].y1 = y1;
-                            possible_boxes[good_box_count].x2 = x2;
-                            possible_boxes[good_box_count].y2 = y2;
-                            possible_boxes[good_box_count].score = max_score;
-                            possible_boxes[good_box_count].class_num = j;
-                            good_box_count++;
-
-                            if (good_box_count >= MAX_POSSIBLE_BOXES)
-                            {
-                                printf("post yolo v3: error ! aborted due to too many boxes\n");
-                                goto err;
-                            }
-                        }
-                    }
-                }
-            }
+    for (int j = 1; j < class_count; j++)
+        post_process_column_max(dst, class_p + j * class_stride, num);
+}
+
+// scan one grid row of one anchor with sigmoid activated scores (YOLO V3 and YOLO V5 for KL520)
+static void scan_sigmoid_row(post_process_yolo_workspace_t *ws, float *data, int grid_w, int class_count, int row,
+                             float ratio_w, float ratio_h, const float anchor[2], float thresh_value, float score_logit_thresh, bool is_v5)
+{
+    float *x_p = data;
+    float *y_p = x_p + grid_w;
+    float *width_p = y_p + grid_w;
+    float *height_p = width_p + grid_w;
+    float *score_p = height_p + grid_w;
+    float *class_p = score_p + grid_w;
+    bool any_cell = false;
+
+    // score = sigmoid(class) * sigmoid(box score) <= sigmoid(box score), most cells are skipped here without sigmoid
+    for (int col = 0; col < grid_w; col++) {
+        if (score_p[col] >= score_logit_thresh) {
+            any_cell = true;
+            break;
         }
     }
 
-    for (int i = 0; i < class_count; i++)
+    if (!any_cell)
+        return;
+
+    class_column_max(ws->column_max, class_p, grid_w, class_count, grid_w);
+
+    for (int col = 0; col < grid_w; col++)
     {
-        kp_bounding_box_t *bbox = possible_boxes;
-        kp_bounding_box_t *r_tmp_p = temp_boxes;
+        if (score_p[col] < score_logit_thresh)
+            continue;
 
-        int class_good_box_count = 0;
+        float box_confidence = sigmoid(score_p[col]);
+        float class_logit_thresh = post_process_logit_lower_bound(thresh_value / box_confidence);
 
-        for (int j = 0; j < good_box_count; j++)
-        {
-            if (bbox->class_num == i)
-            {
-                memcpy(r_tmp_p, bbox, sizeof(kp_bounding_box_t));
-                r_tmp_p++;
-                class_good_box_count++;
-            }
-            bbox++;
-        }
+        if (ws->column_max[col] < class_logit_thresh)
+            continue;
 
-        if (class_good_box_count == 1)
-        {
-            if (good_result_count < YOLO_GOOD_BOX_MAX)
-            {
-                memcpy(&(yoloResult->boxes[good_result_count]), &temp_boxes[0], sizeof(kp_bounding_box_t));
-                good_result_count++;
-            }
-        }
-        else if (class_good_box_count >= 2)
+        float box_x = x_p[col];
+        float box_y = y_p[col];
+        float box_w = width_p[col];
+        float box_h = height_p[col];
+        float x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+        bool first_box = false;
+
+        for (int j = 0; j < class_count; j++)
         {
-            qsort(temp_boxes, class_good_box_count, sizeof(kp_bounding_box_t), box_comparator);
-            for (int j = 0; j < class_good_box_count; j++)
-            {
-                if (temp_boxes[j].score == 0)
-                    continue;
-                for (int k = j + 1; k < class_good_box_count; k++)
-                {
-                    if (box_iou(&temp_boxes[j], &temp_boxes[k], IOU_UNION) > NMS_THRESH_YOLOV3_520)
-                    {
-                        temp_boxes[k].score = 0;
-                    }
-                }
-            }
+            float class_value = class_p[col + j * grid_w];
 
-            int good_count = 0;
-            for (int j = 0; j < class_good_box_count; j++)
+            if (class_value < class_logit_thresh)
+                continue;
+
+            float max_score = sigmoid(class_value) * box_confidence;
+            if (max_score < thresh_value)
+                continue;
+
+            if (!first_box)
             {
-                if (temp_boxes[j].score > 0 && good_result_count < YOLO_GOOD_BOX_MAX)
+                first_box = true;
+
+                if (is_v5)
                 {
-                    memcpy(&(yoloResult->boxes[good_result_count]), &temp_boxes[j], sizeof(kp_bounding_box_t));
-                    good_result_count++;
-                    good_count++;
+                    box_x = sigmoid(box_x);
+                    box_y = sigmoid(box_y);
+                    box_w = sigmoid(box_w);
+                    box_h = sigmoid(box_h);
+
+                    box_x = ((box_x * 2 - 0.5f + col) * ratio_w);
+                    box_y = ((box_y * 2 - 0.5f + row) * ratio_h);
+                    box_w *= 2;
+                    box_h *= 2;
+                    box_w = box_w * box_w * anchor[0];
+                    box_h = box_h * box_h * anchor[1];
                 }
-                if (YOLO_MAX_DETECTION_PER_CLASS == good_count)
+                else
                 {
-                    break;
+                    box_x = (sigmoid(box_x) + col) * ratio_w;
+                    box_y = (sigmoid(box_y) + row) * ratio_h;
+                    box_w = exp(box_w) * anchor[0];
+                    box_h = exp(box_h) * anchor[1];
                 }
+
+                x1 = box_x - (box_w / 2);
+                y1 = box_y - (box_h / 2);
+                x2 = box_x + (box_w / 2);
+                y2 = box_y + (box_h / 2);
             }
-        }
 
-        // FIXME: find a better policy to filter the detected bounding box result if total box count exceeds YOLO_GOOD_BOX_MAX
-        if (good_result_count >= YOLO_GOOD_BOX_MAX)
-            break;
+            ws_add_candidate(ws, x1, y1, x2, y2, max_score, j);
+        }
     }
-
-    yoloResult->box_count = good_result_count;
-    yoloResult->class_count = class_count;
-
-    // convert the coordinate of all bounding boxes to raw image
-    boxes_scale(yoloResult->boxes, yoloResult->box_count, pre_proc_info);
-
-    free(box_class_probs);
-    free(possible_boxes);
-    free(temp_boxes);
-
-    return 0;
-
-err:
-    free(box_class_probs);
-    free(possible_boxes);
-    free(temp_boxes);
-
-    return -1;
 }
 
-int post_process_yolo_v5_520(kp_inf_float_node_output_t *node_output[], int num_output_node,
-                             kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+static void scan_sigmoid_nodes(post_process_yolo_workspace_t *ws, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                               kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, int class_count,
+                               const float anchors[3][3][2], bool is_v5)
 {
-    int class_count = (node_output[0]->channel / YOLO_V3_CELL_BOX_NUM) - YOLO_V3_BOX_FIX_CH;
-    float *box_class_probs = NULL;
-    kp_bounding_box_t *possible_boxes = NULL;
-    kp_bounding_box_t *temp_boxes = NULL;
-
-    int good_box_count = 0;
-    int good_result_count = 0;
-
-    box_class_probs = (float *)malloc(class_count * sizeof(float));
-    if (NULL == box_class_probs) {
-        printf("error! malloc %s temp space failed\n", "box class probs");
-        goto err;
-    }
-
-    possible_boxes = (kp_bounding_box_t *)malloc(MAX_POSSIBLE_BOXES * sizeof(kp_bounding_box_t));
-    if (NULL == possible_boxes){
-        printf("error! malloc %s temp space failed\n", "possible_boxes");
-        goto err;
-    }
-    temp_boxes = (kp_bounding_box_t *)malloc(MAX_POSSIBLE_BOXES * sizeof(kp_bounding_box_t));
-    if (NULL == temp_boxes){
-        printf("error! malloc %s temp space failed\n", "temp_boxes");
-        goto err;
-    }
+    float score_logit_thresh = post_process_logit_lower_bound(thresh_value);
 
     for (int i = 0; i < num_output_node; i++)
     {
@@ -421,207 +343,16 @@ int post_process_yolo_v5_520(kp_inf_float_node_output_t *node_output[], int num_
             {
                 float *data = node_output[i]->data + row * width_size + an * anchor_offset;
 
-                float *x_p = data;
-                float *y_p = x_p + grid_w;
-                float *width_p = y_p + grid_w;
-                float *height_p = width_p + grid_w;
-                float *score_p = height_p + grid_w;
-                float *class_p = score_p + grid_w;
-
-                for (int col = 0; col < grid_w; col++)
-                {
-                    float box_x = *(x_p + col);
-                    float box_y = *(y_p + col);
-                    float box_w = *(width_p + col);
-                    float box_h = *(height_p + col);
-                    float box_confidence = sigmoid(*(score_p + col));
-
-                    float x1, y1, x2, y2;
-                    bool first_box = false;
-
-                    for (int j = 0; j < class_count; j++)
-                    {
-                        box_class_probs[j] = (float)*(class_p + col + j * grid_w);
-                    }
-
-                    /* Get scores of all class */
-                    for (int j = 0; j < class_count; j++)
-                    {
-                        float max_score = sigmoid(box_class_probs[j]) * box_confidence;
-                        if (max_score >= thresh_value)
-                        {
-                            if (!first_box)
-                            {
-                                first_box = true;
-
-                                box_x = sigmoid(box_x);
-                                box_y = sigmoid(box_y);
-                                box_w = sigmoid(box_w);
-                                box_h = sigmoid(box_h);
-
-                                box_x = ((box_x * 2 - 0.5f + col) * ratio_w);
-                                box_y = ((box_y * 2 - 0.5f + row) * ratio_h);
-                                box_w *= 2;
-                                box_h *= 2;
-                                box_w = box_w * box_w * yolo_v5_anchers[i][an][0];
-                                box_h = box_h * box_h * yolo_v5_anchers[i][an][1];
-
-                                x1 = (box_x - (box_w / 2));
-                                y1 = (box_y - (box_h / 2));
-                                x2 = (box_x + (box_w / 2));
-                                y2 = (box_y + (box_h / 2));
-                            }
-
-                            possible_boxes[good_box_count].x1 = x1;
-                            possible_boxes[good_box_count].y1 = y1;
-                            possible_boxes[good_box_count].x2 = x2;
-                            possible_boxes[good_box_count].y2 = y2;
-                            possible_boxes[good_box_count].score = max_score;
-                            possible_boxes[good_box_count].class_num = j;
-                            good_box_count++;
-
-                            if (good_box_count >= MAX_POSSIBLE_BOXES)
-                            {
-                                printf("post yolo v5: error ! aborted due to too many boxes\n");
-                                goto err;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    for (int i = 0; i < class_count; i++)
-    {
-        kp_bounding_box_t *bbox = possible_boxes;
-        kp_bounding_box_t *r_tmp_p = temp_boxes;
-
-        int class_good_box_count = 0;
-
-        for (int j = 0; j < good_box_count; j++)
-        {
-            if (bbox->class_num == i)
-            {
-                memcpy(r_tmp_p, bbox, sizeof(kp_bounding_box_t));
-                r_tmp_p++;
-                class_good_box_count++;
-            }
-            bbox++;
-        }
-
-        if (class_good_box_count == 1)
-        {
-            if (good_result_count < YOLO_GOOD_BOX_MAX)
-            {
-                memcpy(&(yoloResult->boxes[good_result_count]), &temp_boxes[0], sizeof(kp_bounding_box_t));
-                good_result_count++;
+                scan_sigmoid_row(ws, data, grid_w, class_count, row, ratio_w, ratio_h, anchors[i][an], thresh_value, score_logit_thresh, is_v5);
             }
         }
-        else if (class_good_box_count >= 2)
-        {
-            qsort(temp_boxes, class_good_box_count, sizeof(kp_bounding_box_t), box_comparator);
-            for (int j = 0; j < class_good_box_count; j++)
-            {
-                if (temp_boxes[j].score == 0)
-                    continue;
-                for (int k = j + 1; k < class_good_box_count; k++)
-                {
-                    if (box_iou(&temp_boxes[j], &temp_boxes[k], IOU_UNION) > NMS_THRESH_YOLOV3_520)
-                    {
-                        temp_boxes[k].score = 0;
-                    }
-                }
-            }
-
-            int good_count = 0;
-            for (int j = 0; j < class_good_box_count; j++)
-            {
-                if (temp_boxes[j].score > 0 && good_result_count < YOLO_GOOD_BOX_MAX)
-                {
-                    memcpy(&(yoloResult->boxes[good_result_count]), &temp_boxes[j], sizeof(kp_bounding_box_t));
-                    good_result_count++;
-                    good_count++;
-                }
-                if (YOLO_MAX_DETECTION_PER_CLASS == good_count)
-                {
-                    break;
-                }
-            }
-        }
-
-        // FIXME: find a better policy to filter the detected bounding box result if total box count exceeds YOLO_GOOD_BOX_MAX
-        if (good_result_count >= YOLO_GOOD_BOX_MAX)
-            break;
     }
-
-    yoloResult->box_count = good_result_count;
-    yoloResult->class_count = class_count;
-
-    // convert the coordinate of all bounding boxes to raw image
-    boxes_scale(yoloResult->boxes, yoloResult->box_count, pre_proc_info);
-
-    free(box_class_probs);
-    free(possible_boxes);
-    free(temp_boxes);
-
-    return 0;
-
-err:
-    free(box_class_probs);
-    free(possible_boxes);
-    free(temp_boxes);
-
-    return -1;
 }
 
-// Use to record candidate bounding box properties of each class
-typedef struct candidate_boxes
-{
-    int boxes_count;
-    float *boxes; // size should be maximum number of possible bounding boxes
-    float **scores; // size should be yolo_v5 class number * maximum number of possible bounding boxes
-} candidate_boxes;
-
-int post_process_yolo_v5_720(kp_inf_float_node_output_t *node_output[], int num_output_node,
-                             kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+// scan activated scores (YOLO V5 for KL720), the layout is anchor x channel x height x width
+static void scan_activated_nodes(post_process_yolo_workspace_t *ws, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                                 kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, int class_count)
 {
-    int class_count = (node_output[0]->channel / YOLO_V3_CELL_BOX_NUM) - YOLO_V3_BOX_FIX_CH;
-    int offset = 0;
-    float *updated_boxes = NULL;
-    kp_bounding_box_t *temp_boxes = NULL;
-    int good_result_count = 0;
-    candidate_boxes cand_boxes = {0};
-    cand_boxes.boxes_count = 0;
-
-    updated_boxes = (float *)malloc(node_output[0]->width * node_output[0]->height * 4 * sizeof(float));
-    if (NULL == updated_boxes){
-        printf("error! malloc failed\n");
-        goto err;
-    }
-
-    for (int i = 0; i < num_output_node; i++)
-        cand_boxes.boxes_count += node_output[i]->width * node_output[i]->height * 3;
-
-    cand_boxes.boxes = (float *)malloc(cand_boxes.boxes_count * 4 * sizeof(float)); // 4 means (x1, y1, x2, y2)
-    if(NULL == cand_boxes.boxes) {
-        printf("error! malloc failed\n");
-        goto err;
-    }
-    cand_boxes.scores = (float **)malloc(class_count * sizeof(float *));
-    if(NULL == cand_boxes.scores) {
-        printf("error! malloc failed\n");
-        goto err;
-    }
-
-    for (int i = 0; i < class_count; i++) {
-        cand_boxes.scores[i] = (float*)malloc(cand_boxes.boxes_count * sizeof(float));
-        if(NULL == cand_boxes.scores[i]) {
-            printf("error! malloc failed\n");
-            goto err;
-        }
-    }
-
     for (int i = 0; i < num_output_node; i++)
     {
         int ratio_w = pre_proc_info->model_input_width / node_output[i]->width;
@@ -630,135 +361,140 @@ int post_process_yolo_v5_720(kp_inf_float_node_output_t *node_output[], int num_
         int ncols = node_output[i]->width;
         int nchs = node_output[i]->channel;
 
-        // following comments are from kdp
-        // node 0 : 1 x 255 x 80 x 80, reshape to 1 x 3 x 85 x 80 x 80, transpose to 1 x 3 x 80 x 80 x 85
-        // node 1 : 1 x 255 x 40 x 40, reshape to 1 x 3 x 85 x 40 x 40, transpose to 1 x 3 x 40 x 40 x 85
-        // node 2 : 1 x 255 x 20 x 20, reshape to 1 x 3 x 85 x 20 x 20, transpose to 1 x 3 x 20 x 20 x 85
         int stride1 = (nchs / YOLO_V3_CELL_BOX_NUM) * nrows * ncols;
         int stride2 = nrows * ncols;
-        int stride3 = ncols;
 
-        // scan scores -> divide to 3 (YOLO_V3_CELL_BOX_NUM) hunks of data
         for (int k = 0; k < YOLO_V3_CELL_BOX_NUM; k++)
         {
-            // update anchor
+            float *boxes = &node_output[i]->data[k * stride1];
+            float *box_prob = &boxes[4 * stride2];
+            float *class_prob = &boxes[YOLO_V3_BOX_FIX_CH * stride2];
+
             for (int row = 0; row < nrows; row++)
             {
+                class_column_max(ws->column_max, class_prob + row * ncols, stride2, class_count, ncols);
+
                 for (int col = 0; col < ncols; col++)
                 {
-                    float *boxes = &node_output[i]->data[k * stride1];
-
-                    int index = row * stride3 + col;
-                    float box_x = boxes[index + 0 * stride2];
-                    float box_y = boxes[index + 1 * stride2];
-                    float box_w = boxes[index + 2 * stride2];
-                    float box_h = boxes[index + 3 * stride2];
-                    float grid_x = (float)col;
-                    float grid_y = (float)row;
-
-                    box_w = (box_w * box_w);
-                    box_h = (box_h * box_h);
-                    float _x = (box_x * 2 - 0.5 + grid_x) * ratio_w;
-                    float _y = (box_y * 2 - 0.5 + grid_y) * ratio_h;
-                    float _w = box_w * 4 * yolo_v5_anchers[i][k][0];
-                    float _h = box_h * 4 * yolo_v5_anchers[i][k][1];
-                    float xleft = (_x - _w / 2);
-                    float yleft = (_y - _h / 2);
-
-                    updated_boxes[4 * index + 0] = xleft;
-                    updated_boxes[4 * index + 1] = yleft;
-                    updated_boxes[4 * index + 2] = xleft + _w;
-                    updated_boxes[4 * index + 3] = yleft + _h;
-                }
-            }
+                    int index = row * ncols + col;
+                    float box_score = box_prob[index];
 
-            // Collect all boxes candidates from 3 nodes and put them in a 1D long array
-            memcpy(&cand_boxes.boxes[(offset + k * nrows * ncols) * 4], updated_boxes, 4 * nrows * ncols * sizeof(float));
+                    // the product is monotonic in class probability if box probability is positive
+                    if ((box_score > 0) && (box_score * ws->column_max[col] <= thresh_value))
+                        continue;
 
-            // Find probability of each bounding box
-            float *box_prob = &node_output[i]->data[k * stride1 + 4 * stride2];
+                    bool first_box = false;
+                    float xleft = 0, yleft = 0, _w = 0, _h = 0;
 
-            // Find probability of each class
-            for (int c = YOLO_V3_BOX_FIX_CH; c < nchs / YOLO_V3_CELL_BOX_NUM; c++)
-            {
-                float *class_prob = &node_output[i]->data[k * stride1 + c * stride2];
-                int count = 0;
-                for (int row = 0; row < nrows; row++)
-                {
-                    for (int col = 0; col < ncols; col++)
+                    for (int c = 0; c < class_count; c++)
                     {
-                        // Find score by multiplying probability of each bounding box and that of each class
-                        cand_boxes.scores[c - YOLO_V3_BOX_FIX_CH][offset + k * nrows * ncols + count] = box_prob[row * ncols + col] * class_prob[row * ncols + col];
-                        count++;
+                        float score = box_score * class_prob[c * stride2 + index];
+
+                        if (score <= thresh_value)
+                            continue;
+
+                        if (!first_box)
+                        {
+                            first_box = true;
+
+                            float box_x = boxes[index + 0 * stride2];
+                            float box_y = boxes[index + 1 * stride2];
+                            float box_w = boxes[index + 2 * stride2];
+                            float box_h = boxes[index + 3 * stride2];
+                            float grid_x = (float)col;
+                            float grid_y = (float)row;
+
+                            box_w = (box_w * box_w);
+                            box_h = (box_h * box_h);
+                            float _x = (box_x * 2 - 0.5 + grid_x) * ratio_w;
+                            float _y = (box_y * 2 - 0.5 + grid_y) * ratio_h;
+                            _w = box_w * 4 * yolo_v5_anchers[i][k][0];
+                            _h = box_h * 4 * yolo_v5_anchers[i][k][1];
+                            xleft = (_x - _w / 2);
+                            yleft = (_y - _h / 2);
+                        }
+
+                        ws_add_candidate(ws, xleft, yleft, xleft + _w, yleft + _h, score, c);
                     }
                 }
             }
         }
-        offset += (YOLO_V3_CELL_BOX_NUM * nrows * ncols);
     }
+}
+
+/******************************************************************
+ * NMS
+ ******************************************************************/
+
+// largest float which is not larger than the double threshold, so 'iou > thresh' is computed in float exactly
+static float float_threshold(double thresh)
+{
+    float f = (float)thresh;
+
+    return ((double)f > thresh) ? nextafterf(f, -INFINITY) : f;
+}
+
+/**
+ * Candidates are grouped by class with a counting sort, each class is sorted by score,
+ * then a box is kept if it does not overlap any kept box of its class.
+ * Only kept boxes are compared and a class stops at YOLO_MAX_DETECTION_PER_CLASS kept boxes,
+ * so the cost is linear in the number of candidates.
+ */
+static void nms_to_result(post_process_yolo_workspace_t *ws, int class_count, double nms_thresh, kp_yolo_result_t *yoloResult)
+{
+    int *class_start = ws->class_start;
+    int good_result_count = 0;
+    float iou_thresh = float_threshold(nms_thresh);
 
-    temp_boxes = (kp_bounding_box_t *)malloc(cand_boxes.boxes_count * sizeof(kp_bounding_box_t));
-    if (NULL == temp_boxes) {
-        printf("error! malloc temp working buffer failed\n");
-        goto err;
+    if (0 != post_process_buf_reserve((void **)&ws->class_boxes, &ws->class_box_capacity, ws->num_candidate, sizeof(kp_bounding_box_t))) {
+        printf("post yolo: error ! out of memory for %d candidate boxes\n", ws->num_candidate);
+        ws->num_candidate = 0;
     }
 
+    memset(class_start, 0, (class_count + 1) * sizeof(int));
+
+    for (int i = 0; i < ws->num_candidate; i++)
+        class_start[ws->candidates[i].class_num + 1]++;
+
     for (int i = 0; i < class_count; i++)
-    {
-        kp_bounding_box_t *r_tmp_p = temp_boxes;
+        class_start[i + 1] += class_start[i];
 
-        int class_good_box_count = 0;
+    for (int i = 0; i < ws->num_candidate; i++)
+        ws->class_boxes[class_start[ws->candidates[i].class_num]++] = ws->candidates[i];
 
-        for (int box_idx = 0; box_idx < cand_boxes.boxes_count; box_idx++)
-        {
-            if (cand_boxes.scores[i][box_idx] > thresh_value)
-            {
-                memcpy(r_tmp_p, cand_boxes.boxes + 4 * box_idx, 4 * sizeof(float)); // copy (x1, y1, x2, y2) //-V::512
-                r_tmp_p->class_num = i;
-                r_tmp_p->score = cand_boxes.scores[i][box_idx];
+    // class_start[i] is the end of class i now
+    for (int i = class_count; i > 0; i--)
+        class_start[i] = class_start[i - 1];
+    class_start[0] = 0;
 
-                r_tmp_p++;
-                class_good_box_count++;
-            }
-        }
+    for (int i = 0; i < class_count; i++)
+    {
+        kp_bounding_box_t *boxes = &ws->class_boxes[class_start[i]];
+        int class_good_box_count = class_start[i + 1] - class_start[i];
 
         if (class_good_box_count == 1)
         {
-            if (good_result_count < YOLO_GOOD_BOX_MAX)
-            {
-                memcpy(&(yoloResult->boxes[good_result_count]), &temp_boxes[0], sizeof(kp_bounding_box_t));
-                good_result_count++;
-            }
+            memcpy(&(yoloResult->boxes[good_result_count]), &boxes[0], sizeof(kp_bounding_box_t));
+            good_result_count++;
         }
         else if (class_good_box_count >= 2)
         {
-            qsort(temp_boxes, class_good_box_count, sizeof(kp_bounding_box_t), box_comparator);
+            ws->kept.count = 0;
+
+            qsort(boxes, class_good_box_count, sizeof(kp_bounding_box_t), box_comparator);
+
             for (int j = 0; j < class_good_box_count; j++)
             {
-                if (temp_boxes[j].score == 0)
+                if (!(boxes[j].score > 0) || post_process_is_suppressed(&ws->kept, &boxes[j], iou_thresh))
                     continue;
-                for (int k = j + 1; k < class_good_box_count; k++)
-                {
-                    if (box_iou(&temp_boxes[j], &temp_boxes[k], IOU_UNION) > NMS_THRESH_YOLOV5_720)
-                    {
-                        temp_boxes[k].score = 0;
-                    }
-                }
-            }
 
-            int good_count = 0;
-            for (int j = 0; j < class_good_box_count; j++)
-            {
-                if (temp_boxes[j].score > 0 && good_result_count < YOLO_GOOD_BOX_MAX)
-                {
-                    memcpy(&(yoloResult->boxes[good_result_count]), &temp_boxes[j], sizeof(kp_bounding_box_t));
-                    good_result_count++;
-                    good_count++;
-                }
-                if (YOLO_MAX_DETECTION_PER_CLASS == good_count)
-                {
+                post_process_kept_boxes_add(&ws->kept, &boxes[j]);
+
+                memcpy(&(yoloResult->boxes[good_result_count]), &boxes[j], sizeof(kp_bounding_box_t));
+                good_result_count++;
+
+                if ((YOLO_MAX_DETECTION_PER_CLASS == ws->kept.count) || (good_result_count >= YOLO_GOOD_BOX_MAX))
                     break;
-                }
             }
         }
 
@@ -769,39 +505,105 @@ int post_process_yolo_v5_720(kp_inf_float_node_output_t *node_output[], int num_
 
     yoloResult->box_count = good_result_count;
     yoloResult->class_count = class_count;
+}
+
+/******************************************************************
+ * post-process functions
+ ******************************************************************/
+
+int post_process_yolo_v3_with_workspace(post_process_yolo_workspace_t *ws, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                                        kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+{
+    int class_count = (node_output[0]->channel / YOLO_V3_CELL_BOX_NUM) - YOLO_V3_BOX_FIX_CH;
+
+    if ((NULL == ws) || (0 != ws_prepare(ws, node_output, num_output_node, class_count))) {
+        printf("Error! %s(): prepare workspace failed\n", __FUNCTION__);
+        return -1;
+    }
+
+    scan_sigmoid_nodes(ws, node_output, num_output_node, pre_proc_info, thresh_value, class_count, yolo_v3_anchers, false);
+
+    nms_to_result(ws, class_count, NMS_THRESH_YOLOV3_520, yoloResult);
 
     // convert the coordinate of all bounding boxes to raw image
     boxes_scale(yoloResult->boxes, yoloResult->box_count, pre_proc_info);
 
-    free(updated_boxes);
+    return 0;
+}
+
+int post_process_yolo_v5_520_with_workspace(post_process_yolo_workspace_t *ws, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                                            kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+{
+    int class_count = (node_output[0]->channel / YOLO_V3_CELL_BOX_NUM) - YOLO_V3_BOX_FIX_CH;
+
+    if ((NULL == ws) || (0 != ws_prepare(ws, node_output, num_output_node, class_count))) {
+        printf("Error! %s(): prepare workspace failed\n", __FUNCTION__);
+        return -1;
+    }
+
+    scan_sigmoid_nodes(ws, node_output, num_output_node, pre_proc_info, thresh_value, class_count, yolo_v5_anchers, true);
 
-    free(cand_boxes.boxes);
-    for(int i = 0; i < class_count; i++)
-        free(cand_boxes.scores[i]);
-    free(cand_boxes.scores);
+    nms_to_result(ws, class_count, NMS_THRESH_YOLOV3_520, yoloResult);
 
-    free(temp_boxes);
+    // convert the coordinate of all bounding boxes to raw image
+    boxes_scale(yoloResult->boxes, yoloResult->box_count, pre_proc_info);
 
     return 0;
+}
 
-err:
-    if (NULL != updated_boxes) {
-        free(updated_boxes);
-    }
+int post_process_yolo_v5_720_with_workspace(post_process_yolo_workspace_t *ws, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                                            kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+{
+    int class_count = (node_output[0]->channel / YOLO_V3_CELL_BOX_NUM) - YOLO_V3_BOX_FIX_CH;
 
-    if (NULL != cand_boxes.boxes) {
-        free(cand_boxes.boxes);
+    if ((NULL == ws) || (0 != ws_prepare(ws, node_output, num_output_node, class_count))) {
+        printf("Error! %s(): prepare workspace failed\n", __FUNCTION__);
+        return -1;
     }
 
-    if (NULL != cand_boxes.scores) {
-        for (int i = 0; i < class_count; i++) {
-            if (NULL != cand_boxes.scores[i]) {
-                free(cand_boxes.scores[i]);
-            }
-        }
+    scan_activated_nodes(ws, node_output, num_output_node, pre_proc_info, thresh_value, class_count);
 
-        free(cand_boxes.scores);
-    }
+    nms_to_result(ws, class_count, NMS_THRESH_YOLOV5_720, yoloResult);
+
+    // convert the coordinate of all bounding boxes to raw image
+    boxes_scale(yoloResult->boxes, yoloResult->box_count, pre_proc_info);
 
     return 0;
 }
+
+typedef int (*post_process_yolo_func_t)(post_process_yolo_workspace_t *ws, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                                        kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult);
+
+static int post_process_yolo_once(post_process_yolo_func_t func, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                                  kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+{
+    post_process_yolo_workspace_t *ws = post_process_yolo_create_workspace();
+    if (NULL == ws) {
+        printf("Error! %s(): malloc memory for workspace failed\n", __FUNCTION__);
+        return -1;
+    }
+
+    int ret = func(ws, node_output, num_output_node, pre_proc_info, thresh_value, yoloResult);
+
+    post_process_yolo_release_workspace(ws);
+
+    return ret;
+}
+
+int post_process_yolo_v3(kp_inf_float_node_output_t *node_output[], int num_output_node,
+                         kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+{
+    return post_process_yolo_once(post_process_yolo_v3_with_workspace, node_output, num_output_node, pre_proc_info, thresh_value, yoloResult);
+}
+
+int post_process_yolo_v5_520(kp_inf_float_node_output_t *node_output[], int num_output_node,
+                             kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+{
+    return post_process_yolo_once(post_process_yolo_v5_520_with_workspace, node_output, num_output_node, pre_proc_info, thresh_value, yoloResult);
+}
+
+int post_process_yolo_v5_720(kp_inf_float_node_output_t *node_output[], int num_output_node,
+                             kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult)
+{
+    return post_process_yolo_once(post_process_yolo_v5_720_with_workspace, node_output, num_output_node, pre_proc_info, thresh_value, yoloResult);
+}
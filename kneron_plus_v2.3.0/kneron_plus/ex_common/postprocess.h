@@ -15,6 +15,27 @@
 #include <stdint.h>
 #include "kp_struct.h"
 
+/**
+ * @brief a workspace of YOLO post-processing, it keeps buffers of candidate boxes between frames.
+ *
+ * A workspace can be used by one thread at a time, create one workspace per thread for concurrent post-processing.
+ */
+typedef struct post_process_yolo_workspace_s post_process_yolo_workspace_t;
+
+/**
+ * @brief Create a workspace for post_process_yolo_*_with_workspace() functions.
+ *
+ * @return the workspace, NULL if out of memory.
+ */
+post_process_yolo_workspace_t *post_process_yolo_create_workspace(void);
+
+/**
+ * @brief Release a workspace created by post_process_yolo_create_workspace().
+ *
+ * @param[in] workspace the workspace, it can be NULL.
+ */
+void post_process_yolo_release_workspace(post_process_yolo_workspace_t *workspace);
+
 /**
  * @brief YOLO V3 post-processing function for KL520.
  *
@@ -56,3 +77,33 @@ int post_process_yolo_v5_520(kp_inf_float_node_output_t *node_output[], int num_
  */
 int post_process_yolo_v5_720(kp_inf_float_node_output_t *node_output[], int num_output_node,
                              kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult);
+
+/**
+ * @brief post_process_yolo_v3() with a workspace, no memory is allocated once the workspace is large enough.
+ *
+ * @param[in] workspace the workspace from post_process_yolo_create_workspace().
+ *
+ * Other parameters and the return value are the same as post_process_yolo_v3().
+ */
+int post_process_yolo_v3_with_workspace(post_process_yolo_workspace_t *workspace, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                                        kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult);
+
+/**
+ * @brief post_process_yolo_v5_520() with a workspace, no memory is allocated once the workspace is large enough.
+ *
+ * @param[in] workspace the workspace from post_process_yolo_create_workspace().
+ *
+ * Other parameters and the return value are the same as post_process_yolo_v5_520().
+ */
+int post_process_yolo_v5_520_with_workspace(post_process_yolo_workspace_t *workspace, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                                            kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult);
+
+/**
+ * @brief post_process_yolo_v5_720() with a workspace, no memory is allocated once the workspace is large enough.
+ *
+ * @param[in] workspace the workspace from post_process_yolo_create_workspace().
+ *
+ * Other parameters and the return value are the same as post_process_yolo_v5_720().
+ */
+int post_process_yolo_v5_720_with_workspace(post_process_yolo_workspace_t *workspace, kp_inf_float_node_output_t *node_output[], int num_output_node,
+                                            kp_hw_pre_proc_info_t *pre_proc_info, float thresh_value, kp_yolo_result_t *yoloResult);
@@ -17,6 +17,7 @@ extern "C"
 {
 #include "kp_core.h"
 #include "kp_inference.h"
+#include "kp_image_convert.h"
 #include "helper_functions.h"
 #include "postprocess.h"
 }
@@ -56,7 +57,6 @@ void *image_send_function(void *data)
     static kp_bounding_box_t boxes_stabilized[YOLO_GOOD_BOX_MAX];
 
     cv::Mat _cv_img_cam;
-    cv::Mat _cv_img_rgb565;
     int img_count = 0;
     int result_count = 0;
 
@@ -89,17 +89,30 @@ void *image_send_function(void *data)
     /* Prepare display window */
     cv::namedWindow("Generic Inference", CV_WINDOW_AUTOSIZE);
 
+    /* Prepare the color converter and the buffer of the converted image */
+    kp_image_convert_t image_convert = kp_image_convert_create(NULL, NULL);
+    uint32_t rgb565_buf_size = kp_image_convert_get_buffer_size(KP_IMAGE_FORMAT_RGB565, _image_width, _image_height);
+    uint8_t *rgb565_buf = (uint8_t *)kp_image_convert_alloc_buffer(rgb565_buf_size);
+
     while (true)
     {
 
         /* Get one frame from camera */
         _cv_camera_cap.read(_cv_img_cam);
 
-        cv::cvtColor(_cv_img_cam, _cv_img_rgb565, CV_BGR2BGR565); // convert image color fomart to Kneron-specified
-        _input_data.input_node_image_list[0].image_buffer = (uint8_t *)_cv_img_rgb565.data;    // buffer of image data
+        /* Convert image color format (BGR888) to Kneron-specified */
+        int ret = kp_image_convert_run(image_convert, _cv_img_cam.data, _image_width, _image_height, (int32_t)_cv_img_cam.step,
+                                       KP_IMAGE_CONVERT_SRC_BGR888, rgb565_buf, _image_width, _image_height, KP_IMAGE_FORMAT_RGB565, rgb565_buf_size);
+        if (ret != KP_SUCCESS)
+        {
+            printf("kp_image_convert_run() error = %d (%s)\n", ret, kp_error_string(ret));
+            break;
+        }
+
+        _input_data.input_node_image_list[0].image_buffer = rgb565_buf;                       // buffer of image data
 
         /* Send buffer to generic inference */
-        int ret = kp_generic_image_inference_send(_device, &_input_data);
+        ret = kp_generic_image_inference_send(_device, &_input_data);
         if (ret != KP_SUCCESS)
         {
             printf("kp_generic_raw_inference_send() error = %d (%s)\n", ret, kp_error_string(ret));
@@ -166,6 +179,9 @@ void *image_send_function(void *data)
         }
     }
 
+    kp_image_convert_free_buffer(rgb565_buf);
+    kp_image_convert_destroy(image_convert);
+
     _receive_running = false;
 
     return NULL;
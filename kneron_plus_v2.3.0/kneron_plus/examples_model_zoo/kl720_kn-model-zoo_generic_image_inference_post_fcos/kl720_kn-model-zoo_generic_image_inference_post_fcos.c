@@ -12,24 +12,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <math.h>
-#include <float.h>
 
 #include "kp_core.h"
 #include "kp_inference.h"
 #include "helper_functions.h"
-#include "postprocess.h"
-
-#define MAX_POSSIBLE_BOXES 1000
-#define NMS_THRESH 0.35
-#define MAX_DETECTION_PER_CLASS 100
-
-/* IOU Methods */
-enum IOU_TYPE
-{
-    IOU_UNION = 0,
-    IOU_MIN,
-};
+#include "kp_app_decoder.h"
 
 static char _model_file_path[128] = "../../res/models/KL720/fcos-drk53s_w512h512_kn-model-zoo/kl720_20004_fcos-drk53s_w512h512.nef";
 static char _image_file_path[128] = "../../res/images/one_bike_many_cars_800x800.bmp";
@@ -44,325 +31,6 @@ static char *_img_buf;
 static int _img_width, _img_height;
 
 
-float sigmoid(float x)
-{
-    float exp_value;
-    float return_value;
-
-    exp_value = exp(-x);
-
-    return_value = 1 / (1 + exp_value);
-
-    return return_value;
-}
-
-float overlap(float l1, float r1, float l2, float r2)
-{
-    float left = l1 > l2 ? l1 : l2;
-    float right = r1 < r2 ? r1 : r2;
-    return right - left;
-}
-
-float box_intersection(kp_bounding_box_t *a, kp_bounding_box_t *b)
-{
-    float w, h, area;
-
-    w = overlap(a->x1, a->x2, b->x1, b->x2);
-    h = overlap(a->y1, a->y2, b->y1, b->y2);
-
-    if (w < 0 || h < 0)
-        return 0;
-
-    area = w * h;
-    return area;
-}
-
-float box_union(kp_bounding_box_t *a, kp_bounding_box_t *b)
-{
-    float i, u;
-
-    i = box_intersection(a, b);
-    u = (a->y2 - a->y1) * (a->x2 - a->x1) + (b->y2 - b->y1) * (b->x2 - b->x1) - i;
-
-    return u;
-}
-
-float box_iou(kp_bounding_box_t *a, kp_bounding_box_t *b, int nms_type)
-{
-    float c = 0.;
-    switch (nms_type)
-    {
-    case IOU_MIN:
-        if (box_intersection(a, b) / box_intersection(a, a) > box_intersection(a, b) / box_intersection(b, b))
-        {
-            c = box_intersection(a, b) / box_intersection(a, a);
-        }
-        else
-        {
-            c = box_intersection(a, b) / box_intersection(b, b);
-        }
-        break;
-    default:
-        if (c < box_intersection(a, b) / box_union(a, b))
-        {
-            c = box_intersection(a, b) / box_union(a, b);
-        }
-        break;
-    }
-
-    return c;
-}
-
-int float_comparator(float float_num_1, float float_num_2)
-{
-    float diff = float_num_1 - float_num_2;
-
-    if (diff < 0)
-        return 1;
-    else if (diff > 0)
-        return -1;
-    return 0;
-}
-
-int int_comparator(int int_num_1, int int_num_2)
-{
-    int diff = int_num_1 - int_num_2;
-
-    if (diff < 0)
-        return -1;
-    else if (diff > 0)
-        return 1;
-    return 0;
-}
-
-int box_comparator(const void *box_1, const void *box_2)
-{
-    kp_bounding_box_t *_box_1 = (kp_bounding_box_t *)box_1;
-    kp_bounding_box_t *_box_2 = (kp_bounding_box_t *)box_2;
-
-    int res = float_comparator(_box_1->score, _box_2->score);
-    if (res != 0)
-        return res;
-
-    res = int_comparator(_box_1->x1, _box_2->x1);
-    if (res != 0)
-        return res;
-
-    res = int_comparator(_box_1->y1, _box_2->y1);
-    if (res != 0)
-        return res;
-
-    res = int_comparator(_box_1->x2, _box_2->x2);
-    if (res != 0)
-        return res;
-
-    return int_comparator(_box_1->y2, _box_2->y2);
-}
-
-
-
-void post_process_fcos(kp_inf_float_node_output_t *node_output[], int num_output_node,
-                       kp_hw_pre_proc_info_t *pre_proc_info, float score_thres, kp_yolo_result_t *OutputBBoxResult)
-{
-    if(NULL == OutputBBoxResult)
-        return;
-
-    kp_bounding_box_t *candidate_boxes = NULL;
-    kp_bounding_box_t *temp_boxes = NULL;
-    int img_width = pre_proc_info->img_width;
-    int img_height = pre_proc_info->img_height;
-
-    int bbox_cnt = 0;
-    int pad_left = 0;
-    int pad_top = 0;
-    float bbox_scale_width = 0.0;
-    float bbox_scale_height = 0.0;
-    int class_count = 0;
-
-    int stages = 0;
-    int good_result_count = 0;
-
-    candidate_boxes = (kp_bounding_box_t *)malloc(MAX_POSSIBLE_BOXES * sizeof(kp_bounding_box_t));
-    if(NULL == candidate_boxes) {
-        printf("error! malloc %s failed\n", "candidate_boxes");
-        goto err;
-    }
-    temp_boxes = (kp_bounding_box_t *)malloc(MAX_POSSIBLE_BOXES * sizeof(kp_bounding_box_t));
-    if(NULL == temp_boxes) {
-        printf("error! malloc %s failed\n", "temp_boxes");
-        goto err;
-    }
-
-    bbox_cnt = 0;
-    pad_left = pre_proc_info->pad_left;
-    pad_top = pre_proc_info->pad_top;
-    bbox_scale_width = (float)img_width / pre_proc_info->resized_img_width;
-    bbox_scale_height = (float)img_height / pre_proc_info->resized_img_height;
-    class_count = node_output[3]->channel;
-
-    stages = num_output_node / 3;
-
-    for(int s = 0; s < stages; s++)
-    {
-        kp_inf_float_node_output_t *reg = node_output[s];
-        kp_inf_float_node_output_t *cls = node_output[s + stages];
-        kp_inf_float_node_output_t *cts = node_output[s + stages*2];
-
-        int feature_map_w = cls->width;
-        int feature_map_h = cls->height;
-        int cls_feature_map_c = cls->channel;
-        int cts_feature_map_c = cts->channel;
-        int reg_feature_map_c = reg->channel;
-
-        float *cls_data = cls->data;
-        float *cts_data = cts->data;
-        float *reg_data = reg->data;
-        int cls_CW_block_size = feature_map_w * cls_feature_map_c; // CW in HCW data ordering
-        int cts_CW_block_size = feature_map_w * cts_feature_map_c;
-        int reg_CW_block_size = feature_map_w * reg_feature_map_c;
-        int stride = pow(2, (int)log2(((float)pre_proc_info->model_input_width / feature_map_h) + 0.5));
-
-        int max_score_cls_idx = -1;
-        float max_cls_score = FLT_MIN_10_EXP;
-        float cls_score = FLT_MIN_10_EXP;
-        float l,t,r,b,cx,cy,xmin,ymin,xmax,ymax;
-
-        for(int row = 0; row < feature_map_h; row++)
-        {
-            for(int col = 0; col < feature_map_w; col++)
-            {
-
-                // find max score
-                max_score_cls_idx = -1;
-                max_cls_score = FLT_MIN_10_EXP;
-                for(int ch = 0; ch < cls_feature_map_c; ch++)
-                {
-                    cls_score = sigmoid(*(cls_data + cls_CW_block_size*row + ch*feature_map_w + col)); // get data from HCW data ordering
-                    if(cls_score > max_cls_score)
-                    {
-                        max_cls_score = cls_score;
-                        max_score_cls_idx = ch;
-                    }
-                }
-
-                max_cls_score = sqrt(max_cls_score*(sigmoid(*(cts_data + cts_CW_block_size*row + col))));
-                if(max_cls_score > score_thres)
-                {
-                    l = *(reg_data + reg_CW_block_size*row + 0*feature_map_w + col);
-                    t = *(reg_data + reg_CW_block_size*row + 1*feature_map_w + col);
-                    r = *(reg_data + reg_CW_block_size*row + 2*feature_map_w + col);
-                    b = *(reg_data + reg_CW_block_size*row + 3*feature_map_w + col);
-                    l = l < 0 ? 0 : pow(2,3+s)*pow(l,2);
-                    t = t < 0 ? 0 : pow(2,3+s)*pow(t,2);
-                    r = r < 0 ? 0 : pow(2,3+s)*pow(r,2);
-                    b = b < 0 ? 0 : pow(2,3+s)*pow(b,2);
-
-                    cx = col*stride + stride/2;
-                    cy = row*stride + stride/2;
-                    xmin = cx-l;
-                    ymin = cy-t;
-                    xmax = cx+r;
-                    ymax = cy+b;
-
-                    candidate_boxes[bbox_cnt].x1 = xmin < pad_left ? 0 : (xmin - pad_left) * bbox_scale_width;
-                    candidate_boxes[bbox_cnt].y1 = ymin < pad_top ? 0 : (ymin - pad_top) * bbox_scale_height;
-                    candidate_boxes[bbox_cnt].x2 = xmax < pad_left ? 0 : (xmax - pad_left) * bbox_scale_width;
-                    candidate_boxes[bbox_cnt].y2 = ymax < pad_top ? 0 : (ymax - pad_top) * bbox_scale_height;
-                    candidate_boxes[bbox_cnt].score = max_cls_score;
-                    candidate_boxes[bbox_cnt].class_num = max_score_cls_idx;
-
-                    bbox_cnt++;
-
-                    if (bbox_cnt >= MAX_POSSIBLE_BOXES)
-                    {
-                        printf("fcos post process error! too many boxes\n");
-                        goto err;
-                    }
-
-                }
-
-            }
-        }
-    } // end stage
-
-    for (int i = 0; i < class_count; i++)
-    {
-        kp_bounding_box_t *bbox = candidate_boxes;
-        kp_bounding_box_t *r_tmp_p = temp_boxes;
-
-        int class_good_box_count = 0;
-
-        for (int j = 0; j < bbox_cnt; j++)
-        {
-            if (bbox->class_num == i)
-            {
-                memcpy(r_tmp_p, bbox, sizeof(kp_bounding_box_t));
-                r_tmp_p++;
-                class_good_box_count++;
-            }
-            bbox++;
-        }
-
-        if (class_good_box_count == 1)
-        {
-            memcpy(&(OutputBBoxResult->boxes[good_result_count]), &temp_boxes[0], sizeof(kp_bounding_box_t));
-            good_result_count++;
-        }
-        else if (class_good_box_count >= 2)
-        {
-            qsort(temp_boxes, class_good_box_count, sizeof(kp_bounding_box_t), box_comparator);
-            for (int j = 0; j < class_good_box_count; j++)
-            {
-                if (temp_boxes[j].score == 0)
-                    continue;
-                for (int k = j + 1; k < class_good_box_count; k++)
-                {
-                    if (box_iou(&temp_boxes[j], &temp_boxes[k], IOU_UNION) > NMS_THRESH)
-                    {
-                        temp_boxes[k].score = 0;
-                    }
-                }
-            }
-
-            int good_count = 0;
-            for (int j = 0; j < class_good_box_count; j++)
-            {
-                if (temp_boxes[j].score > 0)
-                {
-                    memcpy(&(OutputBBoxResult->boxes[good_result_count]), &temp_boxes[j], sizeof(kp_bounding_box_t));
-                    good_result_count++;
-                    good_count++;
-                }
-                if (MAX_DETECTION_PER_CLASS == good_count)
-                {
-                    break;
-                }
-            }
-        }
-    }
-
-    for (int i = 0; i < good_result_count; i++)
-    {
-        OutputBBoxResult->boxes[i].x1 = (int)(OutputBBoxResult->boxes[i].x1 + (float)0.5) < 0 ? 0 : (int)(OutputBBoxResult->boxes[i].x1 + (float)0.5);
-        OutputBBoxResult->boxes[i].y1 = (int)(OutputBBoxResult->boxes[i].y1 + (float)0.5) < 0 ? 0 : (int)(OutputBBoxResult->boxes[i].y1 + (float)0.5);
-        OutputBBoxResult->boxes[i].x2 = (int)(OutputBBoxResult->boxes[i].x2 + (float)0.5) > img_width - 1 ? img_width - 1 : (int)(OutputBBoxResult->boxes[i].x2 + (float)0.5);
-        OutputBBoxResult->boxes[i].y2 = (int)(OutputBBoxResult->boxes[i].y2 + (float)0.5) > img_height - 1 ? img_height - 1 : (int)(OutputBBoxResult->boxes[i].y2 + (float)0.5);
-    }
-
-    OutputBBoxResult->box_count = good_result_count;
-    OutputBBoxResult->class_count = class_count;
-
-err:
-
-    if (NULL != candidate_boxes)
-        free(candidate_boxes);
-
-    if (NULL != temp_boxes)
-        free(temp_boxes);
-
-    return;
-}
-
 int main(int argc, char *argv[])
 {
     // each device has a unique port ID, 0 for auto-search
@@ -460,9 +128,20 @@ int main(int argc, char *argv[])
     output_nodes[8] = kp_generic_inference_retrieve_float_node(6, raw_output_buf, KP_CHANNEL_ORDERING_HCW);
 
 
-    kp_yolo_result_t *output_bbox_result = (kp_yolo_result_t *)malloc(sizeof(kp_yolo_result_t));
-    // post-process fcos output nodes to class/bounding boxes
-    post_process_fcos(output_nodes, _output_desc.num_output_node, &_output_desc.pre_proc_info[0], 0.5, output_bbox_result);
+    kp_yolo_result_t *output_bbox_result = (kp_yolo_result_t *)calloc(1, sizeof(kp_yolo_result_t));
+
+    // post-process fcos output nodes to class/bounding boxes, nodes are reg, cls and centerness of all levels in order
+    kp_app_decoder_config_t decoder_config = {0};
+    decoder_config.head = KP_APP_DECODER_HEAD_FCOS;
+    decoder_config.channel_ordering = KP_CHANNEL_ORDERING_HCW;
+    decoder_config.score_thresh = 0.5;
+
+    kp_app_decoder_t decoder = kp_app_decoder_create(&decoder_config, &ret);
+    if (NULL != decoder)
+        ret = kp_app_decoder_run(decoder, output_nodes, _output_desc.num_output_node, &_output_desc.pre_proc_info[0], output_bbox_result, NULL, 0);
+    printf("post-process ... %s\n", (ret == KP_SUCCESS) ? "OK" : "failed");
+
+    kp_app_decoder_destroy(decoder);
 
     helper_print_yolo_box_on_bmp(output_bbox_result, _image_file_path);
 
@@ -4,6 +4,7 @@
 #include "kmdw_dfu.h"
 #include "kmdw_utils_crc.h"
 #include "kdev_flash.h"
+#include "kmdw_memxfer.h"
 #include "kmdw_model.h"
 #include "kmdw_console.h"
 #include "kdrv_clock.h"
@@ -985,3 +986,61 @@ int kmdw_dfu_switch_active_partition(u32 partition)
     }
     return SUCCESS;
 }
+
+u32 kmdw_dfu_get_model_info_flash_addr(void)
+{
+    return MODEL_INFO_FLASH_ADDR;
+}
+
+u32 kmdw_dfu_get_all_models_flash_addr(void)
+{
+    return MODEL_ALL_BIN_FLASH_ADDR;
+}
+
+u32 kmdw_dfu_get_flash_block_size(void)
+{
+    return VERIFY_BLK_SZ;
+}
+
+int kmdw_dfu_get_flash_digest(u32 flash_addr, u32 size, u32 *sector_size, u32 *digest, u32 max_sector, u32 mem_addr, u32 mem_size)
+{
+    u32 sect_size = *sector_size;
+    u32 sect_num, offset, len;
+
+    if ((flash_addr & (VERIFY_BLK_SZ - 1)) != 0)
+    {
+        err_msg("flash address does not align to 4K boundary");
+        return -1;
+    }
+
+    // a sector is always erased as a whole, so it is made of whole erase blocks
+    if (sect_size == 0)
+        sect_size = VERIFY_BLK_SZ;
+    sect_size = (sect_size + VERIFY_BLK_SZ - 1) & ~(VERIFY_BLK_SZ - 1);
+
+    // flash is read into the buffer a sector at a time, a larger sector is cut to fit it
+    if (sect_size > mem_size)
+        sect_size = mem_size & ~(VERIFY_BLK_SZ - 1);
+    if (sect_size == 0)
+    {
+        err_msg("Buffer of %d bytes too small for flash digest\n", mem_size);
+        return -1;
+    }
+
+    // a cut sector size may need more sectors than the caller has, the area is covered partly then
+    sect_num = (size + sect_size - 1) / sect_size;
+    if (sect_num > max_sector)
+        sect_num = max_sector;
+
+    for (u32 sect = 0; sect < sect_num; sect++)
+    {
+        offset = sect * sect_size;
+        len = (size - offset) > sect_size ? sect_size : (size - offset);
+
+        kdp_memxfer_flash_to_ddr(mem_addr, flash_addr + offset, len);
+        digest[sect] = kmdw_utils_crc_gen_crc32((u8 *)mem_addr, len);
+    }
+
+    *sector_size = sect_size;
+    return sect_num;
+}
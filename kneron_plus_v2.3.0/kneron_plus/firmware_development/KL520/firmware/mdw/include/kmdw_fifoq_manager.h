@@ -39,6 +39,52 @@ int kmdw_fifoq_manager_init(uint32_t image_count, uint32_t result_count);
  */
 osStatus_t kmdw_fifoq_manager_image_enqueue(uint32_t total_num_buf, uint32_t index, uint32_t buf_addr, int buf_size, uint32_t timeout, bool preempt);
 
+/**
+ * @brief enqueue one inference object to an inference lane of the "inference-waiting buffer queue"
+ *
+ * the same as kmdw_fifoq_manager_image_enqueue(), which enqueues to lane 0
+ * the dispatcher takes inference objects from the lanes by their priority and weight, refer to kmdw_fifoq_manager_image_set_lane()
+ * all buffers of a multiple-input object should be enqueued to the same lane
+ *
+ * @param total_num_buf[in] the total number of buffers should be contain in the list
+ * @param index[in] index of the buffer in the list
+ * @param lane[in] inference lane, 0 ~ (MAX_INFERENCE_LANE - 1)
+ * @param buf_addr[in] address of the buffer
+ * @param buf_size[in] size of the buffer
+ * @param timeout[in] CMSIS_RTOS_TimeOutValue or 0 in case of no time-out.
+ * @param preempt[in] preempt this result data
+ * @return osStatus_t Status code values returned by CMSIS-RTOS functions.
+ */
+osStatus_t kmdw_fifoq_manager_image_enqueue_to_lane(uint32_t total_num_buf, uint32_t index, uint32_t lane, uint32_t buf_addr, int buf_size, uint32_t timeout, bool preempt);
+
+/**
+ * @brief set the scheduling of an inference lane
+ *
+ * non-empty lanes of the highest priority (the lowest value) are always served first,
+ * lanes of the same priority are served in proportion to their weights
+ * by default lane N has priority N and weight 1
+ *
+ * @param lane[in] inference lane, 0 ~ (MAX_INFERENCE_LANE - 1)
+ * @param priority[in] priority of the lane, 0 is the highest
+ * @param weight[in] weight of the lane among lanes of the same priority, must be non-zero
+ * @return osStatus_t osOK or osErrorParameter
+ */
+osStatus_t kmdw_fifoq_manager_image_set_lane(uint32_t lane, uint32_t priority, uint32_t weight);
+
+/**
+ * @brief get queue depth and waiting time statistics of an inference lane
+ *
+ * @param lane[in] inference lane, 0 ~ (MAX_INFERENCE_LANE - 1)
+ * @param stats[out] statistics of the lane
+ * @return osStatus_t osOK or osErrorParameter
+ */
+osStatus_t kmdw_fifoq_manager_image_get_lane_stats(uint32_t lane, dual_fifo2_lane_stats_t *stats);
+
+/**
+ * @brief clear statistics of all inference lanes
+ */
+void kmdw_fifoq_manager_image_reset_lane_stats(void);
+
 /**
  * @brief request one inference object from the "inference-waiting buffer queue"
  *
@@ -135,6 +181,15 @@ osStatus_t kmdw_fifoq_manager_result_put_free_buffer(uint32_t buf_addr, int buf_
  */
 void kmdw_fifoq_manager_clean_queues(void);
 
+/**
+ * @brief Take all buffers out of the free queues, so that the fifo queue buffers can be given back and allocated again
+ * the data queues should be cleaned and the inference should be idle before
+ * @param timeout_ms[in] time in ms to wait for the buffers still in use
+ * @return true all buffers are taken out, the fifo queue buffer is not allocated any more
+ * @return false some buffer is still in use, nothing is taken out
+ */
+bool kmdw_fifoq_manager_release_buffers(uint32_t timeout_ms);
+
 /**
  * @brief Set the status of the fifo queue buffer has been allocated
  *
@@ -11,7 +11,7 @@
 #include "base.h"
 
 #define CRC16_CONSTANT 0x8005  /**< crc16 constant value */
-#define ENABLE_CRC32 0         /**< enable CRC32 check or not */
+#define ENABLE_CRC32 0         /**< enable CRC32 check of models or not */
 
 /**
  * @brief generate crc16 code
@@ -15,6 +15,10 @@
 #include "kmdw_fifoq_manager.h"
 #include "kdp2_inf_generic_raw.h"
 
+#define CROP_BATCH_WAIT_TIMEOUT_MS 5000 // longer than the parallel inference timeout of the result handler
+
+static osSemaphoreId_t _crop_batch_done = NULL; // released once per crop by the result callback
+
 void kdp2_generic_raw_inference(int num_input_buf, void **inf_input_buf_list)
 {
     // 'inf_input_buf' and 'result_buf' are provided by kdp2 middleware
@@ -246,3 +250,166 @@ void kdp2_generic_raw_inference_bypass_pre_proc(int num_input_buf, void **inf_in
 
     kmdw_fifoq_manager_result_enqueue((void *)output_header, output_header_buf_size, false);
 }
+
+static void _crop_batch_result_callback(int status, void *inf_result_buf, int inf_result_buf_size, void *ncpu_result_buf)
+{
+    // the raw output of a crop is right after its own result header in the batch slot
+    kdp2_ipc_generic_raw_result_t *crop_header = (kdp2_ipc_generic_raw_result_t *)((uint32_t)ncpu_result_buf - sizeof(kdp2_ipc_generic_raw_result_t));
+
+    if (status != KP_SUCCESS) {
+        crop_header->header_stamp.status_code = status;
+        crop_header->header_stamp.total_size = sizeof(kdp2_ipc_generic_raw_result_t);
+    }
+
+    osSemaphoreRelease(_crop_batch_done);
+}
+
+void kdp2_generic_raw_crop_batch_inference(int num_input_buf, void **inf_input_buf_list)
+{
+    // all crops of the image run on the same model and their results are packed into one result buffer,
+    // so the whole batch goes back to host SW with a single result transfer
+
+    kdp2_ipc_generic_raw_crop_batch_inf_header_t *input_header = (kdp2_ipc_generic_raw_crop_batch_inf_header_t *)inf_input_buf_list[0];
+    int crop_count = input_header->crop_count;
+
+    int output_header_buf_size;
+    void *result_buf = kmdw_fifoq_manager_result_get_free_buffer(&output_header_buf_size);
+
+    kdp2_ipc_generic_raw_crop_batch_result_t *output_header = (kdp2_ipc_generic_raw_crop_batch_result_t *)result_buf;
+
+    // need to know model raw output size for the size of each crop slot, slots are 4-byte aligned
+    uint32_t model_raw_out_size = kmdw_inference_app_get_model_raw_output_size(input_header->model_id);
+    uint32_t crop_result_size = (sizeof(kdp2_ipc_generic_raw_result_t) + model_raw_out_size + 3) & ~3;
+
+    // header_stamp is a must to correctly transfer result data back to host SW
+    output_header->header_stamp.magic_type = KDP2_MAGIC_TYPE_INFERENCE;
+    output_header->header_stamp.job_id = KDP2_INF_ID_GENERIC_RAW_CROP_BATCH;
+    output_header->header_stamp.status_code = KP_SUCCESS;
+    output_header->header_stamp.total_size = sizeof(kdp2_ipc_generic_raw_crop_batch_result_t);
+    output_header->product_id = KP_DEVICE_KL520;
+    output_header->inf_number = input_header->inference_number;         // sync the inference number
+    output_header->crop_count = 0;
+    output_header->crop_result_size = crop_result_size;
+
+    if (1 != num_input_buf) {
+        output_header->header_stamp.status_code = KP_FW_WRONG_INPUT_BUFFER_COUNT_110;
+    } else if ((0 >= crop_count) || (MAX_CROP_BATCH_BOX < crop_count) ||
+               (sizeof(kdp2_ipc_generic_raw_crop_batch_result_t) + crop_count * crop_result_size > (uint32_t)output_header_buf_size)) {
+        // all crop results must fit in one result buffer
+        output_header->header_stamp.status_code = KP_FW_INVALID_INPUT_CROP_PARAM_112;
+    }
+
+    if (output_header->header_stamp.status_code != KP_SUCCESS) {
+        kmdw_fifoq_manager_result_enqueue((void *)output_header, output_header_buf_size, false);
+        return;
+    }
+
+    if (NULL == _crop_batch_done)
+        _crop_batch_done = osSemaphoreNew(MAX_CROP_BATCH_BOX, 0, NULL);
+
+    // drop releases left by crops of a timed out batch, they must not count for this batch
+    while (osOK == osSemaphoreAcquire(_crop_batch_done, 0))
+        ;
+
+    // config image preprocessing and model settings
+    kmdw_inference_app_config_t inf_config;
+    memset(&inf_config, 0, sizeof(kmdw_inference_app_config_t)); // for safety let default 'bool' to 'false'
+
+    kp_pad_value_t pad_value;
+
+    // image buffer address should be just after the header
+    inf_config.num_image = 1;
+    inf_config.image_list[0].image_buf = (void *)((uint32_t)input_header + sizeof(kdp2_ipc_generic_raw_crop_batch_inf_header_t));
+    inf_config.image_list[0].image_width = input_header->width;
+    inf_config.image_list[0].image_height = input_header->height;
+    inf_config.image_list[0].image_channel = (input_header->image_format == KP_IMAGE_FORMAT_RAW8) ? 1 : 3;
+    inf_config.image_list[0].image_format = input_header->image_format;
+    inf_config.image_list[0].image_norm = input_header->normalize_mode;
+    inf_config.image_list[0].enable_crop = true;
+    inf_config.image_list[0].image_resize = input_header->resize_mode;          // user's choice
+    inf_config.image_list[0].image_padding = input_header->padding_mode;        // user's choice
+    inf_config.image_list[0].pad_value = &pad_value;
+
+    inf_config.model_id = input_header->model_id;
+    inf_config.enable_raw_output = true;                        // raw output no post-processing
+    // pre-process crop k+1 while NPU runs crop k, parallel mode works here because all crops run the same
+    // model and the raw output is written to 'ncpu_result_buf' by ncpu as its post-process step
+    inf_config.enable_parallel = true;
+    inf_config.inf_result_buf = result_buf;
+    inf_config.inf_result_buf_size = output_header_buf_size;
+    inf_config.result_callback = _crop_batch_result_callback;
+    inf_config.user_define_data = NULL;
+
+    uint32_t model_input_width = 0;
+    uint32_t model_input_height = 0;
+
+    kmdw_inference_get_model_input_image_size(inf_config.model_id, 0, &model_input_width, &model_input_height);
+
+    int num_submitted = 0;
+
+    for (int c = 0; c < crop_count; c++)
+    {
+        kdp2_ipc_generic_raw_result_t *crop_header = (kdp2_ipc_generic_raw_result_t *)(output_header->crop_results + c * crop_result_size);
+
+        // each slot is a complete generic RAW result, host SW parses it as usual
+        crop_header->header_stamp.magic_type = KDP2_MAGIC_TYPE_INFERENCE;
+        crop_header->header_stamp.job_id = KDP2_INF_ID_GENERIC_RAW;
+        crop_header->header_stamp.status_code = KP_SUCCESS;
+        crop_header->header_stamp.total_size = sizeof(kdp2_ipc_generic_raw_result_t) + model_raw_out_size;
+        crop_header->product_id = KP_DEVICE_KL520;
+        crop_header->inf_number = input_header->inference_number;              // sync the inference number
+        crop_header->crop_number = input_header->inf_crop[c].crop_number;      // sync the crop number
+        crop_header->is_last_crop = (c == crop_count - 1) ? 1 : 0;
+        crop_header->num_of_pre_proc_info = 1;
+
+        inf_config.image_list[0].crop_area = input_header->inf_crop[c];
+        memset(&pad_value, 0, sizeof(kp_pad_value_t));
+
+        inf_config.ncpu_result_buf = (void *)crop_header->raw_data;    // give result buffer for ncpu/npu
+
+        // in parallel mode it returns once the crop is pre-processed and handed to NPU,
+        // the result callback is invoked when its raw output is written, but not if the inference fails
+        int ret = kmdw_inference_app_execute(&inf_config);
+
+        if (ret == KP_SUCCESS) {
+            num_submitted++;
+        } else {
+            // some sort of inference error
+            crop_header->header_stamp.status_code = ret;
+            crop_header->header_stamp.total_size = sizeof(kdp2_ipc_generic_raw_result_t);
+        }
+
+        crop_header->pre_proc_info[0].img_width = inf_config.image_list[0].crop_area.width;
+        crop_header->pre_proc_info[0].img_height = inf_config.image_list[0].crop_area.height;
+        crop_header->pre_proc_info[0].pad_top = pad_value.pad_top;
+        crop_header->pre_proc_info[0].pad_bottom = pad_value.pad_bottom;
+        crop_header->pre_proc_info[0].pad_left = pad_value.pad_left;
+        crop_header->pre_proc_info[0].pad_right = pad_value.pad_right;
+        crop_header->pre_proc_info[0].resized_img_width = model_input_width - pad_value.pad_left - pad_value.pad_right;
+        crop_header->pre_proc_info[0].resized_img_height = model_input_height - pad_value.pad_top - pad_value.pad_bottom;
+        crop_header->pre_proc_info[0].model_input_width = model_input_width;
+        crop_header->pre_proc_info[0].model_input_height = model_input_height;
+
+        memcpy(&crop_header->pre_proc_info[0].crop_area, &inf_config.image_list[0].crop_area, sizeof(kp_inf_crop_box_t));
+    }
+
+    // every crop slot must be complete before the batch is sent
+    for (int i = 0; i < num_submitted; i++)
+    {
+        if (osOK != osSemaphoreAcquire(_crop_batch_done, CROP_BATCH_WAIT_TIMEOUT_MS)) {
+            kmdw_printf("[inf] crop batch timeout, crops %d done %d\n", num_submitted, i);
+            output_header->header_stamp.status_code = KP_FW_INFERENCE_TIMEOUT_103;
+
+            // the other crops may still be using the image and result buffers, so wait for them before giving both back
+            kmdw_inference_app_wait_idle(CROP_BATCH_WAIT_TIMEOUT_MS);
+
+            kmdw_fifoq_manager_result_enqueue((void *)output_header, output_header_buf_size, false);
+            return;
+        }
+    }
+
+    output_header->crop_count = crop_count;
+    output_header->header_stamp.total_size = sizeof(kdp2_ipc_generic_raw_crop_batch_result_t) + crop_count * crop_result_size;
+
+    kmdw_fifoq_manager_result_enqueue((void *)output_header, output_header_buf_size, false);
+}
@@ -44,6 +44,7 @@ typedef struct
     uint32_t buffer_addr;
     int length;
     int buffer_index;
+    uint32_t lane;
 } special_buffer_object_t;
 
 void kdp2_fifoq_manager_enqueue_image_thread(void *arg)
@@ -74,7 +75,7 @@ void kdp2_fifoq_manager_enqueue_image_thread(void *arg)
         stored_bobj.length[received_bobj.buffer_index] = received_bobj.length;
 
         if (num_received_img == stored_bobj.num_of_buffer) {
-            dual_fifo2_enqueue_data(_image_fifioq, stored_bobj, osWaitForever, false);
+            dual_fifo2_enqueue_data_to_lane(_image_fifioq, stored_bobj, received_bobj.lane, osWaitForever, false);
 
             num_received_img = 0;
             memset(&stored_bobj, 0, sizeof(buffer_object_t));
@@ -87,7 +88,7 @@ int kmdw_fifoq_manager_init(uint32_t image_count, uint32_t result_count)
     kmdw_printf("creating image queue with size %d\n", image_count);
     kmdw_printf("creating result queue with size %d\n", result_count);
 
-    _image_fifioq = dual_fifo2_create(image_count);
+    _image_fifioq = dual_fifo2_create_lanes(image_count, MAX_INFERENCE_LANE);
     if ((uint32_t)_image_fifioq < DUAL_FIFO_VALID_ADDR)
     {
         kmdw_printf("image queue creating failed !!\n");
@@ -109,7 +110,12 @@ int kmdw_fifoq_manager_init(uint32_t image_count, uint32_t result_count)
 
 osStatus_t kmdw_fifoq_manager_image_enqueue(uint32_t total_num_buf, uint32_t index, uint32_t buf_addr, int buf_size, uint32_t timeout, bool preempt)
 {
-    if (0 == total_num_buf) {
+    return kmdw_fifoq_manager_image_enqueue_to_lane(total_num_buf, index, 0, buf_addr, buf_size, timeout, preempt);
+}
+
+osStatus_t kmdw_fifoq_manager_image_enqueue_to_lane(uint32_t total_num_buf, uint32_t index, uint32_t lane, uint32_t buf_addr, int buf_size, uint32_t timeout, bool preempt)
+{
+    if ((0 == total_num_buf) || (MAX_INFERENCE_LANE <= lane)) {
         return osErrorParameter;
     }
 
@@ -119,6 +125,7 @@ osStatus_t kmdw_fifoq_manager_image_enqueue(uint32_t total_num_buf, uint32_t ind
     special_obj.buffer_index = (1 == special_obj.total_num_buffer) ? 0 : index;
     special_obj.buffer_addr = buf_addr;
     special_obj.length = buf_size;
+    special_obj.lane = lane;
 
     return osMessageQueuePut(_temp_image_queue, (const void *)&special_obj, (preempt) ? (1U) : (0U), timeout);
 }
@@ -128,6 +135,21 @@ osStatus_t kmdw_fifoq_manager_image_dequeue(buffer_object_t *bobj, uint32_t time
     return dual_fifo2_dequeue_data(_image_fifioq, bobj, timeout);
 }
 
+osStatus_t kmdw_fifoq_manager_image_set_lane(uint32_t lane, uint32_t priority, uint32_t weight)
+{
+    return dual_fifo2_set_lane(_image_fifioq, lane, priority, weight);
+}
+
+osStatus_t kmdw_fifoq_manager_image_get_lane_stats(uint32_t lane, dual_fifo2_lane_stats_t *stats)
+{
+    return dual_fifo2_get_lane_stats(_image_fifioq, lane, stats);
+}
+
+void kmdw_fifoq_manager_image_reset_lane_stats(void)
+{
+    dual_fifo2_reset_lane_stats(_image_fifioq);
+}
+
 osStatus_t kmdw_fifoq_manager_image_get_free_buffer(uint32_t *buf_addr, int *buf_size, uint32_t timeout, bool force_grab)
 {
     buffer_object_t bobj;
@@ -250,6 +272,33 @@ void kmdw_fifoq_manager_clean_queues(void)
     }
 }
 
+bool kmdw_fifoq_manager_release_buffers(uint32_t timeout_ms)
+{
+    buffer_object_t bobj;
+    uint32_t waited_ms = 0;
+
+    // buffers being sent or received are given back soon, take out nothing until all of them are free
+    while ((dual_fifo2_num_free_buffer(_image_fifioq) < _fifoq_input_buf_count) ||
+           (dual_fifo2_num_free_buffer(_result_fifoq) < _fifoq_result_buf_count))
+    {
+        if (waited_ms >= timeout_ms)
+            return false;
+
+        osDelay(1);
+        waited_ms++;
+    }
+
+    while (dual_fifo2_get_free_buffer(_image_fifioq, &bobj, 0, false) == osOK)
+        ;
+
+    while (dual_fifo2_get_free_buffer(_result_fifoq, &bobj, 0, false) == osOK)
+        ;
+
+    _fifoq_mem_allocated = false;
+
+    return true;
+}
+
 void kmdw_fifoq_manager_store_fifoq_config(uint32_t input_buf_count, uint32_t input_buf_size, uint32_t result_buf_count, uint32_t result_buf_size)
 {
     _fifoq_mem_allocated = true;
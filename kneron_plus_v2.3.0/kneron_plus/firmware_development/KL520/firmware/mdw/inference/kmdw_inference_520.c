@@ -23,6 +23,7 @@
 #include "kmdw_inference_app.h"
 #include "kmdw_fifoq_manager.h"
 #include "kdp2_inf_generic_raw.h"
+#include "kdp2_ipc_cmd.h"
 
 #ifdef DEBUG_PRINT
 #include "kmdw_console.h"
@@ -33,6 +34,9 @@
 
 #define IMG_PREPROC_UNIT_BYTES 4 // copied from ncpu fw
 #define INF_TIMEOUT 2000 // twice
+#define INF_IDLE_POLL_MS 10 // polling interval of kmdw_inference_app_wait_idle()
+#define INF_TIME_EST_MODEL_NUM 8 // models whose inference time is tracked for deadline drop
+#define INF_TIME_EST_WEIGHT 8 // a new inference time sample weighs 1/8 in the moving average
 
 /* Structure of CNN Header in setup.bin - copy from kdpio.h */
 struct cnn_header_s
@@ -65,6 +69,16 @@ static volatile int g_inf_index = 0;
 static volatile uint32_t g_num_parallel_inf = 0;
 static volatile uint32_t g_num_parallel_result = 0;
 
+typedef struct
+{
+    uint32_t model_id;
+    uint32_t inf_time_us; // moving average of the time the dispatcher is busy with one inference, 0 for no sample yet
+} inf_time_estimate_t;
+
+static volatile bool g_enable_deadline_drop = false;
+static inf_time_estimate_t g_inf_time_est[INF_TIME_EST_MODEL_NUM] = {0};
+static uint32_t g_timer_freq_mhz = 1;
+
 typedef struct
 {
     void *inf_result_buf;
@@ -78,10 +92,95 @@ static result_context_t g_result_ctx[MAX_OUTPUT_CONTEXT_NUM] = {0};
 
 extern void kdp2_generic_raw_inference(int num_input_buf, void **inf_input_buf_list);
 extern void kdp2_generic_raw_inference_bypass_pre_proc(int num_input_buf, void **inf_input_buf_list);
+extern void kdp2_generic_raw_crop_batch_inference(int num_input_buf, void **inf_input_buf_list);
+
+// deadline trailer of an image tagged by the host, NULL if the image has no deadline
+static kdp2_ipc_inf_deadline_t *get_inference_deadline(void *inf_input_buf)
+{
+    kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)inf_input_buf;
+
+    if ((KDP2_INF_LANE_TAG != (header_stamp->status_code & KDP2_INF_LANE_TAG_MASK)) ||
+        (0 == (header_stamp->status_code & KDP2_INF_DEADLINE_FLAG)))
+        return NULL;
+
+    return (kdp2_ipc_inf_deadline_t *)((uint32_t)inf_input_buf + header_stamp->total_size - sizeof(kdp2_ipc_inf_deadline_t));
+}
+
+// a model without an entry takes a free one, or the one picked by its ID if the table is full
+static inf_time_estimate_t *get_inference_time_estimate(uint32_t model_id)
+{
+    for (int i = 0; i < INF_TIME_EST_MODEL_NUM; i++) {
+        if ((g_inf_time_est[i].model_id == model_id) && (0 < g_inf_time_est[i].inf_time_us))
+            return &g_inf_time_est[i];
+    }
+
+    for (int i = 0; i < INF_TIME_EST_MODEL_NUM; i++) {
+        if (0 == g_inf_time_est[i].inf_time_us)
+            return &g_inf_time_est[i];
+    }
+
+    return &g_inf_time_est[model_id % INF_TIME_EST_MODEL_NUM];
+}
+
+static void update_inference_time_estimate(uint32_t model_id, uint32_t start_tick)
+{
+    uint32_t inf_time_us = (osKernelGetSysTimerCount() - start_tick) / g_timer_freq_mhz;
+    inf_time_estimate_t *est = get_inference_time_estimate(model_id);
+
+    if ((est->model_id != model_id) || (0 == est->inf_time_us)) {
+        est->model_id = model_id;
+        est->inf_time_us = (0 < inf_time_us) ? inf_time_us : 1;
+    } else {
+        est->inf_time_us += ((int32_t)inf_time_us - (int32_t)est->inf_time_us) / INF_TIME_EST_WEIGHT;
+    }
+}
+
+// send a drop report in place of the results if the image can not be inferenced before its deadline
+static bool drop_late_inference(void *inf_input_buf, kdp2_ipc_inf_deadline_t *deadline)
+{
+    kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)inf_input_buf;
+    inf_time_estimate_t *est = get_inference_time_estimate(deadline->model_id);
+    uint32_t est_inf_time_us = (est->model_id == deadline->model_id) ? est->inf_time_us : 0;
+    uint32_t elapsed_us = (osKernelGetSysTimerCount() - deadline->recv_tick) / g_timer_freq_mhz;
+    uint32_t reason;
+
+    if (elapsed_us >= deadline->budget_us)
+        reason = KP_INFERENCE_DROP_EXPIRED;
+    else if (elapsed_us + est_inf_time_us > deadline->budget_us)
+        reason = KP_INFERENCE_DROP_UNREACHABLE;
+    else
+        return false;
+
+    int report_buf_size;
+    kdp2_ipc_inf_drop_report_t *report = (kdp2_ipc_inf_drop_report_t *)kmdw_fifoq_manager_result_get_free_buffer(&report_buf_size);
+
+    report->header_stamp.magic_type = KDP2_MAGIC_TYPE_INFERENCE;
+    report->header_stamp.total_size = sizeof(kdp2_ipc_inf_drop_report_t);
+    report->header_stamp.total_image = 1;
+    report->header_stamp.image_index = 0;
+    report->header_stamp.job_id = header_stamp->job_id;
+    report->header_stamp.status_code = KP_FW_INFERENCE_DEADLINE_MISSED_136;
+    report->inference_number = deadline->inference_number;
+    report->model_id = deadline->model_id;
+    report->reason = reason;
+    report->est_inf_time_us = est_inf_time_us;
+    report->late_us = elapsed_us + est_inf_time_us - deadline->budget_us;
+
+    dbg_print("drop inference %u, reason %u, late %u us\n", report->inference_number, reason, report->late_us);
+
+    kmdw_fifoq_manager_result_enqueue((void *)report, report_buf_size, false);
+
+    return true;
+}
 
 void kmdw_inference_image_dispatcher_thread(void *argument)
 {
     dbg_print("[%s] start !\n", __FUNCTION__);
+
+    g_timer_freq_mhz = osKernelGetSysTimerFreq() / 1000000;
+    if (0 == g_timer_freq_mhz)
+        g_timer_freq_mhz = 1;
+
     while (1)
     {
         buffer_object_t fifoq_obj; // fifoq buffer object
@@ -94,13 +193,24 @@ void kmdw_inference_image_dispatcher_thread(void *argument)
             dbg_print("got a image buffer for inference: buf 0x%x\n", inf_input_buf);
 
             kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)inf_input_buf;
+            kdp2_ipc_inf_deadline_t *deadline = get_inference_deadline(inf_input_buf);
+            uint32_t deadline_model_id = (NULL != deadline) ? deadline->model_id : 0;
+            uint32_t start_tick = osKernelGetSysTimerCount();
 
-            if (header_stamp->job_id == KDP2_INF_ID_GENERIC_RAW)
+            if ((NULL != deadline) && (true == g_enable_deadline_drop) && (true == drop_late_inference(inf_input_buf, deadline)))
+                deadline = NULL;
+            else if (header_stamp->job_id == KDP2_INF_ID_GENERIC_RAW)
                 kdp2_generic_raw_inference(fifoq_obj.num_of_buffer, (void **)fifoq_obj.buffer_addr);
             else if (header_stamp->job_id == KDP2_INF_ID_GENERIC_RAW_BYPASS_PRE_PROC)
                 kdp2_generic_raw_inference_bypass_pre_proc(fifoq_obj.num_of_buffer, (void **)fifoq_obj.buffer_addr);
+            else if (header_stamp->job_id == KDP2_INF_ID_GENERIC_RAW_CROP_BATCH)
+                kdp2_generic_raw_crop_batch_inference(fifoq_obj.num_of_buffer, (void **)fifoq_obj.buffer_addr);
             else
                 _app_entry_func(fifoq_obj.num_of_buffer, (void **)fifoq_obj.buffer_addr);
+
+            // dropped inferences are not measured
+            if (NULL != deadline)
+                update_inference_time_estimate(deadline_model_id, start_tick);
         }
 
         // return buffer back to fifoq
@@ -445,6 +555,39 @@ void kmdw_inference_app_send_status_code(int job_id, int error_code)
     kmdw_fifoq_manager_result_enqueue((void *)result_stamp, result_buf_size, false);
 }
 
+void kmdw_inference_app_set_deadline_drop(bool enable)
+{
+    g_enable_deadline_drop = enable;
+}
+
+int kmdw_inference_app_wait_idle(uint32_t timeout_ms)
+{
+    uint32_t waited_ms = 0;
+
+    // an image may be dequeued by the dispatcher just before it is counted, so it must be idle for two polls in a row
+    for (int idle_count = 0; idle_count < 2; )
+    {
+        if (g_num_parallel_inf == g_num_parallel_result)
+        {
+            idle_count++;
+        }
+        else if (waited_ms >= timeout_ms)
+        {
+            kmdw_printf("[inf] wait idle timeout, inf req %d done %d\n", g_num_parallel_inf, g_num_parallel_result);
+            return KP_FW_INFERENCE_TIMEOUT_103;
+        }
+        else
+        {
+            idle_count = 0;
+        }
+
+        osDelay(INF_IDLE_POLL_MS);
+        waited_ms += INF_IDLE_POLL_MS;
+    }
+
+    return KP_SUCCESS;
+}
+
 uint32_t kmdw_inference_app_get_model_raw_output_size(uint32_t model_id)
 {
 #define OUT_NODE_HEAD_SIZE 24 //  for 520, node's width, height, channel, radix, scale, data_layout
@@ -14,8 +14,10 @@
 #include "kdp_system.h"
 
 #include "kmdw_dfu.h"
+#include "kmdw_utils_crc.h"
 #include "kmdw_console.h"
 #include "kmdw_model.h"
+#include "kmdw_memory.h"
 #include "kmdw_memxfer.h"
 
 
@@ -24,6 +26,7 @@
 #include "kdp2_ipc_cmd.h"
 #include "kdp2_inf_generic_raw.h"
 #include "kmdw_fifoq_manager.h"
+#include "kmdw_inference_app.h"
 
 #ifdef FIFO_CMD_DBG
 #define fifo_cmd_dbg(__format__, ...) kmdw_printf("[fifoCmd]"__format__, ##__VA_ARGS__)
@@ -33,6 +36,7 @@
 
 #define USB_NORMAL_TIMEOUT (2 * 1000) // 2 secs
 #define KP_DEBUG_BUF_SIZE (8 * 1024 * 1024) // FIXME, max is 1920x1080 RGB565
+#define UNLOAD_MODEL_WAIT_IDLE_TIMEOUT (5 * 1000) // 5 secs
 
 typedef struct
 {
@@ -117,13 +121,35 @@ static int _load_model(kdp2_ipc_cmd_load_model_t *cmd_lmd)
 
     _fw_info_t *first_fwinfo = (_fw_info_t *)(cmd_lmd->fw_info + 4);
 
-    kmdw_model_fw_info_t *fw_info_p = kmdw_model_get_fw_info(true);
-    memcpy(fw_info_p, (void *)cmd_lmd->fw_info, cmd_lmd->fw_info_size);
-    fifo_cmd_dbg("fw_info_p = 0x%x, fw_info_size = %d, sizeof(_fw_info_t) = %d\n",
-	    fw_info_p, cmd_lmd->fw_info_size, sizeof(_fw_info_t));
+    uint32_t return_code = KP_SUCCESS;
+    int32_t reload_model_info_sts = 0;
+
+    if (true == kmdw_fifoq_manager_get_fifoq_allocated())
+    {
+        // replacing models without reboot: no image is received while a command is handled, drop queued images then wait for the running inference
+        kmdw_fifoq_manager_clean_queues();
+
+        return_code = kmdw_inference_app_wait_idle(UNLOAD_MODEL_WAIT_IDLE_TIMEOUT);
+
+        if (KP_SUCCESS == return_code)
+        {
+            kmdw_fifoq_manager_clean_queues();
+
+            // FIFO queue buffers are kept and the heap boundary follows the new model end, the loaded models are kept if the new models do not fit
+            reload_model_info_sts = kmdw_model_replace_model_info(cmd_lmd->fw_info, cmd_lmd->fw_info_size);
+            return_code = (0 < reload_model_info_sts) ? KP_SUCCESS : KP_FW_LOAD_MODEL_FAILED_104;
+        }
+    }
+    else
+    {
+        kmdw_model_fw_info_t *fw_info_p = kmdw_model_get_fw_info(true);
+        memcpy(fw_info_p, (void *)cmd_lmd->fw_info, cmd_lmd->fw_info_size);
+        fifo_cmd_dbg("fw_info_p = 0x%x, fw_info_size = %d, sizeof(_fw_info_t) = %d\n", fw_info_p, cmd_lmd->fw_info_size, sizeof(_fw_info_t));
+
+        reload_model_info_sts = kmdw_model_reload_model_info(true);
+        return_code = (0 < reload_model_info_sts) ? KP_SUCCESS : KP_FW_LOAD_MODEL_FAILED_104;
+    }
 
-    uint32_t reload_model_info_sts = kmdw_model_reload_model_info(true);
-    uint32_t return_code = (0 < reload_model_info_sts) ? KP_SUCCESS : KP_FW_LOAD_MODEL_FAILED_104;
     kdrv_status_t usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)&return_code, sizeof(uint32_t), USB_NORMAL_TIMEOUT);
 
     if (usb_sts != KDRV_STATUS_OK)
@@ -156,6 +182,37 @@ static int _load_model(kdp2_ipc_cmd_load_model_t *cmd_lmd)
     return 0;
 }
 
+static int _unload_model(kdp2_ipc_cmd_unload_model_t *cmd_buf)
+{
+    fifo_cmd_dbg("[%s]\n", __FUNCTION__);
+
+    // no image is received while a command is handled, drop queued images then wait for the running inference
+    kmdw_fifoq_manager_clean_queues();
+
+    uint32_t return_code = kmdw_inference_app_wait_idle(UNLOAD_MODEL_WAIT_IDLE_TIMEOUT);
+
+    if (KP_SUCCESS == return_code)
+    {
+        // drop results of the last inference as well
+        kmdw_fifoq_manager_clean_queues();
+
+        // no model is in DDR, the model data is reset and inference on the unloaded models is refused
+        kmdw_model_fw_info_t *fw_info_p = kmdw_model_get_fw_info(true);
+        fw_info_p->model_count = 0;
+        kmdw_model_reload_model_info(true);
+    }
+
+    kdrv_status_t usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)&return_code, sizeof(uint32_t), USB_NORMAL_TIMEOUT);
+
+    if (usb_sts != KDRV_STATUS_OK)
+    {
+        fifo_cmd_dbg("[%s] send unload model status failed, sts %d\n", __FUNCTION__, usb_sts);
+        return -1;
+    }
+
+    return (KP_SUCCESS == return_code) ? 0 : -1;
+}
+
 static uint8_t ack_packet[] = {0x35, 0x8A, 0xC, 0, 0x4, 0, 0x8, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
 static int _update_firmware(kdp_firmware_update_cmd_t *kdp_cmd)
@@ -456,6 +513,227 @@ FUNC_OUT:
     return return_code;
 }
 
+static kdp2_ipc_response_flash_digest_t _flash_digest_response; // too big for the stack of the command thread
+
+static int _get_flash_digest(kdp2_ipc_cmd_get_flash_digest_t *cmd_buf, uint32_t buffer_size)
+{
+    kdrv_status_t usb_sts;
+    kdp2_ipc_response_flash_digest_t *response = &_flash_digest_response;
+    uint32_t buffer = (uint32_t)cmd_buf; // command buffer is reused to read flash
+    uint32_t flash_addr = cmd_buf->flash_offset;
+    uint32_t length = cmd_buf->length;
+    uint32_t sector_size = cmd_buf->sector_size;
+    int num_sector;
+
+    if (KDP2_FLASH_REGION_MODEL_INFO == cmd_buf->region)
+        flash_addr += kmdw_dfu_get_model_info_flash_addr();
+    else if (KDP2_FLASH_REGION_MODEL_ALL == cmd_buf->region)
+        flash_addr += kmdw_dfu_get_all_models_flash_addr();
+
+    fifo_cmd_dbg("[%s] flash addr 0x%x, length %d, sector size %d\n", __FUNCTION__, flash_addr, length, sector_size);
+
+    num_sector = kmdw_dfu_get_flash_digest(flash_addr, length, &sector_size, response->digest, KDP2_FLASH_DIGEST_MAX_SECTOR, buffer, buffer_size);
+
+    response->return_code = (0 <= num_sector) ? KP_SUCCESS : KP_ERROR_FW_UPDATE_FAILED_19;
+    response->flash_addr = flash_addr;
+    response->sector_size = sector_size;
+    response->num_sector = (0 <= num_sector) ? num_sector : 0;
+
+    // digests of unused sectors are not sent
+    uint32_t response_size = sizeof(kdp2_ipc_response_flash_digest_t) - (KDP2_FLASH_DIGEST_MAX_SECTOR - response->num_sector) * sizeof(uint32_t);
+
+    usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)response, response_size, USB_NORMAL_TIMEOUT);
+    if (usb_sts != KDRV_STATUS_OK) {
+        fifo_cmd_dbg("[%s] send flash digest failed, sts %d\n", __FUNCTION__, usb_sts);
+        return -1;
+    }
+
+    return (KP_SUCCESS == response->return_code) ? 0 : -1;
+}
+
+/* flash write stream, chunks are received by the command thread and programmed by the flash stream thread */
+
+#define FLASH_STREAM_TIMEOUT (10 * 1000) // 10 secs, host sends the next chunk after an ack when the window is full
+
+typedef struct
+{
+    uint32_t buf_addr;   // FIFO queue input buffer holding the chunk header and data, 0 for the end of stream
+    int buf_size;
+    uint32_t flash_addr;
+} _flash_chunk_t;
+
+static osThreadId_t _flash_stream_tid = NULL;
+static osMessageQueueId_t _flash_chunk_msgq = NULL;
+static osSemaphoreId_t _flash_stream_done = NULL;
+static volatile int32_t _flash_stream_sts; // set to the first failure of the stream by the flash stream thread
+
+static void _flash_stream_thread(void *arg)
+{
+    _flash_chunk_t chunk;
+    kdp2_ipc_response_flash_chunk_ack_t ack;
+    kdrv_status_t usb_sts;
+
+    while (1)
+    {
+        if (osOK != osMessageQueueGet(_flash_chunk_msgq, &chunk, NULL, osWaitForever))
+            continue;
+
+        if (0 == chunk.buf_addr) {
+            osSemaphoreRelease(_flash_stream_done);
+            continue;
+        }
+
+        kdp2_flash_chunk_header_t *header = (kdp2_flash_chunk_header_t *)chunk.buf_addr;
+        uint32_t data = chunk.buf_addr + sizeof(kdp2_flash_chunk_header_t);
+
+        ack.return_code = _flash_stream_sts; // chunks after a failed one are not written
+        ack.chunk_index = header->chunk_index;
+        ack.crc32 = 0;
+
+        if (KP_SUCCESS == ack.return_code)
+        {
+            uint32_t sector_size = header->length;
+
+            if (kmdw_utils_crc_gen_crc32((uint8_t *)data, header->length) != header->crc32)
+                ack.return_code = KP_FW_ERROR_USB_RECEIVE_FAILED_123;
+            else if (0 != kdp_memxfer_ddr_to_flash(chunk.flash_addr, data, header->length))
+                ack.return_code = KP_ERROR_FW_UPDATE_FAILED_19;
+            else if (1 != kmdw_dfu_get_flash_digest(chunk.flash_addr, header->length, &sector_size, &ack.crc32, 1, data, chunk.buf_size - sizeof(kdp2_flash_chunk_header_t)))
+                ack.return_code = KP_ERROR_FW_UPDATE_FAILED_19; // read back, the host compares it with the CRC32 of its data
+
+            _flash_stream_sts = ack.return_code;
+        }
+
+        fifo_cmd_dbg("[%s] chunk %d at flash 0x%x, length %d, return code %d\n", __FUNCTION__, ack.chunk_index, chunk.flash_addr, header->length, ack.return_code);
+
+        kmdw_fifoq_manager_image_put_free_buffer(chunk.buf_addr, chunk.buf_size, osWaitForever);
+
+        usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)&ack, sizeof(ack), USB_NORMAL_TIMEOUT);
+        if (usb_sts != KDRV_STATUS_OK) {
+            fifo_cmd_dbg("[%s] send chunk ack failed, sts %d\n", __FUNCTION__, usb_sts);
+            _flash_stream_sts = KP_FW_ERROR_USB_SEND_FAILED_122;
+        }
+    }
+}
+
+static int _flash_stream_init(void)
+{
+    osThreadAttr_t attr;
+
+    if (NULL != _flash_stream_tid)
+        return 0;
+
+    _flash_chunk_msgq = osMessageQueueNew(KDP2_FLASH_STREAM_MAX_WINDOW + 1, sizeof(_flash_chunk_t), NULL);
+    _flash_stream_done = osSemaphoreNew(1, 0, NULL);
+
+    if ((NULL == _flash_chunk_msgq) || (NULL == _flash_stream_done))
+        return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.stack_size = 1024;
+    attr.priority = osPriorityNormal;
+    _flash_stream_tid = osThreadNew(_flash_stream_thread, NULL, &attr);
+
+    return (NULL != _flash_stream_tid) ? 0 : -1;
+}
+
+static int _write_flash_stream(kdp2_ipc_cmd_write_flash_stream_t *cmd_buf)
+{
+    kdrv_status_t usb_sts;
+    kdp2_ipc_response_write_flash_stream_t response;
+    uint32_t input_buf_count, input_buf_size, result_buf_count, result_buf_size;
+    uint32_t block_size = kmdw_dfu_get_flash_block_size();
+    uint32_t flash_addr = cmd_buf->flash_offset;
+    uint32_t length = cmd_buf->length;
+    uint32_t chunk_size = cmd_buf->chunk_size;
+    uint32_t window = (0 == cmd_buf->window) ? 2 : cmd_buf->window; // double buffering by default
+    uint32_t max_chunk_size, num_chunk, chunk_index;
+
+    if (KDP2_FLASH_REGION_MODEL_INFO == cmd_buf->region)
+        flash_addr += kmdw_dfu_get_model_info_flash_addr();
+    else if (KDP2_FLASH_REGION_MODEL_ALL == cmd_buf->region)
+        flash_addr += kmdw_dfu_get_all_models_flash_addr();
+
+    // chunks are staged in free input buffers of the FIFO queue, the command itself holds one of them
+    kmdw_fifoq_manager_get_fifoq_config(&input_buf_count, &input_buf_size, &result_buf_count, &result_buf_size);
+
+    max_chunk_size = (input_buf_size - sizeof(kdp2_flash_chunk_header_t)) / block_size * block_size;
+
+    if ((0 == chunk_size) || (chunk_size > max_chunk_size))
+        chunk_size = max_chunk_size;
+    else
+        chunk_size = (chunk_size + block_size - 1) / block_size * block_size;
+
+    if (window > input_buf_count - 1)
+        window = input_buf_count - 1;
+    if (window > KDP2_FLASH_STREAM_MAX_WINDOW)
+        window = KDP2_FLASH_STREAM_MAX_WINDOW;
+
+    response.return_code = KP_SUCCESS;
+    response.flash_addr = flash_addr;
+    response.chunk_size = chunk_size;
+    response.window = window;
+
+    if ((false == kmdw_fifoq_manager_get_fifoq_allocated()) || (2 > input_buf_count) ||
+        (input_buf_size <= sizeof(kdp2_flash_chunk_header_t)) || (0 == chunk_size))
+        response.return_code = KP_FW_FIFOQ_NOT_READY_126;
+    else if ((0 != (flash_addr & 0xfff)) || (0 == length))
+        response.return_code = KP_ERROR_INVALID_PARAM_12;
+    else if (0 != _flash_stream_init())
+        response.return_code = KP_FW_DDR_MALLOC_FAILED_102;
+
+    fifo_cmd_dbg("[%s] flash addr 0x%x, length %d, chunk size %d, window %d, return code %d\n", __FUNCTION__, flash_addr, length, chunk_size, window, response.return_code);
+
+    usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)&response, sizeof(response), USB_NORMAL_TIMEOUT);
+    if ((usb_sts != KDRV_STATUS_OK) || (KP_SUCCESS != response.return_code)) {
+        fifo_cmd_dbg("[%s] start stream failed, sts %d\n", __FUNCTION__, usb_sts);
+        return -1;
+    }
+
+    _flash_stream_sts = KP_SUCCESS;
+    num_chunk = (length + chunk_size - 1) / chunk_size;
+
+    // receive chunk N + 1 while chunk N is being programmed
+    for (chunk_index = 0; chunk_index < num_chunk; chunk_index++)
+    {
+        _flash_chunk_t chunk;
+        kdp2_flash_chunk_header_t *header;
+        uint32_t data_len = ((length - chunk_index * chunk_size) > chunk_size) ? chunk_size : (length - chunk_index * chunk_size);
+        uint32_t rxLen;
+
+        data_len = (data_len + 3) & ~3; // the host pads the last chunk to whole words
+
+        if (osOK != kmdw_fifoq_manager_image_get_free_buffer(&chunk.buf_addr, &chunk.buf_size, FLASH_STREAM_TIMEOUT, false)) {
+            fifo_cmd_dbg("[%s] no free buffer for chunk %d\n", __FUNCTION__, chunk_index);
+            break;
+        }
+
+        rxLen = chunk.buf_size;
+        usb_sts = usbd_hal_bulk_receive(KDP2_USB_ENDPOINT_DATA_OUT, (void *)chunk.buf_addr, &rxLen, FLASH_STREAM_TIMEOUT);
+        header = (kdp2_flash_chunk_header_t *)chunk.buf_addr;
+
+        if ((usb_sts != KDRV_STATUS_OK) || (rxLen != sizeof(kdp2_flash_chunk_header_t) + data_len) ||
+            (KDP2_FLASH_CHUNK_MAGIC != header->magic) || (chunk_index != header->chunk_index) || (data_len != header->length))
+        {
+            // stop here, the host times out waiting for the ack of this chunk
+            fifo_cmd_dbg("[%s] receive chunk %d failed, sts %d, length %d\n", __FUNCTION__, chunk_index, usb_sts, rxLen);
+            kmdw_fifoq_manager_image_put_free_buffer(chunk.buf_addr, chunk.buf_size, osWaitForever);
+            break;
+        }
+
+        chunk.flash_addr = flash_addr + chunk_index * chunk_size;
+        osMessageQueuePut(_flash_chunk_msgq, &chunk, 0, osWaitForever);
+    }
+
+    // wait until the chunks in flight are programmed and acknowledged
+    _flash_chunk_t end_of_stream = {0};
+
+    osMessageQueuePut(_flash_chunk_msgq, &end_of_stream, 0, osWaitForever);
+    osSemaphoreAcquire(_flash_stream_done, osWaitForever);
+
+    return ((chunk_index == num_chunk) && (KP_SUCCESS == _flash_stream_sts)) ? 0 : -1;
+}
+
 #define OUT_NODE_HEAD_SIZE 20 // node's width, height, channel, radix, scale
 
 static int _get_model_info(kdp2_ipc_cmd_get_model_info_t *cmd_buf)
@@ -733,7 +1011,86 @@ static int _get_fifo_queue_config(kdp2_ipc_cmd_get_fifo_queue_config_t *cmd_buf)
     return 0;
 }
 
-int kdp2_cmd_handle_kp_command(uint32_t command_buffer)
+static int _get_ddr_heap_stats(kdp2_ipc_cmd_get_ddr_heap_stats_t *cmd_buf)
+{
+    kp_ddr_heap_stats_t heap_stats = {0};
+    kmdw_ddr_stats_t ddr_stats;
+
+    kmdw_ddr_get_stats(&ddr_stats);
+
+    heap_stats.heap_begin = ddr_stats.heap_begin;
+    heap_stats.heap_end = ddr_stats.heap_end;
+    heap_stats.used_size = ddr_stats.used_size;
+    heap_stats.free_size = ddr_stats.free_size;
+    heap_stats.largest_free_size = ddr_stats.largest_free_size;
+    heap_stats.used_block_count = ddr_stats.used_block_count;
+    heap_stats.free_block_count = ddr_stats.free_block_count;
+    heap_stats.peak_used_size = ddr_stats.peak_used_size;
+    heap_stats.lowest_addr = ddr_stats.lowest_addr;
+
+    if (0 < ddr_stats.free_size)
+        heap_stats.fragmentation = 1000 - (uint32_t)(((uint64_t)ddr_stats.largest_free_size * 1000) / ddr_stats.free_size);
+
+    kdrv_status_t usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)&heap_stats, sizeof(kp_ddr_heap_stats_t), USB_NORMAL_TIMEOUT);
+    if (KDRV_STATUS_OK != usb_sts)
+        fifo_cmd_dbg("[%s] send ack failed, sts %d\n", __FUNCTION__, usb_sts);
+
+    return 0;
+}
+
+static int _configure_inf_lanes(kdp2_ipc_cmd_configure_inf_lanes_t *cmd_buf)
+{
+    uint32_t return_code = KP_SUCCESS;
+    kp_inference_lane_config_t *lane_config = &cmd_buf->lane_config;
+
+    for (int i = 0; i < MAX_INFERENCE_LANE; i++) {
+        if ((0 == lane_config->weight[i]) || (MAX_INFERENCE_LANE_WEIGHT < lane_config->weight[i]))
+            return_code = KP_ERROR_INVALID_PARAM_12;
+    }
+
+    // lanes are configured all or none
+    for (int i = 0; (KP_SUCCESS == return_code) && (i < MAX_INFERENCE_LANE); i++)
+        kmdw_fifoq_manager_image_set_lane(i, lane_config->priority[i], lane_config->weight[i]);
+
+    kdrv_status_t usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)&return_code, sizeof(uint32_t), USB_NORMAL_TIMEOUT);
+    if (KDRV_STATUS_OK != usb_sts)
+        fifo_cmd_dbg("[%s] send ack failed, sts %d\n", __FUNCTION__, usb_sts);
+
+    return 0;
+}
+
+static int _get_inf_lane_stats(kdp2_ipc_cmd_get_inf_lane_stats_t *cmd_buf)
+{
+    kp_inference_lane_stats_t lane_stats[MAX_INFERENCE_LANE] = {0};
+
+    for (int i = 0; i < MAX_INFERENCE_LANE; i++) {
+        dual_fifo2_lane_stats_t stats;
+
+        if (osOK != kmdw_fifoq_manager_image_get_lane_stats(i, &stats))
+            continue;
+
+        lane_stats[i].depth = stats.depth;
+        lane_stats[i].peak_depth = stats.peak_depth;
+        lane_stats[i].enqueued = stats.enqueued;
+        lane_stats[i].dequeued = stats.dequeued;
+        lane_stats[i].dropped = stats.dropped;
+        lane_stats[i].max_wait_us = stats.max_wait_us;
+
+        if (0 < stats.dequeued)
+            lane_stats[i].avg_wait_us = (uint32_t)(stats.total_wait_us / stats.dequeued);
+    }
+
+    if (0 != cmd_buf->reset)
+        kmdw_fifoq_manager_image_reset_lane_stats();
+
+    kdrv_status_t usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)lane_stats, sizeof(lane_stats), USB_NORMAL_TIMEOUT);
+    if (KDRV_STATUS_OK != usb_sts)
+        fifo_cmd_dbg("[%s] send ack failed, sts %d\n", __FUNCTION__, usb_sts);
+
+    return 0;
+}
+
+int kdp2_cmd_handle_kp_command(uint32_t command_buffer, uint32_t buffer_size)
 {
     int ret = -1;
     kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)command_buffer;
@@ -745,6 +1102,9 @@ int kdp2_cmd_handle_kp_command(uint32_t command_buffer)
     case KDP2_COMMAND_LOAD_MODEL:
         ret = _load_model((kdp2_ipc_cmd_load_model_t *)command_buffer);
         break;
+    case KDP2_COMMAND_UNLOAD_MODEL:
+        ret = _unload_model((kdp2_ipc_cmd_unload_model_t *)command_buffer);
+        break;
     case KDP2_COMMAND_MEMORY_READ:
     case KDP2_COMMAND_MEMORY_WRITE:
         ret = _memory_read_write((kdp2_ipc_cmd_memory_read_write_t *)command_buffer);
@@ -761,6 +1121,12 @@ int kdp2_cmd_handle_kp_command(uint32_t command_buffer)
     case KDP2_COMMAND_WRITE_FLASH:
         ret = _write_flash((kdp2_ipc_cmd_write_flash_t *)command_buffer);
         break;
+    case KDP2_COMMAND_GET_FLASH_DIGEST:
+        ret = _get_flash_digest((kdp2_ipc_cmd_get_flash_digest_t *)command_buffer, buffer_size);
+        break;
+    case KDP2_COMMAND_WRITE_FLASH_STREAM:
+        ret = _write_flash_stream((kdp2_ipc_cmd_write_flash_stream_t *)command_buffer);
+        break;
     case KDP2_COMMAND_GET_MODEL_INFO:
         ret = _get_model_info((kdp2_ipc_cmd_get_model_info_t *)command_buffer);
         break;
@@ -785,6 +1151,15 @@ int kdp2_cmd_handle_kp_command(uint32_t command_buffer)
     case KDP2_COMMAND_GET_FIFOQ_CONFIG:
         ret = _get_fifo_queue_config((kdp2_ipc_cmd_get_fifo_queue_config_t *)command_buffer);
         break;
+    case KDP2_COMMAND_GET_DDR_HEAP_STATS:
+        ret = _get_ddr_heap_stats((kdp2_ipc_cmd_get_ddr_heap_stats_t *)command_buffer);
+        break;
+    case KDP2_COMMAND_CONFIGURE_INF_LANES:
+        ret = _configure_inf_lanes((kdp2_ipc_cmd_configure_inf_lanes_t *)command_buffer);
+        break;
+    case KDP2_COMMAND_GET_INF_LANE_STATS:
+        ret = _get_inf_lane_stats((kdp2_ipc_cmd_get_inf_lane_stats_t *)command_buffer);
+        break;
     default:
         kmdw_printf("error ! unknown command id %d\n", command_id);
         break;
@@ -13,9 +13,12 @@
 
 #include "buffer_object.h"
 
+#include "kmdw_memory.h"
+#include "kmdw_inference_app.h"
 #include "kmdw_fifoq_manager.h"
 #include "kdp2_usb_companion.h"
 #include "kdp2_ipc_cmd.h"
+#include "kdp2_inf_generic_raw.h"
 
 #ifdef ENABLE_DBG_LOG
 #define dbg_log(__format__, ...) kmdw_printf("[kp companion]"__format__, ##__VA_ARGS__)
@@ -24,24 +27,41 @@
 #endif
 
 #define FLAG_WAIT_USB_CONNECTION 0x1
+#define FIFOQ_MAX_BUF_COUNT 8                     // the same limit as KDP2_CONTROL_FIFOQ_CONFIGURE
+#define RESIZE_FIFOQ_WAIT_TIMEOUT (5 * 1000)      // 5 secs
+#define USB_RESPONSE_TIMEOUT (2 * 1000)           // 2 secs
+#define RECV_PEEK_SIZE 1024                       // header peek into the command buffer, a multiple of the bulk max packet size
+#define USB_FAKE_ZLP 0x11223344                   // sent by the host after a transfer of a multiple of the max packet size
 
 static osThreadId_t result_thread_id = NULL;
 static osThreadId_t image_thread_id = NULL;
 
 static bool _do_reset_queue = false;
 static bool _enable_inf_droppable = false;
+static bool _enable_inf_deadline_drop = false;
+
+static uint32_t _coalesce_buf = 0;      // staging buffer of coalesced results, reserved by the result thread on first use
+static uint32_t _coalesce_buf_size = 0;
+static uint32_t _coalesce_max_size = 0; // maximum size of a coalesced transfer, 0 for coalescing disabled
+
+static uint32_t _fifoq_image_pool = 0;  // FIFO queue buffers, allocated by KDP2_CONTROL_FIFOQ_CONFIGURE and KDP2_COMMAND_RESIZE_FIFOQ
+static uint32_t _fifoq_result_pool = 0;
 
 static bool allocate_memory_for_inference_queue(uint32_t image_count, uint32_t image_size, uint32_t result_count, uint32_t result_size)
 {
     if (true == kmdw_fifoq_manager_get_fifoq_allocated())
         return false; // already inited
 
-    uint32_t total_need_size = (image_count * image_size) + (result_count * result_size);
+    uint32_t image_stride = 0;
+    uint32_t result_stride = 0;
+
+    kmdw_printf("allocating memory for fifoq: image %d x %d, result %d x %d\n", image_count, image_size, result_count, result_size);
 
-    kmdw_printf("allocating memory for fifoq: image %d x %d, result %d x %d, total %u bytes\n", image_count, image_size, result_count, result_size, total_need_size);
+    // image and result buffers are separate pools, they are given back when the FIFO queue is resized
+    _fifoq_image_pool = kmdw_ddr_alloc_pool(image_size, image_count, ALIGN_16BYTE, &image_stride);
+    _fifoq_result_pool = (0 < _fifoq_image_pool) ? kmdw_ddr_alloc_pool(result_size, result_count, ALIGN_16BYTE, &result_stride) : 0;
 
-    uint32_t buf_addr = kmdw_ddr_reserve(total_need_size);
-    if (buf_addr > 0)
+    if (_fifoq_result_pool > 0)
     {
         dbg_log("allocated fifoq buffers OK\n");
 
@@ -52,34 +72,130 @@ static bool allocate_memory_for_inference_queue(uint32_t image_count, uint32_t i
         // queue image and result buffers into queues correspondingly
         for (uint32_t i = 0; i < image_count; i++)
         {
-            sts = kmdw_fifoq_manager_image_put_free_buffer(buf_addr, (int)image_size, 0);
+            sts = kmdw_fifoq_manager_image_put_free_buffer(_fifoq_image_pool + i * image_stride, (int)image_size, 0);
             if (sts != osOK)
             {
                 dbg_log("kmdw_fifoq_manager_image_put_free_buffer error = %d\n", sts);
             }
-
-            buf_addr += image_size;
         }
         for (uint32_t i = 0; i < result_count; i++)
         {
-            sts = kmdw_fifoq_manager_result_put_free_buffer(buf_addr, (int)result_size, 0);
+            sts = kmdw_fifoq_manager_result_put_free_buffer(_fifoq_result_pool + i * result_stride, (int)result_size, 0);
             if (sts != osOK)
             {
                 dbg_log("kmdw_fifoq_manager_image_put_free_buffer error = %d\n", sts);
             }
-
-            buf_addr += result_size;
         }
 
         return true;
     }
     else
     {
+        if (_fifoq_image_pool > 0)
+            kmdw_ddr_free(_fifoq_image_pool);
+
+        _fifoq_image_pool = 0;
+
         kmdw_printf("error ! not enough memory for inference queue buffers\n");
         return false;
     }
 }
 
+// inference lane tagged by the host, untagged images go to lane 0 and an unknown lane is served last
+static uint32_t get_inference_lane(kp_inference_header_stamp_t *header_stamp)
+{
+    uint32_t lane = header_stamp->status_code & KDP2_INF_LANE_NUM_MASK;
+
+    if (KDP2_INF_LANE_TAG != (header_stamp->status_code & KDP2_INF_LANE_TAG_MASK))
+        return 0;
+
+    return (MAX_INFERENCE_LANE > lane) ? lane : (MAX_INFERENCE_LANE - 1);
+}
+
+// first image of an inference which carries a deadline trailer
+static bool has_inference_deadline(kp_inference_header_stamp_t *header_stamp)
+{
+    return (KDP2_INF_LANE_TAG == (header_stamp->status_code & KDP2_INF_LANE_TAG_MASK)) &&
+           (0 != (header_stamp->status_code & KDP2_INF_DEADLINE_FLAG)) &&
+           (0 == header_stamp->image_index);
+}
+
+// write the receive time into the deadline trailer, a trailer which does not fit is ignored by the dispatcher
+static void stamp_inference_deadline(uint32_t buf_addr, uint32_t recv_tick)
+{
+    kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)buf_addr;
+
+    if (header_stamp->total_size < sizeof(kp_inference_header_stamp_t) + sizeof(kdp2_ipc_inf_deadline_t))
+    {
+        header_stamp->status_code &= ~KDP2_INF_DEADLINE_FLAG;
+        return;
+    }
+
+    kdp2_ipc_inf_deadline_t *deadline = (kdp2_ipc_inf_deadline_t *)(buf_addr + header_stamp->total_size - sizeof(kdp2_ipc_inf_deadline_t));
+    deadline->recv_tick = recv_tick;
+}
+
+// in deadline drop mode a full queue never drops an image, the dispatcher drops the late ones and reports them
+static bool is_inf_droppable(void)
+{
+    return _enable_inf_droppable && !_enable_inf_deadline_drop;
+}
+
+// runs in the image thread which holds no FIFO queue buffer, the command buffer has been given back
+static void resize_inference_queue(kdp2_ipc_cmd_resize_fifo_queue_t *cmd)
+{
+    uint32_t return_code = KP_SUCCESS;
+    uint32_t image_count, image_size, result_count, result_size;
+
+    kmdw_fifoq_manager_get_fifoq_config(&image_count, &image_size, &result_count, &result_size);
+
+    if (false == kmdw_fifoq_manager_get_fifoq_allocated())
+    {
+        return_code = KP_FW_FIFOQ_NOT_READY_126;
+        goto FUNC_OUT;
+    }
+
+    if ((0 == cmd->input_buf_count) || (FIFOQ_MAX_BUF_COUNT < cmd->input_buf_count) || (0 == cmd->input_buf_size) ||
+        (0 == cmd->result_buf_count) || (FIFOQ_MAX_BUF_COUNT < cmd->result_buf_count) || (0 == cmd->result_buf_size))
+    {
+        return_code = KP_FW_WRONG_INPUT_BUFFER_COUNT_110;
+        goto FUNC_OUT;
+    }
+
+    // drop queued images and results, then wait for the running inference
+    kmdw_fifoq_manager_clean_queues();
+
+    return_code = kmdw_inference_app_wait_idle(RESIZE_FIFOQ_WAIT_TIMEOUT);
+    if (KP_SUCCESS != return_code)
+        goto FUNC_OUT;
+
+    kmdw_fifoq_manager_clean_queues();
+
+    if (false == kmdw_fifoq_manager_release_buffers(RESIZE_FIFOQ_WAIT_TIMEOUT))
+    {
+        return_code = KP_FW_FIFOQ_ACCESS_FAILED_125;
+        goto FUNC_OUT;
+    }
+
+    kmdw_ddr_free(_fifoq_result_pool);
+    kmdw_ddr_free(_fifoq_image_pool);
+    _fifoq_image_pool = 0;
+    _fifoq_result_pool = 0;
+
+    if (false == allocate_memory_for_inference_queue(cmd->input_buf_count, cmd->input_buf_size, cmd->result_buf_count, cmd->result_buf_size))
+    {
+        // the old buffers have just been given back, so they should fit again
+        if (true == allocate_memory_for_inference_queue(image_count, image_size, result_count, result_size))
+            return_code = KP_FW_DDR_MALLOC_FAILED_102;
+        else
+            return_code = KP_FW_FIFOQ_NOT_READY_126; // no FIFO queue is left, the host has to configure it again
+    }
+
+FUNC_OUT:
+    if (KDRV_STATUS_OK != usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)&return_code, sizeof(uint32_t), USB_RESPONSE_TIMEOUT))
+        dbg_log("[%s] send resize status failed\n", __FUNCTION__);
+}
+
 // usb link status notify
 void usb_link_status_callback(usbd_hal_link_status_t link_status)
 {
@@ -127,6 +243,8 @@ static bool usb_user_control_callback(usbd_hal_setup_packet_t *setup)
 
             // also reset any inf defaults
             _enable_inf_droppable = false;
+            _enable_inf_deadline_drop = false;
+            kmdw_inference_app_set_deadline_drop(false);
 
             usbd_hal_terminate_all_endpoint();
         }
@@ -158,6 +276,30 @@ static bool usb_user_control_callback(usbd_hal_setup_packet_t *setup)
         ret = true;
         break;
     }
+    case KDP2_CONTROL_FIFOQ_ENABLE_DEADLINE_DROP:
+    {
+        _enable_inf_deadline_drop = (setup->wValue == 1);
+        kmdw_inference_app_set_deadline_drop(_enable_inf_deadline_drop);
+        ret = true;
+        break;
+    }
+    case KDP2_CONTROL_FIFOQ_ENABLE_COALESCING:
+    {
+        uint32_t max_size = (uint32_t)setup->wValue * 1024;
+
+        // reserved DDR is never given back, so the staging buffer is reserved once and can not grow later
+        ret = ((0 == _coalesce_buf_size) || (max_size <= _coalesce_buf_size));
+        if (true == ret)
+            _coalesce_max_size = max_size;
+
+        break;
+    }
+    case KDP2_CONTROL_QUERY_COMMAND:
+    {
+        // commands the host can not tell from the firmware version
+        ret = ((KDP2_COMMAND_GET_FLASH_DIGEST == setup->wValue) || (KDP2_COMMAND_WRITE_FLASH_STREAM == setup->wValue));
+        break;
+    }
     case KDP2_CONTROL_DDR_HEAP_BOUNDARY_ADJUST:
     {
         uint32_t arg1 = (uint32_t)setup->wValue;
@@ -182,7 +324,7 @@ static bool usb_user_control_callback(usbd_hal_setup_packet_t *setup)
     return ret;
 }
 
-static void process_plus_command(uint32_t cmd_buf)
+static void process_plus_command(uint32_t cmd_buf, uint32_t buf_size)
 {
     kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)cmd_buf;
 
@@ -190,7 +332,7 @@ static void process_plus_command(uint32_t cmd_buf)
     {
         dbg_log("handle kdp2 command = 0x%x\n", header_stamp->job_id);
         // handle kdp2 commands ...
-        kdp2_cmd_handle_kp_command(cmd_buf);
+        kdp2_cmd_handle_kp_command(cmd_buf, buf_size);
     }
     else if ((header_stamp->magic_type & 0xFFFF) == KDP_MSG_HDR_CMD) // very speical case for old arch. fw update
     {
@@ -204,19 +346,60 @@ static void process_plus_command(uint32_t cmd_buf)
     }
 }
 
-enum
+// take a FIFO queue buffer for an inference image, in droppable mode the oldest queued image is dropped if none is free
+static void get_image_buffer(uint32_t *buf_addr, int *buf_size)
 {
-    RECV_TYPE_INF_IMAGE = 1,
-    RECV_TYPE_COMMAND = 2,
-    RECV_TYPE_UNKNOWN = 3,
-};
+    osStatus_t sts = kmdw_fifoq_manager_image_get_free_buffer(buf_addr, buf_size, osWaitForever, is_inf_droppable());
 
+    while (is_inf_droppable() && osErrorResource == sts)
+    {
+        sts = kmdw_fifoq_manager_image_get_free_buffer(buf_addr, buf_size, osWaitForever, is_inf_droppable());
+    }
+}
+
+// nothing but the fake ZLP which ends a host transfer of a multiple of the max packet size
+static bool is_zlp(uint32_t buf_addr, uint32_t len)
+{
+    return (0 == len) || ((sizeof(uint32_t) == len) && (USB_FAKE_ZLP == *(uint32_t *)buf_addr));
+}
+
+// a bulk receive is terminated, the transfer is abandoned
+static void receive_terminated(kdrv_status_t usb_sts)
+{
+    dbg_log("[%s] bulk receive is terminated, sts %d\n", __FUNCTION__, usb_sts);
+
+    // guess this is good time to clear/reset queue
+    if (_do_reset_queue)
+    {
+        dbg_log("[%s] do reset fifo queue !!!\n", __FUNCTION__);
+
+        _do_reset_queue = false;
+
+        // abandon all unprocessed data
+        kmdw_fifoq_manager_clean_queues();
+
+        // sending enpoint may still hold a buffer, terminate it
+        usbd_hal_terminate_all_endpoint();
+    }
+}
+
+/*
+ * Receive state machine, nothing of an inference image is copied as long as a FIFO queue buffer is free:
+ *   - a free FIFO queue buffer is taken in advance without waiting, the next transfer is received into it directly,
+ *     an image keeps it and a command is handled in place, the buffer is then kept for the next transfer
+ *   - if none is free, only RECV_PEEK_SIZE bytes are received into the command buffer (system reserve) to see the
+ *     header stamp, a command is served at once and an image waits for a FIFO queue buffer, which gets the peeked
+ *     bytes and the rest of the image directly
+ * so a command never waits for or holds an image buffer.
+ */
 void kdp2_usb_companion_image_thread(void *arg)
 {
     dbg_log("[%s] starting ..\n", __FUNCTION__);
 
     uint32_t temp_cmd_buffer = 0;
     uint32_t temp_cmd_buffer_size = 0;
+    uint32_t pre_buf_addr = 0; // FIFO queue buffer taken in advance for the next transfer
+    int pre_buf_size = 0;
 
     kmdw_ddr_get_system_reserve(&temp_cmd_buffer, &temp_cmd_buffer_size);
 
@@ -233,140 +416,248 @@ void kdp2_usb_companion_image_thread(void *arg)
     {
         uint32_t buf_addr; // contains a inference image or a command
         int buf_size;      // buffer size should bigger than inference image size
+        uint32_t txLen;
 
-        // take a free buffer to receive a inf image or a command
-        if (true == kmdw_fifoq_manager_get_fifoq_allocated()) {
-            osStatus_t sts = kmdw_fifoq_manager_image_get_free_buffer(&buf_addr, &buf_size, osWaitForever, _enable_inf_droppable);
+        if (true == kmdw_fifoq_manager_get_fifoq_allocated())
+        {
+            if ((0 == pre_buf_addr) && (osOK != kmdw_fifoq_manager_image_get_free_buffer(&pre_buf_addr, &pre_buf_size, 0, false)))
+                pre_buf_addr = 0;
+        }
 
-            while (_enable_inf_droppable && osErrorResource == sts)
-            {
-                sts = kmdw_fifoq_manager_image_get_free_buffer(&buf_addr, &buf_size, osWaitForever, _enable_inf_droppable);
-            }
-        } else {
+        if (0 != pre_buf_addr)
+        {
+            buf_addr = pre_buf_addr;
+            buf_size = pre_buf_size;
+            txLen = buf_size;
+        }
+        else
+        {
             buf_addr = temp_cmd_buffer;
             buf_size = temp_cmd_buffer_size;
-            dbg_log("[%s] got system reserve buffer: 0x%X size %d\n", __FUNCTION__, buf_addr, buf_size);
+            txLen = (true == kmdw_fifoq_manager_get_fifoq_allocated()) ? RECV_PEEK_SIZE : buf_size;
         }
 
-        dbg_log("[%s] free queue --> buf 0x%X size %d\n", __FUNCTION__, buf_addr, buf_size);
+        dbg_log("[%s] receive into buf 0x%X size %d\n", __FUNCTION__, buf_addr, txLen);
 
-        uint32_t total_recv_len = 0;
-        uint32_t total_wanted_len = 0;
-        int recv_type = RECV_TYPE_UNKNOWN;
-        uint32_t total_image_count = 0;
-        uint32_t image_index = 0;
-
-        // loop done when receiving size-matched data
-        while (1)
+        kdrv_status_t usb_sts = usbd_hal_bulk_receive(KDP2_USB_ENDPOINT_DATA_OUT, (uint32_t *)buf_addr, &txLen, osWaitForever);
+        if (usb_sts != KDRV_STATUS_OK) // KDRV_STATUS_USBD_TRANSFER_TERMINATED or KDRV_STATUS_USBD_TRANSFER_DISCONNECTED
         {
-            uint32_t txLen = buf_size - total_recv_len;
-            kdrv_status_t usb_sts = usbd_hal_bulk_receive(KDP2_USB_ENDPOINT_DATA_OUT, (uint32_t *)(buf_addr + total_recv_len), &txLen, osWaitForever);
-            if (usb_sts != KDRV_STATUS_OK) // KDRV_STATUS_USBD_TRANSFER_TERMINATED or KDRV_STATUS_USBD_TRANSFER_DISCONNECTED
-            {
-                dbg_log("[%s] bulk receive is terminated, sts %d\n", __FUNCTION__, usb_sts);
+            receive_terminated(usb_sts);
+            continue;
+        }
 
-                // guess this is good time to clear/reset queue
-                if (_do_reset_queue)
-                {
-                    dbg_log("[%s] do reset fifo queue !!!\n", __FUNCTION__);
+        if (true == is_zlp(buf_addr, txLen))
+            continue;
 
-                    _do_reset_queue = false;
+        // the header stamp is parsed once, the rest of the transfer is payload
+        kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)buf_addr;
+        uint32_t total_recv_len = txLen;
 
-                    // abandon all unprocessed data
-                    kmdw_fifoq_manager_clean_queues();
+        if (header_stamp->magic_type == KDP2_MAGIC_TYPE_INFERENCE)
+        {
+            uint32_t total_wanted_len = header_stamp->total_size;
+            uint32_t total_image_count = header_stamp->total_image;
+            uint32_t image_index = header_stamp->image_index;
+            uint32_t lane = get_inference_lane(header_stamp);
+            bool has_deadline = has_inference_deadline(header_stamp);
+            uint32_t recv_tick = osKernelGetSysTimerCount();
+
+            if (buf_addr == pre_buf_addr)
+            {
+                pre_buf_addr = 0; // the image takes the buffer taken in advance
+            }
+            else if (false == kmdw_fifoq_manager_get_fifoq_allocated())
+            {
+                kmdw_printf("[%s] error !! inf image received before the fifo queue is configured\n", __FUNCTION__);
+                continue;
+            }
+            else
+            {
+                // only the peeked bytes are moved, the rest of the image is received into the FIFO queue buffer
+                get_image_buffer(&buf_addr, &buf_size);
+                memcpy((void *)buf_addr, (void *)temp_cmd_buffer, txLen);
 
-                    // sending enpoint may still hold a buffer, terminate it
-                    usbd_hal_terminate_all_endpoint();
+                dbg_log("[%s] move peeked %d bytes to fifoq buffer: 0x%X\n", __FUNCTION__, txLen, buf_addr);
+            }
 
-                    recv_type = RECV_TYPE_UNKNOWN;
+            if (total_wanted_len > buf_size)
+            {
+                // FIXME, serious error, make host SW pending (timeout)
+                // reboot and configure bigger buffer !!!!
+                kmdw_printf("[%s] error !! inf image size (%d) is bigger than buffer size (%d)\n", __FUNCTION__, total_wanted_len, buf_size);
+                return; // a way to inform host SW ?
+            }
 
+            // loop done when receiving size-matched data
+            while (total_recv_len < total_wanted_len)
+            {
+                txLen = buf_size - total_recv_len;
+                usb_sts = usbd_hal_bulk_receive(KDP2_USB_ENDPOINT_DATA_OUT, (uint32_t *)(buf_addr + total_recv_len), &txLen, osWaitForever);
+                if (usb_sts != KDRV_STATUS_OK)
                     break;
-                }
+
+                total_recv_len += txLen;
+
+                dbg_log("[%s] host -- usb --> buf 0x%x len %d (total %d)\n", __FUNCTION__, (void *)buf_addr, txLen, total_recv_len);
             }
 
-            if (total_recv_len == 0) // buffer should begin with header stamp 'magic_type'
+            if (usb_sts != KDRV_STATUS_OK)
             {
-                kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)buf_addr;
+                // the image is abandoned, its buffer is kept for the next transfer
+                pre_buf_addr = buf_addr;
+                pre_buf_size = buf_size;
 
-                if (header_stamp->magic_type == KDP2_MAGIC_TYPE_INFERENCE)
-                {
-                    recv_type = RECV_TYPE_INF_IMAGE; // indicate this buffer contains inf image
-                    total_wanted_len = header_stamp->total_size;
-                    total_image_count = header_stamp->total_image;
-                    image_index = header_stamp->image_index;
+                receive_terminated(usb_sts);
+                continue;
+            }
+
+            if (total_recv_len > total_wanted_len)
+                kmdw_printf("[%s] warning !! actual received size (%d) is bigger than expected size (%d)\n", __FUNCTION__, total_recv_len, total_wanted_len);
 
-                    if ((buf_addr == temp_cmd_buffer) && (true == kmdw_fifoq_manager_get_fifoq_allocated())) {
-                        osStatus_t sts = kmdw_fifoq_manager_image_get_free_buffer(&buf_addr, &buf_size, osWaitForever, _enable_inf_droppable);
+            dbg_log("[%s] buf 0x%x -- > inference queue\n", __FUNCTION__, (void *)buf_addr);
 
-                        while (_enable_inf_droppable && osErrorResource == sts) {
-                            sts = kmdw_fifoq_manager_image_get_free_buffer(&buf_addr, &buf_size, osWaitForever, _enable_inf_droppable);
-                        }
+            if (true == has_deadline)
+                stamp_inference_deadline(buf_addr, recv_tick);
 
-                        memcpy((void *)buf_addr, (void *)temp_cmd_buffer, txLen);
+            kmdw_fifoq_manager_image_enqueue_to_lane(total_image_count, image_index, lane, buf_addr, buf_size, osWaitForever, false);
+            continue;
+        }
 
-                        dbg_log("[%s] swap data from system reserve buffer to fifoq buffer: 0x%X\n", __FUNCTION__, buf_addr);
-                    }
+        if (buf_addr == temp_cmd_buffer)
+        {
+            // a command filling the peek is received on up to the size in its header stamp
+            if ((RECV_PEEK_SIZE == txLen) && (header_stamp->magic_type == KDP2_MAGIC_TYPE_COMMAND) && (header_stamp->total_size <= buf_size))
+            {
+                while (total_recv_len < header_stamp->total_size)
+                {
+                    txLen = header_stamp->total_size - total_recv_len;
+                    usb_sts = usbd_hal_bulk_receive(KDP2_USB_ENDPOINT_DATA_OUT, (uint32_t *)(buf_addr + total_recv_len), &txLen, osWaitForever);
+                    if (usb_sts != KDRV_STATUS_OK)
+                        break;
 
-                    if (header_stamp->total_size > buf_size) {
-                        // FIXME, serious error, make host SW pending (timeout)
-                        // reboot and configure bigger buffer !!!!
-                        kmdw_printf("[%s] error !! inf image size (%d) is bigger than buffer size (%d)\n", __FUNCTION__, total_wanted_len, buf_size);
-                        return; // a way to inform host SW ?
-                    }
+                    total_recv_len += txLen;
                 }
-                else
+
+                if (usb_sts != KDRV_STATUS_OK)
                 {
-                    recv_type = RECV_TYPE_COMMAND; // indicate this buffer contains a command (if no failuire)
-                    total_wanted_len = txLen;      // assume this is a command (or not if failure)
+                    receive_terminated(usb_sts);
+                    continue;
                 }
             }
-            else
+
+            // some commands reuse their buffer for data, ex. flash writing, a FIFO queue buffer freed meanwhile is roomier
+            if ((true == kmdw_fifoq_manager_get_fifoq_allocated()) &&
+                (osOK == kmdw_fifoq_manager_image_get_free_buffer(&pre_buf_addr, &pre_buf_size, 0, false)))
             {
-                // extra check for inference image data
-                kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)(buf_addr + total_recv_len);
-                if (header_stamp->magic_type == KDP2_MAGIC_TYPE_COMMAND ||
-                    header_stamp->magic_type == KDP2_MAGIC_TYPE_COMMAND)
+                if (total_recv_len <= pre_buf_size)
                 {
-                    // this should not happen
-                    kmdw_printf("[%s] error !! receiving inf image corrupted ! start over.\n", __FUNCTION__);
-                    recv_type = RECV_TYPE_UNKNOWN;
+                    memcpy((void *)pre_buf_addr, (void *)buf_addr, total_recv_len);
+                    buf_addr = pre_buf_addr;
+                    buf_size = pre_buf_size;
+                    header_stamp = (kp_inference_header_stamp_t *)buf_addr;
                 }
             }
+        }
 
-            total_recv_len += txLen;
+        dbg_log("[%s] buf 0x%x -- > command handler\n", __FUNCTION__, (void *)buf_addr);
 
-            dbg_log("[%s] host -- usb --> buf 0x%x len %d (total %d)\n", __FUNCTION__, (void *)buf_addr, txLen, total_recv_len);
+        // the FIFO queue buffers are replaced, the one taken in advance is given back before resizing
+        if ((KDP2_MAGIC_TYPE_COMMAND == header_stamp->magic_type) && (KDP2_COMMAND_RESIZE_FIFOQ == header_stamp->job_id))
+        {
+            kdp2_ipc_cmd_resize_fifo_queue_t resize_cmd = *(kdp2_ipc_cmd_resize_fifo_queue_t *)buf_addr;
 
-            if (total_recv_len == total_wanted_len)
-                break; // recv done
-            else if (total_recv_len > total_wanted_len)
-            {
-                kmdw_printf("[%s] warning !! actual received size (%d) is bigger than expected size (%d)\n", __FUNCTION__, total_recv_len, total_wanted_len);
-                break;
-            }
-        }
+            if (0 != pre_buf_addr)
+                kmdw_fifoq_manager_image_put_free_buffer(pre_buf_addr, pre_buf_size, osWaitForever);
 
-        if (recv_type == RECV_TYPE_INF_IMAGE)
-        {
-            dbg_log("[%s] buf 0x%x -- > inference queue\n", __FUNCTION__, (void *)buf_addr);
-            kmdw_fifoq_manager_image_enqueue(total_image_count, image_index, buf_addr, buf_size, osWaitForever, false);
+            pre_buf_addr = 0;
+            resize_inference_queue(&resize_cmd);
+            continue;
         }
-        else if (recv_type == RECV_TYPE_COMMAND)
+
+        // the command is handled in the buffer it is received into, a FIFO queue buffer is kept for the next transfer
+        process_plus_command(buf_addr, buf_size);
+    }
+}
+
+static bool is_coalescible_result(kp_inference_header_stamp_t *header_stamp)
+{
+    // results of customized inference are read by the host as they are
+    return (KDP2_MAGIC_TYPE_INFERENCE == header_stamp->magic_type) &&
+           ((KDP2_INF_ID_GENERIC_RAW == header_stamp->job_id) || (KDP2_INF_ID_GENERIC_RAW_BYPASS_PRE_PROC == header_stamp->job_id));
+}
+
+// pack results already pending behind 'buf_addr' into the staging buffer, return the number of packed results
+// a pending result which can not be packed is put back at the head of the result queue, so it is sent next
+static int coalesce_results(uint32_t buf_addr)
+{
+    kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)buf_addr;
+    uint32_t max_size = _coalesce_max_size;
+    uint32_t offset = sizeof(kdp2_ipc_coalesced_result_t) + ((header_stamp->total_size + 3) & ~3);
+    int num_result = 1;
+
+    if ((0 == max_size) || (false == is_coalescible_result(header_stamp)) || (offset > max_size))
+        return 1;
+
+    // the staging buffer is reserved here rather than in the control request, which runs in the USB interrupt context
+    if (0 == _coalesce_buf)
+    {
+        _coalesce_buf = kmdw_ddr_reserve(max_size);
+        if (0 == _coalesce_buf)
         {
-            dbg_log("[%s] buf 0x%x -- > command handler\n", __FUNCTION__, (void *)buf_addr);
-            process_plus_command(buf_addr);
-            // as the buffer is not put into inference queue, return it back to free buffer queue
-            if (temp_cmd_buffer != buf_addr)
-                kmdw_fifoq_manager_image_put_free_buffer(buf_addr, buf_size, osWaitForever);
+            _coalesce_max_size = 0; // results are sent one by one
+            return 1;
         }
-        else
+
+        _coalesce_buf_size = max_size;
+    }
+
+    if (max_size > _coalesce_buf_size)
+        max_size = _coalesce_buf_size;
+
+    kdp2_ipc_coalesced_result_t *coalesced = (kdp2_ipc_coalesced_result_t *)_coalesce_buf;
+
+    while (KDP2_COALESCED_RESULT_MAX_NUM > num_result)
+    {
+        uint32_t addr;
+        int size;
+
+        // never wait for a result, it would add latency to the ones done
+        if (osOK != kmdw_fifoq_manager_result_dequeue(&addr, &size, 0))
+            break;
+
+        kp_inference_header_stamp_t *next_stamp = (kp_inference_header_stamp_t *)addr;
+        uint32_t aligned_size = (next_stamp->total_size + 3) & ~3;
+
+        if ((false == is_coalescible_result(next_stamp)) || (offset + aligned_size > max_size))
         {
-            // invalid data !! ignore it !
-            dbg_log("[%s] XXXXXX buf 0x%x -- > free buffer queue\n", __FUNCTION__, (void *)buf_addr);
-            if (temp_cmd_buffer != buf_addr)
-                kmdw_fifoq_manager_image_put_free_buffer(buf_addr, buf_size, osWaitForever);
+            // nothing is held outside the queue, a FIFO queue reset or resize finds it there
+            if (osOK != kmdw_fifoq_manager_result_enqueue((void *)addr, size, true))
+                kmdw_fifoq_manager_result_put_free_buffer(addr, size, osWaitForever);
+            break;
         }
+
+        // the first result is copied only when there is another one to pack
+        if (1 == num_result)
+            memcpy((void *)(_coalesce_buf + sizeof(kdp2_ipc_coalesced_result_t)), (void *)buf_addr, header_stamp->total_size);
+
+        memcpy((void *)(_coalesce_buf + offset), (void *)addr, next_stamp->total_size);
+        offset += aligned_size;
+        num_result++;
+
+        kmdw_fifoq_manager_result_put_free_buffer(addr, size, osWaitForever);
     }
+
+    if (1 < num_result)
+    {
+        coalesced->header_stamp.magic_type = KDP2_MAGIC_TYPE_COALESCED_RESULT;
+        coalesced->header_stamp.total_size = offset;
+        coalesced->header_stamp.job_id = 0;
+        coalesced->header_stamp.status_code = KP_SUCCESS;
+        coalesced->header_stamp.total_image = num_result;
+        coalesced->header_stamp.image_index = 0;
+    }
+
+    return num_result;
 }
 
 void kdp2_usb_companion_result_thread(void *arg)
@@ -404,8 +695,14 @@ void kdp2_usb_companion_result_thread(void *arg)
             bRunning_dbg = false;
         }
 
+        uint32_t send_addr = buf_addr;
+
+        // pack the results pending behind this one into one transfer
+        if (1 < coalesce_results(buf_addr))
+            send_addr = _coalesce_buf;
+
         // send result to the host, blocking wait
-        kdrv_status_t usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)buf_addr, header_stamp->total_size, osWaitForever);
+        kdrv_status_t usb_sts = usbd_hal_bulk_send(KDP2_USB_ENDPOINT_DATA_IN, (void *)send_addr, ((kp_inference_header_stamp_t *)send_addr)->total_size, osWaitForever);
 
         if (usb_sts != KDRV_STATUS_OK) // KDRV_STATUS_USBD_TRANSFER_TERMINATED or KDRV_STATUS_USBD_TRANSFER_DISCONNECTED
         {
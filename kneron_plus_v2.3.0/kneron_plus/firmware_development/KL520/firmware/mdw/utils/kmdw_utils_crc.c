@@ -414,7 +414,6 @@ uint32_t kmdw_utils_crc_gen_sum32(uint8_t *data, uint32_t size)
     return(sum);
 }
 
-#if ENABLE_CRC32
 static const uint32_t crc32_tab[] = {
 	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
 	0xe963a535, 0x9e6495a3,	0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
@@ -520,4 +519,3 @@ uint16_t kmdw_utils_crc_gen_crc16(uint8_t *data, uint32_t size)
 
     return crc;
 }
-#endif
@@ -0,0 +1,34 @@
+#!/bin/bash
+function fail {
+    printf '%s\n' "$1"
+    exit "${2-1}"
+}
+
+build_type=$1
+if [[ -z $build_type ]];then
+    build_type=Release
+elif [[ $build_type == "debug" ]];then
+    build_type=Debug
+elif [[ $build_type == "release" ]];then
+    build_type=Release
+else
+    fail "[ERROR] wrong argument! Usage: bulid.sh [debug|release]"
+fi
+
+echo Start to compile ...
+
+if [ -d "./build" ];then
+    rm -rf ./build
+fi
+mkdir build
+cd build
+
+cmake .. -DCMAKE_BUILD_TYPE=$build_type
+status=$?
+[ $status -eq 0 ] && echo "[INFO] cmake done" || fail "[ERROR] cmake failed"
+
+make -j
+status=$?
+[ $status -eq 0 ] && echo "[INFO] compile done" || fail "[ERROR] compile failed"
+
+echo [Done]
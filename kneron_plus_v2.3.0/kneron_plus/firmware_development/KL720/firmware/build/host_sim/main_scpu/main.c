@@ -0,0 +1,621 @@
+/* Copyright (c) 2022 Kneron, Inc. All Rights Reserved.
+ *
+ * The information contained herein is property of Kneron, Inc.
+ * Terms and conditions of usage are described in detail in Kneron
+ * STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information.
+ * NO WARRANTY of ANY KIND is provided. This heading must NOT be removed
+ * from the file.
+ */
+
+/******************************************************************************
+*  Filename:
+*  ---------
+*  main.c
+*
+*  Description:
+*  ------------
+*  Benchmark of the KL720 companion-mode inference middleware running natively
+*  on a Linux host. The SCPU side is brought up like solution_kdp2_user_ex,
+*  then main() plays the USB host and streams 'Generic RAW inference' images.
+*
+*  Reported:
+*  - queue throughput (FPS) and end-to-end latency (host send -> result read)
+*  - dispatcher latency (image fully received -> NCPU takes it)
+*  - buffer hold time (image received -> NCPU done) and turnaround (receive to
+*    receive of the same FIFO buffer)
+*  - host time blocked waiting for a free FIFO buffer, NCPU/NPU utilization
+*  - with -L, latency and FIFO queue statistics of an urgent lane (0) next to
+*    a background lane (1)
+*  - with -D, drop reports of images which can not be inferenced before their
+*    deadline and the number of late results
+*  - with -j, the same for JPEG bitstreams decoded by the NCPU into the rest of
+*    their FIFO buffers
+*
+******************************************************************************/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "cmsis_os2.h"
+#include "project.h"
+
+#include "kp_struct.h"
+#include "kmdw_console.h"
+#include "kmdw_memory.h"
+#include "kmdw_inference_app.h"
+#include "kmdw_fifoq_manager.h"
+#include "kdp2_usb_companion.h"
+#include "kdp2_ipc_cmd.h"
+#include "kdp2_inf_generic_raw.h"
+#include "host_sim.h"
+
+#define MAX_IMAGE_COUNT     10          /**< MAX inference input  queue slot count */
+#define MAX_RESULT_COUNT    10          /**< MAX inference output queue slot count */
+
+#define SIM_MODEL_ID        211         /**< an arbitrary model ID served by the fake NCPU */
+#define SIM_MAX_FIFO_BUF    16
+#define SIM_USB_TIMEOUT_MS  5000
+#define SIM_FIFOQ_UNIT      (10 * 1024) /**< buffer size unit of KDP2_CONTROL_FIFOQ_CONFIGURE */
+
+extern void kmdw_inference_image_dispatcher_thread(void *argument);
+extern void kmdw_inference_result_handler_callback_thread(void *argument);
+extern void kdp2_usb_companion_result_thread(void *arg);
+extern void kdp2_usb_companion_image_thread(void *arg);
+extern void kdp2_fifoq_manager_enqueue_image_thread(void *arg);
+
+typedef struct
+{
+    const char *name;
+    osThreadFunc_t entry;
+    uint32_t stack_size;
+    osPriority_t priority;
+} sim_task_t;
+
+// the same threads and priorities as task_handler.h of solution_kdp2_user_ex
+static const sim_task_t _task_pool[] = {
+    {"Infdata",     kmdw_inference_image_dispatcher_thread,         4096,   osPriorityHigh},
+    {"Infcb",       kmdw_inference_result_handler_callback_thread,  2048,   osPriorityHigh},
+    {"buf_mgr",     kdp2_fifoq_manager_enqueue_image_thread,        1024,   osPriorityNormal},
+    {"usbrecv",     kdp2_usb_companion_image_thread,                2048,   osPriorityBelowNormal},
+    {"usbsend",     kdp2_usb_companion_result_thread,               2048,   osPriorityBelowNormal},
+    {NULL, NULL, 0, osPriorityNone},
+};
+
+typedef struct
+{
+    uint32_t frames;
+    uint32_t image_count;
+    uint32_t result_count;
+    uint32_t width;
+    uint32_t height;
+    uint32_t raw_output_size;
+    uint32_t pre_proc_us;
+    uint32_t npu_us;
+    uint32_t post_proc_us;
+    uint32_t bytes_per_us;
+    uint32_t lane_period;
+    uint32_t deadline_us;
+    uint32_t jpeg_size;
+    uint32_t jpeg_dec_us;
+    int cpu;
+} sim_config_t;
+
+typedef struct
+{
+    uint32_t addr;
+    uint64_t last_recv_us;
+    uint64_t turnaround_us;
+    uint32_t turnaround_count;
+    uint64_t hold_us;
+    uint32_t hold_count;
+} sim_fifo_buf_stat_t;
+
+static sim_config_t _cfg = {
+    .frames = 1000,
+    .image_count = 3,
+    .result_count = 3,
+    .width = 640,
+    .height = 480,
+    .raw_output_size = 256 * 1024,
+    .pre_proc_us = 1000,
+    .npu_us = 8000,
+    .post_proc_us = 0,
+    .bytes_per_us = 300,
+    .lane_period = 0,
+    .deadline_us = 0,
+    .jpeg_size = 0,
+    .jpeg_dec_us = 4000,
+    .cpu = -1,
+};
+
+static uint32_t _image_total_size = 0;
+static uint32_t _image_offset = sizeof(kdp2_ipc_generic_raw_inf_header_t); // of the image taken by the NCPU in the FIFO buffer
+
+static uint64_t *_send_start_us = NULL;     // per inference number
+static uint64_t *_send_done_us = NULL;
+static uint64_t *_dispatch_us = NULL;
+static uint64_t *_result_us = NULL;
+static uint64_t _blocked_us = 0;
+static uint32_t _result_errors = 0;
+static uint32_t _dropped[KP_INFERENCE_DROP_UNREACHABLE + 1]; // per kp_inference_drop_reason_t
+
+static pthread_mutex_t _stat_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_fifo_buf_stat_t _buf_stat[SIM_MAX_FIFO_BUF];
+static int _buf_stat_count = 0;
+
+static void _app_func(int num_input_buf, void **inf_input_buf_list)
+{
+    kp_inference_header_stamp_t *header_stamp = (kp_inference_header_stamp_t *)inf_input_buf_list[0];
+
+    kmdw_inference_app_send_status_code(header_stamp->job_id, KP_FW_ERROR_UNKNOWN_APP);
+}
+
+static void task_initialize(void)
+{
+    for (int i = 0; NULL != _task_pool[i].name; i++)
+    {
+        osThreadAttr_t attr = {
+            .name = _task_pool[i].name,
+            .stack_size = _task_pool[i].stack_size,
+            .priority = _task_pool[i].priority,
+        };
+
+        if (NULL == osThreadNew(_task_pool[i].entry, NULL, &attr))
+            printf("failed to create thread %s\n", _task_pool[i].name);
+    }
+}
+
+static sim_fifo_buf_stat_t *_get_buf_stat(uint32_t addr)
+{
+    for (int i = 0; i < _buf_stat_count; i++)
+    {
+        if (_buf_stat[i].addr == addr)
+            return &_buf_stat[i];
+    }
+
+    if (SIM_MAX_FIFO_BUF <= _buf_stat_count)
+        return NULL;
+
+    _buf_stat[_buf_stat_count].addr = addr;
+    return &_buf_stat[_buf_stat_count++];
+}
+
+static void _usb_receive_hook(uint32_t buf_addr, uint32_t offset, uint32_t len)
+{
+    if (offset + len != _image_total_size)
+        return;
+
+    uint64_t now = host_sim_get_time_us();
+    uint32_t buf = buf_addr - offset;
+
+    pthread_mutex_lock(&_stat_lock);
+
+    sim_fifo_buf_stat_t *stat = _get_buf_stat(buf);
+    if (NULL != stat)
+    {
+        if (0 != stat->last_recv_us)
+        {
+            stat->turnaround_us += now - stat->last_recv_us;
+            stat->turnaround_count++;
+        }
+        stat->last_recv_us = now;
+    }
+
+    pthread_mutex_unlock(&_stat_lock);
+}
+
+static void _ncpu_job_hook(uint32_t image_addr, bool done)
+{
+    uint64_t now = host_sim_get_time_us();
+    uint32_t buf = image_addr - _image_offset;
+    uint32_t inf_number = ((kdp2_ipc_generic_raw_inf_header_t *)buf)->inference_number;
+
+    if (false == done)
+    {
+        if (inf_number < _cfg.frames)
+            _dispatch_us[inf_number] = now;
+        return;
+    }
+
+    pthread_mutex_lock(&_stat_lock);
+
+    sim_fifo_buf_stat_t *stat = _get_buf_stat(buf);
+    if ((NULL != stat) && (0 != stat->last_recv_us))
+    {
+        stat->hold_us += now - stat->last_recv_us;
+        stat->hold_count++;
+    }
+
+    pthread_mutex_unlock(&_stat_lock);
+}
+
+static void *_result_reader(void *arg)
+{
+    uint32_t result_size = *(uint32_t *)arg;
+    uint8_t *buf = (uint8_t *)malloc(result_size);
+
+    for (uint32_t i = 0; i < _cfg.frames; i++)
+    {
+        int len = usbd_sim_host_bulk_read(buf, result_size, SIM_USB_TIMEOUT_MS);
+        if (0 > len)
+        {
+            printf("result read timeout after %u results\n", i);
+            break;
+        }
+
+        kdp2_ipc_generic_raw_result_t *result = (kdp2_ipc_generic_raw_result_t *)buf;
+
+        if (KP_FW_INFERENCE_DEADLINE_MISSED_136 == result->header_stamp.status_code)
+        {
+            kdp2_ipc_inf_drop_report_t *report = (kdp2_ipc_inf_drop_report_t *)buf;
+
+            if (KP_INFERENCE_DROP_UNREACHABLE >= report->reason)
+                _dropped[report->reason]++;
+            continue;
+        }
+
+        if ((KP_SUCCESS != result->header_stamp.status_code) || (result->inf_number >= _cfg.frames))
+        {
+            _result_errors++;
+            continue;
+        }
+
+        _result_us[result->inf_number] = host_sim_get_time_us();
+    }
+
+    free(buf);
+    return NULL;
+}
+
+// with lanes every 'lane_period'-th frame is urgent (lane 0), the others are background (lane 1)
+static uint32_t _frame_lane(uint32_t inf_number)
+{
+    if (0 == _cfg.lane_period)
+        return 0;
+
+    return (0 == (inf_number % _cfg.lane_period)) ? 0 : 1;
+}
+
+static int _cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void _usage(const char *prog)
+{
+    printf("usage: %s [options]\n", prog);
+    printf("  -n <frames>       number of inference images (%u)\n", _cfg.frames);
+    printf("  -i <count>        image FIFO buffer count, 1~8 (%u)\n", _cfg.image_count);
+    printf("  -r <count>        result FIFO buffer count, 1~8 (%u)\n", _cfg.result_count);
+    printf("  -W <width>        RGB565 image and model width (%u)\n", _cfg.width);
+    printf("  -H <height>       RGB565 image and model height (%u)\n", _cfg.height);
+    printf("  -o <bytes>        model raw output size (%u)\n", _cfg.raw_output_size);
+    printf("  -p <us>           NCPU pre-processing time (%u)\n", _cfg.pre_proc_us);
+    printf("  -c <us>           NPU time (%u)\n", _cfg.npu_us);
+    printf("  -q <us>           NCPU post-processing time (%u)\n", _cfg.post_proc_us);
+    printf("  -t <bytes/us>     USB throughput, 0 for unlimited (%u)\n", _cfg.bytes_per_us);
+    printf("  -L <period>       send every period-th frame on lane 0 and the rest on lane 1, 0 for no lanes (%u)\n", _cfg.lane_period);
+    printf("  -D <us>           send images with a deadline and enable deadline drop, 0 for no deadline (%u)\n", _cfg.deadline_us);
+    printf("  -j <bytes>        send JPEG bitstreams of this size instead of RGB565 images, 0 for RGB565 (%u)\n", _cfg.jpeg_size);
+    printf("  -d <us>           NCPU JPEG decode time (%u)\n", _cfg.jpeg_dec_us);
+    printf("  -a <cpu>          pin SCPU threads to a host CPU (none)\n");
+}
+
+static int _parse_args(int argc, char *argv[])
+{
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "n:i:r:W:H:o:p:c:q:t:L:D:j:d:a:h")))
+    {
+        switch (opt)
+        {
+        case 'n': _cfg.frames = strtoul(optarg, NULL, 0); break;
+        case 'i': _cfg.image_count = strtoul(optarg, NULL, 0); break;
+        case 'r': _cfg.result_count = strtoul(optarg, NULL, 0); break;
+        case 'W': _cfg.width = strtoul(optarg, NULL, 0); break;
+        case 'H': _cfg.height = strtoul(optarg, NULL, 0); break;
+        case 'o': _cfg.raw_output_size = strtoul(optarg, NULL, 0); break;
+        case 'p': _cfg.pre_proc_us = strtoul(optarg, NULL, 0); break;
+        case 'c': _cfg.npu_us = strtoul(optarg, NULL, 0); break;
+        case 'q': _cfg.post_proc_us = strtoul(optarg, NULL, 0); break;
+        case 't': _cfg.bytes_per_us = strtoul(optarg, NULL, 0); break;
+        case 'L': _cfg.lane_period = strtoul(optarg, NULL, 0); break;
+        case 'D': _cfg.deadline_us = strtoul(optarg, NULL, 0); break;
+        case 'j': _cfg.jpeg_size = strtoul(optarg, NULL, 0); break;
+        case 'd': _cfg.jpeg_dec_us = strtoul(optarg, NULL, 0); break;
+        case 'a': _cfg.cpu = atoi(optarg); break;
+        default:
+            _usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if ((0 == _cfg.frames) || (1 > _cfg.image_count) || (8 < _cfg.image_count) ||
+        (1 > _cfg.result_count) || (8 < _cfg.result_count) || (0 == _cfg.width) || (0 == _cfg.height) ||
+        ((0 < _cfg.jpeg_size) && (2 > _cfg.jpeg_size)))
+    {
+        _usage(argv[0]);
+        return -1;
+    }
+
+    return 0;
+}
+
+// print end-to-end latency of the frames of a lane, or of all frames for lane -1, return the number of done frames
+static uint32_t _report_latency(const char *label, int lane)
+{
+    uint64_t *latency = (uint64_t *)calloc(_cfg.frames, sizeof(uint64_t));
+    uint64_t latency_sum = 0;
+    uint32_t done = 0;
+
+    for (uint32_t i = 0; i < _cfg.frames; i++)
+    {
+        if ((0 != _result_us[i]) && ((0 > lane) || ((uint32_t)lane == _frame_lane(i))))
+        {
+            latency[done] = _result_us[i] - _send_start_us[i];
+            latency_sum += latency[done];
+            done++;
+        }
+    }
+
+    qsort(latency, done, sizeof(uint64_t), _cmp_u64);
+
+    if (0 < done)
+    {
+        printf("%-18s: avg %llu, p50 %llu, p99 %llu, max %llu\n", label,
+               (unsigned long long)(latency_sum / done),
+               (unsigned long long)latency[done / 2],
+               (unsigned long long)latency[(done * 99) / 100],
+               (unsigned long long)latency[done - 1]);
+    }
+
+    free(latency);
+
+    return done;
+}
+
+static void _report_lanes(void)
+{
+    for (uint32_t lane = 0; lane < 2; lane++)
+    {
+        dual_fifo2_lane_stats_t stats;
+        char label[32];
+
+        snprintf(label, sizeof(label), "lane %u e2e (us)", lane);
+        _report_latency(label, (int)lane);
+
+        if (osOK != kmdw_fifoq_manager_image_get_lane_stats(lane, &stats))
+            continue;
+
+        printf("lane %u queue      : %u enqueued, %u dequeued, peak depth %u, wait avg %llu us, max %u us\n", lane,
+               stats.enqueued, stats.dequeued, stats.peak_depth,
+               (unsigned long long)((0 < stats.dequeued) ? stats.total_wait_us / stats.dequeued : 0), stats.max_wait_us);
+    }
+}
+
+static void _report(uint64_t elapsed_us)
+{
+    uint64_t dispatch_sum = 0;
+    uint64_t dispatch_max = 0;
+    uint32_t done = 0;
+    uint32_t dispatched = 0;
+
+    for (uint32_t i = 0; i < _cfg.frames; i++)
+    {
+        if (0 != _result_us[i])
+            done++;
+
+        if ((0 != _dispatch_us[i]) && (_dispatch_us[i] >= _send_done_us[i]))
+        {
+            uint64_t d = _dispatch_us[i] - _send_done_us[i];
+            dispatch_sum += d;
+            dispatch_max = (d > dispatch_max) ? d : dispatch_max;
+            dispatched++;
+        }
+    }
+
+    uint64_t ncpu_busy_us, npu_busy_us;
+    ncpu_sim_get_busy_time(&ncpu_busy_us, &npu_busy_us);
+
+    printf("\n");
+    printf("frames            : %u done, %u errors, image %u bytes\n", done, _result_errors, _image_total_size);
+    printf("FIFO queue        : %u image buffers, %u result buffers\n", _cfg.image_count, _cfg.result_count);
+    printf("elapsed           : %.3f ms\n", elapsed_us / 1000.0);
+    printf("throughput        : %.2f FPS\n", (0 < elapsed_us) ? done * 1000000.0 / elapsed_us : 0.0);
+
+    _report_latency("e2e latency (us)", -1);
+
+    if (0 < _cfg.lane_period)
+        _report_lanes();
+
+    if (0 < _cfg.deadline_us)
+    {
+        uint32_t late = 0;
+
+        for (uint32_t i = 0; i < _cfg.frames; i++)
+        {
+            if ((0 != _result_us[i]) && (_result_us[i] - _send_start_us[i] > _cfg.deadline_us))
+                late++;
+        }
+
+        printf("deadline drops    : %u expired, %u unreachable, %u done frames late\n",
+               _dropped[KP_INFERENCE_DROP_EXPIRED], _dropped[KP_INFERENCE_DROP_UNREACHABLE], late);
+    }
+
+    if (0 < dispatched)
+    {
+        printf("dispatch (us)     : avg %llu, max %llu (image received -> NCPU start)\n",
+               (unsigned long long)(dispatch_sum / dispatched), (unsigned long long)dispatch_max);
+    }
+
+    printf("host blocked      : %.3f ms total, %.1f us per frame\n", _blocked_us / 1000.0, (double)_blocked_us / _cfg.frames);
+    printf("NCPU / NPU busy   : %.1f%% / %.1f%%\n",
+           (0 < elapsed_us) ? ncpu_busy_us * 100.0 / elapsed_us : 0.0,
+           (0 < elapsed_us) ? npu_busy_us * 100.0 / elapsed_us : 0.0);
+
+    for (int i = 0; i < _buf_stat_count; i++)
+    {
+        sim_fifo_buf_stat_t *stat = &_buf_stat[i];
+
+        printf("buffer 0x%08X : hold avg %llu us, turnaround avg %llu us (%u cycles)\n", stat->addr,
+               (unsigned long long)((0 < stat->hold_count) ? stat->hold_us / stat->hold_count : 0),
+               (unsigned long long)((0 < stat->turnaround_count) ? stat->turnaround_us / stat->turnaround_count : 0),
+               stat->turnaround_count);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (0 != _parse_args(argc, argv))
+        return 1;
+
+    if (0 != host_sim_map_memory())
+        return 1;
+
+    /* middleware initialization, see middleware_init.c */
+    kmdw_ddr_init(DDR_HEAP_BEGIN, DDR_HEAP_END);
+    kmdw_ddr_store_system_reserve(DDR_SYSTEM_RESERVE_BEGIN, DDR_SYSTEM_RESERVE_END);
+
+    if (0 != ncpu_sim_set_model(SIM_MODEL_ID, _cfg.width, _cfg.height, _cfg.raw_output_size))
+        return 1;
+
+    ncpu_sim_set_timing(_cfg.pre_proc_us, _cfg.npu_us, _cfg.post_proc_us);
+    ncpu_sim_set_jpeg_decode_time(_cfg.jpeg_dec_us);
+    ncpu_sim_set_job_hook(_ncpu_job_hook);
+    usbd_sim_set_throughput(_cfg.bytes_per_us);
+    usbd_sim_set_receive_hook(_usb_receive_hook);
+    host_sim_rtos_set_cpu(_cfg.cpu);
+
+    osKernelInitialize();
+
+    ncpu_sim_initialize();
+
+    /* application initialization, see application_init.c */
+    kmdw_inference_app_init(_app_func, MAX_IMAGE_COUNT, MAX_RESULT_COUNT);
+    kdp2_usb_companion_init();
+
+    task_initialize();
+
+    osKernelStart();
+
+    /* ---- from here main() is the USB host ---- */
+
+    _send_start_us = (uint64_t *)calloc(_cfg.frames, sizeof(uint64_t));
+    _send_done_us = (uint64_t *)calloc(_cfg.frames, sizeof(uint64_t));
+    _dispatch_us = (uint64_t *)calloc(_cfg.frames, sizeof(uint64_t));
+    _result_us = (uint64_t *)calloc(_cfg.frames, sizeof(uint64_t));
+
+    // let the threads reach their waits, enumeration takes longer than this on a real link
+    osDelay(100);
+    usbd_sim_host_connect(true);
+
+    uint32_t image_size = (0 < _cfg.jpeg_size) ? _cfg.jpeg_size : _cfg.width * _cfg.height * 2; // JPEG or RGB565
+    _image_total_size = sizeof(kdp2_ipc_generic_raw_inf_header_t) + image_size;
+    if (0 < _cfg.deadline_us)
+        _image_total_size += sizeof(kdp2_ipc_inf_deadline_t);
+    uint32_t result_size = sizeof(kdp2_ipc_generic_raw_result_t) + sizeof(_720_raw_cnn_res_t) + _cfg.raw_output_size;
+
+    // a JPEG bitstream is decoded to YUYV behind itself in the same FIFO buffer
+    uint32_t image_buf_size = _image_total_size;
+    if (0 < _cfg.jpeg_size)
+    {
+        _image_offset = (_image_total_size + KDP2_INF_JPEG_DECODE_ALIGN - 1) & ~(KDP2_INF_JPEG_DECODE_ALIGN - 1);
+        image_buf_size = _image_offset + _cfg.width * _cfg.height * 2;
+    }
+
+    uint32_t image_units = (image_buf_size + SIM_FIFOQ_UNIT - 1) / SIM_FIFOQ_UNIT;
+    uint32_t result_units = (result_size + SIM_FIFOQ_UNIT - 1) / SIM_FIFOQ_UNIT;
+
+    uint16_t wValue = (uint16_t)((_cfg.image_count - 1) | ((image_units - 1) << 3));
+    uint16_t wIndex = (uint16_t)((_cfg.result_count - 1) | ((result_units - 1) << 3));
+
+    if (false == usbd_sim_host_control(KDP2_CONTROL_FIFOQ_CONFIGURE, wValue, wIndex))
+    {
+        printf("failed to configure the FIFO queue\n");
+        return 1;
+    }
+
+    if ((0 < _cfg.deadline_us) && (false == usbd_sim_host_control(KDP2_CONTROL_FIFOQ_ENABLE_DEADLINE_DROP, 1, 0)))
+    {
+        printf("failed to enable deadline drop\n");
+        return 1;
+    }
+
+    uint8_t *image = (uint8_t *)calloc(1, _image_total_size);
+    kdp2_ipc_generic_raw_inf_header_t *header = (kdp2_ipc_generic_raw_inf_header_t *)image;
+
+    header->header_stamp.magic_type = KDP2_MAGIC_TYPE_INFERENCE;
+    header->header_stamp.total_size = _image_total_size;
+    header->header_stamp.job_id = KDP2_INF_ID_GENERIC_RAW;
+    header->header_stamp.total_image = 1;
+    header->header_stamp.image_index = 0;
+    header->model_id = SIM_MODEL_ID;
+    header->image_header.width = _cfg.width;
+    header->image_header.height = _cfg.height;
+    header->image_header.resize_mode = KP_RESIZE_ENABLE;
+    header->image_header.padding_mode = KP_PADDING_CORNER;
+    header->image_header.image_format = (0 < _cfg.jpeg_size) ? KP_IMAGE_FORMAT_JPEG : KP_IMAGE_FORMAT_RGB565;
+    header->image_header.normalize_mode = KP_NORMALIZE_KNERON;
+    header->image_header.crop_count = 0;
+
+    if (0 < _cfg.jpeg_size)
+    {
+        // SOI marker, the fake NCPU does not look further
+        image[sizeof(kdp2_ipc_generic_raw_inf_header_t)] = 0xFF;
+        image[sizeof(kdp2_ipc_generic_raw_inf_header_t) + 1] = 0xD8;
+    }
+
+    kdp2_ipc_inf_deadline_t *deadline = (kdp2_ipc_inf_deadline_t *)(image + _image_total_size - sizeof(kdp2_ipc_inf_deadline_t));
+
+    pthread_t reader;
+    pthread_create(&reader, NULL, _result_reader, &result_size);
+
+    uint64_t start_us = host_sim_get_time_us();
+
+    for (uint32_t i = 0; i < _cfg.frames; i++)
+    {
+        uint64_t blocked_us = 0;
+
+        header->inference_number = i;
+
+        if (0 < _cfg.lane_period)
+            header->header_stamp.status_code = KDP2_INF_LANE_TAG | _frame_lane(i);
+
+        if (0 < _cfg.deadline_us)
+        {
+            header->header_stamp.status_code = KDP2_INF_LANE_TAG | KDP2_INF_DEADLINE_FLAG | _frame_lane(i);
+            deadline->inference_number = i;
+            deadline->model_id = SIM_MODEL_ID;
+            deadline->budget_us = _cfg.deadline_us;
+        }
+
+        _send_start_us[i] = host_sim_get_time_us();
+
+        if (0 != usbd_sim_host_bulk_write(image, _image_total_size, SIM_USB_TIMEOUT_MS, &blocked_us))
+        {
+            printf("image write timeout at frame %u\n", i);
+            break;
+        }
+
+        _send_done_us[i] = host_sim_get_time_us();
+        _blocked_us += blocked_us;
+    }
+
+    pthread_join(reader, NULL);
+
+    uint64_t elapsed_us = host_sim_get_time_us() - start_us;
+
+    _report(elapsed_us);
+
+    free(image);
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/* Copyright (c) 2022 Kneron, Inc. All Rights Reserved.
+ *
+ * The information contained herein is property of Kneron, Inc.
+ * Terms and conditions of usage are described in detail in Kneron
+ * STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information.
+ * NO WARRANTY of ANY KIND is provided. This heading must NOT be removed
+ * from the file.
+ */
+
+/******************************************************************************
+*  Filename:
+*  ---------
+*  project.h
+*
+*  Description:
+*  ------------
+*  Project settings of the host-native middleware build, the memory map is the
+*  same as solution_kdp2_user_ex/sn72096_9x9, there is no board or clock setting.
+*
+******************************************************************************/
+
+#ifndef _PROJECT_H_
+#define _PROJECT_H_
+
+
+/*=============================================================================
+asic setting
+=============================================================================*/
+#include "membase.h"
+
+
+/*=============================================================================
+mdw setting
+=============================================================================*/
+#define DDR_SCATTER_SPACE_BASE              0x85900000
+#define DDR_SCATTER_SPACE_SIZE              0x00000000
+
+#define DDR_SYSTEM_RESERVE_END              0x88000000
+#define DDR_SYSTEM_RESERVE_BEGIN            0x87FFA000
+
+#define DDR_HEAP_BEGIN                      0x87FFA000      // 127MB + 1000KB from base 0x80000000
+#define DDR_HEAP_END                        (DDR_SCATTER_SPACE_BASE+DDR_SCATTER_SPACE_SIZE)
+
+// Size limit of all_models.bin
+#define DDR_MEM_MODEL_MAX_SIZE              ((DDR_HEAP_END - DDR_MEM_BASE) & ~0x000FFFFF)
+
+
+/*===========================================================================
+log level setting
+============================================================================*/
+#define SCPU_LOG_LEVEL                 (BIT1 | BIT7)
+#define NCPU_LOG_LEVEL                 (BIT1)
+
+#endif //_PROJECT_H_
@@ -7,6 +7,7 @@
 #include "kmdw_power_manager.h"
 #include "kdrv_cmsis_core.h"
 #include "kdev_flash.h"
+#include "kmdw_memxfer.h"
 
 #define VERIFY_BLK_SZ  FLASH_MINI_BLOCK_SIZE    //NOR:4KB, NAND:128KB
 
@@ -1152,3 +1153,81 @@ int kmdw_dfu_update_model_flash_process(uint32_t addr, uint32_t info_size, uint3
         err_msg("[%s]: flashing done\n",__FUNCTION__);
         return ret;
 }
+
+uint32_t kmdw_dfu_get_model_info_flash_addr(void)
+{
+    return MODEL_INFO_FLASH_ADDR;
+}
+
+uint32_t kmdw_dfu_get_all_models_flash_addr(void)
+{
+    return MODEL_ALL_BIN_FLASH_ADDR;
+}
+
+uint32_t kmdw_dfu_get_flash_block_size(void)
+{
+    return VERIFY_BLK_SZ;
+}
+
+int kmdw_dfu_get_flash_digest(uint32_t flash_addr, uint32_t size, uint32_t *sector_size, uint32_t *digest, uint32_t max_sector, uint32_t mem_addr, uint32_t mem_size)
+{
+    uint32_t sect_size = *sector_size;
+    uint32_t sect_num, offset, len;
+
+    if ((flash_addr & 0xfff) != 0)
+    {
+        err_msg("flash address does not align to 4K boundary");
+        return -1;
+    }
+
+    // a sector is always erased as a whole, so it is made of whole erase blocks (4KB on NOR, 128KB on NAND)
+    if (sect_size == 0)
+        sect_size = VERIFY_BLK_SZ;
+    sect_size = (sect_size + VERIFY_BLK_SZ - 1) / VERIFY_BLK_SZ * VERIFY_BLK_SZ;
+
+    // flash is read into the buffer a sector at a time, a larger sector is cut to fit it
+    if (sect_size > mem_size)
+        sect_size = mem_size / VERIFY_BLK_SZ * VERIFY_BLK_SZ;
+    if (sect_size == 0)
+    {
+        err_msg("[%s]: buffer of %d bytes too small\n", __FUNCTION__, mem_size);
+        return -1;
+    }
+
+    // a cut sector size may need more sectors than the caller has, the area is covered partly then
+    sect_num = (size + sect_size - 1) / sect_size;
+    if (sect_num > max_sector)
+        sect_num = max_sector;
+
+    for (uint32_t sect = 0; sect < sect_num; sect++)
+    {
+        offset = sect * sect_size;
+        len = (size - offset) > sect_size ? sect_size : (size - offset);
+
+        kdp_memxfer_flash_to_ddr(mem_addr, flash_addr + offset, len);
+        digest[sect] = kmdw_utils_crc_gen_crc32((uint8_t *)mem_addr, len);
+    }
+
+    *sector_size = sect_size;
+    return sect_num;
+}
+
+int kmdw_dfu_write_flash(uint32_t mem_addr, uint32_t flash_addr, uint32_t size)
+{
+    int ret;
+
+    dfu_pre_update();
+
+    ret = dfu_mem_to_flash_4k_blocks(mem_addr, flash_addr, size);
+    if (ret == 0)
+        ret = dfu_post_flash_verify_4kblock(flash_addr, size, (uint8_t *)mem_addr);
+
+    dfu_update_abort(0);
+
+    if (ret != 0) {
+        err_msg("[%s]: write flash at 0x%X failed\n", __FUNCTION__, flash_addr);
+        return MSG_FLASH_FAIL;
+    }
+
+    return SUCCESS;
+}
@@ -24,6 +24,9 @@ enum
     KDP2_CONTROL_FIFOQ_ENABLE_DROPPABLE = 0x83, // enable/disable droppable inference image attribute (default : disabled)
     KDP2_CONTROL_DDR_HEAP_BOUNDARY_ADJUST = 0x84, // adjust the boundary address of the ddr heap
     KDP2_CONTROL_REBOOT_SYSTEM = 0x85,          // reboot the entire system (KL630 only)
+    KDP2_CONTROL_FIFOQ_ENABLE_COALESCING = 0x86, // pack pending results into one bulk transfer, wValue is the maximum transfer size in KB (0 : disabled)
+    KDP2_CONTROL_FIFOQ_ENABLE_DEADLINE_DROP = 0x87, // drop images which can not be inferenced before their deadline (default : disabled)
+    KDP2_CONTROL_QUERY_COMMAND = 0x88,              // succeeds if the firmware handles the KDP2 command in wValue, older firmware stalls it like any unknown request
 };
 
 // below are for usb bulk command transfer
@@ -52,8 +55,15 @@ enum kdp2_command_id
     KDP2_COMMAND_GET_PERFORMANCE_MONITOR_STATISTICS = 0xA15,    // not supported
     KDP2_COMMAND_UPDATE_NEF = 0xA16,        // not supported
     KDP2_COMMAND_GET_TDC_TEMPERATURE = 0xA17,
+    KDP2_COMMAND_UNLOAD_MODEL = 0xA18,      // stop inference and unload models without reboot
+    KDP2_COMMAND_RESIZE_FIFOQ = 0xA19,      // replace FIFO queue buffers without reboot
+    KDP2_COMMAND_GET_DDR_HEAP_STATS = 0xA1A,
+    KDP2_COMMAND_CONFIGURE_INF_LANES = 0xA1B, // set priority and weight of the inference lanes
+    KDP2_COMMAND_GET_INF_LANE_STATS = 0xA1C,
     KDP2_COMMAND_READ_FLASH = 0xA98,        // not supported
-    KDP2_COMMAND_WRITE_FLASH = 0xA99,       // not supported
+    KDP2_COMMAND_WRITE_FLASH = 0xA99,
+    KDP2_COMMAND_GET_FLASH_DIGEST = 0xA9A,
+    KDP2_COMMAND_WRITE_FLASH_STREAM = 0xA9B,
 };
 
 // below are for firmware serial number
@@ -125,6 +135,13 @@ typedef struct
     uint8_t fw_info[];
 } __attribute__((aligned(4))) kdp2_ipc_cmd_load_model_t;
 
+typedef struct
+{
+    uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
+    uint32_t total_size; // size of this data struct
+    uint32_t command_id; // should be 'KDP2_COMMAND_UNLOAD_MODEL'
+} __attribute__((aligned(4))) kdp2_ipc_cmd_unload_model_t;
+
 typedef struct
 {
     uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
@@ -182,6 +199,129 @@ typedef struct
 
 } __attribute__((aligned(4))) kdp2_ipc_cmd_write_flash_t;
 
+#define KDP2_FLASH_DIGEST_MAX_SECTOR 512    // maximum number of sectors of one digest request
+
+enum kdp2_flash_region
+{
+    KDP2_FLASH_REGION_RAW = 0,              // flash_offset is an absolute flash address
+    KDP2_FLASH_REGION_MODEL_INFO = 1,       // flash_offset is relative to fw_info.bin of the models in flash
+    KDP2_FLASH_REGION_MODEL_ALL = 2,        // flash_offset is relative to all_models.bin in flash
+};
+
+typedef struct
+{
+    uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
+    uint32_t total_size; // size of this data struct
+    uint32_t command_id; // should be 'KDP2_COMMAND_GET_FLASH_DIGEST'
+
+    uint32_t region;       // refer to 'kdp2_flash_region'
+    uint32_t flash_offset; // 4KB alignment
+    uint32_t length;
+    uint32_t sector_size;  // 4KB alignment, the last sector may be shorter
+
+} __attribute__((aligned(4))) kdp2_ipc_cmd_get_flash_digest_t;
+
+typedef struct
+{
+    uint32_t return_code; // KP_API_RETURN_CODE
+
+    uint32_t flash_addr;  // absolute flash address of the first sector, for KDP2_COMMAND_WRITE_FLASH
+    uint32_t sector_size; // sector size in use, it is rounded up to the erase block size of the flash
+    uint32_t num_sector;
+    uint32_t digest[KDP2_FLASH_DIGEST_MAX_SECTOR]; // CRC32 of each sector
+
+} __attribute__((aligned(4))) kdp2_ipc_response_flash_digest_t;
+
+#define KDP2_FLASH_STREAM_MAX_WINDOW 8      // maximum number of chunks in flight of a flash write stream
+#define KDP2_FLASH_CHUNK_MAGIC 0x4B43464B   // "KFCK", magic of kdp2_flash_chunk_header_t
+
+typedef struct
+{
+    uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
+    uint32_t total_size; // size of this data struct
+    uint32_t command_id; // should be 'KDP2_COMMAND_WRITE_FLASH_STREAM'
+
+    uint32_t region;       // refer to 'kdp2_flash_region'
+    uint32_t flash_offset; // 4KB alignment
+    uint32_t length;       // total bytes of all chunks
+    uint32_t chunk_size;   // data bytes of each chunk but the last one, 0 for the device to choose
+    uint32_t window;       // maximum number of chunks sent but not acknowledged
+
+} __attribute__((aligned(4))) kdp2_ipc_cmd_write_flash_stream_t;
+
+typedef struct
+{
+    uint32_t return_code; // KP_API_RETURN_CODE
+
+    uint32_t flash_addr;  // absolute flash address of the first chunk
+    uint32_t chunk_size;  // chunk size in use, a multiple of the erase block size of the flash
+    uint32_t window;      // window in use, limited by the free buffers of the FIFO queue
+
+} __attribute__((aligned(4))) kdp2_ipc_response_write_flash_stream_t;
+
+// each chunk is sent as this header followed by its data in one transfer
+typedef struct
+{
+    uint32_t magic;       // should be 'KDP2_FLASH_CHUNK_MAGIC'
+    uint32_t chunk_index;
+    uint32_t length;      // data bytes after this header, a multiple of 4
+    uint32_t crc32;       // CRC32 of the data
+
+} __attribute__((aligned(4))) kdp2_flash_chunk_header_t;
+
+// sent after a chunk is programmed, in the order of chunks
+typedef struct
+{
+    uint32_t return_code; // KP_API_RETURN_CODE
+    uint32_t chunk_index;
+    uint32_t crc32;       // CRC32 of the chunk read back from flash
+
+} __attribute__((aligned(4))) kdp2_ipc_response_flash_chunk_ack_t;
+
+// the inference lane of an image is tagged in 'status_code' of its header stamp, untagged images go to lane 0
+#define KDP2_INF_LANE_TAG 0x4C4E0000                // 'LN' in the upper 16 bits, flags and lane number in the lower 16 bits
+#define KDP2_INF_LANE_TAG_MASK 0xFFFF0000
+#define KDP2_INF_LANE_NUM_MASK 0x000000FF
+#define KDP2_INF_DEADLINE_FLAG 0x00008000           // the first image of the inference ends with a kdp2_ipc_inf_deadline_t
+
+// deadline of an inference, the last bytes of its first image (included in 'total_size' of the image header stamp)
+// the host sends the time left instead of an absolute time, so the device needs no clock synchronized with the host
+typedef struct
+{
+    uint32_t inference_number;  // the same as in the inference header
+    uint32_t model_id;          // model whose inference time is measured to predict the deadline miss
+    uint32_t budget_us;         // time left to the deadline when the host starts sending the image
+    uint32_t recv_tick;         // system timer count when the device receives the image header, written by the device
+
+} __attribute__((aligned(4))) kdp2_ipc_inf_deadline_t;
+
+// sent in place of the result(s) of an inference dropped for its deadline, enabled by 'KDP2_CONTROL_FIFOQ_ENABLE_DEADLINE_DROP'
+typedef struct
+{
+    kp_inference_header_stamp_t header_stamp; // job_id of the inference, status_code = 'KP_FW_INFERENCE_DEADLINE_MISSED_136'
+    uint32_t inference_number;
+    uint32_t model_id;
+    uint32_t reason;            // refer to kp_inference_drop_reason_t
+    uint32_t est_inf_time_us;   // inference time predicted by the device
+    uint32_t late_us;           // how late the inference would have been done with 'est_inf_time_us'
+
+} __attribute__((aligned(4))) kdp2_ipc_inf_drop_report_t;
+
+// a 'KP_IMAGE_FORMAT_JPEG' image is decoded to YUYV in the rest of its own input buffer (KL720 only),
+// from the first address aligned to this after 'total_size' of the image header stamp
+#define KDP2_INF_JPEG_DECODE_ALIGN 64
+
+#define KDP2_MAGIC_TYPE_COALESCED_RESULT 0x11FF44DD // magic of kdp2_ipc_coalesced_result_t
+#define KDP2_COALESCED_RESULT_MAX_NUM 8             // maximum number of results in one coalesced transfer
+
+// results pending in the result queue packed into one transfer, enabled by 'KDP2_CONTROL_FIFOQ_ENABLE_COALESCING'
+typedef struct
+{
+    kp_inference_header_stamp_t header_stamp; // magic_type = 'KDP2_MAGIC_TYPE_COALESCED_RESULT', total_image = number of results
+    // followed by the results, each one starts at a 4-byte aligned offset and its own header_stamp.total_size tells its size
+
+} __attribute__((aligned(4))) kdp2_ipc_coalesced_result_t;
+
 typedef struct
 {
     uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
@@ -295,6 +435,40 @@ typedef struct
     uint32_t command_id; // should be 'KDP2_COMMAND_GET_FIFOQ_CONFIG'
 } __attribute__((aligned(4))) kdp2_ipc_cmd_get_fifo_queue_config_t;
 
+typedef struct
+{
+    uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
+    uint32_t total_size; // size of this data struct
+    uint32_t command_id; // should be 'KDP2_COMMAND_RESIZE_FIFOQ'
+    uint32_t input_buf_count;
+    uint32_t input_buf_size;
+    uint32_t result_buf_count;
+    uint32_t result_buf_size;
+} __attribute__((aligned(4))) kdp2_ipc_cmd_resize_fifo_queue_t;
+
+typedef struct
+{
+    uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
+    uint32_t total_size; // size of this data struct
+    uint32_t command_id; // should be 'KDP2_COMMAND_GET_DDR_HEAP_STATS'
+} __attribute__((aligned(4))) kdp2_ipc_cmd_get_ddr_heap_stats_t;
+
+typedef struct
+{
+    uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
+    uint32_t total_size; // size of this data struct
+    uint32_t command_id; // should be 'KDP2_COMMAND_CONFIGURE_INF_LANES'
+    kp_inference_lane_config_t lane_config;
+} __attribute__((aligned(4))) kdp2_ipc_cmd_configure_inf_lanes_t;
+
+typedef struct
+{
+    uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
+    uint32_t total_size; // size of this data struct
+    uint32_t command_id; // should be 'KDP2_COMMAND_GET_INF_LANE_STATS'
+    uint32_t reset;      // non-zero to clear the statistics after they are read
+} __attribute__((aligned(4))) kdp2_ipc_cmd_get_inf_lane_stats_t;
+
 typedef struct
 {
     uint32_t magic_type; // should be 'KDP2_MAGIC_TYPE_COMMAND'
@@ -115,4 +115,45 @@ int kmdw_dfu_update_flash_cpu_process(uint8_t *ddr_addr, uint32_t bin_size, uint
 */
 int kmdw_dfu_update_model_flash_process(uint32_t ddr_addr, uint32_t info_size, uint32_t model_size);
 
+/**
+ * @brief get flash address of fw_info.bin of the models
+ * @return flash address
+ */
+uint32_t kmdw_dfu_get_model_info_flash_addr(void);
+
+/**
+ * @brief get flash address of all_models.bin
+ * @return flash address
+ */
+uint32_t kmdw_dfu_get_all_models_flash_addr(void);
+
+/**
+ * @brief get erase block size of the flash, flash is written in multiples of it
+ * @return erase block size in bytes
+ */
+uint32_t kmdw_dfu_get_flash_block_size(void);
+
+/**
+ * @brief get CRC32 of each sector of a flash area
+ * @param[in] flash_addr flash address, 4KB alignment
+ * @param[in] size size of the area
+ * @param[in,out] sector_size sector size, it is rounded up to the erase block size of the flash
+ *                 and cut down to whole erase blocks of mem_size
+ * @param[out] digest CRC32 of each sector, the last sector may be shorter
+ * @param[in] max_sector number of entries of digest
+ * @param[in] mem_addr DDR buffer to read flash into
+ * @param[in] mem_size size of the DDR buffer
+ * @return number of sectors from flash_addr, at most max_sector, or -1 on failure
+ */
+int kmdw_dfu_get_flash_digest(uint32_t flash_addr, uint32_t size, uint32_t *sector_size, uint32_t *digest, uint32_t max_sector, uint32_t mem_addr, uint32_t mem_size);
+
+/**
+ * @brief erase, write and verify a flash area
+ * @param[in] mem_addr memory address of the data
+ * @param[in] flash_addr flash address, 4KB alignment
+ * @param[in] size data size
+ * @return 0 on success
+ */
+int kmdw_dfu_write_flash(uint32_t mem_addr, uint32_t flash_addr, uint32_t size);
+
 #endif
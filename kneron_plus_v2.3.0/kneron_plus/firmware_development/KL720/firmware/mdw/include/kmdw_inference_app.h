@@ -103,6 +103,22 @@ int kmdw_inference_app_init(kmdw_inference_app_callback_t app_entry, uint32_t im
  */
 void kmdw_inference_app_send_status_code(int job_id, int error_code);
 
+/**
+ * @brief wait until all executed inferences are done, images in FIFO queue are not counted
+ *
+ * @param[in] timeout_ms timeout in milliseconds
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kmdw_inference_app_wait_idle(uint32_t timeout_ms);
+
+/**
+ * @brief enable or disable dropping images which can not be inferenced before the deadline set by host SW
+ *
+ * @param[in] enable a late image is dropped and reported to host SW instead of inferenced
+ */
+void kmdw_inference_app_set_deadline_drop(bool enable);
+
 /**
  * @brief do one inference, result_callback works only while enable_parallel = true
  *
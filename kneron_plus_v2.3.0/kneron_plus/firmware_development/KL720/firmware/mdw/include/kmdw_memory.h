@@ -19,6 +19,22 @@
 #define ALIGN64(n)         ((n + ALIGN_64BYTE - 1) & ~(ALIGN_64BYTE - 1))
 #define ALIGN64_FLOOR(n)   ((n) & ~(ALIGN_64BYTE - 1))
 
+/**
+ * @brief DDR heap usage statistics
+ */
+typedef struct
+{
+    uint32_t heap_begin;            /**< lowest address the heap can allocate (the boundary) */
+    uint32_t heap_end;              /**< end address of the heap (exclusive) */
+    uint32_t used_size;             /**< size in bytes of allocated blocks */
+    uint32_t free_size;             /**< size in bytes of free space */
+    uint32_t largest_free_size;     /**< size in bytes of the largest free block */
+    uint32_t used_block_count;      /**< number of allocated blocks, adjacent reserved blocks are counted as one */
+    uint32_t free_block_count;      /**< number of free blocks */
+    uint32_t peak_used_size;        /**< high-water mark of used_size */
+    uint32_t lowest_addr;           /**< high-water mark of the heap toward the boundary, the lowest address ever allocated */
+} kmdw_ddr_stats_t;
+
 /**
  * @brief To initialize available DDR block
  * @param start_addr the start address of DDR block
@@ -34,12 +50,44 @@ void kmdw_ddr_init(uint32_t start_addr, uint32_t end_addr);
 int kmdw_ddr_set_ddr_boundary(uint32_t boundary);
 
 /**
- * @brief to allocate DDR memory aligned at 64 bytes
+ * @brief to allocate DDR memory aligned at 64 bytes for the lifetime of the system
  * @param numbtye size in byte
  * @return the address of allocated block
  */
 uint32_t kmdw_ddr_reserve(uint32_t numbyte);
 
+/**
+ * @brief to allocate DDR memory which can be given back by kmdw_ddr_free()
+ * @param numbyte size in byte
+ * @param align alignment in byte of the block, power of 2, at least ALIGN_64BYTE
+ * @return the address of allocated block, 0 if failed
+ */
+uint32_t kmdw_ddr_alloc(uint32_t numbyte, uint32_t align);
+
+/**
+ * @brief to allocate a pool of equally sized DDR buffers, every buffer starts at the given alignment
+ * @param buf_size size in byte of one buffer
+ * @param buf_count number of buffers
+ * @param align alignment in byte of every buffer, power of 2
+ * @param buf_stride distance in byte from one buffer to the next
+ * @return the address of the first buffer, 0 if failed, the pool is given back by kmdw_ddr_free()
+ */
+uint32_t kmdw_ddr_alloc_pool(uint32_t buf_size, uint32_t buf_count, uint32_t align, uint32_t *buf_stride);
+
+/**
+ * @brief to give back DDR memory allocated by kmdw_ddr_alloc() or kmdw_ddr_alloc_pool()
+ * @param addr the address of allocated block
+ * @return 0: ok, -1: failed(not an allocated block or reserved by kmdw_ddr_reserve())
+ * @note the freed block is merged with the free space around it
+ */
+int kmdw_ddr_free(uint32_t addr);
+
+/**
+ * @brief to get DDR heap usage statistics
+ * @param stats the statistics
+ */
+void kmdw_ddr_get_stats(kmdw_ddr_stats_t *stats);
+
 /**
  * @brief to get available DDR block tail address
  * @return uint32_t
@@ -112,6 +112,15 @@ int32_t kmdw_model_load_model(int8_t model_info_index_p);
 int32_t kmdw_model_reload_model_info(bool from_ddr);
 
 
+/**
+ * @brief Replace the loaded models info by a new fw_info from host, the heap boundary follows the new model end
+ * @param [in] fw_info: fw_info of the new models
+ * @param [in] fw_info_size: size of fw_info
+ * @return model count of the new models; 0 means failed and the loaded models are kept
+ */
+int32_t kmdw_model_replace_model_info(const void *fw_info, uint32_t fw_info_size);
+
+
 /**
  * @brief Refresh all models
  * @return refreshed model count; 0 means failed
@@ -11,7 +11,7 @@
 #include "base.h"
 
 #define CRC16_CONSTANT 0x8005 /**< CRC16 constant */
-#define ENABLE_CRC32 0 /**< To enable CRC32 calculation or not */
+#define ENABLE_CRC32 0 /**< To enable CRC32 check of models or not */
 
 /**
  * @brief generate crc16 code
@@ -1,41 +1,226 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include "dual_fifo2.h"
 #include "kmdw_memory.h"
 #include "kmdw_console.h"
 
+#define SLOT_NONE (-1)
+
+// a queued data buffer, slots are linked into the lane lists or the free slot list
+typedef struct
+{
+    buffer_object_t bobj;
+    uint32_t enqueue_time; // system timer count at enqueue
+    bool preempt;
+    int next;
+} _Dual_FIFO2_Slot_t;
+
+typedef struct
+{
+    int head;
+    int tail;
+    uint32_t count;
+    uint32_t priority;
+    int32_t weight;
+    int32_t credit;        // smooth weighted round-robin credit
+    dual_fifo2_lane_stats_t stats;
+} _Dual_FIFO2_Lane_t;
+
 typedef struct _Dual_FIFO2_s
 {
     osMessageQueueId_t free_msgq; // free buf queue
-    osMessageQueueId_t data_msgq; // data buf queue
+    osSemaphoreId_t data_sem;     // number of data buf in all lanes
+    osSemaphoreId_t slot_sem;     // number of free slots
+    osMutexId_t lane_mutex;       // lanes, slots and statistics
     uint32_t queue_count;
+    uint32_t num_lanes;
+    uint32_t timer_freq_mhz;
+    int free_slot;
+    _Dual_FIFO2_Lane_t lanes[DUAL_FIFO_MAX_LANES];
+    _Dual_FIFO2_Slot_t slots[];
 } _Dual_FIFO2_t;
 
+static void _delete_dual_fifo2(_Dual_FIFO2_t *df_ptr)
+{
+    if (df_ptr->lane_mutex != NULL)
+        osMutexDelete(df_ptr->lane_mutex);
+    if (df_ptr->slot_sem != NULL)
+        osSemaphoreDelete(df_ptr->slot_sem);
+    if (df_ptr->data_sem != NULL)
+        osSemaphoreDelete(df_ptr->data_sem);
+    if (df_ptr->free_msgq != NULL)
+        osMessageQueueDelete(df_ptr->free_msgq);
+
+    free(df_ptr);
+}
+
 dual_fifo2_t dual_fifo2_create(uint32_t queue_count)
 {
-    _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)malloc(sizeof(_Dual_FIFO2_t));
+    return dual_fifo2_create_lanes(queue_count, 1);
+}
+
+dual_fifo2_t dual_fifo2_create_lanes(uint32_t queue_count, uint32_t num_lanes)
+{
+    if ((queue_count == 0) || (num_lanes == 0) || (num_lanes > DUAL_FIFO_MAX_LANES))
+        return (void *)DUAL_FIFO_MSGQ_NEW_FAILED;
+
+    // data slots are shared by all lanes, so lanes cost no more memory than a single data queue
+    _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)calloc(1, sizeof(_Dual_FIFO2_t) + queue_count * sizeof(_Dual_FIFO2_Slot_t));
     if (df_ptr == NULL)
         return (void *)DUAL_FIFO_MALLOC_FAILED;
 
     // fifo queues save only the pointer address
     df_ptr->free_msgq = osMessageQueueNew(queue_count, sizeof(buffer_object_t), NULL);
-    if (df_ptr->free_msgq == NULL) {
-        free(df_ptr);
+    df_ptr->data_sem = osSemaphoreNew(queue_count, 0, NULL);
+    df_ptr->slot_sem = osSemaphoreNew(queue_count, queue_count, NULL);
+    df_ptr->lane_mutex = osMutexNew(NULL);
+    if ((df_ptr->free_msgq == NULL) || (df_ptr->data_sem == NULL) || (df_ptr->slot_sem == NULL) || (df_ptr->lane_mutex == NULL)) {
+        _delete_dual_fifo2(df_ptr);
         return (void *)DUAL_FIFO_MSGQ_NEW_FAILED;
     }
 
-    df_ptr->data_msgq = osMessageQueueNew(queue_count, sizeof(buffer_object_t), NULL);
-    if (df_ptr->data_msgq == NULL) {
-        osMessageQueueDelete(df_ptr->free_msgq);
-        free(df_ptr);
-        return (void *)DUAL_FIFO_MSGQ_NEW_FAILED;
+    for (uint32_t i = 0; i < queue_count; i++)
+        df_ptr->slots[i].next = (i + 1 < queue_count) ? (int)(i + 1) : SLOT_NONE;
+
+    for (uint32_t i = 0; i < num_lanes; i++) {
+        df_ptr->lanes[i].head = SLOT_NONE;
+        df_ptr->lanes[i].tail = SLOT_NONE;
+        df_ptr->lanes[i].priority = i;
+        df_ptr->lanes[i].weight = 1;
     }
 
     df_ptr->queue_count = queue_count;
+    df_ptr->num_lanes = num_lanes;
+    df_ptr->free_slot = 0;
+    df_ptr->timer_freq_mhz = osKernelGetSysTimerFreq() / 1000000;
+    if (df_ptr->timer_freq_mhz == 0)
+        df_ptr->timer_freq_mhz = 1;
 
     return (dual_fifo2_t)df_ptr;
 }
 
+// link a slot into a lane, preempting slots go after the other preempting slots but before the rest
+static void _lane_push(_Dual_FIFO2_t *df_ptr, _Dual_FIFO2_Lane_t *lane, int slot)
+{
+    int prev = SLOT_NONE;
+    int cur = lane->head;
+
+    if (df_ptr->slots[slot].preempt) {
+        while ((cur != SLOT_NONE) && df_ptr->slots[cur].preempt) {
+            prev = cur;
+            cur = df_ptr->slots[cur].next;
+        }
+    } else {
+        prev = lane->tail;
+        cur = SLOT_NONE;
+    }
+
+    df_ptr->slots[slot].next = cur;
+
+    if (prev == SLOT_NONE)
+        lane->head = slot;
+    else
+        df_ptr->slots[prev].next = slot;
+
+    if (cur == SLOT_NONE)
+        lane->tail = slot;
+
+    lane->count++;
+}
+
+static int _lane_pop(_Dual_FIFO2_t *df_ptr, _Dual_FIFO2_Lane_t *lane)
+{
+    int slot = lane->head;
+
+    lane->head = df_ptr->slots[slot].next;
+    if (lane->head == SLOT_NONE)
+        lane->tail = SLOT_NONE;
+
+    lane->count--;
+
+    return slot;
+}
+
+// pick the lane to dequeue, some lane must have data
+static _Dual_FIFO2_Lane_t *_pick_data_lane(_Dual_FIFO2_t *df_ptr)
+{
+    uint32_t top_priority = UINT32_MAX;
+    int32_t total_weight = 0;
+    _Dual_FIFO2_Lane_t *picked = NULL;
+
+    // strict priority: only the non-empty lanes of the highest priority take part
+    for (uint32_t i = 0; i < df_ptr->num_lanes; i++) {
+        if ((df_ptr->lanes[i].count > 0) && (df_ptr->lanes[i].priority < top_priority))
+            top_priority = df_ptr->lanes[i].priority;
+    }
+
+    // smooth weighted round-robin among them
+    for (uint32_t i = 0; i < df_ptr->num_lanes; i++) {
+        _Dual_FIFO2_Lane_t *lane = &df_ptr->lanes[i];
+
+        if ((lane->count == 0) || (lane->priority != top_priority))
+            continue;
+
+        lane->credit += lane->weight;
+        total_weight += lane->weight;
+
+        if ((picked == NULL) || (lane->credit > picked->credit))
+            picked = lane;
+    }
+
+    picked->credit -= total_weight;
+
+    return picked;
+}
+
+// pick the lane to be robbed by a forced grab, some lane must have data
+static _Dual_FIFO2_Lane_t *_pick_drop_lane(_Dual_FIFO2_t *df_ptr)
+{
+    _Dual_FIFO2_Lane_t *picked = NULL;
+
+    for (uint32_t i = 0; i < df_ptr->num_lanes; i++) {
+        _Dual_FIFO2_Lane_t *lane = &df_ptr->lanes[i];
+
+        if ((lane->count > 0) && ((picked == NULL) || (lane->priority >= picked->priority)))
+            picked = lane;
+    }
+
+    return picked;
+}
+
+// take one data buffer out of a lane, the caller holds one count of 'data_sem'
+static osStatus_t _take_data(_Dual_FIFO2_t *df_ptr, buffer_object_t *bobj, bool drop)
+{
+    osMutexAcquire(df_ptr->lane_mutex, osWaitForever);
+
+    _Dual_FIFO2_Lane_t *lane = drop ? _pick_drop_lane(df_ptr) : _pick_data_lane(df_ptr);
+    int slot = _lane_pop(df_ptr, lane);
+    uint32_t wait_us = (osKernelGetSysTimerCount() - df_ptr->slots[slot].enqueue_time) / df_ptr->timer_freq_mhz;
+
+    if (drop) {
+        lane->stats.dropped++;
+    } else {
+        lane->stats.dequeued++;
+        lane->stats.total_wait_us += wait_us;
+        if (wait_us > lane->stats.max_wait_us)
+            lane->stats.max_wait_us = wait_us;
+    }
+
+    // an idle lane starts over, it does not bring credit or debt into the next burst
+    if (lane->count == 0)
+        lane->credit = 0;
+
+    *bobj = df_ptr->slots[slot].bobj;
+
+    df_ptr->slots[slot].next = df_ptr->free_slot;
+    df_ptr->free_slot = slot;
+
+    osMutexRelease(df_ptr->lane_mutex);
+
+    return osSemaphoreRelease(df_ptr->slot_sem);
+}
+
 osStatus_t dual_fifo2_get_free_buffer(dual_fifo2_t df, buffer_object_t *bobj, uint32_t timeout, bool force_grab)
 {
     // NOTE: timeout should be 0 for force_grab = true
@@ -47,8 +232,11 @@ osStatus_t dual_fifo2_get_free_buffer(dual_fifo2_t df, buffer_object_t *bobj, ui
 
     osStatus_t sts = osMessageQueueGet(df_ptr->free_msgq, (void *)bobj, NULL, timeout);
 
-    if (force_grab && sts == osErrorResource)
-        sts = osMessageQueueGet(df_ptr->data_msgq, (void *)bobj, NULL, 0);
+    if (force_grab && sts == osErrorResource) {
+        sts = osSemaphoreAcquire(df_ptr->data_sem, 0);
+        if (sts == osOK)
+            sts = _take_data(df_ptr, bobj, true);
+    }
 
     return sts;
 }
@@ -61,23 +249,104 @@ osStatus_t dual_fifo2_put_free_buffer(dual_fifo2_t df, buffer_object_t bobj, uin
 }
 
 osStatus_t dual_fifo2_enqueue_data(dual_fifo2_t df, buffer_object_t bobj, uint32_t timeout, bool preempt)
+{
+    return dual_fifo2_enqueue_data_to_lane(df, bobj, 0, timeout, preempt);
+}
+
+osStatus_t dual_fifo2_enqueue_data_to_lane(dual_fifo2_t df, buffer_object_t bobj, uint32_t lane, uint32_t timeout, bool preempt)
 {
     _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)df;
-    osStatus_t sts = osMessageQueuePut(df_ptr->data_msgq, (const void *)&bobj, (preempt) ? (1U) : (0U), timeout);
-    return sts;
+
+    if (lane >= df_ptr->num_lanes)
+        return osErrorParameter;
+
+    osStatus_t sts = osSemaphoreAcquire(df_ptr->slot_sem, timeout);
+    if (sts != osOK)
+        return sts;
+
+    osMutexAcquire(df_ptr->lane_mutex, osWaitForever);
+
+    int slot = df_ptr->free_slot;
+    df_ptr->free_slot = df_ptr->slots[slot].next;
+
+    df_ptr->slots[slot].bobj = bobj;
+    df_ptr->slots[slot].enqueue_time = osKernelGetSysTimerCount();
+    df_ptr->slots[slot].preempt = preempt;
+
+    _Dual_FIFO2_Lane_t *data_lane = &df_ptr->lanes[lane];
+
+    _lane_push(df_ptr, data_lane, slot);
+
+    data_lane->stats.enqueued++;
+    if (data_lane->count > data_lane->stats.peak_depth)
+        data_lane->stats.peak_depth = data_lane->count;
+
+    osMutexRelease(df_ptr->lane_mutex);
+
+    return osSemaphoreRelease(df_ptr->data_sem);
 }
 
 osStatus_t dual_fifo2_dequeue_data(dual_fifo2_t df, buffer_object_t *bobj, uint32_t timeout)
 {
     _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)df;
-    osStatus_t sts = osMessageQueueGet(df_ptr->data_msgq, (void *)bobj, NULL, timeout);
-    return sts;
+    osStatus_t sts = osSemaphoreAcquire(df_ptr->data_sem, timeout);
+    if (sts != osOK)
+        return sts;
+
+    return _take_data(df_ptr, bobj, false);
+}
+
+osStatus_t dual_fifo2_set_lane(dual_fifo2_t df, uint32_t lane, uint32_t priority, uint32_t weight)
+{
+    _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)df;
+
+    if ((lane >= df_ptr->num_lanes) || (weight == 0) || (weight > INT16_MAX))
+        return osErrorParameter;
+
+    osMutexAcquire(df_ptr->lane_mutex, osWaitForever);
+    df_ptr->lanes[lane].priority = priority;
+    df_ptr->lanes[lane].weight = (int32_t)weight;
+    df_ptr->lanes[lane].credit = 0;
+    osMutexRelease(df_ptr->lane_mutex);
+
+    return osOK;
+}
+
+osStatus_t dual_fifo2_get_lane_stats(dual_fifo2_t df, uint32_t lane, dual_fifo2_lane_stats_t *stats)
+{
+    _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)df;
+
+    if (lane >= df_ptr->num_lanes)
+        return osErrorParameter;
+
+    osMutexAcquire(df_ptr->lane_mutex, osWaitForever);
+    *stats = df_ptr->lanes[lane].stats;
+    stats->depth = df_ptr->lanes[lane].count;
+    osMutexRelease(df_ptr->lane_mutex);
+
+    return osOK;
+}
+
+void dual_fifo2_reset_lane_stats(dual_fifo2_t df)
+{
+    _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)df;
+
+    osMutexAcquire(df_ptr->lane_mutex, osWaitForever);
+    for (uint32_t i = 0; i < df_ptr->num_lanes; i++)
+        memset(&df_ptr->lanes[i].stats, 0, sizeof(dual_fifo2_lane_stats_t));
+    osMutexRelease(df_ptr->lane_mutex);
+}
+
+uint32_t dual_fifo2_num_lanes(dual_fifo2_t df)
+{
+    _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)df;
+    return df_ptr->num_lanes;
 }
 
 uint32_t dual_fifo2_num_unconsumed_data(dual_fifo2_t df)
 {
     _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)df;
-    return osMessageQueueGetCount(df_ptr->data_msgq);
+    return osSemaphoreGetCount(df_ptr->data_sem);
 }
 
 uint32_t dual_fifo2_num_free_buffer(dual_fifo2_t df)
@@ -88,8 +357,5 @@ uint32_t dual_fifo2_num_free_buffer(dual_fifo2_t df)
 
 void dual_fifo2_destroy(dual_fifo2_t df)
 {
-    _Dual_FIFO2_t *df_ptr = (_Dual_FIFO2_t *)df;
-    osMessageQueueDelete(df_ptr->free_msgq);
-    osMessageQueueDelete(df_ptr->data_msgq);
-    free(df_ptr);
+    _delete_dual_fifo2((_Dual_FIFO2_t *)df);
 }
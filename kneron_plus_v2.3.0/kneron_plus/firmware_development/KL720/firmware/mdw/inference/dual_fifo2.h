@@ -28,17 +28,58 @@ typedef void *dual_fifo2_t;
 #define DUAL_FIFO_MALLOC_FAILED 0x1
 #define DUAL_FIFO_MSGQ_NEW_FAILED 0x2
 
+#define DUAL_FIFO_MAX_LANES 4
+
+/*
+Lanes :
+data buffers are enqueued to one of 'num_lanes' data lanes, free buffers are shared by all lanes.
+the consumer takes data from the non-empty lanes of the highest priority (the lowest value) first,
+lanes of the same priority share the consumer by their weights (smooth weighted round-robin).
+a forced grab of the producer takes the earliest data of the lowest-priority non-empty lane.
+by default lane N has priority N and weight 1, so lane 0 is always served first.
+*/
+
+// statistics of a data lane, times are in micro-seconds
+typedef struct
+{
+    uint32_t depth;         // number of data buffers waiting in this lane
+    uint32_t peak_depth;
+    uint32_t enqueued;      // number of data buffers enqueued
+    uint32_t dequeued;      // number of data buffers taken by the consumer
+    uint32_t dropped;       // number of data buffers taken by a forced grab
+    uint32_t max_wait_us;   // longest time from enqueue to dequeue
+    uint64_t total_wait_us; // sum of the time from enqueue to dequeue of all dequeued data buffers
+} dual_fifo2_lane_stats_t;
+
 // create a new dual fifo
 dual_fifo2_t dual_fifo2_create(uint32_t queue_count);
 
+// create a new dual fifo with 'num_lanes' data lanes, at most DUAL_FIFO_MAX_LANES
+dual_fifo2_t dual_fifo2_create_lanes(uint32_t queue_count, uint32_t num_lanes);
+
+// set scheduling of a data lane, 0 is the highest priority, weight must be non-zero
+osStatus_t dual_fifo2_set_lane(dual_fifo2_t df, uint32_t lane, uint32_t priority, uint32_t weight);
+
+// get statistics of a data lane
+osStatus_t dual_fifo2_get_lane_stats(dual_fifo2_t df, uint32_t lane, dual_fifo2_lane_stats_t *stats);
+
+// clear statistics of all data lanes
+void dual_fifo2_reset_lane_stats(dual_fifo2_t df);
+
+// return the number of data lanes
+uint32_t dual_fifo2_num_lanes(dual_fifo2_t df);
+
 // producer: acquire a new free buffer
 // NOTE: timeout should be 0 for force_grab = true
 osStatus_t dual_fifo2_get_free_buffer(dual_fifo2_t df, buffer_object_t *bobj, uint32_t timeout, bool force_grab);
 
-// producer: put/enqueue data buffer
+// producer: put/enqueue data buffer to lane 0
 osStatus_t dual_fifo2_enqueue_data(dual_fifo2_t df, buffer_object_t bobj, uint32_t timeout, bool preempt);
 
-// consumer get/dequeue data buffer
+// producer: put/enqueue data buffer to a data lane
+osStatus_t dual_fifo2_enqueue_data_to_lane(dual_fifo2_t df, buffer_object_t bobj, uint32_t lane, uint32_t timeout, bool preempt);
+
+// consumer get/dequeue data buffer, from the lane selected by priority and weight
 osStatus_t dual_fifo2_dequeue_data(dual_fifo2_t df, buffer_object_t *bobj, uint32_t timeout);
 
 // consumer: return used data buffer
@@ -29,6 +29,8 @@
  *
  */
 
+#include <stdbool.h>
+#include <string.h>
 #include "cmsis_os2.h"
 #include "base.h"
 #include "kmdw_console.h"
@@ -36,32 +38,106 @@
 
 /* ddr malloc direction : from tail(bigger address) to head (smaller) */
 
-static uint32_t s_ddr_addr_tail = 0;
+#define DDR_MAX_BLOCK_COUNT 64 // adjacent reserved blocks share one entry, most entries are left for freeable blocks
+
+typedef struct
+{
+    uint32_t addr;  // aligned start address
+    uint32_t size;  // size in bytes, multiple of ALIGN_64BYTE
+    bool permanent; // reserved by kmdw_ddr_reserve(), never freed
+} ddr_block_t;
+
+/* allocated blocks sorted from higher to lower address, free space is the gaps between them */
+static ddr_block_t s_ddr_blocks[DDR_MAX_BLOCK_COUNT];
+static uint32_t s_ddr_block_count = 0;
+
+static uint32_t s_ddr_addr_top = 0; // (exclusive) end of heap
 static uint32_t s_ddr_addr_boundary = 0;
 
+static uint32_t s_ddr_used_size = 0;
+static uint32_t s_ddr_peak_used_size = 0;
+static uint32_t s_ddr_lowest_addr = 0;
+
 static uint32_t s_ddr_system_reserve_addr = 0;
 static uint32_t s_ddr_system_reserve_size = 0;
 
+/* the heap is used by threads and by the USB control callback, which runs in interrupt context and can not wait,
+ * so the lock is a binary semaphore rather than a mutex */
+static osSemaphoreId_t s_ddr_lock = NULL;
+
+static bool _ddr_lock(void)
+{
+    // only the main thread runs before the kernel is initialized
+    if (osKernelInactive == osKernelGetState())
+        return true;
+
+    // created on first use after the kernel is initialized, interrupt context can not create it and goes without
+    if (NULL == s_ddr_lock)
+        s_ddr_lock = osSemaphoreNew(1, 1, NULL);
+
+    if (NULL == s_ddr_lock)
+        return true;
+
+    if (osOK == osSemaphoreAcquire(s_ddr_lock, 0))
+        return true;
+
+    // interrupt context can not wait, it fails while a thread uses the heap
+    return (osOK == osSemaphoreAcquire(s_ddr_lock, osWaitForever));
+}
+
+static void _ddr_unlock(void)
+{
+    if ((osKernelInactive != osKernelGetState()) && (NULL != s_ddr_lock))
+        osSemaphoreRelease(s_ddr_lock);
+}
+
+static uint32_t _heap_tail(void)
+{
+    return (0 < s_ddr_block_count) ? s_ddr_blocks[s_ddr_block_count - 1].addr : s_ddr_addr_top;
+}
+
 void kmdw_ddr_init(uint32_t start_addr, uint32_t end_addr)
 {
-    s_ddr_addr_tail = start_addr; //KDP_DDR_HEAP_HEAD_FOR_MALLOC+1 (address to the last used tail)
+    s_ddr_addr_top = start_addr; //KDP_DDR_HEAP_HEAD_FOR_MALLOC+1 (address to the last used tail)
     s_ddr_addr_boundary = end_addr; //KDP_DDR_MODEL_RESERVED_END
+    s_ddr_lowest_addr = s_ddr_addr_top;
 }
 
 int kmdw_ddr_set_ddr_boundary(uint32_t boundary)
 {
-    if (boundary >= s_ddr_addr_tail)
+    int ret = -1;
+
+    if (false == _ddr_lock())
         return -1;
-    else {
+
+    if (boundary < _heap_tail()) {
         s_ddr_addr_boundary = boundary;
-        return 0;
+        ret = 0;
     }
+
+    _ddr_unlock();
+
+    return ret;
 }
 
-uint32_t kmdw_ddr_reserve(uint32_t numbyte)
+// lower end of the free space below block 'index', the last gap ends at the boundary
+static uint32_t _gap_lower(uint32_t index)
+{
+    if (index < s_ddr_block_count)
+        return s_ddr_blocks[index].addr + s_ddr_blocks[index].size;
+    else
+        return s_ddr_addr_boundary + 1; // an allocated block never starts at the boundary
+}
+
+// upper end of the free space below block 'index - 1'
+static uint32_t _gap_upper(uint32_t index)
+{
+    return (0 == index) ? s_ddr_addr_top : s_ddr_blocks[index - 1].addr;
+}
+
+static uint32_t _ddr_alloc_block(uint32_t numbyte, uint32_t align, bool permanent)
 {
     uint32_t aligned_numbyte;
-    uint32_t tail_tmp;
 
     if(numbyte == 0)
         return 0;
@@ -69,22 +145,186 @@ uint32_t kmdw_ddr_reserve(uint32_t numbyte)
     if(s_ddr_addr_boundary == 0)
         return 0; //not initialized yet
 
+    if ((0 == align) || (0 != (align & (align - 1))))
+        return 0;
+
+    if (align < ALIGN_64BYTE)
+        align = ALIGN_64BYTE;
+
     aligned_numbyte = ALIGN64(numbyte);
-    tail_tmp = s_ddr_addr_tail;
-    tail_tmp = ALIGN64_FLOOR(tail_tmp - aligned_numbyte);
 
-    if(tail_tmp <= s_ddr_addr_boundary)
+    // first fit from the top, blocks are kept close to the top and away from the models
+    for (uint32_t i = 0; i <= s_ddr_block_count; i++)
     {
-        err_msg("[ERR] ddr malloc64 %x over (<) available bondary %x\n", tail_tmp, s_ddr_addr_boundary);
+        uint32_t upper = _gap_upper(i);
+        uint32_t lower = _gap_lower(i);
+
+        if ((upper <= lower) || (upper - lower < aligned_numbyte))
+            continue;
+
+        uint32_t addr = (upper - aligned_numbyte) & ~(align - 1);
+
+        if (addr < lower)
+            continue;
+
+        if (permanent && (0 < i) && s_ddr_blocks[i - 1].permanent && (addr + aligned_numbyte == s_ddr_blocks[i - 1].addr))
+        {
+            s_ddr_blocks[i - 1].addr = addr;
+            s_ddr_blocks[i - 1].size += aligned_numbyte;
+        }
+        else if (DDR_MAX_BLOCK_COUNT > s_ddr_block_count)
+        {
+            memmove(&s_ddr_blocks[i + 1], &s_ddr_blocks[i], (s_ddr_block_count - i) * sizeof(ddr_block_t));
+            s_ddr_blocks[i].addr = addr;
+            s_ddr_blocks[i].size = aligned_numbyte;
+            s_ddr_blocks[i].permanent = permanent;
+            s_ddr_block_count++;
+        }
+        else
+        {
+            err_msg("Failed DDR allocation: %8d bytes, no more than %d blocks\n", numbyte, DDR_MAX_BLOCK_COUNT);
+            return 0;
+        }
+
+        dbg_msg("[DBG] DDR allocated: %8d [ *0x%x : 0x%x]\n",
+            numbyte, addr, addr + aligned_numbyte - 1);
+
+        s_ddr_used_size += aligned_numbyte;
+
+        if (s_ddr_used_size > s_ddr_peak_used_size)
+            s_ddr_peak_used_size = s_ddr_used_size;
+
+        if (addr < s_ddr_lowest_addr)
+            s_ddr_lowest_addr = addr;
+
+        return addr; // aligned address
+    }
+
+    err_msg("[ERR] ddr malloc64 %d bytes over (<) available bondary %x\n", numbyte, s_ddr_addr_boundary);
+    return 0;
+}
+
+static uint32_t _ddr_alloc(uint32_t numbyte, uint32_t align, bool permanent)
+{
+    uint32_t addr = 0;
+
+    if (true == _ddr_lock())
+    {
+        addr = _ddr_alloc_block(numbyte, align, permanent);
+        _ddr_unlock();
+    }
+
+    return addr;
+}
+
+uint32_t kmdw_ddr_reserve(uint32_t numbyte)
+{
+    return _ddr_alloc(numbyte, ALIGN_64BYTE, true);
+}
+
+uint32_t kmdw_ddr_alloc(uint32_t numbyte, uint32_t align)
+{
+    return _ddr_alloc(numbyte, align, false);
+}
+
+uint32_t kmdw_ddr_alloc_pool(uint32_t buf_size, uint32_t buf_count, uint32_t align, uint32_t *buf_stride)
+{
+    if ((0 == buf_count) || (0 == align) || (0 != (align & (align - 1))))
+        return 0;
+
+    uint32_t stride = (buf_size + align - 1) & ~(align - 1);
+
+    if ((0 == stride) || (stride > 0xFFFFFFFF / buf_count))
+        return 0;
+
+    uint32_t addr = _ddr_alloc(stride * buf_count, align, false);
+
+    if ((0 != addr) && (NULL != buf_stride))
+        *buf_stride = stride;
+
+    return addr;
+}
+
+static int _ddr_free_block(uint32_t addr)
+{
+    for (uint32_t i = 0; i < s_ddr_block_count; i++)
+    {
+        if (s_ddr_blocks[i].addr != addr)
+            continue;
+
+        if (s_ddr_blocks[i].permanent)
+            break;
+
+        dbg_msg("[DBG] DDR freed: %8d [ *0x%x ]\n", s_ddr_blocks[i].size, addr);
+
+        // free space is the gaps between blocks, removing the block merges it with the free space around it
+        s_ddr_used_size -= s_ddr_blocks[i].size;
+        s_ddr_block_count--;
+        memmove(&s_ddr_blocks[i], &s_ddr_blocks[i + 1], (s_ddr_block_count - i) * sizeof(ddr_block_t));
+
         return 0;
     }
-    s_ddr_addr_tail = tail_tmp;
-    return s_ddr_addr_tail;
+
+    err_msg("Failed DDR free: 0x%x is not a freeable block\n", addr);
+    return -1;
+}
+
+int kmdw_ddr_free(uint32_t addr)
+{
+    int ret = -1;
+
+    if (true == _ddr_lock())
+    {
+        ret = _ddr_free_block(addr);
+        _ddr_unlock();
+    }
+
+    return ret;
+}
+
+void kmdw_ddr_get_stats(kmdw_ddr_stats_t *stats)
+{
+    memset(stats, 0, sizeof(kmdw_ddr_stats_t));
+
+    if (false == _ddr_lock())
+        return;
+
+    stats->heap_begin = s_ddr_addr_boundary;
+    stats->heap_end = s_ddr_addr_top;
+    stats->used_size = s_ddr_used_size;
+    stats->used_block_count = s_ddr_block_count;
+    stats->peak_used_size = s_ddr_peak_used_size;
+    stats->lowest_addr = s_ddr_lowest_addr;
+
+    for (uint32_t i = 0; i <= s_ddr_block_count; i++)
+    {
+        uint32_t upper = _gap_upper(i);
+        uint32_t lower = _gap_lower(i);
+
+        if (upper <= lower)
+            continue;
+
+        stats->free_size += upper - lower;
+        stats->free_block_count++;
+
+        if (upper - lower > stats->largest_free_size)
+            stats->largest_free_size = upper - lower;
+    }
+
+    _ddr_unlock();
 }
 
 uint32_t kmdw_ddr_get_heap_tail()
 {
-    return s_ddr_addr_tail;
+    uint32_t tail = s_ddr_addr_top;
+
+    if (true == _ddr_lock())
+    {
+        tail = _heap_tail();
+        _ddr_unlock();
+    }
+
+    return tail;
 }
 
 void kmdw_ddr_store_system_reserve(uint32_t start_addr, uint32_t end_addr)
@@ -891,6 +891,39 @@ int32_t kmdw_model_reload_model_info(bool from_ddr)
     return _load_model_info(from_ddr, true/*reload*/);
 }
 
+int32_t kmdw_model_replace_model_info(const void *fw_info, uint32_t fw_info_size)
+{
+    kmdw_model_fw_info_t *fw_info_buf_p = s_fw_info_buf_p;
+    bool loaded_from_ddr = (1 != s_model_data.n_model_source);
+    uint8_t loaded_table[KMDW_MODEL_MAX_MODEL_COUNT];
+    int32_t model_count;
+
+    if ((NULL == fw_info_buf_p) || (KDP_FLASH_FW_INFO_SIZE < fw_info_size))
+        return 0;
+
+    memcpy(loaded_table, s_model_data.pn_is_model_loaded_table, sizeof(loaded_table));
+
+    // the new info is checked in place, the info of the loaded models is kept until it is accepted
+    s_fw_info_buf_p = (kmdw_model_fw_info_t *)fw_info;
+    model_count = _load_model_info(true/*from ddr*/, true/*reload*/);
+    s_fw_info_buf_p = fw_info_buf_p;
+
+    if ((0 < model_count) && (0 != kmdw_ddr_set_ddr_boundary(kmdw_model_get_model_end_addr(true)))) {
+        err_msg("[%s] model end 0x%x over (>=) heap tail 0x%x\n", __FUNCTION__, kmdw_model_get_model_end_addr(true), kmdw_ddr_get_heap_tail());
+        model_count = 0;
+    }
+
+    if (0 < model_count) {
+        memcpy(s_fw_info_buf_p, fw_info, fw_info_size);
+    } else {
+        // the loaded models are not touched in DDR, they keep running
+        if (0 < _load_model_info(loaded_from_ddr, true/*reload*/))
+            memcpy(s_model_data.pn_is_model_loaded_table, loaded_table, sizeof(loaded_table));
+    }
+
+    return model_count;
+}
+
 int32_t kmdw_model_refresh_models(void)    // reload all the models from flash again
 {
     uint8_t i;
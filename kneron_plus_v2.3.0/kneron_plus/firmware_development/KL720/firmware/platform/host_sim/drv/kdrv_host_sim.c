@@ -0,0 +1,61 @@
+/*
+ * Drivers of the host-native build
+ *
+ * Copyright (C) 2022 Kneron, Inc. All rights reserved.
+ *
+ * DDR is anonymous memory mapped at the KL720 physical address, the middleware keeps buffer
+ * addresses in uint32_t so it must live below 4GB in this 64-bit process.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "membase.h"
+#include "kdrv_power.h"
+#include "host_sim.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+#define HOST_SIM_JTAG_MAGIC_PAGE    0x1FFFF000      // holds JTAG_MAGIC_ADDRESS read by kdp2_usb_companion_init()
+#define HOST_SIM_PAGE_SIZE          0x1000
+
+static int _map_fixed(uint32_t addr, uint32_t size)
+{
+    void *p = mmap((void *)(uintptr_t)addr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if ((MAP_FAILED == p) || ((uintptr_t)addr != (uintptr_t)p))
+    {
+        fprintf(stderr, "[host_sim] failed to map 0x%08X size 0x%X\n", addr, size);
+        return -1;
+    }
+
+    return 0;
+}
+
+int host_sim_map_memory(void)
+{
+    if (0 != _map_fixed(DDR_MEM_PHY_BASE, DDR_MEM_PHY_SIZE))
+        return -1;
+
+    if (0 != _map_fixed(HOST_SIM_JTAG_MAGIC_PAGE, HOST_SIM_PAGE_SIZE))
+        return -1;
+
+    return 0;
+}
+
+void kdrv_power_sw_reset(void)
+{
+    printf("[host_sim] software reset\n");
+    exit(0);
+}
+
+uint32_t kdrv_efuse_get_kn_number(void)
+{
+    return 0x72000000;
+}
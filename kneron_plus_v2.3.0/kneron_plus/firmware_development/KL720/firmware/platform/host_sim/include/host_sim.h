@@ -0,0 +1,152 @@
+/**
+ * @file        host_sim.h
+ * @brief       host-side controls of the KL720 SCPU middleware running natively on Linux
+ *
+ * The middleware (FIFO queue manager, USB companion and inference dispatcher) is compiled unchanged
+ * against a CMSIS-RTOS2 shim on pthreads, a simulated usbd_hal and a fake NCPU.
+ * Functions here are called by the benchmark driver which plays the part of the USB host.
+ *
+ * @copyright   Copyright (c) 2022 Kneron Inc. All rights reserved.
+ */
+#ifndef __HOST_SIM_H__
+#define __HOST_SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ############################
+ * ##    memory map          ##
+ * ############################ */
+
+/**
+ * @brief map DDR and the JTAG magic word at their KL720 physical addresses
+ *
+ * @note the middleware keeps buffer addresses in uint32_t, so they must be real addresses below 4GB
+ *
+ * @return 0 on success, -1 if the address range is not available in this process
+ */
+int host_sim_map_memory(void);
+
+/* ############################
+ * ##    CMSIS-RTOS2 shim    ##
+ * ############################ */
+
+/**
+ * @brief pin all threads created by osThreadNew() to one host CPU, like the single core SCPU
+ *
+ * @param[in] cpu host CPU index, -1 to let the host schedule threads on any CPU (default)
+ *
+ * @note must be called before osThreadNew()
+ */
+void host_sim_rtos_set_cpu(int cpu);
+
+/**
+ * @brief get the monotonic host time in micro-seconds, the time base of all host_sim statistics
+ */
+uint64_t host_sim_get_time_us(void);
+
+/* ############################
+ * ##    simulated usbd_hal  ##
+ * ############################ */
+
+/**
+ * @brief hook of bulk-out transfers, called when the device has received 'len' bytes into 'buf_addr'
+ *
+ * @param[in] offset position of the received bytes in the host transfer
+ */
+typedef void (*usbd_sim_receive_hook_t)(uint32_t buf_addr, uint32_t offset, uint32_t len);
+
+/**
+ * @brief set the simulated link throughput, 0 for transfers limited by memcpy only
+ *
+ * @param[in] bytes_per_us throughput in both directions, 300 for about a USB 3.0 link
+ */
+void usbd_sim_set_throughput(uint32_t bytes_per_us);
+
+/**
+ * @brief set a hook called on every completed bulk-out (host to device) transfer
+ */
+void usbd_sim_set_receive_hook(usbd_sim_receive_hook_t hook);
+
+/**
+ * @brief plug or unplug the simulated cable, the link status callback of the device is invoked
+ */
+void usbd_sim_host_connect(bool connect);
+
+/**
+ * @brief issue a vendor-specific control transfer
+ *
+ * @return true if the device accepts the request
+ */
+bool usbd_sim_host_control(uint8_t bRequest, uint16_t wValue, uint16_t wIndex);
+
+/**
+ * @brief bulk-out write, blocks until the device has received all of 'len' bytes
+ *
+ * @param[out] blocked_us time the transfer waited for the device to post a receive buffer, can be NULL
+ *
+ * @return 0 on success, -1 on timeout or terminated transfer
+ */
+int usbd_sim_host_bulk_write(const void *buf, uint32_t len, uint32_t timeout_ms, uint64_t *blocked_us);
+
+/**
+ * @brief bulk-in read, blocks until the device sends data
+ *
+ * @return number of bytes read, -1 on timeout or terminated transfer
+ */
+int usbd_sim_host_bulk_read(void *buf, uint32_t buf_size, uint32_t timeout_ms);
+
+/* ############################
+ * ##    fake NCPU           ##
+ * ############################ */
+
+/**
+ * @brief hook of NCPU jobs, called when the fake NCPU takes an image and when its result is written
+ *
+ * @param[in] image_addr address of the first input image, right after the inference header
+ * @param[in] done false when the job starts, true when its result is written
+ */
+typedef void (*ncpu_sim_job_hook_t)(uint32_t image_addr, bool done);
+
+/**
+ * @brief register the single model served by the fake NCPU
+ *
+ * @param[in] model_id model ID used in inference headers
+ * @param[in] width model input width
+ * @param[in] height model input height
+ * @param[in] raw_output_size size of the raw output data written per inference
+ *
+ * @return 0 on success, -1 if DDR for the model setup can not be reserved
+ */
+int ncpu_sim_set_model(uint32_t model_id, uint32_t width, uint32_t height, uint32_t raw_output_size);
+
+/**
+ * @brief set the time the fake NCPU spends on one inference
+ *
+ * @param[in] pre_proc_us pre-processing on NCPU
+ * @param[in] npu_us CNN on NPU, the next image is pre-processed meanwhile in parallel mode
+ * @param[in] post_proc_us post-processing on NCPU, overlaps the NPU time of the next image
+ */
+void ncpu_sim_set_timing(uint32_t pre_proc_us, uint32_t npu_us, uint32_t post_proc_us);
+
+/**
+ * @brief set the time the fake NCPU spends on one JPEG decode command
+ */
+void ncpu_sim_set_jpeg_decode_time(uint32_t jpeg_dec_us);
+
+/**
+ * @brief set a hook called on NCPU job start and completion
+ */
+void ncpu_sim_set_job_hook(ncpu_sim_job_hook_t hook);
+
+/**
+ * @brief start the fake NCPU threads, call it after osKernelInitialize()
+ */
+void ncpu_sim_initialize(void);
+
+/**
+ * @brief get the accumulated time the fake NCPU and NPU were busy
+ */
+void ncpu_sim_get_busy_time(uint64_t *ncpu_busy_us, uint64_t *npu_busy_us);
+
+#endif // __HOST_SIM_H__
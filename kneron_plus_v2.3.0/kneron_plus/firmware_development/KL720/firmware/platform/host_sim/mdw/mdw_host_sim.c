@@ -0,0 +1,94 @@
+/*
+ * Middleware services of the host-native build
+ *
+ * Copyright (C) 2022 Kneron, Inc. All rights reserved.
+ *
+ * Console output goes to stdout, errands run in the caller's context and the command handler is
+ * a stub, kdp2_cmd_handler_720.c depends on flash, DFU and model loading which are not simulated.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "project.h"
+#include "kmdw_console.h"
+#include "kmdw_errandserv.h"
+#include "kmdw_power_manager.h"
+#include "kdp2_cmd.h"
+
+static uint32_t _scpu_log_level = SCPU_LOG_LEVEL;
+
+/* ############################
+ * ##    console             ##
+ * ############################ */
+
+void kmdw_console_set_log_level_scpu(uint32_t level)
+{
+    _scpu_log_level = level;
+}
+
+uint32_t kmdw_console_get_log_level_scpu(void)
+{
+    return _scpu_log_level;
+}
+
+void kmdw_level_printf(int level, const char *fmt, ...)
+{
+    if ((LOG_NONE != level) && (0 == (_scpu_log_level & level)))
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+void kmdw_printf_nocrlf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+/* ############################
+ * ##    errand service      ##
+ * ############################ */
+
+int kmdw_errandserv_run_task(errand_function_t func, void *arg, uint32_t execute_time)
+{
+    func(arg);
+    return 0;
+}
+
+/* ############################
+ * ##    power manager       ##
+ * ############################ */
+
+void kmdw_power_manager_shutdown(void)
+{
+    kmdw_printf("[host_sim] shutdown\n");
+    exit(0);
+}
+
+/* ############################
+ * ##    command handler     ##
+ * ############################ */
+
+int kdp2_cmd_handler_initialize(void)
+{
+    return 0;
+}
+
+int kdp2_cmd_handle_kp_command(uint32_t command_header_buf, uint32_t buffer_size)
+{
+    err_msg("[host_sim] commands are not supported\n");
+    return -1;
+}
+
+int kdp2_cmd_handle_legend_kdp_command(uint32_t command_buffer)
+{
+    err_msg("[host_sim] commands are not supported\n");
+    return -1;
+}
@@ -0,0 +1,450 @@
+/*
+ * Fake NCPU/NPU for the host-native middleware build
+ *
+ * Copyright (C) 2022 Kneron, Inc. All rights reserved.
+ *
+ * Replaces kmdw_model.c and kmdw_ipc.c at the kmdw_model API level, the real ones pull in flash, model
+ * loading and the NCPU firmware loader. One model is served, an inference takes pre-processing and
+ * post-processing time on the NCPU and CNN time on the NPU, like kmdw_model_run():
+ * - parallel mode returns once the NPU is done, the result event is set after post-processing
+ * - otherwise it returns after post-processing
+ * The NCPU takes finished NPU jobs ahead of new images so the post-processing of an image overlaps
+ * the CNN of the next one.
+ * The standalone JPEG decode command of kmdw_jpeg.c is served too, it takes decode time on the NCPU
+ * and reports the configured size, the output buffer is left as it is.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "cmsis_os2.h"
+#include "ipc.h"
+#include "kmdw_ipc.h"
+#include "kmdw_model.h"
+#include "kmdw_memory.h"
+#include "kmdw_console.h"
+#include "kmdw_jpeg.h"
+#include "kdp2_inf_generic_raw.h"
+#include "flatbuffer_setup_reader.h"
+#include "host_sim.h"
+
+#define NCPU_SIM_RUN_TIMEOUT        2000        // the same as MODEL_INF_TIMEOUT
+#define NCPU_SIM_QUEUE_DEPTH        (2 * IPC_IMAGE_MAX + 2)
+
+#define FLAG_NCPU_SIM_DONE(ref)     (0x1 << (ref))
+
+#define NCPU_SIM_MSG_NEW_IMAGE      0           // message priority: new image for pre-processing
+#define NCPU_SIM_MSG_NPU_DONE       1           // message priority: NPU done, go post-processing first
+
+// legacy setup.bin layout read by kmdw_inference_get_model_input_image_size(), see kneron_api_data.h in ncpu firmware
+typedef struct
+{
+    uint32_t magic;     // SETUP_LEGACY_MAGIC_NUM at the place of 'crc'
+    uint32_t version;
+    uint32_t reamaining_models;
+    uint32_t model_type;
+    uint32_t application_type;
+    uint32_t dram_start;
+    uint32_t dram_size;
+    uint32_t cmd_start;
+    uint32_t cmd_size;
+    uint32_t weight_start;
+    uint32_t weight_size;
+    uint32_t input_start;
+    uint32_t input_size;
+    uint32_t input_num;
+    uint32_t output_num;
+
+    // the single NetInput_Node
+    uint32_t node_id;
+    uint32_t input_index;
+    uint32_t input_format;
+    uint32_t input_row;
+    uint32_t input_col;
+    uint32_t input_channel;
+    uint32_t node_input_start;
+    uint32_t node_input_size;
+    uint32_t input_radix;
+} ncpu_sim_setup_t;
+
+typedef struct
+{
+    int ref_idx;        // IPC slot, index of the caller event flag
+    int raw_img_idx;
+} ncpu_sim_job_t;
+
+typedef struct
+{
+    int raw_img_idx;
+    osEventFlagsId_t evt_result;
+    uint32_t result_e;
+} ncpu_sim_img_data_t;
+
+static scpu_to_ncpu_t _ipc_out;
+static ncpu_sim_img_data_t _img_data[IPC_IMAGE_MAX];
+static int _current_ipc_idx = 0;
+static int _next_ipc_idx = 0;
+
+static struct kdp_model_s _model;
+static uint32_t _model_id_list[2] = {0}; // [model_count, id0]
+static uint32_t _model_width = 0;
+static uint32_t _model_height = 0;
+
+static uint32_t _pre_proc_us = 0;
+static uint32_t _npu_us = 0;
+static uint32_t _post_proc_us = 0;
+static uint32_t _jpeg_dec_us = 0;
+static ncpu_sim_job_hook_t _job_hook = NULL;
+
+static osEventFlagsId_t _evt_caller = NULL;
+static osMessageQueueId_t _ncpu_q = NULL;
+static osMessageQueueId_t _npu_q = NULL;
+
+static volatile uint64_t _ncpu_busy_us = 0;
+static volatile uint64_t _npu_busy_us = 0;
+
+static jpeg_decode_params_t _jpeg_dec_params;
+static jpeg_dec_kmdw_ctx_t _jpeg_dec_ctx;
+
+// the NCPU/NPU is a different core, spending time means sleeping here so the SCPU threads keep the host CPU
+static void _spend_time(uint32_t us, volatile uint64_t *busy_us)
+{
+    if (0 == us)
+        return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += us / 1000000;
+    ts.tv_nsec += (long)(us % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    while (0 != clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+        ;
+
+    *busy_us += us;
+}
+
+static uint32_t _job_image_addr(ncpu_sim_job_t *job)
+{
+    return _ipc_out.raw_images[job->raw_img_idx].image_list[0].image_mem_addr;
+}
+
+static void _write_raw_output(struct kdp_img_raw_s *raw_img)
+{
+    _720_raw_cnn_res_t *res = (_720_raw_cnn_res_t *)raw_img->result.result_mem_addr;
+
+    // only the node description, the output data is left as it is like a DMA nobody looks at
+    res->total_raw_len = _model.output_mem_len;
+    res->total_nodes = 1;
+    memset(&res->onode_a[0], 0, sizeof(_720_raw_onode_t));
+    res->onode_a[0].row_length = 1;
+    res->onode_a[0].col_length = 1;
+    res->onode_a[0].ch_length = _model.output_mem_len;
+}
+
+static void _npu_thread(void *arg)
+{
+    ncpu_sim_job_t job;
+
+    while (1)
+    {
+        osMessageQueueGet(_npu_q, &job, NULL, osWaitForever);
+
+        _spend_time(_npu_us, &_npu_busy_us);
+
+        struct kdp_img_raw_s *raw_img = &_ipc_out.raw_images[job.raw_img_idx];
+        raw_img->state = IMAGE_STATE_NPU_DONE;
+
+        // in parallel mode the caller may feed the next image now
+        if (raw_img->inf_format & IMAGE_FORMAT_PARALLEL_PROC)
+            osEventFlagsSet(_evt_caller, FLAG_NCPU_SIM_DONE(job.ref_idx));
+
+        osMessageQueuePut(_ncpu_q, &job, NCPU_SIM_MSG_NPU_DONE, osWaitForever);
+    }
+}
+
+static void _ncpu_thread(void *arg)
+{
+    ncpu_sim_job_t job;
+    uint8_t msg_type;
+
+    while (1)
+    {
+        osMessageQueueGet(_ncpu_q, &job, &msg_type, osWaitForever);
+
+        struct kdp_img_raw_s *raw_img = &_ipc_out.raw_images[job.raw_img_idx];
+
+        if (NCPU_SIM_MSG_NEW_IMAGE == msg_type)
+        {
+            if (NULL != _job_hook)
+                _job_hook(_job_image_addr(&job), false);
+
+            _spend_time(_pre_proc_us, &_ncpu_busy_us);
+
+            raw_img->state = IMAGE_STATE_NPU_BUSY;
+            osMessageQueuePut(_npu_q, &job, 0, osWaitForever);
+        }
+        else
+        {
+            if (0 == (raw_img->inf_format & IMAGE_FORMAT_RAW_OUTPUT))
+                _spend_time(_post_proc_us, &_ncpu_busy_us);
+
+            _write_raw_output(raw_img);
+            raw_img->state = IMAGE_STATE_DONE;
+            raw_img->tick_end = osKernelGetSysTimerCount();
+
+            if (NULL != _job_hook)
+                _job_hook(_job_image_addr(&job), true);
+
+            if (raw_img->inf_format & IMAGE_FORMAT_PARALLEL_PROC)
+                osEventFlagsSet(_img_data[job.ref_idx].evt_result, _img_data[job.ref_idx].result_e);
+            else
+                osEventFlagsSet(_evt_caller, FLAG_NCPU_SIM_DONE(job.ref_idx));
+        }
+    }
+}
+
+/* ############################
+ * ##    host_sim controls   ##
+ * ############################ */
+
+int ncpu_sim_set_model(uint32_t model_id, uint32_t width, uint32_t height, uint32_t raw_output_size)
+{
+    uint32_t setup_addr = kmdw_ddr_reserve(sizeof(ncpu_sim_setup_t));
+    if (0 == setup_addr)
+        return -1;
+
+    ncpu_sim_setup_t *setup = (ncpu_sim_setup_t *)setup_addr;
+    memset(setup, 0, sizeof(ncpu_sim_setup_t));
+    setup->magic = SETUP_LEGACY_MAGIC_NUM;
+    setup->model_type = model_id;
+    setup->input_num = 1;
+    setup->output_num = 1;
+    setup->node_id = 5;
+    setup->input_row = height;
+    setup->input_col = width;
+    setup->input_channel = 4;
+
+    memset(&_model, 0, sizeof(struct kdp_model_s));
+    _model.model_type = model_id;
+    _model.output_mem_len = raw_output_size;
+    _model.setup_mem_addr = setup_addr;
+    _model.setup_mem_len = sizeof(ncpu_sim_setup_t);
+
+    _model_id_list[0] = 1;
+    _model_id_list[1] = model_id;
+    _model_width = width;
+    _model_height = height;
+
+    return 0;
+}
+
+void ncpu_sim_set_timing(uint32_t pre_proc_us, uint32_t npu_us, uint32_t post_proc_us)
+{
+    _pre_proc_us = pre_proc_us;
+    _npu_us = npu_us;
+    _post_proc_us = post_proc_us;
+}
+
+void ncpu_sim_set_jpeg_decode_time(uint32_t jpeg_dec_us)
+{
+    _jpeg_dec_us = jpeg_dec_us;
+}
+
+void ncpu_sim_set_job_hook(ncpu_sim_job_hook_t hook)
+{
+    _job_hook = hook;
+}
+
+void ncpu_sim_initialize(void)
+{
+    osThreadAttr_t attr = {
+        .stack_size = 2048,
+        .priority = osPriorityRealtime,
+    };
+
+    _evt_caller = osEventFlagsNew(NULL);
+    _ncpu_q = osMessageQueueNew(NCPU_SIM_QUEUE_DEPTH, sizeof(ncpu_sim_job_t), NULL);
+    _npu_q = osMessageQueueNew(1, sizeof(ncpu_sim_job_t), NULL);
+
+    attr.name = "ncpu_sim";
+    osThreadNew(_ncpu_thread, NULL, &attr);
+    attr.name = "npu_sim";
+    osThreadNew(_npu_thread, NULL, &attr);
+}
+
+void ncpu_sim_get_busy_time(uint64_t *ncpu_busy_us, uint64_t *npu_busy_us)
+{
+    *ncpu_busy_us = _ncpu_busy_us;
+    *npu_busy_us = _npu_busy_us;
+}
+
+/* ############################
+ * ##    kmdw_ipc            ##
+ * ############################ */
+
+scpu_to_ncpu_t *kmdw_ipc_get_output(void)
+{
+    return &_ipc_out;
+}
+
+/* ############################
+ * ##    kmdw_model          ##
+ * ############################ */
+
+int kmdw_model_is_model_loaded(uint32_t model_type)
+{
+    return (0 < _model_id_list[0]) && (model_type == _model.model_type);
+}
+
+int kmdw_model_get_input_tensor_num(uint32_t model_type)
+{
+    return kmdw_model_is_model_loaded(model_type) ? 1 : 0;
+}
+
+int kmdw_model_get_input_tensor_info(uint32_t model_type, uint32_t tensor_idx, kmdw_model_tensor_descriptor_t *tensor_info)
+{
+    if ((0 == kmdw_model_is_model_loaded(model_type)) || (0 != tensor_idx) || (NULL == tensor_info))
+        return 0;
+
+    memset(tensor_info, 0, sizeof(kmdw_model_tensor_descriptor_t));
+    tensor_info->index = 0;
+    tensor_info->shape_npu_len = 4;
+    tensor_info->shape_npu[0] = 1;
+    tensor_info->shape_npu[1] = 4;
+    tensor_info->shape_npu[2] = _model_height;
+    tensor_info->shape_npu[3] = _model_width;
+    tensor_info->scale = 1.0f;
+
+    return 1;
+}
+
+uint32_t *kmdw_model_get_all_model_info(bool trust_ddr_data)
+{
+    return (0 < _model_id_list[0]) ? _model_id_list : NULL;
+}
+
+struct kdp_model_s *kmdw_model_get_model_info(int idx_p)
+{
+    return (idx_p < (int)_model_id_list[0]) ? &_model : NULL;
+}
+
+int32_t kmdw_model_config_result(osEventFlagsId_t result_evt, uint32_t result_evt_flag)
+{
+    _img_data[_current_ipc_idx].evt_result = result_evt;
+    _img_data[_current_ipc_idx].result_e = result_evt_flag;
+
+    return 0;
+}
+
+void kmdw_model_config_img(struct kdp_img_cfg *img_cfg, void *ext_param)
+{
+    int act_img_idx = img_cfg->image_buf_active_index;
+    struct kdp_img_raw_s *raw_img = kmdw_model_get_raw_img(act_img_idx);
+
+    _current_ipc_idx = _next_ipc_idx;
+
+    if (img_cfg->inf_format & IMAGE_FORMAT_PARALLEL_PROC)
+        _next_ipc_idx = !_next_ipc_idx;
+
+    _img_data[_current_ipc_idx].raw_img_idx = act_img_idx;
+
+    raw_img->state = IMAGE_STATE_ACTIVE;
+    raw_img->seq_num = act_img_idx;
+    raw_img->ref_idx = _current_ipc_idx;
+    raw_img->num_image = img_cfg->num_image;
+    raw_img->inf_format = img_cfg->inf_format;
+
+    for (int i = 0; i < img_cfg->num_image; i++)
+        raw_img->image_list[i] = img_cfg->image_list[i];
+
+    if (NULL == ext_param)
+        memset(raw_img->ext_params, 0, MAX_PARAMS_LEN * 4);
+    else
+        memcpy(raw_img->ext_params, ext_param, MAX_PARAMS_LEN * 4);
+}
+
+struct kdp_img_raw_s *kmdw_model_get_raw_img(int idx)
+{
+    return &(kmdw_ipc_get_output()->raw_images[idx]);
+}
+
+int kmdw_model_run(const char *tag, void *output, uint32_t model_type, bool model_from_ddr)
+{
+    if (0 == kmdw_model_is_model_loaded(model_type))
+        return KMDW_MODEL_RUN_RC_ABORT;
+
+    ncpu_sim_job_t job = {
+        .ref_idx = _current_ipc_idx,
+        .raw_img_idx = _img_data[_current_ipc_idx].raw_img_idx,
+    };
+
+    struct kdp_img_raw_s *raw_img = kmdw_model_get_raw_img(job.raw_img_idx);
+    raw_img->result.result_mem_addr = (uint32_t)output;
+    raw_img->tick_start = osKernelGetSysTimerCount();
+
+    osEventFlagsClear(_evt_caller, FLAG_NCPU_SIM_DONE(job.ref_idx));
+    osMessageQueuePut(_ncpu_q, &job, NCPU_SIM_MSG_NEW_IMAGE, osWaitForever);
+
+    raw_img->tick_got_ncpu_ack = osKernelGetSysTimerCount();
+
+    uint32_t flags = osEventFlagsWait(_evt_caller, FLAG_NCPU_SIM_DONE(job.ref_idx), osFlagsWaitAny, NCPU_SIM_RUN_TIMEOUT);
+    if (flags == (uint32_t)osFlagsErrorTimeout)
+    {
+        err_msg("[%s] fake NCPU timeout\n", __FUNCTION__);
+        return IMAGE_STATE_TIMEOUT;
+    }
+
+    return 0;
+}
+
+/* ############################
+ * ##    kmdw_jpeg           ##
+ * ############################ */
+
+void model_jpeg_dec_cfg(uint32_t img_seq, uint32_t jpeg_in_buf_addr, uint32_t jpeg_in_size, uint32_t yuv_out_buf_addr,
+                        uint32_t exec_rlt_addr, uint32_t w, uint32_t h, uint32_t fmt, osEventFlagsId_t *pEvt, uint32_t evt_flag)
+{
+    _jpeg_dec_ctx.jpeg_dec_evt_id = *pEvt;
+    _jpeg_dec_ctx.jpeg_dec_evt_flag = evt_flag;
+
+    memset(&_jpeg_dec_params, 0, sizeof(jpeg_decode_params_t));
+    _jpeg_dec_params.src_buf.buf_addr = jpeg_in_buf_addr;
+    _jpeg_dec_params.src_buf.buf_filled_len = jpeg_in_size;
+    _jpeg_dec_params.out_fmt = (jpeg_fmt_t)fmt;
+    _jpeg_dec_params.width = w;
+    _jpeg_dec_params.height = h;
+    _jpeg_dec_params.dst_yuv_buf = yuv_out_buf_addr;
+    _jpeg_dec_params.dst_buf_size = w * h * 2;
+    _jpeg_dec_params.frame_seq = img_seq;
+}
+
+// the NCPU is a different core, the caller waits for the event anyway so the decode time is spent here
+void model_jpeg_dec_start_run(void)
+{
+    _spend_time(_jpeg_dec_us, &_ncpu_busy_us);
+
+    jpeg_decode_result_t *rslt = &_jpeg_dec_ctx.npu_rslt;
+
+    memset(rslt, 0, sizeof(jpeg_decode_result_t));
+    rslt->sts = JPEG_OPERATION_SUCCESS;
+    rslt->yuv_buf.fmt = _jpeg_dec_params.out_fmt;
+    rslt->yuv_buf.width = _jpeg_dec_params.width;
+    rslt->yuv_buf.height = _jpeg_dec_params.height;
+    rslt->yuv_buf.yBuf = (uint8_t *)_jpeg_dec_params.dst_yuv_buf;
+    rslt->frame_seq = _jpeg_dec_params.frame_seq;
+
+    osEventFlagsSet(_jpeg_dec_ctx.jpeg_dec_evt_id, _jpeg_dec_ctx.jpeg_dec_evt_flag);
+}
+
+jpeg_decode_result_t *model_jpeg_dec_get_rslt(void)
+{
+    return &_jpeg_dec_ctx.npu_rslt;
+}
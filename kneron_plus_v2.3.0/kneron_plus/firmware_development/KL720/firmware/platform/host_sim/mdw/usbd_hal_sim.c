@@ -0,0 +1,397 @@
+/*
+ * Simulated USB device HAL for the host-native middleware build
+ *
+ * Copyright (C) 2022 Kneron, Inc. All rights reserved.
+ *
+ * The device side is the usbd_hal API used by the USB companion, the host side is driven by
+ * the benchmark through the usbd_sim_host_*() functions of host_sim.h.
+ * A bulk-out transfer completes when the device has received all of it, a device receive takes
+ * at most the posted buffer length so a big host transfer can be received in pieces, like a real
+ * bulk endpoint. A bulk-in transfer completes when the host has read it.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "usbd_hal.h"
+#include "host_sim.h"
+
+#define USBD_SIM_EP_OUT     0
+#define USBD_SIM_EP_IN      1
+#define USBD_SIM_EP_NUM     2
+
+typedef struct
+{
+    uint8_t *buf;           // host buffer of the pending transfer, NULL if none
+    uint32_t len;
+    uint32_t done_len;
+    bool busy;              // a side is copying data, the transfer can not be cancelled
+    bool completed;
+    uint32_t terminate_seq; // bumped by usbd_hal_terminate_endpoint()
+} usbd_sim_ep_t;
+
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _cond;
+
+static usbd_sim_ep_t _ep[USBD_SIM_EP_NUM];
+static usbd_hal_link_status_t _link_status = USBD_STATUS_DISCONNECTED;
+static usbd_hal_user_link_status_callback_t _link_cb = NULL;
+static usbd_hal_user_control_callback_t _control_cb = NULL;
+
+static uint32_t _bytes_per_us = 0;
+static usbd_sim_receive_hook_t _receive_hook = NULL;
+
+static void _init_cond(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// the condition uses CLOCK_MONOTONIC so it can not be statically initialized
+static void _lock_sim(void)
+{
+    pthread_once(&_once, _init_cond);
+    pthread_mutex_lock(&_lock);
+}
+
+static struct timespec _deadline(uint32_t timeout_ms)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    return ts;
+}
+
+// wait with '_lock' held, returns false on timeout
+static bool _wait(uint32_t timeout_ms, const struct timespec *deadline)
+{
+    if (0xFFFFFFFF == timeout_ms)
+        return (0 == pthread_cond_wait(&_cond, &_lock));
+
+    return (ETIMEDOUT != pthread_cond_timedwait(&_cond, &_lock, deadline));
+}
+
+// copy and take the link time with '_lock' released
+static void _transfer(void *dst, const void *src, uint32_t len)
+{
+    uint64_t start_us = host_sim_get_time_us();
+
+    memcpy(dst, src, len);
+
+    if (0 < _bytes_per_us)
+    {
+        uint64_t end_us = start_us + len / _bytes_per_us;
+        while (host_sim_get_time_us() < end_us)
+            ;
+    }
+}
+
+static int _ep_index(uint32_t endpoint)
+{
+    if (KDP2_USB_ENDPOINT_DATA_OUT == endpoint)
+        return USBD_SIM_EP_OUT;
+    else if (KDP2_USB_ENDPOINT_DATA_IN == endpoint)
+        return USBD_SIM_EP_IN;
+    else
+        return -1;
+}
+
+/* ############################
+ * ##    device side         ##
+ * ############################ */
+
+kdrv_status_t usbd_hal_initialize(
+    uint8_t *serial_string,
+    uint16_t bcdDevice,
+    usbd_hal_user_link_status_callback_t usr_link_isr_cb,
+    usbd_hal_user_control_callback_t usr_cx_isr_cb)
+{
+    _lock_sim();
+    _link_cb = usr_link_isr_cb;
+    _control_cb = usr_cx_isr_cb;
+    pthread_mutex_unlock(&_lock);
+
+    return KDRV_STATUS_OK;
+}
+
+kdrv_status_t usbd_hal_set_enable(bool enable)
+{
+    return KDRV_STATUS_OK;
+}
+
+kdrv_status_t usbd_hal_bulk_receive(uint32_t endpoint, uint32_t *buf, uint32_t *blen, uint32_t timeout_ms)
+{
+    usbd_sim_ep_t *ep = &_ep[USBD_SIM_EP_OUT];
+
+    if (USBD_SIM_EP_OUT != _ep_index(endpoint))
+        return KDRV_STATUS_USBD_INVALID_ENDPOINT;
+
+    struct timespec deadline = _deadline(timeout_ms);
+
+    _lock_sim();
+
+    uint32_t terminate_seq = ep->terminate_seq;
+
+    // wait for the host to send something
+    while ((NULL == ep->buf) || (ep->done_len == ep->len))
+    {
+        if (terminate_seq != ep->terminate_seq)
+        {
+            pthread_mutex_unlock(&_lock);
+            return KDRV_STATUS_USBD_TRANSFER_TERMINATED;
+        }
+
+        if (false == _wait(timeout_ms, &deadline))
+        {
+            pthread_mutex_unlock(&_lock);
+            return KDRV_STATUS_USBD_TRANSFER_TIMEOUT;
+        }
+    }
+
+    uint32_t offset = ep->done_len;
+    uint32_t len = ep->len - offset;
+    if (len > *blen)
+        len = *blen;
+
+    ep->busy = true;
+    pthread_mutex_unlock(&_lock);
+
+    _transfer(buf, ep->buf + offset, len);
+
+    if (NULL != _receive_hook)
+        _receive_hook((uint32_t)buf, offset, len);
+
+    _lock_sim();
+    ep->busy = false;
+    ep->done_len += len;
+    if (ep->done_len == ep->len)
+        ep->completed = true;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    *blen = len;
+
+    return KDRV_STATUS_OK;
+}
+
+kdrv_status_t usbd_hal_bulk_send(uint32_t endpoint, uint32_t *buf, uint32_t txLen, uint32_t timeout_ms)
+{
+    usbd_sim_ep_t *ep = &_ep[USBD_SIM_EP_IN];
+    kdrv_status_t sts = KDRV_STATUS_OK;
+
+    if (USBD_SIM_EP_IN != _ep_index(endpoint))
+        return KDRV_STATUS_USBD_INVALID_ENDPOINT;
+
+    struct timespec deadline = _deadline(timeout_ms);
+
+    _lock_sim();
+
+    uint32_t terminate_seq = ep->terminate_seq;
+
+    ep->buf = (uint8_t *)buf;
+    ep->len = txLen;
+    ep->done_len = 0;
+    ep->completed = false;
+    pthread_cond_broadcast(&_cond);
+
+    // wait for the host to read it
+    while (false == ep->completed)
+    {
+        if ((false == ep->busy) && (terminate_seq != ep->terminate_seq))
+        {
+            sts = KDRV_STATUS_USBD_TRANSFER_TERMINATED;
+            break;
+        }
+
+        if ((false == _wait(timeout_ms, &deadline)) && (false == ep->busy))
+        {
+            sts = KDRV_STATUS_USBD_TRANSFER_TIMEOUT;
+            break;
+        }
+    }
+
+    ep->buf = NULL;
+    pthread_mutex_unlock(&_lock);
+
+    return sts;
+}
+
+bool usbd_hal_is_endpoint_available(uint32_t endpoint)
+{
+    return (USBD_STATUS_CONFIGURED == _link_status) && (0 <= _ep_index(endpoint));
+}
+
+bool usbd_hal_interrupt_send_check_buffer_empty(uint32_t endpoint)
+{
+    return true;
+}
+
+kdrv_status_t usbd_hal_interrupt_send(uint32_t endpoint, uint32_t *buf, uint32_t txLen, uint32_t timeout_ms)
+{
+    return KDRV_STATUS_OK;
+}
+
+kdrv_status_t usbd_hal_terminate_all_endpoint(void)
+{
+    usbd_hal_terminate_endpoint(KDP2_USB_ENDPOINT_DATA_OUT);
+    usbd_hal_terminate_endpoint(KDP2_USB_ENDPOINT_DATA_IN);
+
+    return KDRV_STATUS_OK;
+}
+
+kdrv_status_t usbd_hal_terminate_endpoint(uint32_t endpoint)
+{
+    int idx = _ep_index(endpoint);
+
+    if (0 > idx)
+        return KDRV_STATUS_USBD_INVALID_ENDPOINT;
+
+    _lock_sim();
+    _ep[idx].terminate_seq++;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    return KDRV_STATUS_OK;
+}
+
+usbd_hal_link_status_t usbd_hal_get_link_status(void)
+{
+    return _link_status;
+}
+
+void usbd_hal_reset_device(void *arg)
+{
+}
+
+/* ############################
+ * ##    host side           ##
+ * ############################ */
+
+void usbd_sim_set_throughput(uint32_t bytes_per_us)
+{
+    _bytes_per_us = bytes_per_us;
+}
+
+void usbd_sim_set_receive_hook(usbd_sim_receive_hook_t hook)
+{
+    _receive_hook = hook;
+}
+
+void usbd_sim_host_connect(bool connect)
+{
+    _link_status = connect ? USBD_STATUS_CONFIGURED : USBD_STATUS_DISCONNECTED;
+
+    if (NULL != _link_cb)
+        _link_cb(_link_status);
+}
+
+bool usbd_sim_host_control(uint8_t bRequest, uint16_t wValue, uint16_t wIndex)
+{
+    usbd_hal_setup_packet_t setup = {
+        .bmRequestType = 0x40, // vendor, host to device
+        .bRequest = bRequest,
+        .wValue = wValue,
+        .wIndex = wIndex,
+        .wLength = 0,
+    };
+
+    if ((USBD_STATUS_CONFIGURED != _link_status) || (NULL == _control_cb))
+        return false;
+
+    return _control_cb(&setup);
+}
+
+int usbd_sim_host_bulk_write(const void *buf, uint32_t len, uint32_t timeout_ms, uint64_t *blocked_us)
+{
+    usbd_sim_ep_t *ep = &_ep[USBD_SIM_EP_OUT];
+    int ret = 0;
+
+    if (USBD_STATUS_CONFIGURED != _link_status)
+        return -1;
+
+    uint64_t start_us = host_sim_get_time_us();
+    uint64_t first_byte_us = 0;
+    struct timespec deadline = _deadline(timeout_ms);
+
+    _lock_sim();
+
+    ep->buf = (uint8_t *)buf;
+    ep->len = len;
+    ep->done_len = 0;
+    ep->completed = false;
+    pthread_cond_broadcast(&_cond);
+
+    while (false == ep->completed)
+    {
+        if ((0 == first_byte_us) && (ep->busy || (0 < ep->done_len)))
+            first_byte_us = host_sim_get_time_us();
+
+        if ((false == _wait(timeout_ms, &deadline)) && (false == ep->busy))
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    ep->buf = NULL;
+    pthread_mutex_unlock(&_lock);
+
+    if (NULL != blocked_us)
+        *blocked_us = ((0 != first_byte_us) ? first_byte_us : host_sim_get_time_us()) - start_us;
+
+    return ret;
+}
+
+int usbd_sim_host_bulk_read(void *buf, uint32_t buf_size, uint32_t timeout_ms)
+{
+    usbd_sim_ep_t *ep = &_ep[USBD_SIM_EP_IN];
+
+    if (USBD_STATUS_CONFIGURED != _link_status)
+        return -1;
+
+    struct timespec deadline = _deadline(timeout_ms);
+
+    _lock_sim();
+
+    // wait for the device to send something
+    while ((NULL == ep->buf) || ep->completed)
+    {
+        if (false == _wait(timeout_ms, &deadline))
+        {
+            pthread_mutex_unlock(&_lock);
+            return -1;
+        }
+    }
+
+    uint32_t len = (ep->len < buf_size) ? ep->len : buf_size;
+
+    ep->busy = true;
+    pthread_mutex_unlock(&_lock);
+
+    _transfer(buf, ep->buf, len);
+
+    _lock_sim();
+    ep->busy = false;
+    ep->done_len = ep->len;
+    ep->completed = true;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    return (int)len;
+}
@@ -0,0 +1,933 @@
+/*
+ * CMSIS-RTOS2 on POSIX threads, for running the SCPU middleware natively on a Linux host
+ *
+ * Copyright (C) 2022 Kneron, Inc. All rights reserved.
+ *
+ * Only the API subset used by the middleware is implemented, with RTX semantics where they matter:
+ * - one kernel tick is 1 ms, timeout 0 means "try" and returns osErrorResource
+ * - threads created before osKernelStart() do not run until it is called
+ * - message queues deliver higher 'msg_prio' first, FIFO among the same priority
+ *
+ * Unlike RTX, osKernelStart() returns so that main() can go on as the USB host.
+ * Thread priorities are mapped to SCHED_FIFO when the process is allowed to, otherwise they are ignored.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "cmsis_os2.h"
+#include "host_sim.h"
+
+#define SHIM_TICK_FREQ          1000        // 1 ms per tick, the same as RTX_Config.h
+#define SHIM_SYS_TIMER_FREQ     1000000     // micro-seconds
+
+typedef struct
+{
+    pthread_t thread;
+    osThreadFunc_t func;
+    void *argument;
+    const char *name;
+    osPriority_t priority;
+    uint32_t stack_size;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t flags;
+} shim_thread_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t flags;
+} shim_event_flags_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t count;
+    uint32_t max_count;
+} shim_semaphore_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint32_t msg_count;
+    uint32_t msg_size;
+    uint32_t head;
+    uint32_t count;
+    uint8_t *prio;      // priority of each slot
+    uint8_t *data;      // msg_count slots of msg_size bytes, a ring from 'head'
+} shim_msgq_t;
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    osTimerFunc_t func;
+    void *argument;
+    osTimerType_t type;
+    uint32_t ticks;
+    uint32_t generation;    // bumped on every start and stop to cancel the pending expiry
+    bool running;
+    bool deleted;
+} shim_timer_t;
+
+static pthread_mutex_t _kernel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _kernel_started_cond = PTHREAD_COND_INITIALIZER;
+static osKernelState_t _kernel_state = osKernelInactive;
+static int _thread_cpu = -1;
+static __thread shim_thread_t *_current_thread = NULL;
+
+uint64_t host_sim_get_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void host_sim_rtos_set_cpu(int cpu)
+{
+    _thread_cpu = cpu;
+}
+
+// absolute CLOCK_MONOTONIC deadline of a timeout in ticks, conditions are created with the same clock
+static struct timespec _deadline(uint32_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    ts.tv_sec += ticks / SHIM_TICK_FREQ;
+    ts.tv_nsec += (long)(ticks % SHIM_TICK_FREQ) * (1000000000 / SHIM_TICK_FREQ);
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    return ts;
+}
+
+// wait on 'cond' until signalled or 'deadline', returns false on timeout
+static bool _cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, uint32_t timeout, const struct timespec *deadline)
+{
+    if (osWaitForever == timeout)
+        return (0 == pthread_cond_wait(cond, lock));
+
+    return (ETIMEDOUT != pthread_cond_timedwait(cond, lock, deadline));
+}
+
+static void _cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static shim_thread_t *_thread_new_cb(void)
+{
+    shim_thread_t *th = (shim_thread_t *)calloc(1, sizeof(shim_thread_t));
+    if (NULL == th)
+        return NULL;
+
+    pthread_mutex_init(&th->lock, NULL);
+    _cond_init(&th->cond);
+    th->priority = osPriorityNormal;
+
+    return th;
+}
+
+//  ==== Kernel Management Functions ====
+
+osStatus_t osKernelInitialize(void)
+{
+    pthread_mutex_lock(&_kernel_lock);
+    if (osKernelInactive == _kernel_state)
+        _kernel_state = osKernelReady;
+    pthread_mutex_unlock(&_kernel_lock);
+
+    return osOK;
+}
+
+osKernelState_t osKernelGetState(void)
+{
+    return _kernel_state;
+}
+
+osStatus_t osKernelStart(void)
+{
+    pthread_mutex_lock(&_kernel_lock);
+
+    if (osKernelReady != _kernel_state)
+    {
+        pthread_mutex_unlock(&_kernel_lock);
+        return osError;
+    }
+
+    _kernel_state = osKernelRunning;
+    pthread_cond_broadcast(&_kernel_started_cond);
+    pthread_mutex_unlock(&_kernel_lock);
+
+    return osOK;
+}
+
+uint32_t osKernelGetTickCount(void)
+{
+    return (uint32_t)(host_sim_get_time_us() / (SHIM_SYS_TIMER_FREQ / SHIM_TICK_FREQ));
+}
+
+uint32_t osKernelGetTickFreq(void)
+{
+    return SHIM_TICK_FREQ;
+}
+
+uint32_t osKernelGetSysTimerCount(void)
+{
+    return (uint32_t)host_sim_get_time_us();
+}
+
+uint32_t osKernelGetSysTimerFreq(void)
+{
+    return SHIM_SYS_TIMER_FREQ;
+}
+
+//  ==== Thread Management Functions ====
+
+static void *_thread_entry(void *arg)
+{
+    shim_thread_t *th = (shim_thread_t *)arg;
+
+    _current_thread = th;
+
+    // like RTX, nothing runs before the kernel is started
+    pthread_mutex_lock(&_kernel_lock);
+    while (osKernelRunning != _kernel_state)
+        pthread_cond_wait(&_kernel_started_cond, &_kernel_lock);
+    pthread_mutex_unlock(&_kernel_lock);
+
+    th->func(th->argument);
+
+    return NULL;
+}
+
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr)
+{
+    if (NULL == func)
+        return NULL;
+
+    shim_thread_t *th = _thread_new_cb();
+    if (NULL == th)
+        return NULL;
+
+    th->func = func;
+    th->argument = argument;
+
+    if (NULL != attr)
+    {
+        th->name = attr->name;
+        th->stack_size = attr->stack_size;
+        if (osPriorityNone != attr->priority)
+            th->priority = attr->priority;
+    }
+
+    // firmware stacks are a few KB, host libc needs more, so 'stack_size' is not applied
+    pthread_attr_t pattr;
+    pthread_attr_init(&pattr);
+    pthread_attr_setdetachstate(&pattr, PTHREAD_CREATE_DETACHED);
+
+    if (0 <= _thread_cpu)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(_thread_cpu, &cpus);
+        pthread_attr_setaffinity_np(&pattr, sizeof(cpu_set_t), &cpus);
+    }
+
+    // RTX priorities 1..56 fit in the SCHED_FIFO range 1..99
+    struct sched_param sp;
+    sp.sched_priority = (int)th->priority;
+    pthread_attr_setinheritsched(&pattr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&pattr, SCHED_FIFO);
+    pthread_attr_setschedparam(&pattr, &sp);
+
+    int ret = pthread_create(&th->thread, &pattr, _thread_entry, th);
+    if (EPERM == ret)
+    {
+        // no real-time privilege, fall back to the default policy
+        pthread_attr_setinheritsched(&pattr, PTHREAD_INHERIT_SCHED);
+        ret = pthread_create(&th->thread, &pattr, _thread_entry, th);
+    }
+
+    pthread_attr_destroy(&pattr);
+
+    if (0 != ret)
+    {
+        free(th);
+        return NULL;
+    }
+
+    return (osThreadId_t)th;
+}
+
+osThreadId_t osThreadGetId(void)
+{
+    // threads not created by osThreadNew(), such as main(), get a control block on first use
+    if (NULL == _current_thread)
+    {
+        _current_thread = _thread_new_cb();
+        if (NULL != _current_thread)
+            _current_thread->thread = pthread_self();
+    }
+
+    return (osThreadId_t)_current_thread;
+}
+
+const char *osThreadGetName(osThreadId_t thread_id)
+{
+    return (NULL != thread_id) ? ((shim_thread_t *)thread_id)->name : NULL;
+}
+
+osPriority_t osThreadGetPriority(osThreadId_t thread_id)
+{
+    return (NULL != thread_id) ? ((shim_thread_t *)thread_id)->priority : osPriorityError;
+}
+
+osStatus_t osThreadYield(void)
+{
+    sched_yield();
+    return osOK;
+}
+
+__NO_RETURN void osThreadExit(void)
+{
+    pthread_exit(NULL);
+}
+
+uint32_t osThreadFlagsSet(osThreadId_t thread_id, uint32_t flags)
+{
+    shim_thread_t *th = (shim_thread_t *)thread_id;
+
+    if ((NULL == th) || (0 != (flags & osFlagsError)))
+        return osFlagsErrorParameter;
+
+    pthread_mutex_lock(&th->lock);
+    th->flags |= flags;
+    uint32_t ret = th->flags;
+    pthread_cond_broadcast(&th->cond);
+    pthread_mutex_unlock(&th->lock);
+
+    return ret;
+}
+
+uint32_t osThreadFlagsClear(uint32_t flags)
+{
+    shim_thread_t *th = (shim_thread_t *)osThreadGetId();
+
+    pthread_mutex_lock(&th->lock);
+    uint32_t ret = th->flags;
+    th->flags &= ~flags;
+    pthread_mutex_unlock(&th->lock);
+
+    return ret;
+}
+
+uint32_t osThreadFlagsGet(void)
+{
+    return ((shim_thread_t *)osThreadGetId())->flags;
+}
+
+static bool _flags_satisfied(uint32_t current, uint32_t flags, uint32_t options)
+{
+    if (options & osFlagsWaitAll)
+        return ((current & flags) == flags);
+    else
+        return (0 != (current & flags));
+}
+
+// shared by thread flags and event flags
+static uint32_t _flags_wait(pthread_mutex_t *lock, pthread_cond_t *cond, uint32_t *current, uint32_t flags, uint32_t options, uint32_t timeout)
+{
+    struct timespec deadline = _deadline(timeout);
+    uint32_t ret;
+
+    pthread_mutex_lock(lock);
+
+    while (false == _flags_satisfied(*current, flags, options))
+    {
+        if ((0 == timeout) || (false == _cond_wait(cond, lock, timeout, &deadline)))
+        {
+            if (_flags_satisfied(*current, flags, options))
+                break;
+
+            pthread_mutex_unlock(lock);
+            return (0 == timeout) ? osFlagsErrorResource : osFlagsErrorTimeout;
+        }
+    }
+
+    ret = *current;
+    if (0 == (options & osFlagsNoClear))
+        *current &= ~flags;
+
+    pthread_mutex_unlock(lock);
+
+    return ret;
+}
+
+uint32_t osThreadFlagsWait(uint32_t flags, uint32_t options, uint32_t timeout)
+{
+    shim_thread_t *th = (shim_thread_t *)osThreadGetId();
+
+    return _flags_wait(&th->lock, &th->cond, &th->flags, flags, options, timeout);
+}
+
+//  ==== Generic Wait Functions ====
+
+osStatus_t osDelay(uint32_t ticks)
+{
+    struct timespec deadline = _deadline(ticks);
+
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL))
+        ;
+
+    return osOK;
+}
+
+osStatus_t osDelayUntil(uint32_t ticks)
+{
+    uint32_t now = osKernelGetTickCount();
+
+    if ((int32_t)(ticks - now) <= 0)
+        return osErrorParameter;
+
+    return osDelay(ticks - now);
+}
+
+//  ==== Timer Management Functions ====
+
+static void *_timer_entry(void *arg)
+{
+    shim_timer_t *tm = (shim_timer_t *)arg;
+
+    pthread_mutex_lock(&tm->lock);
+
+    while (false == tm->deleted)
+    {
+        if (false == tm->running)
+        {
+            pthread_cond_wait(&tm->cond, &tm->lock);
+            continue;
+        }
+
+        uint32_t generation = tm->generation;
+        struct timespec deadline = _deadline(tm->ticks);
+
+        // restarted, stopped or deleted meanwhile
+        if (_cond_wait(&tm->cond, &tm->lock, tm->ticks, &deadline) || (generation != tm->generation))
+            continue;
+
+        if (osTimerOnce == tm->type)
+            tm->running = false;
+
+        pthread_mutex_unlock(&tm->lock);
+        tm->func(tm->argument);
+        pthread_mutex_lock(&tm->lock);
+    }
+
+    pthread_mutex_unlock(&tm->lock);
+
+    pthread_mutex_destroy(&tm->lock);
+    pthread_cond_destroy(&tm->cond);
+    free(tm);
+
+    return NULL;
+}
+
+osTimerId_t osTimerNew(osTimerFunc_t func, osTimerType_t type, void *argument, const osTimerAttr_t *attr)
+{
+    if (NULL == func)
+        return NULL;
+
+    shim_timer_t *tm = (shim_timer_t *)calloc(1, sizeof(shim_timer_t));
+    if (NULL == tm)
+        return NULL;
+
+    pthread_mutex_init(&tm->lock, NULL);
+    _cond_init(&tm->cond);
+    tm->func = func;
+    tm->argument = argument;
+    tm->type = type;
+
+    if (0 != pthread_create(&tm->thread, NULL, _timer_entry, tm))
+    {
+        free(tm);
+        return NULL;
+    }
+
+    pthread_detach(tm->thread);
+
+    return (osTimerId_t)tm;
+}
+
+osStatus_t osTimerStart(osTimerId_t timer_id, uint32_t ticks)
+{
+    shim_timer_t *tm = (shim_timer_t *)timer_id;
+
+    if ((NULL == tm) || (0 == ticks))
+        return osErrorParameter;
+
+    pthread_mutex_lock(&tm->lock);
+    tm->ticks = ticks;
+    tm->running = true;
+    tm->generation++;
+    pthread_cond_broadcast(&tm->cond);
+    pthread_mutex_unlock(&tm->lock);
+
+    return osOK;
+}
+
+osStatus_t osTimerStop(osTimerId_t timer_id)
+{
+    shim_timer_t *tm = (shim_timer_t *)timer_id;
+
+    if (NULL == tm)
+        return osErrorParameter;
+
+    pthread_mutex_lock(&tm->lock);
+    osStatus_t sts = (tm->running) ? osOK : osErrorResource;
+    tm->running = false;
+    tm->generation++;
+    pthread_cond_broadcast(&tm->cond);
+    pthread_mutex_unlock(&tm->lock);
+
+    return sts;
+}
+
+uint32_t osTimerIsRunning(osTimerId_t timer_id)
+{
+    return (NULL != timer_id) ? ((shim_timer_t *)timer_id)->running : 0;
+}
+
+osStatus_t osTimerDelete(osTimerId_t timer_id)
+{
+    shim_timer_t *tm = (shim_timer_t *)timer_id;
+
+    if (NULL == tm)
+        return osErrorParameter;
+
+    // the timer thread frees it
+    pthread_mutex_lock(&tm->lock);
+    tm->deleted = true;
+    pthread_cond_broadcast(&tm->cond);
+    pthread_mutex_unlock(&tm->lock);
+
+    return osOK;
+}
+
+//  ==== Event Flags Management Functions ====
+
+osEventFlagsId_t osEventFlagsNew(const osEventFlagsAttr_t *attr)
+{
+    shim_event_flags_t *ef = (shim_event_flags_t *)calloc(1, sizeof(shim_event_flags_t));
+    if (NULL == ef)
+        return NULL;
+
+    pthread_mutex_init(&ef->lock, NULL);
+    _cond_init(&ef->cond);
+
+    return (osEventFlagsId_t)ef;
+}
+
+uint32_t osEventFlagsSet(osEventFlagsId_t ef_id, uint32_t flags)
+{
+    shim_event_flags_t *ef = (shim_event_flags_t *)ef_id;
+
+    if ((NULL == ef) || (0 != (flags & osFlagsError)))
+        return osFlagsErrorParameter;
+
+    pthread_mutex_lock(&ef->lock);
+    ef->flags |= flags;
+    uint32_t ret = ef->flags;
+    pthread_cond_broadcast(&ef->cond);
+    pthread_mutex_unlock(&ef->lock);
+
+    return ret;
+}
+
+uint32_t osEventFlagsClear(osEventFlagsId_t ef_id, uint32_t flags)
+{
+    shim_event_flags_t *ef = (shim_event_flags_t *)ef_id;
+
+    if (NULL == ef)
+        return osFlagsErrorParameter;
+
+    pthread_mutex_lock(&ef->lock);
+    uint32_t ret = ef->flags;
+    ef->flags &= ~flags;
+    pthread_mutex_unlock(&ef->lock);
+
+    return ret;
+}
+
+uint32_t osEventFlagsGet(osEventFlagsId_t ef_id)
+{
+    return (NULL != ef_id) ? ((shim_event_flags_t *)ef_id)->flags : 0;
+}
+
+uint32_t osEventFlagsWait(osEventFlagsId_t ef_id, uint32_t flags, uint32_t options, uint32_t timeout)
+{
+    shim_event_flags_t *ef = (shim_event_flags_t *)ef_id;
+
+    if (NULL == ef)
+        return osFlagsErrorParameter;
+
+    return _flags_wait(&ef->lock, &ef->cond, &ef->flags, flags, options, timeout);
+}
+
+osStatus_t osEventFlagsDelete(osEventFlagsId_t ef_id)
+{
+    shim_event_flags_t *ef = (shim_event_flags_t *)ef_id;
+
+    if (NULL == ef)
+        return osErrorParameter;
+
+    pthread_mutex_destroy(&ef->lock);
+    pthread_cond_destroy(&ef->cond);
+    free(ef);
+
+    return osOK;
+}
+
+//  ==== Mutex Management Functions ====
+
+osMutexId_t osMutexNew(const osMutexAttr_t *attr)
+{
+    pthread_mutex_t *mtx = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+    if (NULL == mtx)
+        return NULL;
+
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    if ((NULL != attr) && (attr->attr_bits & osMutexRecursive))
+        pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
+    if ((NULL != attr) && (attr->attr_bits & osMutexPrioInherit))
+        pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(mtx, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    return (osMutexId_t)mtx;
+}
+
+osStatus_t osMutexAcquire(osMutexId_t mutex_id, uint32_t timeout)
+{
+    pthread_mutex_t *mtx = (pthread_mutex_t *)mutex_id;
+
+    if (NULL == mtx)
+        return osErrorParameter;
+
+    if (osWaitForever == timeout)
+        return (0 == pthread_mutex_lock(mtx)) ? osOK : osError;
+
+    if (0 == timeout)
+        return (0 == pthread_mutex_trylock(mtx)) ? osOK : osErrorResource;
+
+    struct timespec deadline = _deadline(timeout);
+    return (0 == pthread_mutex_clocklock(mtx, CLOCK_MONOTONIC, &deadline)) ? osOK : osErrorTimeout;
+}
+
+osStatus_t osMutexRelease(osMutexId_t mutex_id)
+{
+    if (NULL == mutex_id)
+        return osErrorParameter;
+
+    return (0 == pthread_mutex_unlock((pthread_mutex_t *)mutex_id)) ? osOK : osErrorResource;
+}
+
+osStatus_t osMutexDelete(osMutexId_t mutex_id)
+{
+    if (NULL == mutex_id)
+        return osErrorParameter;
+
+    pthread_mutex_destroy((pthread_mutex_t *)mutex_id);
+    free(mutex_id);
+
+    return osOK;
+}
+
+//  ==== Semaphore Management Functions ====
+
+osSemaphoreId_t osSemaphoreNew(uint32_t max_count, uint32_t initial_count, const osSemaphoreAttr_t *attr)
+{
+    if ((0 == max_count) || (initial_count > max_count))
+        return NULL;
+
+    shim_semaphore_t *sem = (shim_semaphore_t *)calloc(1, sizeof(shim_semaphore_t));
+    if (NULL == sem)
+        return NULL;
+
+    pthread_mutex_init(&sem->lock, NULL);
+    _cond_init(&sem->cond);
+    sem->count = initial_count;
+    sem->max_count = max_count;
+
+    return (osSemaphoreId_t)sem;
+}
+
+osStatus_t osSemaphoreAcquire(osSemaphoreId_t semaphore_id, uint32_t timeout)
+{
+    shim_semaphore_t *sem = (shim_semaphore_t *)semaphore_id;
+
+    if (NULL == sem)
+        return osErrorParameter;
+
+    struct timespec deadline = _deadline(timeout);
+
+    pthread_mutex_lock(&sem->lock);
+
+    while (0 == sem->count)
+    {
+        if ((0 == timeout) || (false == _cond_wait(&sem->cond, &sem->lock, timeout, &deadline)))
+        {
+            if (0 < sem->count)
+                break;
+
+            pthread_mutex_unlock(&sem->lock);
+            return (0 == timeout) ? osErrorResource : osErrorTimeout;
+        }
+    }
+
+    sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+
+    return osOK;
+}
+
+osStatus_t osSemaphoreRelease(osSemaphoreId_t semaphore_id)
+{
+    shim_semaphore_t *sem = (shim_semaphore_t *)semaphore_id;
+    osStatus_t sts = osOK;
+
+    if (NULL == sem)
+        return osErrorParameter;
+
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max_count)
+    {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+    }
+    else
+    {
+        sts = osErrorResource;
+    }
+    pthread_mutex_unlock(&sem->lock);
+
+    return sts;
+}
+
+uint32_t osSemaphoreGetCount(osSemaphoreId_t semaphore_id)
+{
+    return (NULL != semaphore_id) ? ((shim_semaphore_t *)semaphore_id)->count : 0;
+}
+
+osStatus_t osSemaphoreDelete(osSemaphoreId_t semaphore_id)
+{
+    shim_semaphore_t *sem = (shim_semaphore_t *)semaphore_id;
+
+    if (NULL == sem)
+        return osErrorParameter;
+
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+
+    return osOK;
+}
+
+//  ==== Message Queue Management Functions ====
+
+osMessageQueueId_t osMessageQueueNew(uint32_t msg_count, uint32_t msg_size, const osMessageQueueAttr_t *attr)
+{
+    if ((0 == msg_count) || (0 == msg_size))
+        return NULL;
+
+    shim_msgq_t *mq = (shim_msgq_t *)calloc(1, sizeof(shim_msgq_t));
+    if (NULL == mq)
+        return NULL;
+
+    mq->prio = (uint8_t *)calloc(msg_count, sizeof(uint8_t));
+    mq->data = (uint8_t *)malloc((size_t)msg_count * msg_size);
+
+    if ((NULL == mq->prio) || (NULL == mq->data))
+    {
+        free(mq->prio);
+        free(mq->data);
+        free(mq);
+        return NULL;
+    }
+
+    pthread_mutex_init(&mq->lock, NULL);
+    _cond_init(&mq->not_empty);
+    _cond_init(&mq->not_full);
+    mq->msg_count = msg_count;
+    mq->msg_size = msg_size;
+
+    return (osMessageQueueId_t)mq;
+}
+
+static uint8_t *_msgq_slot(shim_msgq_t *mq, uint32_t pos)
+{
+    return mq->data + (size_t)((mq->head + pos) % mq->msg_count) * mq->msg_size;
+}
+
+osStatus_t osMessageQueuePut(osMessageQueueId_t mq_id, const void *msg_ptr, uint8_t msg_prio, uint32_t timeout)
+{
+    shim_msgq_t *mq = (shim_msgq_t *)mq_id;
+
+    if ((NULL == mq) || (NULL == msg_ptr))
+        return osErrorParameter;
+
+    struct timespec deadline = _deadline(timeout);
+
+    pthread_mutex_lock(&mq->lock);
+
+    while (mq->count == mq->msg_count)
+    {
+        if ((0 == timeout) || (false == _cond_wait(&mq->not_full, &mq->lock, timeout, &deadline)))
+        {
+            if (mq->count < mq->msg_count)
+                break;
+
+            pthread_mutex_unlock(&mq->lock);
+            return (0 == timeout) ? osErrorResource : osErrorTimeout;
+        }
+    }
+
+    // insert behind the last message of the same or higher priority
+    uint32_t pos = mq->count;
+    while ((0 < pos) && (mq->prio[(mq->head + pos - 1) % mq->msg_count] < msg_prio))
+    {
+        memcpy(_msgq_slot(mq, pos), _msgq_slot(mq, pos - 1), mq->msg_size);
+        mq->prio[(mq->head + pos) % mq->msg_count] = mq->prio[(mq->head + pos - 1) % mq->msg_count];
+        pos--;
+    }
+
+    memcpy(_msgq_slot(mq, pos), msg_ptr, mq->msg_size);
+    mq->prio[(mq->head + pos) % mq->msg_count] = msg_prio;
+    mq->count++;
+
+    pthread_cond_signal(&mq->not_empty);
+    pthread_mutex_unlock(&mq->lock);
+
+    return osOK;
+}
+
+osStatus_t osMessageQueueGet(osMessageQueueId_t mq_id, void *msg_ptr, uint8_t *msg_prio, uint32_t timeout)
+{
+    shim_msgq_t *mq = (shim_msgq_t *)mq_id;
+
+    if ((NULL == mq) || (NULL == msg_ptr))
+        return osErrorParameter;
+
+    struct timespec deadline = _deadline(timeout);
+
+    pthread_mutex_lock(&mq->lock);
+
+    while (0 == mq->count)
+    {
+        if ((0 == timeout) || (false == _cond_wait(&mq->not_empty, &mq->lock, timeout, &deadline)))
+        {
+            if (0 < mq->count)
+                break;
+
+            pthread_mutex_unlock(&mq->lock);
+            return (0 == timeout) ? osErrorResource : osErrorTimeout;
+        }
+    }
+
+    memcpy(msg_ptr, _msgq_slot(mq, 0), mq->msg_size);
+    if (NULL != msg_prio)
+        *msg_prio = mq->prio[mq->head];
+
+    mq->head = (mq->head + 1) % mq->msg_count;
+    mq->count--;
+
+    pthread_cond_signal(&mq->not_full);
+    pthread_mutex_unlock(&mq->lock);
+
+    return osOK;
+}
+
+uint32_t osMessageQueueGetCapacity(osMessageQueueId_t mq_id)
+{
+    return (NULL != mq_id) ? ((shim_msgq_t *)mq_id)->msg_count : 0;
+}
+
+uint32_t osMessageQueueGetMsgSize(osMessageQueueId_t mq_id)
+{
+    return (NULL != mq_id) ? ((shim_msgq_t *)mq_id)->msg_size : 0;
+}
+
+uint32_t osMessageQueueGetCount(osMessageQueueId_t mq_id)
+{
+    shim_msgq_t *mq = (shim_msgq_t *)mq_id;
+
+    if (NULL == mq)
+        return 0;
+
+    pthread_mutex_lock(&mq->lock);
+    uint32_t count = mq->count;
+    pthread_mutex_unlock(&mq->lock);
+
+    return count;
+}
+
+uint32_t osMessageQueueGetSpace(osMessageQueueId_t mq_id)
+{
+    return (NULL != mq_id) ? (((shim_msgq_t *)mq_id)->msg_count - osMessageQueueGetCount(mq_id)) : 0;
+}
+
+osStatus_t osMessageQueueReset(osMessageQueueId_t mq_id)
+{
+    shim_msgq_t *mq = (shim_msgq_t *)mq_id;
+
+    if (NULL == mq)
+        return osErrorParameter;
+
+    pthread_mutex_lock(&mq->lock);
+    mq->head = 0;
+    mq->count = 0;
+    pthread_cond_broadcast(&mq->not_full);
+    pthread_mutex_unlock(&mq->lock);
+
+    return osOK;
+}
+
+osStatus_t osMessageQueueDelete(osMessageQueueId_t mq_id)
+{
+    shim_msgq_t *mq = (shim_msgq_t *)mq_id;
+
+    if (NULL == mq)
+        return osErrorParameter;
+
+    pthread_mutex_destroy(&mq->lock);
+    pthread_cond_destroy(&mq->not_empty);
+    pthread_cond_destroy(&mq->not_full);
+    free(mq->prio);
+    free(mq->data);
+    free(mq);
+
+    return osOK;
+}
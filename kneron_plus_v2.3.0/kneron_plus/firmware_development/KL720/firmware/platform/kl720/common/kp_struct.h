@@ -14,6 +14,8 @@
 
 #define APP_PADDING_BYTES 28                            /**< Default padding size */
 #define MAX_INPUT_NODE_COUNT 5                          /**< Supported maximum count of the model input node */
+#define MAX_INFERENCE_LANE 4                            /**< Supported maximum number of inference lanes */
+#define MAX_INFERENCE_LANE_WEIGHT 1000                  /**< Maximum weight of an inference lane */
 
 #define KDP2_MAGIC_TYPE_COMMAND 0xAB67CD13              /**< Magic number for data check */
 #define KDP2_MAGIC_TYPE_INFERENCE 0x11FF22AA            /**< Magic number for data check */
@@ -135,6 +137,11 @@ enum KP_API_RETURN_CODE
     KP_FW_ERROR_POSIX_SPAWN_FAILED_121 = 121,
     KP_FW_ERROR_USB_SEND_FAILED_122 = 122,
     KP_FW_ERROR_USB_RECEIVE_FAILED_123 = 123,
+    KP_FW_ERROR_HANDLE_NOT_READY_124 = 124,
+    KP_FW_FIFOQ_ACCESS_FAILED_125 = 125,
+    KP_FW_FIFOQ_NOT_READY_126 = 126,
+    KP_FW_INFERENCE_DEADLINE_MISSED_136 = 136,
+    KP_FW_JPEG_DECODE_FAILED_137 = 137,
 
     /* ncpu error code (sync with ipc.h) */
     KP_FW_NCPU_ERR_BEGIN         = 200,
@@ -250,6 +257,7 @@ typedef enum
     KP_IMAGE_FORMAT_YCBCR422_Y0CRY1CB = 0x36,    /**< YCbCr422 (order: Y0CrY1Cb) 16bits */
     KP_IMAGE_FORMAT_YCBCR422_Y0CBY1CR = 0x37,    /**< YCbCr422 (order: Y0CbY1Cr) 16bits */
     KP_IMAGE_FORMAT_RAW8 = 0x20,                 /**< RAW 8bits */
+    KP_IMAGE_FORMAT_JPEG = 0x80,                 /**< JPEG bitstream, decoded on device (KL720 only) */
 } kp_image_format_t;
 
 /**
@@ -452,6 +460,7 @@ typedef enum
 typedef struct
 {
     bool enable_frame_drop;                 /**< enable this to keep inference non-blocking by dropping oldest and unprocessed frames */
+    bool enable_deadline_drop;              /**< enable this to drop frames which can not be inferenced before their deadlines */
 } __attribute__((aligned(4))) kp_inf_configuration_t;
 
 /**
@@ -487,6 +496,7 @@ typedef struct
 } __attribute__((packed, aligned(4))) kp_hw_pre_proc_info_t;
 
 #define MAX_CROP_BOX 4 /**< MAX crop count */
+#define MAX_CROP_BATCH_BOX 64 /**< MAX crop count of a crop batch inference */
 
 /**
  * @brief inference RAW descriptor for one image
@@ -716,7 +726,7 @@ typedef struct
     uint32_t magic_type;                    /**< must be 'KDP2_MAGIC_TYPE_XXXXXX' */
     uint32_t total_size;                    /**< total size of user-defined header data struct and data (image) */
     uint32_t job_id;                        /**< user-defined ID to synchronize with firmware side, must >= 1000 */
-    uint32_t status_code;                   /**< this field is valid only for result data, refer to KP_API_RETURN_CODE */
+    uint32_t status_code;                   /**< for result data, refer to KP_API_RETURN_CODE, for inference data, the tagged inference lane */
     uint32_t total_image;                   /**< total number of images for this inference */
     uint32_t image_index;                   /**< the index of the image in this transmission */
 } __attribute__((aligned(4))) kp_inference_header_stamp_t;
@@ -846,3 +856,55 @@ typedef struct
     uint32_t fifoq_result_buf_count;    /**< Input buffer count for FIFO queue, 0 if FIFO queue has not been set */
     uint32_t fifoq_result_buf_size;     /**< Input buffer size for FIFO queue, 0 if FIFO queue has not been set */
 } __attribute__((aligned(4))) kp_fifo_queue_config_t;
+
+/**
+ * @brief Describe DDR heap usage of a device
+ */
+typedef struct
+{
+    uint32_t heap_begin;                /**< Lowest address the heap can allocate, it is the end of models */
+    uint32_t heap_end;                  /**< End address of the heap (exclusive) */
+    uint32_t used_size;                 /**< Size in bytes of allocated blocks (FIFO queue buffers, system buffers, etc.) */
+    uint32_t free_size;                 /**< Size in bytes of free space */
+    uint32_t largest_free_size;         /**< Size in bytes of the largest free block, the largest allocation which can succeed */
+    uint32_t used_block_count;          /**< Number of allocated blocks */
+    uint32_t free_block_count;          /**< Number of free blocks */
+    uint32_t peak_used_size;            /**< High-water mark of used_size since boot */
+    uint32_t lowest_addr;               /**< High-water mark of the heap toward models, the lowest address ever allocated since boot */
+    uint32_t fragmentation;             /**< Fragmentation of free space in per mille, 1000 * (1 - largest_free_size / free_size) */
+} __attribute__((aligned(4))) kp_ddr_heap_stats_t;
+
+/**
+ * @brief Scheduling of the inference lanes of a device
+ *
+ * Images waiting in the FIFO queue of a device are inferenced lane by lane: lanes of a higher priority are always served first,
+ * lanes of the same priority share the device by their weights.
+ */
+typedef struct
+{
+    uint32_t priority[MAX_INFERENCE_LANE];         /**< Priority of each lane, 0 is the highest, default is the lane number */
+    uint32_t weight[MAX_INFERENCE_LANE];           /**< Share of each lane among lanes of the same priority, 1 ~ MAX_INFERENCE_LANE_WEIGHT, default is 1 */
+} __attribute__((aligned(4))) kp_inference_lane_config_t;
+
+/**
+ * @brief Describe the queue of an inference lane of a device, times are in micro-seconds
+ */
+typedef struct
+{
+    uint32_t depth;                     /**< Number of images waiting in this lane */
+    uint32_t peak_depth;                /**< High-water mark of depth */
+    uint32_t enqueued;                  /**< Number of images received into this lane */
+    uint32_t dequeued;                  /**< Number of images taken out of this lane for inference */
+    uint32_t dropped;                   /**< Number of images dropped from this lane to receive newer ones (droppable mode) */
+    uint32_t avg_wait_us;               /**< Average time an image waited in this lane before inference */
+    uint32_t max_wait_us;               /**< Longest time an image waited in this lane before inference */
+} __attribute__((aligned(4))) kp_inference_lane_stats_t;
+
+/**
+ * @brief Reason of an inference dropped for its deadline
+ */
+typedef enum
+{
+    KP_INFERENCE_DROP_EXPIRED = 1,      /**< the deadline passed while the image waited in the FIFO queue */
+    KP_INFERENCE_DROP_UNREACHABLE = 2,  /**< the measured inference time of the model exceeds the time left to the deadline */
+} kp_inference_drop_reason_t;
@@ -68,6 +68,35 @@ int kp_disconnect_devices(kp_device_group_t devices);
  */
 void kp_set_timeout(kp_device_group_t devices, int milliseconds);
 
+/**
+ * @brief To set how inference frames are distributed among devices of the device group.
+ *
+ * With KP_GROUP_SCHEDULING_LEAST_LOADED, kp_generic_image_inference_send() and kp_generic_data_inference_send() choose the device with the fewest frames in flight,
+ * and kp_generic_image_inference_receive() and kp_generic_data_inference_receive() return the result of whichever device finishes first,
+ * so results may come out of order, use 'inference_number' and 'device_index' of the result header to identify them.
+ *
+ * Note: the receive buffer size of the first receive call is used for every device.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] scheduling refer to kp_group_scheduling_t.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_set_group_scheduling(kp_device_group_t devices, kp_group_scheduling_t scheduling);
+
+/**
+ * @brief To set how kp_generic_image_inference_send() and kp_generic_data_inference_send() send each input node to the device.
+ *
+ * With KP_INFERENCE_SEND_MODE_SINGLE_TRANSFER, the inference header and the image of every input node are copied into a staging buffer and sent as one USB transfer,
+ * this costs a memory copy but saves one USB transaction per input node, which dominates the throughput of small models (ex. 224x224 classifiers).
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] send_mode refer to kp_inference_send_mode_t.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_set_inference_send_mode(kp_device_group_t devices, kp_inference_send_mode_t send_mode);
+
 /**
  * @brief reset the device in hardware mode or software mode.
  *
@@ -117,6 +146,8 @@ int kp_load_model(kp_device_group_t devices, void *nef_buf, int nef_size, kp_mod
 /**
  * @brief Similar to kp_load_model(), and it accepts file path instead of a buffer (must release model_desc by kp_release_model_nef_descriptor)
  *
+ * The file is memory-mapped and sent to devices directly from the mapping, so the NEF content is not copied into a heap buffer.
+ *
  * @param[in] devices a set of devices handle.
  * @param[in] file_path a buffer contains the content of NEF file.
  * @param[out] model_desc this parameter is output for describing the uploaded models.
@@ -125,6 +156,51 @@ int kp_load_model(kp_device_group_t devices, void *nef_buf, int nef_size, kp_mod
  */
 int kp_load_model_from_file(kp_device_group_t devices, const char *file_path, kp_model_nef_descriptor_t *model_desc);
 
+/**
+ * @brief Replace the loaded models in devices without rebooting devices (KL520/KL720 only), and return kp_model_nef_descriptor_t *model_desc (must release model_desc by kp_release_model_nef_descriptor)
+ *
+ * kp_load_model() reboots devices if models are loaded, this function keeps the FIFO queue set up by the first load and uploads the new models in place.
+ *
+ * The new NEF is parsed and checked before the loaded models are replaced, and devices check the new models fit in DDR before the loaded models are dropped, so an invalid NEF does not interrupt the loaded models (KP_FW_LOAD_MODEL_FAILED_104 if devices refuse it). Images not yet inferenced and results not yet received are dropped.
+ *
+ * Inference must not be running on the device group (including kp_pipeline_t) while the models are replaced.
+ *
+ * If the new models do not fit in the FIFO queue (input node number and raw output size), the FIFO queue is resized by kp_resize_fifo_queue() before the loaded models are replaced.
+ * The new models must fit in the DDR space before the FIFO queue buffers, otherwise use kp_load_model() to reboot and set up a new FIFO queue.
+ *
+ * If no model is loaded, it is the same as kp_load_model().
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] nef_buf a buffer contains the content of NEF file.
+ * @param[in] nef_size file size of the NEF.
+ * @param[out] model_desc this parameter is output for describing the uploaded models, it can be NULL.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h, KP_ERROR_FIFOQ_SETTING_FAILED_43 if the FIFO queue can not be resized for the new models.
+ */
+int kp_replace_model(kp_device_group_t devices, void *nef_buf, int nef_size, kp_model_nef_descriptor_t *model_desc);
+
+/**
+ * @brief Similar to kp_replace_model(), and it accepts file path instead of a buffer (must release model_desc by kp_release_model_nef_descriptor)
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] file_path a buffer contains the content of NEF file.
+ * @param[out] model_desc this parameter is output for describing the uploaded models, it can be NULL.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_replace_model_from_file(kp_device_group_t devices, const char *file_path, kp_model_nef_descriptor_t *model_desc);
+
+/**
+ * @brief Stop inference and unload models from devices without rebooting devices (KL520/KL720 only).
+ *
+ * Images not yet inferenced and results not yet received are dropped, the FIFO queue is kept for the next kp_load_model() or kp_replace_model().
+ *
+ * @param[in] devices a set of devices handle.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_unload_model(kp_device_group_t devices);
+
 /**
  * @brief upload encrypted models to multiple device through USB, and return kp_model_nef_descriptor_t *model_desc (must release model_desc by kp_release_model_nef_descriptor)
  *
@@ -232,6 +308,63 @@ int kp_install_driver_for_windows(kp_product_id_t device_pid);
  */
 int kp_store_ddr_manage_attr(kp_device_group_t devices, kp_ddr_manage_attr_t ddr_attr);
 
+/**
+ * @brief Replace the FIFO queue buffers of devices without rebooting devices (KL520/KL720 only).
+ *
+ * The old buffers are given back to the DDR heap of devices and new buffers are allocated, so the queues can follow the loaded models.
+ *
+ * Images not yet inferenced and results not yet received are dropped, inference must not be running on the device group (including kp_pipeline_t).
+ *
+ * If the new buffers can not be allocated, the old FIFO queue is kept.
+ *
+ * @param devices a set of devices handle.
+ * @param ddr_attr new FIFO queue attributes, the zero item keeps the current value and 'model_size' is ignored, the counts are at most 8
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h, KP_ERROR_FIFOQ_SETTING_FAILED_43 if the loaded models do not fit or devices refuse the new FIFO queue.
+ */
+int kp_resize_fifo_queue(kp_device_group_t devices, kp_ddr_manage_attr_t ddr_attr);
+
+/**
+ * @brief Get DDR heap usage statistics (KL520/KL720 only).
+ *
+ * The heap holds the FIFO queue buffers and the system buffers of the firmware, the statistics show the space left for larger models or buffers.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] dev_port_id specific device port id.
+ * @param[out] heap_stats return value of DDR heap statistics.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_get_ddr_heap_statistics(kp_device_group_t devices, int dev_port_id, kp_ddr_heap_stats_t *heap_stats);
+
+/**
+ * @brief Configure the inference lanes of the image FIFO queue (KL520/KL720 only).
+ *
+ * Images are sent to a lane by kp_generic_image_inference_send_to_lane(), all other inferences go to lane 0.
+ * The firmware always takes the next image from the non-empty lanes of the lowest 'priority' value,
+ * lanes of the same priority share the NPU in proportion to their 'weight'.
+ * When frame dropping is enabled and the queue is full, the oldest image of the lowest priority lane is dropped first.
+ *
+ * By default lane N has priority N and weight 1.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] lane_config priority and weight (1 ~ KP_MAX_INFERENCE_LANE_WEIGHT) of each lane.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h, KP_ERROR_INVALID_FIRMWARE_24 if the firmware does not support it.
+ */
+int kp_inference_configure_lanes(kp_device_group_t devices, kp_inference_lane_config_t *lane_config);
+
+/**
+ * @brief Get the statistics of the inference lanes (KL520/KL720 only).
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] dev_port_id specific device port id.
+ * @param[out] lane_stats return value of the statistics of each lane.
+ * @param[in] reset clear the counters after they are read.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_inference_get_lane_statistics(kp_device_group_t devices, int dev_port_id, kp_inference_lane_stats_t lane_stats[KP_MAX_INFERENCE_LANE], bool reset);
+
 /**
  * @brief Translate error code to char string.
  *
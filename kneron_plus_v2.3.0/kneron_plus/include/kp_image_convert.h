@@ -0,0 +1,128 @@
+/**
+ * @file        kp_image_convert.h
+ * @brief       Kneron PLUS host image conversion for image inference
+ *
+ * kp_generic_image_inference_send() takes images in the formats of kp_image_format_t, while images from files and cameras
+ * (ex. BMP files, OpenCV cv::Mat) are usually 3 bytes per pixel in B, G, R order.
+ * An image conversion handle converts such images into:
+ *   - KP_IMAGE_FORMAT_RGB565, KP_IMAGE_FORMAT_RGBA8888 (alpha is 0)
+ *   - KP_IMAGE_FORMAT_YUYV and every KP_IMAGE_FORMAT_YCBCR422_* order, the width must be even
+ *   - KP_IMAGE_FORMAT_RAW8 (luma only)
+ *   - KP_IMAGE_FORMAT_YUV420 (planar Y, U, V), the width and height must be even
+ *
+ * YCbCr is full range BT.601 in 8-bit fixed point, the chroma of 2 (YCbCr422) or 2x2 (YUV420) pixels is averaged.
+ *
+ * The image can be resized (bilinear) in the same pass, ex. to the model input size, so a big camera frame is
+ * shrunk before it is converted and sent over USB. Give the size with the aspect ratio of the image to let the device
+ * pad it, the device pre-process maps the results back to the given size.
+ *
+ * Rows are converted with SIMD instructions of the host CPU (AVX2 or SSE4.1 on x86, NEON on ARM) if available,
+ * and the rows of a big image (ex. 4K) can be split over several threads.
+ * The converted image is written to a buffer of the caller, kp_image_convert_alloc_buffer() gives one aligned for the SIMD
+ * instructions, but any buffer works.
+ *
+ * @version     0.1
+ * @date        2024-06-10
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kp_struct.h"
+
+#define KP_IMAGE_CONVERT_BUFFER_ALIGN 64    /**< alignment of buffers from kp_image_convert_alloc_buffer() */
+
+/**
+ * @brief pixel formats of the source image, 3 bytes per pixel.
+ */
+typedef enum
+{
+    KP_IMAGE_CONVERT_SRC_BGR888 = 0,        /**< B, G, R order, ex. BMP files and OpenCV cv::Mat */
+    KP_IMAGE_CONVERT_SRC_RGB888 = 1,        /**< R, G, B order */
+} kp_image_convert_src_format_t;
+
+/**
+ * @brief a handle of host image conversion.
+ */
+typedef struct kp_image_convert_s *kp_image_convert_t;
+
+/**
+ * @brief host image conversion configuration
+ */
+typedef struct
+{
+    int num_thread;                         /**< number of threads splitting one image by rows (the caller thread included), 0 for default (1) */
+} kp_image_convert_config_t;
+
+/**
+ * @brief Create a host image conversion handle.
+ *
+ * @param[in] config refer to kp_image_convert_config_t, NULL for defaults.
+ * @param[out] error_code refer to KP_API_RETURN_CODE in kp_struct.h, it can be NULL.
+ *
+ * @return the image conversion handle, NULL if failed.
+ */
+kp_image_convert_t kp_image_convert_create(kp_image_convert_config_t *config, int *error_code);
+
+/**
+ * @brief Get the size of an image in a format, which is the buffer size needed by kp_image_convert_run().
+ *
+ * @param[in] format format of the image.
+ * @param[in] width image width.
+ * @param[in] height image height.
+ *
+ * @return size in bytes, 0 if the format is not supported or the width/height is not allowed by the format.
+ */
+uint32_t kp_image_convert_get_buffer_size(kp_image_format_t format, uint32_t width, uint32_t height);
+
+/**
+ * @brief Convert an image, and resize it if the destination size is different.
+ *
+ * The handle can not be used by two threads at the same time, create one handle per thread if needed.
+ * Resize tables are kept from the last call, so images of the same size are faster.
+ *
+ * @param[in] convert the image conversion handle.
+ * @param[in] src the first (top) row of the source image.
+ * @param[in] src_width source image width.
+ * @param[in] src_height source image height.
+ * @param[in] src_stride bytes from a row to the next one, 0 for packed rows (src_width * 3),
+ *                       negative for bottom-up images (ex. BMP pixel data, with 'src' pointing to the last row in memory).
+ * @param[in] src_format refer to kp_image_convert_src_format_t.
+ * @param[out] dst_buf buffer of the converted image, it can be given to 'image_buffer' of kp_generic_input_node_image_t.
+ * @param[in] dst_width width of the converted image.
+ * @param[in] dst_height height of the converted image.
+ * @param[in] dst_format format of the converted image, refer to the formats listed in kp_image_convert.h.
+ * @param[in] buf_size size of dst_buf, refer to kp_image_convert_get_buffer_size().
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_image_convert_run(kp_image_convert_t convert, const uint8_t *src, uint32_t src_width, uint32_t src_height, int32_t src_stride,
+                         kp_image_convert_src_format_t src_format, uint8_t *dst_buf, uint32_t dst_width, uint32_t dst_height,
+                         kp_image_format_t dst_format, uint32_t buf_size);
+
+/**
+ * @brief Stop the threads and free the image conversion handle.
+ *
+ * @param[in] convert the image conversion handle.
+ */
+void kp_image_convert_destroy(kp_image_convert_t convert);
+
+/**
+ * @brief Allocate a buffer aligned to KP_IMAGE_CONVERT_BUFFER_ALIGN bytes.
+ *
+ * @param[in] size size in bytes.
+ *
+ * @return the buffer, NULL if failed, it must be freed by kp_image_convert_free_buffer().
+ */
+void *kp_image_convert_alloc_buffer(uint32_t size);
+
+/**
+ * @brief Free a buffer from kp_image_convert_alloc_buffer().
+ *
+ * @param[in] buf the buffer, it can be NULL.
+ */
+void kp_image_convert_free_buffer(void *buf);
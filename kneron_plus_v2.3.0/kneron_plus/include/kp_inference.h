@@ -27,6 +27,24 @@
  */
 int kp_inference_configure(kp_device_group_t devices, kp_inf_configuration_t *conf);
 
+/**
+ * @brief Enable or disable result coalescing of generic inference.
+ *
+ * When enabled, the device packs results which are already done and waiting in its result queue into one USB transfer, up to 'max_transfer_size' bytes.
+ * kp_generic_image_inference_receive() and kp_generic_data_inference_receive() split them back apart and still return one result per call.
+ * This saves one USB transaction per result, which limits the frame rate of models with small outputs (ex. classifiers).
+ * A result never waits for the next one, so latency is not increased.
+ *
+ * The device reserves memory for the first non-zero 'max_transfer_size' and keeps it until reboot, a larger value later fails.
+ * Results of customized inference are never coalesced.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] max_transfer_size maximum bytes of one coalesced transfer, rounded up to KB, 0 to disable (default).
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h, KP_ERROR_INVALID_FIRMWARE_24 if the firmware does not support it.
+ */
+int kp_inference_set_result_coalescing(kp_device_group_t devices, uint32_t max_transfer_size);
+
 /**
  * @brief Generic raw inference with multiple input images send.
  *
@@ -36,6 +54,12 @@ int kp_inference_configure(kp_device_group_t devices, kp_inf_configuration_t *co
  *
  * In addition, to have better performance, users can issue multiple kp_generic_image_inference_send() then start to receive results through kp_generic_image_inference_receive().
  *
+ * On KL720 an image can be a JPEG bitstream (KP_IMAGE_FORMAT_JPEG) of 'image_buffer_size' bytes, 'width' and 'height' must be the JPEG image size.
+ * The device decodes it into the rest of the FIFO queue buffer which holds the bitstream, so the input buffer size of kp_store_ddr_manage_attr() (or the automatic one)
+ * must also hold the decoded image (width x height x 2 bytes), otherwise KP_ERROR_SEND_DATA_TOO_LARGE_15 is returned.
+ *
+ * BGR888/RGB888 images (ex. BMP files, OpenCV cv::Mat) can be converted to the image formats, and shrunk to reduce the USB transfer, by kp_image_convert_run() in kp_image_convert.h.
+ *
  * @param[in] devices a set of devices handle.
  * @param[in] inf_data inference data of needed parameters for performing inference including image buffer size, model id.
  *
@@ -43,6 +67,67 @@ int kp_inference_configure(kp_device_group_t devices, kp_inf_configuration_t *co
  */
 int kp_generic_image_inference_send(kp_device_group_t devices, kp_generic_image_inference_desc_t *inf_data);
 
+/**
+ * @brief Generic raw inference send into an inference lane of the device FIFO queue (KL520/KL720 only).
+ *
+ * Same as kp_generic_image_inference_send(), but the images wait in the given lane, which is scheduled by kp_inference_configure_lanes().
+ * kp_generic_image_inference_send() uses lane 0.
+ *
+ * @note Results of different lanes may come back in a different order than they are sent, use 'inference_number' to match them.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] inf_data inference data of needed parameters for performing inference including image buffer size, model id.
+ * @param[in] lane inference lane, 0 ~ KP_MAX_INFERENCE_LANE - 1.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_generic_image_inference_send_to_lane(kp_device_group_t devices, kp_generic_image_inference_desc_t *inf_data, uint32_t lane);
+
+/**
+ * @brief Get the current time in micro-seconds of the clock used by inference deadlines.
+ *
+ * @return monotonic time in micro-seconds, it is not related to the wall clock.
+ */
+uint64_t kp_inference_get_time_us(void);
+
+/**
+ * @brief Generic raw inference send with a deadline into an inference lane (KL520/KL720 only).
+ *
+ * Same as kp_generic_image_inference_send_to_lane(), and the time left to the deadline goes with the first image.
+ * With 'enable_deadline_drop' of kp_inference_configure(), the device drops the frame instead of inferencing it if the deadline
+ *   has passed while the frame waited in the FIFO queue, or if the measured inference time of the model does not fit the time left.
+ * kp_generic_image_inference_receive() then returns KP_FW_INFERENCE_DEADLINE_MISSED_136 for the frame, with its 'inference_number'.
+ * So a frame never disappears silently and a late frame does not delay the frames after it.
+ *
+ * Without 'enable_deadline_drop' the frame is always inferenced, and the deadline is only counted by kp_inference_get_deadline_statistics().
+ *
+ * @note The deadline drop replaces 'enable_frame_drop', the device no longer drops the oldest frame when its FIFO queue is full.
+ * @note The image buffer size of the FIFO queue must also hold a 16-byte deadline trailer after the first image.
+ * @note The first image always goes in one USB transfer with its header and the trailer, like KP_INFERENCE_SEND_MODE_SINGLE_TRANSFER.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] inf_data inference data of needed parameters for performing inference including image buffer size, model id.
+ * @param[in] lane inference lane, 0 ~ KP_MAX_INFERENCE_LANE - 1.
+ * @param[in] deadline capture time and deadline of the frame, by kp_inference_get_time_us().
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_generic_image_inference_send_with_deadline(kp_device_group_t devices, kp_generic_image_inference_desc_t *inf_data, uint32_t lane, kp_inference_deadline_t *deadline);
+
+/**
+ * @brief Get drop and latency counters of the frames sent with a deadline to an inference lane.
+ *
+ * Latency is from 'capture_time_us' of the frame to its result received by kp_generic_image_inference_receive().
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] lane inference lane, 0 ~ KP_MAX_INFERENCE_LANE - 1.
+ * @param[out] stats refer to kp_inference_deadline_stats_t.
+ * @param[in] reset clear the counters after they are read.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_inference_get_deadline_statistics(kp_device_group_t devices, uint32_t lane, kp_inference_deadline_stats_t *stats, bool reset);
+
 /**
  * @brief
  *
@@ -64,6 +149,8 @@ int kp_generic_image_inference_receive(kp_device_group_t devices, kp_generic_ima
  *
  * In addition, to have better performance, users can issue multiple kp_generic_data_inference_send() then start to receive results through kp_generic_data_inference_receive().
  *
+ * Input node data must be normalized, quantized and in NPU data layout, kp_preproc_run() in kp_preproc.h prepares it from an image.
+ *
  * @param[in] devices a set of devices handle.
  * @param[in] inf_data inference data of needed parameters for performing inference including image buffer size, model id.
  *
@@ -87,6 +174,63 @@ int kp_generic_data_inference_send(kp_device_group_t devices, kp_generic_data_in
  */
 int kp_generic_data_inference_receive(kp_device_group_t devices, kp_generic_data_inference_result_header_t *output_desc, uint8_t *raw_out_buffer, uint32_t buf_size);
 
+/**
+ * @brief Generic raw inference on a batch of crops of one image send.
+ *
+ * This is to run one model on up to MAX_CROP_BATCH_BOX crops of one image, ex. the faces or plates found by a detector.
+ * The device pre-processes the next crop while NPU runs the current one, and sends the RAW outputs of all crops back in one result.
+ * The model must have one input node.
+ *
+ * All crop outputs have to fit in one result buffer of the device FIFO queue, refer to kp_generic_crop_batch_inference_get_result_size()
+ * and set a large enough 'result_buffer_size' with kp_store_ddr_manage_attr() before loading the model.
+ *
+ * When this is performed, user can issue kp_generic_crop_batch_inference_receive() to get the result.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] inf_data inference data of needed parameters for performing inference including image buffer, crop boxes and model id.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h, KP_ERROR_SEND_DATA_TOO_LARGE_15 if the image or the crop outputs do not fit in the FIFO queue buffers.
+ */
+int kp_generic_crop_batch_inference_send(kp_device_group_t devices, kp_generic_crop_batch_inference_desc_t *inf_data);
+
+/**
+ * @brief Receive the RAW outputs of all crops sent by one kp_generic_crop_batch_inference_send().
+ *
+ * Use kp_generic_crop_batch_inference_get_crop_result() to get the output of each crop.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[out] output_desc refer to kp_generic_crop_batch_inference_result_header_t for describing some information of received data.
+ * @param[out] raw_out_buffer a user-allocated buffer for receiving the RAW data results, the needed buffer size can be known from kp_generic_crop_batch_inference_get_result_size().
+ * @param[in] buf_size size of raw_out_buffer.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_generic_crop_batch_inference_receive(kp_device_group_t devices, kp_generic_crop_batch_inference_result_header_t *output_desc, uint8_t *raw_out_buffer, uint32_t buf_size);
+
+/**
+ * @brief Get the output of one crop from the buffer of kp_generic_crop_batch_inference_receive().
+ *
+ * @param[in] crop_idx index of the crop in the 'crop_list' sent, starts from 0.
+ * @param[in] raw_out_buffer the RAW output buffer, it should come from kp_generic_crop_batch_inference_receive().
+ * @param[out] crop_desc information of the crop output, as kp_generic_image_inference_receive() gives for one crop, except 'device_index' which is in the batch header.
+ * @param[out] crop_raw_out the RAW output of the crop inside 'raw_out_buffer', it can be given to kp_generic_inference_retrieve_float_node() and the other retrieve functions.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h, the inference status of this crop.
+ */
+int kp_generic_crop_batch_inference_get_crop_result(uint32_t crop_idx, uint8_t *raw_out_buffer, kp_generic_image_inference_result_header_t *crop_desc, uint8_t **crop_raw_out);
+
+/**
+ * @brief Get the size of the RAW output of a crop batch.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] model_id target inference model ID.
+ * @param[in] crop_count number of crops.
+ * @param[out] result_size needed size of 'raw_out_buffer' of kp_generic_crop_batch_inference_receive(), also the needed 'result_buffer_size' of the FIFO queue.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_generic_crop_batch_inference_get_result_size(kp_device_group_t devices, uint32_t model_id, uint32_t crop_count, uint32_t *result_size);
+
 /**
  * @brief Retrieve single node output data from raw output buffer.
  *
@@ -127,6 +271,83 @@ kp_inf_fixed_node_output_t *kp_generic_inference_retrieve_fixed_node(uint32_t no
  */
 kp_inf_float_node_output_t *kp_generic_inference_retrieve_float_node(uint32_t node_idx, uint8_t *raw_out_buffer, kp_channel_ordering_t ordering);
 
+/**
+ * @brief Get the buffer size needed by kp_generic_inference_retrieve_float_node_to_buffer().
+ *
+ * @param[in] node_idx wanted output node index, starts from 0.
+ * @param[in] raw_out_buffer the RAW output buffer, it should come from kp_generic_raw_inference_receive().
+ * @param[out] buf_size size in bytes of kp_inf_float_node_output_t including its floating-point values.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_generic_inference_get_float_node_size(uint32_t node_idx, uint8_t *raw_out_buffer, uint32_t *buf_size);
+
+/**
+ * @brief Retrieve single node output data from raw output buffer into a user provided buffer.
+ *
+ * This is the same as kp_generic_inference_retrieve_float_node() but without memory allocation, so the buffer can be reused for every frame.
+ *
+ * The conversion uses SIMD instructions of the host CPU (SSE2/AVX2 or NEON) if available.
+ *
+ * @param[in] node_idx wanted output node index, starts from 0.
+ * @param[in] raw_out_buffer the RAW output buffer, it should come from kp_generic_raw_inference_receive().
+ * @param[in] ordering the RAW output channel ordering
+ * @param[out] float_node_output user provided buffer to store the floating-point values of this node.
+ * @param[in] buf_size size in bytes of float_node_output, refer to kp_generic_inference_get_float_node_size().
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_generic_inference_retrieve_float_node_to_buffer(uint32_t node_idx, uint8_t *raw_out_buffer, kp_channel_ordering_t ordering,
+                                                        kp_inf_float_node_output_t *float_node_output, uint32_t buf_size);
+
+/**
+ * @brief Get the channel of the maximum value at every pixel of a node, e.g. the class map of a segmentation model.
+ *
+ * Values are compared in fixed-point in the device data layout (16W1C8B, 1W16C8B or 8W1C16B), the node is not converted to floating-point.
+ *
+ * @param[in] node_idx wanted output node index, starts from 0.
+ * @param[in] raw_out_buffer the RAW output buffer, it should come from kp_generic_raw_inference_receive().
+ * @param[out] class_map user provided buffer, class_map[h * width + w] is the channel of the maximum value at (h, w), the lowest channel on ties.
+ * @param[out] score_map user provided buffer of the maximum values in floating-point in the same order, it can be NULL.
+ * @param[in] map_size number of entries of class_map (and score_map), at least node height x node width.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_generic_inference_retrieve_node_argmax(uint32_t node_idx, uint8_t *raw_out_buffer, uint16_t *class_map, float *score_map, uint32_t map_size);
+
+/**
+ * @brief Get the k largest values of a node, e.g. the top-k classes of a classification model.
+ *
+ * Values are selected in fixed-point in the device data layout, only the selected values are converted to floating-point.
+ *
+ * @param[in] node_idx wanted output node index, starts from 0.
+ * @param[in] raw_out_buffer the RAW output buffer, it should come from kp_generic_raw_inference_receive().
+ * @param[in] k number of wanted values.
+ * @param[out] elements user provided array of k elements, sorted by value in descending order (then by channel, row and column).
+ * @param[out] num_element number of stored elements, k or the number of values of the node if it is smaller.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_generic_inference_retrieve_node_top_k(uint32_t node_idx, uint8_t *raw_out_buffer, uint32_t k, kp_inf_node_element_t *elements, uint32_t *num_element);
+
+/**
+ * @brief Get the values of a node which are not less than a threshold, e.g. score candidates of a detection model.
+ *
+ * The threshold is quantized with the radix and scale of the node, so values are compared in fixed-point in the device data layout
+ * and only the values passing the threshold are converted to floating-point.
+ *
+ * @param[in] node_idx wanted output node index, starts from 0.
+ * @param[in] raw_out_buffer the RAW output buffer, it should come from kp_generic_raw_inference_receive().
+ * @param[in] threshold minimum floating-point value.
+ * @param[out] elements user provided array of max_element elements, in the order of the device memory.
+ * @param[in] max_element size of the 'elements' array.
+ * @param[out] num_element number of values passing the threshold, only the first 'max_element' of them are stored if it is larger.
+ *
+ * @return int refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_generic_inference_retrieve_node_threshold(uint32_t node_idx, uint8_t *raw_out_buffer, float threshold,
+                                                 kp_inf_node_element_t *elements, uint32_t max_element, uint32_t *num_element);
+
 /**
  * @brief send image for age gender inference
  *
@@ -0,0 +1,141 @@
+/**
+ * @file        kp_pipeline.h
+ * @brief       Kneron PLUS pipelined inference executor
+ *
+ * The pipeline runs generic image inference as stages connected by bounded queues:
+ *
+ *   kp_pipeline_submit() -> pre-process -> send -> receive -> float conversion + post-process -> complete callback or kp_pipeline_get_frame()
+ *
+ * Pre-process, float conversion and post-process run on a pool of worker threads, send and receive run on their own threads,
+ * so the host CPU work of one frame overlaps with the NPU work of others.
+ *
+ * The number of frames in devices is limited by the FIFO queue input buffers of devices ('ddr_attr.input_buffer_count'),
+ * and the number of frames in the pipeline is limited by 'num_frame', kp_pipeline_submit() blocks if all frames are in use.
+ *
+ * Note: crop inference (more than one result per frame) and frame drop (kp_inf_configuration_t) are not supported.
+ *
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kp_struct.h"
+
+/**
+ * @brief a handle of a pipeline.
+ */
+typedef struct kp_pipeline_s *kp_pipeline_t;
+
+/**
+ * @brief a frame going through the pipeline, frames are owned by the pipeline and reused.
+ */
+typedef struct
+{
+    void *user_data;                                            /**< user data given to kp_pipeline_submit(), the pipeline does not touch it */
+    int status;                                                 /**< KP_SUCCESS, or the error code of the stage where the frame failed */
+    kp_generic_image_inference_desc_t inf_desc;                 /**< inference descriptor, 'model_id' and 'inference_number' are set by the pipeline */
+    kp_generic_image_inference_result_header_t result_header;   /**< inference result header */
+    uint8_t *raw_out_buffer;                                    /**< RAW output buffer */
+    uint32_t num_float_node;                                    /**< number of output nodes in float_node_list, 0 if 'convert_to_float' is disabled */
+    kp_inf_float_node_output_t **float_node_list;               /**< floating-point output nodes */
+    void *post_proc_result;                                     /**< free to be used by the post-process callback to pass its result */
+} kp_pipeline_frame_t;
+
+/**
+ * @brief pre-process callback, it prepares 'inf_desc' of the frame (ex. capture and resize an image), runs on a worker thread.
+ *
+ * Image buffers referenced by 'inf_desc' must be valid until the frame is completed.
+ *
+ * @return KP_SUCCESS to send the frame, otherwise the frame is completed with this error code.
+ */
+typedef int (*kp_pipeline_pre_process_callback_t)(kp_pipeline_frame_t *frame, void *user_arg);
+
+/**
+ * @brief post-process callback, it runs on a worker thread after the float conversion.
+ *
+ * @return KP_SUCCESS or an error code which is stored to 'status' of the frame.
+ */
+typedef int (*kp_pipeline_post_process_callback_t)(kp_pipeline_frame_t *frame, void *user_arg);
+
+/**
+ * @brief complete callback, it runs on a worker thread (or send/receive thread if the frame failed there), the frame is reused after it returns.
+ */
+typedef void (*kp_pipeline_complete_callback_t)(kp_pipeline_frame_t *frame, void *user_arg);
+
+/**
+ * @brief pipeline configuration
+ */
+typedef struct
+{
+    uint32_t model_id;                                      /**< target inference model ID */
+    bool convert_to_float;                                  /**< convert every output node to floating-point before post-process */
+    kp_channel_ordering_t channel_ordering;                 /**< channel ordering of floating-point output nodes */
+    int num_frame;                                          /**< number of frames in the pipeline, 0 for default (8) */
+    int num_worker;                                         /**< number of worker threads for pre-process, float conversion and post-process, 0 for default (2) */
+    int max_frame_in_device;                                /**< number of frames sent but not received, 0 to derive it from 'ddr_attr.input_buffer_count' of the device group */
+    kp_pipeline_pre_process_callback_t pre_process;         /**< NULL if 'inf_desc' is given to kp_pipeline_submit() */
+    kp_pipeline_post_process_callback_t post_process;       /**< NULL if not needed */
+    kp_pipeline_complete_callback_t complete;               /**< NULL to get completed frames by kp_pipeline_get_frame() */
+    void *user_arg;                                         /**< passed to all callbacks */
+} kp_pipeline_config_t;
+
+/**
+ * @brief Create a pipeline and start its threads.
+ *
+ * The model must be loaded, and the device group must not be used by other inference functions while the pipeline exists.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] config refer to kp_pipeline_config_t.
+ * @param[out] error_code refer to KP_API_RETURN_CODE in kp_struct.h, it can be NULL.
+ *
+ * @return the pipeline handle, NULL if failed.
+ */
+kp_pipeline_t kp_pipeline_create(kp_device_group_t devices, kp_pipeline_config_t *config, int *error_code);
+
+/**
+ * @brief Submit a frame to the pipeline, it blocks if all frames are in use.
+ *
+ * @param[in] pipeline the pipeline handle.
+ * @param[in] inf_desc inference descriptor to be copied into the frame, it can be NULL if 'pre_process' is set.
+ * @param[in] user_data user data of the frame.
+ * @param[in] timeout timeout in milliseconds, 0 means blocking wait.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h, KP_ERROR_PIPELINE_TIMEOUT_50 if no frame is available in time.
+ */
+int kp_pipeline_submit(kp_pipeline_t pipeline, kp_generic_image_inference_desc_t *inf_desc, void *user_data, int timeout);
+
+/**
+ * @brief Get a completed frame, only if 'complete' callback is not set. Frames are completed in any order.
+ *
+ * @param[in] pipeline the pipeline handle.
+ * @param[out] frame the completed frame, it must be returned by kp_pipeline_release_frame().
+ * @param[in] timeout timeout in milliseconds, 0 means blocking wait.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h, KP_ERROR_PIPELINE_TIMEOUT_50 if no frame is completed in time.
+ */
+int kp_pipeline_get_frame(kp_pipeline_t pipeline, kp_pipeline_frame_t **frame, int timeout);
+
+/**
+ * @brief Return a frame got by kp_pipeline_get_frame() to the pipeline.
+ *
+ * @param[in] pipeline the pipeline handle.
+ * @param[in] frame the frame.
+ */
+void kp_pipeline_release_frame(kp_pipeline_t pipeline, kp_pipeline_frame_t *frame);
+
+/**
+ * @brief Wait for all submitted frames to be completed, then stop threads and free the pipeline.
+ *
+ * Frames not yet got by kp_pipeline_get_frame() are dropped. Do not call it from pipeline callbacks.
+ *
+ * @param[in] pipeline the pipeline handle.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_pipeline_destroy(kp_pipeline_t pipeline);
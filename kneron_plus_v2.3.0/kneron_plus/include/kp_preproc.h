@@ -0,0 +1,97 @@
+/**
+ * @file        kp_preproc.h
+ * @brief       Kneron PLUS host pre-processing for bypass pre-process data inference
+ *
+ * kp_generic_data_inference_send() takes input node data which is already normalized, quantized and in NPU data layout.
+ * A pre-process handle prepares such data from an image for one input node of a model:
+ *
+ *   image -> resize (bilinear) + letterbox -> normalization -> quantization (radix/scale of the input node) -> NPU data layout
+ *
+ * All steps are done row by row in one pass over the output with SIMD instructions of the host CPU (SSE2 or NEON) if available,
+ * and the rows of a big image can be split over several threads.
+ *
+ * Supported NPU data layouts of the input node:
+ *   - KP_MODEL_TENSOR_DATA_LAYOUT_4W4C8B:  KL520 models in HxCxW order with width aligned to 16, other models in CxHxW order with width aligned to 4
+ *   - KP_MODEL_TENSOR_DATA_LAYOUT_1W16C8B: CxHxW order, 16 bytes per pixel
+ *   - KP_MODEL_TENSOR_DATA_LAYOUT_16W1C8B: CxHxW order, width aligned to 16
+ *
+ * Padded areas get the quantized value 0, like the hardware pre-process of image inference.
+ *
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kp_struct.h"
+
+/**
+ * @brief a handle of host pre-processing for one input node.
+ */
+typedef struct kp_preproc_s *kp_preproc_t;
+
+/**
+ * @brief host pre-processing configuration
+ */
+typedef struct
+{
+    kp_resize_mode_t resize_mode;           /**< KP_RESIZE_ENABLE to scale images to the model input size, KP_RESIZE_DISABLE if images are not bigger than the model input */
+    kp_padding_mode_t padding_mode;         /**< KP_PADDING_CORNER or KP_PADDING_SYMMETRIC to keep the aspect ratio (letterbox), KP_PADDING_DISABLE to stretch */
+    kp_normalize_mode_t normalize_mode;     /**< normalization the model is trained with, refer to kp_normalize_mode_t */
+    int num_thread;                         /**< number of threads splitting one image by rows (the caller thread included), 0 for default (1) */
+} kp_preproc_config_t;
+
+/**
+ * @brief Create a host pre-processing handle for one input node of a model.
+ *
+ * Everything needed is copied from the model descriptor, so it can be released after this call.
+ *
+ * @param[in] model the model descriptor, ex. '&devices->loaded_model_desc.models[i]'.
+ * @param[in] input_node_idx index of the input node of the model, starts from 0.
+ * @param[in] config refer to kp_preproc_config_t.
+ * @param[out] error_code refer to KP_API_RETURN_CODE in kp_struct.h, KP_ERROR_INVALID_MODEL_21 if the input node is not supported, it can be NULL.
+ *
+ * @return the pre-processing handle, NULL if failed.
+ */
+kp_preproc_t kp_preproc_create(kp_single_model_descriptor_t *model, uint32_t input_node_idx, kp_preproc_config_t *config, int *error_code);
+
+/**
+ * @brief Get the size of the input node data in NPU data layout, which is the buffer size needed by kp_preproc_run().
+ *
+ * @param[in] preproc the pre-processing handle.
+ *
+ * @return size in bytes.
+ */
+uint32_t kp_preproc_get_data_size(kp_preproc_t preproc);
+
+/**
+ * @brief Pre-process an image into input node data for kp_generic_data_inference_send().
+ *
+ * The handle can not be used by two threads at the same time, create one handle per thread if needed.
+ * Resize tables are kept from the last call, so images of the same size are faster.
+ *
+ * @param[in] preproc the pre-processing handle.
+ * @param[in] image image buffer, rows are packed without padding.
+ * @param[in] width image width.
+ * @param[in] height image height.
+ * @param[in] format KP_IMAGE_FORMAT_RGBA8888, KP_IMAGE_FORMAT_RGB565 or KP_IMAGE_FORMAT_RAW8 (gray, given to every channel).
+ * @param[out] data_buf buffer of the input node data, it can be given to 'input_node_data_list' of kp_generic_data_inference_desc_t.
+ * @param[in] buf_size size of data_buf, refer to kp_preproc_get_data_size().
+ * @param[out] pre_proc_info resize and padding of the image, to map results back to the image, it can be NULL.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h
+ */
+int kp_preproc_run(kp_preproc_t preproc, const uint8_t *image, uint32_t width, uint32_t height, kp_image_format_t format,
+                   uint8_t *data_buf, uint32_t buf_size, kp_hw_pre_proc_info_t *pre_proc_info);
+
+/**
+ * @brief Stop the threads and free the pre-processing handle.
+ *
+ * @param[in] preproc the pre-processing handle.
+ */
+void kp_preproc_destroy(kp_preproc_t preproc);
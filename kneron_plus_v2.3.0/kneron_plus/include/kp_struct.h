@@ -15,6 +15,8 @@
 #define APP_PADDING_BYTES 28                            /**< Default padding size */
 #define KP_MAX_INPUT_NODE_COUNT 5                       /**< Supported maximum number of the model input node (Note: The KL520, KL720, and KL630 only support maximum 5 inputs.) */
 #define KP_MAX_MODEL_COUNT 16                           /**< Supported maximum number of the models (Note: The KL520, KL720, and KL630 only support maximum 16 models.) */
+#define KP_MAX_INFERENCE_LANE 4                         /**< Supported maximum number of inference lanes of a device (KL520, KL720 only) */
+#define KP_MAX_INFERENCE_LANE_WEIGHT 1000               /**< Maximum weight of an inference lane */
 
 #define KDP2_MAGIC_TYPE_COMMAND 0xAB67CD13              /**< Magic number for data check */
 #define KDP2_MAGIC_TYPE_INFERENCE 0x11FF22AA            /**< Magic number for data check */
@@ -107,6 +109,8 @@ enum KP_API_RETURN_CODE
     KP_ERROR_ADJUST_DDR_HEAP_FAILED_46 = 46,
     KP_ERROR_DEVICE_NOT_ACCESSIBLE_47 = 47,
     KP_ERROR_INVALID_INPUT_NODE_DATA_NUMBER_48 = 48,
+    KP_ERROR_PIPELINE_STOPPED_49 = 49,
+    KP_ERROR_PIPELINE_TIMEOUT_50 = 50,
 
     KP_ERROR_OTHER_99 = 99,
 
@@ -147,6 +151,8 @@ enum KP_API_RETURN_CODE
     KP_FW_ERROR_GET_MSG_QUEUE_FAILED_133 = 133,
     KP_FW_ERROR_SEND_MSG_QUEUE_FAILED_134 = 134,
     KP_FW_ERROR_RECV_MSG_QUEUE_FAILED_135 = 135,
+    KP_FW_INFERENCE_DEADLINE_MISSED_136 = 136,
+    KP_FW_JPEG_DECODE_FAILED_137 = 137,
 
     /* ncpu error code (sync with ipc.h) */
     KP_FW_NCPU_ERR_BEGIN         = 200,
@@ -204,6 +210,24 @@ typedef enum
     KP_RESET_REBOOT_SYSTEM = 3, /**< Reboot entire system */
 } kp_reset_mode_t;
 
+/**
+ * @brief scheduling policy of inference frames among devices of a device group
+ */
+typedef enum
+{
+    KP_GROUP_SCHEDULING_ROUND_ROBIN = 0,    /**< Send to devices in turn, results are received in the same order as sent (default). */
+    KP_GROUP_SCHEDULING_LEAST_LOADED = 1,   /**< Send to the device with the fewest frames in flight, results are received from whichever device finishes first. */
+} kp_group_scheduling_t;
+
+/**
+ * @brief how a inference header and its image (or data) are sent to the device
+ */
+typedef enum
+{
+    KP_INFERENCE_SEND_MODE_SEPARATE = 0,          /**< Send header and image as two bulk transfers (default). */
+    KP_INFERENCE_SEND_MODE_SINGLE_TRANSFER = 1,   /**< Copy header and image into one buffer and send as one bulk transfer, it reduces per-frame USB overhead for small images. */
+} kp_inference_send_mode_t;
+
 /**
  * @brief enum for generic raw data channel ordering
  */
@@ -268,6 +292,7 @@ typedef enum
     KP_IMAGE_FORMAT_YCBCR422_Y0CBY1CR = 0x37,    /**< YCbCr422 (order: Y0CbY1Cr) 16bits */
     KP_IMAGE_FORMAT_RAW8 = 0x20,                 /**< RAW 8bits */
     KP_IMAGE_FORMAT_YUV420 = 0x70,               /**< YUV420 (planar) 12bits (KL630 only) */
+    KP_IMAGE_FORMAT_JPEG = 0x80,                 /**< JPEG bitstream, decoded on device (KL720 only) */
 } kp_image_format_t;
 
 /**
@@ -470,6 +495,7 @@ typedef enum
 typedef struct
 {
     bool enable_frame_drop;                 /**< enable this to keep inference non-blocking by dropping oldest and unprocessed frames */
+    bool enable_deadline_drop;              /**< enable this to drop frames which can not be inferenced before their deadlines (KL520, KL720 only), refer to kp_generic_image_inference_send_with_deadline() */
 } __attribute__((aligned(4))) kp_inf_configuration_t;
 
 /**
@@ -505,6 +531,7 @@ typedef struct
 } __attribute__((packed, aligned(4))) kp_hw_pre_proc_info_t;
 
 #define MAX_CROP_BOX 4 /**< MAX crop count */
+#define MAX_CROP_BATCH_BOX 64 /**< MAX crop count of a crop batch inference */
 
 /**
  * @brief inference RAW descriptor for one image
@@ -520,6 +547,7 @@ typedef struct
     uint32_t crop_count;                        /**< crop count */
     kp_inf_crop_box_t inf_crop[MAX_CROP_BOX];   /**< box information to crop */
     uint8_t *image_buffer;                      /**< image buffer */
+    uint32_t image_buffer_size;                 /**< size of the JPEG bitstream in image_buffer, only for KP_IMAGE_FORMAT_JPEG */
 } __attribute__((packed, aligned(4))) kp_generic_input_node_image_t;
 
 /**
@@ -554,8 +582,38 @@ typedef struct
     uint32_t product_id;                                                /**< product id, refer to kp_product_id_t */
     uint32_t num_pre_proc_info;                                         /**< number of pre_proc_info is available */
     kp_hw_pre_proc_info_t pre_proc_info[KP_MAX_INPUT_NODE_COUNT];       /**< hardware pre-process related value */
+    uint32_t device_index;                                              /**< index of the device in the device group which produced this result */
 } __attribute__((packed, aligned(4))) kp_generic_image_inference_result_header_t;
 
+/**
+ * @brief inference descriptor for a batch of crops on one image
+ */
+typedef struct
+{
+    uint32_t inference_number;                  /**< inference sequence number */
+    uint32_t model_id;                          /**< target inference model ID, the model must have one input node */
+    uint32_t width;                             /**< image width */
+    uint32_t height;                            /**< image height */
+    uint32_t resize_mode;                       /**< resize mode, refer to kp_resize_mode_t */
+    uint32_t padding_mode;                      /**< padding mode, refer to kp_padding_mode_t */
+    uint32_t image_format;                      /**< image format, refer to kp_image_format_t */
+    uint32_t normalize_mode;                    /**< inference normalization, refer to kp_normalize_mode_t */
+    uint32_t crop_count;                        /**< number of boxes in crop_list, 1 ~ MAX_CROP_BATCH_BOX */
+    kp_inf_crop_box_t *crop_list;               /**< boxes to crop, the model runs once on each of them */
+    uint8_t *image_buffer;                      /**< image buffer */
+} __attribute__((packed, aligned(4))) kp_generic_crop_batch_inference_desc_t;
+
+/**
+ * @brief inference RAW output descriptor for a batch of crops
+ */
+typedef struct
+{
+    uint32_t inference_number;                  /**< inference sequence number */
+    uint32_t crop_count;                        /**< number of crop results in the RAW output buffer */
+    uint32_t product_id;                        /**< product id, refer to kp_product_id_t */
+    uint32_t device_index;                      /**< index of the device in the device group which produced this result */
+} __attribute__((packed, aligned(4))) kp_generic_crop_batch_inference_result_header_t;
+
 /**
  * @brief inference descriptor for multiple input images bypass pre-processing
  */
@@ -576,6 +634,7 @@ typedef struct
     uint32_t crop_number;                   /**< crop box sequence number */
     uint32_t num_output_node;               /**< total number of output nodes */
     uint32_t product_id;                    /**< product id, refer to kp_product_id_t */
+    uint32_t device_index;                  /**< index of the device in the device group which produced this result */
 } __attribute__((packed, aligned(4))) kp_generic_data_inference_result_header_t;
 
 /**
@@ -639,6 +698,17 @@ typedef struct
     float data[];                           /**< array of floating-point values */
 } __attribute__((aligned(4))) kp_inf_float_node_output_t;
 
+/**
+ * @brief one element of an output node picked in fixed-point domain (top-k or threshold), only its value is converted to floating-point
+ */
+typedef struct
+{
+    uint32_t channel;                       /**< channel index of the element */
+    uint32_t row;                           /**< row (height) index of the element */
+    uint32_t col;                           /**< column (width) index of the element */
+    float value;                            /**< floating-point value of the element */
+} __attribute__((aligned(4))) kp_inf_node_element_t;
+
 /**
  * @brief describe a bounding box
  */
@@ -749,7 +819,7 @@ typedef struct
     uint32_t magic_type;                    /**< must be 'KDP2_MAGIC_TYPE_XXXXXX' */
     uint32_t total_size;                    /**< total size of user-defined header data struct and data (image) */
     uint32_t job_id;                        /**< user-defined ID to synchronize with firmware side, must >= 1000 */
-    uint32_t status_code;                   /**< this field is valid only for result data, refer to KP_API_RETURN_CODE */
+    uint32_t status_code;                   /**< for result data, refer to KP_API_RETURN_CODE, for inference data, the tagged inference lane */
     uint32_t total_image;                   /**< total number of images for this inference */
     uint32_t image_index;                   /**< the index of the image in this transmission */
 } __attribute__((aligned(4))) kp_inference_header_stamp_t;
@@ -899,3 +969,78 @@ typedef struct
     uint32_t fifoq_result_buf_count;    /**< Input buffer count for FIFO queue, 0 if FIFO queue has not been set */
     uint32_t fifoq_result_buf_size;     /**< Input buffer size for FIFO queue, 0 if FIFO queue has not been set */
 } __attribute__((aligned(4))) kp_fifo_queue_config_t;
+
+/**
+ * @brief Describe DDR heap usage of a device
+ */
+typedef struct
+{
+    uint32_t heap_begin;                /**< Lowest address the heap can allocate, it is the end of models */
+    uint32_t heap_end;                  /**< End address of the heap (exclusive) */
+    uint32_t used_size;                 /**< Size in bytes of allocated blocks (FIFO queue buffers, system buffers, etc.) */
+    uint32_t free_size;                 /**< Size in bytes of free space */
+    uint32_t largest_free_size;         /**< Size in bytes of the largest free block, the largest allocation which can succeed */
+    uint32_t used_block_count;          /**< Number of allocated blocks */
+    uint32_t free_block_count;          /**< Number of free blocks */
+    uint32_t peak_used_size;            /**< High-water mark of used_size since boot */
+    uint32_t lowest_addr;               /**< High-water mark of the heap toward models, the lowest address ever allocated since boot */
+    uint32_t fragmentation;             /**< Fragmentation of free space in per mille, 1000 * (1 - largest_free_size / free_size) */
+} __attribute__((aligned(4))) kp_ddr_heap_stats_t;
+
+/**
+ * @brief Scheduling of the inference lanes of a device
+ *
+ * Images waiting in the FIFO queue of a device are inferenced lane by lane: lanes of a higher priority are always served first,
+ * lanes of the same priority share the device by their weights.
+ */
+typedef struct
+{
+    uint32_t priority[KP_MAX_INFERENCE_LANE];         /**< Priority of each lane, 0 is the highest, default is the lane number */
+    uint32_t weight[KP_MAX_INFERENCE_LANE];           /**< Share of each lane among lanes of the same priority, 1 ~ KP_MAX_INFERENCE_LANE_WEIGHT, default is 1 */
+} __attribute__((aligned(4))) kp_inference_lane_config_t;
+
+/**
+ * @brief Describe the queue of an inference lane of a device, times are in micro-seconds
+ */
+typedef struct
+{
+    uint32_t depth;                     /**< Number of images waiting in this lane */
+    uint32_t peak_depth;                /**< High-water mark of depth */
+    uint32_t enqueued;                  /**< Number of images received into this lane */
+    uint32_t dequeued;                  /**< Number of images taken out of this lane for inference */
+    uint32_t dropped;                   /**< Number of images dropped from this lane to receive newer ones (droppable mode) */
+    uint32_t avg_wait_us;               /**< Average time an image waited in this lane before inference */
+    uint32_t max_wait_us;               /**< Longest time an image waited in this lane before inference */
+} __attribute__((aligned(4))) kp_inference_lane_stats_t;
+
+/**
+ * @brief Reason of an inference dropped for its deadline
+ */
+typedef enum
+{
+    KP_INFERENCE_DROP_EXPIRED = 1,      /**< the deadline passed while the image waited in the FIFO queue */
+    KP_INFERENCE_DROP_UNREACHABLE = 2,  /**< the measured inference time of the model exceeds the time left to the deadline */
+} kp_inference_drop_reason_t;
+
+/**
+ * @brief Timing of a frame sent with a deadline, times are of kp_inference_get_time_us()
+ */
+typedef struct
+{
+    uint64_t capture_time_us;           /**< when the frame is captured, the start of its end-to-end latency */
+    uint64_t deadline_us;               /**< the result is useless after this time */
+} __attribute__((aligned(4))) kp_inference_deadline_t;
+
+/**
+ * @brief Drop and latency counters of the frames sent with a deadline to an inference lane, times are in micro-seconds
+ */
+typedef struct
+{
+    uint32_t sent;                      /**< Number of frames sent */
+    uint32_t completed;                 /**< Number of frames whose results are received */
+    uint32_t missed;                    /**< Number of completed frames whose results are received after the deadline */
+    uint32_t dropped_expired;           /**< Number of frames dropped by the device for KP_INFERENCE_DROP_EXPIRED */
+    uint32_t dropped_unreachable;       /**< Number of frames dropped by the device for KP_INFERENCE_DROP_UNREACHABLE */
+    uint32_t avg_latency_us;            /**< Average time from capture to result received of the completed frames */
+    uint32_t max_latency_us;            /**< Longest time from capture to result received of the completed frames */
+} __attribute__((aligned(4))) kp_inference_deadline_stats_t;
@@ -0,0 +1,117 @@
+/**
+ * @file        kp_trace.h
+ * @brief       Kneron PLUS latency tracing of the host inference path
+ *
+ * When tracing is enabled, every call of the following stages is timestamped:
+ *
+ *   header write, payload write, ZLP, result read, result header verification, float node conversion,
+ *   and the whole kp_generic_image/data_inference_send() and kp_generic_image/data_inference_receive().
+ *
+ * Each calling thread records into its own lock-free ring buffer (the latest KP_TRACE_RING_SIZE calls) and latency histogram
+ * (all calls since the last kp_trace_reset()), so tracing does not serialize the send and receive threads.
+ * Histograms are log-linear (HDR style), values are kept with a relative error below 1/16.
+ *
+ * Results can be exported as per-stage percentiles, a percentile distribution text file, or a Chrome trace JSON file
+ * which can be opened with chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Tracing is disabled by default, a disabled hook costs one load and branch.
+ *
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KP_TRACE_RING_SIZE 4096     /**< number of latest calls kept per thread for the Chrome trace */
+
+/**
+ * @brief traced stages of the host inference path.
+ */
+typedef enum
+{
+    KP_TRACE_STAGE_HEADER_WRITE = 0,        /**< inference header bulk write */
+    KP_TRACE_STAGE_PAYLOAD_WRITE,           /**< image/data bulk write, header and payload together in the single transfer send mode */
+    KP_TRACE_STAGE_ZLP,                     /**< zero length packet (or fake ZLP) write or read */
+    KP_TRACE_STAGE_RESULT_READ,             /**< waiting for and reading one result */
+    KP_TRACE_STAGE_HEADER_VERIFY,           /**< result header verification and parsing */
+    KP_TRACE_STAGE_NODE_CONVERT,            /**< conversion of one output node to floating-point */
+    KP_TRACE_STAGE_INFERENCE_SEND,          /**< a whole inference send call */
+    KP_TRACE_STAGE_INFERENCE_RECEIVE,       /**< a whole inference receive call */
+    KP_TRACE_NUM_STAGE
+} kp_trace_stage_t;
+
+/**
+ * @brief latency statistics of one stage, percentiles are the upper bound of the histogram bucket.
+ */
+typedef struct
+{
+    uint64_t count;             /**< number of calls */
+    double min_us;              /**< minimum latency in microseconds */
+    double mean_us;             /**< mean latency in microseconds */
+    double p50_us;              /**< 50th percentile in microseconds */
+    double p90_us;              /**< 90th percentile in microseconds */
+    double p99_us;              /**< 99th percentile in microseconds */
+    double p999_us;             /**< 99.9th percentile in microseconds */
+    double max_us;              /**< maximum latency in microseconds */
+} kp_trace_latency_stats_t;
+
+/**
+ * @brief Enable or disable tracing, recorded data is kept when it is disabled.
+ *
+ * @param[in] enable enable or disable.
+ */
+void kp_trace_enable(bool enable);
+
+/**
+ * @brief Check if tracing is enabled.
+ *
+ * @return true if enabled.
+ */
+bool kp_trace_is_enabled(void);
+
+/**
+ * @brief Discard all recorded data, histograms and ring buffers start over.
+ */
+void kp_trace_reset(void);
+
+/**
+ * @brief Get the name of a stage.
+ *
+ * @param[in] stage refer to kp_trace_stage_t.
+ *
+ * @return the stage name, "unknown" if the stage is invalid.
+ */
+const char *kp_trace_stage_name(kp_trace_stage_t stage);
+
+/**
+ * @brief Get latency statistics of one stage, merged from all threads.
+ *
+ * @param[in] stage refer to kp_trace_stage_t.
+ * @param[out] stats refer to kp_trace_latency_stats_t.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h.
+ */
+int kp_trace_get_latency_stats(kp_trace_stage_t stage, kp_trace_latency_stats_t *stats);
+
+/**
+ * @brief Write the latency percentile distribution of every stage which has been called, in the HdrHistogram text format.
+ *
+ * @param[in] file_path output file path, NULL for stdout.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h.
+ */
+int kp_trace_dump_histograms(const char *file_path);
+
+/**
+ * @brief Write the calls kept in the ring buffers as a Chrome trace (JSON) file, one track per thread.
+ *
+ * @param[in] file_path output file path.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h.
+ */
+int kp_trace_dump_chrome_trace(const char *file_path);
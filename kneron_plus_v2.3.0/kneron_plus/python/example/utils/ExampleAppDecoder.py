@@ -0,0 +1,227 @@
+# ******************************************************************************
+#  Copyright (c) 2024. Kneron Inc. All rights reserved.                        *
+# ******************************************************************************
+from typing import List, Tuple, Union
+from enum import IntEnum
+
+from utils.ExampleValue import ExampleBoundingBox, ExampleYoloResult
+
+import os
+import sys
+import ctypes
+import platform
+import numpy as np
+
+PWD = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(1, os.path.join(PWD, '../..'))
+
+import kp
+
+KP_APP_DECODER_LEVEL_MAX = 5
+KP_APP_DECODER_ANCHOR_NUM = 3
+YOLO_GOOD_BOX_MAX = 500
+KP_SUCCESS = 0
+
+
+class AppDecoderHead(IntEnum):
+    """
+    Detection head types of the app_lib decoder (kp_app_decoder_head_t).
+
+    Attributes
+    ----------
+    YOLOX : int, default=0
+        Nodes are reg(4), obj(1), cls(C) of level 0, then of level 1, ...
+    FCOS : int, default=1
+        Nodes are reg(4) of all levels, then cls(C) of all levels, then centerness(1) of all levels.
+    YOLOV7_POSE : int, default=2
+        One node per level of 3 anchors x (x, y, w, h, obj, C classes, K x (x, y, conf)).
+    """
+    YOLOX = 0
+    FCOS = 1
+    YOLOV7_POSE = 2
+
+
+class _DecoderConfig(ctypes.Structure):
+    _fields_ = [('head', ctypes.c_int),
+                ('channel_ordering', ctypes.c_int),
+                ('score_thresh', ctypes.c_float),
+                ('nms_thresh', ctypes.c_float),
+                ('max_detection_per_class', ctypes.c_uint32),
+                ('class_agnostic_nms', ctypes.c_bool),
+                ('num_keypoint', ctypes.c_uint32),
+                ('strides', ctypes.c_uint32 * KP_APP_DECODER_LEVEL_MAX),
+                ('anchors', ctypes.c_float * 2 * KP_APP_DECODER_ANCHOR_NUM * KP_APP_DECODER_LEVEL_MAX)]
+
+
+class _BoundingBox(ctypes.Structure):
+    _fields_ = [('x1', ctypes.c_float),
+                ('y1', ctypes.c_float),
+                ('x2', ctypes.c_float),
+                ('y2', ctypes.c_float),
+                ('score', ctypes.c_float),
+                ('class_num', ctypes.c_int32)]
+
+
+class _YoloResult(ctypes.Structure):
+    _fields_ = [('class_count', ctypes.c_uint32),
+                ('box_count', ctypes.c_uint32),
+                ('boxes', _BoundingBox * YOLO_GOOD_BOX_MAX)]
+
+
+class _HwPreProcInfo(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint32) for name in ['img_width', 'img_height', 'resized_img_width', 'resized_img_height',
+                                                     'pad_top', 'pad_bottom', 'pad_left', 'pad_right',
+                                                     'model_input_width', 'model_input_height',
+                                                     'crop_number', 'crop_x1', 'crop_y1', 'crop_width', 'crop_height']]
+
+
+def _default_library_path() -> str:
+    if 'Windows' == platform.system():
+        library_name = 'libkapp_decoder.dll'
+    elif 'Darwin' == platform.system():
+        library_name = 'libkapp_decoder.dylib'
+    else:
+        library_name = 'libkapp_decoder.so'
+
+    return os.path.join(PWD, '../../../build/bin', library_name)
+
+
+class ExampleAppDecoder:
+    """
+    Detection head decoder of app_lib (libkapp_decoder) for YOLOX, FCOS and YOLOv7-pose, called through ctypes.
+
+    Build the C library first (cmake in kneron_plus), it is placed in 'kneron_plus/build/bin' by default.
+
+    Parameters
+    ----------
+    head : AppDecoderHead
+        Detection head type of the model.
+    score_thresh : float, default=0
+        Minimum box score, 0 for the default of the head.
+    nms_thresh : float, default=0
+        IoU threshold of NMS, 0 for the default of the head.
+    max_detection_per_class : int, default=0
+        Maximum boxes kept by NMS per class, 0 for default (100).
+    class_agnostic_nms : bool, default=False
+        True to suppress boxes of different classes too.
+    num_keypoint : int, default=0
+        Keypoints per box of YOLOv7-pose, 0 for default (17).
+    strides : List[int], default=None
+        Stride of each level, None to take it from the model input size and the grid size.
+    library_path : str, default=None
+        Path of libkapp_decoder, None for the default build output.
+    """
+
+    def __init__(self,
+                 head: AppDecoderHead,
+                 score_thresh: float = 0,
+                 nms_thresh: float = 0,
+                 max_detection_per_class: int = 0,
+                 class_agnostic_nms: bool = False,
+                 num_keypoint: int = 0,
+                 strides: Union[List[int], None] = None,
+                 library_path: Union[str, None] = None):
+        self.__lib = ctypes.CDLL(library_path if library_path is not None else _default_library_path())
+        self.__lib.kp_app_decoder_create.restype = ctypes.c_void_p
+        self.__lib.kp_app_decoder_create.argtypes = [ctypes.POINTER(_DecoderConfig), ctypes.POINTER(ctypes.c_int)]
+        self.__lib.kp_app_decoder_get_keypoint_count.restype = ctypes.c_uint32
+        self.__lib.kp_app_decoder_get_keypoint_count.argtypes = [ctypes.c_void_p]
+        self.__lib.kp_app_decoder_run.restype = ctypes.c_int
+        self.__lib.kp_app_decoder_run.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p), ctypes.c_uint32,
+                                                  ctypes.POINTER(_HwPreProcInfo), ctypes.POINTER(_YoloResult),
+                                                  ctypes.c_void_p, ctypes.c_uint32]
+        self.__lib.kp_app_decoder_destroy.restype = None
+        self.__lib.kp_app_decoder_destroy.argtypes = [ctypes.c_void_p]
+
+        # nodes of the Python API are in NCHW order
+        config = _DecoderConfig()
+        config.head = int(head)
+        config.channel_ordering = kp.ChannelOrdering.KP_CHANNEL_ORDERING_CHW.value
+        config.score_thresh = score_thresh
+        config.nms_thresh = nms_thresh
+        config.max_detection_per_class = max_detection_per_class
+        config.class_agnostic_nms = class_agnostic_nms
+        config.num_keypoint = num_keypoint
+
+        for level, stride in enumerate(strides if strides is not None else []):
+            config.strides[level] = stride
+
+        error_code = ctypes.c_int(0)
+        self.__decoder = self.__lib.kp_app_decoder_create(ctypes.byref(config), ctypes.byref(error_code))
+
+        if not self.__decoder:
+            raise ValueError('create app decoder failed, error = {}'.format(error_code.value))
+
+        self.__num_keypoint = self.__lib.kp_app_decoder_get_keypoint_count(self.__decoder)
+        self.__result = _YoloResult()
+        self.__keypoints = np.zeros((YOLO_GOOD_BOX_MAX, max(self.__num_keypoint, 1), 3), dtype=np.float32)
+        self.__node_buffers = []
+
+    def __del__(self):
+        if getattr(self, '_ExampleAppDecoder__decoder', None):
+            self.__lib.kp_app_decoder_destroy(self.__decoder)
+            self.__decoder = None
+
+    def __node_buffer(self, index: int, node: kp.InferenceFloatNodeOutput) -> np.ndarray:
+        # kp_inf_float_node_output_t: width, height, channel, num_data, then the data, buffers are kept for the next call
+        num_data = node.width * node.height * node.channel
+
+        while len(self.__node_buffers) <= index:
+            self.__node_buffers.append(np.zeros(0, dtype=np.float32))
+
+        if self.__node_buffers[index].size != 4 + num_data:
+            self.__node_buffers[index] = np.zeros(4 + num_data, dtype=np.float32)
+
+        buffer = self.__node_buffers[index]
+        buffer[:4].view(np.uint32)[:] = [node.width, node.height, node.channel, num_data]
+        buffer[4:] = np.asarray(node.ndarray, dtype=np.float32).reshape(-1)
+
+        return buffer
+
+    def run(self,
+            inference_float_node_output_list: List[kp.InferenceFloatNodeOutput],
+            hardware_preproc_info: Union[kp.HwPreProcInfo, None] = None) -> Tuple[ExampleYoloResult, np.ndarray]:
+        """
+        Decode output nodes of one inference into boxes.
+
+        Parameters
+        ----------
+        inference_float_node_output_list : List[kp.InferenceFloatNodeOutput]
+            Floating-point output nodes from 'kp.inference.generic_inference_retrieve_float_node()' in the order of the head.
+        hardware_preproc_info : kp.HwPreProcInfo, default=None
+            Information of hardware pre-process to map boxes back to the image, None to keep boxes in model input coordinates.
+
+        Returns
+        -------
+        yolo_result : ExampleYoloResult
+            Boxes sorted by class and then by score.
+        keypoints : np.ndarray
+            Keypoints of the boxes in shape (box_count, K, 3) of x, y and score, K is 0 for heads without keypoints.
+        """
+        buffers = [self.__node_buffer(i, node) for i, node in enumerate(inference_float_node_output_list)]
+        node_pointers = (ctypes.c_void_p * len(buffers))(*[buffer.ctypes.data for buffer in buffers])
+        pre_proc_info_pointer = None
+
+        if hardware_preproc_info is not None:
+            pre_proc_info = _HwPreProcInfo()
+
+            for name in ['img_width', 'img_height', 'resized_img_width', 'resized_img_height', 'pad_top', 'pad_bottom',
+                         'pad_left', 'pad_right', 'model_input_width', 'model_input_height']:
+                setattr(pre_proc_info, name, getattr(hardware_preproc_info, name))
+
+            pre_proc_info_pointer = ctypes.byref(pre_proc_info)
+
+        ret = self.__lib.kp_app_decoder_run(self.__decoder, node_pointers, len(buffers), pre_proc_info_pointer,
+                                            ctypes.byref(self.__result), self.__keypoints.ctypes.data,
+                                            YOLO_GOOD_BOX_MAX * self.__num_keypoint)
+
+        if KP_SUCCESS != ret:
+            raise ValueError('app decoder failed, error = {}'.format(ret))
+
+        box_list = [ExampleBoundingBox(x1=box.x1, y1=box.y1, x2=box.x2, y2=box.y2, score=box.score, class_num=box.class_num)
+                    for box in self.__result.boxes[:self.__result.box_count]]
+
+        return ExampleYoloResult(class_count=self.__result.class_count,
+                                 box_count=self.__result.box_count,
+                                 box_list=box_list), \
+            self.__keypoints[:self.__result.box_count, :self.__num_keypoint].copy()
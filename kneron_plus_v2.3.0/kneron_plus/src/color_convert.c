@@ -0,0 +1,783 @@
+/**
+ * @file        color_convert.c
+ * @brief       color conversion and resize kernels for host image conversion
+ * @version     0.1
+ * @date        2024-06-10
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "color_convert.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+// the library is built for baseline x86, kernels of newer instruction sets are enabled per function and picked at run time
+#define COLOR_CONVERT_X86
+#include <immintrin.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define COLOR_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+typedef void (*row_func_t)(uint8_t *dst, const uint8_t *src, int width, int swap_rb);
+typedef void (*ycbcr422_func_t)(uint8_t *dst, const uint8_t *src, int width, int swap_rb, const uint8_t *order);
+typedef void (*yuv420_func_t)(uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+                              const uint8_t *src0, const uint8_t *src1, int width, int swap_rb);
+
+static pthread_once_t _kernel_once = PTHREAD_ONCE_INIT;
+static row_func_t _rgb565 = NULL;
+static row_func_t _rgba8888 = NULL;
+static row_func_t _raw8 = NULL;
+static ycbcr422_func_t _ycbcr422 = NULL;
+static yuv420_func_t _yuv420 = NULL;
+
+/******************************************************************
+ * C kernels
+ ******************************************************************/
+
+static inline uint8_t luma_c(int r, int g, int b)
+{
+    return (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+// ((128 p - kq q - ks s + 128) >> 8) + 128, the rounding is added with 16-bit saturation like the SIMD kernels
+static inline uint8_t chroma_c(int p, int q, int s, int kq, int ks)
+{
+    int t = 128 * p - kq * q - ks * s + 128;
+
+    if (t > 32767)
+        t = 32767;
+
+    return (uint8_t)((t >> 8) + 128);
+}
+
+static inline int avg_c(int a, int b)
+{
+    return (a + b + 1) >> 1;
+}
+
+static void rgb565_c(uint8_t *dst, const uint8_t *src, int width, int swap_rb, int begin)
+{
+    int ri = swap_rb ? 0 : 2;
+    int bi = 2 - ri;
+
+    for (int x = begin; x < width; x++)
+    {
+        const uint8_t *s = src + x * 3;
+        uint16_t v = (uint16_t)(((s[ri] & 0xF8) << 8) | ((s[1] & 0xFC) << 3) | (s[bi] >> 3));
+
+        dst[x * 2] = (uint8_t)v;
+        dst[x * 2 + 1] = (uint8_t)(v >> 8);
+    }
+}
+
+static void rgba8888_c(uint8_t *dst, const uint8_t *src, int width, int swap_rb, int begin)
+{
+    int ri = swap_rb ? 0 : 2;
+    int bi = 2 - ri;
+
+    for (int x = begin; x < width; x++)
+    {
+        const uint8_t *s = src + x * 3;
+        uint8_t *d = dst + x * 4;
+
+        d[0] = s[ri];
+        d[1] = s[1];
+        d[2] = s[bi];
+        d[3] = 0;
+    }
+}
+
+static void raw8_c(uint8_t *dst, const uint8_t *src, int width, int swap_rb, int begin)
+{
+    int ri = swap_rb ? 0 : 2;
+    int bi = 2 - ri;
+
+    for (int x = begin; x < width; x++)
+    {
+        const uint8_t *s = src + x * 3;
+
+        dst[x] = luma_c(s[ri], s[1], s[bi]);
+    }
+}
+
+static void ycbcr422_c(uint8_t *dst, const uint8_t *src, int width, int swap_rb, const uint8_t *order, int begin)
+{
+    int ri = swap_rb ? 0 : 2;
+    int bi = 2 - ri;
+
+    for (int x = begin; x + 1 < width; x += 2)
+    {
+        const uint8_t *s = src + x * 3;
+        int r = avg_c(s[ri], s[ri + 3]);
+        int g = avg_c(s[1], s[4]);
+        int b = avg_c(s[bi], s[bi + 3]);
+        uint8_t comp[4];
+
+        comp[0] = luma_c(s[ri], s[1], s[bi]);
+        comp[1] = chroma_c(b, r, g, 43, 85);
+        comp[2] = luma_c(s[ri + 3], s[4], s[bi + 3]);
+        comp[3] = chroma_c(r, g, b, 107, 21);
+
+        uint8_t *d = dst + x * 2;
+        d[0] = comp[order[0]];
+        d[1] = comp[order[1]];
+        d[2] = comp[order[2]];
+        d[3] = comp[order[3]];
+    }
+}
+
+static void yuv420_c(uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+                     const uint8_t *src0, const uint8_t *src1, int width, int swap_rb, int begin)
+{
+    int ri = swap_rb ? 0 : 2;
+    int bi = 2 - ri;
+
+    for (int x = begin; x + 1 < width; x += 2)
+    {
+        const uint8_t *s0 = src0 + x * 3;
+        const uint8_t *s1 = src1 + x * 3;
+
+        dst_y0[x] = luma_c(s0[ri], s0[1], s0[bi]);
+        dst_y0[x + 1] = luma_c(s0[ri + 3], s0[4], s0[bi + 3]);
+        dst_y1[x] = luma_c(s1[ri], s1[1], s1[bi]);
+        dst_y1[x + 1] = luma_c(s1[ri + 3], s1[4], s1[bi + 3]);
+
+        int r = avg_c(avg_c(s0[ri], s0[ri + 3]), avg_c(s1[ri], s1[ri + 3]));
+        int g = avg_c(avg_c(s0[1], s0[4]), avg_c(s1[1], s1[4]));
+        int b = avg_c(avg_c(s0[bi], s0[bi + 3]), avg_c(s1[bi], s1[bi + 3]));
+
+        dst_u[x / 2] = chroma_c(b, r, g, 43, 85);
+        dst_v[x / 2] = chroma_c(r, g, b, 107, 21);
+    }
+}
+
+static void rgb565_all_c(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    rgb565_c(dst, src, width, swap_rb, 0);
+}
+
+static void rgba8888_all_c(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    rgba8888_c(dst, src, width, swap_rb, 0);
+}
+
+static void raw8_all_c(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    raw8_c(dst, src, width, swap_rb, 0);
+}
+
+static void ycbcr422_all_c(uint8_t *dst, const uint8_t *src, int width, int swap_rb, const uint8_t *order)
+{
+    ycbcr422_c(dst, src, width, swap_rb, order, 0);
+}
+
+static void yuv420_all_c(uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+                         const uint8_t *src0, const uint8_t *src1, int width, int swap_rb)
+{
+    yuv420_c(dst_y0, dst_y1, dst_u, dst_v, src0, src1, width, swap_rb, 0);
+}
+
+#if defined(COLOR_CONVERT_X86)
+
+/******************************************************************
+ * SSE4.1 kernels, 16 pixels per iteration
+ ******************************************************************/
+
+// byte shuffles gathering channel c of 16 pixels from the 3 vectors of 48 source bytes
+static const int8_t _deinterleave_mask[3][3][16] = {
+    {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+    {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+    {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}},
+};
+
+static inline TARGET_SSE41 __m128i sse41_gather(__m128i a0, __m128i a1, __m128i a2, int c)
+{
+    __m128i v = _mm_shuffle_epi8(a0, _mm_loadu_si128((const __m128i *)_deinterleave_mask[c][0]));
+
+    v = _mm_or_si128(v, _mm_shuffle_epi8(a1, _mm_loadu_si128((const __m128i *)_deinterleave_mask[c][1])));
+    return _mm_or_si128(v, _mm_shuffle_epi8(a2, _mm_loadu_si128((const __m128i *)_deinterleave_mask[c][2])));
+}
+
+static inline TARGET_SSE41 void sse41_load16(const uint8_t *src, int swap_rb, __m128i *r, __m128i *g, __m128i *b)
+{
+    __m128i a0 = _mm_loadu_si128((const __m128i *)src);
+    __m128i a1 = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i a2 = _mm_loadu_si128((const __m128i *)(src + 32));
+    __m128i c0 = sse41_gather(a0, a1, a2, 0);
+    __m128i c2 = sse41_gather(a0, a1, a2, 2);
+
+    *g = sse41_gather(a0, a1, a2, 1);
+    *r = swap_rb ? c0 : c2;
+    *b = swap_rb ? c2 : c0;
+}
+
+// 8 lanes of 16 bits
+static inline TARGET_SSE41 __m128i sse41_luma8(__m128i r, __m128i g, __m128i b)
+{
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)), _mm_mullo_epi16(g, _mm_set1_epi16(150)));
+
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(29)));
+    return _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8);
+}
+
+static inline TARGET_SSE41 __m128i sse41_luma16(__m128i r, __m128i g, __m128i b)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = sse41_luma8(_mm_cvtepu8_epi16(r), _mm_cvtepu8_epi16(g), _mm_cvtepu8_epi16(b));
+    __m128i hi = sse41_luma8(_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(b, zero));
+
+    return _mm_packus_epi16(lo, hi);
+}
+
+// 8 lanes of 16 bits, ((128 p - kq q - ks s + 128) >> 8) + 128
+static inline TARGET_SSE41 __m128i sse41_chroma8(__m128i p, __m128i q, __m128i s, int16_t kq, int16_t ks)
+{
+    __m128i t = _mm_slli_epi16(p, 7);
+
+    t = _mm_sub_epi16(t, _mm_mullo_epi16(q, _mm_set1_epi16(kq)));
+    t = _mm_sub_epi16(t, _mm_mullo_epi16(s, _mm_set1_epi16(ks)));
+    t = _mm_srai_epi16(_mm_adds_epi16(t, _mm_set1_epi16(128)), 8);
+
+    return _mm_add_epi16(t, _mm_set1_epi16(128));
+}
+
+// average of every 2 bytes into 16-bit lanes
+static inline TARGET_SSE41 __m128i sse41_pair_avg(__m128i v)
+{
+    return _mm_avg_epu16(_mm_and_si128(v, _mm_set1_epi16(0xFF)), _mm_srli_epi16(v, 8));
+}
+
+// byte shuffle writing component order[i] of (y0, cb, y1, cr) to byte i of every 4 bytes
+static inline TARGET_SSE41 __m128i sse41_order_mask(const uint8_t *order)
+{
+    int8_t mask[16];
+
+    for (int i = 0; i < 16; i++)
+        mask[i] = (int8_t)((i & ~3) + order[i & 3]);
+
+    return _mm_loadu_si128((const __m128i *)mask);
+}
+
+static TARGET_SSE41 void rgb565_sse41(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    __m128i zero = _mm_setzero_si128();
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i r, g, b;
+        sse41_load16(src + x * 3, swap_rb, &r, &g, &b);
+
+        r = _mm_and_si128(r, _mm_set1_epi8((char)0xF8));
+        g = _mm_and_si128(g, _mm_set1_epi8((char)0xFC));
+
+        // R is the high byte as it is, G is shifted across both bytes, B is the low bits
+        __m128i rg_lo = _mm_or_si128(_mm_unpacklo_epi8(zero, r), _mm_slli_epi16(_mm_unpacklo_epi8(g, zero), 3));
+        __m128i rg_hi = _mm_or_si128(_mm_unpackhi_epi8(zero, r), _mm_slli_epi16(_mm_unpackhi_epi8(g, zero), 3));
+        __m128i lo = _mm_or_si128(rg_lo, _mm_srli_epi16(_mm_unpacklo_epi8(b, zero), 3));
+        __m128i hi = _mm_or_si128(rg_hi, _mm_srli_epi16(_mm_unpackhi_epi8(b, zero), 3));
+
+        _mm_storeu_si128((__m128i *)(dst + x * 2), lo);
+        _mm_storeu_si128((__m128i *)(dst + x * 2 + 16), hi);
+    }
+
+    rgb565_c(dst, src, width, swap_rb, x);
+}
+
+static TARGET_SSE41 void rgba8888_sse41(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    __m128i zero = _mm_setzero_si128();
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i r, g, b;
+        sse41_load16(src + x * 3, swap_rb, &r, &g, &b);
+
+        __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+        __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+        __m128i ba_lo = _mm_unpacklo_epi8(b, zero);
+        __m128i ba_hi = _mm_unpackhi_epi8(b, zero);
+        uint8_t *d = dst + x * 4;
+
+        _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i *)(d + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i *)(d + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+        _mm_storeu_si128((__m128i *)(d + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+
+    rgba8888_c(dst, src, width, swap_rb, x);
+}
+
+static TARGET_SSE41 void raw8_sse41(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i r, g, b;
+        sse41_load16(src + x * 3, swap_rb, &r, &g, &b);
+
+        _mm_storeu_si128((__m128i *)(dst + x), sse41_luma16(r, g, b));
+    }
+
+    raw8_c(dst, src, width, swap_rb, x);
+}
+
+static TARGET_SSE41 void ycbcr422_sse41(uint8_t *dst, const uint8_t *src, int width, int swap_rb, const uint8_t *order)
+{
+    __m128i shuffle = sse41_order_mask(order);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i r, g, b;
+        sse41_load16(src + x * 3, swap_rb, &r, &g, &b);
+
+        __m128i y = sse41_luma16(r, g, b);
+        __m128i ra = sse41_pair_avg(r);
+        __m128i ga = sse41_pair_avg(g);
+        __m128i ba = sse41_pair_avg(b);
+
+        // 8 Cb then 8 Cr, interleaved to Cb, Cr pairs
+        __m128i cc = _mm_packus_epi16(sse41_chroma8(ba, ra, ga, 43, 85), sse41_chroma8(ra, ga, ba, 107, 21));
+        __m128i cbcr = _mm_unpacklo_epi8(cc, _mm_srli_si128(cc, 8));
+
+        _mm_storeu_si128((__m128i *)(dst + x * 2), _mm_shuffle_epi8(_mm_unpacklo_epi8(y, cbcr), shuffle));
+        _mm_storeu_si128((__m128i *)(dst + x * 2 + 16), _mm_shuffle_epi8(_mm_unpackhi_epi8(y, cbcr), shuffle));
+    }
+
+    ycbcr422_c(dst, src, width, swap_rb, order, x);
+}
+
+static TARGET_SSE41 void yuv420_sse41(uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+                                      const uint8_t *src0, const uint8_t *src1, int width, int swap_rb)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i r0, g0, b0, r1, g1, b1;
+        sse41_load16(src0 + x * 3, swap_rb, &r0, &g0, &b0);
+        sse41_load16(src1 + x * 3, swap_rb, &r1, &g1, &b1);
+
+        _mm_storeu_si128((__m128i *)(dst_y0 + x), sse41_luma16(r0, g0, b0));
+        _mm_storeu_si128((__m128i *)(dst_y1 + x), sse41_luma16(r1, g1, b1));
+
+        __m128i ra = _mm_avg_epu16(sse41_pair_avg(r0), sse41_pair_avg(r1));
+        __m128i ga = _mm_avg_epu16(sse41_pair_avg(g0), sse41_pair_avg(g1));
+        __m128i ba = _mm_avg_epu16(sse41_pair_avg(b0), sse41_pair_avg(b1));
+        __m128i cc = _mm_packus_epi16(sse41_chroma8(ba, ra, ga, 43, 85), sse41_chroma8(ra, ga, ba, 107, 21));
+
+        _mm_storel_epi64((__m128i *)(dst_u + x / 2), cc);
+        _mm_storel_epi64((__m128i *)(dst_v + x / 2), _mm_srli_si128(cc, 8));
+    }
+
+    yuv420_c(dst_y0, dst_y1, dst_u, dst_v, src0, src1, width, swap_rb, x);
+}
+
+/******************************************************************
+ * AVX2 kernels, 32 pixels per iteration
+ * pixels are gathered by 128-bit shuffles, the arithmetic is done on 16 pixels per instruction
+ ******************************************************************/
+
+static inline TARGET_AVX2 __m256i avx2_combine(__m128i lo, __m128i hi)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+static inline TARGET_AVX2 void avx2_load32(const uint8_t *src, int swap_rb, __m256i *r, __m256i *g, __m256i *b)
+{
+    __m128i r0, g0, b0, r1, g1, b1;
+
+    sse41_load16(src, swap_rb, &r0, &g0, &b0);
+    sse41_load16(src + 48, swap_rb, &r1, &g1, &b1);
+
+    *r = avx2_combine(r0, r1);
+    *g = avx2_combine(g0, g1);
+    *b = avx2_combine(b0, b1);
+}
+
+// 16 lanes of 16 bits
+static inline TARGET_AVX2 __m256i avx2_luma16(__m256i r, __m256i g, __m256i b)
+{
+    __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(77)), _mm256_mullo_epi16(g, _mm256_set1_epi16(150)));
+
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(b, _mm256_set1_epi16(29)));
+    return _mm256_srli_epi16(_mm256_add_epi16(y, _mm256_set1_epi16(128)), 8);
+}
+
+// pack 2 x 16 lanes of 16 bits into 32 bytes in lane order
+static inline TARGET_AVX2 __m256i avx2_pack(__m256i a, __m256i b)
+{
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+}
+
+static inline TARGET_AVX2 __m256i avx2_luma32(__m256i r, __m256i g, __m256i b)
+{
+    __m256i lo = avx2_luma16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(r)), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(g)),
+                             _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b)));
+    __m256i hi = avx2_luma16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(r, 1)), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(g, 1)),
+                             _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1)));
+
+    return avx2_pack(lo, hi);
+}
+
+static inline TARGET_AVX2 __m256i avx2_chroma16(__m256i p, __m256i q, __m256i s, int16_t kq, int16_t ks)
+{
+    __m256i t = _mm256_slli_epi16(p, 7);
+
+    t = _mm256_sub_epi16(t, _mm256_mullo_epi16(q, _mm256_set1_epi16(kq)));
+    t = _mm256_sub_epi16(t, _mm256_mullo_epi16(s, _mm256_set1_epi16(ks)));
+    t = _mm256_srai_epi16(_mm256_adds_epi16(t, _mm256_set1_epi16(128)), 8);
+
+    return _mm256_add_epi16(t, _mm256_set1_epi16(128));
+}
+
+static inline TARGET_AVX2 __m256i avx2_pair_avg(__m256i v)
+{
+    return _mm256_avg_epu16(_mm256_and_si256(v, _mm256_set1_epi16(0xFF)), _mm256_srli_epi16(v, 8));
+}
+
+static TARGET_AVX2 void raw8_avx2(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i r, g, b;
+        avx2_load32(src + x * 3, swap_rb, &r, &g, &b);
+
+        _mm256_storeu_si256((__m256i *)(dst + x), avx2_luma32(r, g, b));
+    }
+
+    raw8_sse41(dst + x, src + x * 3, width - x, swap_rb);
+}
+
+static TARGET_AVX2 void ycbcr422_avx2(uint8_t *dst, const uint8_t *src, int width, int swap_rb, const uint8_t *order)
+{
+    __m128i shuffle = sse41_order_mask(order);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i r, g, b;
+        avx2_load32(src + x * 3, swap_rb, &r, &g, &b);
+
+        __m256i y = avx2_luma32(r, g, b);
+        __m256i ra = avx2_pair_avg(r);
+        __m256i ga = avx2_pair_avg(g);
+        __m256i ba = avx2_pair_avg(b);
+
+        // 16 Cb in the low half, 16 Cr in the high half
+        __m256i cc = avx2_pack(avx2_chroma16(ba, ra, ga, 43, 85), avx2_chroma16(ra, ga, ba, 107, 21));
+        __m128i cb = _mm256_castsi256_si128(cc);
+        __m128i cr = _mm256_extracti128_si256(cc, 1);
+        __m128i cbcr_lo = _mm_unpacklo_epi8(cb, cr);
+        __m128i cbcr_hi = _mm_unpackhi_epi8(cb, cr);
+        __m128i y_lo = _mm256_castsi256_si128(y);
+        __m128i y_hi = _mm256_extracti128_si256(y, 1);
+        uint8_t *d = dst + x * 2;
+
+        _mm_storeu_si128((__m128i *)d, _mm_shuffle_epi8(_mm_unpacklo_epi8(y_lo, cbcr_lo), shuffle));
+        _mm_storeu_si128((__m128i *)(d + 16), _mm_shuffle_epi8(_mm_unpackhi_epi8(y_lo, cbcr_lo), shuffle));
+        _mm_storeu_si128((__m128i *)(d + 32), _mm_shuffle_epi8(_mm_unpacklo_epi8(y_hi, cbcr_hi), shuffle));
+        _mm_storeu_si128((__m128i *)(d + 48), _mm_shuffle_epi8(_mm_unpackhi_epi8(y_hi, cbcr_hi), shuffle));
+    }
+
+    ycbcr422_sse41(dst + x * 2, src + x * 3, width - x, swap_rb, order);
+}
+
+static TARGET_AVX2 void yuv420_avx2(uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+                                    const uint8_t *src0, const uint8_t *src1, int width, int swap_rb)
+{
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i r0, g0, b0, r1, g1, b1;
+        avx2_load32(src0 + x * 3, swap_rb, &r0, &g0, &b0);
+        avx2_load32(src1 + x * 3, swap_rb, &r1, &g1, &b1);
+
+        _mm256_storeu_si256((__m256i *)(dst_y0 + x), avx2_luma32(r0, g0, b0));
+        _mm256_storeu_si256((__m256i *)(dst_y1 + x), avx2_luma32(r1, g1, b1));
+
+        __m256i ra = _mm256_avg_epu16(avx2_pair_avg(r0), avx2_pair_avg(r1));
+        __m256i ga = _mm256_avg_epu16(avx2_pair_avg(g0), avx2_pair_avg(g1));
+        __m256i ba = _mm256_avg_epu16(avx2_pair_avg(b0), avx2_pair_avg(b1));
+        __m256i cc = avx2_pack(avx2_chroma16(ba, ra, ga, 43, 85), avx2_chroma16(ra, ga, ba, 107, 21));
+
+        _mm_storeu_si128((__m128i *)(dst_u + x / 2), _mm256_castsi256_si128(cc));
+        _mm_storeu_si128((__m128i *)(dst_v + x / 2), _mm256_extracti128_si256(cc, 1));
+    }
+
+    yuv420_sse41(dst_y0 + x, dst_y1 + x, dst_u + x / 2, dst_v + x / 2, src0 + x * 3, src1 + x * 3, width - x, swap_rb);
+}
+
+#elif defined(COLOR_CONVERT_NEON)
+
+/******************************************************************
+ * NEON kernels, 16 pixels per iteration
+ ******************************************************************/
+
+static inline void neon_load16(const uint8_t *src, int swap_rb, uint8x16_t *r, uint8x16_t *g, uint8x16_t *b)
+{
+    uint8x16x3_t v = vld3q_u8(src);
+
+    *g = v.val[1];
+    *r = swap_rb ? v.val[0] : v.val[2];
+    *b = swap_rb ? v.val[2] : v.val[0];
+}
+
+static inline uint8x8_t neon_luma8(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+    uint16x8_t y = vmull_u8(r, vdup_n_u8(77));
+
+    y = vmlal_u8(y, g, vdup_n_u8(150));
+    y = vmlal_u8(y, b, vdup_n_u8(29));
+
+    return vrshrn_n_u16(y, 8);
+}
+
+static inline uint8x16_t neon_luma16(uint8x16_t r, uint8x16_t g, uint8x16_t b)
+{
+    return vcombine_u8(neon_luma8(vget_low_u8(r), vget_low_u8(g), vget_low_u8(b)),
+                       neon_luma8(vget_high_u8(r), vget_high_u8(g), vget_high_u8(b)));
+}
+
+// ((128 p - kq q - ks s + 128) >> 8) + 128
+static inline uint8x8_t neon_chroma8(uint16x8_t p, uint16x8_t q, uint16x8_t s, int16_t kq, int16_t ks)
+{
+    int16x8_t t = vshlq_n_s16(vreinterpretq_s16_u16(p), 7);
+
+    t = vmlsq_n_s16(t, vreinterpretq_s16_u16(q), kq);
+    t = vmlsq_n_s16(t, vreinterpretq_s16_u16(s), ks);
+    t = vshrq_n_s16(vqaddq_s16(t, vdupq_n_s16(128)), 8);
+
+    return vqmovun_s16(vaddq_s16(t, vdupq_n_s16(128)));
+}
+
+// average of every 2 bytes into 16-bit lanes
+static inline uint16x8_t neon_pair_avg(uint8x16_t v)
+{
+    return vrshrq_n_u16(vpaddlq_u8(v), 1);
+}
+
+static void rgb565_neon(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t r, g, b;
+        neon_load16(src + x * 3, swap_rb, &r, &g, &b);
+
+        r = vandq_u8(r, vdupq_n_u8(0xF8));
+        g = vandq_u8(g, vdupq_n_u8(0xFC));
+        b = vshrq_n_u8(b, 3);
+
+        uint16x8_t lo = vorrq_u16(vorrq_u16(vshll_n_u8(vget_low_u8(r), 8), vshll_n_u8(vget_low_u8(g), 3)), vmovl_u8(vget_low_u8(b)));
+        uint16x8_t hi = vorrq_u16(vorrq_u16(vshll_n_u8(vget_high_u8(r), 8), vshll_n_u8(vget_high_u8(g), 3)), vmovl_u8(vget_high_u8(b)));
+
+        vst1q_u8(dst + x * 2, vreinterpretq_u8_u16(lo));
+        vst1q_u8(dst + x * 2 + 16, vreinterpretq_u8_u16(hi));
+    }
+
+    rgb565_c(dst, src, width, swap_rb, x);
+}
+
+static void rgba8888_neon(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x4_t v;
+        neon_load16(src + x * 3, swap_rb, &v.val[0], &v.val[1], &v.val[2]);
+        v.val[3] = vdupq_n_u8(0);
+
+        vst4q_u8(dst + x * 4, v);
+    }
+
+    rgba8888_c(dst, src, width, swap_rb, x);
+}
+
+static void raw8_neon(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t r, g, b;
+        neon_load16(src + x * 3, swap_rb, &r, &g, &b);
+
+        vst1q_u8(dst + x, neon_luma16(r, g, b));
+    }
+
+    raw8_c(dst, src, width, swap_rb, x);
+}
+
+static void ycbcr422_neon(uint8_t *dst, const uint8_t *src, int width, int swap_rb, const uint8_t *order)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t r, g, b;
+        neon_load16(src + x * 3, swap_rb, &r, &g, &b);
+
+        uint8x16_t y = neon_luma16(r, g, b);
+        uint8x8x2_t y01 = vuzp_u8(vget_low_u8(y), vget_high_u8(y));
+        uint16x8_t ra = neon_pair_avg(r);
+        uint16x8_t ga = neon_pair_avg(g);
+        uint16x8_t ba = neon_pair_avg(b);
+        uint8x8_t comp[4];
+
+        comp[0] = y01.val[0];
+        comp[1] = neon_chroma8(ba, ra, ga, 43, 85);
+        comp[2] = y01.val[1];
+        comp[3] = neon_chroma8(ra, ga, ba, 107, 21);
+
+        uint8x8x4_t v;
+        v.val[0] = comp[order[0]];
+        v.val[1] = comp[order[1]];
+        v.val[2] = comp[order[2]];
+        v.val[3] = comp[order[3]];
+
+        vst4_u8(dst + x * 2, v);
+    }
+
+    ycbcr422_c(dst, src, width, swap_rb, order, x);
+}
+
+static void yuv420_neon(uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+                        const uint8_t *src0, const uint8_t *src1, int width, int swap_rb)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t r0, g0, b0, r1, g1, b1;
+        neon_load16(src0 + x * 3, swap_rb, &r0, &g0, &b0);
+        neon_load16(src1 + x * 3, swap_rb, &r1, &g1, &b1);
+
+        vst1q_u8(dst_y0 + x, neon_luma16(r0, g0, b0));
+        vst1q_u8(dst_y1 + x, neon_luma16(r1, g1, b1));
+
+        uint16x8_t ra = vrhaddq_u16(neon_pair_avg(r0), neon_pair_avg(r1));
+        uint16x8_t ga = vrhaddq_u16(neon_pair_avg(g0), neon_pair_avg(g1));
+        uint16x8_t ba = vrhaddq_u16(neon_pair_avg(b0), neon_pair_avg(b1));
+
+        vst1_u8(dst_u + x / 2, neon_chroma8(ba, ra, ga, 43, 85));
+        vst1_u8(dst_v + x / 2, neon_chroma8(ra, ga, ba, 107, 21));
+    }
+
+    yuv420_c(dst_y0, dst_y1, dst_u, dst_v, src0, src1, width, swap_rb, x);
+}
+
+#endif
+
+/******************************************************************
+ * kernel selection
+ ******************************************************************/
+
+static void select_kernels(void)
+{
+    _rgb565 = rgb565_all_c;
+    _rgba8888 = rgba8888_all_c;
+    _raw8 = raw8_all_c;
+    _ycbcr422 = ycbcr422_all_c;
+    _yuv420 = yuv420_all_c;
+
+#if defined(COLOR_CONVERT_X86)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        _rgb565 = rgb565_sse41;
+        _rgba8888 = rgba8888_sse41;
+        _raw8 = raw8_sse41;
+        _ycbcr422 = ycbcr422_sse41;
+        _yuv420 = yuv420_sse41;
+    }
+
+    // RGB565 and RGBA8888 are only shuffles, they are bound by memory and stay with SSE4.1
+    if (__builtin_cpu_supports("avx2"))
+    {
+        _raw8 = raw8_avx2;
+        _ycbcr422 = ycbcr422_avx2;
+        _yuv420 = yuv420_avx2;
+    }
+#elif defined(COLOR_CONVERT_NEON)
+    _rgb565 = rgb565_neon;
+    _rgba8888 = rgba8888_neon;
+    _raw8 = raw8_neon;
+    _ycbcr422 = ycbcr422_neon;
+    _yuv420 = yuv420_neon;
+#endif
+}
+
+void color_convert_row_rgb565(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _rgb565(dst, src, width, swap_rb);
+}
+
+void color_convert_row_rgba8888(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _rgba8888(dst, src, width, swap_rb);
+}
+
+void color_convert_row_raw8(uint8_t *dst, const uint8_t *src, int width, int swap_rb)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _raw8(dst, src, width, swap_rb);
+}
+
+void color_convert_row_ycbcr422(uint8_t *dst, const uint8_t *src, int width, int swap_rb, const uint8_t *order)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _ycbcr422(dst, src, width, swap_rb, order);
+}
+
+void color_convert_rows_yuv420(uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+                               const uint8_t *src0, const uint8_t *src1, int width, int swap_rb)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _yuv420(dst_y0, dst_y1, dst_u, dst_v, src0, src1, width, swap_rb);
+}
+
+void color_resample_row(uint16_t *dst, const uint8_t *src, const int32_t *xofs0, const int32_t *xofs1, const uint16_t *fx, int width)
+{
+    for (int x = 0; x < width; x++)
+    {
+        const uint8_t *p0 = src + xofs0[x];
+        const uint8_t *p1 = src + xofs1[x];
+        uint32_t w1 = fx[x];
+        uint32_t w0 = 256 - w1;
+
+        dst[x * 3] = (uint16_t)(p0[0] * w0 + p1[0] * w1);
+        dst[x * 3 + 1] = (uint16_t)(p0[1] * w0 + p1[1] * w1);
+        dst[x * 3 + 2] = (uint16_t)(p0[2] * w0 + p1[2] * w1);
+    }
+}
+
+void color_blend_rows(uint8_t *dst, const uint16_t *row0, const uint16_t *row1, uint32_t fy, int count)
+{
+    uint32_t w0 = 256 - fy;
+
+    for (int i = 0; i < count; i++)
+        dst[i] = (uint8_t)((row0[i] * w0 + row1[i] * fy + 32768) >> 16);
+}
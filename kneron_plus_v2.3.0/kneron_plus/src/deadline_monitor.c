@@ -0,0 +1,175 @@
+/**
+ * @file        deadline_monitor.c
+ * @brief       track frames sent with a deadline until their results or drop reports are received
+ * @version     0.1
+ * @date        2024-06-12
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+// #define DEBUG_PRINT
+
+#include <stdio.h>
+#include <string.h>
+
+#include "deadline_monitor.h"
+
+#ifdef DEBUG_PRINT
+#define dbg_print(format, ...) { printf(format, ##__VA_ARGS__); fflush(stdout); }
+#else
+#define dbg_print(format, ...)
+#endif
+
+// the oldest frame in flight with the inference number, NULL if none
+static _kp_deadline_frame_t *find_frame(_kp_deadline_monitor_t *mon, uint32_t inference_number)
+{
+    _kp_deadline_frame_t *found = NULL;
+
+    for (int i = 0; i < MAX_DEADLINE_FRAME; i++)
+    {
+        _kp_deadline_frame_t *frame = &mon->frame[i];
+
+        if (frame->used && frame->inference_number == inference_number &&
+            (NULL == found || (int32_t)(frame->seq - found->seq) < 0))
+            found = frame;
+    }
+
+    return found;
+}
+
+void deadline_monitor_init(_kp_devices_group_t *devices_grp)
+{
+    _kp_deadline_monitor_t *mon = &devices_grp->deadline_monitor;
+
+    memset(mon, 0, sizeof(_kp_deadline_monitor_t));
+
+    pthread_mutex_init(&mon->mutex, NULL);
+}
+
+void deadline_monitor_release(_kp_devices_group_t *devices_grp)
+{
+    pthread_mutex_destroy(&devices_grp->deadline_monitor.mutex);
+}
+
+void deadline_monitor_reset(_kp_devices_group_t *devices_grp)
+{
+    _kp_deadline_monitor_t *mon = &devices_grp->deadline_monitor;
+
+    pthread_mutex_lock(&mon->mutex);
+    memset(mon->frame, 0, sizeof(mon->frame));
+    pthread_mutex_unlock(&mon->mutex);
+}
+
+void deadline_monitor_add(_kp_devices_group_t *devices_grp, uint32_t inference_number, uint32_t lane, kp_inference_deadline_t *deadline)
+{
+    _kp_deadline_monitor_t *mon = &devices_grp->deadline_monitor;
+    _kp_deadline_frame_t *slot = NULL;
+
+    pthread_mutex_lock(&mon->mutex);
+
+    // a frame whose result is never read is given up when the table is full
+    for (int i = 0; i < MAX_DEADLINE_FRAME; i++)
+    {
+        _kp_deadline_frame_t *frame = &mon->frame[i];
+
+        if (false == frame->used)
+        {
+            slot = frame;
+            break;
+        }
+
+        if (NULL == slot || (int32_t)(frame->seq - slot->seq) < 0)
+            slot = frame;
+    }
+
+    if (slot->used)
+        dbg_print("[%s] give up inference %u\n", __func__, slot->inference_number);
+
+    slot->used = true;
+    slot->inference_number = inference_number;
+    slot->lane = lane;
+    slot->seq = mon->seq++;
+    slot->capture_us = deadline->capture_time_us;
+    slot->deadline_us = deadline->deadline_us;
+
+    mon->stats[lane].sent++;
+
+    pthread_mutex_unlock(&mon->mutex);
+}
+
+void deadline_monitor_cancel(_kp_devices_group_t *devices_grp, uint32_t inference_number)
+{
+    _kp_deadline_monitor_t *mon = &devices_grp->deadline_monitor;
+
+    pthread_mutex_lock(&mon->mutex);
+
+    _kp_deadline_frame_t *frame = find_frame(mon, inference_number);
+
+    if (NULL != frame)
+    {
+        frame->used = false;
+        mon->stats[frame->lane].sent--;
+    }
+
+    pthread_mutex_unlock(&mon->mutex);
+}
+
+void deadline_monitor_done(_kp_devices_group_t *devices_grp, uint32_t inference_number, uint64_t now_us, uint32_t drop_reason)
+{
+    _kp_deadline_monitor_t *mon = &devices_grp->deadline_monitor;
+
+    pthread_mutex_lock(&mon->mutex);
+
+    _kp_deadline_frame_t *frame = find_frame(mon, inference_number);
+
+    if (NULL == frame)
+    {
+        pthread_mutex_unlock(&mon->mutex);
+        return;
+    }
+
+    kp_inference_deadline_stats_t *stats = &mon->stats[frame->lane];
+
+    frame->used = false;
+
+    if (KP_INFERENCE_DROP_EXPIRED == drop_reason)
+    {
+        stats->dropped_expired++;
+    }
+    else if (KP_INFERENCE_DROP_UNREACHABLE == drop_reason)
+    {
+        stats->dropped_unreachable++;
+    }
+    else
+    {
+        uint64_t latency_us = (now_us > frame->capture_us) ? now_us - frame->capture_us : 0;
+
+        stats->completed++;
+        if (now_us > frame->deadline_us)
+            stats->missed++;
+
+        mon->latency_sum_us[frame->lane] += latency_us;
+        if (latency_us > stats->max_latency_us)
+            stats->max_latency_us = (uint32_t)latency_us;
+    }
+
+    pthread_mutex_unlock(&mon->mutex);
+}
+
+void deadline_monitor_get_statistics(_kp_devices_group_t *devices_grp, uint32_t lane, kp_inference_deadline_stats_t *stats, bool reset)
+{
+    _kp_deadline_monitor_t *mon = &devices_grp->deadline_monitor;
+
+    pthread_mutex_lock(&mon->mutex);
+
+    *stats = mon->stats[lane];
+    stats->avg_latency_us = (0 < stats->completed) ? (uint32_t)(mon->latency_sum_us[lane] / stats->completed) : 0;
+
+    if (reset)
+    {
+        memset(&mon->stats[lane], 0, sizeof(kp_inference_deadline_stats_t));
+        mon->latency_sum_us[lane] = 0;
+    }
+
+    pthread_mutex_unlock(&mon->mutex);
+}
@@ -0,0 +1,416 @@
+/**
+ * @file        group_scheduler.c
+ * @brief       distribute inference frames among devices of a device group
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+// #define DEBUG_PRINT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "group_scheduler.h"
+#include "kdp2_ipc_cmd.h"
+
+#ifdef DEBUG_PRINT
+#define dbg_print(format, ...) { printf(format, ##__VA_ARGS__); fflush(stdout); }
+#else
+#define dbg_print(format, ...)
+#endif
+
+static void cancel_posted_reads(_kp_group_scheduler_t *sched, int num_device)
+{
+    for (int i = 0; i < num_device; i++)
+    {
+        if (sched->recv_posted[i])
+        {
+            kp_usb_async_cancel(&sched->recv_req[i]);
+            kp_usb_async_complete(&sched->recv_req[i], NULL);
+            sched->recv_posted[i] = false;
+        }
+    }
+}
+
+// reads are posted only while group_scheduler_receive() waits, otherwise they would take the responses of commands
+// a transfer which is already (partly) received when its read is cancelled is kept for the next receive
+static void drain_posted_reads(_kp_devices_group_t *devices_grp)
+{
+    _kp_group_scheduler_t *sched = &devices_grp->scheduler;
+
+    for (int i = 0; i < devices_grp->num_device; i++)
+    {
+        if (!sched->recv_posted[i])
+            continue;
+
+        int recv_size = 0;
+
+        kp_usb_async_cancel(&sched->recv_req[i]);
+        int ret = kp_usb_async_complete(&sched->recv_req[i], &recv_size);
+        sched->recv_posted[i] = false;
+
+        if (0 == recv_size)
+            continue;
+
+        if (ret != KP_USB_RET_OK)
+        {
+            // cancelled in the middle of the transfer, the rest is still on the device
+            ret = kp_usb_read_data(devices_grp->ll_device[i], sched->recv_buf[i] + recv_size, sched->recv_buf_size[i] - recv_size, devices_grp->timeout);
+            if (ret < 0)
+            {
+                dbg_print("[%s] device %d: read the rest of a cancelled transfer failed %d\n", __func__, i, ret);
+                continue;
+            }
+
+            recv_size += ret;
+        }
+
+        sched->recv_ready[i] = recv_size;
+    }
+}
+
+static int ensure_recv_buf(_kp_group_scheduler_t *sched, int dev_idx, uint32_t size)
+{
+    if (sched->recv_buf_size[dev_idx] < size)
+    {
+        uint8_t *recv_buf = (uint8_t *)realloc(sched->recv_buf[dev_idx], size);
+        if (NULL == recv_buf)
+            return KP_USB_USB_NO_MEM;
+
+        sched->recv_buf[dev_idx] = recv_buf;
+        sched->recv_buf_size[dev_idx] = size;
+    }
+
+    return KP_USB_RET_OK;
+}
+
+// copy the next pending result of a coalesced transfer to 'buf'
+static int take_pending_result(_kp_group_scheduler_t *sched, int dev_idx, uint8_t *buf, uint32_t buf_size)
+{
+    uint8_t *result = sched->pending_buf[dev_idx] + sched->pending_offset[dev_idx];
+    uint32_t remaining = sched->pending_end[dev_idx] - sched->pending_offset[dev_idx];
+    uint32_t result_size = ((kp_inference_header_stamp_t *)result)->total_size;
+
+    if (remaining < sizeof(kp_inference_header_stamp_t) || result_size < sizeof(kp_inference_header_stamp_t) || result_size > remaining)
+    {
+        dbg_print("[%s] device %d: broken coalesced transfer\n", __func__, dev_idx);
+        sched->pending_offset[dev_idx] = 0;
+        return KP_USB_USB_IO;
+    }
+
+    // the result stays pending, it can be taken again with a larger buffer
+    if (result_size > buf_size)
+        return KP_USB_USB_OVERFLOW;
+
+    memcpy(buf, result, result_size);
+
+    sched->pending_offset[dev_idx] += (result_size + 3) & ~3;
+    if (sched->pending_offset[dev_idx] >= sched->pending_end[dev_idx])
+        sched->pending_offset[dev_idx] = 0;
+
+    return KP_USB_RET_OK;
+}
+
+// copy a transfer received in recv_buf to 'buf', results of a coalesced transfer are returned one by one
+static int take_received(_kp_group_scheduler_t *sched, int dev_idx, int recv_size, uint8_t *buf, uint32_t buf_size)
+{
+    kp_inference_header_stamp_t *stamp = (kp_inference_header_stamp_t *)sched->recv_buf[dev_idx];
+
+    if ((uint32_t)recv_size >= sizeof(kdp2_ipc_coalesced_result_t) && KDP2_MAGIC_TYPE_COALESCED_RESULT == stamp->magic_type)
+    {
+        if (stamp->total_size > (uint32_t)recv_size)
+            return KP_USB_USB_IO;
+
+        // swap buffers rather than copy, the next read goes to the old pending buffer
+        uint8_t *pending_buf = sched->pending_buf[dev_idx];
+        uint32_t pending_buf_size = sched->pending_buf_size[dev_idx];
+
+        sched->pending_buf[dev_idx] = sched->recv_buf[dev_idx];
+        sched->pending_buf_size[dev_idx] = sched->recv_buf_size[dev_idx];
+        sched->pending_offset[dev_idx] = sizeof(kdp2_ipc_coalesced_result_t);
+        sched->pending_end[dev_idx] = stamp->total_size;
+
+        sched->recv_buf[dev_idx] = pending_buf;
+        sched->recv_buf_size[dev_idx] = pending_buf_size;
+
+        return take_pending_result(sched, dev_idx, buf, buf_size);
+    }
+
+    if ((uint32_t)recv_size > buf_size)
+        return KP_USB_USB_OVERFLOW;
+
+    memcpy(buf, sched->recv_buf[dev_idx], recv_size);
+
+    return KP_USB_RET_OK;
+}
+
+static int get_num_inflight(_kp_group_scheduler_t *sched, int dev_idx)
+{
+    pthread_mutex_lock(&sched->mutex);
+    int num_inflight = sched->num_inflight[dev_idx];
+    pthread_mutex_unlock(&sched->mutex);
+
+    return num_inflight;
+}
+
+void group_scheduler_init(_kp_devices_group_t *devices_grp)
+{
+    _kp_group_scheduler_t *sched = &devices_grp->scheduler;
+
+    memset(sched, 0, sizeof(_kp_group_scheduler_t));
+
+    sched->mode = KP_GROUP_SCHEDULING_ROUND_ROBIN;
+    pthread_mutex_init(&sched->mutex, NULL);
+    pthread_mutex_init(&sched->recv_notify.mutex, NULL);
+    pthread_cond_init(&sched->recv_notify.cond, NULL);
+
+    for (int i = 0; i < MAX_GROUP_DEVICE; i++)
+        kp_usb_async_request_init(&sched->recv_req[i]);
+}
+
+void group_scheduler_release(_kp_devices_group_t *devices_grp)
+{
+    _kp_group_scheduler_t *sched = &devices_grp->scheduler;
+
+    cancel_posted_reads(sched, devices_grp->num_device);
+
+    for (int i = 0; i < MAX_GROUP_DEVICE; i++)
+    {
+        kp_usb_async_request_release(&sched->recv_req[i]);
+        free(sched->recv_buf[i]);
+        sched->recv_buf[i] = NULL;
+        sched->recv_buf_size[i] = 0;
+        free(sched->pending_buf[i]);
+        sched->pending_buf[i] = NULL;
+        sched->pending_buf_size[i] = 0;
+    }
+
+    pthread_cond_destroy(&sched->recv_notify.cond);
+    pthread_mutex_destroy(&sched->recv_notify.mutex);
+    pthread_mutex_destroy(&sched->mutex);
+}
+
+int group_scheduler_set_mode(_kp_devices_group_t *devices_grp, kp_group_scheduling_t mode)
+{
+    if (KP_GROUP_SCHEDULING_ROUND_ROBIN != mode && KP_GROUP_SCHEDULING_LEAST_LOADED != mode)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    group_scheduler_reset(devices_grp);
+    devices_grp->scheduler.mode = mode;
+
+    return KP_SUCCESS;
+}
+
+void group_scheduler_reset(_kp_devices_group_t *devices_grp)
+{
+    _kp_group_scheduler_t *sched = &devices_grp->scheduler;
+
+    cancel_posted_reads(sched, devices_grp->num_device);
+
+    pthread_mutex_lock(&sched->mutex);
+    memset(sched->num_inflight, 0, sizeof(sched->num_inflight));
+    pthread_mutex_unlock(&sched->mutex);
+
+    memset(sched->pending_offset, 0, sizeof(sched->pending_offset));
+    memset(sched->recv_ready, 0, sizeof(sched->recv_ready));
+
+    devices_grp->cur_send = 0;
+    devices_grp->cur_recv = 0;
+}
+
+int group_scheduler_begin_send(_kp_devices_group_t *devices_grp)
+{
+    _kp_group_scheduler_t *sched = &devices_grp->scheduler;
+    int dev_idx = devices_grp->cur_send;
+
+    if (KP_GROUP_SCHEDULING_LEAST_LOADED == sched->mode)
+    {
+        pthread_mutex_lock(&sched->mutex);
+
+        // start searching from the next device in turn so that idle devices are used evenly
+        for (int i = 1; i < devices_grp->num_device; i++)
+        {
+            int idx = (devices_grp->cur_send + i) % devices_grp->num_device;
+
+            if (sched->num_inflight[idx] < sched->num_inflight[dev_idx])
+                dev_idx = idx;
+        }
+
+        // count it before sending, the result may be received before the send call returns
+        sched->num_inflight[dev_idx]++;
+
+        pthread_mutex_unlock(&sched->mutex);
+    }
+
+    devices_grp->cur_send = dev_idx + 1;
+
+    if (devices_grp->cur_send >= devices_grp->num_device)
+        devices_grp->cur_send = 0;
+
+    return dev_idx;
+}
+
+void group_scheduler_end_send(_kp_devices_group_t *devices_grp, int dev_idx, bool success)
+{
+    _kp_group_scheduler_t *sched = &devices_grp->scheduler;
+
+    if (KP_GROUP_SCHEDULING_LEAST_LOADED == sched->mode && !success)
+    {
+        pthread_mutex_lock(&sched->mutex);
+        sched->num_inflight[dev_idx]--;
+        pthread_mutex_unlock(&sched->mutex);
+    }
+}
+
+int group_scheduler_receive(_kp_devices_group_t *devices_grp, uint8_t *buf, uint32_t buf_size, int *dev_idx)
+{
+    _kp_group_scheduler_t *sched = &devices_grp->scheduler;
+    int timeout = devices_grp->timeout;
+    int ret;
+
+    // a read may bring a coalesced transfer which is larger than one result
+    uint32_t read_size = (buf_size > sched->coalesce_size) ? buf_size : sched->coalesce_size;
+
+    if (KP_GROUP_SCHEDULING_LEAST_LOADED != sched->mode)
+    {
+        kp_usb_async_request_t usb_req;
+        int recv_len = 0;
+
+        *dev_idx = devices_grp->cur_recv;
+
+        if (0 != sched->pending_offset[*dev_idx])
+            return take_pending_result(sched, *dev_idx, buf, buf_size);
+
+        // without coalescing the result is read to 'buf' directly
+        uint8_t *recv_buf = buf;
+
+        if (0 < sched->coalesce_size)
+        {
+            ret = ensure_recv_buf(sched, *dev_idx, read_size);
+            if (ret != KP_USB_RET_OK)
+                return ret;
+
+            recv_buf = sched->recv_buf[*dev_idx];
+        }
+
+        kp_usb_async_request_init(&usb_req);
+
+        // the chunks of a large result are queued by the usb event handler as soon as the previous one is full
+        ret = kp_usb_async_submit_read(devices_grp->ll_device[*dev_idx], &usb_req, (void *)recv_buf, (recv_buf == buf) ? buf_size : read_size, timeout);
+        if (ret == KP_USB_RET_OK)
+            ret = kp_usb_async_complete(&usb_req, &recv_len);
+
+        kp_usb_async_request_release(&usb_req);
+
+        if (ret == KP_USB_RET_OK && recv_buf != buf)
+            ret = take_received(sched, *dev_idx, recv_len, buf, buf_size);
+
+        return ret;
+    }
+
+    // results already received in a coalesced transfer or by a cancelled read come first
+    for (int i = 0; i < devices_grp->num_device; i++)
+    {
+        if (0 != sched->pending_offset[i])
+        {
+            *dev_idx = i;
+            return take_pending_result(sched, i, buf, buf_size);
+        }
+
+        if (0 != sched->recv_ready[i])
+        {
+            uint32_t recv_size = sched->recv_ready[i];
+
+            sched->recv_ready[i] = 0;
+            *dev_idx = i;
+            return take_received(sched, i, recv_size, buf, buf_size);
+        }
+    }
+
+    // post one read on every device and take whichever completes first, the others are cancelled before it returns
+    kp_usb_async_notify_t *notify = devices_grp->usb_event_handler.running ? &sched->recv_notify : NULL;
+    kp_usb_async_request_t *reqs[MAX_GROUP_DEVICE];
+    int idx = 0;
+    int recv_size = 0;
+
+    while (1)
+    {
+        ret = KP_USB_RET_OK;
+
+        for (int i = 0; i < devices_grp->num_device; i++)
+        {
+            if (!sched->recv_posted[i])
+            {
+                ret = ensure_recv_buf(sched, i, read_size);
+                if (ret != KP_USB_RET_OK)
+                    break;
+
+                sched->recv_req[i].notify = notify;
+
+                ret = kp_usb_async_submit_read(devices_grp->ll_device[i], &sched->recv_req[i], sched->recv_buf[i], sched->recv_buf_size[i], timeout);
+                if (ret != KP_USB_RET_OK)
+                    break;
+
+                sched->recv_posted[i] = true;
+            }
+
+            reqs[i] = &sched->recv_req[i];
+        }
+
+        if (ret != KP_USB_RET_OK)
+            break;
+
+        idx = kp_usb_async_wait_any(notify, reqs, devices_grp->num_device, timeout);
+        if (idx < 0)
+        {
+            ret = idx;
+            break;
+        }
+
+        ret = kp_usb_async_complete(&sched->recv_req[idx], &recv_size);
+        sched->recv_posted[idx] = false;
+
+        if (ret == KP_USB_USB_TIMEOUT && 0 == get_num_inflight(sched, idx))
+        {
+            dbg_print("[%s] device %d is idle, read it again\n", __func__, idx);
+            continue;
+        }
+
+        break;
+    }
+
+    drain_posted_reads(devices_grp);
+
+    if (ret != KP_USB_RET_OK)
+        return ret;
+
+    *dev_idx = idx;
+
+    return take_received(sched, idx, recv_size, buf, buf_size);
+}
+
+void group_scheduler_end_receive(_kp_devices_group_t *devices_grp, int dev_idx, bool is_last_crop)
+{
+    _kp_group_scheduler_t *sched = &devices_grp->scheduler;
+
+    if (!is_last_crop)
+        return;
+
+    if (KP_GROUP_SCHEDULING_LEAST_LOADED == sched->mode)
+    {
+        pthread_mutex_lock(&sched->mutex);
+        if (sched->num_inflight[dev_idx] > 0)
+            sched->num_inflight[dev_idx]--;
+        pthread_mutex_unlock(&sched->mutex);
+    }
+    else
+    {
+        devices_grp->cur_recv++;
+
+        if (devices_grp->cur_recv >= devices_grp->num_device)
+            devices_grp->cur_recv = 0;
+    }
+}
@@ -0,0 +1,49 @@
+/**
+ * @file        color_convert.h
+ * @brief       color conversion and resize kernels for host image conversion
+ * @version     0.1
+ * @date        2024-06-10
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#ifndef __COLOR_CONVERT_H__
+#define __COLOR_CONVERT_H__
+
+#include <stdint.h>
+
+/**
+ * Kernels are selected on first use according to the host CPU (AVX2 or SSE4.1 on x86, NEON on ARM, C otherwise).
+ * Every kernel gives the same bytes, the fixed-point math of the C kernels is the reference:
+ *   Y  = (77 R + 150 G + 29 B + 128) >> 8
+ *   Cb = saturate_u8(((128 B - 43 R - 85 G + 128) >> 8) + 128)
+ *   Cr = saturate_u8(((128 R - 107 G - 21 B + 128) >> 8) + 128)
+ * Cb/Cr of YCbCr422 take the average (a + b + 1) >> 1 of 2 pixels, YUV420 averages the averages of 2 rows again.
+ *
+ * Source rows are 3 bytes per pixel, B, G, R order if 'swap_rb' is 0, R, G, B order otherwise.
+ */
+
+// RGB565 in little-endian 16 bits: R[15:11] G[10:5] B[4:0]
+void color_convert_row_rgb565(uint8_t *dst, const uint8_t *src, int width, int swap_rb);
+
+// R, G, B, 0 bytes per pixel
+void color_convert_row_rgba8888(uint8_t *dst, const uint8_t *src, int width, int swap_rb);
+
+// Y only
+void color_convert_row_raw8(uint8_t *dst, const uint8_t *src, int width, int swap_rb);
+
+// 4 bytes per 2 pixels, byte i of every 4 bytes is component order[i] of (y0, cb, y1, cr), width is even
+void color_convert_row_ycbcr422(uint8_t *dst, const uint8_t *src, int width, int swap_rb, const uint8_t *order);
+
+// 2 rows of Y plus 1 row of U (Cb) and V (Cr) with half width, width is even
+void color_convert_rows_yuv420(uint8_t *dst_y0, uint8_t *dst_y1, uint8_t *dst_u, uint8_t *dst_v,
+                               const uint8_t *src0, const uint8_t *src1, int width, int swap_rb);
+
+// horizontal bilinear resample of one 3 bytes per pixel row, weights are 8-bit fixed point
+// dst[x * 3 + c] = src[xofs0[x] + c] * (256 - fx[x]) + src[xofs1[x] + c] * fx[x]
+void color_resample_row(uint16_t *dst, const uint8_t *src, const int32_t *xofs0, const int32_t *xofs1, const uint16_t *fx, int width);
+
+// vertical blend of 2 resampled rows of 'count' bytes, dst[i] = (row0[i] * (256 - fy) + row1[i] * fy + 32768) >> 16
+void color_blend_rows(uint8_t *dst, const uint16_t *row0, const uint16_t *row1, uint32_t fy, int count);
+
+#endif
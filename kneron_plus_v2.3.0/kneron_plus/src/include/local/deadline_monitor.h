@@ -0,0 +1,31 @@
+/**
+ * @file        deadline_monitor.h
+ * @brief       track frames sent with a deadline until their results or drop reports are received
+ * @version     0.1
+ * @date        2024-06-12
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#ifndef __DEADLINE_MONITOR_H__
+#define __DEADLINE_MONITOR_H__
+
+#include "kp_internal.h"
+
+void deadline_monitor_init(_kp_devices_group_t *devices_grp);
+void deadline_monitor_release(_kp_devices_group_t *devices_grp);
+
+// forget frames in flight, it is needed when the device FIFO queues are flushed
+void deadline_monitor_reset(_kp_devices_group_t *devices_grp);
+
+// a frame is added before it is sent, deadline_monitor_cancel() takes it back if the sending fails
+void deadline_monitor_add(_kp_devices_group_t *devices_grp, uint32_t inference_number, uint32_t lane, kp_inference_deadline_t *deadline);
+void deadline_monitor_cancel(_kp_devices_group_t *devices_grp, uint32_t inference_number);
+
+// the result of a frame is received at 'now_us' or the frame is dropped by the device for 'drop_reason' (0 for not dropped)
+// frames not sent with a deadline are ignored
+void deadline_monitor_done(_kp_devices_group_t *devices_grp, uint32_t inference_number, uint64_t now_us, uint32_t drop_reason);
+
+void deadline_monitor_get_statistics(_kp_devices_group_t *devices_grp, uint32_t lane, kp_inference_deadline_stats_t *stats, bool reset);
+
+#endif
@@ -0,0 +1,34 @@
+/**
+ * @file        group_scheduler.h
+ * @brief       distribute inference frames among devices of a device group
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#ifndef __GROUP_SCHEDULER_H__
+#define __GROUP_SCHEDULER_H__
+
+#include "kp_internal.h"
+
+void group_scheduler_init(_kp_devices_group_t *devices_grp);
+void group_scheduler_release(_kp_devices_group_t *devices_grp);
+
+// return KP_SUCCESS or KP_ERROR_INVALID_PARAM_12
+int group_scheduler_set_mode(_kp_devices_group_t *devices_grp, kp_group_scheduling_t mode);
+
+// cancel pending reads and forget frames in flight, it is needed before the device FIFO queues are reset
+void group_scheduler_reset(_kp_devices_group_t *devices_grp);
+
+// return the device index for the next frame, group_scheduler_end_send() must follow
+int group_scheduler_begin_send(_kp_devices_group_t *devices_grp);
+void group_scheduler_end_send(_kp_devices_group_t *devices_grp, int dev_idx, bool success);
+
+// receive one result into 'buf', return 0 (KP_USB_RET_OK) or usb error code
+// 'dev_idx' tells which device it came from, group_scheduler_end_receive() must follow on success
+// no read is left pending on the devices when it returns, so commands can be issued between receives
+int group_scheduler_receive(_kp_devices_group_t *devices_grp, uint8_t *buf, uint32_t buf_size, int *dev_idx);
+void group_scheduler_end_receive(_kp_devices_group_t *devices_grp, int dev_idx, bool is_last_crop);
+
+#endif
@@ -10,9 +10,53 @@
 #pragma once
 
 #include "kp_usb.h"
+#include "kp_update_flash.h"
 
 #define MAX_GROUP_DEVICE 20
 
+// state of result receiving, least-loaded scheduling (KP_GROUP_SCHEDULING_LEAST_LOADED) and result coalescing
+typedef struct
+{
+    kp_group_scheduling_t mode;
+    pthread_mutex_t mutex;                              // protect num_inflight
+    int num_inflight[MAX_GROUP_DEVICE];                 // frames sent but the last result not yet received
+    bool recv_posted[MAX_GROUP_DEVICE];                 // a read is pending in recv_req
+    kp_usb_async_request_t recv_req[MAX_GROUP_DEVICE];
+    uint8_t *recv_buf[MAX_GROUP_DEVICE];
+    uint32_t recv_buf_size[MAX_GROUP_DEVICE];
+    uint32_t recv_ready[MAX_GROUP_DEVICE];              // size of a transfer read into recv_buf but not yet returned, 0 for none
+    kp_usb_async_notify_t recv_notify;
+    uint32_t coalesce_size;                             // maximum size of a coalesced transfer, 0 for coalescing disabled
+    uint8_t *pending_buf[MAX_GROUP_DEVICE];             // coalesced transfer with results not yet returned
+    uint32_t pending_buf_size[MAX_GROUP_DEVICE];
+    uint32_t pending_offset[MAX_GROUP_DEVICE];          // offset of the next result in pending_buf, 0 for none
+    uint32_t pending_end[MAX_GROUP_DEVICE];
+} _kp_group_scheduler_t;
+
+#define MAX_DEADLINE_FRAME 64
+
+// a frame sent with a deadline whose result is not yet received
+typedef struct
+{
+    bool used;
+    uint32_t inference_number;
+    uint32_t lane;
+    uint32_t seq;                                       // send order, frames of the same inference number are matched oldest first
+    uint64_t capture_us;
+    uint64_t deadline_us;
+} _kp_deadline_frame_t;
+
+// frames sent by kp_generic_image_inference_send_with_deadline() and their drop and latency counters
+typedef struct
+{
+    bool drop_enabled;                                  // deadline drop is enabled on the devices
+    pthread_mutex_t mutex;                              // protect all below
+    uint32_t seq;
+    _kp_deadline_frame_t frame[MAX_DEADLINE_FRAME];
+    kp_inference_deadline_stats_t stats[KP_MAX_INFERENCE_LANE];
+    uint64_t latency_sum_us[KP_MAX_INFERENCE_LANE];
+} _kp_deadline_monitor_t;
+
 typedef struct
 {
     // public
@@ -25,7 +69,15 @@ typedef struct
     // private
     int cur_send; // record current sending device index
     int cur_recv; // record current receiving device index
+    kp_inference_send_mode_t send_mode;
+    kp_flash_update_mode_t flash_update_mode;
+    char flash_journal_dir[KP_FLASH_JOURNAL_DIR_MAX_LEN]; // empty for no journal
+    uint32_t flash_stream_window;
+    uint32_t flash_stream_chunk_size; // 0 for the device to choose
     kp_usb_device_t *ll_device[MAX_GROUP_DEVICE];
+    kp_usb_event_handler_t usb_event_handler; // handle async usb transfers in background
+    _kp_group_scheduler_t scheduler;
+    _kp_deadline_monitor_t deadline_monitor;
 
 } _kp_devices_group_t;
 
@@ -0,0 +1,35 @@
+/**
+ * @file        kp_trace_internal.h
+ * @brief       tracing hooks of the host inference path
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#ifndef __KP_TRACE_INTERNAL_H__
+#define __KP_TRACE_INTERNAL_H__
+
+#include <stdint.h>
+
+#include "kp_trace.h"
+
+extern int _kp_trace_enabled;
+
+uint64_t kp_trace_now_ns(void);
+void kp_trace_record(kp_trace_stage_t stage, uint64_t begin_ns, uint64_t end_ns, uint32_t arg);
+
+// return the begin timestamp of a call, or 0 if tracing is disabled
+static inline uint64_t kp_trace_begin(void)
+{
+    return __atomic_load_n(&_kp_trace_enabled, __ATOMIC_RELAXED) ? kp_trace_now_ns() : 0;
+}
+
+// record a call started by kp_trace_begin(), 'arg' is shown in the Chrome trace (ex. bytes or node index)
+static inline void kp_trace_end(kp_trace_stage_t stage, uint64_t begin_ns, uint32_t arg)
+{
+    if (begin_ns != 0)
+        kp_trace_record(stage, begin_ns, kp_trace_now_ns(), arg);
+}
+
+#endif
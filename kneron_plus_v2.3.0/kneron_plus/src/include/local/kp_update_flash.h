@@ -14,6 +14,53 @@
 
 #include "kp_struct.h"
 
+/**
+ * @brief how images are written to flash by kp_update_kdp2_firmware() (KL520) and kp_update_model() (KL520, KL720).
+ */
+typedef enum
+{
+    KP_FLASH_UPDATE_MODE_FULL = 0,          /**< erase and write the whole image (default) */
+    KP_FLASH_UPDATE_MODE_SECTOR_DIFF = 1,   /**< compare per-sector CRC32 with the flash, erase and write only sectors which differ */
+} kp_flash_update_mode_t;
+
+#define KP_FLASH_JOURNAL_DIR_MAX_LEN 256    /**< maximum length of the journal directory path */
+
+/**
+ * @brief Set how images are written to flash.
+ *
+ * In KP_FLASH_UPDATE_MODE_SECTOR_DIFF, written sectors are verified by CRC32 read back from the device.
+ * If 'journal_dir' is given, the progress of each device is kept in a journal file there until the update succeeds,
+ * so an interrupted update of the same image resumes without comparing the whole flash again.
+ * Devices running firmware without the flash digest command fall back to KP_FLASH_UPDATE_MODE_FULL.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] mode refer to kp_flash_update_mode_t.
+ * @param[in] journal_dir directory of journal files, NULL for no journal.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h.
+ */
+int kp_set_flash_update_mode(kp_device_group_t devices, kp_flash_update_mode_t mode, const char *journal_dir);
+
+#define KP_FLASH_STREAM_DEFAULT_WINDOW 2    /**< chunks in flight of a flash write stream by default, the device double buffers them */
+#define KP_FLASH_STREAM_MAX_WINDOW 8        /**< maximum chunks in flight of a flash write stream */
+
+/**
+ * @brief Set how images are streamed to flash.
+ *
+ * Images are sent in chunks with CRC32, the device receives the next chunks into DDR while it erases and programs the
+ * current one, and acknowledges each chunk with the CRC32 read back from flash.
+ * Up to 'window' chunks are sent before the first of them is acknowledged, the device may lower 'window' and 'chunk_size'
+ * to fit its FIFO queue input buffers.
+ * Devices running firmware without the flash write stream command fall back to writing the whole image at once.
+ *
+ * @param[in] devices a set of devices handle.
+ * @param[in] window number of chunks in flight, 1 to KP_FLASH_STREAM_MAX_WINDOW.
+ * @param[in] chunk_size bytes of one chunk, 0 to let the device choose.
+ *
+ * @return refer to KP_API_RETURN_CODE in kp_struct.h.
+ */
+int kp_set_flash_stream_config(kp_device_group_t devices, uint32_t window, uint32_t chunk_size);
+
 int kp_update_kdp2_firmware(kp_device_group_t devices, void *scpu_fw_buf, int scpu_fw_size,
                             void *ncpu_fw_buf, int ncpu_fw_size, bool auto_reboot);
 
@@ -19,6 +19,10 @@
 
 // kdp2 Low Level API
 
+#define KP_USB_ASYNC_MAX_TXFER 16 // maximum number of bulk transfers (chunks) in flight for one async request
+
+struct kp_usb_async_request;
+
 typedef struct
 {
     libusb_device_handle *usb_handle;
@@ -29,8 +33,48 @@ typedef struct
     uint8_t endpoint_cmd_in;
     uint8_t endpoint_cmd_out;
     uint8_t endpoint_log_in;
+    struct kp_usb_async_request *async_recv_req; // pending async read request, protected by mutex_recv
+    uint8_t *staging_buf;     // joins header and data into one bulk transfer, protected by mutex_send
+    int staging_buf_size;
+    bool staging_buf_dev_mem; // allocated by libusb_dev_mem_alloc()
 } kp_usb_device_t;
 
+// signaled whenever an attached request completes, used to wait for any of several requests
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} kp_usb_async_notify_t;
+
+// one asynchronous bulk read or write, the data buffer is split into chunks which are queued on the endpoint
+typedef struct kp_usb_async_request
+{
+    kp_usb_device_t *dev;
+    bool is_out;
+    uint8_t *buf;
+    int length;
+    int actual_length;
+    int max_psize;
+    int num_submitted; // number of submitted transfers
+    int num_inflight;  // number of transfers not yet called back
+    int status;        // kp_usb_status_t
+    bool zlp_stage;    // read path is receiving the zero length packet
+    uint64_t zlp_begin_ns; // when the zero length packet started, for tracing
+    int completed;     // set to 1 when all transfers are done
+    uint32_t zlp_buf;
+    pthread_mutex_t mutex;
+    kp_usb_async_notify_t *notify; // optional, NULL if not used
+    struct libusb_transfer *txfer[KP_USB_ASYNC_MAX_TXFER + 1]; // one more for (fake) ZLP
+} kp_usb_async_request_t;
+
+// background libusb event handling, one per device group
+typedef struct
+{
+    pthread_t thread;
+    int stop;
+    bool running;
+} kp_usb_event_handler_t;
+
 typedef enum
 {
     KP_USB_RET_OK = 0,
@@ -80,6 +124,12 @@ int kp_usb_control(kp_usb_device_t *dev, kp_usb_control_t *control_request, int
 // timeout in milliseconds, 0 means blocking wait, if timeout it returns KP_USB_USB_TIMEOUT
 int kp_usb_write_data(kp_usb_device_t *dev, void *buf, int len, int timeout);
 
+// same as kp_usb_write_data() but header and data are copied into a staging buffer and sent as one transfer
+int kp_usb_write_data_with_header(kp_usb_device_t *dev, void *header, int header_len, void *buf, int len, int timeout);
+
+// same as kp_usb_write_data_with_header() with a trailer after the data, a (fake) ZLP can not come in between
+int kp_usb_write_data_with_header_trailer(kp_usb_device_t *dev, void *header, int header_len, void *buf, int len, void *trailer, int trailer_len, int timeout);
+
 // return read size on success, or < 0 if failed
 // timeout in milliseconds, 0 means blocking wait, if timeout it returns KP_USB_USB_TIMEOUT
 int kp_usb_read_data(kp_usb_device_t *dev, void *buf, int len, int timeout);
@@ -87,6 +137,32 @@ int kp_usb_read_data(kp_usb_device_t *dev, void *buf, int len, int timeout);
 int kp_usb_endpoint_write_data(kp_usb_device_t *dev, int endpoint, void *buf, int len, int timeout);
 int kp_usb_endpoint_read_data(kp_usb_device_t *dev, int endpoint, void *buf, int len, int timeout);
 
+// asynchronous read/write
+// a request can be reused after kp_usb_async_complete() returns, transfers are allocated once and freed in release
+void kp_usb_async_request_init(kp_usb_async_request_t *req);
+void kp_usb_async_request_release(kp_usb_async_request_t *req);
+
+// return 0 (KP_USB_RET_OK) if all chunks are queued, the data is sent in the same order as submitted
+// data of more than KP_USB_ASYNC_MAX_TXFER chunks is sent synchronously before it returns, the result is still taken by kp_usb_async_complete()
+int kp_usb_async_submit_write(kp_usb_device_t *dev, kp_usb_async_request_t *req, void *buf, int len, int timeout);
+
+// return 0 (KP_USB_RET_OK) if queued, or KP_USB_USB_BUSY if another read is pending on this device
+int kp_usb_async_submit_read(kp_usb_device_t *dev, kp_usb_async_request_t *req, void *buf, int len, int timeout);
+
+// wait for a submitted request, return 0 (KP_USB_RET_OK) on success, or < 0 if failed
+int kp_usb_async_complete(kp_usb_async_request_t *req, int *actual_length);
+
+// cancel a submitted request, kp_usb_async_complete() is still needed to wait for the cancellation
+void kp_usb_async_cancel(kp_usb_async_request_t *req);
+
+// wait until any of the requests attached to 'notify' is completed, return its index or KP_USB_USB_TIMEOUT
+// 'notify' requires a running event handler, if it is NULL the caller handles libusb events by itself
+int kp_usb_async_wait_any(kp_usb_async_notify_t *notify, kp_usb_async_request_t *reqs[], int num_req, int timeout);
+
+// start/stop a thread to handle libusb events so transfers progress without a waiting caller
+int kp_usb_event_handler_start(kp_usb_event_handler_t *handler);
+void kp_usb_event_handler_stop(kp_usb_event_handler_t *handler);
+
 int kp_usb_read_firmware_log(kp_usb_device_t *dev, void *buf, int len, int timeout);
 
 #endif
@@ -0,0 +1,28 @@
+/**
+ * @file        node_convert.h
+ * @brief       fixed-point to floating-point conversion kernels for output nodes
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#ifndef __NODE_CONVERT_H__
+#define __NODE_CONVERT_H__
+
+#include <stdint.h>
+
+/**
+ * Kernels are selected on first use according to the host CPU (AVX2/SSE2 on x86, NEON on 64-bit ARM, C otherwise).
+ * Every value is divided by the node conversion factor (scale * 2^radix), so the results are the same as the scalar loops.
+ */
+
+// dst[i] = src[i] / factor, 0 <= i < num
+void node_convert_s8_to_float(float *dst, const int8_t *src, int num, float factor);
+void node_convert_s16_to_float(float *dst, const int16_t *src, int num, float factor);
+
+// dst[j * dst_stride + i] = src[i * src_stride + j] / factor, 0 <= i < rows, 0 <= j < cols
+void node_convert_s8_to_float_transpose(float *dst, int dst_stride, const int8_t *src, int src_stride, int rows, int cols, float factor);
+void node_convert_s16_to_float_transpose(float *dst, int dst_stride, const int16_t *src, int src_stride, int rows, int cols, float factor);
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * @file        node_reduce.h
+ * @brief       fixed-point argmax, top-k and threshold kernels on raw output nodes in NPU data layout
+ * @version     0.1
+ * @date        2024-06-12
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#ifndef __NODE_REDUCE_H__
+#define __NODE_REDUCE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kp_struct.h"
+
+/**
+ * Values are compared in fixed-point in the NPU data layout of the node (16W1C8B, 1W16C8B or 8W1C16B),
+ * only the picked values are divided by 'factor' (the node conversion factor, it must be positive), like node_convert.h.
+ * 'hcw' is the row order of 16W1C8B and 8W1C16B, true for height x channel x width (KL520), false for channel x height x width.
+ * Kernels are selected on first use according to the host CPU (SSE2 on x86, NEON on ARM, C otherwise).
+ */
+
+// class_map[h * width + w] = channel of the maximum value at (h, w), the lowest channel on ties, score_map (can be NULL) = the maximum value
+void node_reduce_argmax(const kp_inf_raw_fixed_node_output_t *node, bool hcw, float factor, uint16_t *class_map, float *score_map);
+
+// elements with value >= threshold in device memory order, returns the number of such elements but stores only the first max_element of them
+uint32_t node_reduce_threshold(const kp_inf_raw_fixed_node_output_t *node, bool hcw, float factor, float threshold,
+                               kp_inf_node_element_t *elements, uint32_t max_element);
+
+// the k largest elements in descending order of value (then channel, row, col), returns the number of stored elements (k or the node size)
+uint32_t node_reduce_top_k(const kp_inf_raw_fixed_node_output_t *node, bool hcw, float factor, uint32_t k, kp_inf_node_element_t *elements);
+
+#endif
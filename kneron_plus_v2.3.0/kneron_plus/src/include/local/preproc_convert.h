@@ -0,0 +1,39 @@
+/**
+ * @file        preproc_convert.h
+ * @brief       resize and quantization kernels for host pre-processing of input nodes
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#ifndef __PREPROC_CONVERT_H__
+#define __PREPROC_CONVERT_H__
+
+#include <stdint.h>
+
+#define PREPROC_MAX_CHANNEL 4
+
+/**
+ * Kernels are selected on first use according to the host CPU (SSE2 on x86, NEON on ARM, C otherwise).
+ * A row of the resized image is kept as 'num_channel' float planes, so the vertical interpolation,
+ * normalization, quantization and NPU re-layout of a row are done by one kernel call.
+ */
+
+// horizontal bilinear resample of one source row into float planes, 0 <= x < width, 0 <= c < num_channel
+// plane[c][x] = p0 + (p1 - p0) * fx[x], p0/p1 are channel c of the pixels at byte offsets xofs0[x]/xofs1[x] of 'src'
+// RGBA8888 is vectorized, RGB565 gives 0 to the 4th channel, RAW8 gives the gray value to every channel
+void preproc_resample_row_rgba8888(float *const *plane, int num_channel, const uint8_t *src,
+                                   const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width);
+void preproc_resample_row_rgb565(float *const *plane, int num_channel, const uint8_t *src,
+                                 const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width);
+void preproc_resample_row_raw8(float *const *plane, int num_channel, const uint8_t *src,
+                               const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width);
+
+// write one row of one channel block in NPU layout, 'block_size' (1, 4 or 16) bytes per column
+// v = row0[c][x] + (row1[c][x] - row0[c][x]) * fy, dst[(pad_left + x) * block_size + c] = saturate_s8(round(v * mul[c] + add[c]))
+// columns outside [pad_left, pad_left + width) of the 'width_align' columns and channels >= num_channel are set to 0
+void preproc_quantize_row(int8_t *dst, int block_size, const float *const *row0, const float *const *row1, float fy,
+                          const float *mul, const float *add, int num_channel, int pad_left, int width, int width_align);
+
+#endif
@@ -2,6 +2,7 @@
 
 #define KDP2_INF_ID_GENERIC_RAW 10
 #define KDP2_INF_ID_GENERIC_RAW_BYPASS_PRE_PROC 17
+#define KDP2_INF_ID_GENERIC_RAW_CROP_BATCH 18
 
 // FIXME ?
 // Parsing KL720 raw output
@@ -155,3 +156,34 @@ typedef struct
 
 // result header for 'Generic RAW inference Bypass Pre-Process'
 typedef kdp2_ipc_generic_raw_result_t kdp2_ipc_generic_raw_bypass_pre_proc_result_t;
+
+// input header for 'Generic RAW inference Crop Batch', the image follows the header
+typedef struct
+{
+    /* header stamp is necessary for data transfer between host and device */
+    kp_inference_header_stamp_t header_stamp;
+    uint32_t inference_number;
+    uint32_t model_id;
+    uint32_t width;
+    uint32_t height;
+    uint32_t resize_mode;
+    uint32_t padding_mode;
+    uint32_t image_format;
+    uint32_t normalize_mode;
+    uint32_t crop_count;
+    kp_inf_crop_box_t inf_crop[MAX_CROP_BATCH_BOX];
+} __attribute__((aligned(4))) kdp2_ipc_generic_raw_crop_batch_inf_header_t;
+
+// result header for 'Generic RAW inference Crop Batch'
+// it is followed by 'crop_count' slots of 'crop_result_size' bytes, one per crop in the order of the input boxes,
+// each slot is a complete 'Generic RAW inference' result (kdp2_ipc_generic_raw_result_t + raw output data)
+typedef struct
+{
+    /* header stamp is necessary for data transfer between host and device */
+    kp_inference_header_stamp_t header_stamp;
+    uint32_t product_id;   // enum kp_product_id_t.
+    uint32_t inf_number;
+    uint32_t crop_count;
+    uint32_t crop_result_size;
+    uint8_t crop_results[];
+} __attribute__((aligned(4))) kdp2_ipc_generic_raw_crop_batch_result_t;
@@ -21,6 +21,8 @@
 
 #include "kp_usb.h"
 #include "kp_internal.h"
+#include "group_scheduler.h"
+#include "deadline_monitor.h"
 #include "kp_update_flash.h"
 
 #include "kp_core.h"
@@ -34,6 +36,11 @@
 
 #ifdef _WIN32
     #include "libwdi.h"
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
 #endif
 
 #ifdef DEBUG_PRINT
@@ -332,9 +339,20 @@ CONNECT_DEVICE:
     _devices_grp->timeout = 0;
     _devices_grp->cur_send = 0;
     _devices_grp->cur_recv = 0;
+    _devices_grp->send_mode = KP_INFERENCE_SEND_MODE_SEPARATE;
+    _devices_grp->flash_update_mode = KP_FLASH_UPDATE_MODE_FULL;
+    _devices_grp->flash_journal_dir[0] = '\0';
+    _devices_grp->flash_stream_window = KP_FLASH_STREAM_DEFAULT_WINDOW;
+    _devices_grp->flash_stream_chunk_size = 0;
     _devices_grp->product_id = first_dev_pid;
     _devices_grp->loaded_model_desc.num_models = 0;
 
+    group_scheduler_init(_devices_grp);
+    deadline_monitor_init(_devices_grp);
+
+    if (KP_USB_RET_OK != kp_usb_event_handler_start(&_devices_grp->usb_event_handler))
+        dbg_print("[%s] usb event handler is not running, async transfers are handled by the waiting caller\n", __func__);
+
     /* Set up fifo queue */
     kp_reset_device((kp_device_group_t)_devices_grp, KP_RESET_INFERENCE);
 
@@ -443,6 +461,10 @@ int kp_disconnect_devices(kp_device_group_t devices)
 
     kp_release_model_nef_descriptor(&(_devices_grp->loaded_model_desc));
 
+    group_scheduler_release(_devices_grp);
+    deadline_monitor_release(_devices_grp);
+    kp_usb_event_handler_stop(&_devices_grp->usb_event_handler);
+
     for (int i = 0; i < _devices_grp->num_device; i++)
         kp_usb_disconnect_device(_devices_grp->ll_device[i]);
 
@@ -457,6 +479,31 @@ void kp_set_timeout(kp_device_group_t devices, int milliseconds)
     _devices_grp->timeout = milliseconds;
 }
 
+int kp_set_group_scheduling(kp_device_group_t devices, kp_group_scheduling_t scheduling)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    if (NULL == _devices_grp)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    return group_scheduler_set_mode(_devices_grp, scheduling);
+}
+
+int kp_set_inference_send_mode(kp_device_group_t devices, kp_inference_send_mode_t send_mode)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    if (NULL == _devices_grp)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if (send_mode != KP_INFERENCE_SEND_MODE_SEPARATE && send_mode != KP_INFERENCE_SEND_MODE_SINGLE_TRANSFER)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    _devices_grp->send_mode = send_mode;
+
+    return KP_SUCCESS;
+}
+
 typedef struct
 {
     kp_usb_device_t *ll_device;
@@ -1237,6 +1284,170 @@ static int check_fw_is_loaded(kp_device_group_t devices)
     return ret;
 }
 
+static int _kp_load_model_to_devices(kp_device_group_t devices, kp_nef_info_t *nef_info)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    uint32_t transfer_size = sizeof(kdp2_ipc_cmd_load_model_t) + nef_info->fw_info_size;
+    kdp2_ipc_cmd_load_model_t *cmd_buf = (kdp2_ipc_cmd_load_model_t *)malloc(transfer_size);
+    if (NULL == cmd_buf)
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    cmd_buf->magic_type = KDP2_MAGIC_TYPE_COMMAND;
+    cmd_buf->total_size = transfer_size;
+    cmd_buf->command_id = KDP2_COMMAND_LOAD_MODEL;
+    cmd_buf->model_size = nef_info->all_models_size;
+    cmd_buf->fw_info_size = nef_info->fw_info_size;
+    memcpy(cmd_buf->fw_info, nef_info->fw_info_addr, nef_info->fw_info_size);
+
+    _load_model_command_package cmd_packs[MAX_GROUP_DEVICE];
+    pthread_t load_model_thd[MAX_GROUP_DEVICE];
+
+    cmd_packs[0].ll_device = _devices_grp->ll_device[0];
+    cmd_packs[0].cmd_buf = cmd_buf;
+    cmd_packs[0].model_buf = nef_info->all_models_addr;
+    cmd_packs[0].timeout = _devices_grp->timeout;
+
+    for (int i = 1; i < _devices_grp->num_device; i++)
+    {
+        memcpy((void *)&cmd_packs[i], (void *)&cmd_packs[0], sizeof(_load_model_command_package));
+        cmd_packs[i].ll_device = _devices_grp->ll_device[i];
+    }
+
+    int ret = _spawn_thread_to_load_model_to_devices(_devices_grp->num_device, cmd_packs, load_model_thd);
+    free(cmd_buf);
+
+    return ret;
+}
+
+static int _kp_unload_model_from_devices(kp_device_group_t devices)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+    int timeout = _devices_grp->timeout;
+
+    kdp2_ipc_cmd_unload_model_t cmd_buf;
+
+    cmd_buf.magic_type = KDP2_MAGIC_TYPE_COMMAND;
+    cmd_buf.total_size = sizeof(kdp2_ipc_cmd_unload_model_t);
+    cmd_buf.command_id = KDP2_COMMAND_UNLOAD_MODEL;
+
+    // pending reads would take the flushed data
+    group_scheduler_reset(_devices_grp);
+    deadline_monitor_reset(_devices_grp);
+
+    for (int i = 0; i < _devices_grp->num_device; i++) {
+        uint32_t return_code;
+
+        int ret = kp_usb_write_data(_devices_grp->ll_device[i], (void *)&cmd_buf, sizeof(kdp2_ipc_cmd_unload_model_t), timeout);
+
+        if (KP_USB_RET_OK != ret)
+            return check_usb_read_data_error(ret);
+
+        ret = kp_usb_read_data(_devices_grp->ll_device[i], (void *)&return_code, sizeof(uint32_t), timeout);
+
+        int status = check_usb_read_data_error(ret);
+
+        if (KP_SUCCESS != status)
+            return status;
+        else if (sizeof(uint32_t) != ret)
+            return KP_ERROR_OTHER_99;
+        else if (KP_SUCCESS != return_code)
+            return (int)return_code;
+    }
+
+    return KP_SUCCESS;
+}
+
+static bool _kp_is_model_fit_in_fifo_queue(kp_ddr_manage_attr_t *ddr_attr, kp_model_nef_descriptor_t *model_desc)
+{
+    for (uint32_t i = 0; i < model_desc->num_models; i++) {
+        if ((model_desc->models[i].input_nodes_num > ddr_attr->input_buffer_count) ||
+            (model_desc->models[i].max_raw_out_size + SIZE_RESERVED_FOR_HEADER > ddr_attr->result_buffer_size)) {
+            printf("[%s] Error: Model %u does not fit in FIFO queue input buf %u x %u, result buf %u x %u\n", __FUNCTION__,
+                                                                                                             model_desc->models[i].id,
+                                                                                                             ddr_attr->input_buffer_count,
+                                                                                                             ddr_attr->input_buffer_size,
+                                                                                                             ddr_attr->result_buffer_count,
+                                                                                                             ddr_attr->result_buffer_size);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int _kp_resize_fifo_queue_on_devices(kp_device_group_t devices, kp_ddr_manage_attr_t *ddr_attr)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+    int timeout = _devices_grp->timeout;
+
+    kdp2_ipc_cmd_resize_fifo_queue_t cmd_buf;
+
+    cmd_buf.magic_type = KDP2_MAGIC_TYPE_COMMAND;
+    cmd_buf.total_size = sizeof(kdp2_ipc_cmd_resize_fifo_queue_t);
+    cmd_buf.command_id = KDP2_COMMAND_RESIZE_FIFOQ;
+    cmd_buf.input_buf_count = ddr_attr->input_buffer_count;
+    cmd_buf.input_buf_size = ddr_attr->input_buffer_size;
+    cmd_buf.result_buf_count = ddr_attr->result_buffer_count;
+    cmd_buf.result_buf_size = ddr_attr->result_buffer_size;
+
+    // queued images and results are dropped, pending reads would take the flushed data
+    group_scheduler_reset(_devices_grp);
+    deadline_monitor_reset(_devices_grp);
+
+    for (int i = 0; i < _devices_grp->num_device; i++) {
+        uint32_t return_code;
+
+        int ret = kp_usb_write_data(_devices_grp->ll_device[i], (void *)&cmd_buf, sizeof(kdp2_ipc_cmd_resize_fifo_queue_t), timeout);
+
+        if (KP_USB_RET_OK != ret)
+            return check_usb_read_data_error(ret);
+
+        ret = kp_usb_read_data(_devices_grp->ll_device[i], (void *)&return_code, sizeof(uint32_t), timeout);
+
+        int status = check_usb_read_data_error(ret);
+
+        if (KP_SUCCESS != status)
+            return status;
+        else if (sizeof(uint32_t) != ret)
+            return KP_ERROR_OTHER_99;
+        else if (KP_SUCCESS != return_code) {
+            printf("[%s] Error: Fifo Queue resize failed for input buf %u x %u, result buf %u x %u, error code %u\n", __FUNCTION__,
+                                                                                                                       ddr_attr->input_buffer_count,
+                                                                                                                       ddr_attr->input_buffer_size,
+                                                                                                                       ddr_attr->result_buffer_count,
+                                                                                                                       ddr_attr->result_buffer_size,
+                                                                                                                       return_code);
+            return KP_ERROR_FIFOQ_SETTING_FAILED_43;
+        }
+    }
+
+    devices->ddr_attr.input_buffer_count = ddr_attr->input_buffer_count;
+    devices->ddr_attr.input_buffer_size = ddr_attr->input_buffer_size;
+    devices->ddr_attr.result_buffer_count = ddr_attr->result_buffer_count;
+    devices->ddr_attr.result_buffer_size = ddr_attr->result_buffer_size;
+
+    return KP_SUCCESS;
+}
+
+static int _kp_resize_fifo_queue_for_models(kp_device_group_t devices, kp_model_nef_descriptor_t *model_desc)
+{
+    kp_ddr_manage_attr_t ddr_attr = devices->ddr_attr;
+
+    // grow only what the models need, the input buffer size is kept
+    for (uint32_t i = 0; i < model_desc->num_models; i++) {
+        uint32_t result_buffer_size = (uint32_t)ceil((double)(model_desc->models[i].max_raw_out_size + SIZE_RESERVED_FOR_HEADER) / BUFFER_SIZE_10_KB) * BUFFER_SIZE_10_KB;
+
+        if (ddr_attr.result_buffer_size < result_buffer_size)
+            ddr_attr.result_buffer_size = result_buffer_size;
+
+        if (ddr_attr.input_buffer_count < model_desc->models[i].input_nodes_num)
+            ddr_attr.input_buffer_count = model_desc->models[i].input_nodes_num;
+    }
+
+    return _kp_resize_fifo_queue_on_devices(devices, &ddr_attr);
+}
+
 int kp_load_model(kp_device_group_t devices, void *nef_buf, int nef_size, kp_model_nef_descriptor_t *model_desc)
 {
     _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
@@ -1294,45 +1505,116 @@ int kp_load_model(kp_device_group_t devices, void *nef_buf, int nef_size, kp_mod
         if (ret != KP_SUCCESS)
             return ret;
     } else {
-        uint32_t transfer_size = sizeof(kdp2_ipc_cmd_load_model_t) + nef_info.fw_info_size;
-        kdp2_ipc_cmd_load_model_t *cmd_buf = (kdp2_ipc_cmd_load_model_t *)malloc(transfer_size);
-        if (NULL == cmd_buf)
-            return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+        ret = _kp_load_model_to_devices(devices, &nef_info);
 
-        cmd_buf->magic_type = KDP2_MAGIC_TYPE_COMMAND;
-        cmd_buf->total_size = transfer_size;
-        cmd_buf->command_id = KDP2_COMMAND_LOAD_MODEL;
-        cmd_buf->model_size = nef_info.all_models_size;
-        cmd_buf->fw_info_size = nef_info.fw_info_size;
-        memcpy(cmd_buf->fw_info, nef_info.fw_info_addr, nef_info.fw_info_size);
+        if (ret != KP_SUCCESS)
+            return ret;
+    }
 
-        _load_model_command_package cmd_packs[MAX_GROUP_DEVICE];
-        pthread_t load_model_thd[MAX_GROUP_DEVICE];
+    // the NEF is parsed only once, the caller gets a copy of the loaded model descriptor
+    if ((KP_SUCCESS == ret) && (NULL != model_desc) && (model_desc != &_devices_grp->loaded_model_desc))
+        ret = copy_model_nef_descriptor(model_desc, &_devices_grp->loaded_model_desc);
 
-        cmd_packs[0].ll_device = _devices_grp->ll_device[0];
-        cmd_packs[0].cmd_buf = cmd_buf;
-        cmd_packs[0].model_buf = nef_info.all_models_addr;
-        cmd_packs[0].timeout = _devices_grp->timeout;
+    if (KP_SUCCESS == ret)
+        ret = _kp_allocate_ddr_memory(devices);
 
-        for (int i = 1; i < _devices_grp->num_device; i++)
-        {
-            memcpy((void *)&cmd_packs[i], (void *)&cmd_packs[0], sizeof(_load_model_command_package));
-            cmd_packs[i].ll_device = _devices_grp->ll_device[i];
-        }
+    return ret;
+}
 
-        ret = _spawn_thread_to_load_model_to_devices(_devices_grp->num_device, cmd_packs, load_model_thd);
-        free(cmd_buf);
+int kp_unload_model(kp_device_group_t devices)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
 
-        if (ret != KP_SUCCESS)
-            return ret;
+    int ret = check_fw_is_loaded(devices);
+
+    if (KP_SUCCESS != ret)
+        return ret;
+
+    if ((KP_DEVICE_KL520 != devices->product_id) &&
+        (KP_DEVICE_KL720 != devices->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
     }
 
+    ret = _kp_unload_model_from_devices(devices);
+
+    // FIFO queue stays allocated in devices, only the models are gone
+    kp_release_model_nef_descriptor(&_devices_grp->loaded_model_desc);
+
+    return ret;
+}
+
+int kp_replace_model(kp_device_group_t devices, void *nef_buf, int nef_size, kp_model_nef_descriptor_t *model_desc)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    kp_metadata_t metadata;
+    kp_nef_info_t nef_info;
+    kp_model_nef_descriptor_t new_model_desc;
+
+    int ret = check_fw_is_loaded(devices);
+
+    if (KP_SUCCESS != ret)
+        return ret;
+
+    if ((KP_DEVICE_KL520 != devices->product_id) &&
+        (KP_DEVICE_KL720 != devices->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
+    }
+
+    // nothing to replace, the FIFO queue is set up by the first load
+    if ((0 == _devices_grp->loaded_model_desc.num_models) || (0 == devices->ddr_attr.input_buffer_count))
+        return kp_load_model(devices, nef_buf, nef_size, model_desc);
+
+    // parse and check the new models before replacing the loaded models
+    memset(&new_model_desc, 0, sizeof(kp_model_nef_descriptor_t));
+
+    ret = load_model_info_from_nef(nef_buf, nef_size, _devices_grp->product_id, &metadata, &nef_info, &new_model_desc);
+
+    if (KP_SUCCESS != ret)
+        goto FUNC_OUT;
+
+    if ((metadata.kn_num != 0 && metadata.enc_type != 0) &&
+        (_devices_grp->num_device > 1 || _devices_grp->ll_device[0]->dev_descp.kn_number != metadata.kn_num)) {
+        ret = KP_ERROR_INVALID_MODEL_21;
+        goto FUNC_OUT;
+    }
+
+    if (false == _kp_is_model_fit_in_fifo_queue(&devices->ddr_attr, &new_model_desc)) {
+        // the loaded models keep running if the FIFO queue can not be resized
+        ret = _kp_resize_fifo_queue_for_models(devices, &new_model_desc);
+
+        if (KP_SUCCESS != ret)
+            goto FUNC_OUT;
+    }
+
+    // pending reads would take the flushed data, devices drop queued images and results before the new models are checked
+    group_scheduler_reset(_devices_grp);
+    deadline_monitor_reset(_devices_grp);
+
+    ret = _kp_load_model_to_devices(devices, &nef_info);
+
+    if (KP_FW_LOAD_MODEL_FAILED_104 == ret) {
+        // devices refused the new models (e.g. they do not fit in DDR), the loaded models are kept
+        goto FUNC_OUT;
+    } else if (KP_SUCCESS != ret) {
+        // the upload is broken off, the models in devices are unknown
+        kp_unload_model(devices);
+        goto FUNC_OUT;
+    }
+
+    ret = copy_model_nef_descriptor(&_devices_grp->loaded_model_desc, &new_model_desc);
+
     if ((KP_SUCCESS == ret) && (NULL != model_desc))
-        ret = load_model_info_from_nef(nef_buf, nef_size, _devices_grp->product_id, &metadata, &nef_info, model_desc);
+        ret = copy_model_nef_descriptor(model_desc, &new_model_desc);
 
+    // FIFO queue is kept, this refreshes 'ddr_attr' from devices
     if (KP_SUCCESS == ret)
         ret = _kp_allocate_ddr_memory(devices);
 
+FUNC_OUT:
+
+    kp_release_model_nef_descriptor(&new_model_desc);
+
     return ret;
 }
 
@@ -1389,16 +1671,111 @@ static char *read_file_to_buffer_auto_malloc(const char *file_path, long *buffer
     return buffer;
 }
 
+// map a file read-only into memory, so big NEF files are sent to devices from page cache without a private copy
+// it falls back to read_file_to_buffer_auto_malloc() if mapping is not possible, release it by unmap_file_buffer()
+static char *map_file_to_buffer(const char *file_path, long *buffer_size, bool *is_mapped)
+{
+    char *buffer = NULL;
+
+    *is_mapped = false;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE != file)
+    {
+        LARGE_INTEGER file_size;
+
+        if (GetFileSizeEx(file, &file_size) && 0 < file_size.QuadPart && file_size.QuadPart <= 0x7FFFFFFF)
+        {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (NULL != mapping)
+            {
+                buffer = (char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping); // the view keeps the mapping
+            }
+
+            *buffer_size = (long)file_size.QuadPart;
+        }
+
+        CloseHandle(file);
+    }
+#else
+    int fd = open(file_path, O_RDONLY);
+    if (0 <= fd)
+    {
+        struct stat st;
+
+        if (0 == fstat(fd, &st) && 0 < st.st_size && st.st_size <= 0x7FFFFFFF)
+        {
+            void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED != addr)
+            {
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                buffer = (char *)addr;
+            }
+
+            *buffer_size = (long)st.st_size;
+        }
+
+        close(fd); // the mapping keeps the file
+    }
+#endif
+
+    if (NULL != buffer)
+    {
+        *is_mapped = true;
+        return buffer;
+    }
+
+    dbg_print("%s(): mapping file %s failed, read it instead\n", __FUNCTION__, file_path);
+
+    return read_file_to_buffer_auto_malloc(file_path, buffer_size);
+}
+
+static void unmap_file_buffer(char *buffer, long buffer_size, bool is_mapped)
+{
+    if (NULL == buffer)
+        return;
+
+    if (!is_mapped)
+    {
+        free(buffer);
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(buffer);
+#else
+    munmap(buffer, buffer_size);
+#endif
+}
+
 int kp_load_model_from_file(kp_device_group_t devices, const char *file_path, kp_model_nef_descriptor_t *model_desc)
 {
     long nef_size;
-    char *nef_buf = read_file_to_buffer_auto_malloc(file_path, &nef_size);
+    bool is_mapped;
+    char *nef_buf = map_file_to_buffer(file_path, &nef_size, &is_mapped);
     if (!nef_buf)
         return KP_ERROR_FILE_OPEN_FAILED_20;
 
     int ret = kp_load_model(devices, (void *)nef_buf, (int)nef_size, model_desc);
 
-    free(nef_buf);
+    unmap_file_buffer(nef_buf, nef_size, is_mapped);
+
+    return ret;
+}
+
+int kp_replace_model_from_file(kp_device_group_t devices, const char *file_path, kp_model_nef_descriptor_t *model_desc)
+{
+    long nef_size;
+    bool is_mapped;
+    char *nef_buf = map_file_to_buffer(file_path, &nef_size, &is_mapped);
+    if (!nef_buf)
+        return KP_ERROR_FILE_OPEN_FAILED_20;
+
+    int ret = kp_replace_model(devices, (void *)nef_buf, (int)nef_size, model_desc);
+
+    unmap_file_buffer(nef_buf, nef_size, is_mapped);
 
     return ret;
 }
@@ -1495,8 +1872,8 @@ int kp_load_encrypted_models(kp_device_group_t devices, void *nef_buf[], int nef
             goto FUNC_OUT;
         }
 
-        if (model_desc != NULL) {
-            ret = load_model_info_from_nef(nef_buf[0], nef_size, _devices_grp->product_id, &metadata[0], &nef_info[0], model_desc);
+        if ((model_desc != NULL) && (model_desc != &_devices_grp->loaded_model_desc)) {
+            ret = copy_model_nef_descriptor(model_desc, &_devices_grp->loaded_model_desc);
             if (ret != KP_SUCCESS) {
                 goto FUNC_OUT;
             }
@@ -1524,27 +1901,39 @@ FUNC_OUT:
 int kp_load_encrypted_models_from_file(kp_device_group_t devices, char *file_path[], int nef_num, kp_model_nef_descriptor_t *model_desc)
 {
     void *nef_buf[MAX_GROUP_DEVICE];
+    long nef_size[MAX_GROUP_DEVICE];
+    bool is_mapped[MAX_GROUP_DEVICE];
 
-    long nef_size_prev = 0;
-    long nef_size = 0;
+    int num_opened = 0;
+    int ret = KP_SUCCESS;
+
+    if (nef_num <= 0 || nef_num > MAX_GROUP_DEVICE)
+        return KP_ERROR_INVALID_PARAM_12;
 
     for (int i = 0; i < nef_num; i++)
     {
-        nef_buf[i] = (void *)read_file_to_buffer_auto_malloc(file_path[i], &nef_size);
+        nef_buf[i] = (void *)map_file_to_buffer(file_path[i], &nef_size[i], &is_mapped[i]);
         if (!nef_buf[i])
-            return KP_ERROR_FILE_OPEN_FAILED_20;
+        {
+            ret = KP_ERROR_FILE_OPEN_FAILED_20;
+            break;
+        }
 
-        // Check if the size of all encrypted nef files are the same
-        if (i > 0 && nef_size_prev != nef_size)
-            return KP_ERROR_INVALID_PARAM_12;
+        num_opened++;
 
-        nef_size_prev = nef_size;
+        // Check if the size of all encrypted nef files are the same
+        if (i > 0 && nef_size[i - 1] != nef_size[i])
+        {
+            ret = KP_ERROR_INVALID_PARAM_12;
+            break;
+        }
     }
 
-    int ret = kp_load_encrypted_models(devices, nef_buf, nef_size, nef_num, model_desc);
+    if (ret == KP_SUCCESS)
+        ret = kp_load_encrypted_models(devices, nef_buf, (int)nef_size[0], nef_num, model_desc);
 
-    for (int i = 0; i < nef_num; i++)
-        free(nef_buf[i]);
+    for (int i = 0; i < num_opened; i++)
+        unmap_file_buffer((char *)nef_buf[i], nef_size[i], is_mapped[i]);
 
     return ret;
 }
@@ -2462,6 +2851,13 @@ int kp_reset_device(kp_device_group_t devices, kp_reset_mode_t reset_mode)
     }
     else if (reset_mode == KP_RESET_INFERENCE)
     {
+        // pending reads would take the flushed data
+        group_scheduler_reset(_devices_grp);
+        deadline_monitor_reset(_devices_grp);
+
+        // the devices also go back to the default inference configuration
+        _devices_grp->deadline_monitor.drop_enabled = false;
+
         kctrl.command = KDP2_CONTROL_FIFOQ_RESET;
         kctrl.arg1 = 0;
         kctrl.arg2 = 0;
@@ -3153,6 +3549,182 @@ int kp_store_ddr_manage_attr(kp_device_group_t devices, kp_ddr_manage_attr_t ddr
     return KP_SUCCESS;
 }
 
+int kp_resize_fifo_queue(kp_device_group_t devices, kp_ddr_manage_attr_t ddr_attr)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    int ret = check_fw_is_loaded(devices);
+
+    if (KP_SUCCESS != ret)
+        return ret;
+
+    if ((KP_DEVICE_KL520 != devices->product_id) &&
+        (KP_DEVICE_KL720 != devices->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
+    }
+
+    // the FIFO queue is set up by the first model load
+    if (0 == devices->ddr_attr.input_buffer_count)
+        return KP_ERROR_MODEL_NOT_LOADED_35;
+
+    if (0 == ddr_attr.input_buffer_count)
+        ddr_attr.input_buffer_count = devices->ddr_attr.input_buffer_count;
+    if (0 == ddr_attr.input_buffer_size)
+        ddr_attr.input_buffer_size = devices->ddr_attr.input_buffer_size;
+    if (0 == ddr_attr.result_buffer_count)
+        ddr_attr.result_buffer_count = devices->ddr_attr.result_buffer_count;
+    if (0 == ddr_attr.result_buffer_size)
+        ddr_attr.result_buffer_size = devices->ddr_attr.result_buffer_size;
+
+    /* align input/output buffer size with BUFFER_SIZE_10_KB */
+    ddr_attr.result_buffer_size = (uint32_t)ceil((double)ddr_attr.result_buffer_size / BUFFER_SIZE_10_KB) * BUFFER_SIZE_10_KB;
+    ddr_attr.input_buffer_size = (uint32_t)ceil((double)ddr_attr.input_buffer_size / BUFFER_SIZE_10_KB) * BUFFER_SIZE_10_KB;
+    ddr_attr.model_size = devices->ddr_attr.model_size;
+
+    if ((MAX_BUF_COUNT < ddr_attr.input_buffer_count) || (MAX_BUF_COUNT < ddr_attr.result_buffer_count) ||
+        (false == _kp_is_model_fit_in_fifo_queue(&ddr_attr, &_devices_grp->loaded_model_desc))) {
+        return KP_ERROR_FIFOQ_SETTING_FAILED_43;
+    }
+
+    return _kp_resize_fifo_queue_on_devices(devices, &ddr_attr);
+}
+
+int kp_get_ddr_heap_statistics(kp_device_group_t devices, int dev_port_id, kp_ddr_heap_stats_t *heap_stats)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    if ((KP_DEVICE_KL520 != devices->product_id) &&
+        (KP_DEVICE_KL720 != devices->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
+    }
+
+    // Search for device with matched port id and corresponding scan index
+    int scan_index;
+    for (scan_index = 0; scan_index < _devices_grp->num_device; scan_index++)
+    {
+        if (dev_port_id == _devices_grp->ll_device[scan_index]->dev_descp.port_id)
+            break;
+    }
+
+    if (scan_index == _devices_grp->num_device)
+        return KP_ERROR_DEVICE_NOT_EXIST_10;
+
+    kp_usb_device_t *ll_dev = _devices_grp->ll_device[scan_index];
+
+    kdp2_ipc_cmd_get_ddr_heap_stats_t cmd_buf;
+
+    cmd_buf.magic_type = KDP2_MAGIC_TYPE_COMMAND;
+    cmd_buf.total_size = sizeof(kdp2_ipc_cmd_get_ddr_heap_stats_t);
+    cmd_buf.command_id = KDP2_COMMAND_GET_DDR_HEAP_STATS;
+
+    int ret = kp_usb_write_data(ll_dev, (void *)&cmd_buf, sizeof(kdp2_ipc_cmd_get_ddr_heap_stats_t), _devices_grp->timeout);
+    int status = check_usb_write_data_error(ret);
+    if (status != KP_SUCCESS)
+        return status;
+
+    ret = kp_usb_read_data(ll_dev, (void *)heap_stats, sizeof(kp_ddr_heap_stats_t), _devices_grp->timeout);
+    status = check_usb_read_data_error(ret);
+    if (status != KP_SUCCESS)
+        return status;
+
+    return (sizeof(kp_ddr_heap_stats_t) == ret) ? KP_SUCCESS : KP_ERROR_RECV_DATA_FAIL_17;
+}
+
+int kp_inference_configure_lanes(kp_device_group_t devices, kp_inference_lane_config_t *lane_config)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+    int timeout = _devices_grp->timeout;
+
+    if ((KP_DEVICE_KL520 != devices->product_id) &&
+        (KP_DEVICE_KL720 != devices->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
+    }
+
+    if (NULL == lane_config)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    for (int lane = 0; lane < KP_MAX_INFERENCE_LANE; lane++) {
+        if ((0 == lane_config->weight[lane]) || (KP_MAX_INFERENCE_LANE_WEIGHT < lane_config->weight[lane]))
+            return KP_ERROR_INVALID_PARAM_12;
+    }
+
+    kdp2_ipc_cmd_configure_inf_lanes_t cmd_buf;
+
+    cmd_buf.magic_type = KDP2_MAGIC_TYPE_COMMAND;
+    cmd_buf.total_size = sizeof(kdp2_ipc_cmd_configure_inf_lanes_t);
+    cmd_buf.command_id = KDP2_COMMAND_CONFIGURE_INF_LANES;
+    cmd_buf.lane_config = *lane_config;
+
+    for (int i = 0; i < _devices_grp->num_device; i++) {
+        uint32_t return_code;
+
+        int ret = kp_usb_write_data(_devices_grp->ll_device[i], (void *)&cmd_buf, sizeof(kdp2_ipc_cmd_configure_inf_lanes_t), timeout);
+        int status = check_usb_write_data_error(ret);
+
+        if (KP_SUCCESS != status)
+            return status;
+
+        ret = kp_usb_read_data(_devices_grp->ll_device[i], (void *)&return_code, sizeof(uint32_t), timeout);
+        status = check_usb_read_data_error(ret);
+
+        if (KP_SUCCESS != status)
+            return status;
+        else if (sizeof(uint32_t) != ret)
+            return KP_ERROR_OTHER_99;
+        else if (KP_FW_ERROR_UNKNOWN_APP == return_code)
+            return KP_ERROR_INVALID_FIRMWARE_24;
+        else if (KP_SUCCESS != return_code)
+            return return_code;
+    }
+
+    return KP_SUCCESS;
+}
+
+int kp_inference_get_lane_statistics(kp_device_group_t devices, int dev_port_id, kp_inference_lane_stats_t lane_stats[KP_MAX_INFERENCE_LANE], bool reset)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    if ((KP_DEVICE_KL520 != devices->product_id) &&
+        (KP_DEVICE_KL720 != devices->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
+    }
+
+    // Search for device with matched port id and corresponding scan index
+    int scan_index;
+    for (scan_index = 0; scan_index < _devices_grp->num_device; scan_index++)
+    {
+        if (dev_port_id == _devices_grp->ll_device[scan_index]->dev_descp.port_id)
+            break;
+    }
+
+    if (scan_index == _devices_grp->num_device)
+        return KP_ERROR_DEVICE_NOT_EXIST_10;
+
+    kp_usb_device_t *ll_dev = _devices_grp->ll_device[scan_index];
+
+    kdp2_ipc_cmd_get_inf_lane_stats_t cmd_buf;
+
+    cmd_buf.magic_type = KDP2_MAGIC_TYPE_COMMAND;
+    cmd_buf.total_size = sizeof(kdp2_ipc_cmd_get_inf_lane_stats_t);
+    cmd_buf.command_id = KDP2_COMMAND_GET_INF_LANE_STATS;
+    cmd_buf.reset = reset ? 1 : 0;
+
+    int ret = kp_usb_write_data(ll_dev, (void *)&cmd_buf, sizeof(kdp2_ipc_cmd_get_inf_lane_stats_t), _devices_grp->timeout);
+    int status = check_usb_write_data_error(ret);
+    if (status != KP_SUCCESS)
+        return status;
+
+    uint32_t size = KP_MAX_INFERENCE_LANE * sizeof(kp_inference_lane_stats_t);
+
+    ret = kp_usb_read_data(ll_dev, (void *)lane_stats, size, _devices_grp->timeout);
+    status = check_usb_read_data_error(ret);
+    if (status != KP_SUCCESS)
+        return status;
+
+    // an older firmware answers an unknown command with a return code only
+    return (size == (uint32_t)ret) ? KP_SUCCESS : KP_ERROR_INVALID_FIRMWARE_24;
+}
+
 // For debug use, only support 1 device
 int kp_memory_read(kp_device_group_t devices, int dev_port_id, uint32_t start_address, uint32_t length, uint8_t *buffer)
 {
@@ -92,6 +92,8 @@ static err_str_map _errmap[] = {
     {KP_ERROR_ADJUST_DDR_HEAP_FAILED_46, "Adjust boundary between model and DDR heap failed"},
     {KP_ERROR_DEVICE_NOT_ACCESSIBLE_47, "Device is not accessible"},
     {KP_ERROR_INVALID_INPUT_NODE_DATA_NUMBER_48, "The input node data number is not compliant with the Kneron device requirement (The KL520, KL720, and KL630 support a maximum of 5 input nodes, and the KL730 supports a maximum of 30 input nodes)"},
+    {KP_ERROR_PIPELINE_STOPPED_49, "The pipeline is being destroyed"},
+    {KP_ERROR_PIPELINE_TIMEOUT_50, "Waiting for a pipeline frame timeout"},
     {KP_ERROR_OTHER_99, "Other/unknown errors !"},
     {KP_FW_ERROR_UNKNOWN_APP, "Device cannot handle the specified APP (or JOB ID)"},
     {KP_FW_INFERENCE_ERROR_101, "Device inference failed"},
@@ -129,6 +131,8 @@ static err_str_map _errmap[] = {
     {KP_FW_ERROR_GET_MSG_QUEUE_FAILED_133, "Device create message queue failed"},
     {KP_FW_ERROR_SEND_MSG_QUEUE_FAILED_134, "Device send data to message queue failed"},
     {KP_FW_ERROR_RECV_MSG_QUEUE_FAILED_135, "Device receive data from message queue failed"},
+    {KP_FW_INFERENCE_DEADLINE_MISSED_136, "Device dropped the inference which can not be done before its deadline"},
+    {KP_FW_JPEG_DECODE_FAILED_137, "Device failed to decode the JPEG image"},
     {KP_FW_NCPU_INVALID_IMAGE_201, "NPU cannot handle this image data under current pre-process setting (e.g. Padding > 127)"},
     {KP_FW_EFUSE_CAN_NOT_BURN_300, "Device cannot burn eFuse"},
     {KP_FW_EFUSE_PROTECTED_301, "Device eFuse protected"},
@@ -0,0 +1,565 @@
+/**
+ * @file        kp_image_convert.c
+ * @brief       host image conversion for image inference
+ * @version     0.1
+ * @date        2024-06-10
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+// #define DEBUG_PRINT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#include "kp_image_convert.h"
+#include "color_convert.h"
+
+#ifdef DEBUG_PRINT
+#define dbg_print(format, ...) { printf(format, ##__VA_ARGS__); fflush(stdout); }
+#else
+#define dbg_print(format, ...)
+#endif
+
+#define CONVERT_DEFAULT_NUM_THREAD 1
+#define CONVERT_MAX_NUM_THREAD 16
+#define CONVERT_SRC_BPP 3
+
+typedef struct
+{
+    struct kp_image_convert_s *convert;
+    pthread_t thread;
+    uint32_t row_begin;                     // rows of the converted image done by this worker in this run
+    uint32_t row_end;
+    uint16_t *resampled[2];                 // 2 horizontally resampled source rows
+    int32_t cached_y[2];                    // source row in resampled[i], -1 if none
+    uint8_t *line[2];                       // 2 resized rows, given to the color conversion
+} _convert_worker_t;
+
+struct kp_image_convert_s
+{
+    // resize tables of the last geometry
+    uint32_t src_width;
+    uint32_t src_height;
+    uint32_t dst_width;
+    uint32_t dst_height;
+    int32_t *xofs0;
+    int32_t *xofs1;
+    uint16_t *fx;
+    int32_t *yofs0;
+    int32_t *yofs1;
+    uint16_t *fy;
+    void *line_buf;                         // row buffers of all workers
+
+    // image being converted
+    const uint8_t *src;
+    int32_t src_stride;
+    int swap_rb;
+    bool resize;
+    uint8_t *dst_buf;
+    uint32_t width;                         // size of the converted image
+    uint32_t height;
+    kp_image_format_t dst_format;
+    uint8_t order[4];                       // YCbCr422 byte order, refer to color_convert_row_ycbcr422()
+
+    // the caller thread is worker 0
+    int num_thread;
+    int num_thread_started;
+    _convert_worker_t worker[CONVERT_MAX_NUM_THREAD];
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    uint32_t run_seq;
+    int num_done;
+    bool stopping;
+};
+
+// which of (y0, cb, y1, cr) is byte i of every 4 bytes, false if the format is not YCbCr422
+static bool ycbcr422_order(kp_image_format_t format, uint8_t order[4])
+{
+    static const uint8_t y0 = 0, cb = 1, y1 = 2, cr = 3;
+    uint8_t o[4];
+
+    switch (format)
+    {
+    case KP_IMAGE_FORMAT_YCBCR422_CRY1CBY0:
+        o[0] = cr; o[1] = y1; o[2] = cb; o[3] = y0;
+        break;
+    case KP_IMAGE_FORMAT_YCBCR422_CBY1CRY0:
+        o[0] = cb; o[1] = y1; o[2] = cr; o[3] = y0;
+        break;
+    case KP_IMAGE_FORMAT_YCBCR422_Y1CRY0CB:
+        o[0] = y1; o[1] = cr; o[2] = y0; o[3] = cb;
+        break;
+    case KP_IMAGE_FORMAT_YCBCR422_Y1CBY0CR:
+        o[0] = y1; o[1] = cb; o[2] = y0; o[3] = cr;
+        break;
+    case KP_IMAGE_FORMAT_YCBCR422_CRY0CBY1:
+        o[0] = cr; o[1] = y0; o[2] = cb; o[3] = y1;
+        break;
+    case KP_IMAGE_FORMAT_YCBCR422_CBY0CRY1:
+        o[0] = cb; o[1] = y0; o[2] = cr; o[3] = y1;
+        break;
+    case KP_IMAGE_FORMAT_YCBCR422_Y0CRY1CB:
+        o[0] = y0; o[1] = cr; o[2] = y1; o[3] = cb;
+        break;
+    case KP_IMAGE_FORMAT_YUYV:
+    case KP_IMAGE_FORMAT_YCBCR422_Y0CBY1CR:
+        o[0] = y0; o[1] = cb; o[2] = y1; o[3] = cr;
+        break;
+    default:
+        return false;
+    }
+
+    memcpy(order, o, sizeof(o));
+
+    return true;
+}
+
+uint32_t kp_image_convert_get_buffer_size(kp_image_format_t format, uint32_t width, uint32_t height)
+{
+    uint64_t pixels = (uint64_t)width * height;
+    uint64_t size;
+    uint8_t order[4];
+
+    switch (format)
+    {
+    case KP_IMAGE_FORMAT_RGB565:
+        size = pixels * 2;
+        break;
+    case KP_IMAGE_FORMAT_RGBA8888:
+        size = pixels * 4;
+        break;
+    case KP_IMAGE_FORMAT_RAW8:
+        size = pixels;
+        break;
+    case KP_IMAGE_FORMAT_YUV420:
+        if (0 != width % 2 || 0 != height % 2)
+            return 0;
+        size = pixels * 3 / 2;
+        break;
+    default:
+        if (!ycbcr422_order(format, order) || 0 != width % 2)
+            return 0;
+        size = pixels * 2;
+        break;
+    }
+
+    return (size <= UINT32_MAX) ? (uint32_t)size : 0;
+}
+
+static void free_tables(kp_image_convert_t convert)
+{
+    free(convert->xofs0);
+    free(convert->xofs1);
+    free(convert->fx);
+    free(convert->yofs0);
+    free(convert->yofs1);
+    free(convert->fy);
+    free(convert->line_buf);
+
+    convert->xofs0 = NULL;
+    convert->xofs1 = NULL;
+    convert->fx = NULL;
+    convert->yofs0 = NULL;
+    convert->yofs1 = NULL;
+    convert->fy = NULL;
+    convert->line_buf = NULL;
+    convert->src_width = 0;
+}
+
+// bilinear with half-pixel centers like kp_preproc, 'ofs' are source indexes multiplied by 'step', 'f' are 8-bit weights
+static void build_table(int32_t *ofs0, int32_t *ofs1, uint16_t *f, uint32_t dst_len, uint32_t src_len, int32_t step)
+{
+    double ratio = (double)src_len / dst_len;
+
+    for (uint32_t i = 0; i < dst_len; i++)
+    {
+        double s = (i + 0.5) * ratio - 0.5;
+        if (s < 0)
+            s = 0;
+
+        uint32_t i0 = (uint32_t)s;
+
+        if (i0 >= src_len - 1)
+        {
+            ofs0[i] = ofs1[i] = (int32_t)(src_len - 1) * step;
+            f[i] = 0;
+        }
+        else
+        {
+            ofs0[i] = (int32_t)i0 * step;
+            ofs1[i] = (int32_t)(i0 + 1) * step;
+            f[i] = (uint16_t)((s - i0) * 256.0 + 0.5);
+        }
+    }
+}
+
+static int setup_geometry(kp_image_convert_t convert, uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height)
+{
+    convert->resize = (src_width != dst_width || src_height != dst_height);
+
+    if (!convert->resize)
+        return KP_SUCCESS;
+
+    if (src_width == convert->src_width && src_height == convert->src_height &&
+        dst_width == convert->dst_width && dst_height == convert->dst_height)
+        return KP_SUCCESS;
+
+    free_tables(convert);
+
+    size_t line_size = (size_t)dst_width * CONVERT_SRC_BPP;
+    size_t worker_size = 2 * line_size * sizeof(uint16_t) + 2 * line_size;
+
+    convert->xofs0 = (int32_t *)malloc(dst_width * sizeof(int32_t));
+    convert->xofs1 = (int32_t *)malloc(dst_width * sizeof(int32_t));
+    convert->fx = (uint16_t *)malloc(dst_width * sizeof(uint16_t));
+    convert->yofs0 = (int32_t *)malloc(dst_height * sizeof(int32_t));
+    convert->yofs1 = (int32_t *)malloc(dst_height * sizeof(int32_t));
+    convert->fy = (uint16_t *)malloc(dst_height * sizeof(uint16_t));
+    convert->line_buf = malloc(worker_size * convert->num_thread);
+
+    if (NULL == convert->xofs0 || NULL == convert->xofs1 || NULL == convert->fx ||
+        NULL == convert->yofs0 || NULL == convert->yofs1 || NULL == convert->fy || NULL == convert->line_buf)
+    {
+        free_tables(convert);
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+    }
+
+    build_table(convert->xofs0, convert->xofs1, convert->fx, dst_width, src_width, CONVERT_SRC_BPP);
+    build_table(convert->yofs0, convert->yofs1, convert->fy, dst_height, src_height, 1);
+
+    for (int i = 0; i < convert->num_thread; i++)
+    {
+        _convert_worker_t *worker = &convert->worker[i];
+        uint8_t *buf = (uint8_t *)convert->line_buf + worker_size * i;
+
+        worker->resampled[0] = (uint16_t *)buf;
+        worker->resampled[1] = worker->resampled[0] + line_size;
+        worker->line[0] = buf + 2 * line_size * sizeof(uint16_t);
+        worker->line[1] = worker->line[0] + line_size;
+    }
+
+    convert->src_width = src_width;
+    convert->src_height = src_height;
+    convert->dst_width = dst_width;
+    convert->dst_height = dst_height;
+
+    dbg_print("[%s] %ux%u -> %ux%u\n", __func__, src_width, src_height, dst_width, dst_height);
+
+    return KP_SUCCESS;
+}
+
+// get the slot of resampled source row 'sy', without evicting source row 'keep_y'
+static int load_source_row(_convert_worker_t *worker, int32_t sy, int32_t keep_y)
+{
+    kp_image_convert_t convert = worker->convert;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (sy == worker->cached_y[i])
+            return i;
+    }
+
+    int slot = (keep_y == worker->cached_y[0]) ? 1 : 0;
+    const uint8_t *src = convert->src + (ptrdiff_t)sy * convert->src_stride;
+
+    color_resample_row(worker->resampled[slot], src, convert->xofs0, convert->xofs1, convert->fx, (int)convert->width);
+    worker->cached_y[slot] = sy;
+
+    return slot;
+}
+
+// row 'y' of the image in the converted size, 3 bytes per pixel, 'line' selects the buffer of a resized row
+static const uint8_t *source_row(_convert_worker_t *worker, uint32_t y, int line)
+{
+    kp_image_convert_t convert = worker->convert;
+
+    if (!convert->resize)
+        return convert->src + (ptrdiff_t)y * convert->src_stride;
+
+    uint16_t fy = convert->fy[y];
+    int32_t sy0 = convert->yofs0[y];
+    int32_t sy1 = (0 == fy) ? sy0 : convert->yofs1[y];
+    int s0 = load_source_row(worker, sy0, sy1);
+    int s1 = load_source_row(worker, sy1, sy0);
+
+    color_blend_rows(worker->line[line], worker->resampled[s0], worker->resampled[s1], fy, (int)convert->width * CONVERT_SRC_BPP);
+
+    return worker->line[line];
+}
+
+static void process_rows(_convert_worker_t *worker)
+{
+    kp_image_convert_t convert = worker->convert;
+    uint32_t width = convert->width;
+    uint8_t *dst = convert->dst_buf;
+    int swap_rb = convert->swap_rb;
+
+    if (KP_IMAGE_FORMAT_YUV420 == convert->dst_format)
+    {
+        // the rows of a worker start from an even row
+        size_t y_size = (size_t)width * convert->height;
+        uint8_t *dst_u = dst + y_size;
+        uint8_t *dst_v = dst_u + y_size / 4;
+
+        for (uint32_t y = worker->row_begin; y < worker->row_end; y += 2)
+        {
+            const uint8_t *src0 = source_row(worker, y, 0);
+            const uint8_t *src1 = source_row(worker, y + 1, 1);
+            size_t uv_ofs = (size_t)(y / 2) * (width / 2);
+
+            color_convert_rows_yuv420(dst + (size_t)y * width, dst + (size_t)(y + 1) * width, dst_u + uv_ofs, dst_v + uv_ofs,
+                                      src0, src1, (int)width, swap_rb);
+        }
+
+        return;
+    }
+
+    for (uint32_t y = worker->row_begin; y < worker->row_end; y++)
+    {
+        const uint8_t *src = source_row(worker, y, 0);
+
+        switch (convert->dst_format)
+        {
+        case KP_IMAGE_FORMAT_RGB565:
+            color_convert_row_rgb565(dst + (size_t)y * width * 2, src, (int)width, swap_rb);
+            break;
+        case KP_IMAGE_FORMAT_RGBA8888:
+            color_convert_row_rgba8888(dst + (size_t)y * width * 4, src, (int)width, swap_rb);
+            break;
+        case KP_IMAGE_FORMAT_RAW8:
+            color_convert_row_raw8(dst + (size_t)y * width, src, (int)width, swap_rb);
+            break;
+        default:
+            color_convert_row_ycbcr422(dst + (size_t)y * width * 2, src, (int)width, swap_rb, convert->order);
+            break;
+        }
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    _convert_worker_t *worker = (_convert_worker_t *)arg;
+    kp_image_convert_t convert = worker->convert;
+    uint32_t seq = 0;
+
+    while (1)
+    {
+        pthread_mutex_lock(&convert->mutex);
+        while (!convert->stopping && seq == convert->run_seq)
+            pthread_cond_wait(&convert->start_cond, &convert->mutex);
+
+        if (convert->stopping)
+        {
+            pthread_mutex_unlock(&convert->mutex);
+            break;
+        }
+
+        seq = convert->run_seq;
+        pthread_mutex_unlock(&convert->mutex);
+
+        process_rows(worker);
+
+        pthread_mutex_lock(&convert->mutex);
+        if (++convert->num_done == convert->num_thread - 1)
+            pthread_cond_signal(&convert->done_cond);
+        pthread_mutex_unlock(&convert->mutex);
+    }
+
+    return NULL;
+}
+
+static void stop_threads(kp_image_convert_t convert)
+{
+    pthread_mutex_lock(&convert->mutex);
+    convert->stopping = true;
+    pthread_cond_broadcast(&convert->start_cond);
+    pthread_mutex_unlock(&convert->mutex);
+
+    // worker 0 is the caller thread
+    for (int i = 1; i < convert->num_thread_started; i++)
+        pthread_join(convert->worker[i].thread, NULL);
+
+    convert->num_thread_started = 0;
+}
+
+static void free_convert(kp_image_convert_t convert)
+{
+    free_tables(convert);
+
+    pthread_mutex_destroy(&convert->mutex);
+    pthread_cond_destroy(&convert->start_cond);
+    pthread_cond_destroy(&convert->done_cond);
+
+    free(convert);
+}
+
+kp_image_convert_t kp_image_convert_create(kp_image_convert_config_t *config, int *error_code)
+{
+    int ret = KP_SUCCESS;
+
+    if (NULL != config && config->num_thread < 0)
+        ret = KP_ERROR_INVALID_PARAM_12;
+
+    kp_image_convert_t convert = NULL;
+
+    if (ret == KP_SUCCESS)
+    {
+        convert = (kp_image_convert_t)calloc(1, sizeof(struct kp_image_convert_s));
+        if (NULL == convert)
+            ret = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+    }
+
+    if (ret != KP_SUCCESS)
+    {
+        if (error_code)
+            *error_code = ret;
+        return NULL;
+    }
+
+    convert->num_thread = (NULL != config && config->num_thread > 0) ? config->num_thread : CONVERT_DEFAULT_NUM_THREAD;
+    if (convert->num_thread > CONVERT_MAX_NUM_THREAD)
+        convert->num_thread = CONVERT_MAX_NUM_THREAD;
+
+    pthread_mutex_init(&convert->mutex, NULL);
+    pthread_cond_init(&convert->start_cond, NULL);
+    pthread_cond_init(&convert->done_cond, NULL);
+
+    for (int i = 0; i < convert->num_thread; i++)
+        convert->worker[i].convert = convert;
+
+    convert->num_thread_started = 1;
+
+    for (int i = 1; i < convert->num_thread && i == convert->num_thread_started; i++)
+    {
+        if (0 == pthread_create(&convert->worker[i].thread, NULL, worker_thread, &convert->worker[i]))
+            convert->num_thread_started++;
+    }
+
+    if (convert->num_thread_started != convert->num_thread)
+    {
+        ret = KP_ERROR_OTHER_99;
+        stop_threads(convert);
+        free_convert(convert);
+        convert = NULL;
+    }
+
+    dbg_print("[%s] %d threads, ret %d\n", __func__, (convert) ? convert->num_thread : 0, ret);
+
+    if (error_code)
+        *error_code = ret;
+
+    return convert;
+}
+
+int kp_image_convert_run(kp_image_convert_t convert, const uint8_t *src, uint32_t src_width, uint32_t src_height, int32_t src_stride,
+                         kp_image_convert_src_format_t src_format, uint8_t *dst_buf, uint32_t dst_width, uint32_t dst_height,
+                         kp_image_format_t dst_format, uint32_t buf_size)
+{
+    if (NULL == convert || NULL == src || NULL == dst_buf || 0 == src_width || 0 == src_height || 0 == dst_width || 0 == dst_height)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if (KP_IMAGE_CONVERT_SRC_BGR888 != src_format && KP_IMAGE_CONVERT_SRC_RGB888 != src_format)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if (0 == src_stride)
+        src_stride = (int32_t)(src_width * CONVERT_SRC_BPP);
+
+    if ((uint64_t)((0 < src_stride) ? src_stride : -(int64_t)src_stride) < (uint64_t)src_width * CONVERT_SRC_BPP)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    uint32_t size = kp_image_convert_get_buffer_size(dst_format, dst_width, dst_height);
+    if (0 == size || buf_size < size)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    int ret = setup_geometry(convert, src_width, src_height, dst_width, dst_height);
+    if (ret != KP_SUCCESS)
+        return ret;
+
+    convert->src = src;
+    convert->src_stride = src_stride;
+    convert->swap_rb = (KP_IMAGE_CONVERT_SRC_RGB888 == src_format) ? 1 : 0;
+    convert->dst_buf = dst_buf;
+    convert->dst_format = dst_format;
+    convert->width = dst_width;
+    convert->height = dst_height;
+    ycbcr422_order(dst_format, convert->order);
+
+    // YUV420 is converted by 2 rows, so the rows are split by pairs
+    uint32_t unit = (KP_IMAGE_FORMAT_YUV420 == dst_format) ? 2 : 1;
+    uint32_t num_unit = dst_height / unit;
+    int num_thread = convert->num_thread;
+
+    for (int i = 0; i < num_thread; i++)
+    {
+        _convert_worker_t *worker = &convert->worker[i];
+
+        worker->row_begin = (uint32_t)((uint64_t)num_unit * i / num_thread) * unit;
+        worker->row_end = (uint32_t)((uint64_t)num_unit * (i + 1) / num_thread) * unit;
+        worker->cached_y[0] = worker->cached_y[1] = -1;
+    }
+
+    if (1 < num_thread)
+    {
+        pthread_mutex_lock(&convert->mutex);
+        convert->num_done = 0;
+        convert->run_seq++;
+        pthread_cond_broadcast(&convert->start_cond);
+        pthread_mutex_unlock(&convert->mutex);
+    }
+
+    process_rows(&convert->worker[0]);
+
+    if (1 < num_thread)
+    {
+        pthread_mutex_lock(&convert->mutex);
+        while (convert->num_done < num_thread - 1)
+            pthread_cond_wait(&convert->done_cond, &convert->mutex);
+        pthread_mutex_unlock(&convert->mutex);
+    }
+
+    return KP_SUCCESS;
+}
+
+void kp_image_convert_destroy(kp_image_convert_t convert)
+{
+    if (NULL == convert)
+        return;
+
+    stop_threads(convert);
+    free_convert(convert);
+}
+
+void *kp_image_convert_alloc_buffer(uint32_t size)
+{
+    if (0 == size)
+        return NULL;
+
+#if defined(_WIN32)
+    return _aligned_malloc(size, KP_IMAGE_CONVERT_BUFFER_ALIGN);
+#else
+    void *buf = NULL;
+
+    if (0 != posix_memalign(&buf, KP_IMAGE_CONVERT_BUFFER_ALIGN, size))
+        return NULL;
+
+    return buf;
+#endif
+}
+
+void kp_image_convert_free_buffer(void *buf)
+{
+#if defined(_WIN32)
+    _aligned_free(buf);
+#else
+    free(buf);
+#endif
+}
@@ -14,6 +14,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <math.h>
 
 #include "kp_inference.h"
 #include "kp_usb.h"
@@ -24,6 +26,11 @@
 #include "kp_internal.h"
 #include "internal_func.h"
 #include "model_type.h"
+#include "node_convert.h"
+#include "node_reduce.h"
+#include "group_scheduler.h"
+#include "deadline_monitor.h"
+#include "kp_trace_internal.h"
 
 #ifdef DEBUG_PRINT
 #define dbg_print(format, ...)  { printf(format, ##__VA_ARGS__); fflush(stdout); }
@@ -85,6 +92,33 @@ static int get_image_size(kp_image_format_t format, int width, int height, uint3
     }
 }
 
+// the bitstream is sent as it is, the device decodes it in the rest of the input buffer after the bitstream and the trailer
+static int get_jpeg_image_size(_kp_devices_group_t *_devices_grp, kp_generic_input_node_image_t *image, uint32_t trailer_size, uint32_t *image_size)
+{
+    *image_size = 0;
+
+    if (KP_DEVICE_KL720 != _devices_grp->product_id)
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
+
+    // a JPEG bitstream starts with the SOI marker
+    if ((NULL == image->image_buffer) || (2 > image->image_buffer_size) ||
+        (0xFF != image->image_buffer[0]) || (0xD8 != image->image_buffer[1]) ||
+        (0 == image->width) || (0 == image->height))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    uint64_t decode_offset = (uint64_t)sizeof(kdp2_ipc_generic_raw_inf_header_t) + image->image_buffer_size + trailer_size;
+    decode_offset = (decode_offset + KDP2_INF_JPEG_DECODE_ALIGN - 1) / KDP2_INF_JPEG_DECODE_ALIGN * KDP2_INF_JPEG_DECODE_ALIGN;
+
+    if (decode_offset + (uint64_t)image->width * image->height * 2 > _devices_grp->ddr_attr.input_buffer_size) {
+        dbg_print("[%s] image buffer size is not enough in firmware to decode %ux%u JPEG\n", __func__, image->width, image->height);
+        return KP_ERROR_SEND_DATA_TOO_LARGE_15;
+    }
+
+    *image_size = image->image_buffer_size;
+
+    return KP_SUCCESS;
+}
+
 static bool check_model_id_is_exist_in_nef(_kp_devices_group_t *_devices_grp, uint32_t model_id)
 {
     bool ret = false;
@@ -185,6 +219,44 @@ static kp_channel_ordering_convert_t get_channel_ordering_convert_code(int produ
     }
 }
 
+static void get_image_result_header(uint8_t *raw_out_buffer, kp_generic_image_inference_result_header_t *output_desc)
+{
+    kdp2_ipc_generic_raw_result_t *ipc_result = (kdp2_ipc_generic_raw_result_t *)raw_out_buffer;
+
+    output_desc->inference_number = ipc_result->inf_number;
+    output_desc->crop_number = ipc_result->crop_number;
+    output_desc->product_id = ipc_result->product_id;
+
+    switch (ipc_result->product_id)
+    {
+    case KP_DEVICE_KL520:
+    {
+        output_desc->num_output_node = *(uint32_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
+        break;
+    }
+    case KP_DEVICE_KL720:
+    {
+        _720_raw_cnn_res_t *raw_cnn_res = (_720_raw_cnn_res_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
+        output_desc->num_output_node = raw_cnn_res->total_nodes;
+        break;
+    }
+    case KP_DEVICE_KL830:
+    case KP_DEVICE_KL730:
+    case KP_DEVICE_KL630:
+    {
+        _630_raw_cnn_res_t *raw_cnn_res = (_630_raw_cnn_res_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
+        output_desc->num_output_node = raw_cnn_res->total_nodes;
+        break;
+    }
+    default:
+        break;
+    }
+
+    output_desc->num_pre_proc_info = ipc_result->num_of_pre_proc_info;
+
+    memcpy(output_desc->pre_proc_info, ipc_result->pre_proc_info, output_desc->num_pre_proc_info * sizeof(kp_hw_pre_proc_info_t));
+}
+
 static float pow2(int exp)
 {
     if (0 <= exp) {
@@ -215,24 +287,103 @@ int kp_inference_configure(kp_device_group_t devices, kp_inf_configuration_t *co
         }
     }
 
-    return ret;
+    // older firmware does not know the deadline drop, leave it alone unless it is used
+    if ((KP_SUCCESS != ret) || ((false == conf->enable_deadline_drop) && (false == _devices_grp->deadline_monitor.drop_enabled)))
+        return ret;
+
+    if ((KP_DEVICE_KL520 != _devices_grp->product_id) &&
+        (KP_DEVICE_KL720 != _devices_grp->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
+    }
+
+    kctrl.command = KDP2_CONTROL_FIFOQ_ENABLE_DEADLINE_DROP;
+    kctrl.arg1 = (conf->enable_deadline_drop) ? 1 : 0;
+
+    for (int i = 0; i < _devices_grp->num_device; i++)
+    {
+        ret = kp_usb_control(_devices_grp->ll_device[i], &kctrl, timeout);
+
+        if (KP_SUCCESS != ret) {
+            dbg_print("[%s] device %d failed to set deadline drop, error %d\n", __func__, i, ret);
+            return (KP_USB_USB_PIPE == ret) ? KP_ERROR_INVALID_FIRMWARE_24 : ret;
+        }
+    }
+
+    _devices_grp->deadline_monitor.drop_enabled = conf->enable_deadline_drop;
+
+    return KP_SUCCESS;
 }
 
-int kp_generic_image_inference_send(kp_device_group_t devices, kp_generic_image_inference_desc_t *inf_data)
+int kp_inference_set_result_coalescing(kp_device_group_t devices, uint32_t max_transfer_size)
 {
     _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+    int timeout = _devices_grp->timeout;
+    kp_usb_control_t kctrl = {0};
+    int ret = KP_SUCCESS;
+    int i;
 
-    kp_usb_device_t *ll_dev = _devices_grp->ll_device[_devices_grp->cur_send++];
+    // wValue of the control request is in KB
+    uint32_t max_kb = (max_transfer_size + 1023) / 1024;
 
-    if (_devices_grp->cur_send >= _devices_grp->num_device)
-        _devices_grp->cur_send = 0;
+    if (0xFFFF < max_kb)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if (0 < max_kb && max_kb * 1024 < sizeof(kdp2_ipc_coalesced_result_t) + sizeof(kp_inference_header_stamp_t))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    kctrl.command = KDP2_CONTROL_FIFOQ_ENABLE_COALESCING;
+    kctrl.arg1 = max_kb;
+
+    for (i = 0; i < _devices_grp->num_device; i++)
+    {
+        ret = kp_usb_control(_devices_grp->ll_device[i], &kctrl, timeout);
+
+        if (KP_SUCCESS != ret)
+            break;
+    }
+
+    if (KP_SUCCESS != ret)
+    {
+        dbg_print("[%s] device %d failed to set result coalescing, error %d\n", __func__, i, ret);
+
+        // every device of a group must agree, or coalesced results would be read by a plain read
+        kctrl.arg1 = 0;
+
+        for (int j = 0; j < i; j++)
+            kp_usb_control(_devices_grp->ll_device[j], &kctrl, timeout);
+
+        _devices_grp->scheduler.coalesce_size = 0;
+
+        return (KP_USB_USB_PIPE == ret) ? KP_ERROR_INVALID_FIRMWARE_24 : ret;
+    }
+
+    _devices_grp->scheduler.coalesce_size = max_kb * 1024;
+
+    return KP_SUCCESS;
+}
+
+uint64_t kp_inference_get_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+// 'deadline' can be NULL, otherwise the deadline trailer follows the first image
+static int generic_image_inference_send(kp_device_group_t devices, kp_generic_image_inference_desc_t *inf_data, uint32_t lane, kp_inference_deadline_t *deadline)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
 
     int timeout = _devices_grp->timeout;
 
     uint32_t image_size = 0;
 
     int ret = 0;
+    int status = KP_SUCCESS;
     int num_input_node_image = inf_data->num_input_node_image;
+    kp_usb_async_request_t usb_req[2];
 
     if (KP_MAX_INPUT_NODE_COUNT < num_input_node_image) {
         return KP_ERROR_INVALID_INPUT_NODE_DATA_NUMBER_48;
@@ -244,15 +395,36 @@ int kp_generic_image_inference_send(kp_device_group_t devices, kp_generic_image_
         return KP_ERROR_FIFOQ_INPUT_BUFF_COUNT_NOT_ENOUGH_42;
     }
 
+    uint64_t trace_send = kp_trace_begin();
+
+    int dev_idx = group_scheduler_begin_send(_devices_grp);
+    kp_usb_device_t *ll_dev = _devices_grp->ll_device[dev_idx];
+
+    kp_usb_async_request_init(&usb_req[0]);
+    kp_usb_async_request_init(&usb_req[1]);
+
+    // the result may come back before this returns, so the frame is tracked before it is sent
+    if (NULL != deadline)
+        deadline_monitor_add(_devices_grp, inf_data->inference_number, lane, deadline);
+
     for (int i = 0; i < num_input_node_image; i++) {
-        ret = get_image_size(inf_data->input_node_image_list[i].image_format, inf_data->input_node_image_list[i].width, inf_data->input_node_image_list[i].height, &image_size);
-        if (ret != KP_SUCCESS)
-            return ret;
+        bool with_deadline = ((NULL != deadline) && (0 == i));
+
+        if (KP_IMAGE_FORMAT_JPEG == inf_data->input_node_image_list[i].image_format)
+            ret = get_jpeg_image_size(_devices_grp, &inf_data->input_node_image_list[i], with_deadline ? sizeof(kdp2_ipc_inf_deadline_t) : 0, &image_size);
+        else
+            ret = get_image_size(inf_data->input_node_image_list[i].image_format, inf_data->input_node_image_list[i].width, inf_data->input_node_image_list[i].height, &image_size);
+
+        if (ret != KP_SUCCESS) {
+            status = ret;
+            break;
+        }
 
         if (false == check_model_id_is_exist_in_nef(_devices_grp, inf_data->model_id))
         {
             dbg_print("[%s] model id [%d] not exist in nef\n", __func__, inf_data->model_id);
-            return KP_ERROR_MODEL_NOT_LOADED_35;
+            status = KP_ERROR_MODEL_NOT_LOADED_35;
+            break;
         }
 
         kdp2_ipc_generic_raw_inf_header_t raw_inf_header;
@@ -262,11 +434,18 @@ int kp_generic_image_inference_send(kp_device_group_t devices, kp_generic_image_
         raw_inf_header.header_stamp.job_id = KDP2_INF_ID_GENERIC_RAW;
         raw_inf_header.header_stamp.total_image = num_input_node_image;
         raw_inf_header.header_stamp.image_index = i;
+        raw_inf_header.header_stamp.status_code = KDP2_INF_LANE_TAG | lane;
+
+        if (with_deadline) {
+            raw_inf_header.header_stamp.total_size += sizeof(kdp2_ipc_inf_deadline_t);
+            raw_inf_header.header_stamp.status_code |= KDP2_INF_DEADLINE_FLAG;
+        }
 
         if (raw_inf_header.header_stamp.total_size > _devices_grp->ddr_attr.input_buffer_size)
         {
             dbg_print("[%s] image buffer size is not enough in firmware\n", __func__);
-            return KP_ERROR_SEND_DATA_TOO_LARGE_15;
+            status = KP_ERROR_SEND_DATA_TOO_LARGE_15;
+            break;
         }
 
         raw_inf_header.inference_number = inf_data->inference_number;
@@ -274,80 +453,177 @@ int kp_generic_image_inference_send(kp_device_group_t devices, kp_generic_image_
 
         memcpy((void *)&raw_inf_header.image_header, &inf_data->input_node_image_list[i], sizeof(kdp2_ipc_generic_raw_inf_image_header_t));
 
-        ret = kp_usb_write_data(ll_dev, (void *)&raw_inf_header, sizeof(raw_inf_header), timeout);
-        int status = check_inf_desc_error(ret);
-        if (status != KP_SUCCESS)
-            return status;
+        // the time left is taken right before sending, so the device needs no clock synchronized with the host
+        kdp2_ipc_inf_deadline_t deadline_trailer = {0};
+
+        if (with_deadline) {
+            uint64_t now_us = kp_inference_get_time_us();
+            uint64_t budget_us = (deadline->deadline_us > now_us) ? deadline->deadline_us - now_us : 0;
+
+            deadline_trailer.inference_number = inf_data->inference_number;
+            deadline_trailer.model_id = inf_data->model_id;
+            deadline_trailer.budget_us = (budget_us < UINT32_MAX) ? (uint32_t)budget_us : UINT32_MAX;
+        }
+
+        // the trailer must be in the same transfer as the image, so it is always a single transfer
+        if ((_devices_grp->send_mode == KP_INFERENCE_SEND_MODE_SINGLE_TRANSFER) || with_deadline) {
+            uint64_t trace_write = kp_trace_begin();
+            ret = kp_usb_write_data_with_header_trailer(ll_dev, (void *)&raw_inf_header, sizeof(raw_inf_header), (void *)inf_data->input_node_image_list[i].image_buffer, image_size,
+                                                        (void *)&deadline_trailer, with_deadline ? sizeof(deadline_trailer) : 0, timeout);
+            kp_trace_end(KP_TRACE_STAGE_PAYLOAD_WRITE, trace_write, raw_inf_header.header_stamp.total_size);
+            status = check_send_image_error(ret);
+            if (status != KP_SUCCESS)
+                break;
+
+            continue;
+        }
+
+        // queue header and image back to back, the image chunks are in flight while header is being sent
+        uint64_t trace_header = kp_trace_begin();
+        ret = kp_usb_async_submit_write(ll_dev, &usb_req[0], (void *)&raw_inf_header, sizeof(raw_inf_header), timeout);
+        status = check_inf_desc_error(ret);
+        if (status != KP_SUCCESS) {
+            kp_trace_end(KP_TRACE_STAGE_HEADER_WRITE, trace_header, sizeof(raw_inf_header));
+            break;
+        }
+
+        uint64_t trace_image = kp_trace_begin();
+        ret = kp_usb_async_submit_write(ll_dev, &usb_req[1], (void *)inf_data->input_node_image_list[i].image_buffer, image_size, timeout);
+        int image_status = check_send_image_error(ret);
+
+        ret = kp_usb_async_complete(&usb_req[0], NULL);
+        status = check_inf_desc_error(ret);
+        kp_trace_end(KP_TRACE_STAGE_HEADER_WRITE, trace_header, sizeof(raw_inf_header));
+
+        if (image_status != KP_SUCCESS) {
+            kp_trace_end(KP_TRACE_STAGE_PAYLOAD_WRITE, trace_image, image_size);
+            status = image_status;
+            break;
+        }
+
+        ret = kp_usb_async_complete(&usb_req[1], NULL);
+        if (status == KP_SUCCESS)
+            status = check_send_image_error(ret);
+        kp_trace_end(KP_TRACE_STAGE_PAYLOAD_WRITE, trace_image, image_size);
 
-        ret = kp_usb_write_data(ll_dev, (void *)inf_data->input_node_image_list[i].image_buffer, image_size, timeout);
-        status = check_send_image_error(ret);
         if (status != KP_SUCCESS)
-            return status;
+            break;
+    }
+
+    kp_usb_async_request_release(&usb_req[0]);
+    kp_usb_async_request_release(&usb_req[1]);
+
+    if ((NULL != deadline) && (status != KP_SUCCESS))
+        deadline_monitor_cancel(_devices_grp, inf_data->inference_number);
+
+    group_scheduler_end_send(_devices_grp, dev_idx, (status == KP_SUCCESS));
+
+    kp_trace_end(KP_TRACE_STAGE_INFERENCE_SEND, trace_send, inf_data->inference_number);
+
+    return status;
+}
+
+int kp_generic_image_inference_send(kp_device_group_t devices, kp_generic_image_inference_desc_t *inf_data)
+{
+    return generic_image_inference_send(devices, inf_data, 0, NULL);
+}
+
+int kp_generic_image_inference_send_to_lane(kp_device_group_t devices, kp_generic_image_inference_desc_t *inf_data, uint32_t lane)
+{
+    if ((KP_DEVICE_KL520 != devices->product_id) &&
+        (KP_DEVICE_KL720 != devices->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
+    }
+
+    if (KP_MAX_INFERENCE_LANE <= lane)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    return generic_image_inference_send(devices, inf_data, lane, NULL);
+}
+
+int kp_generic_image_inference_send_with_deadline(kp_device_group_t devices, kp_generic_image_inference_desc_t *inf_data, uint32_t lane, kp_inference_deadline_t *deadline)
+{
+    if ((KP_DEVICE_KL520 != devices->product_id) &&
+        (KP_DEVICE_KL720 != devices->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
     }
 
+    if ((KP_MAX_INFERENCE_LANE <= lane) || (NULL == deadline))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    return generic_image_inference_send(devices, inf_data, lane, deadline);
+}
+
+int kp_inference_get_deadline_statistics(kp_device_group_t devices, uint32_t lane, kp_inference_deadline_stats_t *stats, bool reset)
+{
+    if ((KP_MAX_INFERENCE_LANE <= lane) || (NULL == stats))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    deadline_monitor_get_statistics((_kp_devices_group_t *)devices, lane, stats, reset);
+
     return KP_SUCCESS;
 }
 
 int kp_generic_image_inference_receive(kp_device_group_t devices, kp_generic_image_inference_result_header_t *output_desc, uint8_t *raw_out_buffer, uint32_t buf_size)
 {
     _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
-    kp_usb_device_t *ll_dev = _devices_grp->ll_device[_devices_grp->cur_recv];
+    int dev_idx = 0;
 
-    int timeout = _devices_grp->timeout;
+    uint64_t trace_receive = kp_trace_begin();
 
-    // if return < 0 means libusb error, otherwise return  received size
-    int usb_ret = kp_usb_read_data(ll_dev, (void *)raw_out_buffer, buf_size, timeout);
-    if (usb_ret < 0)
+    int usb_ret = group_scheduler_receive(_devices_grp, raw_out_buffer, buf_size, &dev_idx);
+
+    kp_trace_end(KP_TRACE_STAGE_RESULT_READ, trace_receive, (usb_ret == KP_USB_RET_OK) ? ((kp_inference_header_stamp_t *)raw_out_buffer)->total_size : 0);
+
+    if (usb_ret != KP_USB_RET_OK) {
+        kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, 0);
         return usb_ret;
+    }
 
     // parsing result buffer
 
     kdp2_ipc_generic_raw_result_t *ipc_result = (kdp2_ipc_generic_raw_result_t *)raw_out_buffer;
 
+    uint64_t trace_verify = kp_trace_begin();
+
+    if (KP_FW_INFERENCE_DEADLINE_MISSED_136 == ipc_result->header_stamp.status_code) {
+        // the frame is dropped by the device, the report takes the place of all its results
+        kdp2_ipc_inf_drop_report_t *report = (kdp2_ipc_inf_drop_report_t *)raw_out_buffer;
+
+        memset(output_desc, 0, sizeof(kp_generic_image_inference_result_header_t));
+        output_desc->inference_number = report->inference_number;
+        output_desc->product_id = _devices_grp->product_id;
+        output_desc->device_index = dev_idx;
+
+        deadline_monitor_done(_devices_grp, report->inference_number, kp_inference_get_time_us(), report->reason);
+        group_scheduler_end_receive(_devices_grp, dev_idx, true);
+
+        kp_trace_end(KP_TRACE_STAGE_HEADER_VERIFY, trace_verify, report->inference_number);
+        kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, report->inference_number);
+
+        return KP_FW_INFERENCE_DEADLINE_MISSED_136;
+    }
+
     int status = verify_result_header_stamp((kp_inference_header_stamp_t *)ipc_result, 0, KDP2_INF_ID_GENERIC_RAW);
 
     if (status != KP_SUCCESS) {
+        kp_trace_end(KP_TRACE_STAGE_HEADER_VERIFY, trace_verify, 0);
+        kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, 0);
         return status;
     }
 
-    output_desc->inference_number = ipc_result->inf_number;
-    output_desc->crop_number = ipc_result->crop_number;
-    output_desc->product_id = ipc_result->product_id;
-
-    switch (ipc_result->product_id)
-    {
-    case KP_DEVICE_KL520:
-    {
-        output_desc->num_output_node = *(uint32_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
-        break;
-    }
-    case KP_DEVICE_KL720:
-    {
-        _720_raw_cnn_res_t *raw_cnn_res = (_720_raw_cnn_res_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
-        output_desc->num_output_node = raw_cnn_res->total_nodes;
-        break;
-    }
-    case KP_DEVICE_KL830:
-    case KP_DEVICE_KL730:
-    case KP_DEVICE_KL630:
-    {
-        _630_raw_cnn_res_t *raw_cnn_res = (_630_raw_cnn_res_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
-        output_desc->num_output_node = raw_cnn_res->total_nodes;
-        break;
-    }
-    default:
-        break;
-    }
+    get_image_result_header(raw_out_buffer, output_desc);
 
-    output_desc->num_pre_proc_info = ipc_result->num_of_pre_proc_info;
+    output_desc->device_index = dev_idx;
 
-    memcpy(output_desc->pre_proc_info, ipc_result->pre_proc_info, output_desc->num_pre_proc_info * sizeof(kp_hw_pre_proc_info_t));
+    kp_trace_end(KP_TRACE_STAGE_HEADER_VERIFY, trace_verify, output_desc->inference_number);
 
     if (ipc_result->is_last_crop == 1)
-        _devices_grp->cur_recv++;
+        deadline_monitor_done(_devices_grp, output_desc->inference_number, kp_inference_get_time_us(), 0);
 
-    if (_devices_grp->cur_recv >= _devices_grp->num_device)
-        _devices_grp->cur_recv = 0;
+    group_scheduler_end_receive(_devices_grp, dev_idx, (ipc_result->is_last_crop == 1));
+
+    kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, output_desc->inference_number);
 
     return KP_SUCCESS;
 }
@@ -356,10 +632,6 @@ int kp_generic_data_inference_send(kp_device_group_t devices, kp_generic_data_in
 {
     int num_input_node_data = inf_data->num_input_node_data;
     _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
-    kp_usb_device_t *ll_dev = _devices_grp->ll_device[_devices_grp->cur_send++];
-
-    if (_devices_grp->cur_send >= _devices_grp->num_device)
-        _devices_grp->cur_send = 0;
 
     if (KP_MAX_INPUT_NODE_COUNT < num_input_node_data) {
         return KP_ERROR_INVALID_INPUT_NODE_DATA_NUMBER_48;
@@ -372,6 +644,10 @@ int kp_generic_data_inference_send(kp_device_group_t devices, kp_generic_data_in
     }
 
     int timeout = _devices_grp->timeout;
+    int status = KP_SUCCESS;
+    uint64_t trace_send = kp_trace_begin();
+    int dev_idx = group_scheduler_begin_send(_devices_grp);
+    kp_usb_device_t *ll_dev = _devices_grp->ll_device[dev_idx];
 
     for (int i = 0; i < num_input_node_data; i++) {
         uint32_t buffer_size = inf_data->input_node_data_list[i].buffer_size;
@@ -381,7 +657,8 @@ int kp_generic_data_inference_send(kp_device_group_t devices, kp_generic_data_in
         if (false == check_model_id_is_exist_in_nef(_devices_grp, inf_data->model_id))
         {
             dbg_print("[%s] model id [%d] not exist in nef\n", __func__, inf_data->model_id);
-            return KP_ERROR_MODEL_NOT_LOADED_35;
+            status = KP_ERROR_MODEL_NOT_LOADED_35;
+            break;
         }
 
         kdp2_ipc_generic_raw_inf_bypass_pre_proc_header_t raw_inf_header;
@@ -395,46 +672,74 @@ int kp_generic_data_inference_send(kp_device_group_t devices, kp_generic_data_in
         if (raw_inf_header.header_stamp.total_size > _devices_grp->ddr_attr.input_buffer_size)
         {
             dbg_print("[%s] image buffer size is not enough in firmware\n", __func__);
-            return KP_ERROR_SEND_DATA_TOO_LARGE_15;
+            status = KP_ERROR_SEND_DATA_TOO_LARGE_15;
+            break;
         }
 
         raw_inf_header.inference_number = inf_data->inference_number;
         raw_inf_header.model_id = inf_data->model_id;
         raw_inf_header.image_buffer_size = buffer_size;
 
+        if (_devices_grp->send_mode == KP_INFERENCE_SEND_MODE_SINGLE_TRANSFER) {
+            uint64_t trace_write = kp_trace_begin();
+            ret = kp_usb_write_data_with_header(ll_dev, (void *)&raw_inf_header, sizeof(raw_inf_header), (void *)inf_data->input_node_data_list[i].buffer, buffer_size, timeout);
+            kp_trace_end(KP_TRACE_STAGE_PAYLOAD_WRITE, trace_write, raw_inf_header.header_stamp.total_size);
+            status = check_send_image_error(ret);
+            if (status != KP_SUCCESS)
+                break;
+
+            continue;
+        }
+
+        uint64_t trace_write = kp_trace_begin();
         ret = kp_usb_write_data(ll_dev, (void *)&raw_inf_header, sizeof(raw_inf_header), timeout);
-        int status = check_inf_desc_error(ret);
+        kp_trace_end(KP_TRACE_STAGE_HEADER_WRITE, trace_write, sizeof(raw_inf_header));
+        status = check_inf_desc_error(ret);
         if (status != KP_SUCCESS)
-            return status;
+            break;
 
+        trace_write = kp_trace_begin();
         ret = kp_usb_write_data(ll_dev, (void *)inf_data->input_node_data_list[i].buffer, buffer_size, timeout);
+        kp_trace_end(KP_TRACE_STAGE_PAYLOAD_WRITE, trace_write, buffer_size);
         status = check_send_image_error(ret);
         if (status != KP_SUCCESS)
-            return status;
+            break;
     }
 
-    return KP_SUCCESS;
+    group_scheduler_end_send(_devices_grp, dev_idx, (status == KP_SUCCESS));
+
+    kp_trace_end(KP_TRACE_STAGE_INFERENCE_SEND, trace_send, inf_data->inference_number);
+
+    return status;
 }
 
 int kp_generic_data_inference_receive(kp_device_group_t devices, kp_generic_data_inference_result_header_t *output_desc, uint8_t *raw_out_buffer, uint32_t buf_size)
 {
     _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
-    kp_usb_device_t *ll_dev = _devices_grp->ll_device[_devices_grp->cur_recv];
+    int dev_idx = 0;
 
-    int timeout = _devices_grp->timeout;
+    uint64_t trace_receive = kp_trace_begin();
 
-    // if return < 0 means libusb error, otherwise return  received size
-    int usb_ret = kp_usb_read_data(ll_dev, (void *)raw_out_buffer, buf_size, timeout);
-    if (usb_ret < 0)
+    int usb_ret = group_scheduler_receive(_devices_grp, raw_out_buffer, buf_size, &dev_idx);
+
+    kp_trace_end(KP_TRACE_STAGE_RESULT_READ, trace_receive, (usb_ret == KP_USB_RET_OK) ? ((kp_inference_header_stamp_t *)raw_out_buffer)->total_size : 0);
+
+    if (usb_ret != KP_USB_RET_OK) {
+        kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, 0);
         return usb_ret;
+    }
 
     // parsing result buffer
 
     kdp2_ipc_generic_raw_bypass_pre_proc_result_t *ipc_result = (kdp2_ipc_generic_raw_bypass_pre_proc_result_t *)raw_out_buffer;
 
+    uint64_t trace_verify = kp_trace_begin();
+
     int status = verify_result_header_stamp((kp_inference_header_stamp_t *)ipc_result, 0, KDP2_INF_ID_GENERIC_RAW_BYPASS_PRE_PROC);
 
     if (status != KP_SUCCESS) {
+        kp_trace_end(KP_TRACE_STAGE_HEADER_VERIFY, trace_verify, 0);
+        kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, 0);
         return status;
     }
 
@@ -467,11 +772,193 @@ int kp_generic_data_inference_receive(kp_device_group_t devices, kp_generic_data
         break;
     }
 
-    if (ipc_result->is_last_crop == 1)
-        _devices_grp->cur_recv++;
+    output_desc->device_index = dev_idx;
 
-    if (_devices_grp->cur_recv >= _devices_grp->num_device)
-        _devices_grp->cur_recv = 0;
+    kp_trace_end(KP_TRACE_STAGE_HEADER_VERIFY, trace_verify, output_desc->inference_number);
+
+    group_scheduler_end_receive(_devices_grp, dev_idx, (ipc_result->is_last_crop == 1));
+
+    kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, output_desc->inference_number);
+
+    return KP_SUCCESS;
+}
+
+static int get_crop_batch_result_size(_kp_devices_group_t *_devices_grp, uint32_t model_id, uint32_t crop_count, uint32_t *result_size)
+{
+    for (int m = 0; m < _devices_grp->loaded_model_desc.num_models; m++)
+    {
+        if (_devices_grp->loaded_model_desc.models[m].id == model_id)
+        {
+            // each crop slot is a 4-byte aligned generic RAW result
+            uint32_t crop_result_size = (_devices_grp->loaded_model_desc.models[m].max_raw_out_size + 3) & ~3;
+
+            *result_size = sizeof(kdp2_ipc_generic_raw_crop_batch_result_t) + crop_count * crop_result_size;
+            return KP_SUCCESS;
+        }
+    }
+
+    return KP_ERROR_MODEL_NOT_LOADED_35;
+}
+
+int kp_generic_crop_batch_inference_get_result_size(kp_device_group_t devices, uint32_t model_id, uint32_t crop_count, uint32_t *result_size)
+{
+    if ((NULL == devices) || (NULL == result_size))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    return get_crop_batch_result_size((_kp_devices_group_t *)devices, model_id, crop_count, result_size);
+}
+
+int kp_generic_crop_batch_inference_send(kp_device_group_t devices, kp_generic_crop_batch_inference_desc_t *inf_data)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    int timeout = _devices_grp->timeout;
+
+    uint32_t image_size = 0;
+    uint32_t result_size = 0;
+
+    if ((KP_DEVICE_KL520 != _devices_grp->product_id) && (KP_DEVICE_KL720 != _devices_grp->product_id)) {
+        return KP_ERROR_UNSUPPORTED_DEVICE_44;
+    }
+
+    if ((0 == inf_data->crop_count) || (MAX_CROP_BATCH_BOX < inf_data->crop_count) || (NULL == inf_data->crop_list)) {
+        return KP_ERROR_INVALID_PARAM_12;
+    }
+
+    if (false == check_model_id_is_exist_in_nef(_devices_grp, inf_data->model_id)) {
+        dbg_print("[%s] model id [%d] not exist in nef\n", __func__, inf_data->model_id);
+        return KP_ERROR_MODEL_NOT_LOADED_35;
+    } else if (false == check_model_input_node_number_is_correct(_devices_grp, inf_data->model_id, 1)) {
+        return KP_ERROR_INVALID_PARAM_12;
+    }
+
+    int ret = get_image_size(inf_data->image_format, inf_data->width, inf_data->height, &image_size);
+    if (ret != KP_SUCCESS)
+        return ret;
+
+    kdp2_ipc_generic_raw_crop_batch_inf_header_t raw_inf_header;
+
+    raw_inf_header.header_stamp.magic_type = KDP2_MAGIC_TYPE_INFERENCE;
+    raw_inf_header.header_stamp.total_size = sizeof(raw_inf_header) + image_size;
+    raw_inf_header.header_stamp.job_id = KDP2_INF_ID_GENERIC_RAW_CROP_BATCH;
+    raw_inf_header.header_stamp.total_image = 1;
+    raw_inf_header.header_stamp.image_index = 0;
+
+    if (raw_inf_header.header_stamp.total_size > _devices_grp->ddr_attr.input_buffer_size) {
+        dbg_print("[%s] image buffer size is not enough in firmware\n", __func__);
+        return KP_ERROR_SEND_DATA_TOO_LARGE_15;
+    }
+
+    // all crop outputs come back in one result buffer of the FIFO queue
+    get_crop_batch_result_size(_devices_grp, inf_data->model_id, inf_data->crop_count, &result_size);
+
+    if (result_size > _devices_grp->ddr_attr.result_buffer_size) {
+        dbg_print("[%s] result buffer size %u is not enough for %u crops, %u is needed\n", __func__,
+                  _devices_grp->ddr_attr.result_buffer_size, inf_data->crop_count, result_size);
+        return KP_ERROR_SEND_DATA_TOO_LARGE_15;
+    }
+
+    raw_inf_header.inference_number = inf_data->inference_number;
+    raw_inf_header.model_id = inf_data->model_id;
+    raw_inf_header.width = inf_data->width;
+    raw_inf_header.height = inf_data->height;
+    raw_inf_header.resize_mode = inf_data->resize_mode;
+    raw_inf_header.padding_mode = inf_data->padding_mode;
+    raw_inf_header.image_format = inf_data->image_format;
+    raw_inf_header.normalize_mode = inf_data->normalize_mode;
+    raw_inf_header.crop_count = inf_data->crop_count;
+
+    memcpy(raw_inf_header.inf_crop, inf_data->crop_list, inf_data->crop_count * sizeof(kp_inf_crop_box_t));
+    memset(&raw_inf_header.inf_crop[inf_data->crop_count], 0, (MAX_CROP_BATCH_BOX - inf_data->crop_count) * sizeof(kp_inf_crop_box_t));
+
+    uint64_t trace_send = kp_trace_begin();
+
+    int dev_idx = group_scheduler_begin_send(_devices_grp);
+    kp_usb_device_t *ll_dev = _devices_grp->ll_device[dev_idx];
+
+    uint64_t trace_write = kp_trace_begin();
+    ret = kp_usb_write_data_with_header(ll_dev, (void *)&raw_inf_header, sizeof(raw_inf_header), (void *)inf_data->image_buffer, image_size, timeout);
+    kp_trace_end(KP_TRACE_STAGE_PAYLOAD_WRITE, trace_write, raw_inf_header.header_stamp.total_size);
+
+    int status = check_send_image_error(ret);
+
+    group_scheduler_end_send(_devices_grp, dev_idx, (status == KP_SUCCESS));
+
+    kp_trace_end(KP_TRACE_STAGE_INFERENCE_SEND, trace_send, inf_data->inference_number);
+
+    return status;
+}
+
+int kp_generic_crop_batch_inference_receive(kp_device_group_t devices, kp_generic_crop_batch_inference_result_header_t *output_desc, uint8_t *raw_out_buffer, uint32_t buf_size)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+    int dev_idx = 0;
+
+    uint64_t trace_receive = kp_trace_begin();
+
+    int usb_ret = group_scheduler_receive(_devices_grp, raw_out_buffer, buf_size, &dev_idx);
+
+    kp_trace_end(KP_TRACE_STAGE_RESULT_READ, trace_receive, (usb_ret == KP_USB_RET_OK) ? ((kp_inference_header_stamp_t *)raw_out_buffer)->total_size : 0);
+
+    if (usb_ret != KP_USB_RET_OK) {
+        kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, 0);
+        return usb_ret;
+    }
+
+    // parsing result buffer
+
+    kdp2_ipc_generic_raw_crop_batch_result_t *ipc_result = (kdp2_ipc_generic_raw_crop_batch_result_t *)raw_out_buffer;
+
+    uint64_t trace_verify = kp_trace_begin();
+
+    int status = verify_result_header_stamp((kp_inference_header_stamp_t *)ipc_result, 0, KDP2_INF_ID_GENERIC_RAW_CROP_BATCH);
+
+    if (status != KP_ERROR_RECEIVE_INCORRECT_HEADER_STAMP_30) {
+        // the device sends nothing else for a batch, even a failed one
+        group_scheduler_end_receive(_devices_grp, dev_idx, true);
+    }
+
+    if ((status == KP_SUCCESS) &&
+        ((MAX_CROP_BATCH_BOX < ipc_result->crop_count) ||
+         (sizeof(kdp2_ipc_generic_raw_crop_batch_result_t) + ipc_result->crop_count * ipc_result->crop_result_size > ipc_result->header_stamp.total_size))) {
+        status = KP_ERROR_RECEIVE_SIZE_MISMATCH_31;
+    }
+
+    if (status != KP_SUCCESS) {
+        kp_trace_end(KP_TRACE_STAGE_HEADER_VERIFY, trace_verify, 0);
+        kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, 0);
+        return status;
+    }
+
+    output_desc->inference_number = ipc_result->inf_number;
+    output_desc->crop_count = ipc_result->crop_count;
+    output_desc->product_id = ipc_result->product_id;
+    output_desc->device_index = dev_idx;
+
+    kp_trace_end(KP_TRACE_STAGE_HEADER_VERIFY, trace_verify, output_desc->inference_number);
+
+    kp_trace_end(KP_TRACE_STAGE_INFERENCE_RECEIVE, trace_receive, output_desc->inference_number);
+
+    return KP_SUCCESS;
+}
+
+int kp_generic_crop_batch_inference_get_crop_result(uint32_t crop_idx, uint8_t *raw_out_buffer, kp_generic_image_inference_result_header_t *crop_desc, uint8_t **crop_raw_out)
+{
+    kdp2_ipc_generic_raw_crop_batch_result_t *ipc_result = (kdp2_ipc_generic_raw_crop_batch_result_t *)raw_out_buffer;
+
+    if (crop_idx >= ipc_result->crop_count)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    uint8_t *crop_buffer = ipc_result->crop_results + crop_idx * ipc_result->crop_result_size;
+
+    int status = verify_result_header_stamp((kp_inference_header_stamp_t *)crop_buffer, 0, KDP2_INF_ID_GENERIC_RAW);
+
+    if (status != KP_SUCCESS)
+        return status;
+
+    get_image_result_header(crop_buffer, crop_desc);
+
+    *crop_raw_out = crop_buffer;
 
     return KP_SUCCESS;
 }
@@ -479,12 +966,13 @@ int kp_generic_data_inference_receive(kp_device_group_t devices, kp_generic_data
 #define KDP_COL_MIN_8       8
 #define KDP_COL_MIN_16      16
 #define KDP_CHANNEL_MIN_16  16
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
 uint32_t round_up(uint32_t num, uint32_t round_num)
 {
     return ((num + (round_num - 1)) & ~(round_num - 1));
 }
 
-kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uint32_t node_idx, uint8_t *raw_out_buffer)
+static bool get_raw_fixed_node(uint32_t node_idx, uint8_t *raw_out_buffer, kp_inf_raw_fixed_node_output_t *node_output)
 {
     kdp2_ipc_generic_raw_result_t *raw_result = (kdp2_ipc_generic_raw_result_t *)raw_out_buffer;
 
@@ -495,11 +983,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
         uint8_t *data_start = raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t);
         uint32_t out_node_num = *(uint32_t *)data_start;
         if (node_idx > out_node_num - 1)
-            return NULL;
-
-        kp_inf_raw_fixed_node_output_t *node_output = (kp_inf_raw_fixed_node_output_t *)malloc(sizeof(kp_inf_raw_fixed_node_output_t));
-        if (NULL == node_output)
-            return NULL;
+            return false;
 
         kp_inf_raw_fixed_node_metadata_t *node_desc = (kp_inf_raw_fixed_node_metadata_t *)(data_start + 4);
 
@@ -515,7 +999,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
         // cast npu data layout to kp_tensor_format
         node_output->metadata.data_layout = convert_data_format_to_kp_tensor_format(node_output->metadata.data_layout, KP_MODEL_TARGET_CHIP_KL520);
 
-        return node_output;
+        return true;
     }
     break;
 
@@ -523,11 +1007,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
     {
         _720_raw_cnn_res_t *pRawHead = (_720_raw_cnn_res_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
         if (node_idx > pRawHead->total_nodes - 1)
-            return NULL;
-
-        kp_inf_raw_fixed_node_output_t *node_output = (kp_inf_raw_fixed_node_output_t *)malloc(sizeof(kp_inf_raw_fixed_node_output_t));
-        if (NULL == node_output)
-            return NULL;
+            return false;
 
         node_output->metadata.height = pRawHead->onode_a[node_idx].row_length;
         node_output->metadata.channel = pRawHead->onode_a[node_idx].ch_length;
@@ -542,7 +1022,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
         // cast npu data layout to kp_tensor_format
         node_output->metadata.data_layout = convert_data_format_to_kp_tensor_format(node_output->metadata.data_layout, KP_MODEL_TARGET_CHIP_KL720);
 
-        return node_output;
+        return true;
     }
     break;
 
@@ -550,11 +1030,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
     {
         _830_raw_cnn_res_t *pRawHead = (_830_raw_cnn_res_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
         if (node_idx > (uint32_t)(pRawHead->total_nodes - 1))
-            return NULL;
-
-        kp_inf_raw_fixed_node_output_t *node_output = (kp_inf_raw_fixed_node_output_t *)malloc(sizeof(kp_inf_raw_fixed_node_output_t));
-        if (NULL == node_output)
-            return NULL;
+            return false;
 
         node_output->metadata.height = pRawHead->onode_a[node_idx].row_length;
         node_output->metadata.channel = pRawHead->onode_a[node_idx].ch_length;
@@ -569,7 +1045,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
         // cast npu data layout to kp_tensor_format
         node_output->metadata.data_layout = convert_data_format_to_kp_tensor_format(node_output->metadata.data_layout, KP_MODEL_TARGET_CHIP_KL730);
 
-        return node_output;
+        return true;
     }
     break;
 
@@ -577,11 +1053,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
     {
         _730_raw_cnn_res_t *pRawHead = (_730_raw_cnn_res_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
         if (node_idx > (uint32_t)(pRawHead->total_nodes - 1))
-            return NULL;
-
-        kp_inf_raw_fixed_node_output_t *node_output = (kp_inf_raw_fixed_node_output_t *)malloc(sizeof(kp_inf_raw_fixed_node_output_t));
-        if (NULL == node_output)
-            return NULL;
+            return false;
 
         node_output->metadata.height = pRawHead->onode_a[node_idx].row_length;
         node_output->metadata.channel = pRawHead->onode_a[node_idx].ch_length;
@@ -596,7 +1068,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
         // cast npu data layout to kp_tensor_format
         node_output->metadata.data_layout = convert_data_format_to_kp_tensor_format(node_output->metadata.data_layout, KP_MODEL_TARGET_CHIP_KL730);
 
-        return node_output;
+        return true;
     }
     break;
 
@@ -604,11 +1076,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
     {
         _630_raw_cnn_res_t *pRawHead = (_630_raw_cnn_res_t *)(raw_out_buffer + sizeof(kdp2_ipc_generic_raw_result_t));
         if (node_idx > (uint32_t)(pRawHead->total_nodes - 1))
-            return NULL;
-
-        kp_inf_raw_fixed_node_output_t *node_output = (kp_inf_raw_fixed_node_output_t *)malloc(sizeof(kp_inf_raw_fixed_node_output_t));
-        if (NULL == node_output)
-            return NULL;
+            return false;
 
         node_output->metadata.height = pRawHead->onode_a[node_idx].row_length;
         node_output->metadata.channel = pRawHead->onode_a[node_idx].ch_length;
@@ -623,7 +1091,7 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
         // cast npu data layout to kp_tensor_format
         node_output->metadata.data_layout = convert_data_format_to_kp_tensor_format(node_output->metadata.data_layout, KP_MODEL_TARGET_CHIP_KL630);
 
-        return node_output;
+        return true;
     }
     break;
 
@@ -632,7 +1100,22 @@ kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uin
     break;
     }
 
-    return NULL;
+    return false;
+}
+
+kp_inf_raw_fixed_node_output_t *kp_generic_inference_retrieve_raw_fixed_node(uint32_t node_idx, uint8_t *raw_out_buffer)
+{
+    kp_inf_raw_fixed_node_output_t *node_output = (kp_inf_raw_fixed_node_output_t *)malloc(sizeof(kp_inf_raw_fixed_node_output_t));
+    if (NULL == node_output)
+        return NULL;
+
+    if (false == get_raw_fixed_node(node_idx, raw_out_buffer, node_output))
+    {
+        free(node_output);
+        return NULL;
+    }
+
+    return node_output;
 }
 
 #define SIZE_OF_FIXED_NODE_DATA 4 // sizeof(int16_t) + padding size for align 4 (ref. kp_inf_fixed_node_output_t)
@@ -879,121 +1362,96 @@ kp_inf_fixed_node_output_t *kp_generic_inference_retrieve_fixed_node(uint32_t no
     return fixed_node_output;
 }
 
-kp_inf_float_node_output_t *kp_generic_inference_retrieve_float_node(uint32_t node_idx, uint8_t *raw_out_buffer, kp_channel_ordering_t ordering)
+int kp_generic_inference_get_float_node_size(uint32_t node_idx, uint8_t *raw_out_buffer, uint32_t *buf_size)
 {
-    kp_inf_raw_fixed_node_output_t *raw_fixed_node_output = kp_generic_inference_retrieve_raw_fixed_node(node_idx, raw_out_buffer);
-    kdp2_ipc_generic_raw_result_t *raw_result = (kdp2_ipc_generic_raw_result_t *)raw_out_buffer;
+    kp_inf_raw_fixed_node_output_t raw_fixed_node_output;
 
-    if (NULL == raw_fixed_node_output)
-        return NULL;
+    if (NULL == raw_out_buffer || NULL == buf_size)
+        return KP_ERROR_INVALID_PARAM_12;
 
-    kp_inf_float_node_output_t *float_node_output = NULL;
+    if (false == get_raw_fixed_node(node_idx, raw_out_buffer, &raw_fixed_node_output))
+        return KP_ERROR_INVALID_PARAM_12;
 
-    int num_data = raw_fixed_node_output->metadata.height * raw_fixed_node_output->metadata.channel * raw_fixed_node_output->metadata.width; // FIXME width
+    uint32_t num_data = raw_fixed_node_output.metadata.height * raw_fixed_node_output.metadata.channel * raw_fixed_node_output.metadata.width;
 
-    float_node_output = (kp_inf_float_node_output_t *)malloc(sizeof(kp_inf_float_node_output_t) + num_data * sizeof(float));
+    *buf_size = sizeof(kp_inf_float_node_output_t) + num_data * sizeof(float);
 
-    if (NULL == float_node_output)
-    {
-        printf("memory is insufficient to allocate buffer for node output\n");
+    return KP_SUCCESS;
+}
 
-        free(raw_fixed_node_output); //memory is allocated in kp_generic_inference_retrieve_raw_fixed_node()
-        return NULL;
-    }
+static int retrieve_float_node_to_buffer(uint32_t node_idx, uint8_t *raw_out_buffer, kp_channel_ordering_t ordering,
+                                         kp_inf_float_node_output_t *float_node_output, uint32_t buf_size)
+{
+    kdp2_ipc_generic_raw_result_t *raw_result = (kdp2_ipc_generic_raw_result_t *)raw_out_buffer;
+    kp_inf_raw_fixed_node_output_t raw_fixed_node_output;
 
-    float_node_output->channel = raw_fixed_node_output->metadata.channel;
-    float_node_output->height = raw_fixed_node_output->metadata.height;
-    float_node_output->width = raw_fixed_node_output->metadata.width;
-    float_node_output->num_data = num_data;
+    if (NULL == raw_out_buffer || NULL == float_node_output)
+        return KP_ERROR_INVALID_PARAM_12;
 
-    float scale = raw_fixed_node_output->metadata.scale;
-    int32_t radix = raw_fixed_node_output->metadata.radix;
-    float ffactor = 0;
+    if (false == get_raw_fixed_node(node_idx, raw_out_buffer, &raw_fixed_node_output))
+        return KP_ERROR_INVALID_PARAM_12;
 
-    #ifdef OPTIMIZED_FIXED_TO_FLOAT
-    {
-        ffactor = (float)1 / (float)(scale * pow2(radix));
-    }
-    #else
-    {
-        ffactor = (float)(scale * pow2(radix));
-    }
-    #endif
+    int height = raw_fixed_node_output.metadata.height;
+    int channel = raw_fixed_node_output.metadata.channel;
+    int width = raw_fixed_node_output.metadata.width;
+    int num_data = height * channel * width; // FIXME width
+
+    if (buf_size < sizeof(kp_inf_float_node_output_t) + num_data * sizeof(float))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    float_node_output->channel = channel;
+    float_node_output->height = height;
+    float_node_output->width = width;
+    float_node_output->num_data = num_data;
+
+    // dequantize by dividing the conversion factor, it is fused with layout conversion
+    float ffactor = (float)(raw_fixed_node_output.metadata.scale * pow2(raw_fixed_node_output.metadata.radix));
 
     kp_channel_ordering_convert_t channel_ordering_convert_code = get_channel_ordering_convert_code(raw_result->product_id, ordering);
+    float *data = float_node_output->data;
     int width_aligned = 0;
-    int n = 0;
 
-    if (KP_MODEL_TENSOR_DATA_LAYOUT_8W1C16B == raw_fixed_node_output->metadata.data_layout)
+    if (KP_MODEL_TENSOR_DATA_LAYOUT_8W1C16B == raw_fixed_node_output.metadata.data_layout)
     {
         /* standard 16-bit floating-point output */
-        width_aligned = round_up(float_node_output->width, KDP_COL_MIN_8);
+        int16_t *raw_data = (int16_t *)raw_fixed_node_output.data;
+        width_aligned = round_up(width, KDP_COL_MIN_8);
 
         switch (channel_ordering_convert_code)
         {
         case KP_CHANNEL_ORDERING_CVT_HCW2CHW:
-            for (int c = 0; c < float_node_output->channel; c++)
+            for (int c = 0; c < channel; c++)
             {
-                for (int h = 0; h < float_node_output->height; h++)
-                {
-                    for (int w = 0; w < float_node_output->width; w++)
-                        float_node_output->data[n++] = (float)((int16_t *)(raw_fixed_node_output->data))[(h * float_node_output->channel * width_aligned) +
-                                                                                                         (c * width_aligned) +
-                                                                                                          w] / ffactor;
-                }
+                for (int h = 0; h < height; h++)
+                    node_convert_s16_to_float(data + (c * height + h) * width, raw_data + (h * channel + c) * width_aligned, width, ffactor);
             }
             break;
         case KP_CHANNEL_ORDERING_CVT_CHW2HCW:
-            for (int h = 0; h < float_node_output->height; h++)
+            for (int h = 0; h < height; h++)
             {
-                for (int c = 0; c < float_node_output->channel; c++)
-                {
-                    for (int w = 0; w < float_node_output->width; w++)
-                        float_node_output->data[n++] = (float)((int16_t *)(raw_fixed_node_output->data))[(c * float_node_output->height * width_aligned) +
-                                                                                                          (h * width_aligned) +
-                                                                                                           w] / ffactor;
-                }
+                for (int c = 0; c < channel; c++)
+                    node_convert_s16_to_float(data + (h * channel + c) * width, raw_data + (c * height + h) * width_aligned, width, ffactor);
             }
             break;
         case KP_CHANNEL_ORDERING_CVT_HCW2HWC:
-            for (int h = 0; h < float_node_output->height; h++)
-            {
-                for (int w = 0; w < float_node_output->width; w++)
-                {
-                    for (int c = 0; c < float_node_output->channel; c++)
-                        float_node_output->data[n++] = (float)((int16_t *)(raw_fixed_node_output->data))[(h * float_node_output->channel * width_aligned) +
-                                                                                                         (c * width_aligned) +
-                                                                                                          w] / ffactor;
-                }
-            }
+            for (int h = 0; h < height; h++)
+                node_convert_s16_to_float_transpose(data + h * width * channel, channel, raw_data + h * channel * width_aligned, width_aligned, channel, width, ffactor);
             break;
         case KP_CHANNEL_ORDERING_CVT_CHW2HWC:
-            for (int h = 0; h < float_node_output->height; h++)
-            {
-                for (int w = 0; w < float_node_output->width; w++)
-                {
-                    for (int c = 0; c < float_node_output->channel; c++)
-                        float_node_output->data[n++] = (float)((int16_t *)(raw_fixed_node_output->data))[(c * float_node_output->height * width_aligned) +
-                                                                                                         (h * width_aligned) +
-                                                                                                          w] / ffactor;
-                }
-            }
+            for (int h = 0; h < height; h++)
+                node_convert_s16_to_float_transpose(data + h * width * channel, channel, raw_data + h * width_aligned, height * width_aligned, channel, width, ffactor);
             break;
         default:
-            for (int i = 0; i < float_node_output->height * float_node_output->channel; i++)
-            {
-                for (int j = 0; j < float_node_output->width; j++)
-                    float_node_output->data[n++] = (float)((int16_t *)(raw_fixed_node_output->data))[i * width_aligned + j] / ffactor;
-            }
+            for (int i = 0; i < height * channel; i++)
+                node_convert_s16_to_float(data + i * width, raw_data + i * width_aligned, width, ffactor);
             break;
         }
     }
-    else if (KP_MODEL_TENSOR_DATA_LAYOUT_1W16C8B == raw_fixed_node_output->metadata.data_layout)
+    else if (KP_MODEL_TENSOR_DATA_LAYOUT_1W16C8B == raw_fixed_node_output.metadata.data_layout)
     {
         /* 8-bit fixed-point output */
-        int channel_block_idx = 0;
-        int channel_offset_idx = 0;
-        int channel_block_size = float_node_output->height * float_node_output->width * KDP_CHANNEL_MIN_16;
+        int8_t *raw_data = raw_fixed_node_output.data;
+        int channel_block_size = height * width * KDP_CHANNEL_MIN_16;
 
         switch (channel_ordering_convert_code)
         {
@@ -1001,51 +1459,37 @@ kp_inf_float_node_output_t *kp_generic_inference_retrieve_float_node(uint32_t no
         case KP_CHANNEL_ORDERING_CVT_HCW2HWC:
             /* KL520 not support 1W16C8B ouput NPU data layout format */
             printf("Invalid NPU data layout of HCW to CHW/HWC channel order conversion, NPU data layout = KP_MODEL_TENSOR_DATA_LAYOUT_1W16C8B.\n");
-            free(raw_fixed_node_output);
-            free(float_node_output);
-            return NULL;
-            break;
+            return KP_ERROR_INVALID_PARAM_12;
         case KP_CHANNEL_ORDERING_CVT_CHW2HCW:
-            for (int h = 0; h < float_node_output->height; h++)
+            for (int h = 0; h < height; h++)
             {
-                for (int c = 0; c < float_node_output->channel; c++)
+                for (int c = 0; c < channel; c += KDP_CHANNEL_MIN_16)
                 {
-                    channel_block_idx = c / KDP_CHANNEL_MIN_16;
-                    channel_offset_idx = c % KDP_CHANNEL_MIN_16;
-                    for (int w = 0; w < float_node_output->width; w++)
-                        float_node_output->data[n++] = (float)((int8_t *)(raw_fixed_node_output->data))[(channel_block_idx * channel_block_size) +
-                                                                                                        (h * float_node_output->width * KDP_CHANNEL_MIN_16) +
-                                                                                                        (w * KDP_CHANNEL_MIN_16) +
-                                                                                                        (channel_offset_idx)] / ffactor;
+                    int block_channel = MIN(channel - c, KDP_CHANNEL_MIN_16);
+                    node_convert_s8_to_float_transpose(data + (h * channel + c) * width, width,
+                                                       raw_data + (c / KDP_CHANNEL_MIN_16) * channel_block_size + h * width * KDP_CHANNEL_MIN_16, KDP_CHANNEL_MIN_16,
+                                                       width, block_channel, ffactor);
                 }
             }
             break;
         case KP_CHANNEL_ORDERING_CVT_CHW2HWC:
-            for (int h = 0; h < float_node_output->height; h++)
+            // channels of one pixel are contiguous in each channel block
+            for (int c = 0; c < channel; c += KDP_CHANNEL_MIN_16)
             {
-                for (int w = 0; w < float_node_output->width; w++)
-                {
-                    for (int c = 0; c < float_node_output->channel; c++)
-                    {
-                        channel_block_idx = c / KDP_CHANNEL_MIN_16;
-                        channel_offset_idx = c % KDP_CHANNEL_MIN_16;
-                        float_node_output->data[n++] = (float)((int8_t *)(raw_fixed_node_output->data))[(channel_block_idx * channel_block_size) +
-                                                                                                        (h * float_node_output->width * KDP_CHANNEL_MIN_16) +
-                                                                                                        (w * KDP_CHANNEL_MIN_16) +
-                                                                                                        (channel_offset_idx)] / ffactor;
-                    }
-                }
+                int block_channel = MIN(channel - c, KDP_CHANNEL_MIN_16);
+                int8_t *block_data = raw_data + (c / KDP_CHANNEL_MIN_16) * channel_block_size;
+
+                for (int i = 0; i < height * width; i++)
+                    node_convert_s8_to_float(data + i * channel + c, block_data + i * KDP_CHANNEL_MIN_16, block_channel, ffactor);
             }
             break;
         default:
-            for (int c = 0; c < float_node_output->channel; c++)
+            for (int c = 0; c < channel; c += KDP_CHANNEL_MIN_16)
             {
-                channel_block_idx = c / KDP_CHANNEL_MIN_16;
-                channel_offset_idx = c % KDP_CHANNEL_MIN_16;
-                for (int i = 0; i < float_node_output->height * float_node_output->width; i++)
-                    float_node_output->data[n++] = (float)((int8_t *)(raw_fixed_node_output->data))[(channel_block_idx * channel_block_size) +
-                                                                                                    (i * KDP_CHANNEL_MIN_16) +
-                                                                                                    (channel_offset_idx)] / ffactor;
+                int block_channel = MIN(channel - c, KDP_CHANNEL_MIN_16);
+                node_convert_s8_to_float_transpose(data + c * height * width, height * width,
+                                                   raw_data + (c / KDP_CHANNEL_MIN_16) * channel_block_size, KDP_CHANNEL_MIN_16,
+                                                   height * width, block_channel, ffactor);
             }
             break;
         }
@@ -1053,73 +1497,155 @@ kp_inf_float_node_output_t *kp_generic_inference_retrieve_float_node(uint32_t no
     else
     {
         /* standard 8-bit floating-point output */
-        width_aligned = round_up(float_node_output->width, KDP_COL_MIN_16);
+        int8_t *raw_data = raw_fixed_node_output.data;
+        width_aligned = round_up(width, KDP_COL_MIN_16);
 
         switch (channel_ordering_convert_code)
         {
         case KP_CHANNEL_ORDERING_CVT_HCW2CHW:
-            for (int c = 0; c < float_node_output->channel; c++)
+            for (int c = 0; c < channel; c++)
             {
-                for (int h = 0; h < float_node_output->height; h++)
-                {
-                    for (int w = 0; w < float_node_output->width; w++)
-                        float_node_output->data[n++] = (float)((int8_t *)(raw_fixed_node_output->data))[(h * float_node_output->channel * width_aligned) +
-                                                                                                        (c * width_aligned) +
-                                                                                                         w] / ffactor;
-                }
+                for (int h = 0; h < height; h++)
+                    node_convert_s8_to_float(data + (c * height + h) * width, raw_data + (h * channel + c) * width_aligned, width, ffactor);
             }
             break;
         case KP_CHANNEL_ORDERING_CVT_CHW2HCW:
-            for (int h = 0; h < float_node_output->height; h++)
+            for (int h = 0; h < height; h++)
             {
-                for (int c = 0; c < float_node_output->channel; c++)
-                {
-                    for (int w = 0; w < float_node_output->width; w++)
-                        float_node_output->data[n++] = (float)((int8_t *)(raw_fixed_node_output->data))[(c * float_node_output->height * width_aligned) +
-                                                                                                        (h * width_aligned) +
-                                                                                                         w] / ffactor;
-                }
+                for (int c = 0; c < channel; c++)
+                    node_convert_s8_to_float(data + (h * channel + c) * width, raw_data + (c * height + h) * width_aligned, width, ffactor);
             }
             break;
         case KP_CHANNEL_ORDERING_CVT_HCW2HWC:
-            for (int h = 0; h < float_node_output->height; h++)
-            {
-                for (int w = 0; w < float_node_output->width; w++)
-                {
-                    for (int c = 0; c < float_node_output->channel; c++)
-                        float_node_output->data[n++] = (float)((int8_t *)(raw_fixed_node_output->data))[(h * float_node_output->channel * width_aligned) +
-                                                                                                        (c * width_aligned) +
-                                                                                                         w] / ffactor;
-                }
-            }
+            for (int h = 0; h < height; h++)
+                node_convert_s8_to_float_transpose(data + h * width * channel, channel, raw_data + h * channel * width_aligned, width_aligned, channel, width, ffactor);
             break;
         case KP_CHANNEL_ORDERING_CVT_CHW2HWC:
-            for (int h = 0; h < float_node_output->height; h++)
-            {
-                for (int w = 0; w < float_node_output->width; w++)
-                {
-                    for (int c = 0; c < float_node_output->channel; c++)
-                        float_node_output->data[n++] = (float)((int8_t *)(raw_fixed_node_output->data))[(c * float_node_output->height * width_aligned) +
-                                                                                                        (h * width_aligned) +
-                                                                                                         w] / ffactor;
-                }
-            }
+            for (int h = 0; h < height; h++)
+                node_convert_s8_to_float_transpose(data + h * width * channel, channel, raw_data + h * width_aligned, height * width_aligned, channel, width, ffactor);
             break;
         default:
-            for (int i = 0; i < float_node_output->height * float_node_output->channel; i++)
-            {
-                for (int j = 0; j < float_node_output->width; j++)
-                    float_node_output->data[n++] = (float)((int8_t *)(raw_fixed_node_output->data))[i * width_aligned + j] / ffactor;
-            }
+            for (int i = 0; i < height * channel; i++)
+                node_convert_s8_to_float(data + i * width, raw_data + i * width_aligned, width, ffactor);
             break;
         }
     }
 
-    free(raw_fixed_node_output);
+    return KP_SUCCESS;
+}
+
+int kp_generic_inference_retrieve_float_node_to_buffer(uint32_t node_idx, uint8_t *raw_out_buffer, kp_channel_ordering_t ordering,
+                                                        kp_inf_float_node_output_t *float_node_output, uint32_t buf_size)
+{
+    uint64_t trace_convert = kp_trace_begin();
+
+    int ret = retrieve_float_node_to_buffer(node_idx, raw_out_buffer, ordering, float_node_output, buf_size);
+
+    kp_trace_end(KP_TRACE_STAGE_NODE_CONVERT, trace_convert, node_idx);
+
+    return ret;
+}
+
+kp_inf_float_node_output_t *kp_generic_inference_retrieve_float_node(uint32_t node_idx, uint8_t *raw_out_buffer, kp_channel_ordering_t ordering)
+{
+    uint32_t buf_size = 0;
+
+    if (KP_SUCCESS != kp_generic_inference_get_float_node_size(node_idx, raw_out_buffer, &buf_size))
+        return NULL;
+
+    kp_inf_float_node_output_t *float_node_output = (kp_inf_float_node_output_t *)malloc(buf_size);
+
+    if (NULL == float_node_output)
+    {
+        printf("memory is insufficient to allocate buffer for node output\n");
+        return NULL;
+    }
+
+    if (KP_SUCCESS != kp_generic_inference_retrieve_float_node_to_buffer(node_idx, raw_out_buffer, ordering, float_node_output, buf_size))
+    {
+        free(float_node_output);
+        return NULL;
+    }
 
     return float_node_output;
 }
 
+static int get_raw_fixed_node_to_reduce(uint32_t node_idx, uint8_t *raw_out_buffer, kp_inf_raw_fixed_node_output_t *node_output, bool *hcw, float *ffactor)
+{
+    if (NULL == raw_out_buffer)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if (false == get_raw_fixed_node(node_idx, raw_out_buffer, node_output))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if (!(0 < node_output->metadata.scale))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    // KL520 rows are in height x channel x width order, the others in channel x height x width order
+    *hcw = (KP_DEVICE_KL520 == ((kdp2_ipc_generic_raw_result_t *)raw_out_buffer)->product_id);
+    *ffactor = (float)(node_output->metadata.scale * pow2(node_output->metadata.radix));
+
+    return KP_SUCCESS;
+}
+
+int kp_generic_inference_retrieve_node_argmax(uint32_t node_idx, uint8_t *raw_out_buffer, uint16_t *class_map, float *score_map, uint32_t map_size)
+{
+    kp_inf_raw_fixed_node_output_t raw_fixed_node_output;
+    bool hcw;
+    float ffactor;
+
+    if (NULL == class_map)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    int ret = get_raw_fixed_node_to_reduce(node_idx, raw_out_buffer, &raw_fixed_node_output, &hcw, &ffactor);
+    if (KP_SUCCESS != ret)
+        return ret;
+
+    if (map_size < raw_fixed_node_output.metadata.height * raw_fixed_node_output.metadata.width || UINT16_MAX < raw_fixed_node_output.metadata.channel)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    node_reduce_argmax(&raw_fixed_node_output, hcw, ffactor, class_map, score_map);
+
+    return KP_SUCCESS;
+}
+
+int kp_generic_inference_retrieve_node_top_k(uint32_t node_idx, uint8_t *raw_out_buffer, uint32_t k, kp_inf_node_element_t *elements, uint32_t *num_element)
+{
+    kp_inf_raw_fixed_node_output_t raw_fixed_node_output;
+    bool hcw;
+    float ffactor;
+
+    if ((NULL == elements && 0 < k) || NULL == num_element)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    int ret = get_raw_fixed_node_to_reduce(node_idx, raw_out_buffer, &raw_fixed_node_output, &hcw, &ffactor);
+    if (KP_SUCCESS != ret)
+        return ret;
+
+    *num_element = node_reduce_top_k(&raw_fixed_node_output, hcw, ffactor, k, elements);
+
+    return KP_SUCCESS;
+}
+
+int kp_generic_inference_retrieve_node_threshold(uint32_t node_idx, uint8_t *raw_out_buffer, float threshold,
+                                                 kp_inf_node_element_t *elements, uint32_t max_element, uint32_t *num_element)
+{
+    kp_inf_raw_fixed_node_output_t raw_fixed_node_output;
+    bool hcw;
+    float ffactor;
+
+    if ((NULL == elements && 0 < max_element) || NULL == num_element || isnan(threshold))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    int ret = get_raw_fixed_node_to_reduce(node_idx, raw_out_buffer, &raw_fixed_node_output, &hcw, &ffactor);
+    if (KP_SUCCESS != ret)
+        return ret;
+
+    *num_element = node_reduce_threshold(&raw_fixed_node_output, hcw, ffactor, threshold, elements, max_element);
+
+    return KP_SUCCESS;
+}
+
 int kp_customized_inference_send(kp_device_group_t devices, void *header, int header_size, uint8_t *image, int image_size)
 {
     int ret;
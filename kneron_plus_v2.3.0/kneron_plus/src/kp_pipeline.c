@@ -0,0 +1,785 @@
+/**
+ * @file        kp_pipeline.c
+ * @brief       pipelined inference executor
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+// #define DEBUG_PRINT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "kp_inference.h"
+#include "kp_pipeline.h"
+#include "kp_internal.h"
+
+#ifdef DEBUG_PRINT
+#define dbg_print(format, ...) { printf(format, ##__VA_ARGS__); fflush(stdout); }
+#else
+#define dbg_print(format, ...)
+#endif
+
+#define PIPELINE_DEFAULT_NUM_FRAME 8
+#define PIPELINE_DEFAULT_NUM_WORKER 2
+#define PIPELINE_MAX_NUM_WORKER 16
+
+typedef enum
+{
+    PIPELINE_STAGE_PRE_PROCESS = 0,
+    PIPELINE_STAGE_POST_PROCESS = 1,
+} _pipeline_stage_t;
+
+typedef struct
+{
+    kp_pipeline_frame_t frame; // must be the first member
+    int index;                 // used as 'inference_number'
+    _pipeline_stage_t stage;
+    bool in_device;            // sent but not received, protected by pipeline mutex
+    uint64_t send_seq;         // sending order, protected by pipeline mutex
+    uint32_t *float_node_size; // buffer size of float_node_list[i]
+} _pipeline_frame_t;
+
+// bounded multi-producer multi-consumer queue, lock-free except for sleeping when it is empty
+typedef struct
+{
+    size_t sequence;
+    _pipeline_frame_t *frame;
+} _queue_cell_t;
+
+typedef struct
+{
+    _queue_cell_t *cells;
+    size_t mask;
+    size_t enqueue_pos;
+    size_t dequeue_pos;
+    int num_waiter;
+    bool closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} _frame_queue_t;
+
+struct kp_pipeline_s
+{
+    _kp_devices_group_t *devices_grp;
+    kp_pipeline_config_t config;
+    int num_frame;
+    int num_worker;
+    int max_frame_in_device;
+    uint32_t num_output_node;
+    uint32_t raw_out_size;
+
+    _pipeline_frame_t *frames;
+    uint8_t *recv_buf; // spare RAW output buffer, swapped with the buffer of the received frame
+
+    _frame_queue_t free_queue; // frames not in use
+    _frame_queue_t work_queue; // frames to be pre-processed or post-processed by workers
+    _frame_queue_t send_queue; // frames to be sent
+    _frame_queue_t done_queue; // completed frames for kp_pipeline_get_frame()
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int num_in_device;
+    int num_pending; // submitted but not completed
+    uint64_t send_seq;
+    bool stopping;
+    bool stop;
+
+    pthread_t send_thread;
+    pthread_t recv_thread;
+    pthread_t worker_thread[PIPELINE_MAX_NUM_WORKER];
+    int num_thread_started;
+};
+
+static void get_deadline(struct timespec *deadline, int timeout)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout / 1000;
+    deadline->tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+static int queue_init(_frame_queue_t *q, int capacity)
+{
+    size_t size = 1;
+    while (size < (size_t)capacity)
+        size <<= 1;
+
+    memset(q, 0, sizeof(_frame_queue_t));
+
+    q->cells = (_queue_cell_t *)malloc(size * sizeof(_queue_cell_t));
+    if (NULL == q->cells)
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    for (size_t i = 0; i < size; i++)
+        q->cells[i].sequence = i;
+
+    q->mask = size - 1;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+
+    return KP_SUCCESS;
+}
+
+static void queue_release(_frame_queue_t *q)
+{
+    if (NULL == q->cells)
+        return;
+
+    free(q->cells);
+    q->cells = NULL;
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->mutex);
+}
+
+static void queue_wake_waiters(_frame_queue_t *q)
+{
+    // pairs with the fence in queue_pop(), either the waiter sees the new item or we see the waiter
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->num_waiter, __ATOMIC_RELAXED) > 0)
+    {
+        pthread_mutex_lock(&q->mutex);
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->mutex);
+    }
+}
+
+static bool queue_try_push(_frame_queue_t *q, _pipeline_frame_t *frame)
+{
+    size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+
+    while (1)
+    {
+        _queue_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                cell->frame = frame;
+                __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false; // full
+        }
+        else
+        {
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static bool queue_try_pop(_frame_queue_t *q, _pipeline_frame_t **frame)
+{
+    size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+
+    while (1)
+    {
+        _queue_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                *frame = cell->frame;
+                __atomic_store_n(&cell->sequence, pos + q->mask + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false; // empty
+        }
+        else
+        {
+            pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void queue_push(_frame_queue_t *q, _pipeline_frame_t *frame)
+{
+    // every queue can hold all frames of the pipeline, so it is never full for long
+    while (!queue_try_push(q, frame))
+        sched_yield();
+
+    queue_wake_waiters(q);
+}
+
+// timeout in milliseconds, 0 means blocking wait, return KP_ERROR_PIPELINE_STOPPED_49 if the queue is closed and empty
+static int queue_pop(_frame_queue_t *q, _pipeline_frame_t **frame, int timeout)
+{
+    if (queue_try_pop(q, frame))
+        return KP_SUCCESS;
+
+    struct timespec deadline;
+    if (timeout > 0)
+        get_deadline(&deadline, timeout);
+
+    int ret = KP_SUCCESS;
+
+    pthread_mutex_lock(&q->mutex);
+    __atomic_add_fetch(&q->num_waiter, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    while (!queue_try_pop(q, frame))
+    {
+        if (q->closed)
+        {
+            ret = KP_ERROR_PIPELINE_STOPPED_49;
+            break;
+        }
+
+        if (timeout > 0)
+        {
+            if (ETIMEDOUT == pthread_cond_timedwait(&q->cond, &q->mutex, &deadline))
+            {
+                if (!queue_try_pop(q, frame))
+                    ret = KP_ERROR_PIPELINE_TIMEOUT_50;
+                break;
+            }
+        }
+        else
+        {
+            pthread_cond_wait(&q->cond, &q->mutex);
+        }
+    }
+
+    __atomic_sub_fetch(&q->num_waiter, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->mutex);
+
+    return ret;
+}
+
+static void queue_close(_frame_queue_t *q)
+{
+    pthread_mutex_lock(&q->mutex);
+    q->closed = true;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static void complete_frame(kp_pipeline_t pipeline, _pipeline_frame_t *pframe)
+{
+    if (NULL != pipeline->config.complete)
+    {
+        pipeline->config.complete(&pframe->frame, pipeline->config.user_arg);
+        queue_push(&pipeline->free_queue, pframe);
+    }
+    else
+    {
+        queue_push(&pipeline->done_queue, pframe);
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->num_pending--;
+    pthread_cond_broadcast(&pipeline->cond);
+    pthread_mutex_unlock(&pipeline->mutex);
+}
+
+static int convert_float_nodes(kp_pipeline_t pipeline, _pipeline_frame_t *pframe)
+{
+    kp_pipeline_frame_t *frame = &pframe->frame;
+    uint32_t num_node = frame->result_header.num_output_node;
+
+    if (num_node > pipeline->num_output_node)
+        return KP_ERROR_INVALID_MODEL_21;
+
+    for (uint32_t i = 0; i < num_node; i++)
+    {
+        uint32_t size = 0;
+        int ret = kp_generic_inference_get_float_node_size(i, frame->raw_out_buffer, &size);
+        if (ret != KP_SUCCESS)
+            return ret;
+
+        if (size > pframe->float_node_size[i])
+        {
+            void *buf = realloc(frame->float_node_list[i], size);
+            if (NULL == buf)
+                return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+            frame->float_node_list[i] = (kp_inf_float_node_output_t *)buf;
+            pframe->float_node_size[i] = size;
+        }
+
+        ret = kp_generic_inference_retrieve_float_node_to_buffer(i, frame->raw_out_buffer, pipeline->config.channel_ordering,
+                                                                  frame->float_node_list[i], pframe->float_node_size[i]);
+        if (ret != KP_SUCCESS)
+            return ret;
+
+        frame->num_float_node = i + 1;
+    }
+
+    return KP_SUCCESS;
+}
+
+static void *worker_thread(void *arg)
+{
+    kp_pipeline_t pipeline = (kp_pipeline_t)arg;
+    _pipeline_frame_t *pframe;
+
+    while (KP_SUCCESS == queue_pop(&pipeline->work_queue, &pframe, 0))
+    {
+        kp_pipeline_frame_t *frame = &pframe->frame;
+
+        if (pframe->stage == PIPELINE_STAGE_PRE_PROCESS)
+        {
+            frame->status = pipeline->config.pre_process(frame, pipeline->config.user_arg);
+
+            if (frame->status == KP_SUCCESS)
+                queue_push(&pipeline->send_queue, pframe);
+            else
+                complete_frame(pipeline, pframe);
+
+            continue;
+        }
+
+        if (pipeline->config.convert_to_float)
+            frame->status = convert_float_nodes(pipeline, pframe);
+
+        if (frame->status == KP_SUCCESS && NULL != pipeline->config.post_process)
+            frame->status = pipeline->config.post_process(frame, pipeline->config.user_arg);
+
+        complete_frame(pipeline, pframe);
+    }
+
+    return NULL;
+}
+
+static void *send_thread(void *arg)
+{
+    kp_pipeline_t pipeline = (kp_pipeline_t)arg;
+    _pipeline_frame_t *pframe;
+
+    while (KP_SUCCESS == queue_pop(&pipeline->send_queue, &pframe, 0))
+    {
+        kp_pipeline_frame_t *frame = &pframe->frame;
+
+        // backpressure, do not queue more frames than the device FIFO queues can hold
+        pthread_mutex_lock(&pipeline->mutex);
+        while (pipeline->num_in_device >= pipeline->max_frame_in_device)
+            pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+
+        // registered before sending as the result may come back before kp_generic_image_inference_send() returns
+        pframe->in_device = true;
+        pframe->send_seq = pipeline->send_seq++;
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        frame->inf_desc.model_id = pipeline->config.model_id;
+        frame->inf_desc.inference_number = pframe->index;
+
+        // once sent, the frame belongs to the receive thread
+        int status = kp_generic_image_inference_send((kp_device_group_t)pipeline->devices_grp, &frame->inf_desc);
+
+        pthread_mutex_lock(&pipeline->mutex);
+        if (status == KP_SUCCESS)
+        {
+            pipeline->num_in_device++;
+            pthread_cond_broadcast(&pipeline->cond);
+        }
+        else
+        {
+            pframe->in_device = false;
+        }
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        if (status != KP_SUCCESS)
+        {
+            dbg_print("[%s] frame %d send failed, error %d\n", __func__, pframe->index, status);
+            frame->status = status;
+            complete_frame(pipeline, pframe);
+        }
+    }
+
+    return NULL;
+}
+
+// the frame a failed receive belongs to is unknown, blame the earliest sent one
+static _pipeline_frame_t *get_earliest_frame_in_device(kp_pipeline_t pipeline)
+{
+    _pipeline_frame_t *earliest = NULL;
+
+    for (int i = 0; i < pipeline->num_frame; i++)
+    {
+        _pipeline_frame_t *pframe = &pipeline->frames[i];
+
+        if (pframe->in_device && (NULL == earliest || pframe->send_seq < earliest->send_seq))
+            earliest = pframe;
+    }
+
+    return earliest;
+}
+
+static void *recv_thread(void *arg)
+{
+    kp_pipeline_t pipeline = (kp_pipeline_t)arg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&pipeline->mutex);
+        while (pipeline->num_in_device == 0 && !pipeline->stop)
+            pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+        bool stop = (pipeline->num_in_device == 0);
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        if (stop)
+            break;
+
+        kp_generic_image_inference_result_header_t result_header;
+        int status = kp_generic_image_inference_receive((kp_device_group_t)pipeline->devices_grp, &result_header, pipeline->recv_buf, pipeline->raw_out_size);
+
+        _pipeline_frame_t *pframe = NULL;
+
+        pthread_mutex_lock(&pipeline->mutex);
+
+        if (status == KP_SUCCESS)
+        {
+            uint32_t index = result_header.inference_number;
+
+            if (index < (uint32_t)pipeline->num_frame && pipeline->frames[index].in_device)
+                pframe = &pipeline->frames[index];
+            else
+                dbg_print("[%s] drop result of unknown inference number %u\n", __func__, index);
+        }
+        else
+        {
+            pframe = get_earliest_frame_in_device(pipeline);
+        }
+
+        if (NULL != pframe)
+        {
+            pframe->in_device = false;
+            pipeline->num_in_device--;
+            pthread_cond_broadcast(&pipeline->cond);
+        }
+
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        if (NULL == pframe)
+            continue;
+
+        kp_pipeline_frame_t *frame = &pframe->frame;
+
+        frame->status = status;
+
+        if (status != KP_SUCCESS)
+        {
+            dbg_print("[%s] frame %d receive failed, error %d\n", __func__, pframe->index, status);
+            complete_frame(pipeline, pframe);
+            continue;
+        }
+
+        // hand the received buffer over to the frame, and keep its old one for the next receive
+        uint8_t *buf = frame->raw_out_buffer;
+        frame->raw_out_buffer = pipeline->recv_buf;
+        pipeline->recv_buf = buf;
+
+        memcpy(&frame->result_header, &result_header, sizeof(result_header));
+
+        pframe->stage = PIPELINE_STAGE_POST_PROCESS;
+        queue_push(&pipeline->work_queue, pframe);
+    }
+
+    return NULL;
+}
+
+static void free_pipeline(kp_pipeline_t pipeline)
+{
+    if (NULL != pipeline->frames)
+    {
+        for (int i = 0; i < pipeline->num_frame; i++)
+        {
+            kp_pipeline_frame_t *frame = &pipeline->frames[i].frame;
+
+            free(frame->raw_out_buffer);
+
+            if (NULL != frame->float_node_list)
+            {
+                for (uint32_t n = 0; n < pipeline->num_output_node; n++)
+                    free(frame->float_node_list[n]);
+            }
+
+            free(frame->float_node_list);
+            free(pipeline->frames[i].float_node_size);
+        }
+
+        free(pipeline->frames);
+    }
+
+    free(pipeline->recv_buf);
+
+    queue_release(&pipeline->free_queue);
+    queue_release(&pipeline->work_queue);
+    queue_release(&pipeline->send_queue);
+    queue_release(&pipeline->done_queue);
+
+    pthread_cond_destroy(&pipeline->cond);
+    pthread_mutex_destroy(&pipeline->mutex);
+
+    free(pipeline);
+}
+
+static void stop_threads(kp_pipeline_t pipeline)
+{
+    queue_close(&pipeline->work_queue);
+    queue_close(&pipeline->send_queue);
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->stop = true;
+    pthread_cond_broadcast(&pipeline->cond);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    // threads are started in the order of send, receive and workers
+    for (int i = 0; i < pipeline->num_thread_started; i++)
+    {
+        if (i == 0)
+            pthread_join(pipeline->send_thread, NULL);
+        else if (i == 1)
+            pthread_join(pipeline->recv_thread, NULL);
+        else
+            pthread_join(pipeline->worker_thread[i - 2], NULL);
+    }
+
+    pipeline->num_thread_started = 0;
+}
+
+static int alloc_frames(kp_pipeline_t pipeline)
+{
+    pipeline->frames = (_pipeline_frame_t *)calloc(pipeline->num_frame, sizeof(_pipeline_frame_t));
+    pipeline->recv_buf = (uint8_t *)malloc(pipeline->raw_out_size);
+
+    if (NULL == pipeline->frames || NULL == pipeline->recv_buf)
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    for (int i = 0; i < pipeline->num_frame; i++)
+    {
+        _pipeline_frame_t *pframe = &pipeline->frames[i];
+
+        pframe->index = i;
+        pframe->frame.raw_out_buffer = (uint8_t *)malloc(pipeline->raw_out_size);
+        pframe->frame.float_node_list = (kp_inf_float_node_output_t **)calloc(pipeline->num_output_node, sizeof(kp_inf_float_node_output_t *));
+        pframe->float_node_size = (uint32_t *)calloc(pipeline->num_output_node, sizeof(uint32_t));
+
+        if (NULL == pframe->frame.raw_out_buffer || NULL == pframe->frame.float_node_list || NULL == pframe->float_node_size)
+            return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+        queue_push(&pipeline->free_queue, pframe);
+    }
+
+    return KP_SUCCESS;
+}
+
+kp_pipeline_t kp_pipeline_create(kp_device_group_t devices, kp_pipeline_config_t *config, int *error_code)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+    kp_single_model_descriptor_t *model = NULL;
+    int ret = KP_SUCCESS;
+
+    if (NULL == _devices_grp || NULL == config || config->num_frame < 0 || config->num_worker < 0 || config->max_frame_in_device < 0)
+        ret = KP_ERROR_INVALID_PARAM_12;
+
+    for (uint32_t m = 0; ret == KP_SUCCESS && m < _devices_grp->loaded_model_desc.num_models; m++)
+    {
+        if (_devices_grp->loaded_model_desc.models[m].id == config->model_id)
+        {
+            model = &_devices_grp->loaded_model_desc.models[m];
+            break;
+        }
+    }
+
+    if (ret == KP_SUCCESS && NULL == model)
+        ret = KP_ERROR_MODEL_NOT_LOADED_35;
+
+    kp_pipeline_t pipeline = NULL;
+
+    if (ret == KP_SUCCESS)
+    {
+        pipeline = (kp_pipeline_t)calloc(1, sizeof(struct kp_pipeline_s));
+        if (NULL == pipeline)
+            ret = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+    }
+
+    if (ret != KP_SUCCESS)
+    {
+        if (error_code)
+            *error_code = ret;
+        return NULL;
+    }
+
+    pipeline->devices_grp = _devices_grp;
+    pipeline->config = *config;
+    pipeline->num_frame = (config->num_frame > 0) ? config->num_frame : PIPELINE_DEFAULT_NUM_FRAME;
+    pipeline->num_worker = (config->num_worker > 0) ? config->num_worker : PIPELINE_DEFAULT_NUM_WORKER;
+    if (pipeline->num_worker > PIPELINE_MAX_NUM_WORKER)
+        pipeline->num_worker = PIPELINE_MAX_NUM_WORKER;
+    pipeline->num_output_node = model->output_nodes_num;
+    pipeline->raw_out_size = model->max_raw_out_size;
+
+    if (config->max_frame_in_device > 0)
+    {
+        pipeline->max_frame_in_device = config->max_frame_in_device;
+    }
+    else
+    {
+        // every input node of a frame takes one FIFO queue input buffer of a device
+        uint32_t num_input_node = (model->input_nodes_num > 0) ? model->input_nodes_num : 1;
+        uint32_t per_device = _devices_grp->ddr_attr.input_buffer_count / num_input_node;
+
+        pipeline->max_frame_in_device = _devices_grp->num_device * ((per_device > 0) ? per_device : 1);
+    }
+
+    pthread_mutex_init(&pipeline->mutex, NULL);
+    pthread_cond_init(&pipeline->cond, NULL);
+
+    ret = queue_init(&pipeline->free_queue, pipeline->num_frame);
+    if (ret == KP_SUCCESS)
+        ret = queue_init(&pipeline->work_queue, pipeline->num_frame);
+    if (ret == KP_SUCCESS)
+        ret = queue_init(&pipeline->send_queue, pipeline->num_frame);
+    if (ret == KP_SUCCESS)
+        ret = queue_init(&pipeline->done_queue, pipeline->num_frame);
+    if (ret == KP_SUCCESS)
+        ret = alloc_frames(pipeline);
+
+    if (ret == KP_SUCCESS && 0 == pthread_create(&pipeline->send_thread, NULL, send_thread, pipeline))
+        pipeline->num_thread_started++;
+    if (ret == KP_SUCCESS && 1 == pipeline->num_thread_started && 0 == pthread_create(&pipeline->recv_thread, NULL, recv_thread, pipeline))
+        pipeline->num_thread_started++;
+    for (int i = 0; ret == KP_SUCCESS && i < pipeline->num_worker && (i + 2) == pipeline->num_thread_started; i++)
+    {
+        if (0 == pthread_create(&pipeline->worker_thread[i], NULL, worker_thread, pipeline))
+            pipeline->num_thread_started++;
+    }
+
+    if (ret == KP_SUCCESS && pipeline->num_thread_started != pipeline->num_worker + 2)
+        ret = KP_ERROR_OTHER_99;
+
+    if (ret != KP_SUCCESS)
+    {
+        stop_threads(pipeline);
+        free_pipeline(pipeline);
+        pipeline = NULL;
+    }
+
+    dbg_print("[%s] %d frames, %d workers, %d frames in device at most, ret %d\n", __func__,
+              (pipeline) ? pipeline->num_frame : 0, (pipeline) ? pipeline->num_worker : 0, (pipeline) ? pipeline->max_frame_in_device : 0, ret);
+
+    if (error_code)
+        *error_code = ret;
+
+    return pipeline;
+}
+
+int kp_pipeline_submit(kp_pipeline_t pipeline, kp_generic_image_inference_desc_t *inf_desc, void *user_data, int timeout)
+{
+    if (NULL == pipeline || (NULL == inf_desc && NULL == pipeline->config.pre_process))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    bool stopping = pipeline->stopping;
+    if (!stopping)
+        pipeline->num_pending++;
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    if (stopping)
+        return KP_ERROR_PIPELINE_STOPPED_49;
+
+    _pipeline_frame_t *pframe = NULL;
+    int ret = queue_pop(&pipeline->free_queue, &pframe, timeout);
+
+    if (ret != KP_SUCCESS)
+    {
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->num_pending--;
+        pthread_cond_broadcast(&pipeline->cond);
+        pthread_mutex_unlock(&pipeline->mutex);
+        return ret;
+    }
+
+    kp_pipeline_frame_t *frame = &pframe->frame;
+
+    frame->user_data = user_data;
+    frame->status = KP_SUCCESS;
+    frame->num_float_node = 0;
+    frame->post_proc_result = NULL;
+
+    if (NULL != inf_desc)
+        memcpy(&frame->inf_desc, inf_desc, sizeof(kp_generic_image_inference_desc_t));
+
+    if (NULL != pipeline->config.pre_process)
+    {
+        pframe->stage = PIPELINE_STAGE_PRE_PROCESS;
+        queue_push(&pipeline->work_queue, pframe);
+    }
+    else
+    {
+        queue_push(&pipeline->send_queue, pframe);
+    }
+
+    return KP_SUCCESS;
+}
+
+int kp_pipeline_get_frame(kp_pipeline_t pipeline, kp_pipeline_frame_t **frame, int timeout)
+{
+    if (NULL == pipeline || NULL == frame || NULL != pipeline->config.complete)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    _pipeline_frame_t *pframe = NULL;
+    int ret = queue_pop(&pipeline->done_queue, &pframe, timeout);
+
+    *frame = (ret == KP_SUCCESS) ? &pframe->frame : NULL;
+
+    return ret;
+}
+
+void kp_pipeline_release_frame(kp_pipeline_t pipeline, kp_pipeline_frame_t *frame)
+{
+    if (NULL == pipeline || NULL == frame)
+        return;
+
+    queue_push(&pipeline->free_queue, (_pipeline_frame_t *)frame);
+}
+
+int kp_pipeline_destroy(kp_pipeline_t pipeline)
+{
+    if (NULL == pipeline)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->stopping = true;
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    // wake up kp_pipeline_submit() waiting for a free frame
+    queue_close(&pipeline->free_queue);
+
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->num_pending > 0)
+        pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    queue_close(&pipeline->done_queue);
+
+    stop_threads(pipeline);
+    free_pipeline(pipeline);
+
+    return KP_SUCCESS;
+}
@@ -0,0 +1,645 @@
+/**
+ * @file        kp_preproc.c
+ * @brief       host pre-processing for bypass pre-process data inference
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+// #define DEBUG_PRINT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "kp_preproc.h"
+#include "preproc_convert.h"
+
+#ifdef DEBUG_PRINT
+#define dbg_print(format, ...) { printf(format, ##__VA_ARGS__); fflush(stdout); }
+#else
+#define dbg_print(format, ...)
+#endif
+
+#define PREPROC_DEFAULT_NUM_THREAD 1
+#define PREPROC_MAX_NUM_THREAD 16
+
+typedef struct
+{
+    struct kp_preproc_s *preproc;
+    pthread_t thread;
+    uint32_t row_begin;                     // rows of the model input done by this worker
+    uint32_t row_end;
+    float *row_buf;                         // 2 resampled source rows of 'num_channel' planes
+    float *plane[2][PREPROC_MAX_CHANNEL];
+    int32_t cached_y[2];                    // source row in plane[i], -1 if none
+} _preproc_worker_t;
+
+struct kp_preproc_s
+{
+    // model input node
+    uint32_t model_width;
+    uint32_t model_height;
+    uint32_t num_channel;
+    uint32_t block_size;                    // channels per column of the data layout
+    uint32_t block_num;
+    uint32_t width_align;
+    uint32_t block_stride;                  // bytes between channel blocks of a row
+    uint32_t row_stride;                    // bytes between rows of a channel block
+    uint32_t data_size;
+    float mul[PREPROC_MAX_CHANNEL];         // normalization and quantization: q = round(pixel * mul + add)
+    float add[PREPROC_MAX_CHANNEL];
+    kp_preproc_config_t config;
+
+    // resize tables of the last image geometry
+    uint32_t img_width;
+    uint32_t img_height;
+    kp_image_format_t img_format;
+    uint32_t img_stride;
+    kp_hw_pre_proc_info_t info;
+    int32_t *xofs0;
+    int32_t *xofs1;
+    float *fx;
+    int32_t *yofs0;
+    int32_t *yofs1;
+    float *fy;
+
+    // image being processed
+    const uint8_t *image;
+    int8_t *data_buf;
+
+    // the caller thread is worker 0
+    int num_thread;
+    int num_thread_started;
+    _preproc_worker_t worker[PREPROC_MAX_NUM_THREAD];
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    uint32_t run_seq;
+    int num_done;
+    bool stopping;
+};
+
+static int normalize_coefficient(kp_normalize_mode_t mode, float *a, float *b)
+{
+    // normalized = pixel * a + b
+    switch (mode)
+    {
+    case KP_NORMALIZE_DISABLE:
+    case KP_NORMALIZE_CUSTOMIZED_DEFAULT:
+        *a = 1.0f;
+        *b = 0.0f;
+        break;
+    case KP_NORMALIZE_KNERON:
+        *a = 1.0f / 256.0f;
+        *b = -0.5f;
+        break;
+    case KP_NORMALIZE_TENSOR_FLOW:
+        *a = 1.0f / 127.5f;
+        *b = -1.0f;
+        break;
+    case KP_NORMALIZE_YOLO:
+        *a = 1.0f / 255.0f;
+        *b = 0.0f;
+        break;
+    case KP_NORMALIZE_CUSTOMIZED_SUB128:
+        *a = 1.0f;
+        *b = -128.0f;
+        break;
+    case KP_NORMALIZE_CUSTOMIZED_DIV2:
+        *a = 0.5f;
+        *b = 0.0f;
+        break;
+    case KP_NORMALIZE_CUSTOMIZED_SUB128_DIV2:
+        *a = 0.5f;
+        *b = -64.0f;
+        break;
+    default:
+        return KP_ERROR_INVALID_PARAM_12;
+    }
+
+    return KP_SUCCESS;
+}
+
+static int setup_input_node(kp_preproc_t preproc, kp_single_model_descriptor_t *model, kp_tensor_descriptor_t *node)
+{
+    kp_quantization_parameters_t *quant = &node->quantization_parameters;
+
+    // shape order: BxCxHxW
+    if (4 > node->shape_npu_len || NULL == node->shape_npu || 0 == quant->quantized_fixed_point_descriptor_num)
+        return KP_ERROR_INVALID_MODEL_21;
+
+    preproc->num_channel = node->shape_npu[1];
+    preproc->model_height = node->shape_npu[2];
+    preproc->model_width = node->shape_npu[3];
+
+    if (0 == preproc->num_channel || PREPROC_MAX_CHANNEL < preproc->num_channel || 0 == preproc->model_height || 0 == preproc->model_width)
+        return KP_ERROR_INVALID_MODEL_21;
+
+    uint32_t width_align_base;
+    bool height_major = false;
+
+    // refer to the re-layout of the generic data inference examples
+    switch (node->data_layout)
+    {
+    case KP_MODEL_TENSOR_DATA_LAYOUT_4W4C8B:
+        preproc->block_size = 4;
+        if (KP_MODEL_TARGET_CHIP_KL520 == model->target)
+        {
+            // KL520 NPU dimension order is HxCxW, and width must be aligned to 16
+            width_align_base = 16;
+            height_major = true;
+        }
+        else
+        {
+            width_align_base = 4;
+        }
+        break;
+    case KP_MODEL_TENSOR_DATA_LAYOUT_1W16C8B:
+        preproc->block_size = 16;
+        width_align_base = 1;
+        break;
+    case KP_MODEL_TENSOR_DATA_LAYOUT_16W1C8B:
+        preproc->block_size = 1;
+        width_align_base = 16;
+        break;
+    default:
+        return KP_ERROR_INVALID_MODEL_21;
+    }
+
+    if (KP_MODEL_TARGET_CHIP_KL520 == model->target && !height_major)
+        return KP_ERROR_INVALID_MODEL_21;
+
+    preproc->width_align = (preproc->model_width + width_align_base - 1) / width_align_base * width_align_base;
+    preproc->block_num = (preproc->num_channel + preproc->block_size - 1) / preproc->block_size;
+
+    uint32_t block_row_size = preproc->width_align * preproc->block_size;
+
+    if (height_major)
+    {
+        preproc->block_stride = block_row_size;
+        preproc->row_stride = preproc->block_num * block_row_size;
+    }
+    else
+    {
+        preproc->block_stride = preproc->model_height * block_row_size;
+        preproc->row_stride = block_row_size;
+    }
+
+    preproc->data_size = preproc->block_num * preproc->model_height * block_row_size;
+
+    float a, b;
+    int ret = normalize_coefficient(preproc->config.normalize_mode, &a, &b);
+    if (ret != KP_SUCCESS)
+        return ret;
+
+    for (uint32_t c = 0; c < preproc->num_channel; c++)
+    {
+        // per-channel quantization if the node has it
+        uint32_t q = (c < quant->quantized_fixed_point_descriptor_num) ? c : 0;
+
+        // NPU divides input data by "2^radix", so the normalized data is multiplied here
+        float factor = powf(2.0f, (float)quant->quantized_fixed_point_descriptor[q].radix) * quant->quantized_fixed_point_descriptor[q].scale;
+
+        preproc->mul[c] = a * factor;
+        preproc->add[c] = b * factor;
+    }
+
+    return KP_SUCCESS;
+}
+
+static void free_tables(kp_preproc_t preproc)
+{
+    free(preproc->xofs0);
+    free(preproc->xofs1);
+    free(preproc->fx);
+    free(preproc->yofs0);
+    free(preproc->yofs1);
+    free(preproc->fy);
+
+    preproc->xofs0 = NULL;
+    preproc->xofs1 = NULL;
+    preproc->fx = NULL;
+    preproc->yofs0 = NULL;
+    preproc->yofs1 = NULL;
+    preproc->fy = NULL;
+    preproc->img_width = 0;
+}
+
+// bilinear with half-pixel centers, 'ofs' are source indexes multiplied by 'step'
+static void build_table(int32_t *ofs0, int32_t *ofs1, float *f, uint32_t dst_len, uint32_t src_len, int32_t step)
+{
+    double ratio = (double)src_len / dst_len;
+
+    for (uint32_t i = 0; i < dst_len; i++)
+    {
+        double s = (i + 0.5) * ratio - 0.5;
+        if (s < 0)
+            s = 0;
+
+        uint32_t i0 = (uint32_t)s;
+
+        if (i0 >= src_len - 1)
+        {
+            ofs0[i] = ofs1[i] = (int32_t)(src_len - 1) * step;
+            f[i] = 0.0f;
+        }
+        else
+        {
+            ofs0[i] = (int32_t)i0 * step;
+            ofs1[i] = (int32_t)(i0 + 1) * step;
+            f[i] = (float)(s - i0);
+        }
+    }
+}
+
+static int setup_geometry(kp_preproc_t preproc, uint32_t width, uint32_t height, kp_image_format_t format)
+{
+    if (width == preproc->img_width && height == preproc->img_height && format == preproc->img_format)
+        return KP_SUCCESS;
+
+    uint32_t bpp;
+
+    switch (format)
+    {
+    case KP_IMAGE_FORMAT_RGBA8888:
+        bpp = 4;
+        break;
+    case KP_IMAGE_FORMAT_RGB565:
+        bpp = 2;
+        break;
+    case KP_IMAGE_FORMAT_RAW8:
+        bpp = 1;
+        break;
+    default:
+        return KP_ERROR_INVALID_PARAM_12;
+    }
+
+    uint32_t mw = preproc->model_width;
+    uint32_t mh = preproc->model_height;
+    uint32_t rw, rh;
+
+    if (KP_RESIZE_ENABLE == preproc->config.resize_mode)
+    {
+        if (KP_PADDING_DISABLE == preproc->config.padding_mode)
+        {
+            rw = mw;
+            rh = mh;
+        }
+        else if ((uint64_t)width * mh >= (uint64_t)height * mw)
+        {
+            // keep the aspect ratio, the wider side fills the model input
+            rw = mw;
+            rh = (uint32_t)(((uint64_t)height * mw + width / 2) / width);
+        }
+        else
+        {
+            rh = mh;
+            rw = (uint32_t)(((uint64_t)width * mh + height / 2) / height);
+        }
+
+        rw = (0 < rw) ? ((rw < mw) ? rw : mw) : 1;
+        rh = (0 < rh) ? ((rh < mh) ? rh : mh) : 1;
+    }
+    else
+    {
+        if (width > mw || height > mh || (KP_PADDING_DISABLE == preproc->config.padding_mode && (width != mw || height != mh)))
+            return KP_ERROR_INVALID_PARAM_12;
+
+        rw = width;
+        rh = height;
+    }
+
+    free_tables(preproc);
+
+    preproc->xofs0 = (int32_t *)malloc(rw * sizeof(int32_t));
+    preproc->xofs1 = (int32_t *)malloc(rw * sizeof(int32_t));
+    preproc->fx = (float *)malloc(rw * sizeof(float));
+    preproc->yofs0 = (int32_t *)malloc(rh * sizeof(int32_t));
+    preproc->yofs1 = (int32_t *)malloc(rh * sizeof(int32_t));
+    preproc->fy = (float *)malloc(rh * sizeof(float));
+
+    if (NULL == preproc->xofs0 || NULL == preproc->xofs1 || NULL == preproc->fx ||
+        NULL == preproc->yofs0 || NULL == preproc->yofs1 || NULL == preproc->fy)
+    {
+        free_tables(preproc);
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+    }
+
+    build_table(preproc->xofs0, preproc->xofs1, preproc->fx, rw, width, (int32_t)bpp);
+    build_table(preproc->yofs0, preproc->yofs1, preproc->fy, rh, height, 1);
+
+    kp_hw_pre_proc_info_t *info = &preproc->info;
+
+    memset(info, 0, sizeof(kp_hw_pre_proc_info_t));
+    info->img_width = width;
+    info->img_height = height;
+    info->resized_img_width = rw;
+    info->resized_img_height = rh;
+    info->model_input_width = mw;
+    info->model_input_height = mh;
+    info->crop_area.width = width;
+    info->crop_area.height = height;
+
+    if (KP_PADDING_SYMMETRIC == preproc->config.padding_mode)
+    {
+        info->pad_left = (mw - rw) / 2;
+        info->pad_top = (mh - rh) / 2;
+    }
+
+    info->pad_right = mw - rw - info->pad_left;
+    info->pad_bottom = mh - rh - info->pad_top;
+
+    preproc->img_width = width;
+    preproc->img_height = height;
+    preproc->img_format = format;
+    preproc->img_stride = width * bpp;
+
+    dbg_print("[%s] %ux%u -> %ux%u, pad l %u t %u r %u b %u\n", __func__, width, height, rw, rh,
+              info->pad_left, info->pad_top, info->pad_right, info->pad_bottom);
+
+    return KP_SUCCESS;
+}
+
+// get the slot of resampled source row 'sy', without evicting source row 'keep_y'
+static int load_source_row(_preproc_worker_t *worker, int32_t sy, int32_t keep_y)
+{
+    kp_preproc_t preproc = worker->preproc;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (sy == worker->cached_y[i])
+            return i;
+    }
+
+    int slot = (keep_y == worker->cached_y[0]) ? 1 : 0;
+    const uint8_t *src = preproc->image + (size_t)sy * preproc->img_stride;
+    int width = (int)preproc->info.resized_img_width;
+    int num_channel = (int)preproc->num_channel;
+
+    if (KP_IMAGE_FORMAT_RGBA8888 == preproc->img_format)
+        preproc_resample_row_rgba8888(worker->plane[slot], num_channel, src, preproc->xofs0, preproc->xofs1, preproc->fx, width);
+    else if (KP_IMAGE_FORMAT_RGB565 == preproc->img_format)
+        preproc_resample_row_rgb565(worker->plane[slot], num_channel, src, preproc->xofs0, preproc->xofs1, preproc->fx, width);
+    else
+        preproc_resample_row_raw8(worker->plane[slot], num_channel, src, preproc->xofs0, preproc->xofs1, preproc->fx, width);
+
+    worker->cached_y[slot] = sy;
+
+    return slot;
+}
+
+static void process_rows(_preproc_worker_t *worker)
+{
+    kp_preproc_t preproc = worker->preproc;
+    kp_hw_pre_proc_info_t *info = &preproc->info;
+    uint32_t block_row_size = preproc->width_align * preproc->block_size;
+
+    for (uint32_t y = worker->row_begin; y < worker->row_end; y++)
+    {
+        int8_t *row = preproc->data_buf + (size_t)y * preproc->row_stride;
+
+        if (y < info->pad_top || y >= info->pad_top + info->resized_img_height)
+        {
+            for (uint32_t b = 0; b < preproc->block_num; b++)
+                memset(row + (size_t)b * preproc->block_stride, 0, block_row_size);
+            continue;
+        }
+
+        uint32_t ry = y - info->pad_top;
+        float fy = preproc->fy[ry];
+        int32_t sy0 = preproc->yofs0[ry];
+        int32_t sy1 = (0.0f == fy) ? sy0 : preproc->yofs1[ry];
+        int s0 = load_source_row(worker, sy0, sy1);
+        int s1 = load_source_row(worker, sy1, sy0);
+
+        for (uint32_t b = 0; b < preproc->block_num; b++)
+        {
+            uint32_t c = b * preproc->block_size;
+            uint32_t num_channel = preproc->num_channel - c;
+            if (num_channel > preproc->block_size)
+                num_channel = preproc->block_size;
+
+            preproc_quantize_row(row + (size_t)b * preproc->block_stride, (int)preproc->block_size,
+                                 (const float *const *)&worker->plane[s0][c], (const float *const *)&worker->plane[s1][c], fy,
+                                 &preproc->mul[c], &preproc->add[c], (int)num_channel,
+                                 (int)info->pad_left, (int)info->resized_img_width, (int)preproc->width_align);
+        }
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    _preproc_worker_t *worker = (_preproc_worker_t *)arg;
+    kp_preproc_t preproc = worker->preproc;
+    uint32_t seq = 0;
+
+    while (1)
+    {
+        pthread_mutex_lock(&preproc->mutex);
+        while (!preproc->stopping && seq == preproc->run_seq)
+            pthread_cond_wait(&preproc->start_cond, &preproc->mutex);
+
+        if (preproc->stopping)
+        {
+            pthread_mutex_unlock(&preproc->mutex);
+            break;
+        }
+
+        seq = preproc->run_seq;
+        pthread_mutex_unlock(&preproc->mutex);
+
+        process_rows(worker);
+
+        pthread_mutex_lock(&preproc->mutex);
+        if (++preproc->num_done == preproc->num_thread - 1)
+            pthread_cond_signal(&preproc->done_cond);
+        pthread_mutex_unlock(&preproc->mutex);
+    }
+
+    return NULL;
+}
+
+static void stop_threads(kp_preproc_t preproc)
+{
+    pthread_mutex_lock(&preproc->mutex);
+    preproc->stopping = true;
+    pthread_cond_broadcast(&preproc->start_cond);
+    pthread_mutex_unlock(&preproc->mutex);
+
+    // worker 0 is the caller thread
+    for (int i = 1; i < preproc->num_thread_started; i++)
+        pthread_join(preproc->worker[i].thread, NULL);
+
+    preproc->num_thread_started = 0;
+}
+
+static void free_preproc(kp_preproc_t preproc)
+{
+    for (int i = 0; i < preproc->num_thread; i++)
+        free(preproc->worker[i].row_buf);
+
+    free_tables(preproc);
+
+    pthread_mutex_destroy(&preproc->mutex);
+    pthread_cond_destroy(&preproc->start_cond);
+    pthread_cond_destroy(&preproc->done_cond);
+
+    free(preproc);
+}
+
+kp_preproc_t kp_preproc_create(kp_single_model_descriptor_t *model, uint32_t input_node_idx, kp_preproc_config_t *config, int *error_code)
+{
+    int ret = KP_SUCCESS;
+
+    if (NULL == model || NULL == config || input_node_idx >= model->input_nodes_num || config->num_thread < 0 ||
+        (KP_RESIZE_ENABLE != config->resize_mode && KP_RESIZE_DISABLE != config->resize_mode) ||
+        (KP_PADDING_DISABLE != config->padding_mode && KP_PADDING_CORNER != config->padding_mode && KP_PADDING_SYMMETRIC != config->padding_mode))
+        ret = KP_ERROR_INVALID_PARAM_12;
+
+    kp_preproc_t preproc = NULL;
+
+    if (ret == KP_SUCCESS)
+    {
+        preproc = (kp_preproc_t)calloc(1, sizeof(struct kp_preproc_s));
+        if (NULL == preproc)
+            ret = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+    }
+
+    if (ret != KP_SUCCESS)
+    {
+        if (error_code)
+            *error_code = ret;
+        return NULL;
+    }
+
+    preproc->config = *config;
+    preproc->num_thread = (config->num_thread > 0) ? config->num_thread : PREPROC_DEFAULT_NUM_THREAD;
+    if (preproc->num_thread > PREPROC_MAX_NUM_THREAD)
+        preproc->num_thread = PREPROC_MAX_NUM_THREAD;
+
+    pthread_mutex_init(&preproc->mutex, NULL);
+    pthread_cond_init(&preproc->start_cond, NULL);
+    pthread_cond_init(&preproc->done_cond, NULL);
+
+    ret = setup_input_node(preproc, model, &model->input_nodes[input_node_idx]);
+
+    // no more threads than rows
+    if (ret == KP_SUCCESS && (uint32_t)preproc->num_thread > preproc->model_height)
+        preproc->num_thread = (int)preproc->model_height;
+
+    for (int i = 0; ret == KP_SUCCESS && i < preproc->num_thread; i++)
+    {
+        _preproc_worker_t *worker = &preproc->worker[i];
+
+        worker->preproc = preproc;
+        worker->row_begin = (uint32_t)((uint64_t)preproc->model_height * i / preproc->num_thread);
+        worker->row_end = (uint32_t)((uint64_t)preproc->model_height * (i + 1) / preproc->num_thread);
+        worker->cached_y[0] = worker->cached_y[1] = -1;
+        worker->row_buf = (float *)malloc(2 * preproc->num_channel * preproc->model_width * sizeof(float));
+
+        if (NULL == worker->row_buf)
+        {
+            ret = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+            break;
+        }
+
+        for (int s = 0; s < 2; s++)
+        {
+            for (uint32_t c = 0; c < preproc->num_channel; c++)
+                worker->plane[s][c] = worker->row_buf + (s * preproc->num_channel + c) * preproc->model_width;
+        }
+    }
+
+    if (ret == KP_SUCCESS)
+        preproc->num_thread_started = 1;
+
+    for (int i = 1; ret == KP_SUCCESS && i < preproc->num_thread && i == preproc->num_thread_started; i++)
+    {
+        if (0 == pthread_create(&preproc->worker[i].thread, NULL, worker_thread, &preproc->worker[i]))
+            preproc->num_thread_started++;
+    }
+
+    if (ret == KP_SUCCESS && preproc->num_thread_started != preproc->num_thread)
+        ret = KP_ERROR_OTHER_99;
+
+    if (ret != KP_SUCCESS)
+    {
+        stop_threads(preproc);
+        free_preproc(preproc);
+        preproc = NULL;
+    }
+
+    dbg_print("[%s] input %ux%ux%u, block %u x %u, width align %u, %d threads, ret %d\n", __func__,
+              (preproc) ? preproc->num_channel : 0, (preproc) ? preproc->model_height : 0, (preproc) ? preproc->model_width : 0,
+              (preproc) ? preproc->block_num : 0, (preproc) ? preproc->block_size : 0, (preproc) ? preproc->width_align : 0,
+              (preproc) ? preproc->num_thread : 0, ret);
+
+    if (error_code)
+        *error_code = ret;
+
+    return preproc;
+}
+
+uint32_t kp_preproc_get_data_size(kp_preproc_t preproc)
+{
+    return (NULL != preproc) ? preproc->data_size : 0;
+}
+
+int kp_preproc_run(kp_preproc_t preproc, const uint8_t *image, uint32_t width, uint32_t height, kp_image_format_t format,
+                   uint8_t *data_buf, uint32_t buf_size, kp_hw_pre_proc_info_t *pre_proc_info)
+{
+    if (NULL == preproc || NULL == image || NULL == data_buf || 0 == width || 0 == height)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if (buf_size < preproc->data_size)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    int ret = setup_geometry(preproc, width, height, format);
+    if (ret != KP_SUCCESS)
+        return ret;
+
+    preproc->image = image;
+    preproc->data_buf = (int8_t *)data_buf;
+
+    if (1 < preproc->num_thread)
+    {
+        pthread_mutex_lock(&preproc->mutex);
+        preproc->num_done = 0;
+        preproc->run_seq++;
+        pthread_cond_broadcast(&preproc->start_cond);
+        pthread_mutex_unlock(&preproc->mutex);
+    }
+
+    process_rows(&preproc->worker[0]);
+
+    if (1 < preproc->num_thread)
+    {
+        pthread_mutex_lock(&preproc->mutex);
+        while (preproc->num_done < preproc->num_thread - 1)
+            pthread_cond_wait(&preproc->done_cond, &preproc->mutex);
+        pthread_mutex_unlock(&preproc->mutex);
+    }
+
+    // cached source rows belong to this image only
+    for (int i = 0; i < preproc->num_thread; i++)
+        preproc->worker[i].cached_y[0] = preproc->worker[i].cached_y[1] = -1;
+
+    if (pre_proc_info)
+        *pre_proc_info = preproc->info;
+
+    return KP_SUCCESS;
+}
+
+void kp_preproc_destroy(kp_preproc_t preproc)
+{
+    if (NULL == preproc)
+        return;
+
+    stop_threads(preproc);
+    free_preproc(preproc);
+}
@@ -0,0 +1,545 @@
+/**
+ * @file        kp_trace.c
+ * @brief       latency tracing of the host inference path
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+// #define DEBUG_PRINT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "kp_struct.h"
+#include "kp_trace_internal.h"
+
+#ifdef DEBUG_PRINT
+#define dbg_print(format, ...) printf(format, ##__VA_ARGS__)
+#else
+#define dbg_print(format, ...)
+#endif
+
+// log-linear histogram: values below 32 ns have their own bucket, above that every power of 2 is split into 16 buckets
+#define HIST_LINEAR_COUNT 32
+#define HIST_SUB_BUCKET_BITS 4
+#define HIST_SUB_BUCKET_COUNT (1 << HIST_SUB_BUCKET_BITS)
+#define HIST_MAX_MSB 43 // about 2.4 hours, larger values are counted in the last bucket
+#define HIST_NUM_BUCKET (HIST_LINEAR_COUNT + (HIST_MAX_MSB - HIST_SUB_BUCKET_BITS) * HIST_SUB_BUCKET_COUNT)
+
+typedef struct
+{
+    uint64_t begin_ns;
+    uint64_t end_ns;
+    uint32_t tid;
+    uint32_t stage;
+    uint32_t arg;
+} trace_event_t;
+
+typedef struct
+{
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t bucket[HIST_NUM_BUCKET];
+} trace_histogram_t;
+
+// written only by the owner thread, read by exporters without locking
+typedef struct trace_buffer
+{
+    struct trace_buffer *next;          // buffers are never freed, a buffer is reused after its thread exits
+    int in_use;
+    uint32_t generation;                // data of an older generation has been discarded by kp_trace_reset()
+    uint64_t head;                      // number of events written to 'ring'
+    trace_histogram_t hist[KP_TRACE_NUM_STAGE];
+    trace_event_t ring[KP_TRACE_RING_SIZE];
+} trace_buffer_t;
+
+int _kp_trace_enabled = 0;
+
+static trace_buffer_t *_trace_buffers = NULL;
+static uint32_t _trace_generation = 1;
+static uint32_t _trace_thread_count = 0;
+static uint64_t _trace_base_ns = 0;     // time zero of the Chrome trace
+
+static __thread trace_buffer_t *_tls_buffer = NULL;
+static __thread uint32_t _tls_tid = 0;
+
+static pthread_key_t _trace_key;
+static pthread_once_t _trace_key_once = PTHREAD_ONCE_INIT;
+
+static const char *_stage_names[KP_TRACE_NUM_STAGE] = {
+    "header write",
+    "payload write",
+    "ZLP",
+    "result read",
+    "header verify",
+    "node convert",
+    "inference send",
+    "inference receive",
+};
+
+static const char *_stage_arg_names[KP_TRACE_NUM_STAGE] = {
+    "bytes",
+    "bytes",
+    "bytes",
+    "bytes",
+    "inference_number",
+    "node_idx",
+    "inference_number",
+    "inference_number",
+};
+
+static int hist_bucket_index(uint64_t value)
+{
+    if (value < HIST_LINEAR_COUNT)
+        return (int)value;
+
+    int msb = 63 - __builtin_clzll(value);
+
+    if (msb >= HIST_MAX_MSB)
+        return HIST_NUM_BUCKET - 1;
+
+    int shift = msb - HIST_SUB_BUCKET_BITS;
+    int mantissa = (int)(value >> shift);
+
+    return HIST_LINEAR_COUNT + (shift - 1) * HIST_SUB_BUCKET_COUNT + (mantissa - HIST_SUB_BUCKET_COUNT);
+}
+
+// the largest value counted in the bucket
+static uint64_t hist_bucket_upper(int idx)
+{
+    if (idx < HIST_LINEAR_COUNT)
+        return (uint64_t)idx;
+
+    int shift = (idx - HIST_LINEAR_COUNT) / HIST_SUB_BUCKET_COUNT + 1;
+    uint64_t mantissa = (idx - HIST_LINEAR_COUNT) % HIST_SUB_BUCKET_COUNT + HIST_SUB_BUCKET_COUNT;
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+static uint64_t hist_bucket_middle(int idx)
+{
+    if (idx < HIST_LINEAR_COUNT)
+        return (uint64_t)idx;
+
+    int shift = (idx - HIST_LINEAR_COUNT) / HIST_SUB_BUCKET_COUNT + 1;
+    uint64_t mantissa = (idx - HIST_LINEAR_COUNT) % HIST_SUB_BUCKET_COUNT + HIST_SUB_BUCKET_COUNT;
+
+    return (mantissa << shift) + ((1ULL << shift) >> 1);
+}
+
+static void trace_thread_exit(void *arg)
+{
+    trace_buffer_t *buf = (trace_buffer_t *)arg;
+
+    __atomic_store_n(&buf->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void trace_create_key(void)
+{
+    pthread_key_create(&_trace_key, trace_thread_exit);
+}
+
+static trace_buffer_t *trace_claim_buffer(void)
+{
+    trace_buffer_t *buf = NULL;
+
+    pthread_once(&_trace_key_once, trace_create_key);
+
+    // reuse a buffer left by an exited thread
+    for (trace_buffer_t *b = __atomic_load_n(&_trace_buffers, __ATOMIC_ACQUIRE); b != NULL; b = b->next)
+    {
+        int expected = 0;
+
+        if (__atomic_compare_exchange_n(&b->in_use, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            buf = b;
+            break;
+        }
+    }
+
+    if (NULL == buf)
+    {
+        buf = (trace_buffer_t *)calloc(1, sizeof(trace_buffer_t));
+        if (NULL == buf)
+            return NULL;
+
+        buf->in_use = 1;
+        buf->next = __atomic_load_n(&_trace_buffers, __ATOMIC_RELAXED);
+
+        while (!__atomic_compare_exchange_n(&_trace_buffers, &buf->next, buf, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+
+        dbg_print("[%s] new trace buffer %p\n", __func__, (void *)buf);
+    }
+
+    pthread_setspecific(_trace_key, buf);
+
+    if (0 == _tls_tid)
+        _tls_tid = __atomic_add_fetch(&_trace_thread_count, 1, __ATOMIC_RELAXED);
+
+    return buf;
+}
+
+static void trace_clear_buffer(trace_buffer_t *buf, uint32_t generation)
+{
+    for (int s = 0; s < KP_TRACE_NUM_STAGE; s++)
+    {
+        trace_histogram_t *hist = &buf->hist[s];
+
+        __atomic_store_n(&hist->sum_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&hist->min_ns, UINT64_MAX, __ATOMIC_RELAXED);
+        __atomic_store_n(&hist->max_ns, 0, __ATOMIC_RELAXED);
+
+        for (int i = 0; i < HIST_NUM_BUCKET; i++)
+            __atomic_store_n(&hist->bucket[i], 0, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&buf->head, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&buf->generation, generation, __ATOMIC_RELEASE);
+}
+
+uint64_t kp_trace_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void kp_trace_record(kp_trace_stage_t stage, uint64_t begin_ns, uint64_t end_ns, uint32_t arg)
+{
+    trace_buffer_t *buf = _tls_buffer;
+
+    if (NULL == buf)
+    {
+        buf = trace_claim_buffer();
+        if (NULL == buf)
+            return;
+
+        _tls_buffer = buf;
+    }
+
+    uint32_t generation = __atomic_load_n(&_trace_generation, __ATOMIC_ACQUIRE);
+
+    if (buf->generation != generation)
+        trace_clear_buffer(buf, generation);
+
+    uint64_t latency = (end_ns > begin_ns) ? end_ns - begin_ns : 0;
+    trace_histogram_t *hist = &buf->hist[stage];
+    int idx = hist_bucket_index(latency);
+
+    // only this thread writes, atomic stores keep concurrent readers from seeing torn values
+    __atomic_store_n(&hist->bucket[idx], hist->bucket[idx] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->sum_ns, hist->sum_ns + latency, __ATOMIC_RELAXED);
+
+    if (latency < hist->min_ns)
+        __atomic_store_n(&hist->min_ns, latency, __ATOMIC_RELAXED);
+
+    if (latency > hist->max_ns)
+        __atomic_store_n(&hist->max_ns, latency, __ATOMIC_RELAXED);
+
+    trace_event_t *event = &buf->ring[buf->head % KP_TRACE_RING_SIZE];
+
+    event->begin_ns = begin_ns;
+    event->end_ns = end_ns;
+    event->tid = _tls_tid;
+    event->stage = stage;
+    event->arg = arg;
+
+    __atomic_store_n(&buf->head, buf->head + 1, __ATOMIC_RELEASE);
+}
+
+void kp_trace_enable(bool enable)
+{
+    if (enable && 0 == __atomic_load_n(&_trace_base_ns, __ATOMIC_RELAXED))
+        __atomic_store_n(&_trace_base_ns, kp_trace_now_ns(), __ATOMIC_RELAXED);
+
+    __atomic_store_n(&_kp_trace_enabled, enable ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+bool kp_trace_is_enabled(void)
+{
+    return (0 != __atomic_load_n(&_kp_trace_enabled, __ATOMIC_ACQUIRE));
+}
+
+void kp_trace_reset(void)
+{
+    // each thread clears its own buffer when it records next time, until then the stale data is ignored
+    __atomic_store_n(&_trace_base_ns, kp_trace_now_ns(), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&_trace_generation, 1, __ATOMIC_ACQ_REL);
+}
+
+const char *kp_trace_stage_name(kp_trace_stage_t stage)
+{
+    if (stage < 0 || stage >= KP_TRACE_NUM_STAGE)
+        return "unknown";
+
+    return _stage_names[stage];
+}
+
+// merge histograms of one stage from all threads, return the total count
+static uint64_t trace_merge_histogram(kp_trace_stage_t stage, trace_histogram_t *merged)
+{
+    uint32_t generation = __atomic_load_n(&_trace_generation, __ATOMIC_ACQUIRE);
+    uint64_t count = 0;
+
+    memset(merged, 0, sizeof(trace_histogram_t));
+    merged->min_ns = UINT64_MAX;
+
+    for (trace_buffer_t *b = __atomic_load_n(&_trace_buffers, __ATOMIC_ACQUIRE); b != NULL; b = b->next)
+    {
+        if (__atomic_load_n(&b->generation, __ATOMIC_ACQUIRE) != generation)
+            continue;
+
+        trace_histogram_t *hist = &b->hist[stage];
+        uint64_t hist_count = 0;
+
+        for (int i = 0; i < HIST_NUM_BUCKET; i++)
+        {
+            uint64_t n = __atomic_load_n(&hist->bucket[i], __ATOMIC_RELAXED);
+            merged->bucket[i] += n;
+            hist_count += n;
+        }
+
+        if (0 == hist_count)
+            continue;
+
+        uint64_t min_ns = __atomic_load_n(&hist->min_ns, __ATOMIC_RELAXED);
+        uint64_t max_ns = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+
+        merged->sum_ns += __atomic_load_n(&hist->sum_ns, __ATOMIC_RELAXED);
+        merged->min_ns = (min_ns < merged->min_ns) ? min_ns : merged->min_ns;
+        merged->max_ns = (max_ns > merged->max_ns) ? max_ns : merged->max_ns;
+
+        count += hist_count;
+    }
+
+    if (0 == count)
+        merged->min_ns = 0;
+
+    return count;
+}
+
+static uint64_t hist_percentile(trace_histogram_t *hist, uint64_t count, double percentile)
+{
+    uint64_t target = (uint64_t)ceil(percentile / 100.0 * (double)count);
+    uint64_t accumulated = 0;
+
+    if (target < 1)
+        target = 1;
+
+    for (int i = 0; i < HIST_NUM_BUCKET; i++)
+    {
+        accumulated += hist->bucket[i];
+
+        if (accumulated >= target)
+        {
+            uint64_t upper = hist_bucket_upper(i);
+            return (upper < hist->max_ns) ? upper : hist->max_ns;
+        }
+    }
+
+    return hist->max_ns;
+}
+
+int kp_trace_get_latency_stats(kp_trace_stage_t stage, kp_trace_latency_stats_t *stats)
+{
+    if (stage < 0 || stage >= KP_TRACE_NUM_STAGE || NULL == stats)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    trace_histogram_t *hist = (trace_histogram_t *)malloc(sizeof(trace_histogram_t));
+    if (NULL == hist)
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    uint64_t count = trace_merge_histogram(stage, hist);
+
+    memset(stats, 0, sizeof(kp_trace_latency_stats_t));
+
+    if (count > 0)
+    {
+        stats->count = count;
+        stats->min_us = hist->min_ns / 1000.0;
+        stats->mean_us = (double)hist->sum_ns / count / 1000.0;
+        stats->p50_us = hist_percentile(hist, count, 50.0) / 1000.0;
+        stats->p90_us = hist_percentile(hist, count, 90.0) / 1000.0;
+        stats->p99_us = hist_percentile(hist, count, 99.0) / 1000.0;
+        stats->p999_us = hist_percentile(hist, count, 99.9) / 1000.0;
+        stats->max_us = hist->max_ns / 1000.0;
+    }
+
+    free(hist);
+
+    return KP_SUCCESS;
+}
+
+static void write_percentile_distribution(FILE *fp, kp_trace_stage_t stage, trace_histogram_t *hist, uint64_t count)
+{
+    double mean = (double)hist->sum_ns / count;
+    double variance = 0;
+
+    for (int i = 0; i < HIST_NUM_BUCKET; i++)
+    {
+        if (hist->bucket[i] > 0)
+        {
+            double dev = (double)hist_bucket_middle(i) - mean;
+            variance += dev * dev * hist->bucket[i];
+        }
+    }
+
+    fprintf(fp, "# %s, value unit: us\n", _stage_names[stage]);
+    fprintf(fp, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+    uint64_t accumulated = 0;
+
+    for (int i = 0; i < HIST_NUM_BUCKET; i++)
+    {
+        if (0 == hist->bucket[i])
+            continue;
+
+        accumulated += hist->bucket[i];
+
+        uint64_t upper = hist_bucket_upper(i);
+        double value = ((upper < hist->max_ns) ? upper : hist->max_ns) / 1000.0;
+        double percentile = (double)accumulated / count;
+
+        if (accumulated < count)
+            fprintf(fp, "%12.3f %2.12f %10llu %14.2f\n", value, percentile, (unsigned long long)accumulated, 1.0 / (1.0 - percentile));
+        else
+            fprintf(fp, "%12.3f %2.12f %10llu\n", value, percentile, (unsigned long long)accumulated);
+    }
+
+    fprintf(fp, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean / 1000.0, sqrt(variance / count) / 1000.0);
+    fprintf(fp, "#[Max     = %12.3f, Total count    = %12llu]\n", hist->max_ns / 1000.0, (unsigned long long)count);
+    fprintf(fp, "#[Buckets = %12d, SubBuckets     = %12d]\n\n", HIST_NUM_BUCKET, HIST_SUB_BUCKET_COUNT);
+}
+
+int kp_trace_dump_histograms(const char *file_path)
+{
+    FILE *fp = stdout;
+
+    if (NULL != file_path)
+    {
+        fp = fopen(file_path, "w");
+        if (NULL == fp)
+            return KP_ERROR_FILE_OPEN_FAILED_20;
+    }
+
+    trace_histogram_t *hist = (trace_histogram_t *)malloc(sizeof(trace_histogram_t));
+
+    if (NULL != hist)
+    {
+        for (int s = 0; s < KP_TRACE_NUM_STAGE; s++)
+        {
+            uint64_t count = trace_merge_histogram((kp_trace_stage_t)s, hist);
+
+            if (count > 0)
+                write_percentile_distribution(fp, (kp_trace_stage_t)s, hist, count);
+        }
+    }
+
+    if (NULL != file_path)
+        fclose(fp);
+    else
+        fflush(fp);
+
+    if (NULL == hist)
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    free(hist);
+
+    return KP_SUCCESS;
+}
+
+// copy events of one buffer which are not overwritten while copying, return the number of events
+static int trace_copy_events(trace_buffer_t *buf, trace_event_t *events)
+{
+    uint64_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    uint64_t start = (head > KP_TRACE_RING_SIZE) ? head - KP_TRACE_RING_SIZE : 0;
+
+    for (uint64_t i = start; i < head; i++)
+        events[i - start] = buf->ring[i % KP_TRACE_RING_SIZE];
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    uint64_t new_head = __atomic_load_n(&buf->head, __ATOMIC_RELAXED);
+
+    if (new_head < head)
+        return 0; // cleared by the owner thread
+
+    // events older than this may have been overwritten by the owner thread
+    uint64_t valid_start = (new_head > KP_TRACE_RING_SIZE) ? new_head - KP_TRACE_RING_SIZE : 0;
+
+    if (valid_start >= head)
+        return 0;
+
+    if (valid_start > start)
+    {
+        memmove(events, events + (valid_start - start), (head - valid_start) * sizeof(trace_event_t));
+        start = valid_start;
+    }
+
+    return (int)(head - start);
+}
+
+int kp_trace_dump_chrome_trace(const char *file_path)
+{
+    if (NULL == file_path)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    trace_event_t *events = (trace_event_t *)malloc(KP_TRACE_RING_SIZE * sizeof(trace_event_t));
+    if (NULL == events)
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    FILE *fp = fopen(file_path, "w");
+    if (NULL == fp)
+    {
+        free(events);
+        return KP_ERROR_FILE_OPEN_FAILED_20;
+    }
+
+    uint32_t generation = __atomic_load_n(&_trace_generation, __ATOMIC_ACQUIRE);
+    uint64_t base_ns = __atomic_load_n(&_trace_base_ns, __ATOMIC_RELAXED);
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"kneron_plus\"}}");
+
+    for (trace_buffer_t *b = __atomic_load_n(&_trace_buffers, __ATOMIC_ACQUIRE); b != NULL; b = b->next)
+    {
+        if (__atomic_load_n(&b->generation, __ATOMIC_ACQUIRE) != generation)
+            continue;
+
+        int num_event = trace_copy_events(b, events);
+
+        for (int i = 0; i < num_event; i++)
+        {
+            trace_event_t *e = &events[i];
+
+            if (e->stage >= KP_TRACE_NUM_STAGE)
+                continue;
+
+            // timestamps in microseconds
+            double ts = (double)(int64_t)(e->begin_ns - base_ns) / 1000.0;
+            double dur = (double)(e->end_ns - e->begin_ns) / 1000.0;
+
+            fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"kp\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"%s\":%u}}",
+                    _stage_names[e->stage], e->tid, ts, dur, _stage_arg_names[e->stage], e->arg);
+        }
+    }
+
+    fprintf(fp, "\n]}\n");
+
+    int ret = (0 == ferror(fp)) ? KP_SUCCESS : KP_ERROR_OTHER_99;
+
+    fclose(fp);
+    free(events);
+
+    return ret;
+}
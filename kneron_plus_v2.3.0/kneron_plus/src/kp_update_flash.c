@@ -41,6 +41,16 @@
 
 #define USB_REBOOT_WAIT_DELAY_US (3000 * 1000)
 
+typedef struct
+{
+    kp_flash_update_mode_t mode;
+    const char *journal_dir;   // NULL for no journal
+    uint32_t max_write_size;
+    uint32_t stream_window;
+    uint32_t stream_chunk_size;
+    bool stream_supported;     // cleared once the firmware is found without the flash write stream command
+} _flash_update_option_t;
+
 typedef struct
 {
     int dev_idx;
@@ -51,6 +61,7 @@ typedef struct
     int timeout;
     bool auto_reboot;
     int sts;
+    _flash_update_option_t flash_option;
 } _update_kdp2_firmware_package;
 
 int kp_write_data_to_flash(kp_usb_device_t *ll_dev, int timeout, uint32_t flash_offset,
@@ -88,6 +99,614 @@ static int check_usb_write_data_error(int ret)
     return KP_SUCCESS;
 }
 
+/* sector-diff flash update */
+
+#define FLASH_DIFF_SECTOR_SIZE (64 * 1024)          // sectors compared by CRC32, the device may round it up to its erase block size
+#define FLASH_DIFF_DEFAULT_WRITE_SIZE (128 * 1024)  // maximum size of one flash write when the FIFO queue is not configured
+#define FLASH_DIFF_MAX_WRITE_SIZE (1024 * 1024)     // maximum size of one flash write
+#define FLASH_DIGEST_TIMEOUT_MS 20000               // the device reads the whole area for its digests
+
+#define FLASH_JOURNAL_MAGIC 0x4A46504B // "KPFJ"
+#define FLASH_JOURNAL_VERSION 1
+
+enum
+{
+    FLASH_SECTOR_PENDING = 0,
+    FLASH_SECTOR_DONE = 1,
+};
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t region;
+    uint32_t flash_offset;
+    uint32_t flash_addr;   // absolute flash address resolved by the device
+    uint32_t length;
+    uint32_t image_crc32;
+    uint32_t sector_size;
+    uint32_t num_sector;   // followed by one FLASH_SECTOR_* byte per sector
+} _flash_journal_header_t;
+
+static uint32_t _crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    static const uint32_t nibble_tab[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+
+    crc = ~crc;
+    while (size--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ nibble_tab[crc & 0xF];
+        crc = (crc >> 4) ^ nibble_tab[crc & 0xF];
+    }
+
+    return ~crc;
+}
+
+static void _get_flash_update_option(_kp_devices_group_t *_devices_grp, _flash_update_option_t *option)
+{
+    uint32_t input_buffer_size = _devices_grp->ddr_attr.input_buffer_size;
+
+    option->mode = _devices_grp->flash_update_mode;
+    option->journal_dir = ('\0' != _devices_grp->flash_journal_dir[0]) ? _devices_grp->flash_journal_dir : NULL;
+
+    // flash data is received into an input buffer of the FIFO queue
+    if (0 == input_buffer_size)
+        option->max_write_size = FLASH_DIFF_DEFAULT_WRITE_SIZE;
+    else if (input_buffer_size > FLASH_DIFF_MAX_WRITE_SIZE)
+        option->max_write_size = FLASH_DIFF_MAX_WRITE_SIZE;
+    else
+        option->max_write_size = input_buffer_size;
+
+    option->stream_window = _devices_grp->flash_stream_window;
+    option->stream_chunk_size = _devices_grp->flash_stream_chunk_size;
+    option->stream_supported = true;
+}
+
+// firmware of this version may not have some commands, it is asked before the command is sent
+static bool _is_command_supported(kp_usb_device_t *ll_dev, uint32_t command_id, int timeout)
+{
+    kp_usb_control_t kctrl = {KDP2_CONTROL_QUERY_COMMAND, (unsigned short)command_id, 0};
+
+    // older firmware stalls the unknown control request
+    return (KP_USB_RET_OK == kp_usb_control(ll_dev, &kctrl, timeout));
+}
+
+static int _get_flash_digest(kp_usb_device_t *ll_dev, int timeout, uint32_t region, uint32_t flash_offset,
+                             uint32_t length, uint32_t sector_size, kdp2_ipc_response_flash_digest_t *response)
+{
+    kdp2_ipc_cmd_get_flash_digest_t cmd_buf;
+    uint32_t header_size = sizeof(kdp2_ipc_response_flash_digest_t) - sizeof(response->digest);
+
+    cmd_buf.magic_type = KDP2_MAGIC_TYPE_COMMAND;
+    cmd_buf.total_size = sizeof(kdp2_ipc_cmd_get_flash_digest_t);
+    cmd_buf.command_id = KDP2_COMMAND_GET_FLASH_DIGEST;
+    cmd_buf.region = region;
+    cmd_buf.flash_offset = flash_offset;
+    cmd_buf.length = length;
+    cmd_buf.sector_size = sector_size;
+
+    if ((0 == timeout) || (FLASH_DIGEST_TIMEOUT_MS > timeout))
+        timeout = FLASH_DIGEST_TIMEOUT_MS;
+
+    int ret = kp_usb_write_data(ll_dev, (void *)&cmd_buf, cmd_buf.total_size, timeout);
+    int status = check_usb_write_data_error(ret);
+    if (status != KP_SUCCESS)
+        return status;
+
+    ret = kp_usb_read_data(ll_dev, (void *)response, sizeof(kdp2_ipc_response_flash_digest_t), timeout);
+    status = check_usb_read_data_error(ret);
+    if (status != KP_SUCCESS)
+        return status;
+
+    // firmware which does not know the command may respond with an error code only
+    if ((uint32_t)ret < header_size)
+        return KP_ERROR_INVALID_FIRMWARE_24;
+
+    if (KP_SUCCESS != response->return_code)
+        return response->return_code;
+
+    if ((KDP2_FLASH_DIGEST_MAX_SECTOR < response->num_sector) ||
+        ((uint32_t)ret != header_size + response->num_sector * sizeof(uint32_t)) ||
+        (0 == response->sector_size) || (0 == response->num_sector) ||
+        (response->num_sector > (length + response->sector_size - 1) / response->sector_size))
+        return KP_ERROR_DEVICE_INCORRECT_RESPONSE_11;
+
+    return KP_SUCCESS;
+}
+
+static FILE *_open_flash_journal(kp_usb_device_t *ll_dev, const char *journal_dir, uint32_t region, uint32_t flash_offset,
+                                 char *path, size_t path_size)
+{
+    uint32_t device_id = ll_dev->dev_descp.kn_number;
+
+    // firmware without KN number support reports 0xFFFF
+    if ((0 == device_id) || (0xFFFF == device_id))
+        device_id = ll_dev->dev_descp.port_id;
+
+    snprintf(path, path_size, "%s/kp_flash_%08X_%u_%08X.jnl", journal_dir, device_id, region, flash_offset);
+
+    FILE *journal = fopen(path, "r+b");
+
+    if (NULL == journal)
+        journal = fopen(path, "w+b");
+
+    return journal;
+}
+
+// load sector states of an interrupted update of the same image, return false if there is none
+static bool _load_flash_journal(FILE *journal, const _flash_journal_header_t *expected, uint32_t *flash_addr,
+                                uint32_t *sector_size, uint8_t **sector_state, uint32_t *num_sector)
+{
+    _flash_journal_header_t header;
+
+    rewind(journal);
+
+    if (1 != fread(&header, sizeof(header), 1, journal))
+        return false;
+
+    if ((FLASH_JOURNAL_MAGIC != header.magic) || (FLASH_JOURNAL_VERSION != header.version) ||
+        (expected->region != header.region) || (expected->flash_offset != header.flash_offset) ||
+        (expected->length != header.length) || (expected->image_crc32 != header.image_crc32) ||
+        (0 == header.sector_size) || (header.num_sector != (header.length + header.sector_size - 1) / header.sector_size))
+        return false;
+
+    uint8_t *state = (uint8_t *)malloc(header.num_sector);
+
+    if (NULL == state)
+        return false;
+
+    if (header.num_sector != fread(state, 1, header.num_sector, journal)) {
+        free(state);
+        return false;
+    }
+
+    *flash_addr = header.flash_addr;
+    *sector_size = header.sector_size;
+    *sector_state = state;
+    *num_sector = header.num_sector;
+
+    return true;
+}
+
+static void _save_flash_journal(FILE *journal, const _flash_journal_header_t *header, const uint8_t *sector_state)
+{
+    rewind(journal);
+    fwrite(header, sizeof(_flash_journal_header_t), 1, journal);
+    fwrite(sector_state, 1, header->num_sector, journal);
+    fflush(journal);
+}
+
+static void _mark_flash_journal(FILE *journal, uint32_t first_sector, const uint8_t *sector_state, uint32_t count)
+{
+    fseek(journal, (long)(sizeof(_flash_journal_header_t) + first_sector), SEEK_SET);
+    fwrite(sector_state + first_sector, 1, count, journal);
+    fflush(journal);
+}
+
+// compare sectors of the image with the flash, 'sector_state' is allocated and 'sector_size' is the size used by the device
+static int _diff_flash_sectors(kp_usb_device_t *ll_dev, int timeout, uint32_t region, uint32_t flash_offset,
+                               const uint8_t *image, uint32_t image_size, uint32_t *flash_addr,
+                               uint32_t *sector_size, uint8_t **sector_state, uint32_t *num_sector)
+{
+    kdp2_ipc_response_flash_digest_t *response = (kdp2_ipc_response_flash_digest_t *)malloc(sizeof(kdp2_ipc_response_flash_digest_t));
+    uint8_t *state = NULL;
+    uint32_t sect_size = FLASH_DIFF_SECTOR_SIZE;
+    uint32_t num_sect = 0;
+    uint32_t offset = 0;
+    int ret = KP_SUCCESS;
+
+    if (NULL == response)
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    while (offset < image_size) {
+        uint32_t length = image_size - offset;
+
+        if (length > KDP2_FLASH_DIGEST_MAX_SECTOR * sect_size)
+            length = KDP2_FLASH_DIGEST_MAX_SECTOR * sect_size;
+
+        ret = _get_flash_digest(ll_dev, timeout, region, flash_offset + offset, length, sect_size, response);
+        if (KP_SUCCESS != ret)
+            break;
+
+        // the device rounds the sector size up to its erase block size and cuts it down to its buffer size,
+        // it can only change in the first response and the sectors digested may cover less than requested
+        if ((response->sector_size != sect_size) && (NULL != state)) {
+            ret = KP_ERROR_DEVICE_INCORRECT_RESPONSE_11;
+            break;
+        }
+
+        sect_size = response->sector_size;
+
+        if ((0 == sect_size) || (0 == response->num_sector) ||
+            (offset / sect_size + response->num_sector > (image_size + sect_size - 1) / sect_size)) {
+            ret = KP_ERROR_DEVICE_INCORRECT_RESPONSE_11;
+            break;
+        }
+
+        if (NULL == state) {
+            num_sect = (image_size + sect_size - 1) / sect_size;
+            *flash_addr = response->flash_addr;
+
+            state = (uint8_t *)malloc(num_sect);
+            if (NULL == state) {
+                ret = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+                break;
+            }
+        }
+
+        for (uint32_t i = 0; i < response->num_sector; i++) {
+            uint32_t sect = offset / sect_size + i;
+            uint32_t sect_offset = sect * sect_size;
+            uint32_t len = (image_size - sect_offset > sect_size) ? sect_size : image_size - sect_offset;
+
+            state[sect] = (_crc32(0, image + sect_offset, len) == response->digest[i]) ? FLASH_SECTOR_DONE : FLASH_SECTOR_PENDING;
+        }
+
+        offset += response->num_sector * sect_size;
+    }
+
+    free(response);
+
+    if (KP_SUCCESS != ret) {
+        free(state);
+        return ret;
+    }
+
+    *sector_size = sect_size;
+    *sector_state = state;
+    *num_sector = num_sect;
+
+    return KP_SUCCESS;
+}
+
+static int _verify_flash_sectors(kp_usb_device_t *ll_dev, int timeout, uint32_t flash_addr, const uint8_t *data,
+                                 uint32_t length, uint32_t sector_size)
+{
+    kdp2_ipc_response_flash_digest_t *response = (kdp2_ipc_response_flash_digest_t *)malloc(sizeof(kdp2_ipc_response_flash_digest_t));
+
+    if (NULL == response)
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    int ret = _get_flash_digest(ll_dev, timeout, KDP2_FLASH_REGION_RAW, flash_addr, length, sector_size, response);
+
+    for (uint32_t i = 0; (KP_SUCCESS == ret) && (i < response->num_sector); i++) {
+        uint32_t offset = i * sector_size;
+        uint32_t len = (length - offset > sector_size) ? sector_size : length - offset;
+
+        if (_crc32(0, data + offset, len) != response->digest[i]) {
+            dbg_print("[%s] sector at flash 0x%08X is not written correctly\n", __FUNCTION__, flash_addr + offset);
+            ret = KP_ERROR_FW_UPDATE_FAILED_19;
+        }
+    }
+
+    free(response);
+
+    return ret;
+}
+
+/* streaming flash write */
+
+#define FLASH_STREAM_ACK_TIMEOUT_MS 20000   // a chunk may take seconds to erase and program
+
+/*
+ * Write data to flash in chunks, the device programs one chunk while the next ones are transferred.
+ * 'option->stream_supported' is cleared if the firmware does not support KDP2_COMMAND_WRITE_FLASH_STREAM,
+ * nothing is written then and the caller should fall back to KDP2_COMMAND_WRITE_FLASH.
+ */
+static int _write_flash_stream(kp_usb_device_t *ll_dev, int timeout, _flash_update_option_t *option, uint32_t region,
+                               uint32_t flash_offset, const uint8_t *data, uint32_t length)
+{
+    kdp2_ipc_cmd_write_flash_stream_t cmd_buf;
+    kdp2_ipc_response_write_flash_stream_t response;
+    kdp2_ipc_response_flash_chunk_ack_t ack;
+    uint32_t chunk_crc[KDP2_FLASH_STREAM_MAX_WINDOW];
+    int chunk_timeout = ((0 == timeout) || (FLASH_STREAM_ACK_TIMEOUT_MS > timeout)) ? FLASH_STREAM_ACK_TIMEOUT_MS : timeout;
+
+    // firmware which does not know the command never responds to it
+    if (false == _is_command_supported(ll_dev, KDP2_COMMAND_WRITE_FLASH_STREAM, timeout)) {
+        dbg_print("[%s] firmware does not support the flash write stream\n", __FUNCTION__);
+        option->stream_supported = false;
+        return KP_ERROR_INVALID_FIRMWARE_24;
+    }
+
+    cmd_buf.magic_type = KDP2_MAGIC_TYPE_COMMAND;
+    cmd_buf.total_size = sizeof(kdp2_ipc_cmd_write_flash_stream_t);
+    cmd_buf.command_id = KDP2_COMMAND_WRITE_FLASH_STREAM;
+    cmd_buf.region = region;
+    cmd_buf.flash_offset = flash_offset;
+    cmd_buf.length = (length + 3) & ~3;
+    cmd_buf.chunk_size = option->stream_chunk_size;
+    cmd_buf.window = option->stream_window;
+
+    int ret = kp_usb_write_data(ll_dev, (void *)&cmd_buf, cmd_buf.total_size, timeout);
+    int status = check_usb_write_data_error(ret);
+    if (status != KP_SUCCESS)
+        return status;
+
+    ret = kp_usb_read_data(ll_dev, (void *)&response, sizeof(response), timeout);
+    status = check_usb_read_data_error(ret);
+    if (status != KP_SUCCESS)
+        return status;
+
+    if ((uint32_t)ret < sizeof(response))
+        return KP_ERROR_DEVICE_INCORRECT_RESPONSE_11;
+
+    // chunks are staged in the FIFO queue, the old way is taken while it is not set up
+    if (KP_FW_FIFOQ_NOT_READY_126 == response.return_code) {
+        option->stream_supported = false;
+        return KP_ERROR_INVALID_FIRMWARE_24;
+    }
+
+    if (KP_SUCCESS != response.return_code)
+        return response.return_code;
+
+    if ((0 == response.chunk_size) || (0 != (response.chunk_size & 3)) ||
+        (0 == response.window) || (KDP2_FLASH_STREAM_MAX_WINDOW < response.window))
+        return KP_ERROR_DEVICE_INCORRECT_RESPONSE_11;
+
+    uint32_t num_chunk = (cmd_buf.length + response.chunk_size - 1) / response.chunk_size;
+    uint8_t *chunk_buf = (uint8_t *)malloc(sizeof(kdp2_flash_chunk_header_t) + response.chunk_size);
+
+    // the device is waiting for chunks, send them all to keep the stream in step even if a chunk fails
+    int first_error = (NULL == chunk_buf) ? KP_ERROR_MEMORY_ALLOCATION_FAILURE_9 : KP_SUCCESS;
+
+    dbg_print("[%s] flash 0x%08X length %u: %u chunks of %u, window %u\n", __FUNCTION__, response.flash_addr,
+              cmd_buf.length, num_chunk, response.chunk_size, response.window);
+
+    for (uint32_t sent = 0, acked = 0; acked < num_chunk;) {
+        if ((sent < num_chunk) && (sent - acked < response.window) && (NULL != chunk_buf)) {
+            kdp2_flash_chunk_header_t *header = (kdp2_flash_chunk_header_t *)chunk_buf;
+            uint8_t *chunk_data = chunk_buf + sizeof(kdp2_flash_chunk_header_t);
+            uint32_t offset = sent * response.chunk_size;
+            uint32_t chunk_len = (cmd_buf.length - offset > response.chunk_size) ? response.chunk_size : cmd_buf.length - offset;
+            uint32_t data_len = (length - offset > chunk_len) ? chunk_len : length - offset;
+
+            // flash is programmed in words, pad the tail of the data
+            memcpy(chunk_data, data + offset, data_len);
+            memset(chunk_data + data_len, 0xFF, chunk_len - data_len);
+
+            header->magic = KDP2_FLASH_CHUNK_MAGIC;
+            header->chunk_index = sent;
+            header->length = chunk_len;
+            header->crc32 = _crc32(0, chunk_data, chunk_len);
+            chunk_crc[sent % KDP2_FLASH_STREAM_MAX_WINDOW] = header->crc32;
+
+            ret = kp_usb_write_data(ll_dev, (void *)chunk_buf, sizeof(kdp2_flash_chunk_header_t) + chunk_len, chunk_timeout);
+            status = check_usb_write_data_error(ret);
+            if (status != KP_SUCCESS) {
+                first_error = status;
+                break;
+            }
+
+            sent++;
+            continue;
+        }
+
+        if (sent == acked)
+            break;
+
+        ret = kp_usb_read_data(ll_dev, (void *)&ack, sizeof(ack), chunk_timeout);
+        status = check_usb_read_data_error(ret);
+        if (status != KP_SUCCESS) {
+            first_error = status;
+            break;
+        }
+
+        if (((uint32_t)ret != sizeof(ack)) || (ack.chunk_index != acked)) {
+            first_error = KP_ERROR_DEVICE_INCORRECT_RESPONSE_11;
+            break;
+        }
+
+        if ((KP_SUCCESS == first_error) && (KP_SUCCESS != ack.return_code)) {
+            dbg_print("[%s] chunk %u failed, error %d\n", __FUNCTION__, acked, ack.return_code);
+            first_error = ack.return_code;
+        } else if ((KP_SUCCESS == first_error) && (ack.crc32 != chunk_crc[acked % KDP2_FLASH_STREAM_MAX_WINDOW])) {
+            dbg_print("[%s] chunk %u is not written correctly\n", __FUNCTION__, acked);
+            first_error = KP_ERROR_FW_UPDATE_FAILED_19;
+        }
+
+        acked++;
+    }
+
+    free(chunk_buf);
+
+    return first_error;
+}
+
+static int _write_flash_run(kp_usb_device_t *ll_dev, int timeout, uint32_t flash_addr, const uint8_t *data, uint32_t length)
+{
+    uint32_t aligned_length = (length + 3) & ~3;
+
+    if (aligned_length == length)
+        return kp_write_data_to_flash(ll_dev, timeout, flash_addr, length, (uint8_t *)data);
+
+    // flash is programmed in words, pad the tail of the image
+    uint8_t *buffer = (uint8_t *)malloc(aligned_length);
+
+    if (NULL == buffer)
+        return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    memcpy(buffer, data, length);
+    memset(buffer + length, 0xFF, aligned_length - length);
+
+    int ret = kp_write_data_to_flash(ll_dev, timeout, flash_addr, aligned_length, buffer);
+
+    free(buffer);
+
+    return ret;
+}
+
+// write data to an absolute flash address, streamed if the firmware supports it, otherwise in writes of up to 'max_run_size'
+static int _write_flash_data(kp_usb_device_t *ll_dev, int timeout, _flash_update_option_t *option, uint32_t flash_addr,
+                             const uint8_t *data, uint32_t length, uint32_t max_run_size)
+{
+    int ret = KP_SUCCESS;
+
+    if (true == option->stream_supported) {
+        ret = _write_flash_stream(ll_dev, timeout, option, KDP2_FLASH_REGION_RAW, flash_addr, data, length);
+
+        if (true == option->stream_supported)
+            return ret;
+
+        ret = KP_SUCCESS; // nothing is written by the stream, write it the old way
+    }
+
+    for (uint32_t offset = 0; (KP_SUCCESS == ret) && (offset < length); offset += max_run_size) {
+        uint32_t run_size = (length - offset > max_run_size) ? max_run_size : length - offset;
+
+        ret = _write_flash_run(ll_dev, timeout, flash_addr + offset, data + offset, run_size);
+    }
+
+    return ret;
+}
+
+/*
+ * Write an image to flash, only sectors whose CRC32 differs from the flash are erased and written.
+ * '*digest_supported' is set to false if the firmware does not support KDP2_COMMAND_GET_FLASH_DIGEST,
+ * nothing is written then and the caller should fall back to a full update.
+ */
+static int _write_flash_sector_diff(kp_usb_device_t *ll_dev, int timeout, _flash_update_option_t *option,
+                                    uint32_t region, uint32_t flash_offset, const uint8_t *image, uint32_t image_size,
+                                    bool *digest_supported)
+{
+    _flash_journal_header_t header = {0};
+    char journal_path[KP_FLASH_JOURNAL_DIR_MAX_LEN + 64];
+    FILE *journal = NULL;
+    uint8_t *sector_state = NULL;
+    uint32_t flash_addr = 0;
+    uint32_t sector_size = 0;
+    uint32_t num_sector = 0;
+    uint32_t num_written = 0;
+    int ret = KP_SUCCESS;
+
+    *digest_supported = _is_command_supported(ll_dev, KDP2_COMMAND_GET_FLASH_DIGEST, timeout);
+
+    if (false == *digest_supported) {
+        dbg_print("[%s] firmware does not support the flash digest\n", __FUNCTION__);
+        return KP_ERROR_INVALID_FIRMWARE_24;
+    }
+
+    header.magic = FLASH_JOURNAL_MAGIC;
+    header.version = FLASH_JOURNAL_VERSION;
+    header.region = region;
+    header.flash_offset = flash_offset;
+    header.length = image_size;
+    header.image_crc32 = _crc32(0, image, image_size);
+
+    if (NULL != option->journal_dir) {
+        journal = _open_flash_journal(ll_dev, option->journal_dir, region, flash_offset, journal_path, sizeof(journal_path));
+
+        if (NULL == journal)
+            dbg_print("[%s] cannot open journal %s, continue without it\n", __FUNCTION__, journal_path);
+    }
+
+    if ((NULL != journal) && _load_flash_journal(journal, &header, &flash_addr, &sector_size, &sector_state, &num_sector)) {
+        dbg_print("[%s] resume the update of flash 0x%08X from journal\n", __FUNCTION__, flash_addr);
+    } else {
+        ret = _diff_flash_sectors(ll_dev, timeout, region, flash_offset, image, image_size, &flash_addr,
+                                  &sector_size, &sector_state, &num_sector);
+
+        if (KP_SUCCESS != ret)
+            goto FUNC_OUT;
+
+        if (NULL != journal) {
+            header.flash_addr = flash_addr;
+            header.sector_size = sector_size;
+            header.num_sector = num_sector;
+            _save_flash_journal(journal, &header, sector_state);
+        }
+    }
+
+    // write runs of adjacent pending sectors, each run is verified before it is marked done
+    uint32_t sectors_per_write = option->max_write_size / sector_size;
+
+    if (0 == sectors_per_write)
+        sectors_per_write = 1;
+
+    // a stream stages chunks itself, so a run is not limited by the FIFO queue buffer size
+    uint32_t max_run_size = sectors_per_write * sector_size;
+
+    if (true == option->stream_supported)
+        sectors_per_write = num_sector;
+
+    for (uint32_t first = 0; first < num_sector;) {
+        if (FLASH_SECTOR_DONE == sector_state[first]) {
+            first++;
+            continue;
+        }
+
+        uint32_t count = 1;
+
+        while ((first + count < num_sector) && (count < sectors_per_write) && (FLASH_SECTOR_PENDING == sector_state[first + count]))
+            count++;
+
+        uint32_t offset = first * sector_size;
+        uint32_t length = (image_size - offset > count * sector_size) ? count * sector_size : image_size - offset;
+
+        ret = _write_flash_data(ll_dev, timeout, option, flash_addr + offset, image + offset, length, max_run_size);
+
+        // a streamed write is verified chunk by chunk already
+        if ((KP_SUCCESS == ret) && (false == option->stream_supported))
+            ret = _verify_flash_sectors(ll_dev, timeout, flash_addr + offset, image + offset, length, sector_size);
+
+        if (KP_SUCCESS != ret) {
+            dbg_print("[%s] write flash 0x%08X length %u failed, error %d\n", __FUNCTION__, flash_addr + offset, length, ret);
+            goto FUNC_OUT;
+        }
+
+        memset(sector_state + first, FLASH_SECTOR_DONE, count);
+
+        if (NULL != journal)
+            _mark_flash_journal(journal, first, sector_state, count);
+
+        num_written += count;
+        first += count;
+    }
+
+    dbg_print("[%s] flash 0x%08X: %u of %u sectors written\n", __FUNCTION__, flash_addr, num_written, num_sector);
+
+FUNC_OUT:
+
+    free(sector_state);
+
+    if (NULL != journal) {
+        fclose(journal);
+
+        // keep the journal of a failed update for resuming
+        if (KP_SUCCESS == ret)
+            remove(journal_path);
+    }
+
+    return ret;
+}
+
+/*
+ * Write an image to flash by sector diff (if configured) or by streaming.
+ * '*supported' is set to false if the firmware supports neither of them, nothing is written then and
+ * the caller should fall back to its own full update command.
+ */
+static int _write_flash_image(kp_usb_device_t *ll_dev, int timeout, _flash_update_option_t *option, uint32_t region,
+                              uint32_t flash_offset, const uint8_t *image, uint32_t image_size, bool *supported)
+{
+    int ret;
+
+    if (KP_FLASH_UPDATE_MODE_SECTOR_DIFF == option->mode) {
+        ret = _write_flash_sector_diff(ll_dev, timeout, option, region, flash_offset, image, image_size, supported);
+
+        if (true == *supported)
+            return ret;
+
+        dbg_print("[%s] firmware does not support sector-diff update, write the whole image\n", __FUNCTION__);
+    }
+
+    ret = _write_flash_stream(ll_dev, timeout, option, region, flash_offset, image, image_size);
+    *supported = option->stream_supported;
+
+    return ret;
+}
+
 static void *_update_kdp2_firmware_to_single_device(void *data)
 {
     _update_kdp2_firmware_package *cmd_pack = (_update_kdp2_firmware_package *)data;
@@ -113,7 +732,15 @@ static void *_update_kdp2_firmware_to_single_device(void *data)
         dbg_print("[%s][%d] device %p, fw_buf 0x%p, fw_size %d, fw_id %d, timeout %d\n", __FUNCTION__, cmd_pack->dev_idx,
                 ll_dev, cmd_pack->fw_buf, cmd_pack->fw_size, cmd_pack->fw_id, cmd_pack->timeout);
 
-        ret = kp_write_data_to_flash(ll_dev, cmd_pack->timeout, flash_offset, cmd_pack->fw_size, (uint8_t *)cmd_pack->fw_buf);
+        bool supported;
+
+        ret = _write_flash_image(ll_dev, cmd_pack->timeout, &cmd_pack->flash_option, KDP2_FLASH_REGION_RAW, flash_offset,
+                                 (uint8_t *)cmd_pack->fw_buf, cmd_pack->fw_size, &supported);
+
+        if (false == supported) {
+            dbg_print("[%s][%d] firmware does not support streamed flash write, write the whole image at once\n", __FUNCTION__, cmd_pack->dev_idx);
+            ret = kp_write_data_to_flash(ll_dev, cmd_pack->timeout, flash_offset, cmd_pack->fw_size, (uint8_t *)cmd_pack->fw_buf);
+        }
     } else if ( (KP_DEVICE_KL630 == ll_dev->dev_descp.product_id) ||
                 (KP_DEVICE_KL730 == ll_dev->dev_descp.product_id) ||
                 (KP_DEVICE_KL830 == ll_dev->dev_descp.product_id)) {
@@ -498,8 +1125,11 @@ typedef struct
     kdp_model_update_cmd_t *cmd_buf;
     void *total_model_buf;
     int total_model_size;
+    int fw_info_size; // total_model_buf is fw_info.bin followed by all_models.bin
     int timeout;
+    bool auto_reboot;
     int sts;
+    _flash_update_option_t flash_option;
 } _update_model_command_package;
 
 static void *_update_model_to_single_device(void *data)
@@ -573,6 +1203,62 @@ static void *_update_model_to_single_device(void *data)
     return NULL;
 }
 
+// write models by flash regions with sector diff or streaming, KDP_CMD_UPDATE_MODEL is used if the firmware supports neither
+static void *_update_model_by_region_to_single_device(void *data)
+{
+    _update_model_command_package *cmd_pack = (_update_model_command_package *)data;
+    kp_usb_device_t *ll_dev = cmd_pack->ll_device;
+    uint8_t *fw_info_buf = (uint8_t *)cmd_pack->total_model_buf;
+    uint8_t *all_models_buf = fw_info_buf + cmd_pack->fw_info_size;
+    uint32_t all_models_size = cmd_pack->total_model_size - cmd_pack->fw_info_size;
+    bool supported;
+
+    // fw_info.bin is written last, so it never describes models which are partially written
+    int ret = _write_flash_image(ll_dev, cmd_pack->timeout, &cmd_pack->flash_option, KDP2_FLASH_REGION_MODEL_ALL, 0,
+                                 all_models_buf, all_models_size, &supported);
+
+    if (false == supported) {
+        dbg_print("[%s][%d] firmware does not support streamed flash write, write the whole model at once\n", __FUNCTION__, cmd_pack->dev_idx);
+        return _update_model_to_single_device(data);
+    }
+
+    if (KP_SUCCESS == ret) {
+        ret = _write_flash_image(ll_dev, cmd_pack->timeout, &cmd_pack->flash_option, KDP2_FLASH_REGION_MODEL_INFO, 0,
+                                 fw_info_buf, cmd_pack->fw_info_size, &supported);
+    }
+
+    if (KP_SUCCESS != ret) {
+        cmd_pack->sts = ret;
+        dbg_print("[%s][%d] write model to flash failed, error %d\n", __FUNCTION__, cmd_pack->dev_idx, cmd_pack->sts);
+        return NULL;
+    }
+
+    if (true == cmd_pack->auto_reboot) {
+        kp_usb_control_t kctrl = {KDP2_CONTROL_REBOOT, 0, 0};
+        ret = kp_usb_control(ll_dev, &kctrl, cmd_pack->timeout);
+        if ((ret != KP_USB_USB_PIPE) &&
+            (ret != KP_USB_USB_IO) &&
+            (ret != KP_USB_USB_NO_DEVICE) &&
+            (ret != KP_USB_USB_NOT_FOUND) &&
+            (ret != KP_SUCCESS)) { // device may be gone before the control transfer completes
+            cmd_pack->sts = KP_ERROR_RESET_FAILED_25;
+            return NULL;
+        }
+    }
+
+    dbg_print("[%s][%d] model write OK, now disconnect device %d\n", __FUNCTION__, cmd_pack->dev_idx, cmd_pack->dev_idx);
+
+    // same as the full update, host disconnects the device and re-connects it later
+    usleep(USB_DISCONNECT_WAIT_DELAY_US);
+    kp_usb_disconnect_device(ll_dev);
+    usleep(USB_DISCONNECT_WAIT_DELAY_US);
+
+    cmd_pack->ll_device = NULL;
+    cmd_pack->sts = KP_SUCCESS;
+
+    return NULL;
+}
+
 typedef struct
 {
     kp_usb_device_t *ll_device;
@@ -884,8 +1570,11 @@ int _update_model(kp_device_group_t devices, void *nef_buf, int nef_size, bool a
     cmd_packs[0].cmd_buf = &cmd_buf;
     cmd_packs[0].total_model_buf = total_model_buf;
     cmd_packs[0].total_model_size = total_model_size;
+    cmd_packs[0].fw_info_size = fw_info_size;
     cmd_packs[0].timeout = _devices_grp->timeout;
+    cmd_packs[0].auto_reboot = auto_reboot;
     cmd_packs[0].sts = -1;
+    _get_flash_update_option(_devices_grp, &cmd_packs[0].flash_option);
 
     port_id_list[0] = ll_dev[0]->dev_descp.port_id;
 
@@ -909,7 +1598,7 @@ int _update_model(kp_device_group_t devices, void *nef_buf, int nef_size, bool a
         memcpy((void *)&cmd_packs[i], (void *)&cmd_packs[0], sizeof(_update_model_command_package));
         cmd_packs[i].ll_device = ll_dev[i];
 
-        int thd_ret = pthread_create(&update_model_thd[i], NULL, _update_model_to_single_device, (void *)&cmd_packs[i]);
+        int thd_ret = pthread_create(&update_model_thd[i], NULL, _update_model_by_region_to_single_device, (void *)&cmd_packs[i]);
 
         if (0 != thd_ret) {
             dbg_print("[%s] thread creation failed ! error %d\n", __FUNCTION__, thd_ret);
@@ -930,7 +1619,7 @@ int _update_model(kp_device_group_t devices, void *nef_buf, int nef_size, bool a
     }
 
     // current thread do first device
-    _update_model_to_single_device((void *)&cmd_packs[0]);
+    _update_model_by_region_to_single_device((void *)&cmd_packs[0]);
 
 AFTER_UPDATE:
 
@@ -1211,6 +1900,45 @@ int kp_write_data_to_flash(kp_usb_device_t *ll_dev, int timeout, uint32_t flash_
     return return_code;
 }
 
+int kp_set_flash_update_mode(kp_device_group_t devices, kp_flash_update_mode_t mode, const char *journal_dir)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    if (NULL == _devices_grp)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if ((KP_FLASH_UPDATE_MODE_FULL != mode) && (KP_FLASH_UPDATE_MODE_SECTOR_DIFF != mode))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if ((NULL != journal_dir) && (KP_FLASH_JOURNAL_DIR_MAX_LEN <= strlen(journal_dir)))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    _devices_grp->flash_update_mode = mode;
+
+    if (NULL != journal_dir)
+        strcpy(_devices_grp->flash_journal_dir, journal_dir);
+    else
+        _devices_grp->flash_journal_dir[0] = '\0';
+
+    return KP_SUCCESS;
+}
+
+int kp_set_flash_stream_config(kp_device_group_t devices, uint32_t window, uint32_t chunk_size)
+{
+    _kp_devices_group_t *_devices_grp = (_kp_devices_group_t *)devices;
+
+    if (NULL == _devices_grp)
+        return KP_ERROR_INVALID_PARAM_12;
+
+    if ((0 == window) || (KP_FLASH_STREAM_MAX_WINDOW < window) || (0 != (chunk_size & 3)))
+        return KP_ERROR_INVALID_PARAM_12;
+
+    _devices_grp->flash_stream_window = window;
+    _devices_grp->flash_stream_chunk_size = chunk_size;
+
+    return KP_SUCCESS;
+}
+
 int kp_update_kdp2_firmware(kp_device_group_t devices, void *scpu_fw_buf, int scpu_fw_size,
                             void *ncpu_fw_buf, int ncpu_fw_size, bool auto_reboot)
 {
@@ -1251,6 +1979,7 @@ int kp_update_kdp2_firmware(kp_device_group_t devices, void *scpu_fw_buf, int sc
         cmd_packs[0].fw_id = 1;
         cmd_packs[0].timeout = _devices_grp->timeout;
         cmd_packs[0].auto_reboot = auto_reboot;
+        _get_flash_update_option(_devices_grp, &cmd_packs[0].flash_option);
 
         port_id_list[0] = ll_dev[0]->dev_descp.port_id;
 
@@ -1338,6 +2067,7 @@ int kp_update_kdp2_firmware(kp_device_group_t devices, void *scpu_fw_buf, int sc
         cmd_packs[0].fw_id = 2;
         cmd_packs[0].timeout = _devices_grp->timeout;
         cmd_packs[0].auto_reboot = auto_reboot;
+        _get_flash_update_option(_devices_grp, &cmd_packs[0].flash_option);
 
         port_id_list[0] = ll_dev[0]->dev_descp.port_id;
 
@@ -11,10 +11,13 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 
 #include "kp_usb.h"
 #include "KL720_usb_minion.h"
 #include "kdp2_ipc_cmd.h"
+#include "kp_trace_internal.h"
 
 #ifdef DEBUG_PRINT
 #define dbg_print(format, ...) printf(format, ##__VA_ARGS__)
@@ -36,6 +39,14 @@
 pthread_mutex_t _g_mutex = PTHREAD_MUTEX_INITIALIZER; // global mutex
 static int _g_libusb_ref_count = 0; // reference count of libusb
 
+static bool __kn_usb_need_fake_zlp(kp_usb_device_t *dev)
+{
+	return ((dev->dev_descp.product_id == KP_DEVICE_KL720) ||
+			(dev->dev_descp.product_id == KP_DEVICE_KL720_PREV) ||
+			((dev->fw_serial & KP_KDP2_FW_V2) == KP_KDP2_FW_V2) ||
+			((dev->fw_serial & KP_KDP2_FW) == KP_KDP2_FW));
+}
+
 static int __kn_usb_bulk_out(kp_usb_device_t *dev, unsigned char endpoint, void *buf, int length, unsigned int timeout)
 {
 	int status;
@@ -87,18 +98,19 @@ static int __kn_usb_bulk_out(kp_usb_device_t *dev, unsigned char endpoint, void
 		int len = 0;
 		int transferred;
 
-		if ((dev->dev_descp.product_id == KP_DEVICE_KL720) ||
-			(dev->dev_descp.product_id == KP_DEVICE_KL720_PREV) ||
-			((dev->fw_serial & KP_KDP2_FW_V2) == KP_KDP2_FW_V2) ||
-			((dev->fw_serial & KP_KDP2_FW) == KP_KDP2_FW))
+		if (__kn_usb_need_fake_zlp(dev))
 		{
 			// use fake ZLP as workaround
 			zlp_buf = 0x11223344;
 			len = 4;
 		}
 
+		uint64_t trace_zlp = kp_trace_begin();
+
 		status = libusb_bulk_transfer(usbdev, endpoint, (unsigned char *)&zlp_buf, len, &transferred, timeout);
 
+		kp_trace_end(KP_TRACE_STAGE_ZLP, trace_zlp, len);
+
 		if (status != 0 || transferred != len)
 		{
 			dbg_print("[%s] [kp_usb] send fake ZLP failed error: %s\n", __func__, libusb_strerror((enum libusb_error)status));
@@ -156,9 +168,12 @@ static int __kn_usb_bulk_in(kp_usb_device_t *dev, unsigned char endpoint, void *
 	if (buf_size == *recv_size && (*recv_size & (max_psize - 1)) == 0)
 	{
 		int zlp_buf;
+		uint64_t trace_zlp = kp_trace_begin();
 
 		status = libusb_bulk_transfer(usbdev, endpoint, (unsigned char *)&zlp_buf, 4, &transferred, 5);
 
+		kp_trace_end(KP_TRACE_STAGE_ZLP, trace_zlp, 0);
+
 		if (status != 0)
 		{
 			dbg_print("[kp_usb] libusb_bulk_transfer ZLP failed error: %s\n", libusb_strerror((enum libusb_error)status));
@@ -175,6 +190,191 @@ static int __kn_usb_bulk_in(kp_usb_device_t *dev, unsigned char endpoint, void *
 	return KP_USB_RET_OK;
 }
 
+static int __kn_usb_transfer_status(enum libusb_transfer_status status)
+{
+	switch (status)
+	{
+	case LIBUSB_TRANSFER_COMPLETED:
+		return KP_USB_RET_OK;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return KP_USB_USB_TIMEOUT;
+	case LIBUSB_TRANSFER_CANCELLED:
+		return KP_USB_USB_INTERRUPTED;
+	case LIBUSB_TRANSFER_STALL:
+		return KP_USB_USB_PIPE;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return KP_USB_USB_NO_DEVICE;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		return KP_USB_USB_OVERFLOW;
+	default:
+		return KP_USB_USB_IO;
+	}
+}
+
+// must be called with req->mutex locked
+static void __kn_usb_async_fail(kp_usb_async_request_t *req, struct libusb_transfer *failed_txfer, int status)
+{
+	if (req->status != KP_USB_RET_OK)
+		return; // already failed, others are being cancelled
+
+	req->status = status;
+
+	for (int i = 0; i < req->num_submitted; i++)
+	{
+		if (req->txfer[i] != failed_txfer)
+			libusb_cancel_transfer(req->txfer[i]);
+	}
+}
+
+static void __kn_usb_async_done(kp_usb_async_request_t *req)
+{
+	if (NULL == req->notify)
+	{
+		req->completed = 1;
+		return;
+	}
+
+	// set completed with notify mutex held so that a waiter can not miss it
+	pthread_mutex_lock(&req->notify->mutex);
+	req->completed = 1;
+	pthread_cond_broadcast(&req->notify->cond);
+	pthread_mutex_unlock(&req->notify->mutex);
+}
+
+static void LIBUSB_CALL __kn_usb_async_out_cb(struct libusb_transfer *txfer)
+{
+	kp_usb_async_request_t *req = (kp_usb_async_request_t *)txfer->user_data;
+
+	pthread_mutex_lock(&req->mutex);
+
+	int status = __kn_usb_transfer_status(txfer->status);
+
+	if (status != KP_USB_RET_OK)
+	{
+		dbg_print("[%s] [kp_usb] async send failed error: %d\n", __func__, status);
+		__kn_usb_async_fail(req, txfer, status);
+	}
+	else if (txfer->actual_length != txfer->length)
+	{
+		__kn_usb_async_fail(req, txfer, KP_USB_RET_ERR);
+	}
+	else if (txfer->buffer != (unsigned char *)&req->zlp_buf)
+	{
+		req->actual_length += txfer->actual_length;
+
+		// the (fake) ZLP starts moving after the last chunk
+		if (req->actual_length == req->length)
+			req->zlp_begin_ns = kp_trace_begin();
+	}
+	else
+	{
+		kp_trace_end(KP_TRACE_STAGE_ZLP, req->zlp_begin_ns, txfer->actual_length);
+	}
+
+	bool done = (--req->num_inflight == 0);
+
+	pthread_mutex_unlock(&req->mutex);
+
+	if (done)
+		__kn_usb_async_done(req);
+}
+
+static void LIBUSB_CALL __kn_usb_async_in_cb(struct libusb_transfer *txfer)
+{
+	kp_usb_async_request_t *req = (kp_usb_async_request_t *)txfer->user_data;
+	int status = __kn_usb_transfer_status(txfer->status);
+
+	pthread_mutex_lock(&req->mutex);
+
+	if (status != KP_USB_RET_OK)
+	{
+		dbg_print("[%s] [kp_usb] async recv failed error: %d\n", __func__, status);
+		req->status = status;
+	}
+	else if (req->zlp_stage)
+	{
+		kp_trace_end(KP_TRACE_STAGE_ZLP, req->zlp_begin_ns, 0);
+
+		if (txfer->actual_length != 0)
+		{
+			dbg_print("[%s] [kp_usb] error, should be ZLP !!\n", __func__);
+			req->status = KP_USB_RET_ERR;
+		}
+	}
+	else
+	{
+		req->actual_length += txfer->actual_length;
+
+		if (txfer->actual_length == txfer->length && req->actual_length < req->length)
+		{
+			// chunk is full, queue the next one right away from the event thread
+			txfer->buffer = req->buf + req->actual_length;
+			txfer->length = MIN(req->length - req->actual_length, MAX_TXFER_SIZE);
+			status = libusb_submit_transfer(txfer);
+
+			if (status == LIBUSB_SUCCESS)
+			{
+				pthread_mutex_unlock(&req->mutex);
+				return;
+			}
+
+			req->status = status;
+		}
+		else if (req->actual_length == req->length && (req->actual_length & (req->max_psize - 1)) == 0)
+		{
+			// try to receive zlp
+			req->zlp_stage = true;
+			txfer->buffer = (unsigned char *)&req->zlp_buf;
+			txfer->length = sizeof(req->zlp_buf);
+			txfer->timeout = 5;
+			req->zlp_begin_ns = kp_trace_begin();
+			status = libusb_submit_transfer(txfer);
+
+			if (status == LIBUSB_SUCCESS)
+			{
+				pthread_mutex_unlock(&req->mutex);
+				return;
+			}
+
+			req->status = status;
+		}
+	}
+
+	req->num_inflight = 0;
+
+	pthread_mutex_unlock(&req->mutex);
+
+	__kn_usb_async_done(req);
+}
+
+static int __kn_usb_async_alloc_txfer(kp_usb_async_request_t *req, int num_txfer)
+{
+	for (int i = 0; i < num_txfer; i++)
+	{
+		if (NULL == req->txfer[i])
+		{
+			req->txfer[i] = libusb_alloc_transfer(0);
+			if (NULL == req->txfer[i])
+				return KP_USB_USB_NO_MEM;
+		}
+	}
+
+	return KP_USB_RET_OK;
+}
+
+static void *__kn_usb_event_thread(void *arg)
+{
+	kp_usb_event_handler_t *handler = (kp_usb_event_handler_t *)arg;
+
+	while (!handler->stop)
+	{
+		struct timeval tv = {0, 100 * 1000};
+		libusb_handle_events_timeout_completed(NULL, &tv, &handler->stop);
+	}
+
+	return NULL;
+}
+
 static void __increase_usb_refcnt()
 {
 	pthread_mutex_lock(&_g_mutex);
@@ -898,6 +1098,9 @@ int kp_usb_connect_multiple_devices_v2(int num_dev, int port_id[], kp_usb_device
 		dev->endpoint_cmd_in = endpoint_bulk_in;
 		dev->endpoint_cmd_out = endpoint_bulk_out;
 		dev->endpoint_log_in = endpoint_interrupt_in;
+		dev->staging_buf = NULL;
+		dev->staging_buf_size = 0;
+		dev->staging_buf_dev_mem = false;
 
 		get_fw_name_by_fw_serial(dev->dev_descp.firmware, desc.idProduct, dev->fw_serial);
 
@@ -923,6 +1126,7 @@ int kp_usb_connect_multiple_devices_v2(int num_dev, int port_id[], kp_usb_device
 
 		pthread_mutex_init(&dev->mutex_send, NULL);
 		pthread_mutex_init(&dev->mutex_recv, NULL);
+		dev->async_recv_req = NULL;
 
 		output_devs[num_connected++] = dev;
 
@@ -944,9 +1148,54 @@ int kp_usb_connect_multiple_devices_v2(int num_dev, int port_id[], kp_usb_device
 	return ret_code;
 }
 
+static void __kn_usb_free_staging_buf(kp_usb_device_t *dev)
+{
+	if (NULL == dev->staging_buf)
+		return;
+
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+	if (dev->staging_buf_dev_mem)
+		libusb_dev_mem_free(dev->usb_handle, dev->staging_buf, dev->staging_buf_size);
+	else
+#endif
+		free(dev->staging_buf);
+
+	dev->staging_buf = NULL;
+	dev->staging_buf_size = 0;
+	dev->staging_buf_dev_mem = false;
+}
+
+static int __kn_usb_reserve_staging_buf(kp_usb_device_t *dev, int size)
+{
+	if (size <= dev->staging_buf_size)
+		return KP_USB_RET_OK;
+
+	__kn_usb_free_staging_buf(dev);
+
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+	// DMA-able memory of usbfs (Linux only), libusb can submit it without an extra copy in kernel
+	dev->staging_buf = libusb_dev_mem_alloc(dev->usb_handle, size);
+	if (NULL != dev->staging_buf)
+	{
+		dev->staging_buf_size = size;
+		dev->staging_buf_dev_mem = true;
+		return KP_USB_RET_OK;
+	}
+#endif
+
+	dev->staging_buf = (uint8_t *)malloc(size);
+	if (NULL == dev->staging_buf)
+		return KP_USB_USB_NO_MEM;
+
+	dev->staging_buf_size = size;
+
+	return KP_USB_RET_OK;
+}
+
 int kp_usb_disconnect_device(kp_usb_device_t *dev)
 {
 	libusb_device_handle *usbdev = dev->usb_handle;
+	__kn_usb_free_staging_buf(dev);
 	libusb_close(usbdev);
 	__decrease_usb_refcnt();
 
@@ -1019,11 +1268,41 @@ int kp_usb_write_data(kp_usb_device_t *dev, void *buf, int len, int timeout)
 	return ret;
 }
 
+int kp_usb_write_data_with_header(kp_usb_device_t *dev, void *header, int header_len, void *buf, int len, int timeout)
+{
+	return kp_usb_write_data_with_header_trailer(dev, header, header_len, buf, len, NULL, 0, timeout);
+}
+
+int kp_usb_write_data_with_header_trailer(kp_usb_device_t *dev, void *header, int header_len, void *buf, int len, void *trailer, int trailer_len, int timeout)
+{
+	pthread_mutex_lock(&dev->mutex_send);
+
+	int ret = __kn_usb_reserve_staging_buf(dev, header_len + len + trailer_len);
+	if (ret == KP_USB_RET_OK)
+	{
+		memcpy(dev->staging_buf, header, header_len);
+		memcpy(dev->staging_buf + header_len, buf, len);
+		if (0 < trailer_len)
+			memcpy(dev->staging_buf + header_len + len, trailer, trailer_len);
+
+		ret = __kn_usb_bulk_out(dev, dev->endpoint_cmd_out, dev->staging_buf, header_len + len + trailer_len, timeout);
+	}
+
+	pthread_mutex_unlock(&dev->mutex_send);
+
+	return ret;
+}
+
 int kp_usb_read_data(kp_usb_device_t *dev, void *buf, int len, int timeout)
 {
 	int read_len;
 
 	pthread_mutex_lock(&dev->mutex_recv);
+	if (NULL != dev->async_recv_req)
+	{
+		pthread_mutex_unlock(&dev->mutex_recv);
+		return KP_USB_USB_BUSY;
+	}
 	int sts = __kn_usb_bulk_in(dev, dev->endpoint_cmd_in, buf, len, &read_len, timeout);
 	pthread_mutex_unlock(&dev->mutex_recv);
 	//printf("%s, sts = %d, len = %d,  read_len = %d \n ", __func__, sts, len, read_len);
@@ -1049,6 +1328,310 @@ int kp_usb_endpoint_read_data(kp_usb_device_t *dev, int endpoint, void *buf, int
 		return sts;
 }
 
+// *********************************************************************************************** //
+// APIs for asynchronous read/write data
+// *********************************************************************************************** //
+
+void kp_usb_async_request_init(kp_usb_async_request_t *req)
+{
+	memset(req, 0, sizeof(kp_usb_async_request_t));
+	pthread_mutex_init(&req->mutex, NULL);
+	req->completed = 1;
+}
+
+void kp_usb_async_request_release(kp_usb_async_request_t *req)
+{
+	for (int i = 0; i <= KP_USB_ASYNC_MAX_TXFER; i++)
+	{
+		if (NULL != req->txfer[i])
+		{
+			libusb_free_transfer(req->txfer[i]);
+			req->txfer[i] = NULL;
+		}
+	}
+
+	pthread_mutex_destroy(&req->mutex);
+}
+
+int kp_usb_async_submit_write(kp_usb_device_t *dev, kp_usb_async_request_t *req, void *buf, int len, int timeout)
+{
+	int num_chunk = (len + MAX_TXFER_SIZE - 1) / MAX_TXFER_SIZE;
+	int max_psize = (dev->dev_descp.link_speed <= KP_USB_SPEED_HIGH) ? 512 : 1024;
+	bool need_zlp = ((len % max_psize) == 0);
+	int num_txfer = num_chunk + (need_zlp ? 1 : 0);
+
+	if (num_chunk > KP_USB_ASYNC_MAX_TXFER)
+	{
+		// too many chunks for the transfer slots (ex. a 4096x2160 RGBA8888 image), send it synchronously after the queued writes
+		req->dev = dev;
+		req->is_out = true;
+		req->buf = (uint8_t *)buf;
+		req->length = len;
+		req->num_submitted = 0;
+		req->num_inflight = 0;
+		req->status = kp_usb_write_data(dev, buf, len, timeout);
+		req->actual_length = (req->status == KP_USB_RET_OK) ? len : 0;
+		req->completed = 0;
+
+		__kn_usb_async_done(req);
+
+		return KP_USB_RET_OK;
+	}
+
+	int ret = __kn_usb_async_alloc_txfer(req, num_txfer);
+	if (ret != KP_USB_RET_OK)
+		return ret;
+
+	req->dev = dev;
+	req->is_out = true;
+	req->buf = (uint8_t *)buf;
+	req->length = len;
+	req->actual_length = 0;
+	req->max_psize = max_psize;
+	req->num_submitted = 0;
+	req->num_inflight = num_txfer;
+	req->status = KP_USB_RET_OK;
+	req->zlp_stage = false;
+	req->zlp_begin_ns = 0;
+	req->completed = 0;
+
+	for (int i = 0; i < num_chunk; i++)
+	{
+		int offset = i * MAX_TXFER_SIZE;
+		libusb_fill_bulk_transfer(req->txfer[i], dev->usb_handle, dev->endpoint_cmd_out, req->buf + offset,
+								  MIN(len - offset, MAX_TXFER_SIZE), __kn_usb_async_out_cb, req, timeout);
+	}
+
+	if (need_zlp)
+	{
+		int zlp_len = 0;
+
+		if (__kn_usb_need_fake_zlp(dev))
+		{
+			// use fake ZLP as workaround
+			req->zlp_buf = 0x11223344;
+			zlp_len = 4;
+		}
+
+		libusb_fill_bulk_transfer(req->txfer[num_chunk], dev->usb_handle, dev->endpoint_cmd_out, (unsigned char *)&req->zlp_buf,
+								  zlp_len, __kn_usb_async_out_cb, req, timeout);
+	}
+
+	// all chunks of one request are queued together so that they are not interleaved with other writes
+	pthread_mutex_lock(&dev->mutex_send);
+	pthread_mutex_lock(&req->mutex);
+
+	for (int i = 0; i < num_txfer; i++)
+	{
+		ret = libusb_submit_transfer(req->txfer[i]);
+		if (ret != LIBUSB_SUCCESS)
+		{
+			dbg_print("[%s] [kp_usb] submit transfer failed error: %d\n", __func__, ret);
+			// not submitted transfers never call back
+			req->num_inflight -= (num_txfer - i);
+			__kn_usb_async_fail(req, NULL, ret);
+			break;
+		}
+
+		req->num_submitted++;
+	}
+
+	if (req->num_inflight == 0)
+		req->completed = 1;
+
+	pthread_mutex_unlock(&req->mutex);
+	pthread_mutex_unlock(&dev->mutex_send);
+
+	// when it failed partially, the caller still has to call kp_usb_async_complete() for the submitted ones
+	return (req->num_submitted == 0) ? ret : KP_USB_RET_OK;
+}
+
+int kp_usb_async_submit_read(kp_usb_device_t *dev, kp_usb_async_request_t *req, void *buf, int len, int timeout)
+{
+	int ret = __kn_usb_async_alloc_txfer(req, 1);
+	if (ret != KP_USB_RET_OK)
+		return ret;
+
+	pthread_mutex_lock(&dev->mutex_recv);
+
+	// read chunks must be queued one by one as a short packet ends the transfer
+	if (NULL != dev->async_recv_req)
+	{
+		pthread_mutex_unlock(&dev->mutex_recv);
+		return KP_USB_USB_BUSY;
+	}
+
+	req->dev = dev;
+	req->is_out = false;
+	req->buf = (uint8_t *)buf;
+	req->length = len;
+	req->actual_length = 0;
+	req->max_psize = (dev->dev_descp.link_speed <= KP_USB_SPEED_HIGH) ? 512 : 1024;
+	req->num_submitted = 1;
+	req->num_inflight = 1;
+	req->status = KP_USB_RET_OK;
+	req->zlp_stage = false;
+	req->zlp_begin_ns = 0;
+	req->completed = 0;
+
+	libusb_fill_bulk_transfer(req->txfer[0], dev->usb_handle, dev->endpoint_cmd_in, req->buf,
+							  MIN(len, MAX_TXFER_SIZE), __kn_usb_async_in_cb, req, timeout);
+
+	ret = libusb_submit_transfer(req->txfer[0]);
+	if (ret != LIBUSB_SUCCESS)
+	{
+		dbg_print("[%s] [kp_usb] submit transfer failed error: %d\n", __func__, ret);
+		req->num_submitted = 0;
+		req->num_inflight = 0;
+		req->completed = 1;
+	}
+	else
+	{
+		dev->async_recv_req = req;
+	}
+
+	pthread_mutex_unlock(&dev->mutex_recv);
+
+	return ret;
+}
+
+int kp_usb_async_complete(kp_usb_async_request_t *req, int *actual_length)
+{
+	// this drives libusb events by itself or waits for the event handler thread
+	while (!req->completed)
+		libusb_handle_events_completed(NULL, &req->completed);
+
+	if (!req->is_out && NULL != req->dev)
+	{
+		pthread_mutex_lock(&req->dev->mutex_recv);
+		if (req->dev->async_recv_req == req)
+			req->dev->async_recv_req = NULL;
+		pthread_mutex_unlock(&req->dev->mutex_recv);
+	}
+
+	if (actual_length)
+		*actual_length = req->actual_length;
+
+	return req->status;
+}
+
+void kp_usb_async_cancel(kp_usb_async_request_t *req)
+{
+	pthread_mutex_lock(&req->mutex);
+
+	if (!req->completed)
+	{
+		for (int i = 0; i < req->num_submitted; i++)
+			libusb_cancel_transfer(req->txfer[i]);
+	}
+
+	pthread_mutex_unlock(&req->mutex);
+}
+
+int kp_usb_async_wait_any(kp_usb_async_notify_t *notify, kp_usb_async_request_t *reqs[], int num_req, int timeout)
+{
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	if (notify)
+		pthread_mutex_lock(&notify->mutex);
+
+	int index = KP_USB_USB_TIMEOUT;
+
+	while (1)
+	{
+		for (int i = 0; i < num_req; i++)
+		{
+			if (NULL != reqs[i] && reqs[i]->completed)
+			{
+				index = i;
+				break;
+			}
+		}
+
+		if (index >= 0)
+			break;
+
+		if (notify)
+		{
+			if (timeout > 0)
+			{
+				if (ETIMEDOUT == pthread_cond_timedwait(&notify->cond, &notify->mutex, &deadline))
+					timeout = -1; // check requests for the last time
+			}
+			else if (timeout == 0)
+			{
+				pthread_cond_wait(&notify->cond, &notify->mutex);
+			}
+			else
+			{
+				break;
+			}
+		}
+		else
+		{
+			if (timeout < 0)
+				break;
+
+			// callbacks are called in this thread
+			struct timeval tv = {0, 100 * 1000};
+			libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+
+			if (timeout > 0)
+			{
+				struct timespec now;
+				clock_gettime(CLOCK_REALTIME, &now);
+
+				if (now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec))
+					timeout = -1; // check requests for the last time
+			}
+		}
+	}
+
+	if (notify)
+		pthread_mutex_unlock(&notify->mutex);
+
+	return index;
+}
+
+int kp_usb_event_handler_start(kp_usb_event_handler_t *handler)
+{
+	handler->stop = 0;
+	handler->running = false;
+
+	if (0 != pthread_create(&handler->thread, NULL, __kn_usb_event_thread, (void *)handler))
+	{
+		dbg_print("[%s] [kp_usb] create event handler thread failed\n", __func__);
+		return KP_USB_RET_ERR;
+	}
+
+	handler->running = true;
+
+	return KP_USB_RET_OK;
+}
+
+void kp_usb_event_handler_stop(kp_usb_event_handler_t *handler)
+{
+	if (!handler->running)
+		return;
+
+	handler->stop = 1;
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+	libusb_interrupt_event_handler(NULL);
+#endif
+	pthread_join(handler->thread, NULL);
+
+	handler->running = false;
+}
+
 // *********************************************************************************************** //
 // APIs for standard read/write in command mode
 // *********************************************************************************************** //
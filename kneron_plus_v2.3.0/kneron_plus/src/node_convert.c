@@ -0,0 +1,403 @@
+/**
+ * @file        node_convert.c
+ * @brief       fixed-point to floating-point conversion kernels for output nodes
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "node_convert.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define NODE_CONVERT_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+// NEON of 32-bit ARM has no division, it runs the C kernels
+#define NODE_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+typedef void (*cvt_s8_func_t)(float *dst, const int8_t *src, int num, float factor);
+typedef void (*cvt_s16_func_t)(float *dst, const int16_t *src, int num, float factor);
+typedef void (*cvt_s8_t_func_t)(float *dst, int dst_stride, const int8_t *src, int src_stride, int rows, int cols, float factor);
+typedef void (*cvt_s16_t_func_t)(float *dst, int dst_stride, const int16_t *src, int src_stride, int rows, int cols, float factor);
+
+static pthread_once_t _kernel_once = PTHREAD_ONCE_INIT;
+static cvt_s8_func_t _cvt_s8 = NULL;
+static cvt_s16_func_t _cvt_s16 = NULL;
+static cvt_s8_t_func_t _cvt_s8_t = NULL;
+static cvt_s16_t_func_t _cvt_s16_t = NULL;
+
+/******************************************************************
+ * C kernels
+ ******************************************************************/
+
+static void cvt_s8_c(float *dst, const int8_t *src, int num, float factor)
+{
+    for (int i = 0; i < num; i++)
+        dst[i] = (float)src[i] / factor;
+}
+
+static void cvt_s16_c(float *dst, const int16_t *src, int num, float factor)
+{
+    for (int i = 0; i < num; i++)
+        dst[i] = (float)src[i] / factor;
+}
+
+static void cvt_s8_t_c(float *dst, int dst_stride, const int8_t *src, int src_stride, int rows, int cols, float factor)
+{
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+            dst[j * dst_stride + i] = (float)src[i * src_stride + j] / factor;
+    }
+}
+
+static void cvt_s16_t_c(float *dst, int dst_stride, const int16_t *src, int src_stride, int rows, int cols, float factor)
+{
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+            dst[j * dst_stride + i] = (float)src[i * src_stride + j] / factor;
+    }
+}
+
+#if defined(NODE_CONVERT_X86)
+
+/******************************************************************
+ * SSE2 kernels
+ ******************************************************************/
+
+static inline __m128 sse2_load4_s8(const int8_t *src)
+{
+    int32_t v;
+    memcpy(&v, src, sizeof(v));
+
+    __m128i x = _mm_cvtsi32_si128(v);
+    x = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+    x = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+
+    return _mm_cvtepi32_ps(x);
+}
+
+static inline __m128 sse2_load4_s16(const int16_t *src)
+{
+    __m128i x = _mm_loadl_epi64((const __m128i *)src);
+    x = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+
+    return _mm_cvtepi32_ps(x);
+}
+
+static void cvt_s8_sse2(float *dst, const int8_t *src, int num, float factor)
+{
+    __m128 vfactor = _mm_set1_ps(factor);
+    int i = 0;
+
+    for (; i + 16 <= num; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+        __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+
+        _mm_storeu_ps(dst + i + 0, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)), vfactor));
+        _mm_storeu_ps(dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)), vfactor));
+        _mm_storeu_ps(dst + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)), vfactor));
+        _mm_storeu_ps(dst + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)), vfactor));
+    }
+
+    cvt_s8_c(dst + i, src + i, num - i, factor);
+}
+
+static void cvt_s16_sse2(float *dst, const int16_t *src, int num, float factor)
+{
+    __m128 vfactor = _mm_set1_ps(factor);
+    int i = 0;
+
+    for (; i + 8 <= num; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+
+        _mm_storeu_ps(dst + i + 0, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)), vfactor));
+        _mm_storeu_ps(dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)), vfactor));
+    }
+
+    cvt_s16_c(dst + i, src + i, num - i, factor);
+}
+
+static void cvt_s8_t_sse2(float *dst, int dst_stride, const int8_t *src, int src_stride, int rows, int cols, float factor)
+{
+    __m128 vfactor = _mm_set1_ps(factor);
+    int i = 0;
+
+    for (; i + 4 <= rows; i += 4)
+    {
+        const int8_t *s = src + i * src_stride;
+        int j = 0;
+
+        for (; j + 4 <= cols; j += 4)
+        {
+            __m128 r0 = _mm_div_ps(sse2_load4_s8(s + j), vfactor);
+            __m128 r1 = _mm_div_ps(sse2_load4_s8(s + src_stride + j), vfactor);
+            __m128 r2 = _mm_div_ps(sse2_load4_s8(s + 2 * src_stride + j), vfactor);
+            __m128 r3 = _mm_div_ps(sse2_load4_s8(s + 3 * src_stride + j), vfactor);
+
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+            float *d = dst + j * dst_stride + i;
+            _mm_storeu_ps(d, r0);
+            _mm_storeu_ps(d + dst_stride, r1);
+            _mm_storeu_ps(d + 2 * dst_stride, r2);
+            _mm_storeu_ps(d + 3 * dst_stride, r3);
+        }
+
+        cvt_s8_t_c(dst + j * dst_stride + i, dst_stride, s + j, src_stride, 4, cols - j, factor);
+    }
+
+    cvt_s8_t_c(dst + i, dst_stride, src + i * src_stride, src_stride, rows - i, cols, factor);
+}
+
+static void cvt_s16_t_sse2(float *dst, int dst_stride, const int16_t *src, int src_stride, int rows, int cols, float factor)
+{
+    __m128 vfactor = _mm_set1_ps(factor);
+    int i = 0;
+
+    for (; i + 4 <= rows; i += 4)
+    {
+        const int16_t *s = src + i * src_stride;
+        int j = 0;
+
+        for (; j + 4 <= cols; j += 4)
+        {
+            __m128 r0 = _mm_div_ps(sse2_load4_s16(s + j), vfactor);
+            __m128 r1 = _mm_div_ps(sse2_load4_s16(s + src_stride + j), vfactor);
+            __m128 r2 = _mm_div_ps(sse2_load4_s16(s + 2 * src_stride + j), vfactor);
+            __m128 r3 = _mm_div_ps(sse2_load4_s16(s + 3 * src_stride + j), vfactor);
+
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+            float *d = dst + j * dst_stride + i;
+            _mm_storeu_ps(d, r0);
+            _mm_storeu_ps(d + dst_stride, r1);
+            _mm_storeu_ps(d + 2 * dst_stride, r2);
+            _mm_storeu_ps(d + 3 * dst_stride, r3);
+        }
+
+        cvt_s16_t_c(dst + j * dst_stride + i, dst_stride, s + j, src_stride, 4, cols - j, factor);
+    }
+
+    cvt_s16_t_c(dst + i, dst_stride, src + i * src_stride, src_stride, rows - i, cols, factor);
+}
+
+/******************************************************************
+ * AVX2 kernels (transpose kernels stay on SSE2, they are bound by the strided stores)
+ ******************************************************************/
+
+__attribute__((target("avx2"))) static void cvt_s8_avx2(float *dst, const int8_t *src, int num, float factor)
+{
+    __m256 vfactor = _mm256_set1_ps(factor);
+    int i = 0;
+
+    for (; i + 16 <= num; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+
+        _mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(x)), vfactor));
+        _mm256_storeu_ps(dst + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(x, 8))), vfactor));
+    }
+
+    cvt_s8_c(dst + i, src + i, num - i, factor);
+}
+
+__attribute__((target("avx2"))) static void cvt_s16_avx2(float *dst, const int16_t *src, int num, float factor)
+{
+    __m256 vfactor = _mm256_set1_ps(factor);
+    int i = 0;
+
+    for (; i + 8 <= num; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+
+        _mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(x)), vfactor));
+    }
+
+    cvt_s16_c(dst + i, src + i, num - i, factor);
+}
+
+#elif defined(NODE_CONVERT_NEON)
+
+/******************************************************************
+ * NEON kernels
+ ******************************************************************/
+
+static inline float32x4_t neon_load4_s8(const int8_t *src)
+{
+    int32_t v;
+    memcpy(&v, src, sizeof(v));
+
+    int16x8_t x = vmovl_s8(vreinterpret_s8_s32(vdup_n_s32(v)));
+
+    return vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+}
+
+static inline float32x4_t neon_load4_s16(const int16_t *src)
+{
+    return vcvtq_f32_s32(vmovl_s16(vld1_s16(src)));
+}
+
+static inline void neon_store_transpose4(float *dst, int dst_stride, float32x4_t r0, float32x4_t r1, float32x4_t r2, float32x4_t r3)
+{
+    float32x4x2_t t01 = vtrnq_f32(r0, r1);
+    float32x4x2_t t23 = vtrnq_f32(r2, r3);
+
+    vst1q_f32(dst, vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0])));
+    vst1q_f32(dst + dst_stride, vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1])));
+    vst1q_f32(dst + 2 * dst_stride, vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0])));
+    vst1q_f32(dst + 3 * dst_stride, vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1])));
+}
+
+static void cvt_s8_neon(float *dst, const int8_t *src, int num, float factor)
+{
+    float32x4_t vfactor = vdupq_n_f32(factor);
+    int i = 0;
+
+    for (; i + 16 <= num; i += 16)
+    {
+        int8x16_t x = vld1q_s8(src + i);
+        int16x8_t lo = vmovl_s8(vget_low_s8(x));
+        int16x8_t hi = vmovl_s8(vget_high_s8(x));
+
+        vst1q_f32(dst + i + 0, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo))), vfactor));
+        vst1q_f32(dst + i + 4, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo))), vfactor));
+        vst1q_f32(dst + i + 8, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi))), vfactor));
+        vst1q_f32(dst + i + 12, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi))), vfactor));
+    }
+
+    cvt_s8_c(dst + i, src + i, num - i, factor);
+}
+
+static void cvt_s16_neon(float *dst, const int16_t *src, int num, float factor)
+{
+    float32x4_t vfactor = vdupq_n_f32(factor);
+    int i = 0;
+
+    for (; i + 8 <= num; i += 8)
+    {
+        int16x8_t x = vld1q_s16(src + i);
+
+        vst1q_f32(dst + i + 0, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), vfactor));
+        vst1q_f32(dst + i + 4, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), vfactor));
+    }
+
+    cvt_s16_c(dst + i, src + i, num - i, factor);
+}
+
+static void cvt_s8_t_neon(float *dst, int dst_stride, const int8_t *src, int src_stride, int rows, int cols, float factor)
+{
+    float32x4_t vfactor = vdupq_n_f32(factor);
+    int i = 0;
+
+    for (; i + 4 <= rows; i += 4)
+    {
+        const int8_t *s = src + i * src_stride;
+        int j = 0;
+
+        for (; j + 4 <= cols; j += 4)
+        {
+            neon_store_transpose4(dst + j * dst_stride + i, dst_stride,
+                                  vdivq_f32(neon_load4_s8(s + j), vfactor),
+                                  vdivq_f32(neon_load4_s8(s + src_stride + j), vfactor),
+                                  vdivq_f32(neon_load4_s8(s + 2 * src_stride + j), vfactor),
+                                  vdivq_f32(neon_load4_s8(s + 3 * src_stride + j), vfactor));
+        }
+
+        cvt_s8_t_c(dst + j * dst_stride + i, dst_stride, s + j, src_stride, 4, cols - j, factor);
+    }
+
+    cvt_s8_t_c(dst + i, dst_stride, src + i * src_stride, src_stride, rows - i, cols, factor);
+}
+
+static void cvt_s16_t_neon(float *dst, int dst_stride, const int16_t *src, int src_stride, int rows, int cols, float factor)
+{
+    float32x4_t vfactor = vdupq_n_f32(factor);
+    int i = 0;
+
+    for (; i + 4 <= rows; i += 4)
+    {
+        const int16_t *s = src + i * src_stride;
+        int j = 0;
+
+        for (; j + 4 <= cols; j += 4)
+        {
+            neon_store_transpose4(dst + j * dst_stride + i, dst_stride,
+                                  vdivq_f32(neon_load4_s16(s + j), vfactor),
+                                  vdivq_f32(neon_load4_s16(s + src_stride + j), vfactor),
+                                  vdivq_f32(neon_load4_s16(s + 2 * src_stride + j), vfactor),
+                                  vdivq_f32(neon_load4_s16(s + 3 * src_stride + j), vfactor));
+        }
+
+        cvt_s16_t_c(dst + j * dst_stride + i, dst_stride, s + j, src_stride, 4, cols - j, factor);
+    }
+
+    cvt_s16_t_c(dst + i, dst_stride, src + i * src_stride, src_stride, rows - i, cols, factor);
+}
+
+#endif
+
+/******************************************************************
+ * kernel selection
+ ******************************************************************/
+
+static void select_kernels(void)
+{
+    _cvt_s8 = cvt_s8_c;
+    _cvt_s16 = cvt_s16_c;
+    _cvt_s8_t = cvt_s8_t_c;
+    _cvt_s16_t = cvt_s16_t_c;
+
+#if defined(NODE_CONVERT_X86)
+    _cvt_s8 = cvt_s8_sse2;
+    _cvt_s16 = cvt_s16_sse2;
+    _cvt_s8_t = cvt_s8_t_sse2;
+    _cvt_s16_t = cvt_s16_t_sse2;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        _cvt_s8 = cvt_s8_avx2;
+        _cvt_s16 = cvt_s16_avx2;
+    }
+#elif defined(NODE_CONVERT_NEON)
+    _cvt_s8 = cvt_s8_neon;
+    _cvt_s16 = cvt_s16_neon;
+    _cvt_s8_t = cvt_s8_t_neon;
+    _cvt_s16_t = cvt_s16_t_neon;
+#endif
+}
+
+void node_convert_s8_to_float(float *dst, const int8_t *src, int num, float factor)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _cvt_s8(dst, src, num, factor);
+}
+
+void node_convert_s16_to_float(float *dst, const int16_t *src, int num, float factor)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _cvt_s16(dst, src, num, factor);
+}
+
+void node_convert_s8_to_float_transpose(float *dst, int dst_stride, const int8_t *src, int src_stride, int rows, int cols, float factor)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _cvt_s8_t(dst, dst_stride, src, src_stride, rows, cols, factor);
+}
+
+void node_convert_s16_to_float_transpose(float *dst, int dst_stride, const int16_t *src, int src_stride, int rows, int cols, float factor)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _cvt_s16_t(dst, dst_stride, src, src_stride, rows, cols, factor);
+}
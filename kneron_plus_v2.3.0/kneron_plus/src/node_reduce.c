@@ -0,0 +1,861 @@
+/**
+ * @file        node_reduce.c
+ * @brief       fixed-point argmax, top-k and threshold kernels on raw output nodes in NPU data layout
+ * @version     0.1
+ * @date        2024-06-12
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "node_reduce.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define NODE_REDUCE_X86
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define NODE_REDUCE_NEON
+#include <arm_neon.h>
+#endif
+
+#define KDP_COL_MIN_8       8
+#define KDP_COL_MIN_16      16
+#define KDP_CHANNEL_MIN_16  16
+#define REDUCE_CHUNK        1024    // values per kernel call, a multiple of KDP_CHANNEL_MIN_16
+
+typedef int (*find_ge_s8_func_t)(uint32_t *index, const int8_t *src, int num, int q);
+typedef int (*find_ge_s16_func_t)(uint32_t *index, const int16_t *src, int num, int q);
+typedef void (*argmax_s8_func_t)(int16_t *max, uint16_t *idx, const int8_t *src, int num, uint16_t channel);
+typedef void (*argmax_s16_func_t)(int16_t *max, uint16_t *idx, const int16_t *src, int num, uint16_t channel);
+typedef void (*argmax_lanes_s8_func_t)(int16_t *max, uint16_t *idx, const int8_t *src, int num, int lanes, uint16_t channel);
+
+static pthread_once_t _kernel_once = PTHREAD_ONCE_INIT;
+static find_ge_s8_func_t _find_ge_s8 = NULL;
+static find_ge_s16_func_t _find_ge_s16 = NULL;
+static argmax_s8_func_t _argmax_s8 = NULL;
+static argmax_s16_func_t _argmax_s16 = NULL;
+static argmax_lanes_s8_func_t _argmax_lanes_s8 = NULL;
+
+/******************************************************************
+ * C kernels
+ ******************************************************************/
+
+// index[n++] = i for src[i] >= q, returns n
+static int find_ge_s8_c(uint32_t *index, const int8_t *src, int num, int q)
+{
+    int n = 0;
+
+    for (int i = 0; i < num; i++)
+    {
+        if (src[i] >= q)
+            index[n++] = i;
+    }
+
+    return n;
+}
+
+static int find_ge_s16_c(uint32_t *index, const int16_t *src, int num, int q)
+{
+    int n = 0;
+
+    for (int i = 0; i < num; i++)
+    {
+        if (src[i] >= q)
+            index[n++] = i;
+    }
+
+    return n;
+}
+
+// max[i] = src[i], idx[i] = channel for src[i] > max[i]
+static void argmax_s8_c(int16_t *max, uint16_t *idx, const int8_t *src, int num, uint16_t channel)
+{
+    for (int i = 0; i < num; i++)
+    {
+        if (src[i] > max[i])
+        {
+            max[i] = src[i];
+            idx[i] = channel;
+        }
+    }
+}
+
+static void argmax_s16_c(int16_t *max, uint16_t *idx, const int16_t *src, int num, uint16_t channel)
+{
+    for (int i = 0; i < num; i++)
+    {
+        if (src[i] > max[i])
+        {
+            max[i] = src[i];
+            idx[i] = channel;
+        }
+    }
+}
+
+// the same as argmax_s8_c() over the first 'lanes' values of src[i * 16], idx[i] = channel + lane
+static void argmax_lanes_s8_c(int16_t *max, uint16_t *idx, const int8_t *src, int num, int lanes, uint16_t channel)
+{
+    for (int i = 0; i < num; i++)
+    {
+        const int8_t *s = src + i * KDP_CHANNEL_MIN_16;
+
+        for (int j = 0; j < lanes; j++)
+        {
+            if (s[j] > max[i])
+            {
+                max[i] = s[j];
+                idx[i] = channel + j;
+            }
+        }
+    }
+}
+
+#if defined(NODE_REDUCE_X86)
+
+/******************************************************************
+ * SSE2 kernels
+ ******************************************************************/
+
+static int find_ge_s8_sse2(uint32_t *index, const int8_t *src, int num, int q)
+{
+    if (INT8_MIN >= q)
+        return find_ge_s8_c(index, src, num, q);
+
+    __m128i vq = _mm_set1_epi8((char)(q - 1));
+    int n = 0;
+    int i = 0;
+
+    for (; i + 16 <= num; i += 16)
+    {
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_loadu_si128((const __m128i *)(src + i)), vq));
+
+        for (; 0 != mask; mask &= mask - 1)
+            index[n++] = i + __builtin_ctz(mask);
+    }
+
+    for (; i < num; i++)
+    {
+        if (src[i] >= q)
+            index[n++] = i;
+    }
+
+    return n;
+}
+
+static int find_ge_s16_sse2(uint32_t *index, const int16_t *src, int num, int q)
+{
+    if (INT16_MIN >= q)
+        return find_ge_s16_c(index, src, num, q);
+
+    __m128i vq = _mm_set1_epi16((short)(q - 1));
+    int n = 0;
+    int i = 0;
+
+    for (; i + 16 <= num; i += 16)
+    {
+        __m128i lo = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *)(src + i)), vq);
+        __m128i hi = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *)(src + i + 8)), vq);
+        unsigned int mask = _mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+
+        for (; 0 != mask; mask &= mask - 1)
+            index[n++] = i + __builtin_ctz(mask);
+    }
+
+    for (; i < num; i++)
+    {
+        if (src[i] >= q)
+            index[n++] = i;
+    }
+
+    return n;
+}
+
+static inline void sse2_argmax8(int16_t *max, uint16_t *idx, __m128i x, __m128i vch)
+{
+    __m128i m = _mm_loadu_si128((const __m128i *)max);
+    __m128i id = _mm_loadu_si128((const __m128i *)idx);
+    __m128i gt = _mm_cmpgt_epi16(x, m);
+
+    _mm_storeu_si128((__m128i *)max, _mm_max_epi16(x, m));
+    _mm_storeu_si128((__m128i *)idx, _mm_or_si128(_mm_and_si128(gt, vch), _mm_andnot_si128(gt, id)));
+}
+
+static void argmax_s8_sse2(int16_t *max, uint16_t *idx, const int8_t *src, int num, uint16_t channel)
+{
+    __m128i vch = _mm_set1_epi16((short)channel);
+    int i = 0;
+
+    for (; i + 16 <= num; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+
+        sse2_argmax8(max + i, idx + i, _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8), vch);
+        sse2_argmax8(max + i + 8, idx + i + 8, _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8), vch);
+    }
+
+    argmax_s8_c(max + i, idx + i, src + i, num - i, channel);
+}
+
+static void argmax_s16_sse2(int16_t *max, uint16_t *idx, const int16_t *src, int num, uint16_t channel)
+{
+    __m128i vch = _mm_set1_epi16((short)channel);
+    int i = 0;
+
+    for (; i + 8 <= num; i += 8)
+        sse2_argmax8(max + i, idx + i, _mm_loadu_si128((const __m128i *)(src + i)), vch);
+
+    argmax_s16_c(max + i, idx + i, src + i, num - i, channel);
+}
+
+static void argmax_lanes_s8_sse2(int16_t *max, uint16_t *idx, const int8_t *src, int num, int lanes, uint16_t channel)
+{
+    // SSE2 has only the unsigned byte maximum, values are biased by 128 to keep their order and invalid lanes are set to the minimum
+    __m128i bias = _mm_set1_epi8((char)0x80);
+    __m128i valid = _mm_cmpgt_epi8(_mm_set1_epi8((char)lanes), _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+
+    for (int i = 0; i < num; i++)
+    {
+        __m128i x = _mm_and_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i * KDP_CHANNEL_MIN_16)), bias), valid);
+        __m128i m = _mm_max_epu8(x, _mm_srli_si128(x, 8));
+        m = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+        m = _mm_max_epu8(m, _mm_srli_si128(m, 2));
+        m = _mm_max_epu8(m, _mm_srli_si128(m, 1));
+
+        int biased = _mm_cvtsi128_si32(m) & 0xff;
+
+        if (biased - 128 > max[i])
+        {
+            unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8((char)biased)));
+
+            max[i] = biased - 128;
+            idx[i] = channel + __builtin_ctz(mask);
+        }
+    }
+}
+
+#elif defined(NODE_REDUCE_NEON)
+
+/******************************************************************
+ * NEON kernels
+ ******************************************************************/
+
+static int find_ge_s8_neon(uint32_t *index, const int8_t *src, int num, int q)
+{
+    int8x16_t vq = vdupq_n_s8((int8_t)q);
+    int n = 0;
+    int i = 0;
+
+    for (; i + 16 <= num; i += 16)
+    {
+        // one nibble per value
+        uint8x16_t ge = vcgeq_s8(vld1q_s8(src + i), vq);
+        uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(ge), 4)), 0);
+
+        while (0 != bits)
+        {
+            int j = __builtin_ctzll(bits) >> 2;
+            index[n++] = i + j;
+            bits &= ~(0xfULL << (j * 4));
+        }
+    }
+
+    for (; i < num; i++)
+    {
+        if (src[i] >= q)
+            index[n++] = i;
+    }
+
+    return n;
+}
+
+static int find_ge_s16_neon(uint32_t *index, const int16_t *src, int num, int q)
+{
+    int16x8_t vq = vdupq_n_s16((int16_t)q);
+    int n = 0;
+    int i = 0;
+
+    for (; i + 8 <= num; i += 8)
+    {
+        // one byte per value
+        uint8x8_t ge = vmovn_u16(vcgeq_s16(vld1q_s16(src + i), vq));
+        uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(ge), 0);
+
+        while (0 != bits)
+        {
+            int j = __builtin_ctzll(bits) >> 3;
+            index[n++] = i + j;
+            bits &= ~(0xffULL << (j * 8));
+        }
+    }
+
+    for (; i < num; i++)
+    {
+        if (src[i] >= q)
+            index[n++] = i;
+    }
+
+    return n;
+}
+
+static inline void neon_argmax8(int16_t *max, uint16_t *idx, int16x8_t x, uint16x8_t vch)
+{
+    int16x8_t m = vld1q_s16(max);
+    uint16x8_t gt = vcgtq_s16(x, m);
+
+    vst1q_s16(max, vmaxq_s16(x, m));
+    vst1q_u16(idx, vbslq_u16(gt, vch, vld1q_u16(idx)));
+}
+
+static void argmax_s8_neon(int16_t *max, uint16_t *idx, const int8_t *src, int num, uint16_t channel)
+{
+    uint16x8_t vch = vdupq_n_u16(channel);
+    int i = 0;
+
+    for (; i + 16 <= num; i += 16)
+    {
+        int8x16_t x = vld1q_s8(src + i);
+
+        neon_argmax8(max + i, idx + i, vmovl_s8(vget_low_s8(x)), vch);
+        neon_argmax8(max + i + 8, idx + i + 8, vmovl_s8(vget_high_s8(x)), vch);
+    }
+
+    argmax_s8_c(max + i, idx + i, src + i, num - i, channel);
+}
+
+static void argmax_s16_neon(int16_t *max, uint16_t *idx, const int16_t *src, int num, uint16_t channel)
+{
+    uint16x8_t vch = vdupq_n_u16(channel);
+    int i = 0;
+
+    for (; i + 8 <= num; i += 8)
+        neon_argmax8(max + i, idx + i, vld1q_s16(src + i), vch);
+
+    argmax_s16_c(max + i, idx + i, src + i, num - i, channel);
+}
+
+static void argmax_lanes_s8_neon(int16_t *max, uint16_t *idx, const int8_t *src, int num, int lanes, uint16_t channel)
+{
+    // invalid lanes are set to the minimum
+    static const int8_t lane_index[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    uint8x16_t valid = vcltq_s8(vld1q_s8(lane_index), vdupq_n_s8((int8_t)lanes));
+    int8x16_t minimum = vdupq_n_s8(INT8_MIN);
+
+    for (int i = 0; i < num; i++)
+    {
+        const int8_t *s = src + i * KDP_CHANNEL_MIN_16;
+        int8x16_t x = vbslq_s8(valid, vld1q_s8(s), minimum);
+        int8x8_t m = vpmax_s8(vget_low_s8(x), vget_high_s8(x));
+        m = vpmax_s8(m, m);
+        m = vpmax_s8(m, m);
+        m = vpmax_s8(m, m);
+
+        int8_t value = vget_lane_s8(m, 0);
+
+        if (value > max[i])
+        {
+            int j = 0;
+            while (s[j] != value)
+                j++;
+
+            max[i] = value;
+            idx[i] = channel + j;
+        }
+    }
+}
+
+#endif
+
+/******************************************************************
+ * kernel selection
+ ******************************************************************/
+
+static void select_kernels(void)
+{
+    _find_ge_s8 = find_ge_s8_c;
+    _find_ge_s16 = find_ge_s16_c;
+    _argmax_s8 = argmax_s8_c;
+    _argmax_s16 = argmax_s16_c;
+    _argmax_lanes_s8 = argmax_lanes_s8_c;
+
+#if defined(NODE_REDUCE_X86)
+    _find_ge_s8 = find_ge_s8_sse2;
+    _find_ge_s16 = find_ge_s16_sse2;
+    _argmax_s8 = argmax_s8_sse2;
+    _argmax_s16 = argmax_s16_sse2;
+    _argmax_lanes_s8 = argmax_lanes_s8_sse2;
+#elif defined(NODE_REDUCE_NEON)
+    _find_ge_s8 = find_ge_s8_neon;
+    _find_ge_s16 = find_ge_s16_neon;
+    _argmax_s8 = argmax_s8_neon;
+    _argmax_s16 = argmax_s16_neon;
+    _argmax_lanes_s8 = argmax_lanes_s8_neon;
+#endif
+}
+
+/******************************************************************
+ * node layout
+ ******************************************************************/
+
+typedef struct
+{
+    const int8_t *data;
+    bool hcw;
+    bool is_16bit;                          // 8W1C16B
+    bool is_block;                          // 1W16C8B
+    int height;
+    int channel;
+    int width;
+    int row_size;                           // values per row of 16W1C8B/8W1C16B (aligned width), values per channel block of 1W16C8B
+    int num_span;
+} node_layout_t;
+
+/**
+ * A span is a run of contiguous values of the node: a row of (width) values of 16W1C8B/8W1C16B,
+ * or a whole channel block of 1W16C8B, i.e. (height x width) pixels of 16 channel lanes.
+ */
+typedef struct
+{
+    const int8_t *s8;                       // values of the span, int16_t if 16-bit
+    int num;                                // number of values
+    uint32_t channel;                       // channel of the first value
+    uint32_t row;                           // row of a width span
+    int lanes;                              // 0 for a width span, valid channel lanes of a 1W16C8B block
+} span_t;
+
+static void get_layout(const kp_inf_raw_fixed_node_output_t *node, bool hcw, node_layout_t *layout)
+{
+    layout->data = node->data;
+    layout->hcw = hcw;
+    layout->is_16bit = (KP_MODEL_TENSOR_DATA_LAYOUT_8W1C16B == node->metadata.data_layout);
+    layout->is_block = (KP_MODEL_TENSOR_DATA_LAYOUT_1W16C8B == node->metadata.data_layout);
+    layout->height = node->metadata.height;
+    layout->channel = node->metadata.channel;
+    layout->width = node->metadata.width;
+
+    if (layout->is_block)
+    {
+        layout->row_size = layout->height * layout->width * KDP_CHANNEL_MIN_16;
+        layout->num_span = (layout->channel + KDP_CHANNEL_MIN_16 - 1) / KDP_CHANNEL_MIN_16;
+    }
+    else
+    {
+        int align = layout->is_16bit ? KDP_COL_MIN_8 : KDP_COL_MIN_16;
+        layout->row_size = (layout->width + align - 1) / align * align;
+        layout->num_span = layout->height * layout->channel;
+    }
+}
+
+static void get_span(const node_layout_t *layout, int i, span_t *span)
+{
+    span->s8 = layout->data + (size_t)i * layout->row_size * (layout->is_16bit ? 2 : 1);
+
+    if (layout->is_block)
+    {
+        span->num = layout->row_size;
+        span->channel = i * KDP_CHANNEL_MIN_16;
+        span->row = 0;
+        span->lanes = layout->channel - i * KDP_CHANNEL_MIN_16;
+        if (KDP_CHANNEL_MIN_16 < span->lanes)
+            span->lanes = KDP_CHANNEL_MIN_16;
+    }
+    else
+    {
+        span->num = layout->width;
+        span->channel = layout->hcw ? (i % layout->channel) : (i / layout->height);
+        span->row = layout->hcw ? (i / layout->channel) : (i % layout->height);
+        span->lanes = 0;
+    }
+}
+
+static inline int span_value(const node_layout_t *layout, const span_t *span, int o)
+{
+    return layout->is_16bit ? ((const int16_t *)span->s8)[o] : span->s8[o];
+}
+
+static inline bool span_is_valid(const span_t *span, int o)
+{
+    return 0 == span->lanes || (o & (KDP_CHANNEL_MIN_16 - 1)) < span->lanes;
+}
+
+static inline void span_position(const node_layout_t *layout, const span_t *span, int o, kp_inf_node_element_t *element)
+{
+    if (0 == span->lanes)
+    {
+        element->channel = span->channel;
+        element->row = span->row;
+        element->col = o;
+    }
+    else
+    {
+        int pixel = o / KDP_CHANNEL_MIN_16;
+
+        element->channel = span->channel + (o & (KDP_CHANNEL_MIN_16 - 1));
+        element->row = pixel / layout->width;
+        element->col = pixel % layout->width;
+    }
+}
+
+// find values >= q of span values [o, o + num), returns offsets relative to 'o'
+static inline int span_find_ge(const node_layout_t *layout, const span_t *span, int o, int num, int q, uint32_t *index)
+{
+    if (layout->is_16bit)
+        return _find_ge_s16(index, (const int16_t *)span->s8 + o, num, q);
+    else
+        return _find_ge_s8(index, span->s8 + o, num, q);
+}
+
+/******************************************************************
+ * argmax
+ ******************************************************************/
+
+void node_reduce_argmax(const kp_inf_raw_fixed_node_output_t *node, bool hcw, float factor, uint16_t *class_map, float *score_map)
+{
+    pthread_once(&_kernel_once, select_kernels);
+
+    node_layout_t layout;
+    get_layout(node, hcw, &layout);
+
+    int16_t max[REDUCE_CHUNK];
+
+    if (layout.is_block)
+    {
+        // pixels of a channel block are contiguous, blocks are visited in channel order for every chunk of pixels
+        int num_pixel = layout.height * layout.width;
+
+        for (int p = 0; p < num_pixel; p += REDUCE_CHUNK)
+        {
+            int num = (num_pixel - p < REDUCE_CHUNK) ? (num_pixel - p) : REDUCE_CHUNK;
+            uint16_t *idx = class_map + p;
+
+            for (int i = 0; i < num; i++)
+            {
+                max[i] = INT16_MIN;
+                idx[i] = 0;
+            }
+
+            for (int b = 0; b < layout.num_span; b++)
+            {
+                span_t span;
+                get_span(&layout, b, &span);
+                _argmax_lanes_s8(max, idx, span.s8 + p * KDP_CHANNEL_MIN_16, num, span.lanes, span.channel);
+            }
+
+            if (NULL != score_map)
+            {
+                for (int i = 0; i < num; i++)
+                    score_map[p + i] = (float)max[i] / factor;
+            }
+        }
+
+        return;
+    }
+
+    // rows of all channels at the same height are merged chunk by chunk of width
+    int height_step = hcw ? layout.channel : 1;
+    int channel_step = hcw ? 1 : layout.height;
+
+    for (int h = 0; h < layout.height; h++)
+    {
+        for (int w = 0; w < layout.width; w += REDUCE_CHUNK)
+        {
+            int num = (layout.width - w < REDUCE_CHUNK) ? (layout.width - w) : REDUCE_CHUNK;
+            uint16_t *idx = class_map + h * layout.width + w;
+
+            for (int i = 0; i < num; i++)
+            {
+                max[i] = INT16_MIN;
+                idx[i] = 0;
+            }
+
+            for (int c = 0; c < layout.channel; c++)
+            {
+                size_t offset = (size_t)(h * height_step + c * channel_step) * layout.row_size + w;
+
+                if (layout.is_16bit)
+                    _argmax_s16(max, idx, (const int16_t *)layout.data + offset, num, c);
+                else
+                    _argmax_s8(max, idx, layout.data + offset, num, c);
+            }
+
+            if (NULL != score_map)
+            {
+                for (int i = 0; i < num; i++)
+                    score_map[h * layout.width + w + i] = (float)max[i] / factor;
+            }
+        }
+    }
+}
+
+/******************************************************************
+ * threshold
+ ******************************************************************/
+
+// smallest fixed-point value q of which q / factor >= threshold, (hi + 1) if none
+static int quantize_threshold(float threshold, float factor, int lo, int hi)
+{
+    float qf = ceilf(threshold * factor);
+
+    if ((float)hi < qf)
+        return hi + 1;
+
+    if ((float)lo > qf)
+        return lo;
+
+    // multiplication and division may be rounded differently, the result must agree with the dequantized values
+    int q = (int)qf;
+
+    while (q > lo && (float)(q - 1) / factor >= threshold)
+        q--;
+
+    while (q <= hi && (float)q / factor < threshold)
+        q++;
+
+    return q;
+}
+
+uint32_t node_reduce_threshold(const kp_inf_raw_fixed_node_output_t *node, bool hcw, float factor, float threshold,
+                               kp_inf_node_element_t *elements, uint32_t max_element)
+{
+    pthread_once(&_kernel_once, select_kernels);
+
+    node_layout_t layout;
+    get_layout(node, hcw, &layout);
+
+    int hi = layout.is_16bit ? INT16_MAX : INT8_MAX;
+    int q = quantize_threshold(threshold, factor, layout.is_16bit ? INT16_MIN : INT8_MIN, hi);
+
+    if (q > hi)
+        return 0;
+
+    uint32_t index[REDUCE_CHUNK];
+    uint32_t total = 0;
+
+    for (int s = 0; s < layout.num_span; s++)
+    {
+        span_t span;
+        get_span(&layout, s, &span);
+
+        for (int o = 0; o < span.num; o += REDUCE_CHUNK)
+        {
+            int num = (span.num - o < REDUCE_CHUNK) ? (span.num - o) : REDUCE_CHUNK;
+            int found = span_find_ge(&layout, &span, o, num, q, index);
+
+            for (int i = 0; i < found; i++)
+            {
+                int offset = o + index[i];
+
+                if (!span_is_valid(&span, offset))
+                    continue;
+
+                if (total < max_element)
+                {
+                    span_position(&layout, &span, offset, &elements[total]);
+                    elements[total].value = (float)span_value(&layout, &span, offset) / factor;
+                }
+
+                total++;
+            }
+        }
+    }
+
+    return total;
+}
+
+/******************************************************************
+ * top-k
+ ******************************************************************/
+
+/**
+ * hist[v - INT8_MIN] of 8-bit values, hist[(v - INT16_MIN) >> 8] of 16-bit values, or hist[(v - INT16_MIN) & 0xff] of 16-bit values in high byte 'high' (>= 0).
+ * Consecutive values are counted in 4 histograms, so increments of the same bin do not wait for each other.
+ */
+static void span_histogram(const node_layout_t *layout, const span_t *span, uint32_t hist[4][256], int high)
+{
+    int o = 0;
+
+    if (0 < span->lanes && KDP_CHANNEL_MIN_16 > span->lanes)
+    {
+        for (; o < span->num; o += KDP_CHANNEL_MIN_16)
+        {
+            for (int j = 0; j < span->lanes; j++)
+                hist[j & 3][span->s8[o + j] - INT8_MIN]++;
+        }
+    }
+    else if (!layout->is_16bit)
+    {
+        const int8_t *s8 = span->s8;
+
+        for (; o + 4 <= span->num; o += 4)
+        {
+            hist[0][s8[o] - INT8_MIN]++;
+            hist[1][s8[o + 1] - INT8_MIN]++;
+            hist[2][s8[o + 2] - INT8_MIN]++;
+            hist[3][s8[o + 3] - INT8_MIN]++;
+        }
+
+        for (; o < span->num; o++)
+            hist[0][s8[o] - INT8_MIN]++;
+    }
+    else if (0 > high)
+    {
+        const int16_t *s16 = (const int16_t *)span->s8;
+
+        for (; o + 4 <= span->num; o += 4)
+        {
+            hist[0][(s16[o] - INT16_MIN) >> 8]++;
+            hist[1][(s16[o + 1] - INT16_MIN) >> 8]++;
+            hist[2][(s16[o + 2] - INT16_MIN) >> 8]++;
+            hist[3][(s16[o + 3] - INT16_MIN) >> 8]++;
+        }
+
+        for (; o < span->num; o++)
+            hist[0][(s16[o] - INT16_MIN) >> 8]++;
+    }
+    else
+    {
+        const int16_t *s16 = (const int16_t *)span->s8;
+
+        for (; o < span->num; o++)
+        {
+            int u = s16[o] - INT16_MIN;
+            if ((u >> 8) == high)
+                hist[o & 3][u & 0xff]++;
+        }
+    }
+}
+
+// the histogram of all values of the node
+static void node_histogram(const node_layout_t *layout, uint32_t *hist, int high)
+{
+    uint32_t sub_hist[4][256];
+
+    memset(sub_hist, 0, sizeof(sub_hist));
+
+    for (int s = 0; s < layout->num_span; s++)
+    {
+        span_t span;
+        get_span(layout, s, &span);
+        span_histogram(layout, &span, sub_hist, high);
+    }
+
+    for (int b = 0; b < 256; b++)
+        hist[b] = sub_hist[0][b] + sub_hist[1][b] + sub_hist[2][b] + sub_hist[3][b];
+}
+
+// the highest bin where the count from the top reaches k, 'above' is the count of the bins above it
+static int find_cutoff_bin(const uint32_t *hist, uint32_t k, uint32_t *above)
+{
+    uint32_t count = *above;
+    int b = 255;
+
+    for (; b > 0; b--)
+    {
+        if (count + hist[b] >= k)
+            break;
+
+        count += hist[b];
+    }
+
+    *above = count;
+
+    return b;
+}
+
+static int compare_element(const void *a, const void *b)
+{
+    const kp_inf_node_element_t *ea = (const kp_inf_node_element_t *)a;
+    const kp_inf_node_element_t *eb = (const kp_inf_node_element_t *)b;
+
+    if (ea->value != eb->value)
+        return (ea->value > eb->value) ? -1 : 1;
+
+    if (ea->channel != eb->channel)
+        return (ea->channel < eb->channel) ? -1 : 1;
+
+    if (ea->row != eb->row)
+        return (ea->row < eb->row) ? -1 : 1;
+
+    return (ea->col < eb->col) ? -1 : (ea->col > eb->col);
+}
+
+uint32_t node_reduce_top_k(const kp_inf_raw_fixed_node_output_t *node, bool hcw, float factor, uint32_t k, kp_inf_node_element_t *elements)
+{
+    pthread_once(&_kernel_once, select_kernels);
+
+    node_layout_t layout;
+    get_layout(node, hcw, &layout);
+
+    uint32_t num_value = (uint32_t)layout.height * layout.channel * layout.width;
+
+    if (k > num_value)
+        k = num_value;
+
+    if (0 == k)
+        return 0;
+
+    // the k-th largest value is found by histograms (one byte at a time for 16-bit), so no value is sorted but the picked ones
+    uint32_t hist[256];
+    uint32_t above = 0;
+    int cutoff;
+
+    node_histogram(&layout, hist, -1);
+
+    int bin = find_cutoff_bin(hist, k, &above);
+
+    if (!layout.is_16bit)
+    {
+        cutoff = bin + INT8_MIN;
+    }
+    else
+    {
+        node_histogram(&layout, hist, bin);
+
+        cutoff = ((bin << 8) | find_cutoff_bin(hist, k, &above)) + INT16_MIN;
+    }
+
+    // values above the cutoff are all taken, values equal to it fill the rest in device memory order
+    uint32_t num_equal = k - above;
+    uint32_t index[REDUCE_CHUNK];
+    uint32_t n = 0;
+
+    for (int s = 0; s < layout.num_span && n < k; s++)
+    {
+        span_t span;
+        get_span(&layout, s, &span);
+
+        for (int o = 0; o < span.num && n < k; o += REDUCE_CHUNK)
+        {
+            int num = (span.num - o < REDUCE_CHUNK) ? (span.num - o) : REDUCE_CHUNK;
+            int found = span_find_ge(&layout, &span, o, num, cutoff, index);
+
+            for (int i = 0; i < found && n < k; i++)
+            {
+                int offset = o + index[i];
+                int value = span_value(&layout, &span, offset);
+
+                if (!span_is_valid(&span, offset))
+                    continue;
+
+                if (value == cutoff)
+                {
+                    if (0 == num_equal)
+                        continue;
+
+                    num_equal--;
+                }
+
+                span_position(&layout, &span, offset, &elements[n]);
+                elements[n].value = (float)value / factor;
+                n++;
+            }
+        }
+    }
+
+    qsort(elements, n, sizeof(kp_inf_node_element_t), compare_element);
+
+    return n;
+}
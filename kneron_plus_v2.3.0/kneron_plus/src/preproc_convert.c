@@ -0,0 +1,420 @@
+/**
+ * @file        preproc_convert.c
+ * @brief       resize and quantization kernels for host pre-processing of input nodes
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "preproc_convert.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define PREPROC_CONVERT_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PREPROC_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+// the largest float below 0.5, adding it with the sign of the value then truncating rounds half away from zero like roundf()
+#define ROUND_HALF 0.49999997f
+
+typedef void (*resample_func_t)(float *const *plane, int num_channel, const uint8_t *src,
+                                const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width);
+typedef void (*quantize_func_t)(int8_t *dst, int block_size, const float *const *row0, const float *const *row1, float fy,
+                                const float *mul, const float *add, int num_channel, int width);
+
+static pthread_once_t _kernel_once = PTHREAD_ONCE_INIT;
+static resample_func_t _resample_rgba8888 = NULL;
+static quantize_func_t _quantize = NULL;
+
+/******************************************************************
+ * C kernels
+ ******************************************************************/
+
+static inline int8_t quantize_c(float v, float mul, float add)
+{
+    v = v * mul + add;
+
+    if (v < -128.0f)
+        v = -128.0f;
+    else if (v > 127.0f)
+        v = 127.0f;
+
+    return (int8_t)(int32_t)(v + copysignf(ROUND_HALF, v));
+}
+
+static void resample_rgba8888_c(float *const *plane, int num_channel, const uint8_t *src,
+                                const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width, int begin)
+{
+    for (int x = begin; x < width; x++)
+    {
+        const uint8_t *p0 = src + xofs0[x];
+        const uint8_t *p1 = src + xofs1[x];
+
+        for (int c = 0; c < num_channel; c++)
+            plane[c][x] = (float)p0[c] + ((float)p1[c] - (float)p0[c]) * fx[x];
+    }
+}
+
+static void resample_rgba8888_all_c(float *const *plane, int num_channel, const uint8_t *src,
+                                    const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width)
+{
+    resample_rgba8888_c(plane, num_channel, src, xofs0, xofs1, fx, width, 0);
+}
+
+// columns [begin, width) of the content, every byte of a column is written
+static void quantize_cols_c(int8_t *dst, int block_size, const float *const *row0, const float *const *row1, float fy,
+                            const float *mul, const float *add, int num_channel, int begin, int width)
+{
+    for (int x = begin; x < width; x++)
+    {
+        int8_t *d = dst + x * block_size;
+        int c = 0;
+
+        for (; c < num_channel; c++)
+            d[c] = quantize_c(row0[c][x] + (row1[c][x] - row0[c][x]) * fy, mul[c], add[c]);
+
+        for (; c < block_size; c++)
+            d[c] = 0;
+    }
+}
+
+static void quantize_c_all(int8_t *dst, int block_size, const float *const *row0, const float *const *row1, float fy,
+                           const float *mul, const float *add, int num_channel, int width)
+{
+    quantize_cols_c(dst, block_size, row0, row1, fy, mul, add, num_channel, 0, width);
+}
+
+#if defined(PREPROC_CONVERT_X86)
+
+/******************************************************************
+ * SSE2 kernels
+ ******************************************************************/
+
+static inline __m128 sse2_load_rgba8888(const uint8_t *src)
+{
+    int32_t v;
+    memcpy(&v, src, sizeof(v));
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+
+    return _mm_cvtepi32_ps(x);
+}
+
+static inline __m128 sse2_lerp_rgba8888(const uint8_t *src, int32_t ofs0, int32_t ofs1, float f)
+{
+    __m128 p0 = sse2_load_rgba8888(src + ofs0);
+    __m128 p1 = sse2_load_rgba8888(src + ofs1);
+
+    return _mm_add_ps(p0, _mm_mul_ps(_mm_sub_ps(p1, p0), _mm_set1_ps(f)));
+}
+
+static void resample_rgba8888_sse2(float *const *plane, int num_channel, const uint8_t *src,
+                                   const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width)
+{
+    int x = 0;
+
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128 ch[4];
+
+        ch[0] = sse2_lerp_rgba8888(src, xofs0[x + 0], xofs1[x + 0], fx[x + 0]);
+        ch[1] = sse2_lerp_rgba8888(src, xofs0[x + 1], xofs1[x + 1], fx[x + 1]);
+        ch[2] = sse2_lerp_rgba8888(src, xofs0[x + 2], xofs1[x + 2], fx[x + 2]);
+        ch[3] = sse2_lerp_rgba8888(src, xofs0[x + 3], xofs1[x + 3], fx[x + 3]);
+
+        // 4 pixels of RGBA to 4 channels of 4 pixels
+        _MM_TRANSPOSE4_PS(ch[0], ch[1], ch[2], ch[3]);
+
+        for (int c = 0; c < num_channel; c++)
+            _mm_storeu_ps(plane[c] + x, ch[c]);
+    }
+
+    resample_rgba8888_c(plane, num_channel, src, xofs0, xofs1, fx, width, x);
+}
+
+static inline __m128i sse2_quantize4(const float *r0, const float *r1, __m128 vfy, __m128 vmul, __m128 vadd)
+{
+    __m128 a = _mm_loadu_ps(r0);
+    __m128 v = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(r1), a), vfy));
+
+    v = _mm_add_ps(_mm_mul_ps(v, vmul), vadd);
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-128.0f)), _mm_set1_ps(127.0f));
+    v = _mm_add_ps(v, _mm_or_ps(_mm_and_ps(v, _mm_set1_ps(-0.0f)), _mm_set1_ps(ROUND_HALF)));
+
+    return _mm_cvttps_epi32(v);
+}
+
+static inline __m128i sse2_quantize16(const float *r0, const float *r1, __m128 vfy, float mul, float add)
+{
+    __m128 vmul = _mm_set1_ps(mul);
+    __m128 vadd = _mm_set1_ps(add);
+
+    __m128i lo = _mm_packs_epi32(sse2_quantize4(r0, r1, vfy, vmul, vadd), sse2_quantize4(r0 + 4, r1 + 4, vfy, vmul, vadd));
+    __m128i hi = _mm_packs_epi32(sse2_quantize4(r0 + 8, r1 + 8, vfy, vmul, vadd), sse2_quantize4(r0 + 12, r1 + 12, vfy, vmul, vadd));
+
+    return _mm_packs_epi16(lo, hi);
+}
+
+// 4 columns of 4 channels in 'quad', each column is stored as 16 bytes with zero padding
+static inline void sse2_store_block16(int8_t *dst, __m128i quad)
+{
+    __m128i mask = _mm_cvtsi32_si128(-1);
+
+    _mm_storeu_si128((__m128i *)dst, _mm_and_si128(quad, mask));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_and_si128(_mm_srli_si128(quad, 4), mask));
+    _mm_storeu_si128((__m128i *)(dst + 32), _mm_and_si128(_mm_srli_si128(quad, 8), mask));
+    _mm_storeu_si128((__m128i *)(dst + 48), _mm_srli_si128(quad, 12));
+}
+
+static void quantize_sse2(int8_t *dst, int block_size, const float *const *row0, const float *const *row1, float fy,
+                          const float *mul, const float *add, int num_channel, int width)
+{
+    __m128 vfy = _mm_set1_ps(fy);
+    int x = 0;
+
+    if (1 == block_size)
+    {
+        for (; x + 16 <= width; x += 16)
+            _mm_storeu_si128((__m128i *)(dst + x), sse2_quantize16(row0[0] + x, row1[0] + x, vfy, mul[0], add[0]));
+    }
+    else
+    {
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i q[4];
+
+            for (int c = 0; c < 4; c++)
+                q[c] = (c < num_channel) ? sse2_quantize16(row0[c] + x, row1[c] + x, vfy, mul[c], add[c]) : _mm_setzero_si128();
+
+            // interleave channels into 4 bytes per column
+            __m128i lo01 = _mm_unpacklo_epi8(q[0], q[1]);
+            __m128i hi01 = _mm_unpackhi_epi8(q[0], q[1]);
+            __m128i lo23 = _mm_unpacklo_epi8(q[2], q[3]);
+            __m128i hi23 = _mm_unpackhi_epi8(q[2], q[3]);
+
+            __m128i quad0 = _mm_unpacklo_epi16(lo01, lo23);
+            __m128i quad1 = _mm_unpackhi_epi16(lo01, lo23);
+            __m128i quad2 = _mm_unpacklo_epi16(hi01, hi23);
+            __m128i quad3 = _mm_unpackhi_epi16(hi01, hi23);
+
+            if (4 == block_size)
+            {
+                int8_t *d = dst + x * 4;
+                _mm_storeu_si128((__m128i *)d, quad0);
+                _mm_storeu_si128((__m128i *)(d + 16), quad1);
+                _mm_storeu_si128((__m128i *)(d + 32), quad2);
+                _mm_storeu_si128((__m128i *)(d + 48), quad3);
+            }
+            else
+            {
+                int8_t *d = dst + x * 16;
+                sse2_store_block16(d, quad0);
+                sse2_store_block16(d + 64, quad1);
+                sse2_store_block16(d + 128, quad2);
+                sse2_store_block16(d + 192, quad3);
+            }
+        }
+    }
+
+    quantize_cols_c(dst, block_size, row0, row1, fy, mul, add, num_channel, x, width);
+}
+
+#elif defined(PREPROC_CONVERT_NEON)
+
+/******************************************************************
+ * NEON kernels
+ ******************************************************************/
+
+static inline float32x4_t neon_load_rgba8888(const uint8_t *src)
+{
+    uint32_t v;
+    memcpy(&v, src, sizeof(v));
+
+    uint16x8_t x = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(v)));
+
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(x)));
+}
+
+static inline float32x4_t neon_lerp_rgba8888(const uint8_t *src, int32_t ofs0, int32_t ofs1, float f)
+{
+    float32x4_t p0 = neon_load_rgba8888(src + ofs0);
+    float32x4_t p1 = neon_load_rgba8888(src + ofs1);
+
+    return vaddq_f32(p0, vmulq_n_f32(vsubq_f32(p1, p0), f));
+}
+
+static void resample_rgba8888_neon(float *const *plane, int num_channel, const uint8_t *src,
+                                   const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width)
+{
+    float pixel[16];
+    int x = 0;
+
+    for (; x + 4 <= width; x += 4)
+    {
+        vst1q_f32(pixel, neon_lerp_rgba8888(src, xofs0[x + 0], xofs1[x + 0], fx[x + 0]));
+        vst1q_f32(pixel + 4, neon_lerp_rgba8888(src, xofs0[x + 1], xofs1[x + 1], fx[x + 1]));
+        vst1q_f32(pixel + 8, neon_lerp_rgba8888(src, xofs0[x + 2], xofs1[x + 2], fx[x + 2]));
+        vst1q_f32(pixel + 12, neon_lerp_rgba8888(src, xofs0[x + 3], xofs1[x + 3], fx[x + 3]));
+
+        // 4 pixels of RGBA to 4 channels of 4 pixels
+        float32x4x4_t ch = vld4q_f32(pixel);
+
+        for (int c = 0; c < num_channel; c++)
+            vst1q_f32(plane[c] + x, ch.val[c]);
+    }
+
+    resample_rgba8888_c(plane, num_channel, src, xofs0, xofs1, fx, width, x);
+}
+
+static inline int16x4_t neon_quantize4(const float *r0, const float *r1, float fy, float32x4_t vmul, float32x4_t vadd)
+{
+    float32x4_t a = vld1q_f32(r0);
+    float32x4_t v = vaddq_f32(a, vmulq_n_f32(vsubq_f32(vld1q_f32(r1), a), fy));
+
+    v = vaddq_f32(vmulq_f32(v, vmul), vadd);
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(-128.0f)), vdupq_n_f32(127.0f));
+
+    uint32x4_t half = vorrq_u32(vandq_u32(vreinterpretq_u32_f32(v), vdupq_n_u32(0x80000000)),
+                                vreinterpretq_u32_f32(vdupq_n_f32(ROUND_HALF)));
+    v = vaddq_f32(v, vreinterpretq_f32_u32(half));
+
+    return vmovn_s32(vcvtq_s32_f32(v));
+}
+
+static inline int8x16_t neon_quantize16(const float *r0, const float *r1, float fy, float mul, float add)
+{
+    float32x4_t vmul = vdupq_n_f32(mul);
+    float32x4_t vadd = vdupq_n_f32(add);
+
+    int16x8_t lo = vcombine_s16(neon_quantize4(r0, r1, fy, vmul, vadd), neon_quantize4(r0 + 4, r1 + 4, fy, vmul, vadd));
+    int16x8_t hi = vcombine_s16(neon_quantize4(r0 + 8, r1 + 8, fy, vmul, vadd), neon_quantize4(r0 + 12, r1 + 12, fy, vmul, vadd));
+
+    return vcombine_s8(vmovn_s16(lo), vmovn_s16(hi));
+}
+
+// 4 columns of 4 channels in 'quad', each column is stored as 16 bytes with zero padding
+static inline void neon_store_block16(int8_t *dst, int32x4_t quad)
+{
+    int32x4_t zero = vdupq_n_s32(0);
+
+    vst1q_s8(dst, vreinterpretq_s8_s32(vsetq_lane_s32(vgetq_lane_s32(quad, 0), zero, 0)));
+    vst1q_s8(dst + 16, vreinterpretq_s8_s32(vsetq_lane_s32(vgetq_lane_s32(quad, 1), zero, 0)));
+    vst1q_s8(dst + 32, vreinterpretq_s8_s32(vsetq_lane_s32(vgetq_lane_s32(quad, 2), zero, 0)));
+    vst1q_s8(dst + 48, vreinterpretq_s8_s32(vsetq_lane_s32(vgetq_lane_s32(quad, 3), zero, 0)));
+}
+
+static void quantize_neon(int8_t *dst, int block_size, const float *const *row0, const float *const *row1, float fy,
+                          const float *mul, const float *add, int num_channel, int width)
+{
+    int x = 0;
+
+    if (1 == block_size)
+    {
+        for (; x + 16 <= width; x += 16)
+            vst1q_s8(dst + x, neon_quantize16(row0[0] + x, row1[0] + x, fy, mul[0], add[0]));
+    }
+    else
+    {
+        for (; x + 16 <= width; x += 16)
+        {
+            int8x16x4_t q;
+
+            for (int c = 0; c < 4; c++)
+                q.val[c] = (c < num_channel) ? neon_quantize16(row0[c] + x, row1[c] + x, fy, mul[c], add[c]) : vdupq_n_s8(0);
+
+            if (4 == block_size)
+            {
+                vst4q_s8(dst + x * 4, q);
+            }
+            else
+            {
+                // interleave channels into 4 bytes per column
+                int8x16x2_t z01 = vzipq_s8(q.val[0], q.val[1]);
+                int8x16x2_t z23 = vzipq_s8(q.val[2], q.val[3]);
+                int16x8x2_t lo = vzipq_s16(vreinterpretq_s16_s8(z01.val[0]), vreinterpretq_s16_s8(z23.val[0]));
+                int16x8x2_t hi = vzipq_s16(vreinterpretq_s16_s8(z01.val[1]), vreinterpretq_s16_s8(z23.val[1]));
+
+                int8_t *d = dst + x * 16;
+                neon_store_block16(d, vreinterpretq_s32_s16(lo.val[0]));
+                neon_store_block16(d + 64, vreinterpretq_s32_s16(lo.val[1]));
+                neon_store_block16(d + 128, vreinterpretq_s32_s16(hi.val[0]));
+                neon_store_block16(d + 192, vreinterpretq_s32_s16(hi.val[1]));
+            }
+        }
+    }
+
+    quantize_cols_c(dst, block_size, row0, row1, fy, mul, add, num_channel, x, width);
+}
+
+#endif
+
+/******************************************************************
+ * kernel selection
+ ******************************************************************/
+
+static void select_kernels(void)
+{
+    _resample_rgba8888 = resample_rgba8888_all_c;
+    _quantize = quantize_c_all;
+
+#if defined(PREPROC_CONVERT_X86)
+    _resample_rgba8888 = resample_rgba8888_sse2;
+    _quantize = quantize_sse2;
+#elif defined(PREPROC_CONVERT_NEON)
+    _resample_rgba8888 = resample_rgba8888_neon;
+    _quantize = quantize_neon;
+#endif
+}
+
+void preproc_resample_row_rgba8888(float *const *plane, int num_channel, const uint8_t *src,
+                                   const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width)
+{
+    pthread_once(&_kernel_once, select_kernels);
+    _resample_rgba8888(plane, num_channel, src, xofs0, xofs1, fx, width);
+}
+
+void preproc_resample_row_rgb565(float *const *plane, int num_channel, const uint8_t *src,
+                                 const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width)
+{
+    for (int x = 0; x < width; x++)
+    {
+        uint16_t v0 = (uint16_t)(src[xofs0[x]] | (src[xofs0[x] + 1] << 8));
+        uint16_t v1 = (uint16_t)(src[xofs1[x]] | (src[xofs1[x] + 1] << 8));
+        float p0[PREPROC_MAX_CHANNEL] = {(float)((v0 >> 8) & 0xF8), (float)((v0 >> 3) & 0xFC), (float)((v0 << 3) & 0xF8), 0.0f};
+        float p1[PREPROC_MAX_CHANNEL] = {(float)((v1 >> 8) & 0xF8), (float)((v1 >> 3) & 0xFC), (float)((v1 << 3) & 0xF8), 0.0f};
+
+        for (int c = 0; c < num_channel; c++)
+            plane[c][x] = p0[c] + (p1[c] - p0[c]) * fx[x];
+    }
+}
+
+void preproc_resample_row_raw8(float *const *plane, int num_channel, const uint8_t *src,
+                               const int32_t *xofs0, const int32_t *xofs1, const float *fx, int width)
+{
+    for (int x = 0; x < width; x++)
+        plane[0][x] = (float)src[xofs0[x]] + ((float)src[xofs1[x]] - (float)src[xofs0[x]]) * fx[x];
+
+    // a gray image is given to every channel
+    for (int c = 1; c < num_channel; c++)
+        memcpy(plane[c], plane[0], width * sizeof(float));
+}
+
+void preproc_quantize_row(int8_t *dst, int block_size, const float *const *row0, const float *const *row1, float fy,
+                          const float *mul, const float *add, int num_channel, int pad_left, int width, int width_align)
+{
+    pthread_once(&_kernel_once, select_kernels);
+
+    int pad_right = width_align - pad_left - width;
+
+    memset(dst, 0, pad_left * block_size);
+    _quantize(dst + pad_left * block_size, block_size, row0, row1, fy, mul, add, num_channel, width);
+    memset(dst + (pad_left + width) * block_size, 0, pad_right * block_size);
+}
@@ -0,0 +1,121 @@
+/**
+ * @file        kp_usb_sim.h
+ * @brief       USB device simulator, hardware-free Kneron devices behind the libusb-1.0 API
+ *
+ * The simulator implements the libusb-1.0 functions used by the SDK, so the whole USB layer (chunking, ZLP, async transfers,
+ * event handling) runs unmodified. Simulated devices emulate the KDP2 companion firmware:
+ *
+ *   - system info, DDR/FIFO queue configuration, model/NEF loading and unloading commands and USB control requests.
+ *   - generic image and data inference, a result is returned after 'npu_time_us' of NPU time, one per crop box.
+ *   - canned RAW results in the KL520, KL720 or KL630 layout, with the output nodes set by kp_usb_sim_set_output_nodes().
+ *   - FIFO queue back pressure, the OUT endpoint stalls when input and result buffers are all in use.
+ *   - flash read, write and digest commands on a 32 MB flash which is kept over reboots, writing takes 1 ms per KB.
+ *   - flash write streams, a chunk is programmed while the next ones are received and acknowledged once it is programmed.
+ *   - result coalescing, results done when a bulk IN transfer starts are packed into it.
+ *
+ * Bulk transfers take 'latency_us' plus the size divided by 'bandwidth_mbps'. OUT and IN endpoints are independent pipes.
+ *
+ * Devices are added by kp_usb_sim_add_device(), or from environment variables when the first libusb_init() finds none:
+ *
+ *   KP_USB_SIM_DEVICES          comma separated chip names, ex. "KL520,KL520,KL720" (default "KL520")
+ *   KP_USB_SIM_LATENCY_US       per transfer latency in microseconds
+ *   KP_USB_SIM_BANDWIDTH_MBPS   bulk bandwidth in MB/s
+ *   KP_USB_SIM_NPU_US           NPU time of one inference in microseconds
+ *
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define KP_USB_SIM_MAX_DEVICE 20        /**< maximum number of simulated devices */
+#define KP_USB_SIM_MAX_OUTPUT_NODE 40   /**< maximum number of output nodes of canned results */
+
+/**
+ * @brief configuration of a simulated device, zero fields take the default value of the chip.
+ */
+typedef struct
+{
+    uint16_t product_id;            /**< KP_DEVICE_KL520, KP_DEVICE_KL720 or KP_DEVICE_KL630 */
+    uint32_t kn_number;             /**< KN number, 0 to derive it from the port */
+    uint32_t latency_us;            /**< fixed cost of one bulk transfer in microseconds */
+    uint32_t bandwidth_mbps;        /**< bulk bandwidth in MB/s, 0 for the default of the link speed */
+    uint32_t npu_time_us;           /**< NPU time of one inference in microseconds */
+} kp_usb_sim_device_config_t;
+
+/**
+ * @brief shape and quantization of one output node of canned results.
+ */
+typedef struct
+{
+    uint32_t height;                /**< node height */
+    uint32_t channel;               /**< node channel */
+    uint32_t width;                 /**< node width, it is padded to 16 bytes in the RAW result */
+    int32_t radix;                  /**< radix for fixed/floating point conversion */
+    float scale;                    /**< scale for fixed/floating point conversion */
+} kp_usb_sim_output_node_t;
+
+/**
+ * @brief statistics of a simulated device.
+ */
+typedef struct
+{
+    uint64_t bytes_out;             /**< bytes received from the host */
+    uint64_t bytes_in;              /**< bytes sent to the host */
+    uint32_t num_inference;         /**< number of completed inferences */
+    uint32_t num_dropped;           /**< number of images dropped by the droppable FIFO queue */
+    uint64_t npu_busy_us;           /**< total NPU time */
+    uint64_t flash_bytes_written;   /**< bytes written to the flash */
+    uint32_t num_coalesced;         /**< number of results sent in coalesced transfers */
+} kp_usb_sim_statistics_t;
+
+/**
+ * @brief Add a simulated device, it shows up in the next device scan.
+ *
+ * @param[in] config refer to kp_usb_sim_device_config_t.
+ *
+ * @return the port ID of the device (> 0), or a negative libusb error code.
+ */
+int kp_usb_sim_add_device(const kp_usb_sim_device_config_t *config);
+
+/**
+ * @brief Remove all simulated devices, they must not be connected.
+ */
+void kp_usb_sim_remove_all_devices(void);
+
+/**
+ * @brief Set output nodes of canned results of all devices, by default a result has one 16x1x16 node.
+ *
+ * Results which are queued but not yet received are dropped.
+ *
+ * @param[in] num_node number of output nodes, up to KP_USB_SIM_MAX_OUTPUT_NODE.
+ * @param[in] nodes output nodes.
+ *
+ * @return 0 on success, or a negative libusb error code.
+ */
+int kp_usb_sim_set_output_nodes(int num_node, const kp_usb_sim_output_node_t nodes[]);
+
+/**
+ * @brief Size of one result of the chip with the given output nodes, including the result header.
+ *
+ * @param[in] product_id KP_DEVICE_KL520, KP_DEVICE_KL720 or KP_DEVICE_KL630.
+ * @param[in] num_node number of output nodes.
+ * @param[in] nodes output nodes.
+ *
+ * @return the result size in bytes, 0 if parameters are invalid.
+ */
+uint32_t kp_usb_sim_get_result_size(uint16_t product_id, int num_node, const kp_usb_sim_output_node_t nodes[]);
+
+/**
+ * @brief Get statistics of a simulated device.
+ *
+ * @param[in] port_id port ID of the device.
+ * @param[out] stats refer to kp_usb_sim_statistics_t.
+ *
+ * @return 0 on success, or a negative libusb error code.
+ */
+int kp_usb_sim_get_statistics(uint32_t port_id, kp_usb_sim_statistics_t *stats);
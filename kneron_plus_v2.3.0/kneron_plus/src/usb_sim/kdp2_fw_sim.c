@@ -0,0 +1,1606 @@
+/**
+ * @file        kdp2_fw_sim.c
+ * @brief       emulation of the KDP2 companion firmware for the USB device simulator
+ *
+ * Data written to the bulk OUT endpoint is parsed as a stream of KDP2 commands and inference headers, payloads
+ * (models, NEF, images) are skipped without being copied, except flash data which is written to the emulated flash.
+ * Responses and inference results are queued as messages which are sent to the bulk IN endpoint when they are ready.
+ *
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "usb_sim_internal.h"
+#include "kp_version.h"
+#include "kdp2_ipc_cmd.h"
+#include "kdp2_inf_generic_raw.h"
+#include "internal_func.h"
+
+// #define DEBUG_PRINT
+
+#ifdef DEBUG_PRINT
+#define dbg_print(format, ...) printf(format, ##__VA_ARGS__)
+#else
+#define dbg_print(format, ...)
+#endif
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+#define FAKE_ZLP_MAGIC 0x11223344
+#define BUFFER_SIZE_10_KB (10 * 1024)
+#define DEFAULT_QUEUE_DEPTH 6       // FIFO queue depth before it is configured
+#define DDR_AVAILABLE_BEGIN 0x60000000
+#define KL520_DDR_AVAILABLE_SIZE (64 * 1024 * 1024)
+#define KL720_DDR_AVAILABLE_SIZE (256 * 1024 * 1024)
+#define SIM_SYSTEM_RESERVE_SIZE (8 * 1024 * 1024)   // DDR heap reserved by the firmware at boot
+#define SIM_FIFOQ_MAX_BUF_COUNT 8
+#define SIM_FLASH_SIZE (32 * 1024 * 1024)
+#define KL520_FLASH_BLOCK_SIZE (4 * 1024)
+#define KL720_FLASH_BLOCK_SIZE (128 * 1024)
+#define KL520_FLASH_MODEL_INFO_ADDR 0x00300000
+#define KL520_FLASH_MODEL_ALL_ADDR 0x00301000
+#define KL720_FLASH_MODEL_INFO_ADDR 0x00540000
+#define KL720_FLASH_MODEL_ALL_ADDR 0x00560000
+#define FLASH_WRITE_NS_PER_KB 1000000   // erase and program, about 1 MB/s
+#define FLASH_READ_NS_PER_KB 50000      // about 20 MB/s
+
+enum
+{
+    PARSE_HEADER = 0,
+    PARSE_SKIP,
+};
+
+// what to do when the skipped payload ends
+enum
+{
+    SKIP_FW_INFO = 0,
+    SKIP_MODEL,
+    SKIP_NEF,
+    SKIP_IMAGE,
+    SKIP_UNKNOWN_INFERENCE,
+    SKIP_FLASH_WRITE,
+    SKIP_FLASH_CHUNK,
+};
+
+enum
+{
+    RAW_OUTPUT_KL520 = 0,
+    RAW_OUTPUT_KL720,
+    RAW_OUTPUT_KL630,
+    NUM_RAW_OUTPUT,
+};
+
+static struct
+{
+    int num_node;
+    kp_usb_sim_output_node_t nodes[KP_USB_SIM_MAX_OUTPUT_NODE];
+    sim_raw_output_t raw[NUM_RAW_OUTPUT];
+} _output = {
+    .num_node = 1,
+    .nodes = {{.height = 1, .channel = 16, .width = 16, .radix = 0, .scale = 1.0f}},
+};
+
+static inline uint32_t read_u32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t crc32(const uint8_t *data, uint32_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+
+    return ~crc;
+}
+
+static inline uint32_t round_up_16(uint32_t num)
+{
+    return (num + 15) & ~15u;
+}
+
+static inline uint32_t node_data_size(const kp_usb_sim_output_node_t *node)
+{
+    return node->height * node->channel * round_up_16(node->width);
+}
+
+static int raw_output_index(uint16_t product_id)
+{
+    switch (product_id)
+    {
+    case KP_DEVICE_KL520:
+        return RAW_OUTPUT_KL520;
+    case KP_DEVICE_KL720:
+        return RAW_OUTPUT_KL720;
+    case KP_DEVICE_KL630:
+        return RAW_OUTPUT_KL630;
+    default:
+        return -1;
+    }
+}
+
+uint32_t sim_fw_raw_output_size(uint16_t product_id, int num_node, const kp_usb_sim_output_node_t nodes[])
+{
+    uint32_t size;
+
+    switch (raw_output_index(product_id))
+    {
+    case RAW_OUTPUT_KL520:
+        size = sizeof(uint32_t) + num_node * sizeof(kp_inf_raw_fixed_node_metadata_t);
+        break;
+    case RAW_OUTPUT_KL720:
+        size = sizeof(_720_raw_cnn_res_t);
+        break;
+    case RAW_OUTPUT_KL630:
+        size = sizeof(_630_raw_cnn_res_t);
+        break;
+    default:
+        return 0;
+    }
+
+    for (int i = 0; i < num_node; i++)
+        size += node_data_size(&nodes[i]);
+
+    return size;
+}
+
+// fixed-point data is the same in every result, it is generated once for the current output nodes
+// like activations of detection heads, values are mostly negative with sparse positive peaks
+static void fill_node_data(int8_t *data, uint32_t size)
+{
+    uint32_t x = 0x2545F491;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        int8_t value = (int8_t)((x >> 8) & 0x7F);
+        data[i] = ((x >> 24) < 4) ? value : -value;
+    }
+}
+
+static int build_raw_output(int index, uint16_t product_id)
+{
+    sim_raw_output_t *raw = &_output.raw[index];
+    uint32_t size = sim_fw_raw_output_size(product_id, _output.num_node, _output.nodes);
+
+    raw->data = (uint8_t *)calloc(1, size);
+    if (NULL == raw->data)
+        return LIBUSB_ERROR_NO_MEM;
+
+    raw->size = size;
+
+    uint32_t offset = 0;
+    uint8_t *data_start;
+
+    if (RAW_OUTPUT_KL520 == index)
+    {
+        kp_inf_raw_fixed_node_metadata_t *metadata = (kp_inf_raw_fixed_node_metadata_t *)(raw->data + sizeof(uint32_t));
+
+        *(uint32_t *)raw->data = _output.num_node;
+
+        for (int i = 0; i < _output.num_node; i++)
+        {
+            metadata[i].height = _output.nodes[i].height;
+            metadata[i].channel = _output.nodes[i].channel;
+            metadata[i].width = _output.nodes[i].width;
+            metadata[i].radix = _output.nodes[i].radix;
+            metadata[i].scale = _output.nodes[i].scale;
+            metadata[i].data_layout = DATA_FMT_KL520_16W1C8B;
+        }
+
+        data_start = (uint8_t *)&metadata[_output.num_node];
+    }
+    else if (RAW_OUTPUT_KL720 == index)
+    {
+        _720_raw_cnn_res_t *res = (_720_raw_cnn_res_t *)raw->data;
+
+        res->total_raw_len = size;
+        res->total_nodes = _output.num_node;
+
+        for (int i = 0; i < _output.num_node; i++)
+        {
+            _720_raw_onode_t *onode = &res->onode_a[i];
+
+            onode->start_offset = offset;
+            onode->buf_len = node_data_size(&_output.nodes[i]);
+            onode->node_id = i;
+            onode->data_format = DATA_FMT_KL720_16W1C8B;
+            onode->row_length = _output.nodes[i].height;
+            onode->col_length = _output.nodes[i].width;
+            onode->ch_length = _output.nodes[i].channel;
+            onode->output_index = i;
+            onode->output_radix = (uint32_t)_output.nodes[i].radix;
+            memcpy(&onode->output_scale, &_output.nodes[i].scale, sizeof(float));
+
+            offset += onode->buf_len;
+        }
+
+        data_start = res->data;
+    }
+    else
+    {
+        _630_raw_cnn_res_t *res = (_630_raw_cnn_res_t *)raw->data;
+
+        res->total_raw_len = size;
+        res->total_nodes = _output.num_node;
+
+        for (int i = 0; i < _output.num_node; i++)
+        {
+            _630_raw_onode_t *onode = &res->onode_a[i];
+
+            onode->idx = i;
+            onode->fmt = DATA_FMT_KL630_16W1C8B;
+            onode->batch = 1;
+            onode->ch_length = _output.nodes[i].channel;
+            onode->row_length = _output.nodes[i].height;
+            onode->col_length = _output.nodes[i].width;
+            onode->buf_len = node_data_size(&_output.nodes[i]);
+            onode->buf_aligned_len = onode->buf_len;
+            memcpy(&onode->scale, &_output.nodes[i].scale, sizeof(float));
+            onode->radix = (uint32_t)_output.nodes[i].radix;
+            onode->start_offset = offset;
+            onode->quant_vect_len = 1;
+
+            offset += onode->buf_len;
+        }
+
+        data_start = res->data;
+    }
+
+    fill_node_data((int8_t *)data_start, size - (uint32_t)(data_start - raw->data));
+
+    return LIBUSB_SUCCESS;
+}
+
+static const sim_raw_output_t *get_raw_output(uint16_t product_id)
+{
+    int index = raw_output_index(product_id);
+
+    if (index < 0)
+        return NULL;
+
+    if (NULL == _output.raw[index].data && LIBUSB_SUCCESS != build_raw_output(index, product_id))
+        return NULL;
+
+    return &_output.raw[index];
+}
+
+void sim_fw_release_output(void)
+{
+    for (int i = 0; i < NUM_RAW_OUTPUT; i++)
+    {
+        free(_output.raw[i].data);
+        _output.raw[i].data = NULL;
+        _output.raw[i].size = 0;
+    }
+}
+
+int sim_fw_set_output_nodes(int num_node, const kp_usb_sim_output_node_t nodes[])
+{
+    if (num_node < 1 || num_node > KP_USB_SIM_MAX_OUTPUT_NODE || NULL == nodes)
+        return LIBUSB_ERROR_INVALID_PARAM;
+
+    for (int i = 0; i < num_node; i++)
+    {
+        if (0 == nodes[i].height || 0 == nodes[i].channel || 0 == nodes[i].width)
+            return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    sim_fw_release_output();
+
+    _output.num_node = num_node;
+    memcpy(_output.nodes, nodes, num_node * sizeof(kp_usb_sim_output_node_t));
+
+    return LIBUSB_SUCCESS;
+}
+
+// *********************************************************************************************** //
+// messages to the host
+// *********************************************************************************************** //
+
+static sim_message_t *alloc_message(sim_fw_t *fw, uint64_t ready_ns)
+{
+    if (fw->msg_count == SIM_MAX_MESSAGE)
+    {
+        dbg_print("[%s] message queue is full\n", __func__);
+        return NULL;
+    }
+
+    sim_message_t *msg = &fw->msg[(fw->msg_head + fw->msg_count) % SIM_MAX_MESSAGE];
+    fw->msg_count++;
+
+    msg->ready_ns = ready_ns;
+    msg->head_len = 0;
+    msg->body_len = 0;
+    msg->body = NULL;
+    msg->owned_body = NULL;
+    msg->offset = 0;
+    msg->jobs_done = 0;
+
+    return msg;
+}
+
+static void send_response(sim_fw_t *fw, const void *data, uint32_t length, uint64_t now_ns)
+{
+    sim_message_t *msg = alloc_message(fw, now_ns);
+
+    if (NULL == msg)
+        return;
+
+    memcpy(msg->head, data, length);
+    msg->head_len = length;
+}
+
+static void send_return_code(sim_fw_t *fw, uint32_t return_code, uint64_t now_ns)
+{
+    send_response(fw, &return_code, sizeof(return_code), now_ns);
+}
+
+void sim_fw_drop_results(sim_device_t *dev)
+{
+    sim_fw_t *fw = &dev->fw;
+
+    for (int i = 0; i < fw->msg_count; i++)
+        free(fw->msg[(fw->msg_head + i) % SIM_MAX_MESSAGE].owned_body);
+
+    fw->msg_head = 0;
+    fw->msg_count = 0;
+    fw->zlp_pending = false;
+    fw->jobs_in_device = 0;
+    fw->npu_free_ns = 0;
+}
+
+bool sim_fw_in_ready(sim_device_t *dev, uint64_t *ready_ns, uint32_t *length)
+{
+    sim_fw_t *fw = &dev->fw;
+
+    if (fw->zlp_pending)
+    {
+        *ready_ns = 0;
+        *length = 0;
+        return true;
+    }
+
+    if (0 == fw->msg_count)
+        return false;
+
+    sim_message_t *msg = &fw->msg[fw->msg_head];
+
+    *ready_ns = msg->ready_ns;
+    *length = msg->head_len + msg->body_len - msg->offset;
+
+    return true;
+}
+
+static bool is_coalescible(const sim_message_t *msg)
+{
+    const kp_inference_header_stamp_t *stamp = (const kp_inference_header_stamp_t *)msg->head;
+
+    return (0 == msg->offset) && (msg->head_len >= sizeof(kp_inference_header_stamp_t)) &&
+           (KDP2_MAGIC_TYPE_INFERENCE == stamp->magic_type) && (KDP2_INF_ID_GENERIC_RAW == stamp->job_id ||
+           KDP2_INF_ID_GENERIC_RAW_BYPASS_PRE_PROC == stamp->job_id);
+}
+
+// same rules as the result thread of the firmware, results done when the transfer starts are packed into it
+bool sim_fw_coalesce_results(sim_device_t *dev, uint64_t start_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+
+    if (0 == fw->coalesce_max_size || fw->zlp_pending || 2 > fw->msg_count || !is_coalescible(&fw->msg[fw->msg_head]))
+        return false;
+
+    uint32_t offset = sizeof(kdp2_ipc_coalesced_result_t);
+    int num_result = 0;
+
+    while (num_result < fw->msg_count && num_result < KDP2_COALESCED_RESULT_MAX_NUM)
+    {
+        sim_message_t *msg = &fw->msg[(fw->msg_head + num_result) % SIM_MAX_MESSAGE];
+        uint32_t aligned_size = (msg->head_len + msg->body_len + 3) & ~3;
+
+        if (!is_coalescible(msg) || msg->ready_ns > start_ns || offset + aligned_size > fw->coalesce_max_size)
+            break;
+
+        offset += aligned_size;
+        num_result++;
+    }
+
+    if (2 > num_result)
+        return false;
+
+    sim_message_t *coalesced = &fw->msg[fw->msg_head];
+    kdp2_ipc_coalesced_result_t *header = (kdp2_ipc_coalesced_result_t *)dev->coalesce_buf;
+    uint32_t jobs_done = 0;
+
+    offset = sizeof(kdp2_ipc_coalesced_result_t);
+
+    for (int i = 0; i < num_result; i++)
+    {
+        sim_message_t *msg = &fw->msg[(fw->msg_head + i) % SIM_MAX_MESSAGE];
+
+        memcpy(dev->coalesce_buf + offset, msg->head, msg->head_len);
+        if (0 < msg->body_len)
+            memcpy(dev->coalesce_buf + offset + msg->head_len, msg->body, msg->body_len);
+
+        offset += (msg->head_len + msg->body_len + 3) & ~3;
+        jobs_done += msg->jobs_done;
+    }
+
+    header->header_stamp.magic_type = KDP2_MAGIC_TYPE_COALESCED_RESULT;
+    header->header_stamp.total_size = offset;
+    header->header_stamp.job_id = 0;
+    header->header_stamp.status_code = KP_SUCCESS;
+    header->header_stamp.total_image = num_result;
+    header->header_stamp.image_index = 0;
+
+    // the first message carries the coalesced transfer, the others are consumed
+    coalesced->head_len = 0;
+    coalesced->body = dev->coalesce_buf;
+    coalesced->body_len = offset;
+    coalesced->jobs_done = jobs_done;
+
+    fw->msg_count -= num_result - 1;
+    for (int i = 1; i < fw->msg_count; i++)
+        fw->msg[(fw->msg_head + i) % SIM_MAX_MESSAGE] = fw->msg[(fw->msg_head + i + num_result - 1) % SIM_MAX_MESSAGE];
+
+    dev->stats.num_coalesced += num_result;
+
+    return true;
+}
+
+int sim_fw_read(sim_device_t *dev, uint8_t *buf, int length)
+{
+    sim_fw_t *fw = &dev->fw;
+
+    if (fw->zlp_pending)
+    {
+        fw->zlp_pending = false;
+        return 0;
+    }
+
+    if (0 == fw->msg_count)
+        return 0;
+
+    sim_message_t *msg = &fw->msg[fw->msg_head];
+    uint32_t total = msg->head_len + msg->body_len;
+    uint32_t n = MIN((uint32_t)length, total - msg->offset);
+    uint32_t copied = 0;
+
+    if (msg->offset < msg->head_len)
+    {
+        copied = MIN(n, msg->head_len - msg->offset);
+        memcpy(buf, msg->head + msg->offset, copied);
+    }
+
+    if (copied < n)
+        memcpy(buf + copied, msg->body + (msg->offset + copied - msg->head_len), n - copied);
+
+    msg->offset += n;
+    dev->stats.bytes_in += n;
+
+    if (msg->offset == total)
+    {
+        fw->jobs_in_device -= MIN(msg->jobs_done, fw->jobs_in_device);
+
+        free(msg->owned_body);
+        msg->owned_body = NULL;
+
+        fw->msg_head = (fw->msg_head + 1) % SIM_MAX_MESSAGE;
+        fw->msg_count--;
+
+        // the buffer ends exactly at a packet boundary, the device terminates the message with a ZLP
+        if ((total % dev->max_psize) == 0 && n == (uint32_t)length)
+            fw->zlp_pending = true;
+    }
+
+    return (int)n;
+}
+
+// *********************************************************************************************** //
+// flash
+// *********************************************************************************************** //
+
+// the flash is kept over reboots, it is allocated and erased by the first flash command
+static uint8_t *get_flash(sim_device_t *dev)
+{
+    if (NULL == dev->flash)
+    {
+        dev->flash = (uint8_t *)malloc(SIM_FLASH_SIZE);
+        if (NULL != dev->flash)
+            memset(dev->flash, 0xFF, SIM_FLASH_SIZE);
+    }
+
+    return dev->flash;
+}
+
+static inline bool flash_range_valid(uint32_t flash_addr, uint32_t length)
+{
+    return (flash_addr <= SIM_FLASH_SIZE) && (length <= SIM_FLASH_SIZE - flash_addr);
+}
+
+static void read_flash(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_ipc_cmd_read_flash_t *cmd = (kdp2_ipc_cmd_read_flash_t *)fw->cmd_buf;
+    uint8_t *flash = get_flash(dev);
+
+    if (NULL == flash || !flash_range_valid(cmd->flash_offset, cmd->length))
+    {
+        send_return_code(fw, KP_ERROR_INVALID_PARAM_12, now_ns);
+        return;
+    }
+
+    uint64_t ready_ns = now_ns + (uint64_t)cmd->length * FLASH_READ_NS_PER_KB / 1024;
+
+    send_return_code(fw, KP_SUCCESS, ready_ns);
+
+    sim_message_t *msg = alloc_message(fw, ready_ns);
+    if (NULL != msg)
+    {
+        msg->body = flash + cmd->flash_offset;
+        msg->body_len = cmd->length;
+    }
+}
+
+static void begin_write_flash(sim_device_t *dev)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_ipc_cmd_write_flash_t *cmd = (kdp2_ipc_cmd_write_flash_t *)fw->cmd_buf;
+
+    // the data is written while it is received, a bad address fails after the data is skipped
+    fw->flash_write_addr = cmd->flash_offset;
+    fw->flash_write_ok = (0 == (cmd->flash_offset & 0xFFF)) && (NULL != get_flash(dev)) &&
+                         flash_range_valid(cmd->flash_offset, cmd->length);
+}
+
+static void write_flash_data(sim_device_t *dev, const uint8_t *data, uint32_t length)
+{
+    sim_fw_t *fw = &dev->fw;
+
+    if (!fw->flash_write_ok)
+        return;
+
+    memcpy(dev->flash + fw->flash_write_addr, data, length);
+    fw->flash_write_addr += length;
+    dev->stats.flash_bytes_written += length;
+}
+
+static inline uint32_t flash_block_size(sim_device_t *dev)
+{
+    return (KP_DEVICE_KL520 == dev->config.product_id) ? KL520_FLASH_BLOCK_SIZE : KL720_FLASH_BLOCK_SIZE;
+}
+
+static uint32_t flash_region_addr(sim_device_t *dev, uint32_t region, uint32_t flash_offset)
+{
+    bool kl520 = (KP_DEVICE_KL520 == dev->config.product_id);
+
+    if (KDP2_FLASH_REGION_MODEL_INFO == region)
+        return flash_offset + (kl520 ? KL520_FLASH_MODEL_INFO_ADDR : KL720_FLASH_MODEL_INFO_ADDR);
+    else if (KDP2_FLASH_REGION_MODEL_ALL == region)
+        return flash_offset + (kl520 ? KL520_FLASH_MODEL_ALL_ADDR : KL720_FLASH_MODEL_ALL_ADDR);
+
+    return flash_offset;
+}
+
+static void get_flash_digest(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_ipc_cmd_get_flash_digest_t *cmd = (kdp2_ipc_cmd_get_flash_digest_t *)fw->cmd_buf;
+    kdp2_ipc_response_flash_digest_t *response = &fw->flash_digest;
+    uint32_t block_size = flash_block_size(dev);
+    uint32_t flash_addr = flash_region_addr(dev, cmd->region, cmd->flash_offset);
+    uint32_t sector_size = (0 == cmd->sector_size) ? block_size : cmd->sector_size;
+    uint8_t *flash = get_flash(dev);
+
+    // same rules as kmdw_dfu_get_flash_digest() of the firmware, flash is read into the FIFO queue buffer holding the command
+    sector_size = (sector_size + block_size - 1) / block_size * block_size;
+    if (fw->fifoq_allocated && sector_size > fw->input_buf_size)
+        sector_size = fw->input_buf_size / block_size * block_size;
+
+    response->return_code = KP_SUCCESS;
+    response->flash_addr = flash_addr;
+    response->sector_size = sector_size;
+    response->num_sector = (0 == sector_size) ? 0 : MIN((cmd->length + sector_size - 1) / sector_size, KDP2_FLASH_DIGEST_MAX_SECTOR);
+
+    if (NULL == flash || 0 != (flash_addr & 0xFFF) || !flash_range_valid(flash_addr, cmd->length) || 0 == sector_size)
+    {
+        response->return_code = KP_ERROR_FW_UPDATE_FAILED_19;
+        response->num_sector = 0;
+    }
+
+    for (uint32_t i = 0; i < response->num_sector; i++)
+    {
+        uint32_t offset = i * sector_size;
+
+        response->digest[i] = crc32(flash + flash_addr + offset, MIN(sector_size, cmd->length - offset));
+    }
+
+    // digests of unused sectors are not sent
+    uint32_t response_size = sizeof(*response) - (KDP2_FLASH_DIGEST_MAX_SECTOR - response->num_sector) * sizeof(uint32_t);
+    uint64_t ready_ns = now_ns + (uint64_t)cmd->length * FLASH_READ_NS_PER_KB / 1024;
+    sim_message_t *msg = alloc_message(fw, ready_ns);
+
+    // the response is larger than a message head, it is sent as the body
+    if (NULL != msg)
+    {
+        msg->body = (const uint8_t *)response;
+        msg->body_len = response_size;
+    }
+}
+
+// same rules as _write_flash_stream() of the firmware, chunks are staged in free input buffers of the FIFO queue
+static void begin_flash_stream(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_ipc_cmd_write_flash_stream_t *cmd = (kdp2_ipc_cmd_write_flash_stream_t *)fw->cmd_buf;
+    kdp2_ipc_response_write_flash_stream_t response;
+    uint32_t block_size = flash_block_size(dev);
+    uint32_t chunk_size = cmd->chunk_size;
+    uint32_t window = (0 == cmd->window) ? 2 : cmd->window;
+    uint32_t max_chunk_size = 0;
+
+    if (fw->input_buf_size > sizeof(kdp2_flash_chunk_header_t))
+        max_chunk_size = (fw->input_buf_size - sizeof(kdp2_flash_chunk_header_t)) / block_size * block_size;
+
+    if ((0 == chunk_size) || (chunk_size > max_chunk_size))
+        chunk_size = max_chunk_size;
+    else
+        chunk_size = (chunk_size + block_size - 1) / block_size * block_size;
+
+    window = MIN(window, MIN(fw->input_buf_count - 1, KDP2_FLASH_STREAM_MAX_WINDOW));
+
+    response.return_code = KP_SUCCESS;
+    response.flash_addr = flash_region_addr(dev, cmd->region, cmd->flash_offset);
+    response.chunk_size = chunk_size;
+    response.window = window;
+
+    if (!fw->fifoq_allocated || 2 > fw->input_buf_count || 0 == chunk_size)
+        response.return_code = KP_FW_FIFOQ_NOT_READY_126;
+    else if (0 != (response.flash_addr & 0xFFF) || 0 == cmd->length || 0 != (cmd->length & 3) ||
+             NULL == get_flash(dev) || !flash_range_valid(response.flash_addr, cmd->length))
+        response.return_code = KP_ERROR_INVALID_PARAM_12;
+
+    send_response(fw, &response, sizeof(response), now_ns);
+
+    fw->stream_num_chunk = 0;
+    fw->stream_next_chunk = 0;
+
+    if (KP_SUCCESS == response.return_code)
+    {
+        fw->stream_addr = response.flash_addr;
+        fw->stream_chunk_size = chunk_size;
+        fw->stream_num_chunk = (cmd->length + chunk_size - 1) / chunk_size;
+        fw->stream_sts = KP_SUCCESS;
+    }
+}
+
+static void begin_flash_chunk(sim_device_t *dev)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_flash_chunk_header_t *header = (kdp2_flash_chunk_header_t *)fw->cmd_buf;
+
+    fw->flash_write_addr = fw->stream_addr + header->chunk_index * fw->stream_chunk_size;
+    fw->flash_write_ok = (KP_SUCCESS == fw->stream_sts) && (header->chunk_index == fw->stream_next_chunk) &&
+                         (header->chunk_index < fw->stream_num_chunk) && (header->length <= fw->stream_chunk_size) &&
+                         flash_range_valid(fw->flash_write_addr, header->length);
+}
+
+// chunks are programmed one by one, each is acknowledged after it is programmed and read back
+static void end_flash_chunk(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_flash_chunk_header_t *header = (kdp2_flash_chunk_header_t *)fw->cmd_buf;
+    kdp2_ipc_response_flash_chunk_ack_t ack;
+
+    if ((header->chunk_index != fw->stream_next_chunk) || (header->chunk_index >= fw->stream_num_chunk))
+    {
+        // the firmware stops the stream, the host times out waiting for the ack
+        dbg_print("[%s] unexpected chunk %u\n", __func__, header->chunk_index);
+        fw->stream_num_chunk = 0;
+        return;
+    }
+
+    ack.return_code = fw->stream_sts;
+    ack.chunk_index = header->chunk_index;
+    ack.crc32 = 0;
+
+    if (KP_SUCCESS == ack.return_code)
+    {
+        if (fw->flash_write_ok)
+            ack.crc32 = crc32(dev->flash + fw->flash_write_addr - header->length, header->length);
+
+        if (!fw->flash_write_ok)
+            ack.return_code = KP_ERROR_FW_UPDATE_FAILED_19;
+        else if (ack.crc32 != header->crc32)
+            ack.return_code = KP_FW_ERROR_USB_RECEIVE_FAILED_123;
+
+        fw->stream_sts = ack.return_code;
+    }
+
+    // the next chunk is received while this one is programmed
+    fw->flash_free_ns = MAX(now_ns, fw->flash_free_ns) + (uint64_t)header->length * FLASH_WRITE_NS_PER_KB / 1024;
+    fw->stream_next_chunk++;
+
+    send_response(fw, &ack, sizeof(ack), fw->flash_free_ns);
+}
+
+// *********************************************************************************************** //
+// commands
+// *********************************************************************************************** //
+
+static void get_fw_version(uint16_t product_id, kp_firmware_version_t *version)
+{
+    const int *fw_version = (KP_DEVICE_KL520 == product_id) ? kl520_fw_version :
+                            (KP_DEVICE_KL720 == product_id) ? kl720_fw_version : kl630_fw_version;
+
+    version->reserved = 0;
+    version->major = fw_version[VERSION_INDEX_MAJOR];
+    version->minor = fw_version[VERSION_INDEX_MINOR];
+    version->update = fw_version[VERSION_INDEX_REVISION];
+    version->build = fw_version[VERSION_INDEX_BUILD];
+}
+
+static uint32_t command_header_size(const uint8_t *cmd)
+{
+    uint32_t magic = read_u32(cmd);
+
+    if (KDP2_FLASH_CHUNK_MAGIC == magic)
+    {
+        return sizeof(kdp2_flash_chunk_header_t);
+    }
+    else if (KDP2_MAGIC_TYPE_INFERENCE == magic)
+    {
+        switch (read_u32(cmd + 8))
+        {
+        case KDP2_INF_ID_GENERIC_RAW:
+            return sizeof(kdp2_ipc_generic_raw_inf_header_t);
+        case KDP2_INF_ID_GENERIC_RAW_BYPASS_PRE_PROC:
+            return sizeof(kdp2_ipc_generic_raw_inf_bypass_pre_proc_header_t);
+        case KDP2_INF_ID_GENERIC_RAW_CROP_BATCH:
+            return sizeof(kdp2_ipc_generic_raw_crop_batch_inf_header_t);
+        default:
+            return sizeof(kp_inference_header_stamp_t);
+        }
+    }
+    else if (KDP2_MAGIC_TYPE_COMMAND == magic)
+    {
+        // 'total_size' is not set by all commands, the size is known by the command ID
+        switch (read_u32(cmd + 8))
+        {
+        case KDP2_COMMAND_LOAD_MODEL:
+            return sizeof(kdp2_ipc_cmd_load_model_t);
+        case KDP2_COMMAND_LOAD_NEF:
+            return sizeof(kdp2_ipc_cmd_load_nef_t);
+        case KDP2_COMMAND_GET_MODEL_INFO:
+            return sizeof(kdp2_ipc_cmd_get_model_info_t);
+        case KDP2_COMMAND_READ_FLASH:
+            return sizeof(kdp2_ipc_cmd_read_flash_t);
+        case KDP2_COMMAND_WRITE_FLASH:
+            return sizeof(kdp2_ipc_cmd_write_flash_t);
+        case KDP2_COMMAND_GET_FLASH_DIGEST:
+            return sizeof(kdp2_ipc_cmd_get_flash_digest_t);
+        case KDP2_COMMAND_WRITE_FLASH_STREAM:
+            return sizeof(kdp2_ipc_cmd_write_flash_stream_t);
+        case KDP2_COMMAND_RESIZE_FIFOQ:
+            return sizeof(kdp2_ipc_cmd_resize_fifo_queue_t);
+        case KDP2_COMMAND_CONFIGURE_INF_LANES:
+            return sizeof(kdp2_ipc_cmd_configure_inf_lanes_t);
+        case KDP2_COMMAND_GET_INF_LANE_STATS:
+            return sizeof(kdp2_ipc_cmd_get_inf_lane_stats_t);
+        default:
+            return 12;
+        }
+    }
+
+    return 0;
+}
+
+static uint32_t ddr_available_size(sim_device_t *dev)
+{
+    return (KP_DEVICE_KL520 == dev->config.product_id) ? KL520_DDR_AVAILABLE_SIZE : KL720_DDR_AVAILABLE_SIZE;
+}
+
+static uint64_t fifoq_size(uint32_t input_buf_count, uint32_t input_buf_size, uint32_t result_buf_count, uint32_t result_buf_size)
+{
+    return (uint64_t)input_buf_count * input_buf_size + (uint64_t)result_buf_count * result_buf_size;
+}
+
+// the emulated heap has no fragmentation, the blocks are packed from the top of DDR
+static uint32_t heap_used_size(sim_fw_t *fw)
+{
+    uint32_t used = SIM_SYSTEM_RESERVE_SIZE + fw->coalesce_reserved;
+
+    if (fw->fifoq_allocated)
+        used += (uint32_t)fifoq_size(fw->input_buf_count, fw->input_buf_size, fw->result_buf_count, fw->result_buf_size);
+
+    return used;
+}
+
+static void update_heap_peak(sim_fw_t *fw)
+{
+    fw->heap_peak_used = MAX(fw->heap_peak_used, heap_used_size(fw));
+}
+
+static void get_ddr_heap_stats(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kp_ddr_heap_stats_t response = {0};
+    uint32_t used = heap_used_size(fw);
+
+    response.heap_begin = DDR_AVAILABLE_BEGIN + fw->model_size;
+    response.heap_end = DDR_AVAILABLE_BEGIN + ddr_available_size(dev);
+    response.used_size = used;
+    response.free_size = (response.heap_end - response.heap_begin > used) ? (response.heap_end - response.heap_begin - used) : 0;
+    response.largest_free_size = response.free_size;
+    response.used_block_count = 1 + (fw->coalesce_reserved ? 1 : 0) + (fw->fifoq_allocated ? 2 : 0);
+    response.free_block_count = response.free_size ? 1 : 0;
+    response.peak_used_size = MAX(fw->heap_peak_used, used);
+    response.lowest_addr = response.heap_end - response.peak_used_size;
+    response.fragmentation = 0;
+
+    send_response(fw, &response, sizeof(response), now_ns);
+}
+
+static void resize_fifo_queue(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_ipc_cmd_resize_fifo_queue_t *cmd = (kdp2_ipc_cmd_resize_fifo_queue_t *)fw->cmd_buf;
+    uint32_t return_code = KP_SUCCESS;
+
+    if (!fw->fifoq_allocated)
+    {
+        return_code = KP_FW_FIFOQ_NOT_READY_126;
+    }
+    else if (0 == cmd->input_buf_count || SIM_FIFOQ_MAX_BUF_COUNT < cmd->input_buf_count || 0 == cmd->input_buf_size ||
+             0 == cmd->result_buf_count || SIM_FIFOQ_MAX_BUF_COUNT < cmd->result_buf_count || 0 == cmd->result_buf_size)
+    {
+        return_code = KP_FW_WRONG_INPUT_BUFFER_COUNT_110;
+    }
+    else
+    {
+        // the old buffers are given back before the new ones are allocated
+        uint64_t heap_size = ddr_available_size(dev) - fw->model_size;
+        uint64_t used = heap_used_size(fw) - fifoq_size(fw->input_buf_count, fw->input_buf_size, fw->result_buf_count, fw->result_buf_size);
+
+        if (used + fifoq_size(cmd->input_buf_count, cmd->input_buf_size, cmd->result_buf_count, cmd->result_buf_size) > heap_size)
+        {
+            return_code = KP_FW_DDR_MALLOC_FAILED_102;
+        }
+        else
+        {
+            sim_fw_drop_results(dev);
+
+            fw->input_buf_count = cmd->input_buf_count;
+            fw->input_buf_size = cmd->input_buf_size;
+            fw->result_buf_count = cmd->result_buf_count;
+            fw->result_buf_size = cmd->result_buf_size;
+            update_heap_peak(fw);
+        }
+    }
+
+    send_return_code(fw, return_code, now_ns);
+}
+
+// inferences run in the order they are received, only the lane configuration and statistics are emulated
+static void configure_inf_lanes(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_ipc_cmd_configure_inf_lanes_t *cmd = (kdp2_ipc_cmd_configure_inf_lanes_t *)fw->cmd_buf;
+    uint32_t return_code = KP_SUCCESS;
+
+    for (int lane = 0; lane < KP_MAX_INFERENCE_LANE; lane++)
+    {
+        if (0 == cmd->lane_config.weight[lane] || KP_MAX_INFERENCE_LANE_WEIGHT < cmd->lane_config.weight[lane])
+            return_code = KP_ERROR_INVALID_PARAM_12;
+    }
+
+    if (KP_SUCCESS == return_code)
+        fw->lane_config = cmd->lane_config;
+
+    send_return_code(fw, return_code, now_ns);
+}
+
+static void get_inf_lane_stats(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_ipc_cmd_get_inf_lane_stats_t *cmd = (kdp2_ipc_cmd_get_inf_lane_stats_t *)fw->cmd_buf;
+    kp_inference_lane_stats_t response[KP_MAX_INFERENCE_LANE];
+
+    for (int lane = 0; lane < KP_MAX_INFERENCE_LANE; lane++)
+    {
+        response[lane] = fw->lane_stats[lane];
+        response[lane].avg_wait_us = response[lane].dequeued ? (uint32_t)(fw->lane_total_wait_us[lane] / response[lane].dequeued) : 0;
+    }
+
+    if (cmd->reset)
+    {
+        memset(fw->lane_stats, 0, sizeof(fw->lane_stats));
+        memset(fw->lane_total_wait_us, 0, sizeof(fw->lane_total_wait_us));
+    }
+
+    send_response(fw, response, sizeof(response), now_ns);
+}
+
+// the image waits in the FIFO queue until the NPU is done with the inferences before it
+static void lane_dequeue(sim_fw_t *fw, uint64_t now_ns)
+{
+    kp_inference_lane_stats_t *stats = &fw->lane_stats[fw->lane];
+    uint32_t wait_us = (uint32_t)((MAX(now_ns, fw->npu_free_ns) - now_ns) / 1000);
+
+    stats->dequeued++;
+    stats->max_wait_us = MAX(stats->max_wait_us, wait_us);
+    fw->lane_total_wait_us[fw->lane] += wait_us;
+}
+
+static void start_skip(sim_fw_t *fw, uint32_t length, int action)
+{
+    fw->parse_state = PARSE_SKIP;
+    fw->skip_remaining = length;
+    fw->skip_action = action;
+}
+
+static void handle_command(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    uint32_t command_id = read_u32(fw->cmd_buf + 8);
+
+    switch (command_id)
+    {
+    case KDP2_COMMAND_GET_SYSTEM_INFO:
+    {
+        kdp2_ipc_response_get_system_info_t response;
+
+        response.return_code = KP_SUCCESS;
+        response.system_info.kn_number = dev->config.kn_number;
+        get_fw_version(dev->config.product_id, &response.system_info.firmware_version);
+
+        send_response(fw, &response, sizeof(response), now_ns);
+        break;
+    }
+    case KDP2_COMMAND_GET_MODEL_INFO:
+    {
+        // reading models back is not emulated, the SDK then loads models without rebooting the device
+        kdp2_ipc_response_get_model_info_fw_info_t response = {KP_ERROR_MODEL_NOT_LOADED_35, 0, 0};
+
+        send_response(fw, &response, sizeof(response), now_ns);
+        break;
+    }
+    case KDP2_COMMAND_GET_DDR_CONFIG:
+    {
+        kp_available_ddr_config_t response;
+
+        response.ddr_available_begin = DDR_AVAILABLE_BEGIN;
+        response.ddr_available_end = DDR_AVAILABLE_BEGIN + ddr_available_size(dev);
+        response.ddr_model_end = DDR_AVAILABLE_BEGIN + fw->model_size;
+        response.ddr_fifoq_allocated = fw->fifoq_allocated ? 1 : 0;
+
+        send_response(fw, &response, sizeof(response), now_ns);
+        break;
+    }
+    case KDP2_COMMAND_GET_FIFOQ_CONFIG:
+    {
+        kp_fifo_queue_config_t response = {0};
+
+        if (fw->fifoq_allocated)
+        {
+            response.fifoq_input_buf_count = fw->input_buf_count;
+            response.fifoq_input_buf_size = fw->input_buf_size;
+            response.fifoq_result_buf_count = fw->result_buf_count;
+            response.fifoq_result_buf_size = fw->result_buf_size;
+        }
+
+        send_response(fw, &response, sizeof(response), now_ns);
+        break;
+    }
+    case KDP2_COMMAND_LOAD_MODEL:
+    {
+        kdp2_ipc_cmd_load_model_t *cmd = (kdp2_ipc_cmd_load_model_t *)fw->cmd_buf;
+
+        // models are replaced in place, queued images and results are dropped like unloading
+        if (fw->fifoq_allocated)
+            sim_fw_drop_results(dev);
+
+        fw->model_loaded = false;
+        fw->model_size = cmd->model_size;
+
+        // fw_info follows the command header in the same write
+        start_skip(fw, cmd->fw_info_size, SKIP_FW_INFO);
+        break;
+    }
+    case KDP2_COMMAND_LOAD_NEF:
+    {
+        kdp2_ipc_cmd_load_nef_t *cmd = (kdp2_ipc_cmd_load_nef_t *)fw->cmd_buf;
+
+        fw->model_loaded = false;
+        fw->model_size = cmd->nef_size;
+
+        send_return_code(fw, KP_SUCCESS, now_ns);
+        start_skip(fw, cmd->nef_size, SKIP_NEF);
+        break;
+    }
+    case KDP2_COMMAND_UNLOAD_MODEL:
+        sim_fw_drop_results(dev);
+        fw->model_loaded = false;
+        fw->model_size = 0;
+        send_return_code(fw, KP_SUCCESS, now_ns);
+        break;
+    case KDP2_COMMAND_READ_FLASH:
+        read_flash(dev, now_ns);
+        break;
+    case KDP2_COMMAND_WRITE_FLASH:
+        begin_write_flash(dev);
+        start_skip(fw, ((kdp2_ipc_cmd_write_flash_t *)fw->cmd_buf)->length, SKIP_FLASH_WRITE);
+        break;
+    case KDP2_COMMAND_GET_FLASH_DIGEST:
+        get_flash_digest(dev, now_ns);
+        break;
+    case KDP2_COMMAND_WRITE_FLASH_STREAM:
+        begin_flash_stream(dev, now_ns);
+        break;
+    case KDP2_COMMAND_RESIZE_FIFOQ:
+        resize_fifo_queue(dev, now_ns);
+        break;
+    case KDP2_COMMAND_GET_DDR_HEAP_STATS:
+        get_ddr_heap_stats(dev, now_ns);
+        break;
+    case KDP2_COMMAND_CONFIGURE_INF_LANES:
+        configure_inf_lanes(dev, now_ns);
+        break;
+    case KDP2_COMMAND_GET_INF_LANE_STATS:
+        get_inf_lane_stats(dev, now_ns);
+        break;
+    case KDP2_COMMAND_STOP_USB_RECV:
+        break;
+    default:
+        dbg_print("[%s] unsupported command 0x%X\n", __func__, command_id);
+        send_return_code(fw, KP_FW_ERROR_UNKNOWN_APP, now_ns);
+        break;
+    }
+}
+
+// *********************************************************************************************** //
+// inference
+// *********************************************************************************************** //
+
+static uint32_t queue_depth(sim_fw_t *fw)
+{
+    return fw->fifoq_allocated ? (fw->input_buf_count + fw->result_buf_count) : DEFAULT_QUEUE_DEPTH;
+}
+
+// a full queue never drops an image in deadline drop mode
+static bool is_droppable(sim_fw_t *fw)
+{
+    return fw->droppable && !fw->deadline_drop;
+}
+
+static void handle_inference_header(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kp_inference_header_stamp_t *stamp = (kp_inference_header_stamp_t *)fw->cmd_buf;
+    uint32_t header_size = command_header_size(fw->cmd_buf);
+    uint32_t payload_size = (stamp->total_size > header_size) ? (stamp->total_size - header_size) : 0;
+
+    if ((KDP2_INF_ID_GENERIC_RAW != stamp->job_id) && (KDP2_INF_ID_GENERIC_RAW_BYPASS_PRE_PROC != stamp->job_id) &&
+        (KDP2_INF_ID_GENERIC_RAW_CROP_BATCH != stamp->job_id))
+    {
+        start_skip(fw, payload_size, SKIP_UNKNOWN_INFERENCE);
+        return;
+    }
+
+    if (0 == stamp->image_index)
+    {
+        fw->job_id = stamp->job_id;
+        fw->total_image = MAX(stamp->total_image, 1);
+        fw->num_pre_proc_info = 0;
+        fw->crop_count = 0;
+        fw->job_dropped = (fw->jobs_in_device >= queue_depth(fw));
+        fw->lane = (KDP2_INF_LANE_TAG == (stamp->status_code & KDP2_INF_LANE_TAG_MASK)) ?
+                   MIN(stamp->status_code & KDP2_INF_LANE_NUM_MASK, KP_MAX_INFERENCE_LANE - 1) : 0;
+        fw->has_deadline = (KDP2_INF_LANE_TAG == (stamp->status_code & KDP2_INF_LANE_TAG_MASK)) &&
+                           (0 != (stamp->status_code & KDP2_INF_DEADLINE_FLAG)) && (payload_size >= sizeof(kdp2_ipc_inf_deadline_t));
+        fw->recv_ns = now_ns;
+
+        if (fw->job_dropped)
+        {
+            dev->stats.num_dropped++;
+            fw->lane_stats[fw->lane].dropped++;
+        }
+        else
+        {
+            fw->jobs_in_device++;
+            fw->lane_stats[fw->lane].enqueued++;
+        }
+    }
+
+    if (KDP2_INF_ID_GENERIC_RAW == stamp->job_id)
+    {
+        kdp2_ipc_generic_raw_inf_header_t *header = (kdp2_ipc_generic_raw_inf_header_t *)fw->cmd_buf;
+        kdp2_ipc_generic_raw_inf_image_header_t *image = &header->image_header;
+
+        fw->inf_number = header->inference_number;
+
+        if (stamp->image_index < KP_MAX_INPUT_NODE_COUNT)
+        {
+            kp_hw_pre_proc_info_t *info = &fw->pre_proc_info[stamp->image_index];
+
+            memset(info, 0, sizeof(kp_hw_pre_proc_info_t));
+            info->img_width = image->width;
+            info->img_height = image->height;
+            info->resized_img_width = image->width;
+            info->resized_img_height = image->height;
+            info->model_input_width = image->width;
+            info->model_input_height = image->height;
+            info->crop_area.width = image->width;
+            info->crop_area.height = image->height;
+
+            fw->num_pre_proc_info = MAX(fw->num_pre_proc_info, stamp->image_index + 1);
+        }
+
+        if (0 == stamp->image_index)
+        {
+            fw->crop_count = MIN(image->crop_count, MAX_CROP_BOX);
+            memcpy(fw->crops, image->inf_crop, fw->crop_count * sizeof(kp_inf_crop_box_t));
+        }
+    }
+    else if (KDP2_INF_ID_GENERIC_RAW_CROP_BATCH == stamp->job_id)
+    {
+        kdp2_ipc_generic_raw_crop_batch_inf_header_t *header = (kdp2_ipc_generic_raw_crop_batch_inf_header_t *)fw->cmd_buf;
+
+        fw->inf_number = header->inference_number;
+        fw->crop_count = MIN(header->crop_count, MAX_CROP_BATCH_BOX);
+        memcpy(fw->crops, header->inf_crop, fw->crop_count * sizeof(kp_inf_crop_box_t));
+    }
+    else
+    {
+        kdp2_ipc_generic_raw_inf_bypass_pre_proc_header_t *header = (kdp2_ipc_generic_raw_inf_bypass_pre_proc_header_t *)fw->cmd_buf;
+
+        fw->inf_number = header->inference_number;
+    }
+
+    start_skip(fw, payload_size, SKIP_IMAGE);
+}
+
+// keep the last bytes of the first image, they are the deadline trailer
+static void receive_deadline(sim_fw_t *fw, const uint8_t *data, uint32_t length)
+{
+    uint32_t trailer_size = sizeof(fw->deadline);
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        uint32_t remaining = fw->skip_remaining - i;
+
+        if (remaining <= trailer_size)
+            fw->deadline[trailer_size - remaining] = data[i];
+    }
+}
+
+// the image is dropped with a report instead of its results if the NPU would not be done before the deadline
+static bool drop_late_inference(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    kdp2_ipc_inf_deadline_t *deadline = (kdp2_ipc_inf_deadline_t *)fw->deadline;
+    uint32_t num_result = (fw->crop_count > 0) ? fw->crop_count : 1;
+    uint64_t start_ns = MAX(now_ns, fw->npu_free_ns);
+    uint64_t deadline_ns = fw->recv_ns + (uint64_t)deadline->budget_us * 1000;
+    uint64_t done_ns = start_ns + (uint64_t)num_result * dev->config.npu_time_us * 1000;
+
+    if (!fw->deadline_drop || !fw->has_deadline || done_ns <= deadline_ns)
+        return false;
+
+    sim_message_t *msg = alloc_message(fw, start_ns);
+    if (NULL == msg)
+        return true;
+
+    kdp2_ipc_inf_drop_report_t *report = (kdp2_ipc_inf_drop_report_t *)msg->head;
+
+    memset(report, 0, sizeof(kdp2_ipc_inf_drop_report_t));
+    report->header_stamp.magic_type = KDP2_MAGIC_TYPE_INFERENCE;
+    report->header_stamp.total_size = sizeof(kdp2_ipc_inf_drop_report_t);
+    report->header_stamp.total_image = 1;
+    report->header_stamp.job_id = fw->job_id;
+    report->header_stamp.status_code = KP_FW_INFERENCE_DEADLINE_MISSED_136;
+    report->inference_number = deadline->inference_number;
+    report->model_id = deadline->model_id;
+    report->reason = (start_ns >= deadline_ns) ? KP_INFERENCE_DROP_EXPIRED : KP_INFERENCE_DROP_UNREACHABLE;
+    report->est_inf_time_us = (uint32_t)((done_ns - start_ns) / 1000);
+    report->late_us = (uint32_t)((done_ns - deadline_ns) / 1000);
+
+    msg->head_len = sizeof(kdp2_ipc_inf_drop_report_t);
+    msg->jobs_done = 1;
+
+    dbg_print("[%s] drop inference %u, reason %u\n", __func__, report->inference_number, report->reason);
+
+    dev->stats.num_dropped++;
+
+    return true;
+}
+
+// a crop batch comes out as one result after the NPU time of all crops, each crop in its own generic RAW slot
+static void run_crop_batch_inference(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    const sim_raw_output_t *raw = fw->model_loaded ? get_raw_output(dev->config.product_id) : NULL;
+    uint32_t raw_size = (NULL != raw) ? raw->size : 0;
+    uint32_t crop_result_size = (sizeof(kdp2_ipc_generic_raw_result_t) + raw_size + 3) & ~3;
+    uint32_t total_size = sizeof(kdp2_ipc_generic_raw_crop_batch_result_t) + fw->crop_count * crop_result_size;
+    uint64_t done_ns = MAX(now_ns, fw->npu_free_ns) + (uint64_t)fw->crop_count * dev->config.npu_time_us * 1000;
+
+    kdp2_ipc_generic_raw_crop_batch_result_t batch;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.header_stamp.magic_type = KDP2_MAGIC_TYPE_INFERENCE;
+    batch.header_stamp.job_id = KDP2_INF_ID_GENERIC_RAW_CROP_BATCH;
+    batch.header_stamp.total_size = sizeof(batch);
+    batch.header_stamp.total_image = 1;
+    batch.product_id = dev->config.product_id;
+    batch.inf_number = fw->inf_number;
+    batch.crop_result_size = crop_result_size;
+
+    if (0 == fw->crop_count)
+        batch.header_stamp.status_code = KP_FW_INVALID_INPUT_CROP_PARAM_112;
+    else if (fw->fifoq_allocated && total_size > fw->result_buf_size)
+        batch.header_stamp.status_code = KP_FW_INVALID_INPUT_CROP_PARAM_112;
+    else if (!fw->model_loaded)
+        batch.header_stamp.status_code = KP_ERROR_MODEL_NOT_LOADED_35;
+    else if (NULL == raw)
+        batch.header_stamp.status_code = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+    sim_message_t *msg = alloc_message(fw, done_ns);
+    if (NULL == msg)
+        return;
+
+    msg->jobs_done = 1;
+
+    if (KP_SUCCESS != batch.header_stamp.status_code || NULL == (msg->owned_body = calloc(1, total_size)))
+    {
+        if (KP_SUCCESS == batch.header_stamp.status_code)
+            batch.header_stamp.status_code = KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+
+        memcpy(msg->head, &batch, sizeof(batch));
+        msg->head_len = sizeof(batch);
+        return;
+    }
+
+    batch.header_stamp.total_size = total_size;
+    batch.crop_count = fw->crop_count;
+    memcpy(msg->owned_body, &batch, sizeof(batch));
+
+    for (uint32_t i = 0; i < fw->crop_count; i++)
+    {
+        uint8_t *slot = msg->owned_body + sizeof(batch) + i * crop_result_size;
+        kdp2_ipc_generic_raw_result_t *result = (kdp2_ipc_generic_raw_result_t *)slot;
+
+        result->header_stamp.magic_type = KDP2_MAGIC_TYPE_INFERENCE;
+        result->header_stamp.total_size = sizeof(kdp2_ipc_generic_raw_result_t) + raw_size;
+        result->header_stamp.job_id = KDP2_INF_ID_GENERIC_RAW;
+        result->header_stamp.total_image = 1;
+        result->header_stamp.status_code = KP_SUCCESS;
+        result->num_of_pre_proc_info = 1;
+        memcpy(&result->pre_proc_info[0].crop_area, &fw->crops[i], sizeof(kp_inf_crop_box_t));
+        result->pre_proc_info[0].img_width = fw->crops[i].width;
+        result->pre_proc_info[0].img_height = fw->crops[i].height;
+        result->pre_proc_info[0].resized_img_width = fw->crops[i].width;
+        result->pre_proc_info[0].resized_img_height = fw->crops[i].height;
+        result->pre_proc_info[0].model_input_width = fw->crops[i].width;
+        result->pre_proc_info[0].model_input_height = fw->crops[i].height;
+        result->product_id = dev->config.product_id;
+        result->inf_number = fw->inf_number;
+        result->crop_number = fw->crops[i].crop_number;
+        result->is_last_crop = (i == fw->crop_count - 1) ? 1 : 0;
+
+        memcpy(slot + sizeof(kdp2_ipc_generic_raw_result_t), raw->data, raw_size);
+    }
+
+    msg->body = msg->owned_body;
+    msg->body_len = total_size;
+
+    dev->stats.num_inference += fw->crop_count;
+    dev->stats.npu_busy_us += (uint64_t)fw->crop_count * dev->config.npu_time_us;
+
+    fw->npu_free_ns = done_ns;
+}
+
+// all images of the inference are received, results come out after the NPU time of each crop
+static void run_inference(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+    const sim_raw_output_t *raw = fw->model_loaded ? get_raw_output(dev->config.product_id) : NULL;
+    uint32_t num_result = (fw->crop_count > 0) ? fw->crop_count : 1;
+    uint64_t npu_ns = (uint64_t)dev->config.npu_time_us * 1000;
+    uint64_t done_ns = MAX(now_ns, fw->npu_free_ns);
+
+    for (uint32_t i = 0; i < num_result; i++)
+    {
+        done_ns += npu_ns;
+
+        sim_message_t *msg = alloc_message(fw, done_ns);
+        if (NULL == msg)
+            break;
+
+        kdp2_ipc_generic_raw_result_t *result = (kdp2_ipc_generic_raw_result_t *)msg->head;
+
+        memset(result, 0, sizeof(kdp2_ipc_generic_raw_result_t));
+
+        if (NULL != raw)
+        {
+            msg->body = raw->data;
+            msg->body_len = raw->size;
+        }
+
+        result->header_stamp.magic_type = KDP2_MAGIC_TYPE_INFERENCE;
+        result->header_stamp.total_size = sizeof(kdp2_ipc_generic_raw_result_t) + msg->body_len;
+        result->header_stamp.job_id = fw->job_id;
+        result->header_stamp.total_image = fw->total_image;
+        result->header_stamp.status_code = !fw->model_loaded ? KP_ERROR_MODEL_NOT_LOADED_35 :
+                                           (NULL == raw) ? KP_ERROR_MEMORY_ALLOCATION_FAILURE_9 : KP_SUCCESS;
+        result->num_of_pre_proc_info = fw->num_pre_proc_info;
+        memcpy(result->pre_proc_info, fw->pre_proc_info, fw->num_pre_proc_info * sizeof(kp_hw_pre_proc_info_t));
+        result->product_id = dev->config.product_id;
+        result->inf_number = fw->inf_number;
+        result->crop_number = (fw->crop_count > 0) ? fw->crops[i].crop_number : 0;
+        result->is_last_crop = (i == num_result - 1) ? 1 : 0;
+
+        if (fw->crop_count > 0)
+        {
+            memcpy(&result->pre_proc_info[0].crop_area, &fw->crops[i], sizeof(kp_inf_crop_box_t));
+            result->pre_proc_info[0].model_input_width = fw->crops[i].width;
+            result->pre_proc_info[0].model_input_height = fw->crops[i].height;
+        }
+
+        msg->head_len = sizeof(kdp2_ipc_generic_raw_result_t);
+        msg->jobs_done = result->is_last_crop ? 1 : 0;
+
+        dev->stats.num_inference++;
+        dev->stats.npu_busy_us += dev->config.npu_time_us;
+    }
+
+    fw->npu_free_ns = done_ns;
+}
+
+static void end_skip(sim_device_t *dev, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+
+    fw->parse_state = PARSE_HEADER;
+
+    switch (fw->skip_action)
+    {
+    case SKIP_FW_INFO:
+        send_return_code(fw, KP_SUCCESS, now_ns);
+        start_skip(fw, fw->model_size, SKIP_MODEL);
+        if (0 == fw->model_size)
+            end_skip(dev, now_ns);
+        break;
+    case SKIP_MODEL:
+        fw->model_loaded = true;
+        break;
+    case SKIP_NEF:
+        fw->model_loaded = true;
+        send_return_code(fw, KP_SUCCESS, now_ns);
+        break;
+    case SKIP_IMAGE:
+    {
+        kp_inference_header_stamp_t *stamp = (kp_inference_header_stamp_t *)fw->cmd_buf;
+
+        if ((stamp->image_index + 1 >= fw->total_image) && !fw->job_dropped)
+        {
+            lane_dequeue(fw, now_ns);
+
+            if (drop_late_inference(dev, now_ns))
+                break;
+            else if (KDP2_INF_ID_GENERIC_RAW_CROP_BATCH == fw->job_id)
+                run_crop_batch_inference(dev, now_ns);
+            else
+                run_inference(dev, now_ns);
+        }
+        break;
+    }
+    case SKIP_UNKNOWN_INFERENCE:
+    {
+        kp_inference_header_stamp_t result = *(kp_inference_header_stamp_t *)fw->cmd_buf;
+
+        result.total_size = sizeof(result);
+        result.status_code = KP_FW_ERROR_UNKNOWN_APP;
+        send_response(fw, &result, sizeof(result), now_ns);
+        break;
+    }
+    case SKIP_FLASH_WRITE:
+    {
+        kdp2_ipc_cmd_write_flash_t *cmd = (kdp2_ipc_cmd_write_flash_t *)fw->cmd_buf;
+        uint64_t ready_ns = now_ns + (uint64_t)cmd->length * FLASH_WRITE_NS_PER_KB / 1024;
+
+        send_return_code(fw, fw->flash_write_ok ? KP_SUCCESS : KP_ERROR_INVALID_PARAM_12, ready_ns);
+        break;
+    }
+    case SKIP_FLASH_CHUNK:
+        end_flash_chunk(dev, now_ns);
+        break;
+    }
+}
+
+// *********************************************************************************************** //
+// OUT endpoint and control requests
+// *********************************************************************************************** //
+
+void sim_fw_reset(sim_device_t *dev)
+{
+    sim_fw_drop_results(dev);
+    memset(&dev->fw, 0, sizeof(sim_fw_t));
+}
+
+int sim_fw_write(sim_device_t *dev, const uint8_t *data, int length, uint64_t now_ns)
+{
+    sim_fw_t *fw = &dev->fw;
+
+    if (PARSE_HEADER == fw->parse_state && 0 == fw->cmd_len)
+    {
+        // (fake) zero length packet after a write of a multiple of the packet size
+        if (0 == length || (4 == length && FAKE_ZLP_MAGIC == read_u32(data)))
+            return SIM_FW_OK;
+
+        // a new inference waits for a free buffer unless images are droppable
+        if (length >= (int)sizeof(kp_inference_header_stamp_t) && KDP2_MAGIC_TYPE_INFERENCE == read_u32(data) &&
+            0 == ((kp_inference_header_stamp_t *)data)->image_index &&
+            fw->jobs_in_device >= queue_depth(fw) && !is_droppable(fw))
+            return SIM_FW_BUSY;
+    }
+
+    dev->stats.bytes_out += length;
+
+    while (length > 0)
+    {
+        if (PARSE_SKIP == fw->parse_state)
+        {
+            uint32_t n = MIN(fw->skip_remaining, (uint32_t)length);
+
+            if (SKIP_FLASH_WRITE == fw->skip_action || SKIP_FLASH_CHUNK == fw->skip_action)
+                write_flash_data(dev, data, n);
+            else if (SKIP_IMAGE == fw->skip_action && fw->has_deadline && 0 == ((kp_inference_header_stamp_t *)fw->cmd_buf)->image_index)
+                receive_deadline(fw, data, n);
+
+            data += n;
+            length -= n;
+            fw->skip_remaining -= n;
+
+            if (0 == fw->skip_remaining)
+                end_skip(dev, now_ns);
+
+            continue;
+        }
+
+        uint32_t need = (0 == fw->cmd_need) ? 12 : fw->cmd_need;
+        uint32_t n = MIN(need - fw->cmd_len, (uint32_t)length);
+
+        memcpy(fw->cmd_buf + fw->cmd_len, data, n);
+        fw->cmd_len += n;
+        data += n;
+        length -= n;
+
+        if (fw->cmd_len < need)
+            break;
+
+        if (0 == fw->cmd_need)
+        {
+            fw->cmd_need = command_header_size(fw->cmd_buf);
+
+            if (0 == fw->cmd_need)
+            {
+                dbg_print("[%s] unknown magic 0x%X, drop %d bytes\n", __func__, read_u32(fw->cmd_buf), length + 12);
+                fw->cmd_len = 0;
+                break;
+            }
+
+            if (fw->cmd_len < fw->cmd_need)
+                continue;
+        }
+
+        fw->cmd_len = 0;
+        fw->cmd_need = 0;
+
+        if (KDP2_MAGIC_TYPE_INFERENCE == read_u32(fw->cmd_buf))
+        {
+            handle_inference_header(dev, now_ns);
+            if (0 == fw->skip_remaining)
+                end_skip(dev, now_ns);
+        }
+        else if (KDP2_FLASH_CHUNK_MAGIC == read_u32(fw->cmd_buf))
+        {
+            begin_flash_chunk(dev);
+            start_skip(fw, ((kdp2_flash_chunk_header_t *)fw->cmd_buf)->length, SKIP_FLASH_CHUNK);
+            if (0 == fw->skip_remaining)
+                end_skip(dev, now_ns);
+        }
+        else
+        {
+            handle_command(dev, now_ns);
+            if (PARSE_SKIP == fw->parse_state && 0 == fw->skip_remaining)
+                end_skip(dev, now_ns);
+        }
+    }
+
+    return SIM_FW_OK;
+}
+
+int sim_fw_control(sim_device_t *dev, uint8_t request, uint16_t value, uint16_t index)
+{
+    sim_fw_t *fw = &dev->fw;
+
+    switch (request)
+    {
+    case KDP2_CONTROL_FIFOQ_RESET:
+        sim_fw_drop_results(dev);
+        fw->parse_state = PARSE_HEADER;
+        fw->cmd_len = 0;
+        fw->cmd_need = 0;
+        fw->deadline_drop = false;
+        break;
+    case KDP2_CONTROL_FIFOQ_CONFIGURE:
+        fw->input_buf_count = (value & 0x7) + 1;
+        fw->input_buf_size = ((value >> 3) + 1) * BUFFER_SIZE_10_KB;
+        fw->result_buf_count = (index & 0x7) + 1;
+        fw->result_buf_size = ((index >> 3) + 1) * BUFFER_SIZE_10_KB;
+        fw->fifoq_allocated = true;
+        update_heap_peak(fw);
+        break;
+    case KDP2_CONTROL_FIFOQ_ENABLE_DROPPABLE:
+        fw->droppable = (0 != value);
+        break;
+    case KDP2_CONTROL_FIFOQ_ENABLE_DEADLINE_DROP:
+        fw->deadline_drop = (0 != value);
+        break;
+    case KDP2_CONTROL_FIFOQ_ENABLE_COALESCING:
+    {
+        uint32_t max_size = (uint32_t)value * 1024;
+
+        // the firmware reserves the buffer once per boot
+        if (0 == fw->coalesce_reserved && 0 < max_size)
+        {
+            if (dev->coalesce_buf_size < max_size)
+            {
+                uint8_t *buf = (uint8_t *)realloc(dev->coalesce_buf, max_size);
+                if (NULL == buf)
+                    return LIBUSB_ERROR_PIPE;
+
+                dev->coalesce_buf = buf;
+                dev->coalesce_buf_size = max_size;
+            }
+
+            fw->coalesce_reserved = max_size;
+        }
+
+        if (max_size > fw->coalesce_reserved)
+            return LIBUSB_ERROR_PIPE;
+
+        fw->coalesce_max_size = max_size;
+        update_heap_peak(fw);
+        break;
+    }
+    case KDP2_CONTROL_QUERY_COMMAND:
+        if (KDP2_COMMAND_GET_FLASH_DIGEST != value && KDP2_COMMAND_WRITE_FLASH_STREAM != value)
+            return LIBUSB_ERROR_PIPE;
+        break;
+    case KDP2_CONTROL_FIFOQ_GET_STATUS:
+    case KDP2_CONTROL_DDR_HEAP_BOUNDARY_ADJUST:
+        break;
+    default:
+        return LIBUSB_ERROR_PIPE;
+    }
+
+    return LIBUSB_SUCCESS;
+}
@@ -0,0 +1,975 @@
+/**
+ * @file        libusb_sim.c
+ * @brief       libusb-1.0 API on top of simulated devices
+ *
+ * Transfers are queued per endpoint and completed by whichever thread handles events, callbacks are called outside of
+ * the simulator lock by one thread at a time as libusb does. Time is real (CLOCK_MONOTONIC), a transfer completes when
+ * its latency and transfer time are over and the emulated firmware has accepted or produced the data.
+ *
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "usb_sim_internal.h"
+#include "kdp2_ipc_cmd.h"
+#include "kdp2_inf_generic_raw.h"
+
+// #define DEBUG_PRINT
+
+#ifdef DEBUG_PRINT
+#define dbg_print(format, ...) printf(format, ##__VA_ARGS__)
+#else
+#define dbg_print(format, ...)
+#endif
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+#define VID_KNERON 0x3231
+#define SIM_BUS_NUMBER 1
+#define SIM_SERIAL_STRING_INDEX 3
+#define SIM_DEFAULT_LATENCY_US 50
+#define SIM_DEFAULT_EVENT_TIMEOUT_MS 60000
+#define NS_PER_MS 1000000ULL
+#define NO_DEADLINE UINT64_MAX
+
+typedef struct sim_transfer
+{
+    struct sim_transfer *next;          // in the endpoint queue
+    struct sim_transfer *done_next;     // in the list of transfers to call back
+    sim_device_t *dev;
+    uint64_t submit_ns;
+    uint64_t due_ns;                    // 0 until the transfer is scheduled on the pipe
+    uint64_t deadline_ns;
+    bool queued;
+    bool blocked;                       // the firmware FIFO queue is full
+    bool cancelled;
+    enum libusb_transfer_status cancel_status;
+    struct libusb_transfer pub;
+} sim_transfer_t;
+
+struct libusb_device_handle
+{
+    sim_device_t *dev;
+    uint32_t generation;
+};
+
+static pthread_mutex_t _sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _sim_cond;
+static pthread_once_t _sim_once = PTHREAD_ONCE_INIT;
+
+static sim_device_t *_devices[KP_USB_SIM_MAX_DEVICE];
+static int _num_devices = 0;
+static bool _env_loaded = false;
+static bool _handling_events = false;   // a thread is calling back transfers
+static uint32_t _interrupt_count = 0;
+
+static const struct libusb_endpoint_descriptor _endpoints[] = {
+    {7, 5, SIM_ENDPOINT_BULK_IN, LIBUSB_TRANSFER_TYPE_BULK, 512, 0, 0, 0, NULL, 0},
+    {7, 5, SIM_ENDPOINT_BULK_OUT, LIBUSB_TRANSFER_TYPE_BULK, 512, 0, 0, 0, NULL, 0},
+    {7, 5, SIM_ENDPOINT_INTERRUPT_IN, LIBUSB_TRANSFER_TYPE_INTERRUPT, 64, 1, 0, 0, NULL, 0},
+};
+
+static const struct libusb_interface_descriptor _interface_descriptor = {
+    9, 4, 0, 0, sizeof(_endpoints) / sizeof(_endpoints[0]), 0xFF, 0, 0, 0, _endpoints, NULL, 0};
+
+static const struct libusb_interface _interface = {&_interface_descriptor, 1};
+
+static struct libusb_config_descriptor _config_descriptor = {9, 2, 39, 1, 1, 0, 0x80, 250, &_interface, NULL, 0};
+
+static void init_once(void)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_sim_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void sim_lock(void)
+{
+    pthread_once(&_sim_once, init_once);
+    pthread_mutex_lock(&_sim_mutex);
+}
+
+static void sim_unlock(void)
+{
+    pthread_mutex_unlock(&_sim_mutex);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void wait_until(uint64_t wake_ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(wake_ns / 1000000000ULL);
+    ts.tv_nsec = (long)(wake_ns % 1000000000ULL);
+
+    pthread_cond_timedwait(&_sim_cond, &_sim_mutex, &ts);
+}
+
+static inline sim_transfer_t *to_sim_transfer(struct libusb_transfer *transfer)
+{
+    return (sim_transfer_t *)((uint8_t *)transfer - offsetof(sim_transfer_t, pub));
+}
+
+// latency plus time on the wire
+static uint64_t transfer_time_ns(sim_device_t *dev, uint32_t length)
+{
+    return (uint64_t)dev->config.latency_us * 1000 + (uint64_t)length * 1000 / dev->config.bandwidth_mbps;
+}
+
+static bool handle_is_valid(libusb_device_handle *dev_handle)
+{
+    return (NULL != dev_handle) && (dev_handle->generation == dev_handle->dev->generation);
+}
+
+// *********************************************************************************************** //
+// transfer queues
+// *********************************************************************************************** //
+
+static void queue_push(sim_transfer_t **head, sim_transfer_t **tail, sim_transfer_t *st)
+{
+    st->next = NULL;
+
+    if (NULL == *tail)
+        *head = st;
+    else
+        (*tail)->next = st;
+
+    *tail = st;
+}
+
+static void queue_pop(sim_transfer_t **head, sim_transfer_t **tail)
+{
+    *head = (*head)->next;
+
+    if (NULL == *head)
+        *tail = NULL;
+}
+
+static void finish_transfer(sim_transfer_t *st, enum libusb_transfer_status status, int actual_length, sim_transfer_t ***done_tail)
+{
+    st->queued = false;
+    st->pub.status = status;
+    st->pub.actual_length = actual_length;
+    st->done_next = NULL;
+
+    **done_tail = st;
+    *done_tail = &st->done_next;
+}
+
+static bool is_expired(sim_transfer_t *st, uint64_t now)
+{
+    return (NO_DEADLINE != st->deadline_ns) && (now >= st->deadline_ns);
+}
+
+// complete or time out the head transfers of each endpoint, returns true if any transfer finished
+static bool process_device(sim_device_t *dev, uint64_t now, uint64_t *wake_ns, sim_transfer_t ***done_tail)
+{
+    bool progress = false;
+    sim_transfer_t *st;
+
+    // IN endpoint first, a result read may free the FIFO queue for a blocked write
+    while (NULL != (st = dev->in_head))
+    {
+        uint64_t ready_ns;
+        uint32_t avail;
+
+        if (st->cancelled)
+        {
+            queue_pop(&dev->in_head, &dev->in_tail);
+            finish_transfer(st, st->cancel_status, 0, done_tail);
+            progress = true;
+            continue;
+        }
+
+        if (!sim_fw_in_ready(dev, &ready_ns, &avail))
+        {
+            st->due_ns = 0;
+        }
+        else if (0 == st->due_ns)
+        {
+            uint64_t start_ns = MAX(MAX(ready_ns, st->submit_ns), dev->in_busy_ns);
+
+            // results done by the time the transfer starts may be packed into it
+            if (sim_fw_coalesce_results(dev, start_ns))
+                sim_fw_in_ready(dev, &ready_ns, &avail);
+
+            st->due_ns = start_ns + transfer_time_ns(dev, MIN(avail, (uint32_t)st->pub.length));
+            dev->in_busy_ns = st->due_ns;
+        }
+
+        if (0 != st->due_ns && now >= st->due_ns)
+        {
+            int n = sim_fw_read(dev, st->pub.buffer, st->pub.length);
+
+            queue_pop(&dev->in_head, &dev->in_tail);
+            finish_transfer(st, LIBUSB_TRANSFER_COMPLETED, n, done_tail);
+            progress = true;
+            continue;
+        }
+
+        if (is_expired(st, now))
+        {
+            queue_pop(&dev->in_head, &dev->in_tail);
+            finish_transfer(st, LIBUSB_TRANSFER_TIMED_OUT, 0, done_tail);
+            progress = true;
+            continue;
+        }
+
+        if (0 != st->due_ns)
+            *wake_ns = MIN(*wake_ns, st->due_ns);
+        *wake_ns = MIN(*wake_ns, st->deadline_ns);
+        break;
+    }
+
+    while (NULL != (st = dev->out_head))
+    {
+        if (st->cancelled)
+        {
+            queue_pop(&dev->out_head, &dev->out_tail);
+            finish_transfer(st, st->cancel_status, 0, done_tail);
+            progress = true;
+            continue;
+        }
+
+        if (0 == st->due_ns)
+        {
+            st->due_ns = MAX(st->submit_ns, dev->out_busy_ns) + transfer_time_ns(dev, st->pub.length);
+            dev->out_busy_ns = st->due_ns;
+        }
+
+        if (now >= st->due_ns)
+        {
+            if (SIM_FW_OK == sim_fw_write(dev, st->pub.buffer, st->pub.length, st->blocked ? now : st->due_ns))
+            {
+                if (st->blocked)
+                    dev->out_busy_ns = MAX(dev->out_busy_ns, now);
+
+                queue_pop(&dev->out_head, &dev->out_tail);
+                finish_transfer(st, LIBUSB_TRANSFER_COMPLETED, st->pub.length, done_tail);
+                progress = true;
+                continue;
+            }
+
+            // FIFO queue is full, wait for a result to be read
+            st->blocked = true;
+        }
+
+        if (is_expired(st, now))
+        {
+            queue_pop(&dev->out_head, &dev->out_tail);
+            finish_transfer(st, LIBUSB_TRANSFER_TIMED_OUT, 0, done_tail);
+            progress = true;
+            continue;
+        }
+
+        if (!st->blocked)
+            *wake_ns = MIN(*wake_ns, st->due_ns);
+        *wake_ns = MIN(*wake_ns, st->deadline_ns);
+        break;
+    }
+
+    // nothing is ever sent to the interrupt endpoint (firmware log)
+    while (NULL != (st = dev->intr_head))
+    {
+        if (st->cancelled || is_expired(st, now))
+        {
+            queue_pop(&dev->intr_head, &dev->intr_tail);
+            finish_transfer(st, st->cancelled ? st->cancel_status : LIBUSB_TRANSFER_TIMED_OUT, 0, done_tail);
+            progress = true;
+            continue;
+        }
+
+        *wake_ns = MIN(*wake_ns, st->deadline_ns);
+        break;
+    }
+
+    return progress;
+}
+
+static void cancel_queue(sim_transfer_t *st, enum libusb_transfer_status status)
+{
+    for (; NULL != st; st = st->next)
+    {
+        if (!st->cancelled)
+        {
+            st->cancelled = true;
+            st->cancel_status = status;
+        }
+    }
+}
+
+// the device drops off the bus and comes back with a fresh firmware state
+static void reboot_device(sim_device_t *dev)
+{
+    cancel_queue(dev->in_head, LIBUSB_TRANSFER_NO_DEVICE);
+    cancel_queue(dev->out_head, LIBUSB_TRANSFER_NO_DEVICE);
+    cancel_queue(dev->intr_head, LIBUSB_TRANSFER_NO_DEVICE);
+
+    dev->generation++;
+    dev->out_busy_ns = 0;
+    dev->in_busy_ns = 0;
+
+    sim_fw_reset(dev);
+
+    pthread_cond_broadcast(&_sim_cond);
+}
+
+// *********************************************************************************************** //
+// devices
+// *********************************************************************************************** //
+
+static int add_device_locked(const kp_usb_sim_device_config_t *config)
+{
+    if (_num_devices >= KP_USB_SIM_MAX_DEVICE)
+        return LIBUSB_ERROR_OVERFLOW;
+
+    sim_device_t *dev = (sim_device_t *)calloc(1, sizeof(sim_device_t));
+    if (NULL == dev)
+        return LIBUSB_ERROR_NO_MEM;
+
+    bool is_kl520 = (KP_DEVICE_KL520 == config->product_id);
+
+    dev->config = *config;
+    dev->bus_number = SIM_BUS_NUMBER;
+    dev->port_number = (uint8_t)(_num_devices + 1);
+    dev->port_id = (dev->bus_number & 0x3) | ((uint32_t)dev->port_number << 2);
+    dev->fw_serial = KP_KDP2_FW_FLASH_TYPE_V2 | KP_KDP2_FW_COMPANION_MODE_V2;
+    dev->speed = is_kl520 ? LIBUSB_SPEED_HIGH : LIBUSB_SPEED_SUPER;
+    dev->max_psize = is_kl520 ? 512 : 1024;
+
+    if (0 == dev->config.kn_number)
+        dev->config.kn_number = 0x5A000000 | dev->port_id;
+    if (0 == dev->config.latency_us)
+        dev->config.latency_us = SIM_DEFAULT_LATENCY_US;
+    if (0 == dev->config.bandwidth_mbps)
+        dev->config.bandwidth_mbps = is_kl520 ? 35 : 300;
+    if (0 == dev->config.npu_time_us)
+        dev->config.npu_time_us = is_kl520 ? 10000 : (KP_DEVICE_KL720 == config->product_id) ? 4000 : 5000;
+
+    _devices[_num_devices++] = dev;
+
+    return (int)dev->port_id;
+}
+
+static uint32_t get_env_u32(const char *name)
+{
+    const char *value = getenv(name);
+    return (NULL == value) ? 0 : (uint32_t)strtoul(value, NULL, 0);
+}
+
+static void load_devices_from_env(void)
+{
+    const char *devices = getenv("KP_USB_SIM_DEVICES");
+    char names[256];
+    char *save_ptr = NULL;
+
+    snprintf(names, sizeof(names), "%s", (NULL != devices) ? devices : "KL520");
+
+    for (char *name = strtok_r(names, ", ", &save_ptr); NULL != name; name = strtok_r(NULL, ", ", &save_ptr))
+    {
+        kp_usb_sim_device_config_t config = {0};
+
+        if (0 == strcasecmp(name, "KL520"))
+            config.product_id = KP_DEVICE_KL520;
+        else if (0 == strcasecmp(name, "KL720"))
+            config.product_id = KP_DEVICE_KL720;
+        else if (0 == strcasecmp(name, "KL630"))
+            config.product_id = KP_DEVICE_KL630;
+        else
+        {
+            printf("[usb_sim] unknown device '%s' in KP_USB_SIM_DEVICES\n", name);
+            continue;
+        }
+
+        config.latency_us = get_env_u32("KP_USB_SIM_LATENCY_US");
+        config.bandwidth_mbps = get_env_u32("KP_USB_SIM_BANDWIDTH_MBPS");
+        config.npu_time_us = get_env_u32("KP_USB_SIM_NPU_US");
+
+        add_device_locked(&config);
+    }
+}
+
+int kp_usb_sim_add_device(const kp_usb_sim_device_config_t *config)
+{
+    // only chips whose RAW result layout is emulated
+    if (NULL == config || 0 == sim_fw_raw_output_size(config->product_id, 0, NULL))
+        return LIBUSB_ERROR_INVALID_PARAM;
+
+    sim_lock();
+    _env_loaded = true;
+    int ret = add_device_locked(config);
+    sim_unlock();
+
+    return ret;
+}
+
+void kp_usb_sim_remove_all_devices(void)
+{
+    sim_lock();
+
+    for (int i = 0; i < _num_devices; i++)
+    {
+        sim_fw_drop_results(_devices[i]);
+        free(_devices[i]->flash);
+        free(_devices[i]->coalesce_buf);
+        free(_devices[i]);
+        _devices[i] = NULL;
+    }
+
+    _num_devices = 0;
+    _env_loaded = true;
+
+    sim_unlock();
+}
+
+int kp_usb_sim_set_output_nodes(int num_node, const kp_usb_sim_output_node_t nodes[])
+{
+    sim_lock();
+
+    int ret = sim_fw_set_output_nodes(num_node, nodes);
+
+    if (LIBUSB_SUCCESS == ret)
+    {
+        for (int i = 0; i < _num_devices; i++)
+            sim_fw_drop_results(_devices[i]);
+    }
+
+    sim_unlock();
+
+    return ret;
+}
+
+uint32_t kp_usb_sim_get_result_size(uint16_t product_id, int num_node, const kp_usb_sim_output_node_t nodes[])
+{
+    uint32_t raw_size = sim_fw_raw_output_size(product_id, num_node, nodes);
+    return (0 == raw_size) ? 0 : (uint32_t)(sizeof(kdp2_ipc_generic_raw_result_t) + raw_size);
+}
+
+int kp_usb_sim_get_statistics(uint32_t port_id, kp_usb_sim_statistics_t *stats)
+{
+    int ret = LIBUSB_ERROR_NOT_FOUND;
+
+    sim_lock();
+
+    for (int i = 0; i < _num_devices; i++)
+    {
+        if (_devices[i]->port_id == port_id)
+        {
+            *stats = _devices[i]->stats;
+            ret = LIBUSB_SUCCESS;
+            break;
+        }
+    }
+
+    sim_unlock();
+
+    return ret;
+}
+
+// *********************************************************************************************** //
+// libusb API
+// *********************************************************************************************** //
+
+int LIBUSB_CALL libusb_init(libusb_context **ctx)
+{
+    if (NULL != ctx)
+        *ctx = NULL;
+
+    sim_lock();
+
+    if (!_env_loaded && 0 == _num_devices)
+        load_devices_from_env();
+
+    _env_loaded = true;
+
+    sim_unlock();
+
+    return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_exit(libusb_context *ctx)
+{
+    (void)ctx;
+}
+
+const char *LIBUSB_CALL libusb_error_name(int errcode)
+{
+    switch (errcode)
+    {
+    case LIBUSB_SUCCESS:
+        return "LIBUSB_SUCCESS";
+    case LIBUSB_ERROR_IO:
+        return "LIBUSB_ERROR_IO";
+    case LIBUSB_ERROR_INVALID_PARAM:
+        return "LIBUSB_ERROR_INVALID_PARAM";
+    case LIBUSB_ERROR_ACCESS:
+        return "LIBUSB_ERROR_ACCESS";
+    case LIBUSB_ERROR_NO_DEVICE:
+        return "LIBUSB_ERROR_NO_DEVICE";
+    case LIBUSB_ERROR_NOT_FOUND:
+        return "LIBUSB_ERROR_NOT_FOUND";
+    case LIBUSB_ERROR_BUSY:
+        return "LIBUSB_ERROR_BUSY";
+    case LIBUSB_ERROR_TIMEOUT:
+        return "LIBUSB_ERROR_TIMEOUT";
+    case LIBUSB_ERROR_OVERFLOW:
+        return "LIBUSB_ERROR_OVERFLOW";
+    case LIBUSB_ERROR_PIPE:
+        return "LIBUSB_ERROR_PIPE";
+    case LIBUSB_ERROR_INTERRUPTED:
+        return "LIBUSB_ERROR_INTERRUPTED";
+    case LIBUSB_ERROR_NO_MEM:
+        return "LIBUSB_ERROR_NO_MEM";
+    case LIBUSB_ERROR_NOT_SUPPORTED:
+        return "LIBUSB_ERROR_NOT_SUPPORTED";
+    default:
+        return "LIBUSB_ERROR_OTHER";
+    }
+}
+
+const char *LIBUSB_CALL libusb_strerror(int errcode)
+{
+    return libusb_error_name(errcode);
+}
+
+ssize_t LIBUSB_CALL libusb_get_device_list(libusb_context *ctx, libusb_device ***list)
+{
+    (void)ctx;
+
+    sim_lock();
+
+    libusb_device **devs = (libusb_device **)calloc(_num_devices + 1, sizeof(libusb_device *));
+    ssize_t count = _num_devices;
+
+    if (NULL == devs)
+        count = LIBUSB_ERROR_NO_MEM;
+    else
+        memcpy(devs, _devices, _num_devices * sizeof(libusb_device *));
+
+    sim_unlock();
+
+    *list = devs;
+
+    return count;
+}
+
+void LIBUSB_CALL libusb_free_device_list(libusb_device **list, int unref_devices)
+{
+    (void)unref_devices;
+    free(list);
+}
+
+int LIBUSB_CALL libusb_get_device_descriptor(libusb_device *dev, struct libusb_device_descriptor *desc)
+{
+    memset(desc, 0, sizeof(struct libusb_device_descriptor));
+
+    desc->bLength = 18;
+    desc->bDescriptorType = 1;
+    desc->bcdUSB = (LIBUSB_SPEED_HIGH == dev->speed) ? 0x0200 : 0x0300;
+    desc->bMaxPacketSize0 = 64;
+    desc->idVendor = VID_KNERON;
+    desc->idProduct = dev->config.product_id;
+    desc->bcdDevice = dev->fw_serial;
+    desc->iSerialNumber = SIM_SERIAL_STRING_INDEX;
+    desc->bNumConfigurations = 1;
+
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_get_config_descriptor(libusb_device *dev, uint8_t config_index, struct libusb_config_descriptor **config)
+{
+    (void)dev;
+
+    if (0 != config_index)
+        return LIBUSB_ERROR_NOT_FOUND;
+
+    *config = &_config_descriptor;
+
+    return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_free_config_descriptor(struct libusb_config_descriptor *config)
+{
+    (void)config;
+}
+
+uint8_t LIBUSB_CALL libusb_get_bus_number(libusb_device *dev)
+{
+    return dev->bus_number;
+}
+
+int LIBUSB_CALL libusb_get_port_numbers(libusb_device *dev, uint8_t *port_numbers, int port_numbers_len)
+{
+    if (port_numbers_len < 1)
+        return LIBUSB_ERROR_OVERFLOW;
+
+    port_numbers[0] = dev->port_number;
+
+    return 1;
+}
+
+int LIBUSB_CALL libusb_get_device_speed(libusb_device *dev)
+{
+    return dev->speed;
+}
+
+int LIBUSB_CALL libusb_open(libusb_device *dev, libusb_device_handle **dev_handle)
+{
+    libusb_device_handle *handle = (libusb_device_handle *)malloc(sizeof(libusb_device_handle));
+    if (NULL == handle)
+        return LIBUSB_ERROR_NO_MEM;
+
+    sim_lock();
+    handle->dev = dev;
+    handle->generation = dev->generation;
+    sim_unlock();
+
+    *dev_handle = handle;
+
+    return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_close(libusb_device_handle *dev_handle)
+{
+    free(dev_handle);
+}
+
+int LIBUSB_CALL libusb_get_string_descriptor_ascii(libusb_device_handle *dev_handle, uint8_t desc_index, unsigned char *data, int length)
+{
+    char serial[16];
+
+    if (SIM_SERIAL_STRING_INDEX != desc_index)
+        return LIBUSB_ERROR_PIPE;
+
+    snprintf(serial, sizeof(serial), "%08X", dev_handle->dev->config.kn_number);
+
+    int n = MIN((int)strlen(serial), length - 1);
+
+    memcpy(data, serial, n);
+    data[n] = 0;
+
+    return n;
+}
+
+int LIBUSB_CALL libusb_get_configuration(libusb_device_handle *dev_handle, int *config)
+{
+    (void)dev_handle;
+    *config = 1;
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_set_configuration(libusb_device_handle *dev_handle, int configuration)
+{
+    (void)dev_handle;
+    return (1 == configuration) ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+
+int LIBUSB_CALL libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number)
+{
+    (void)dev_handle;
+    return (0 == interface_number) ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+
+int LIBUSB_CALL libusb_attach_kernel_driver(libusb_device_handle *dev_handle, int interface_number)
+{
+    (void)dev_handle;
+    (void)interface_number;
+    return LIBUSB_ERROR_NOT_SUPPORTED;
+}
+
+int LIBUSB_CALL libusb_reset_device(libusb_device_handle *dev_handle)
+{
+    (void)dev_handle;
+    return LIBUSB_SUCCESS;
+}
+
+unsigned char *LIBUSB_CALL libusb_dev_mem_alloc(libusb_device_handle *dev_handle, size_t length)
+{
+    // no DMA-able memory, the SDK falls back to normal heap buffers
+    (void)dev_handle;
+    (void)length;
+    return NULL;
+}
+
+int LIBUSB_CALL libusb_dev_mem_free(libusb_device_handle *dev_handle, unsigned char *buffer, size_t length)
+{
+    (void)dev_handle;
+    (void)buffer;
+    (void)length;
+    return LIBUSB_ERROR_INVALID_PARAM;
+}
+
+int LIBUSB_CALL libusb_control_transfer(libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest, uint16_t wValue,
+                                        uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout)
+{
+    (void)data;
+    (void)timeout;
+
+    int ret;
+
+    sim_lock();
+
+    if (!handle_is_valid(dev_handle))
+    {
+        ret = LIBUSB_ERROR_NO_DEVICE;
+    }
+    else if ((LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE) != request_type || 0 != wLength)
+    {
+        ret = LIBUSB_ERROR_PIPE;
+    }
+    else if (KDP2_CONTROL_REBOOT == bRequest || KDP2_CONTROL_SHUTDOWN == bRequest || KDP2_CONTROL_REBOOT_SYSTEM == bRequest)
+    {
+        reboot_device(dev_handle->dev);
+        ret = LIBUSB_SUCCESS;
+    }
+    else
+    {
+        ret = sim_fw_control(dev_handle->dev, bRequest, wValue, wIndex);
+    }
+
+    sim_unlock();
+
+    return ret;
+}
+
+struct libusb_transfer *LIBUSB_CALL libusb_alloc_transfer(int iso_packets)
+{
+    if (0 != iso_packets)
+        return NULL;
+
+    sim_transfer_t *st = (sim_transfer_t *)calloc(1, sizeof(sim_transfer_t));
+
+    return (NULL == st) ? NULL : &st->pub;
+}
+
+void LIBUSB_CALL libusb_free_transfer(struct libusb_transfer *transfer)
+{
+    if (NULL != transfer)
+        free(to_sim_transfer(transfer));
+}
+
+static int submit_transfer_locked(sim_transfer_t *st)
+{
+    libusb_device_handle *dev_handle = st->pub.dev_handle;
+
+    if (!handle_is_valid(dev_handle))
+        return LIBUSB_ERROR_NO_DEVICE;
+
+    if (st->queued)
+        return LIBUSB_ERROR_BUSY;
+
+    sim_device_t *dev = dev_handle->dev;
+    uint64_t now = now_ns();
+
+    st->dev = dev;
+    st->submit_ns = now;
+    st->due_ns = 0;
+    st->deadline_ns = (0 == st->pub.timeout) ? NO_DEADLINE : now + (uint64_t)st->pub.timeout * NS_PER_MS;
+    st->blocked = false;
+    st->cancelled = false;
+    st->pub.actual_length = 0;
+
+    if (SIM_ENDPOINT_BULK_OUT == st->pub.endpoint && LIBUSB_TRANSFER_TYPE_BULK == st->pub.type)
+        queue_push(&dev->out_head, &dev->out_tail, st);
+    else if (SIM_ENDPOINT_BULK_IN == st->pub.endpoint && LIBUSB_TRANSFER_TYPE_BULK == st->pub.type)
+        queue_push(&dev->in_head, &dev->in_tail, st);
+    else if (SIM_ENDPOINT_INTERRUPT_IN == st->pub.endpoint && LIBUSB_TRANSFER_TYPE_INTERRUPT == st->pub.type)
+        queue_push(&dev->intr_head, &dev->intr_tail, st);
+    else
+        return LIBUSB_ERROR_NOT_FOUND;
+
+    st->queued = true;
+
+    pthread_cond_broadcast(&_sim_cond);
+
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_submit_transfer(struct libusb_transfer *transfer)
+{
+    sim_lock();
+    int ret = submit_transfer_locked(to_sim_transfer(transfer));
+    sim_unlock();
+
+    return ret;
+}
+
+int LIBUSB_CALL libusb_cancel_transfer(struct libusb_transfer *transfer)
+{
+    sim_transfer_t *st = to_sim_transfer(transfer);
+    int ret = LIBUSB_ERROR_NOT_FOUND;
+
+    sim_lock();
+
+    if (st->queued && !st->cancelled)
+    {
+        st->cancelled = true;
+        st->cancel_status = LIBUSB_TRANSFER_CANCELLED;
+        pthread_cond_broadcast(&_sim_cond);
+        ret = LIBUSB_SUCCESS;
+    }
+
+    sim_unlock();
+
+    return ret;
+}
+
+static int handle_events(uint64_t timeout_ns, int *completed)
+{
+    uint64_t deadline = now_ns() + timeout_ns;
+
+    sim_lock();
+
+    uint32_t interrupt_count = _interrupt_count;
+
+    while (NULL == completed || !*completed)
+    {
+        uint64_t now = now_ns();
+        uint64_t wake_ns = deadline;
+
+        if (!_handling_events)
+        {
+            sim_transfer_t *done_head = NULL;
+            sim_transfer_t **done_tail = &done_head;
+            bool progress;
+
+            do
+            {
+                progress = false;
+                for (int i = 0; i < _num_devices; i++)
+                    progress |= process_device(_devices[i], now, &wake_ns, &done_tail);
+            } while (progress);
+
+            if (NULL != done_head)
+            {
+                // transfers may be resubmitted or freed in callbacks
+                _handling_events = true;
+                sim_unlock();
+
+                while (NULL != done_head)
+                {
+                    sim_transfer_t *st = done_head;
+                    done_head = st->done_next;
+
+                    if (NULL != st->pub.callback)
+                        st->pub.callback(&st->pub);
+                }
+
+                sim_lock();
+                _handling_events = false;
+                pthread_cond_broadcast(&_sim_cond);
+                break;
+            }
+        }
+
+        if (interrupt_count != _interrupt_count || now >= deadline)
+            break;
+
+        wait_until(wake_ns);
+    }
+
+    sim_unlock();
+
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_handle_events_completed(libusb_context *ctx, int *completed)
+{
+    (void)ctx;
+    return handle_events(SIM_DEFAULT_EVENT_TIMEOUT_MS * NS_PER_MS, completed);
+}
+
+int LIBUSB_CALL libusb_handle_events_timeout_completed(libusb_context *ctx, struct timeval *tv, int *completed)
+{
+    (void)ctx;
+    return handle_events((uint64_t)tv->tv_sec * 1000000000ULL + (uint64_t)tv->tv_usec * 1000, completed);
+}
+
+void LIBUSB_CALL libusb_interrupt_event_handler(libusb_context *ctx)
+{
+    (void)ctx;
+
+    sim_lock();
+    _interrupt_count++;
+    pthread_cond_broadcast(&_sim_cond);
+    sim_unlock();
+}
+
+// *********************************************************************************************** //
+// synchronous transfers
+// *********************************************************************************************** //
+
+static void LIBUSB_CALL sync_transfer_cb(struct libusb_transfer *transfer)
+{
+    *(int *)transfer->user_data = 1;
+}
+
+static int do_sync_transfer(libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char type, unsigned char *data,
+                            int length, int *actual_length, unsigned int timeout)
+{
+    sim_transfer_t st;
+    int completed = 0;
+
+    memset(&st, 0, sizeof(st));
+    libusb_fill_bulk_transfer(&st.pub, dev_handle, endpoint, data, length, sync_transfer_cb, &completed, timeout);
+    st.pub.type = type;
+
+    int ret = libusb_submit_transfer(&st.pub);
+    if (LIBUSB_SUCCESS != ret)
+        return ret;
+
+    while (!completed)
+        libusb_handle_events_completed(NULL, &completed);
+
+    if (NULL != actual_length)
+        *actual_length = st.pub.actual_length;
+
+    switch (st.pub.status)
+    {
+    case LIBUSB_TRANSFER_COMPLETED:
+        return LIBUSB_SUCCESS;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+        return LIBUSB_ERROR_TIMEOUT;
+    case LIBUSB_TRANSFER_STALL:
+        return LIBUSB_ERROR_PIPE;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+        return LIBUSB_ERROR_NO_DEVICE;
+    case LIBUSB_TRANSFER_OVERFLOW:
+        return LIBUSB_ERROR_OVERFLOW;
+    default:
+        return LIBUSB_ERROR_IO;
+    }
+}
+
+int LIBUSB_CALL libusb_bulk_transfer(libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *data, int length,
+                                     int *actual_length, unsigned int timeout)
+{
+    return do_sync_transfer(dev_handle, endpoint, LIBUSB_TRANSFER_TYPE_BULK, data, length, actual_length, timeout);
+}
+
+int LIBUSB_CALL libusb_interrupt_transfer(libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *data, int length,
+                                          int *actual_length, unsigned int timeout)
+{
+    return do_sync_transfer(dev_handle, endpoint, LIBUSB_TRANSFER_TYPE_INTERRUPT, data, length, actual_length, timeout);
+}
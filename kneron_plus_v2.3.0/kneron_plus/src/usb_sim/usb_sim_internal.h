@@ -0,0 +1,164 @@
+/**
+ * @file        usb_sim_internal.h
+ * @brief       internal data structures of the USB device simulator
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#ifndef __USB_SIM_INTERNAL_H__
+#define __USB_SIM_INTERNAL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libusb-1.0/libusb.h>
+
+#include "kp_struct.h"
+#include "kdp2_ipc_cmd.h"
+#include "kp_usb_sim.h"
+
+#define SIM_ENDPOINT_BULK_IN 0x81
+#define SIM_ENDPOINT_BULK_OUT 0x02
+#define SIM_ENDPOINT_INTERRUPT_IN 0x83
+
+#define SIM_MAX_MESSAGE 32          // responses and results queued to the host
+#define SIM_MESSAGE_HEAD_SIZE 512   // per message bytes, a result refers to the shared canned RAW data after it
+#define SIM_COMMAND_BUF_SIZE 2048   // largest command or inference header
+
+#define SIM_FW_OK 0
+#define SIM_FW_BUSY 1               // FIFO queue is full, the OUT transfer has to wait
+
+// one response or result queued to the host, 'head' followed by 'body'
+typedef struct
+{
+    uint64_t ready_ns;              // when the firmware has it ready to be sent
+    uint32_t head_len;
+    uint32_t body_len;
+    const uint8_t *body;
+    uint8_t *owned_body;            // body allocated for this message only, freed when it is sent or dropped
+    uint32_t offset;                // bytes already sent
+    uint32_t jobs_done;             // FIFO queue slots released after it is sent
+    uint8_t head[SIM_MESSAGE_HEAD_SIZE];
+} sim_message_t;
+
+// canned RAW output data of one chip, shared by all results
+typedef struct
+{
+    uint8_t *data;
+    uint32_t size;
+} sim_raw_output_t;
+
+// state of the emulated KDP2 firmware
+typedef struct
+{
+    // OUT stream parser
+    int parse_state;
+    uint8_t cmd_buf[SIM_COMMAND_BUF_SIZE];
+    uint32_t cmd_len;
+    uint32_t cmd_need;
+    uint32_t skip_remaining;
+    int skip_action;
+
+    // model and FIFO queue
+    bool model_loaded;
+    uint32_t model_size;
+    bool fifoq_allocated;
+    uint32_t input_buf_count;
+    uint32_t input_buf_size;
+    uint32_t result_buf_count;
+    uint32_t result_buf_size;
+    bool droppable;
+    bool deadline_drop;             // drop images which can not be inferenced before their deadlines, replaces 'droppable'
+    uint32_t coalesce_reserved;     // size of the coalescing buffer reserved since reboot
+    uint32_t coalesce_max_size;     // maximum size of a coalesced transfer, 0 for coalescing disabled
+    uint32_t heap_peak_used;        // high-water mark of the DDR heap usage since reboot
+    kp_inference_lane_config_t lane_config;
+    kp_inference_lane_stats_t lane_stats[KP_MAX_INFERENCE_LANE];
+    uint64_t lane_total_wait_us[KP_MAX_INFERENCE_LANE];
+
+    // inference being received
+    uint32_t job_id;
+    uint32_t inf_number;
+    uint32_t total_image;
+    uint32_t lane;                  // inference lane from the tag in 'status_code' of the header stamp
+    bool job_dropped;
+    bool has_deadline;              // the first image ends with a kdp2_ipc_inf_deadline_t
+    uint64_t recv_ns;               // when the header of the first image is received
+    uint8_t deadline[sizeof(kdp2_ipc_inf_deadline_t)];
+    uint32_t num_pre_proc_info;
+    kp_hw_pre_proc_info_t pre_proc_info[KP_MAX_INPUT_NODE_COUNT];
+    uint32_t crop_count;
+    kp_inf_crop_box_t crops[MAX_CROP_BATCH_BOX];
+
+    uint32_t jobs_in_device;        // inferences received but not all of whose results are sent
+    uint64_t npu_free_ns;
+
+    // flash command being received
+    uint32_t flash_write_addr;
+    bool flash_write_ok;
+    kdp2_ipc_response_flash_digest_t flash_digest;
+
+    // flash write stream
+    uint32_t stream_addr;           // flash address of the first chunk
+    uint32_t stream_chunk_size;
+    uint32_t stream_num_chunk;
+    uint32_t stream_next_chunk;
+    uint32_t stream_sts;            // first failure of the stream, later chunks are not written
+    uint64_t flash_free_ns;         // when the flash finishes programming the chunks in flight
+
+    // messages to the host
+    sim_message_t msg[SIM_MAX_MESSAGE];
+    int msg_head;
+    int msg_count;
+    bool zlp_pending;
+} sim_fw_t;
+
+struct sim_transfer;
+
+// a simulated device, also the opaque libusb_device
+struct libusb_device
+{
+    kp_usb_sim_device_config_t config;
+    uint32_t port_id;
+    uint8_t bus_number;
+    uint8_t port_number;
+    uint16_t fw_serial;
+    int speed;
+    int max_psize;
+    uint32_t generation;            // increased by reboot, handles opened before become invalid
+
+    uint64_t out_busy_ns;           // the OUT pipe is busy until this time
+    uint64_t in_busy_ns;            // the IN pipe is busy until this time
+
+    struct sim_transfer *out_head;  // pending transfers of each endpoint
+    struct sim_transfer *out_tail;
+    struct sim_transfer *in_head;
+    struct sim_transfer *in_tail;
+    struct sim_transfer *intr_head;
+    struct sim_transfer *intr_tail;
+
+    sim_fw_t fw;
+    uint8_t *flash;                 // emulated flash, allocated by the first flash command
+    uint8_t *coalesce_buf;          // coalesced results being sent, kept over reboots to be reused
+    uint32_t coalesce_buf_size;
+    kp_usb_sim_statistics_t stats;
+};
+
+typedef struct libusb_device sim_device_t;
+
+// firmware emulation, all functions are called with the simulator lock held
+void sim_fw_reset(sim_device_t *dev);
+int sim_fw_write(sim_device_t *dev, const uint8_t *data, int length, uint64_t now_ns);
+int sim_fw_control(sim_device_t *dev, uint8_t request, uint16_t value, uint16_t index);
+bool sim_fw_in_ready(sim_device_t *dev, uint64_t *ready_ns, uint32_t *length);
+bool sim_fw_coalesce_results(sim_device_t *dev, uint64_t start_ns);
+int sim_fw_read(sim_device_t *dev, uint8_t *buf, int length);
+void sim_fw_drop_results(sim_device_t *dev);
+
+int sim_fw_set_output_nodes(int num_node, const kp_usb_sim_output_node_t nodes[]);
+uint32_t sim_fw_raw_output_size(uint16_t product_id, int num_node, const kp_usb_sim_output_node_t nodes[]);
+void sim_fw_release_output(void);
+
+#endif
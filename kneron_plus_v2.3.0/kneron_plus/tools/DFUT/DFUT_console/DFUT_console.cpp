@@ -78,6 +78,10 @@ void DisplayHelpMessage()
     std::cout << "    --type                : [argument required]   type of device (\"KL520\", \"KL630\", \"KL720\", \"KL730\" or \"KL830\")" << std::endl;
     std::cout << "    --port                : [argument required]   port id set (\"all\" or specified multiple port ids \"13,537\")" << std::endl;
     std::cout << std::endl;
+    std::cout << "[Only write flash sectors which differ] (Works with --kl520-flash-boot, and --model-to-flash of KL520 and KL720)" << std::endl;
+    std::cout << "    --sector-diff         : [no argument]         compare flash sectors with the files and only write changed ones" << std::endl;
+    std::cout << "    --journal             : [argument required]   folder of the journal file to resume an interrupted update" << std::endl;
+    std::cout << std::endl;
     std::cout << "[Get Current DFUT console Version]" << std::endl;
     std::cout << "    --version             : [no argument]         display the version of DFUT console" << std::endl;
     std::cout << std::endl;
@@ -100,6 +104,7 @@ void ParseArguments(int argc, char *argv[], std::unordered_map<char, std::string
                                   {"model-to-flash", required_argument, nullptr, ON_FLASH_MODEL},
                                   {"port", required_argument, nullptr, ON_PORT}, {"type", required_argument, nullptr, ON_TYPE},
                                   {"scpu", required_argument, nullptr, ON_SCPU}, {"ncpu", required_argument, nullptr, ON_NCPU},
+                                  {"sector-diff", no_argument, nullptr, ON_SECTOR_DIFF}, {"journal", required_argument, nullptr, ON_JOURNAL},
                                   {"help", no_argument, nullptr, ON_HELP},
                                   {"version", no_argument, nullptr, ON_VERSION}, {"quiet", no_argument, nullptr, ON_QUIET},
                                   {nullptr, no_argument, nullptr, 0}};
@@ -163,6 +168,12 @@ void ParseArguments(int argc, char *argv[], std::unordered_map<char, std::string
             case ON_NCPU:
                 ArgumentMap[ON_NCPU] = optarg;
                 break;
+            case ON_SECTOR_DIFF:
+                ArgumentMap[ON_SECTOR_DIFF] = "true";
+                break;
+            case ON_JOURNAL:
+                ArgumentMap[ON_JOURNAL] = optarg;
+                break;
             case ON_VERSION:
                 DisplayVersion();
                 exit(0);
@@ -226,6 +226,16 @@ void SplitString(std::string strSource, std::string strSplit,
     }
 }
 
+int SetFlashUpdateMode(kp_device_group_t Devices, std::unordered_map<char, std::string> ArgumentMap)
+{
+    if (true == ArgumentMap[ON_SECTOR_DIFF].empty()) {
+        return kp_set_flash_update_mode(Devices, KP_FLASH_UPDATE_MODE_FULL, nullptr);
+    }
+
+    return kp_set_flash_update_mode(Devices, KP_FLASH_UPDATE_MODE_SECTOR_DIFF,
+                                    ArgumentMap[ON_JOURNAL].empty() ? nullptr : ArgumentMap[ON_JOURNAL].c_str());
+}
+
 kp_device_group_t RebootAndReconnect(kp_device_group_t Devices, int PortId, int *ErrorCode)
 {
     int TryConnectTimes = 0;
@@ -492,6 +502,11 @@ int CheckArgument(std::unordered_map<char, std::string> ArgumentMap)
         }
     }
 
+    if ((false == ArgumentMap[ON_JOURNAL].empty()) && (true == ArgumentMap[ON_SECTOR_DIFF].empty())) {
+        std::cout << "[Error] Journal folder can only be used with sector-diff update." << std::endl;
+        return -1;
+    }
+
     return 0;
 }
 
@@ -937,6 +952,12 @@ int UpdateKl520ToFlashBoot(std::vector<int> PortIdList, std::unordered_map<char,
 
         SLEEP(USB_WAIT_CONNECT_DELAY_MS);
 
+        Ret = SetFlashUpdateMode(Devices, ArgumentMap);
+
+        if (KP_SUCCESS != Ret) {
+            goto FLASH_LOOP_OUT;
+        }
+
         if (true == AUTO_REBOOT) {
             Ret = kp_update_kdp2_firmware_from_files(Devices, ArgumentMap[ON_SCPU].c_str(), ArgumentMap[ON_NCPU].c_str(), true);
         } else {
@@ -954,6 +975,12 @@ int UpdateKl520ToFlashBoot(std::vector<int> PortIdList, std::unordered_map<char,
 
             kp_set_timeout(Devices, 20000); // 20 secs timeout
 
+            Ret = SetFlashUpdateMode(Devices, ArgumentMap);
+
+            if (KP_SUCCESS != Ret) {
+                goto FLASH_LOOP_OUT;
+            }
+
             Ret = kp_update_kdp2_firmware_from_files(Devices, nullptr, ArgumentMap[ON_NCPU].c_str(), false);
 
             if (KP_SUCCESS != Ret) {
@@ -1854,6 +1881,12 @@ int UpdateModelToFlash(std::vector<int> PortIdList, std::unordered_map<char, std
             }
         }
 
+        Ret = SetFlashUpdateMode(Devices, ArgumentMap);
+
+        if (KP_SUCCESS != Ret) {
+            goto MODEL_LOOP_OUT;
+        }
+
         Ret = kp_update_model_from_file(Devices, ArgumentMap[ON_FLASH_MODEL].c_str(), AUTO_REBOOT, NULL);
 
         if (KP_SUCCESS != Ret) {
@@ -90,6 +90,8 @@ typedef enum {
     ON_TYPE,
     ON_SCPU,
     ON_NCPU,
+    ON_SECTOR_DIFF,
+    ON_JOURNAL,
 
     /* Update Cmd */
     ON_UPDATE_CMD_BEGIN,
@@ -122,6 +124,7 @@ bool IsNumber(const std::string& s);
 void SplitString(std::string strSource, std::string strSplit,
                  std::vector<int> &PortIdList);
 kp_device_group_t RebootAndReconnect(kp_device_group_t Devices, int PortId, int *ErrorCode);
+int SetFlashUpdateMode(kp_device_group_t Devices, std::unordered_map<char, std::string> ArgumentMap);
 bool GetResponseFromUser(std::string WarningMessage, std::string ConfirmMessage);
 bool IsDriverInstalled(int DevicePid);
 int InstallDriver(std::unordered_map<char, std::string> ArgumentMap);
@@ -0,0 +1,661 @@
+/**
+ * @file        kp_benchmark.c
+ * @brief       throughput benchmark of the host SDK on simulated devices
+ *
+ * It runs generic image inference with a send thread and a receive thread as the multithread examples do, the receive
+ * thread also retrieves all output nodes in floating point and runs YOLO V3 post-processing on them. Frames per second,
+ * latency percentiles and memory allocations of each stage are reported. With --min-fps or --max-allocs it exits with
+ * an error if the result is worse, so it can guard against regressions on machines without Kneron devices.
+ * With --trace the SDK tracing is enabled, SDK stage latencies are reported and written to a Chrome trace file.
+ *
+ * @version     0.1
+ * @date        2024-05-20
+ *
+ * @copyright   Copyright (c) 2024 Kneron Inc. All rights reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "kp_core.h"
+#include "kp_inference.h"
+#include "kp_trace.h"
+#include "kp_usb_sim.h"
+#include "postprocess.h"
+
+#define MAX_OUTPUT_NODE 8
+#define IMAGE_WIDTH 224
+#define IMAGE_HEIGHT 224
+#define NUM_WARMUP_FRAME 10
+#define YOLO_THRESHOLD 0.2f
+
+enum
+{
+    STAGE_SEND = 0,
+    STAGE_RECEIVE,
+    STAGE_RETRIEVE,
+    STAGE_POST_PROCESS,
+    STAGE_END_TO_END,
+    NUM_STAGE,
+    STAGE_OTHER = NUM_STAGE,    // allocations not made by the benchmark threads, ex. USB event handling
+};
+
+static const char *_stage_names[NUM_STAGE + 1] = {"send", "receive", "retrieve", "post-process", "end-to-end", "other"};
+
+static char _model_file_path[256] = "../../res/models/KL520/ssd_fd_lm/models_520.nef";
+static uint16_t _product_id = KP_DEVICE_KL520;
+static int _num_frame = 300;
+static uint32_t _latency_us = 0;
+static uint32_t _bandwidth_mbps = 0;
+static uint32_t _npu_time_us = 0;
+static double _min_fps = 0;
+static double _max_allocs_per_frame = -1;
+static char *_trace_prefix = NULL;
+static uint32_t _coalesce_kb = 0;
+
+static kp_device_group_t _device;
+static kp_generic_image_inference_desc_t _input_data;
+static uint8_t *_raw_output_buf = NULL;
+static uint32_t _raw_buf_size = 0;
+static kp_inf_float_node_output_t *_float_nodes[MAX_OUTPUT_NODE] = {NULL};
+static uint32_t _float_node_size[MAX_OUTPUT_NODE] = {0};
+static post_process_yolo_workspace_t *_yolo_workspace = NULL;
+static kp_yolo_result_t *_yolo_result = NULL;
+
+static double *_stage_us[NUM_STAGE];
+static double *_send_begin_us;
+static pthread_barrier_t _start_barrier;
+static double _time_spent_us = 0;
+static kp_usb_sim_statistics_t _stats_begin;
+static volatile int _failed = 0;
+
+// tiny YOLO V3 of 224x224 input, 80 classes
+static const kp_usb_sim_output_node_t _yolo_nodes[2] = {
+    {.height = 7, .channel = 255, .width = 7, .radix = 5, .scale = 1.0f},
+    {.height = 14, .channel = 255, .width = 14, .radix = 5, .scale = 1.0f},
+};
+
+// *********************************************************************************************** //
+// allocation counting, malloc family of glibc is wrapped for the whole process
+// *********************************************************************************************** //
+
+static volatile int _count_allocs = 0;
+static uint64_t _num_allocs[NUM_STAGE + 1];
+static __thread int _current_stage = STAGE_OTHER;
+
+static inline void count_alloc(void)
+{
+    if (_count_allocs)
+        __atomic_add_fetch(&_num_allocs[_current_stage], 1, __ATOMIC_RELAXED);
+}
+
+#if defined(__GLIBC__)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    count_alloc();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    count_alloc();
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count_alloc();
+    return __libc_realloc(ptr, size);
+}
+#define ALLOC_COUNTING_SUPPORTED 1
+#else
+#define ALLOC_COUNTING_SUPPORTED 0
+#endif
+
+// *********************************************************************************************** //
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int num, double p)
+{
+    int idx = (int)(p * (num - 1) + 0.5);
+    return sorted[idx];
+}
+
+void print_settings()
+{
+    printf("kp_benchmark\n");
+    printf("\n");
+    printf("  measure frames per second, latency and memory allocations of the host SDK on a simulated device\n");
+    printf("\n");
+    printf("Arguments:\n");
+    printf("-help, h         : print help message\n");
+    printf("-target, t       : (KL520|KL720|KL630), default KL520\n");
+    printf("-model, m        : NEF file of the target, default '%s'\n", _model_file_path);
+    printf("-frames, n       : number of measured frames, default %d\n", _num_frame);
+    printf("-latency, l      : USB transfer latency in microseconds, 0 for the default\n");
+    printf("-bandwidth, b    : USB bandwidth in MB/s, 0 for the default of the link speed\n");
+    printf("-npu, u          : NPU time of one inference in microseconds, 0 for the default of the chip\n");
+    printf("-min-fps         : fail if frames per second is lower than this\n");
+    printf("-max-allocs      : fail if memory allocations per frame are more than this\n");
+    printf("-trace           : enable SDK tracing, write '<arg>.json' (Chrome trace) and '<arg>.hgrm' (latency histograms)\n");
+    printf("-coalesce        : enable result coalescing with transfers up to this size in KB, default 0 (disabled)\n");
+    printf("\n");
+}
+
+bool parse_arguments(int argc, char *argv[])
+{
+    int opt = 0;
+
+    static struct option long_options[] = {
+        {"help",       no_argument,       0, 'h'},
+        {"target",     required_argument, 0, 't'},
+        {"model",      required_argument, 0, 'm'},
+        {"frames",     required_argument, 0, 'n'},
+        {"latency",    required_argument, 0, 'l'},
+        {"bandwidth",  required_argument, 0, 'b'},
+        {"npu",        required_argument, 0, 'u'},
+        {"min-fps",    required_argument, 0, 'F'},
+        {"max-allocs", required_argument, 0, 'A'},
+        {"trace",      required_argument, 0, 'T'},
+        {"coalesce",   required_argument, 0, 'C'},
+        {0, 0, 0, 0}};
+
+    int option_index = 0;
+    bool helper_specified = false;
+
+    while ((opt = getopt_long_only(argc, argv, "ht:m:n:l:b:u:", long_options, &option_index)) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            if (0 == strcasecmp(optarg, "KL520"))
+                _product_id = KP_DEVICE_KL520;
+            else if (0 == strcasecmp(optarg, "KL720"))
+                _product_id = KP_DEVICE_KL720;
+            else if (0 == strcasecmp(optarg, "KL630"))
+                _product_id = KP_DEVICE_KL630;
+            else
+                helper_specified = true;
+            break;
+        case 'm':
+            strncpy(_model_file_path, optarg, sizeof(_model_file_path) - 1);
+            break;
+        case 'n':
+            _num_frame = atoi(optarg);
+            break;
+        case 'l':
+            _latency_us = (uint32_t)atoi(optarg);
+            break;
+        case 'b':
+            _bandwidth_mbps = (uint32_t)atoi(optarg);
+            break;
+        case 'u':
+            _npu_time_us = (uint32_t)atoi(optarg);
+            break;
+        case 'F':
+            _min_fps = atof(optarg);
+            break;
+        case 'A':
+            _max_allocs_per_frame = atof(optarg);
+            break;
+        case 'T':
+            _trace_prefix = optarg;
+            break;
+        case 'C':
+            _coalesce_kb = (uint32_t)atoi(optarg);
+            break;
+        case 'h':
+        case '?':
+        default:
+            helper_specified = true;
+        }
+    }
+
+    if (helper_specified || _num_frame < 1)
+    {
+        print_settings();
+        exit(0);
+    }
+
+    return true;
+}
+
+// *********************************************************************************************** //
+// per-frame stages
+// *********************************************************************************************** //
+
+static int send_frame(void)
+{
+    return kp_generic_image_inference_send(_device, &_input_data);
+}
+
+static int receive_frame(kp_generic_image_inference_result_header_t *output_desc)
+{
+    return kp_generic_image_inference_receive(_device, output_desc, _raw_output_buf, _raw_buf_size);
+}
+
+static int retrieve_frame(kp_generic_image_inference_result_header_t *output_desc)
+{
+    for (uint32_t i = 0; i < output_desc->num_output_node; i++)
+    {
+        int ret = kp_generic_inference_retrieve_float_node_to_buffer(i, _raw_output_buf, KP_CHANNEL_ORDERING_HCW,
+                                                                      _float_nodes[i], _float_node_size[i]);
+        if (KP_SUCCESS != ret)
+            return ret;
+    }
+
+    return KP_SUCCESS;
+}
+
+static int post_process_frame(kp_generic_image_inference_result_header_t *output_desc)
+{
+    return post_process_yolo_v3_with_workspace(_yolo_workspace, _float_nodes, output_desc->num_output_node,
+                                               &output_desc->pre_proc_info[0], YOLO_THRESHOLD, _yolo_result);
+}
+
+// the first frames size buffers of retrieved nodes and the post-process workspace
+static int warm_up(void)
+{
+    kp_generic_image_inference_result_header_t output_desc;
+
+    for (int i = 0; i < NUM_WARMUP_FRAME; i++)
+    {
+        int ret = send_frame();
+        if (KP_SUCCESS == ret)
+            ret = receive_frame(&output_desc);
+
+        if (KP_SUCCESS != ret)
+        {
+            printf("warm-up inference failed, error = %d (%s)\n", ret, kp_error_string(ret));
+            return ret;
+        }
+
+        if (0 == i)
+        {
+            if (output_desc.num_output_node > MAX_OUTPUT_NODE)
+                return KP_ERROR_INVALID_PARAM_12;
+
+            for (uint32_t n = 0; n < output_desc.num_output_node; n++)
+            {
+                kp_generic_inference_get_float_node_size(n, _raw_output_buf, &_float_node_size[n]);
+
+                _float_nodes[n] = (kp_inf_float_node_output_t *)malloc(_float_node_size[n]);
+                if (NULL == _float_nodes[n])
+                    return KP_ERROR_MEMORY_ALLOCATION_FAILURE_9;
+            }
+        }
+
+        ret = retrieve_frame(&output_desc);
+        if (KP_SUCCESS == ret)
+            ret = post_process_frame(&output_desc);
+
+        if (KP_SUCCESS != ret)
+        {
+            printf("warm-up post-processing failed, error = %d\n", ret);
+            return ret;
+        }
+    }
+
+    return KP_SUCCESS;
+}
+
+static void *send_thread(void *data)
+{
+    pthread_barrier_wait(&_start_barrier);
+    pthread_barrier_wait(&_start_barrier);
+
+    _current_stage = STAGE_SEND;
+
+    for (int i = 0; i < _num_frame && !_failed; i++)
+    {
+        double begin = now_us();
+
+        _send_begin_us[i] = begin;
+
+        int ret = send_frame();
+
+        _stage_us[STAGE_SEND][i] = now_us() - begin;
+
+        if (KP_SUCCESS != ret)
+        {
+            printf("kp_generic_image_inference_send() error = %d (%s)\n", ret, kp_error_string(ret));
+            _failed = 1;
+        }
+    }
+
+    _current_stage = STAGE_OTHER;
+
+    return NULL;
+}
+
+static void *receive_thread(void *data)
+{
+    kp_generic_image_inference_result_header_t output_desc;
+
+    pthread_barrier_wait(&_start_barrier);
+    pthread_barrier_wait(&_start_barrier);
+
+    for (int i = 0; i < _num_frame && !_failed; i++)
+    {
+        double t0 = now_us();
+
+        _current_stage = STAGE_RECEIVE;
+        int ret = receive_frame(&output_desc);
+        double t1 = now_us();
+
+        if (KP_SUCCESS == ret)
+        {
+            _current_stage = STAGE_RETRIEVE;
+            ret = retrieve_frame(&output_desc);
+        }
+        double t2 = now_us();
+
+        if (KP_SUCCESS == ret)
+        {
+            _current_stage = STAGE_POST_PROCESS;
+            ret = post_process_frame(&output_desc);
+        }
+        double t3 = now_us();
+
+        _current_stage = STAGE_OTHER;
+
+        if (KP_SUCCESS != ret)
+        {
+            printf("frame %d failed, error = %d (%s)\n", i, ret, kp_error_string(ret));
+            _failed = 1;
+            break;
+        }
+
+        _stage_us[STAGE_RECEIVE][i] = t1 - t0;
+        _stage_us[STAGE_RETRIEVE][i] = t2 - t1;
+        _stage_us[STAGE_POST_PROCESS][i] = t3 - t2;
+        _stage_us[STAGE_END_TO_END][i] = t3 - _send_begin_us[i];
+    }
+
+    return NULL;
+}
+
+static uint64_t total_allocations(void)
+{
+    uint64_t total = 0;
+
+    for (int s = 0; s <= NUM_STAGE; s++)
+        total += _num_allocs[s];
+
+    return total;
+}
+
+static void print_report(double time_spent_us, uint32_t port_id)
+{
+    double fps = _num_frame / (time_spent_us / 1000000.0);
+
+    printf("\n%-14s %10s %10s %10s %10s %14s\n", "stage", "mean(ms)", "p50(ms)", "p90(ms)", "p99(ms)", "allocs/frame");
+
+    for (int s = 0; s < NUM_STAGE; s++)
+    {
+        double sum = 0;
+
+        for (int i = 0; i < _num_frame; i++)
+            sum += _stage_us[s][i];
+
+        qsort(_stage_us[s], _num_frame, sizeof(double), compare_double);
+
+        printf("%-14s %10.3f %10.3f %10.3f %10.3f", _stage_names[s], sum / _num_frame / 1000,
+               percentile(_stage_us[s], _num_frame, 0.5) / 1000, percentile(_stage_us[s], _num_frame, 0.9) / 1000,
+               percentile(_stage_us[s], _num_frame, 0.99) / 1000);
+
+        if (STAGE_END_TO_END != s)
+            printf(" %14.2f\n", (double)_num_allocs[s] / _num_frame);
+        else
+            printf(" %14s\n", "-");
+    }
+
+    printf("%-14s %10s %10s %10s %10s %14.2f\n", _stage_names[STAGE_OTHER], "-", "-", "-", "-", (double)_num_allocs[STAGE_OTHER] / _num_frame);
+
+    kp_usb_sim_statistics_t stats;
+
+    // exclude warm-up frames
+    if (0 == kp_usb_sim_get_statistics(port_id, &stats))
+    {
+        printf("\ndevice: %u inferences, %u dropped, %u coalesced, NPU busy %.1f%%, USB out %.1f MB/s, in %.1f MB/s\n",
+               stats.num_inference - _stats_begin.num_inference, stats.num_dropped - _stats_begin.num_dropped,
+               stats.num_coalesced - _stats_begin.num_coalesced, (stats.npu_busy_us - _stats_begin.npu_busy_us) * 100.0 / time_spent_us,
+               (stats.bytes_out - _stats_begin.bytes_out) / time_spent_us, (stats.bytes_in - _stats_begin.bytes_in) / time_spent_us);
+    }
+
+    printf("\ntotal %d frames in %.3f secs, FPS = %.1f", _num_frame, time_spent_us / 1000000.0, fps);
+
+    if (ALLOC_COUNTING_SUPPORTED)
+        printf(", allocations per frame = %.2f\n", (double)total_allocations() / _num_frame);
+    else
+        printf(", allocations are not counted on this platform\n");
+}
+
+static void print_trace_report(void)
+{
+    char file_path[512];
+
+    printf("\n%-18s %8s %10s %10s %10s %10s %10s\n", "SDK stage", "calls", "mean(us)", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+
+    for (int s = 0; s < KP_TRACE_NUM_STAGE; s++)
+    {
+        kp_trace_latency_stats_t stats;
+
+        if (KP_SUCCESS != kp_trace_get_latency_stats((kp_trace_stage_t)s, &stats) || 0 == stats.count)
+            continue;
+
+        printf("%-18s %8llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", kp_trace_stage_name((kp_trace_stage_t)s),
+               (unsigned long long)stats.count, stats.mean_us, stats.p50_us, stats.p99_us, stats.p999_us, stats.max_us);
+    }
+
+    snprintf(file_path, sizeof(file_path), "%s.json", _trace_prefix);
+    printf("\nChrome trace ... %s\n", (KP_SUCCESS == kp_trace_dump_chrome_trace(file_path)) ? file_path : "failed");
+
+    snprintf(file_path, sizeof(file_path), "%s.hgrm", _trace_prefix);
+    printf("latency histograms ... %s\n", (KP_SUCCESS == kp_trace_dump_histograms(file_path)) ? file_path : "failed");
+}
+
+int main(int argc, char *argv[])
+{
+    parse_arguments(argc, argv);
+
+    /******* add a simulated device *******/
+    kp_usb_sim_device_config_t sim_config = {0};
+
+    sim_config.product_id = _product_id;
+    sim_config.latency_us = _latency_us;
+    sim_config.bandwidth_mbps = _bandwidth_mbps;
+    sim_config.npu_time_us = _npu_time_us;
+
+    int port_id = kp_usb_sim_add_device(&sim_config);
+    if (port_id <= 0)
+    {
+        printf("add simulated device failed, error = %d\n", port_id);
+        return -1;
+    }
+
+    kp_usb_sim_set_output_nodes(2, _yolo_nodes);
+
+    /******* connect the device *******/
+    int error_code;
+    _device = kp_connect_devices(1, &port_id, &error_code);
+    printf("connect device ... %s\n", (_device) ? "OK" : "failed");
+
+    if (NULL == _device)
+        return -1;
+
+    kp_set_timeout(_device, 5000);
+
+    /******* upload model to device *******/
+    kp_model_nef_descriptor_t model_desc;
+    int ret = kp_load_model_from_file(_device, _model_file_path, &model_desc);
+    printf("upload model ... %s\n", (ret == KP_SUCCESS) ? "OK" : "failed");
+
+    if (KP_SUCCESS != ret)
+    {
+        printf("error = %d (%s)\n", ret, kp_error_string(ret));
+        kp_disconnect_devices(_device);
+        return -1;
+    }
+
+    if (0 < _coalesce_kb)
+    {
+        ret = kp_inference_set_result_coalescing(_device, _coalesce_kb * 1024);
+        printf("enable result coalescing ... %s\n", (ret == KP_SUCCESS) ? "OK" : "failed");
+
+        if (KP_SUCCESS != ret)
+        {
+            printf("error = %d (%s)\n", ret, kp_error_string(ret));
+            kp_disconnect_devices(_device);
+            return -1;
+        }
+    }
+
+    /******* prepare buffers *******/
+    _raw_buf_size = kp_usb_sim_get_result_size(_product_id, 2, _yolo_nodes);
+    if (model_desc.models[0].max_raw_out_size > _raw_buf_size)
+        _raw_buf_size = model_desc.models[0].max_raw_out_size;
+
+    _raw_output_buf = (uint8_t *)malloc(_raw_buf_size);
+    _yolo_workspace = post_process_yolo_create_workspace();
+    _yolo_result = (kp_yolo_result_t *)malloc(sizeof(kp_yolo_result_t));
+    _send_begin_us = (double *)malloc(_num_frame * sizeof(double));
+
+    // synthetic RGB565 image
+    uint16_t *img_buf = (uint16_t *)malloc(IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(uint16_t));
+
+    bool buf_ok = (NULL != _raw_output_buf) && (NULL != _yolo_workspace) && (NULL != _yolo_result) &&
+                  (NULL != _send_begin_us) && (NULL != img_buf);
+
+    for (int s = 0; s < NUM_STAGE; s++)
+    {
+        _stage_us[s] = (double *)calloc(_num_frame, sizeof(double));
+        buf_ok = buf_ok && (NULL != _stage_us[s]);
+    }
+
+    if (!buf_ok)
+    {
+        printf("out of memory\n");
+        return -1;
+    }
+
+    for (int i = 0; i < IMAGE_WIDTH * IMAGE_HEIGHT; i++)
+        img_buf[i] = (uint16_t)(i * 2654435761u >> 16);
+
+    _input_data.model_id = model_desc.models[0].id;
+    _input_data.inference_number = 0;
+    _input_data.num_input_node_image = 1;
+
+    _input_data.input_node_image_list[0].resize_mode = KP_RESIZE_ENABLE;
+    _input_data.input_node_image_list[0].padding_mode = KP_PADDING_CORNER;
+    _input_data.input_node_image_list[0].normalize_mode = KP_NORMALIZE_KNERON;
+    _input_data.input_node_image_list[0].image_format = KP_IMAGE_FORMAT_RGB565;
+    _input_data.input_node_image_list[0].width = IMAGE_WIDTH;
+    _input_data.input_node_image_list[0].height = IMAGE_HEIGHT;
+    _input_data.input_node_image_list[0].crop_count = 0;
+    _input_data.input_node_image_list[0].image_buffer = (uint8_t *)img_buf;
+
+    /******* run *******/
+    if (NULL != _trace_prefix)
+        kp_trace_enable(true);
+
+    ret = warm_up();
+
+    if (KP_SUCCESS == ret)
+    {
+        pthread_t send_thd, recv_thd;
+
+        printf("\nrunning %d frames on simulated %s ...\n", _num_frame,
+               (KP_DEVICE_KL520 == _product_id) ? "KL520" : (KP_DEVICE_KL720 == _product_id) ? "KL720" : "KL630");
+
+        kp_usb_sim_get_statistics((uint32_t)port_id, &_stats_begin);
+        kp_trace_reset();
+
+        pthread_barrier_init(&_start_barrier, NULL, 3);
+        pthread_create(&send_thd, NULL, send_thread, NULL);
+        pthread_create(&recv_thd, NULL, receive_thread, NULL);
+
+        // thread creation is not counted, both threads start together
+        pthread_barrier_wait(&_start_barrier);
+        _count_allocs = 1;
+        double begin = now_us();
+        pthread_barrier_wait(&_start_barrier);
+
+        pthread_join(send_thd, NULL);
+        pthread_join(recv_thd, NULL);
+
+        _time_spent_us = now_us() - begin;
+        _count_allocs = 0;
+
+        kp_trace_enable(false);
+
+        pthread_barrier_destroy(&_start_barrier);
+
+        if (_failed)
+            ret = KP_ERROR_OTHER_99;
+        else
+            print_report(_time_spent_us, (uint32_t)port_id);
+
+        if (!_failed && NULL != _trace_prefix)
+            print_trace_report();
+    }
+
+    kp_release_model_nef_descriptor(&model_desc);
+    kp_disconnect_devices(_device);
+
+    /******* check thresholds *******/
+    if (KP_SUCCESS == ret)
+    {
+        double fps = _num_frame / (_time_spent_us / 1000000.0);
+        double allocs_per_frame = (double)total_allocations() / _num_frame;
+
+        if (_min_fps > 0 && fps < _min_fps)
+        {
+            printf("[FAILED] FPS %.1f < %.1f\n", fps, _min_fps);
+            ret = KP_ERROR_OTHER_99;
+        }
+
+        if (_max_allocs_per_frame >= 0 && ALLOC_COUNTING_SUPPORTED && allocs_per_frame > _max_allocs_per_frame)
+        {
+            printf("[FAILED] allocations per frame %.2f > %.2f\n", allocs_per_frame, _max_allocs_per_frame);
+            ret = KP_ERROR_OTHER_99;
+        }
+    }
+
+    for (int n = 0; n < MAX_OUTPUT_NODE; n++)
+        free(_float_nodes[n]);
+
+    for (int s = 0; s < NUM_STAGE; s++)
+        free(_stage_us[s]);
+
+    post_process_yolo_release_workspace(_yolo_workspace);
+    free(_yolo_result);
+    free(_raw_output_buf);
+    free(_send_begin_us);
+    free(img_buf);
+
+    return (KP_SUCCESS == ret) ? 0 : -1;
+}